@@ -5,6 +5,7 @@
 
 #include <QApplication>
 #include <QScreen>
+#include <QStyleOptionGraphicsItem>
 #include <QStyle>
 #include <QDesktopServices>
 #include <QUrl>
@@ -264,9 +265,403 @@ QString Logger::getCurrentTimestamp() const {
     return QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss.zzz");
 }
 
+// WireProtocol implementation (mirrors the server)
+QByteArray WireProtocol::encode(const QJsonObject& message, bool compress)
+{
+    MessageType type = static_cast<MessageType>(message["type"].toInt());
+    
+    QByteArray payload;
+    Encoding encoding = Encoding::PACKED;
+    if (!encodePacked(type, message, payload)) {
+        encoding = Encoding::CBOR;
+        
+        QJsonObject fields = message;
+        fields.remove("type");
+        if (type == MessageType::GAME_STATE && fields["gameState"].toObject().contains("board")) {
+            // The board is 64 small objects in JSON; send the placement instead
+            QJsonObject gameState = fields["gameState"].toObject();
+            gameState["board"] = packBoard(gameState["board"].toArray());
+            gameState.remove("asciiBoard");
+            fields["gameState"] = gameState;
+        }
+        payload = QCborMap::fromJsonObject(fields).toCborValue().toCbor();
+        
+        if (compress && payload.size() >= COMPRESSION_THRESHOLD) {
+            QByteArray compressed = qCompress(payload);
+            if (compressed.size() < payload.size()) {
+                payload = compressed;
+                encoding = Encoding::COMPRESSED_CBOR;
+            }
+        }
+    }
+    
+    QByteArray frame;
+    frame.reserve(HEADER_SIZE + payload.size());
+    frame.resize(4);
+    qToBigEndian<quint32>(static_cast<quint32>(2 + payload.size()), frame.data());
+    frame.append(static_cast<char>(type));
+    frame.append(static_cast<char>(encoding));
+    frame.append(payload);
+    return frame;
+}
+
+qsizetype WireProtocol::frameSize(const char* data, qsizetype available)
+{
+    if (available < 4) {
+        return 0;
+    }
+    
+    quint32 size = qFromBigEndian<quint32>(data);
+    if (size < 2 || size > MAX_FRAME_SIZE) {
+        return -1;
+    }
+    return 4 + static_cast<qsizetype>(size);
+}
+
+bool WireProtocol::decode(const char* frame, qsizetype size, QJsonObject& message)
+{
+    if (size < HEADER_SIZE || frameSize(frame, size) != size) {
+        return false;
+    }
+    
+    MessageType type = static_cast<MessageType>(static_cast<quint8>(frame[4]));
+    Encoding encoding = static_cast<Encoding>(static_cast<quint8>(frame[5]));
+    const char* payload = frame + HEADER_SIZE;
+    qsizetype payloadSize = size - HEADER_SIZE;
+    
+    if (encoding == Encoding::PACKED) {
+        message = QJsonObject();
+        if (!decodePacked(type, payload, payloadSize, message)) {
+            return false;
+        }
+    } else if (encoding == Encoding::CBOR || encoding == Encoding::COMPRESSED_CBOR) {
+        QByteArray cbor = QByteArray::fromRawData(payload, payloadSize);
+        if (encoding == Encoding::COMPRESSED_CBOR) {
+            // qCompress() output starts with the expanded size; refuse anything oversized
+            if (payloadSize < 4 || qFromBigEndian<quint32>(payload) > MAX_UNCOMPRESSED_SIZE) {
+                return false;
+            }
+            cbor = qUncompress(cbor);
+            if (cbor.isEmpty()) {
+                return false;
+            }
+        }
+        
+        QCborValue value = QCborValue::fromCbor(cbor);
+        if (!value.isMap()) {
+            return false;
+        }
+        message = value.toMap().toJsonObject();
+        if (type == MessageType::GAME_STATE && message["gameState"].toObject()["board"].isString()) {
+            QJsonObject gameState = message["gameState"].toObject();
+            gameState["board"] = unpackBoard(gameState["board"].toString());
+            message["gameState"] = gameState;
+        }
+    } else {
+        return false;
+    }
+    
+    message["type"] = static_cast<int>(type);
+    return true;
+}
+
+bool WireProtocol::encodePacked(MessageType type, const QJsonObject& message, QByteArray& payload)
+{
+    if (type == MessageType::MOVE) {
+        // uint8 gameId length, gameId, uint16 move
+        QByteArray gameId = message["gameId"].toString().toUtf8();
+        quint16 move;
+        if (message.size() != 3 || gameId.size() > 255 || !packMove(message["move"].toString(), move)) {
+            return false;
+        }
+        
+        payload.resize(1 + gameId.size() + 2);
+        payload[0] = static_cast<char>(gameId.size());
+        std::memcpy(payload.data() + 1, gameId.constData(), gameId.size());
+        qToBigEndian<quint16>(move, payload.data() + 1 + gameId.size());
+        return true;
+    }
+    
+    if (type == MessageType::MOVE_RESULT) {
+        // uint8 success, then the optional message text
+        bool hasText = message.contains("message");
+        if (message.size() != (hasText ? 3 : 2) || !message["success"].isBool()) {
+            return false;
+        }
+        
+        payload.append(static_cast<char>(message["success"].toBool() ? 1 : 0));
+        if (hasText) {
+            payload.append(message["message"].toString().toUtf8());
+        }
+        return true;
+    }
+    
+    return false;
+}
+
+bool WireProtocol::decodePacked(MessageType type, const char* payload, qsizetype size, QJsonObject& message)
+{
+    if (type == MessageType::MOVE) {
+        if (size < 1) return false;
+        int gameIdLength = static_cast<quint8>(payload[0]);
+        if (size != 1 + gameIdLength + 2) return false;
+        
+        message["gameId"] = QString::fromUtf8(payload + 1, gameIdLength);
+        message["move"] = unpackMove(qFromBigEndian<quint16>(payload + 1 + gameIdLength));
+        return true;
+    }
+    
+    if (type == MessageType::MOVE_RESULT) {
+        if (size < 1) return false;
+        message["success"] = payload[0] != 0;
+        if (size > 1) {
+            message["message"] = QString::fromUtf8(payload + 1, size - 1);
+        }
+        return true;
+    }
+    
+    return false;
+}
+
+bool WireProtocol::packMove(const QString& move, quint16& packed)
+{
+    static const char promotions[] = "qrbn";
+    
+    QByteArray text = move.toLatin1();
+    if (text.size() != 4 && text.size() != 5) return false;
+    
+    int squares[2];
+    for (int i = 0; i < 2; ++i) {
+        int col = text[i * 2] - 'a';
+        int row = text[i * 2 + 1] - '1';
+        if (col < 0 || col > 7 || row < 0 || row > 7) return false;
+        squares[i] = row * 8 + col;
+    }
+    
+    int promotion = 0;
+    if (text.size() == 5) {
+        const char* found = std::strchr(promotions, text[4]);
+        if (!found || !*found) return false;
+        promotion = static_cast<int>(found - promotions) + 1;
+    }
+    
+    packed = static_cast<quint16>(squares[0] | (squares[1] << 6) | (promotion << 12));
+    return true;
+}
+
+QString WireProtocol::unpackMove(quint16 packed)
+{
+    static const char promotions[] = "qrbn";
+    
+    std::string text;
+    for (int sq : { packed & 0x3F, (packed >> 6) & 0x3F }) {
+        text += static_cast<char>('a' + sq % 8);
+        text += static_cast<char>('1' + sq / 8);
+    }
+    
+    int promotion = (packed >> 12) & 0x7;
+    if (promotion >= 1 && promotion <= 4) {
+        text += promotions[promotion - 1];
+    }
+    return QString::fromStdString(text);
+}
+
+QString WireProtocol::packBoard(const QJsonArray& board)
+{
+    std::string placement(64, '.');
+    for (int r = 0; r < 8 && r < board.size(); ++r) {
+        QJsonArray row = board[r].toArray();
+        for (int c = 0; c < 8 && c < row.size(); ++c) {
+            QJsonObject piece = row[c].toObject();
+            QString type = piece["type"].toString();
+            
+            char symbol = '.';
+            if (type == "pawn") symbol = 'p';
+            else if (type == "knight") symbol = 'n';
+            else if (type == "bishop") symbol = 'b';
+            else if (type == "rook") symbol = 'r';
+            else if (type == "queen") symbol = 'q';
+            else if (type == "king") symbol = 'k';
+            
+            if (symbol != '.' && piece["color"].toString() == "white") {
+                symbol = static_cast<char>(std::toupper(symbol));
+            }
+            placement[r * 8 + c] = symbol;
+        }
+    }
+    return QString::fromStdString(placement);
+}
+
+QJsonArray WireProtocol::unpackBoard(const QString& placement)
+{
+    std::string text = placement.toStdString();
+    text.resize(64, '.');
+    
+    QJsonArray board;
+    for (int r = 0; r < 8; ++r) {
+        QJsonArray row;
+        for (int c = 0; c < 8; ++c) {
+            char symbol = text[r * 8 + c];
+            QJsonObject piece;
+            
+            switch (std::tolower(static_cast<unsigned char>(symbol))) {
+                case 'p': piece["type"] = "pawn"; break;
+                case 'n': piece["type"] = "knight"; break;
+                case 'b': piece["type"] = "bishop"; break;
+                case 'r': piece["type"] = "rook"; break;
+                case 'q': piece["type"] = "queen"; break;
+                case 'k': piece["type"] = "king"; break;
+                default:  piece["type"] = "empty"; break;
+            }
+            
+            if (piece["type"].toString() == "empty") {
+                piece["color"] = "none";
+            } else {
+                piece["color"] = std::isupper(static_cast<unsigned char>(symbol)) ? "white" : "black";
+            }
+            row.append(piece);
+        }
+        board.append(row);
+    }
+    return board;
+}
+
+// MessageFramer implementation (mirrors the server)
+void MessageFramer::readFrom(QIODevice* device)
+{
+    // Drop consumed bytes before growing the buffer, so it stays bounded by the unread input
+    if (readOffset > 0) {
+        buffer.remove(0, readOffset);
+        if (scanOffset >= 0) {
+            scanOffset -= readOffset;
+        }
+        readOffset = 0;
+    }
+    
+    qint64 available = device->bytesAvailable();
+    if (available <= 0) {
+        return;
+    }
+    
+    qsizetype oldSize = buffer.size();
+    buffer.resize(oldSize + available);
+    qint64 bytesRead = device->read(buffer.data() + oldSize, available);
+    buffer.resize(oldSize + std::max<qint64>(0, bytesRead));
+}
+
+MessageFramer::Status MessageFramer::next(QJsonObject& message, QString& error)
+{
+    // Skip the newlines between compact JSON messages
+    while (readOffset < buffer.size() && std::isspace(static_cast<unsigned char>(buffer[readOffset]))) {
+        ++readOffset;
+    }
+    if (readOffset >= buffer.size()) {
+        return Status::INCOMPLETE;
+    }
+    
+    const char* start = buffer.constData() + readOffset;
+    qsizetype available = buffer.size() - readOffset;
+    
+    // A zero byte starts a binary frame
+    if (*start == '\0') {
+        qsizetype frameSize = WireProtocol::frameSize(start, available);
+        if (frameSize < 0) {
+            error = QString("binary frame exceeds %1 bytes").arg(WireProtocol::MAX_FRAME_SIZE);
+            return Status::FATAL;
+        }
+        if (frameSize == 0 || frameSize > available) {
+            return Status::INCOMPLETE;
+        }
+        
+        bool decoded = WireProtocol::decode(start, frameSize, message);
+        consume(frameSize);
+        if (!decoded) {
+            error = "malformed binary frame";
+            return Status::INVALID;
+        }
+        return Status::MESSAGE;
+    }
+    
+    if (*start != '{') {
+        error = QString("unexpected byte %1 between messages").arg(static_cast<unsigned char>(*start));
+        return Status::FATAL;
+    }
+    
+    qsizetype end = scanJsonObject();
+    if (end < 0) {
+        if (available > static_cast<qsizetype>(WireProtocol::MAX_FRAME_SIZE)) {
+            error = QString("JSON message exceeds %1 bytes").arg(WireProtocol::MAX_FRAME_SIZE);
+            return Status::FATAL;
+        }
+        return Status::INCOMPLETE;
+    }
+    
+    // Parse in place; fromRawData does not copy the bytes
+    qsizetype length = end - readOffset;
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(start, length), &parseError);
+    consume(length);
+    
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        error = "invalid JSON: " + parseError.errorString();
+        return Status::INVALID;
+    }
+    
+    message = doc.object();
+    return Status::MESSAGE;
+}
+
+void MessageFramer::reset()
+{
+    buffer.clear();
+    readOffset = 0;
+    resetScan();
+}
+
+void MessageFramer::consume(qsizetype bytes)
+{
+    readOffset += bytes;
+    resetScan();
+}
+
+qsizetype MessageFramer::scanJsonObject()
+{
+    // Resume where the last call stopped instead of rescanning the partial message
+    if (scanOffset < 0) {
+        scanOffset = readOffset;
+    }
+    
+    const char* data = buffer.constData();
+    for (; scanOffset < buffer.size(); ++scanOffset) {
+        char c = data[scanOffset];
+        
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                return ++scanOffset;
+            }
+        }
+    }
+    
+    return -1;
+}
+
 // NetworkManager implementation
 NetworkManager::NetworkManager(Logger* logger, QObject* parent)
-    : QObject(parent), logger(logger), socket(nullptr), pingTimer(nullptr)
+    : QObject(parent), logger(logger), socket(nullptr), pingTimer(nullptr), binaryProtocol(false),
+      redirecting(false), resendMatchmaking(false), resumeSequence(-1), serverPort(0), closingConnection(false),
+      reconnecting(false), reconnectAttempts(0)
 {    
     try {
         if (!logger) {
@@ -337,7 +732,10 @@ bool NetworkManager::connectToServer(const QString& host, int port)
         logger->info(QString("Connecting to server at %1:%2").arg(host).arg(port));
         
         // Clear any existing buffer data
-        buffer.clear();
+        framer.reset();
+        serverHost = host;
+        serverPort = port;
+        closingConnection = false;
         
         // Connect to host
         socket->connectToHost(host, port);
@@ -373,6 +771,8 @@ void NetworkManager::disconnectFromServer()
         }
         
         logger->info("Disconnecting from server");
+        closingConnection = true;
+        sessionToken.clear();
         socket->disconnectFromHost();
         
         if (pingTimer && pingTimer->isActive()) {
@@ -407,6 +807,22 @@ void NetworkManager::authenticate(const QString& username, const QString& passwo
         message["username"] = username;
         message["password"] = password;
         message["register"] = isRegistration;
+        message["protocol"] = WireProtocol::PROTOCOL_NAME;  // Servers that don't know it keep using JSON
+        message["compression"] = WireProtocol::COMPRESSION_NAME;  // decode() expands COMPRESSED_CBOR frames
+        message["stateDelta"] = true;  // GameManager applies GAME_STATE_DELTA after moves
+        message["redirected"] = redirecting;  // The node we were sent to keeps us
+        
+        // The token resumes the session, and the sequence tells the server what we already have
+        if (!sessionToken.isEmpty() && username == authUsername && !isRegistration) {
+            message["sessionToken"] = sessionToken;
+            if (!resumeGameId.isEmpty()) {
+                message["gameId"] = resumeGameId;
+                message["lastSequence"] = resumeSequence;
+            }
+        }
+        
+        authUsername = username;
+        authPassword = password;
         
         logger->info(QString("%1 attempt for user: %2")
                     .arg(isRegistration ? "Registration" : "Authentication")
@@ -447,6 +863,9 @@ void NetworkManager::requestMatchmaking(bool join, TimeControlType timeControl)
             case TimeControlType::CASUAL:    timeControlStr = "casual"; break;
         }
         message["timeControl"] = timeControlStr;
+        matchmakingRequest = message;
+    } else {
+        matchmakingRequest = QJsonObject();
     }
     
     sendMessage(message);
@@ -454,12 +873,16 @@ void NetworkManager::requestMatchmaking(bool join, TimeControlType timeControl)
                 .arg(join ? "Joining" : "Leaving"));
 }
 
-void NetworkManager::requestGameHistory() {
+void NetworkManager::requestGameHistory(qint64 cursor, int limit) {
     QJsonObject message;
     message["type"] = static_cast<int>(MessageType::GAME_HISTORY_REQUEST);
+    message["limit"] = limit;
+    if (cursor > 0) {
+        message["cursor"] = cursor;
+    }
     
     sendMessage(message);
-    logger->info("Requesting game history");
+    logger->info(cursor > 0 ? "Requesting older game history" : "Requesting game history");
 }
 
 void NetworkManager::requestGameAnalysis(const QString& gameId) {
@@ -513,6 +936,15 @@ void NetworkManager::requestLeaderboard(bool allPlayers, int count) {
                 .arg(allPlayers ? "all players" : QString("top %1").arg(count)));
 }
 
+void NetworkManager::requestGameState(const QString& gameId) {
+    QJsonObject message;
+    message["type"] = static_cast<int>(MessageType::GAME_STATE_REQUEST);
+    message["gameId"] = gameId;
+    
+    sendMessage(message);
+    logger->info(QString("Requesting full game state for game: %1").arg(gameId));
+}
+
 void NetworkManager::sendPing() {
     QJsonObject message;
     message["type"] = static_cast<int>(MessageType::PING);
@@ -537,6 +969,11 @@ void NetworkManager::onConnected() {
             logger->warning("Ping timer is null in onConnected");
         }
         
+        // A redirect or reconnect logs in again by itself, without asking the user
+        if (redirecting || reconnecting) {
+            return;
+        }
+        
         // Use QueuedConnection to avoid potential issues with signal-slot execution order
         QMetaObject::invokeMethod(this, "emitConnectedSignal", Qt::QueuedConnection);
     } catch (const std::exception& e) {
@@ -564,8 +1001,22 @@ void NetworkManager::onDisconnected()
             pingTimer->stop();
         }
         
-        // Clear buffer
-        buffer.clear();
+        // Clear buffer; the next connection negotiates its protocol again
+        framer.reset();
+        binaryProtocol = false;
+        
+        // Leaving a node we were redirected from is not a disconnection
+        if (redirecting || reconnecting) {
+            return;
+        }
+        
+        // A connection the server or the network dropped is retried before the UI hears of it
+        if (!closingConnection && !sessionToken.isEmpty() && !serverHost.isEmpty()) {
+            logger->info("Connection lost, trying to reconnect");
+            reconnectAttempts = 0;
+            QTimer::singleShot(RECONNECT_DELAY_MS, this, &NetworkManager::attemptReconnect);
+            return;
+        }
         
         emit disconnected();
     } catch (const std::exception& e) {
@@ -588,11 +1039,53 @@ void NetworkManager::emitConnectedSignal()
     }
 }
 
+void NetworkManager::attemptReconnect()
+{
+    if (closingConnection || isConnected()) {
+        return;
+    }
+    
+    ++reconnectAttempts;
+    logger->info(QString("Reconnect attempt %1 of %2").arg(reconnectAttempts).arg(RECONNECT_ATTEMPTS));
+    
+    reconnecting = true;
+    bool reconnected = connectToServer(serverHost, serverPort);
+    if (reconnected) {
+        authenticate(authUsername, authPassword, false);
+    }
+    reconnecting = false;
+    
+    if (reconnected) {
+        return;
+    }
+    
+    if (reconnectAttempts < RECONNECT_ATTEMPTS) {
+        QTimer::singleShot(RECONNECT_DELAY_MS, this, &NetworkManager::attemptReconnect);
+    } else {
+        sessionToken.clear();
+        emit disconnected();
+        emit connectionError("Lost the connection to the server");
+    }
+}
+
+void NetworkManager::setResumePoint(const QString& gameId, qint64 sequence)
+{
+    resumeGameId = gameId;
+    resumeSequence = sequence;
+}
+
 void NetworkManager::onError(QAbstractSocket::SocketError socketError) {
     try {
         QString errorMessage = socket ? socket->errorString() : "Unknown socket error";
         logger->error(QString("Socket error: %1 (code: %2)").arg(errorMessage).arg(socketError));
         
+        // Failed reconnect attempts and the drop that starts them are reported once, at the end
+        bool willReconnect = !closingConnection && !sessionToken.isEmpty() &&
+                             socketError == QAbstractSocket::RemoteHostClosedError;
+        if (reconnecting || willReconnect) {
+            return;
+        }
+        
         emit connectionError(errorMessage);
     } catch (const std::exception& e) {
         logger->error(QString("Exception in onError(): %1").arg(e.what()));
@@ -608,17 +1101,17 @@ void NetworkManager::onReadyRead() {
             return;
         }
         
-        // Read all available data
-        QByteArray newData = socket->readAll();
-        if (newData.isEmpty()) {
+        // Read straight into the framer's buffer, after whatever partial message it holds
+        qsizetype before = framer.bufferedBytes();
+        framer.readFrom(socket);
+        if (framer.bufferedBytes() == before) {
             logger->warning("onReadyRead called but no data available");
             return;
         }
         
-        logger->debug(QString("Received %1 bytes of data").arg(newData.size()));
-        buffer.append(newData);
+        logger->debug(QString("Received %1 bytes of data").arg(framer.bufferedBytes() - before));
         
-        // Process complete JSON messages
+        // Process complete messages
         processBuffer();
     } catch (const std::exception& e) {
         logger->error(QString("Exception in onReadyRead(): %1").arg(e.what()));
@@ -627,87 +1120,38 @@ void NetworkManager::onReadyRead() {
     }
 }
 
-// To process the buffer and extract complete JSON messages
+// Dispatch every complete message in the buffer, in arrival order
 void NetworkManager::processBuffer()
 {
     try {
-        while (!buffer.isEmpty()) {
-            // Try to parse the current buffer content
-            QJsonParseError parseError;
-            QJsonDocument doc = QJsonDocument::fromJson(buffer, &parseError);
-            
-            if (parseError.error == QJsonParseError::NoError) {
-                // Successfully parsed a complete JSON message
-                if (doc.isObject()) {
-                    logger->debug("Processing complete JSON message");
-                    
-                    // Process the message in a queued connection to prevent recursion
-                    QJsonObject msgObj = doc.object();
-                    QMetaObject::invokeMethod(this, [this, msgObj]() {
-                        processMessage(msgObj);
-                    }, Qt::QueuedConnection);
-                } else {
-                    logger->warning("Received JSON is not an object");
-                }
-                
-                // Clear the buffer
-                buffer.clear();
-            } else if (parseError.error == QJsonParseError::DocumentTooLarge) {
-                // Message is too large, discard the buffer
-                logger->error("JSON document too large, discarding buffer");
-                buffer.clear();
-            } else if (parseError.error == QJsonParseError::GarbageAtEnd || 
-                      parseError.error == QJsonParseError::IllegalValue) {
-                // Try to find a valid JSON object in the buffer
-                int braceCount = 0;
-                int startPos = buffer.indexOf('{');
-                bool foundValidJson = false;
-                
-                if (startPos >= 0) {
-                    for (int i = startPos; i < buffer.size(); i++) {
-                        if (buffer[i] == '{') braceCount++;
-                        else if (buffer[i] == '}') braceCount--;
-                        
-                        if (braceCount == 0 && i > startPos) {
-                            // Found a potential complete JSON object
-                            QByteArray jsonData = buffer.mid(startPos, i - startPos + 1);
-                            QJsonParseError testError;
-                            QJsonDocument testDoc = QJsonDocument::fromJson(jsonData, &testError);
-                            
-                            if (testError.error == QJsonParseError::NoError && testDoc.isObject()) {
-                                logger->debug("Found valid JSON object in buffer");
-                                
-                                // Process the message in a queued connection
-                                QJsonObject msgObj = testDoc.object();
-                                QMetaObject::invokeMethod(this, [this, msgObj]() {
-                                    processMessage(msgObj);
-                                }, Qt::QueuedConnection);
-                                
-                                buffer.remove(0, i + 1);
-                                foundValidJson = true;
-                                break;
-                            }
-                        }
-                    }
-                }
-                
-                // If we couldn't find a valid JSON object, discard the buffer
-                if (!foundValidJson && !buffer.isEmpty()) {
-                    logger->warning(QString("Could not extract valid JSON from buffer, discarding %1 bytes").arg(buffer.size()));
-                    buffer.clear();
-                }
-            } else {
-                // Probably an incomplete message, wait for more data
-                logger->debug(QString("Incomplete JSON message: %1").arg(parseError.errorString()));
+        QJsonObject message;
+        QString error;
+        while (true) {
+            MessageFramer::Status status = framer.next(message, error);
+            if (status == MessageFramer::Status::INCOMPLETE) {
+                break;
+            }
+            if (status == MessageFramer::Status::INVALID) {
+                logger->warning("Skipping message: " + error);
+                continue;
+            }
+            if (status == MessageFramer::Status::FATAL) {
+                logger->error(QString("Cannot frame server data (%1), discarding %2 bytes")
+                              .arg(error).arg(framer.bufferedBytes()));
+                framer.reset();
                 break;
             }
+            
+            // The framer is between messages here, so a handler that runs a nested event
+            // loop may read and dispatch later messages without disturbing this loop
+            processMessage(message);
         }
     } catch (const std::exception& e) {
         logger->error(QString("Exception in processBuffer: %1").arg(e.what()));
-        buffer.clear();
+        framer.reset();
     } catch (...) {
         logger->error("Unknown exception in processBuffer");
-        buffer.clear();
+        framer.reset();
     }
 }
 
@@ -729,8 +1173,13 @@ void NetworkManager::sendMessage(const QJsonObject& message) {
             return;
         }
         
-        QJsonDocument doc(message);
-        QByteArray data = doc.toJson(QJsonDocument::Compact);
+        QByteArray data;
+        if (binaryProtocol) {
+            data = WireProtocol::encode(message);
+        } else {
+            data = QJsonDocument(message).toJson(QJsonDocument::Compact);
+            data.append('\n');
+        }
         
         logger->debug(QString("Sending message: %1 bytes").arg(data.size()));
         
@@ -773,6 +1222,10 @@ void NetworkManager::processMessage(const QJsonObject& message)
                 processGameState(message);
                 break;
                 
+            case MessageType::GAME_STATE_DELTA:
+                processGameStateDelta(message);
+                break;
+                
             case MessageType::MOVE_RESULT:
                 processMoveResult(message);
                 break;
@@ -797,6 +1250,10 @@ void NetworkManager::processMessage(const QJsonObject& message)
                 processGameAnalysisResponse(message);
                 break;
                 
+            case MessageType::GAME_ANALYSIS_PROGRESS:
+                processGameAnalysisProgress(message);
+                break;
+                
             case MessageType::LEADERBOARD_RESPONSE:
                 processLeaderboardResponse(message);
                 break;
@@ -817,6 +1274,17 @@ void NetworkManager::processMessage(const QJsonObject& message)
                 processDrawResponse(message);
                 break;
                 
+            case MessageType::NODE_REDIRECT:
+                processNodeRedirect(message);
+                break;
+                
+            case MessageType::TOURNAMENT_STATUS:
+                // Tournament games arrive as ordinary GAME_START messages
+                logger->info(QString("Tournament %1: %2")
+                            .arg(message["tournament"].toObject()["tournamentId"].toString(),
+                                 message["action"].toString()));
+                break;
+                
             case MessageType::PONG:
                 logger->debug("Received pong");
                 break;
@@ -836,11 +1304,34 @@ void NetworkManager::processAuthenticationResult(const QJsonObject& data) {
     bool success = data["success"].toBool();
     QString message = data["message"].toString();
     
+    // Everything after this result arrives, and must be sent, as binary frames
+    if (success && data["protocol"].toString() == WireProtocol::PROTOCOL_NAME) {
+        binaryProtocol = true;
+        logger->debug("Server accepted the binary protocol");
+    }
+    
+    // Presented on the next login so a dropped connection can resume the session
+    if (success && data.contains("sessionToken")) {
+        sessionToken = data["sessionToken"].toString();
+        reconnectAttempts = 0;
+    }
+    if (data["resumed"].toBool()) {
+        logger->info("Resumed the previous session");
+    }
+    
     logger->info(QString("Authentication result: %1 - %2")
                 .arg(success ? "Success" : "Failure")
                 .arg(message));
     
     emit authenticationResult(success, message);
+    
+    // Join the queue on the node that owns it, marked so that node does not send us on
+    if (success && resendMatchmaking && !matchmakingRequest.isEmpty()) {
+        QJsonObject request = matchmakingRequest;
+        request["redirected"] = true;
+        sendMessage(request);
+    }
+    resendMatchmaking = false;
 }
 
 void NetworkManager::processGameStart(const QJsonObject& data) {
@@ -881,6 +1372,32 @@ void NetworkManager::processGameState(const QJsonObject& data)
     }
 }
 
+void NetworkManager::processGameStateDelta(const QJsonObject& data)
+{
+    try {
+        if (!data.contains("delta")) {
+            logger->warning("Received game state delta message without delta field");
+            return;
+        }
+        
+        QJsonObject delta = data["delta"].toObject();
+        
+        logger->debug(QString("Received game state delta %1 for game: %2")
+                     .arg(delta["sequence"].toInteger())
+                     .arg(delta["gameId"].toString()));
+        
+        // Queued like full states so deltas and snapshots are applied in arrival order
+        QMetaObject::invokeMethod(this, [this, delta]() {
+            emit gameStateDeltaReceived(delta);
+        }, Qt::QueuedConnection);
+        
+    } catch (const std::exception& e) {
+        logger->error(QString("Exception in processGameStateDelta: %1").arg(e.what()));
+    } catch (...) {
+        logger->error("Unknown exception in processGameStateDelta");
+    }
+}
+
 void NetworkManager::processMoveResult(const QJsonObject& data) {
     bool success = data["success"].toBool();
     QString message = data["message"].toString();
@@ -925,7 +1442,11 @@ void NetworkManager::processGameHistoryResponse(const QJsonObject& data) {
     if (success) {
         QJsonArray gameHistories = data["gameHistories"].toArray();
         logger->info(QString("Received game history: %1 games").arg(gameHistories.size()));
-        emit gameHistoryReceived(gameHistories);
+        
+        // A page requested with a cursor continues the list already shown
+        qint64 nextCursor = static_cast<qint64>(data["nextCursor"].toDouble());
+        bool append = data["cursor"].toDouble() > 0;
+        emit gameHistoryReceived(gameHistories, nextCursor, append);
     } else {
         QString message = data["message"].toString();
         logger->warning(QString("Game history request failed: %1").arg(message));
@@ -947,6 +1468,10 @@ void NetworkManager::processGameAnalysisResponse(const QJsonObject& data) {
     }
 }
 
+void NetworkManager::processGameAnalysisProgress(const QJsonObject& data) {
+    emit gameAnalysisProgress(data["gameId"].toString(), data["completed"].toInt(), data["total"].toInt());
+}
+
 void NetworkManager::processLeaderboardResponse(const QJsonObject& data) {
     QJsonObject leaderboard = data["leaderboard"].toObject();
     
@@ -988,6 +1513,34 @@ void NetworkManager::processDrawResponse(const QJsonObject& data) {
     emit drawResponseReceived(accepted);
 }
 
+void NetworkManager::processNodeRedirect(const QJsonObject& data) {
+    QString host = data["host"].toString();
+    int port = data["port"].toInt();
+    if (host.isEmpty() || port <= 0 || authUsername.isEmpty()) {
+        logger->warning("Ignoring redirect without a node address or credentials");
+        return;
+    }
+    
+    logger->info(QString("Server node %1 is at %2:%3, reconnecting")
+                .arg(data["nodeId"].toString())
+                .arg(host)
+                .arg(port));
+    
+    // Move to the other node quietly; the UI only hears from the login there
+    redirecting = true;
+    resendMatchmaking = data["matchmaking"].toBool();
+    socket->abort();
+    
+    if (connectToServer(host, port)) {
+        authenticate(authUsername, authPassword, false);
+    } else {
+        resendMatchmaking = false;
+        emit disconnected();
+        emit connectionError(QString("Could not reach server node %1:%2").arg(host).arg(port));
+    }
+    redirecting = false;
+}
+
 // AudioManager implementation
 AudioManager::AudioManager(QObject* parent)
     : QObject(parent), soundEffectsEnabled(true), backgroundMusicEnabled(true),
@@ -1073,27 +1626,28 @@ void AudioManager::playSoundEffect(SoundEffect effect) {
         return;
     }
     
-    QString path = soundEffectPaths.value(effect);
-    if (path.isEmpty()) {
+    auto it = soundEffects.find(effect);
+    if (it == soundEffects.end() || it->voices.isEmpty()) {
         return;
     }
     
-    QMediaPlayer* player = new QMediaPlayer(this);
-    QAudioOutput* output = new QAudioOutput(this);
-    player->setAudioOutput(output);
-    
-    output->setVolume(soundEffectVolume / 100.0);
-    player->setSource(QUrl(path));
-    
-    // Connect to the media status changed signal to clean up the player when done
-    connect(player, &QMediaPlayer::playbackStateChanged, this, [player, output](QMediaPlayer::PlaybackState state) {
-        if (state == QMediaPlayer::StoppedState) {
-            player->deleteLater();
-            output->deleteLater();
+    // Take the next idle voice in turn; with all of them busy, restart the oldest
+    SoundEffectVoices& pool = it.value();
+    QSoundEffect* voice = pool.voices[pool.next];
+    for (int i = 0; i < pool.voices.size(); ++i) {
+        QSoundEffect* candidate = pool.voices[(pool.next + i) % pool.voices.size()];
+        if (!candidate->isPlaying()) {
+            voice = candidate;
+            pool.next = (pool.next + i) % pool.voices.size();
+            break;
         }
-    });
+    }
+    pool.next = (pool.next + 1) % pool.voices.size();
     
-    player->play();
+    if (voice->isPlaying()) {
+        voice->stop();
+    }
+    voice->play();
 }
 
 void AudioManager::playBackgroundMusic(bool play) {
@@ -1136,6 +1690,12 @@ bool AudioManager::isBackgroundMusicEnabled() const {
 
 void AudioManager::setSoundEffectVolume(int volume) {
     soundEffectVolume = qBound(0, volume, 100);
+    
+    for (const SoundEffectVoices& pool : soundEffects) {
+        for (QSoundEffect* voice : pool.voices) {
+            voice->setVolume(soundEffectVolume / 100.0);
+        }
+    }
 }
 
 int AudioManager::getSoundEffectVolume() const {
@@ -1167,12 +1727,21 @@ void AudioManager::loadSoundEffects()
     soundEffectPaths[SoundEffect::ERROR] = "qrc:/sounds/error.wav";
     soundEffectPaths[SoundEffect::NOTIFICATION] = "qrc:/sounds/notification.wav";
     
-    // Verify resources exist
+    // Verify resources exist and decode each effect into its voices
     for (auto it = soundEffectPaths.begin(); it != soundEffectPaths.end(); ++it) {
         QString path = it.value();
-        QFile resourceFile(path);
+        QFile resourceFile(":" + QUrl(path).path());
         if (!resourceFile.exists()) {
             qWarning() << "AudioManager: Resource file(s) (sound effects) do not exist: " << path;
+            continue;
+        }
+        
+        SoundEffectVoices& pool = soundEffects[it.key()];
+        for (int i = 0; i < SOUND_EFFECT_VOICES; ++i) {
+            QSoundEffect* voice = new QSoundEffect(this);
+            voice->setSource(QUrl(path));
+            voice->setVolume(soundEffectVolume / 100.0);
+            pool.voices.append(voice);
         }
     }
 
@@ -1224,6 +1793,7 @@ ThemeManager::BoardTheme ThemeManager::getBoardTheme() const {
 void ThemeManager::setPieceTheme(PieceTheme newTheme) {
     if (pieceTheme != newTheme) {
         pieceTheme = newTheme;
+        pieceSprites.clear();
         emit pieceThemeChanged();
     }
 }
@@ -1297,11 +1867,46 @@ void ThemeManager::setCustomCheckHighlightColor(const QColor& color) {
 void ThemeManager::setCustomPieceThemePath(const QString& path) {
     customPieceThemePath = path;
     if (pieceTheme == PieceTheme::CUSTOM) {
+        pieceSprites.clear();
         emit pieceThemeChanged();
     }
 }
 
-QColor ThemeManager::getTextColor() const {
+qreal ThemeManager::roundRasterScale(qreal scale) {
+    return std::max(0.125, std::ceil(scale * 8.0) / 8.0);
+}
+
+QPixmap ThemeManager::getPieceSprite(PieceType type, PieceColor color, int size, qreal devicePixelRatio) {
+    int ratio = qRound(devicePixelRatio * 100);  // Hundredths, so fractional scaling gets its own sprites
+    quint64 key = (static_cast<quint64>(ratio) << 32) | (static_cast<quint64>(size) << 8) |
+                  (static_cast<quint64>(type) << 2) | static_cast<quint64>(color);
+    
+    auto it = pieceSprites.constFind(key);
+    if (it != pieceSprites.constEnd()) {
+        return it.value();
+    }
+    
+    if (pieceSprites.size() >= PIECE_SPRITE_LIMIT) {
+        pieceSprites.clear();
+    }
+    
+    // Render at device resolution, so the sprite stays sharp on high-DPI screens
+    QPixmap sprite(QSize(size, size) * devicePixelRatio);
+    sprite.setDevicePixelRatio(devicePixelRatio);
+    sprite.fill(Qt::transparent);
+    
+    QSvgRenderer renderer(ChessPiece(type, color).getSvgFileName(getPieceThemePath()));
+    if (renderer.isValid()) {
+        QPainter painter(&sprite);
+        painter.setRenderHint(QPainter::Antialiasing);
+        renderer.render(&painter, QRectF(0, 0, size, size));
+    }
+    
+    pieceSprites.insert(key, sprite);
+    return sprite;
+}
+
+QColor ThemeManager::getTextColor() const {
     switch (theme) {
         case Theme::LIGHT:
             return QColor(51, 51, 51);
@@ -1571,9 +2176,6 @@ ChessPieceItem::ChessPieceItem(PieceType type, PieceColor color, ThemeManager* t
     setFlag(QGraphicsItem::ItemSendsGeometryChanges);
     setFlag(QGraphicsItem::ItemIsSelectable);
     
-    // Load the SVG for this piece
-    loadSvg();
-    
     // Set Z value to ensure pieces are drawn above squares
     setZValue(1);
 }
@@ -1589,8 +2191,15 @@ void ChessPieceItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* op
     Q_UNUSED(option);
     Q_UNUSED(widget);
     
-    // Draw the piece
-    renderer.render(painter, boundingRect());
+    // Draw the piece at the resolution it covers on screen, which includes the view's
+    // scaling; the sprite is fetched again only when that changes
+    qreal ratio = painter->device() ? painter->device()->devicePixelRatioF() : 1.0;
+    const QTransform& transform = painter->worldTransform();
+    ratio = ThemeManager::roundRasterScale(ratio * std::hypot(transform.m11(), transform.m12()));
+    if (sprite.isNull() || !qFuzzyCompare(sprite.devicePixelRatio(), ratio)) {
+        loadSprite(ratio);
+    }
+    painter->drawPixmap(QPointF(0, 0), sprite);
 }
 
 PieceType ChessPieceItem::getType() const {
@@ -1602,8 +2211,12 @@ PieceColor ChessPieceItem::getColor() const {
 }
 
 void ChessPieceItem::setSquareSize(int size) {
+    if (size == squareSize) {
+        return;
+    }
     prepareGeometryChange();
     squareSize = size;
+    sprite = QPixmap();
     update();
 }
 
@@ -1612,7 +2225,7 @@ int ChessPieceItem::getSquareSize() const {
 }
 
 void ChessPieceItem::updateTheme() {
-    loadSvg();
+    sprite = QPixmap();
     update();
 }
 
@@ -1651,20 +2264,245 @@ void ChessPieceItem::mouseReleaseEvent(QGraphicsSceneMouseEvent* event)
     QGraphicsItem::mouseReleaseEvent(event);
 }
 
-void ChessPieceItem::loadSvg()
+void ChessPieceItem::loadSprite(qreal devicePixelRatio)
 {
-    // Get the SVG file name for this piece
-    QString svgFileName = ChessPiece(type, color).getSvgFileName(themeManager->getPieceThemePath());
+    sprite = themeManager->getPieceSprite(type, color, squareSize, devicePixelRatio);
+}
+
+// BoardHighlightItem implementation
+BoardHighlightItem::BoardHighlightItem(int squareSize) : squareSize(squareSize) {
+    // Fill in exposedRect, so a repaint of one square skips the other marks
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+QRectF BoardHighlightItem::boundingRect() const {
+    return QRectF(0, 0, 8 * squareSize, 8 * squareSize);
+}
+
+void BoardHighlightItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
+    Q_UNUSED(widget);
     
-    // Load the SVG
-    renderer.load(svgFileName);
+    painter->setPen(Qt::NoPen);
+    for (const Mark& mark : marks) {
+        QRectF rect = squareRect(mark.square);
+        if (!rect.intersects(option->exposedRect)) {
+            continue;
+        }
+        
+        painter->setBrush(mark.color);
+        if (mark.hint) {
+            painter->setOpacity(0.6);
+            painter->drawEllipse(rect.adjusted(squareSize * 0.3, squareSize * 0.3, -squareSize * 0.3, -squareSize * 0.3));
+        } else {
+            painter->setOpacity(0.5);
+            painter->drawRect(rect);
+        }
+    }
+}
+
+void BoardHighlightItem::setSquareSize(int size) {
+    prepareGeometryChange();
+    squareSize = size;
+}
+
+void BoardHighlightItem::addMark(const Mark& mark) {
+    marks.append(mark);
+    update(squareRect(mark.square));
+}
+
+void BoardHighlightItem::clearMarks(bool hints) {
+    for (int i = marks.size() - 1; i >= 0; --i) {
+        if (marks[i].hint == hints) {
+            update(squareRect(marks[i].square));
+            marks.removeAt(i);
+        }
+    }
+}
+
+void BoardHighlightItem::setMarks(const QVector<Mark>& newMarks) {
+    marks = newMarks;
+    update();
+}
+
+QRectF BoardHighlightItem::squareRect(const Position& square) const {
+    return QRectF(square.col * squareSize, square.row * squareSize, squareSize, squareSize);
+}
+
+// LocalPosition implementation (moves come from the shared MoveGenPosition)
+static_assert(static_cast<int>(PieceType::KING) == MoveGenPosition::KING &&
+              static_cast<int>(PieceColor::BLACK) == MoveGenPosition::BLACK,
+              "MoveGenPosition numbers pieces and colors as PieceType and PieceColor do");
+
+static ChessMove fromMoveGenMove(const MoveGenMove& move) {
+    return ChessMove(Position(move.from / 8, move.from % 8), Position(move.to / 8, move.to % 8),
+                     move.promotion < 0 ? PieceType::EMPTY : static_cast<PieceType>(move.promotion));
+}
+
+LocalPosition::LocalPosition() : plyCount(0), loaded(false) {
+}
+
+void LocalPosition::reset() {
+    position.reset();
+    plyCount = 0;
+    loaded = true;
+}
+
+bool LocalPosition::loadGameState(const QJsonObject& gameState) {
+    position.clear();
+    plyCount = 0;
+    loaded = false;
+    
+    QJsonArray board = gameState["board"].toArray();
+    if (board.size() != 8) {
+        return false;
+    }
+    for (int r = 0; r < 8; ++r) {
+        QJsonArray rowArray = board[r].toArray();
+        if (rowArray.size() != 8) {
+            return false;
+        }
+        for (int c = 0; c < 8; ++c) {
+            QJsonObject pieceObj = rowArray[c].toObject();
+            QString type = pieceObj["type"].toString();
+            PieceColor color = pieceObj["color"].toString() == "white" ? PieceColor::WHITE : PieceColor::BLACK;
+            
+            PieceType pieceType;
+            if (type == "pawn") pieceType = PieceType::PAWN;
+            else if (type == "knight") pieceType = PieceType::KNIGHT;
+            else if (type == "bishop") pieceType = PieceType::BISHOP;
+            else if (type == "rook") pieceType = PieceType::ROOK;
+            else if (type == "queen") pieceType = PieceType::QUEEN;
+            else if (type == "king") pieceType = PieceType::KING;
+            else continue;
+            
+            position.addPiece(r * 8 + c, static_cast<int>(pieceType), static_cast<int>(color));
+        }
+    }
+    if (!position.piecesOf(MoveGenPosition::KING, MoveGenPosition::WHITE) ||
+        !position.piecesOf(MoveGenPosition::KING, MoveGenPosition::BLACK)) {
+        return false;
+    }
+    
+    position.sideToMove = gameState["currentTurn"].toString() == "black" ? MoveGenPosition::BLACK : MoveGenPosition::WHITE;
+    
+    // A castling right survives until a move starts or ends on the king's or that rook's home square
+    position.castlingRights = MoveGenPosition::WHITE_KINGSIDE | MoveGenPosition::WHITE_QUEENSIDE |
+                              MoveGenPosition::BLACK_KINGSIDE | MoveGenPosition::BLACK_QUEENSIDE;
+    QJsonArray history = gameState["moveHistory"].toArray();
+    for (const QJsonValue& value : history) {
+        QJsonObject moveObj = value.toObject();
+        Position from = Position::fromAlgebraic(moveObj["from"].toString());
+        Position to = Position::fromAlgebraic(moveObj["to"].toString());
+        if (from.isValid()) position.clearCastlingRights(square(from));
+        if (to.isValid()) position.clearCastlingRights(square(to));
+    }
+    plyCount = history.size();
+    
+    // The last move leaves an en passant square if it was a pawn's double step
+    if (!history.isEmpty()) {
+        QJsonObject lastMove = history.last().toObject();
+        Position from = Position::fromAlgebraic(lastMove["from"].toString());
+        Position to = Position::fromAlgebraic(lastMove["to"].toString());
+        if (from.isValid() && to.isValid() && from.col == to.col && std::abs(from.row - to.row) == 2 &&
+            position.typeAt(square(to)) == MoveGenPosition::PAWN) {
+            position.enPassantSquare = ((from.row + to.row) / 2) * 8 + from.col;
+        }
+    }
+    
+    loaded = true;
+    return true;
+}
+
+bool LocalPosition::isLoaded() const {
+    return loaded;
+}
+
+PieceType LocalPosition::typeAt(const Position& pos) const {
+    if (!pos.isValid() || position.typeAt(square(pos)) < 0) return PieceType::EMPTY;
+    return static_cast<PieceType>(position.typeAt(square(pos)));
+}
+
+PieceColor LocalPosition::colorAt(const Position& pos) const {
+    if (!pos.isValid() || position.colorAt(square(pos)) < 0) return PieceColor::NONE;
+    return static_cast<PieceColor>(position.colorAt(square(pos)));
+}
+
+PieceColor LocalPosition::getSideToMove() const {
+    return static_cast<PieceColor>(position.sideToMove);
+}
+
+int LocalPosition::getPlyCount() const {
+    return plyCount;
+}
+
+QVector<ChessMove> LocalPosition::legalMoves() const {
+    QVector<ChessMove> moves;
+    if (!loaded) {
+        return moves;
+    }
+    
+    std::vector<MoveGenMove> generated;
+    position.generateLegalMoves(generated);
+    moves.reserve(static_cast<qsizetype>(generated.size()));
+    for (const MoveGenMove& move : generated) {
+        moves.append(fromMoveGenMove(move));
+    }
+    return moves;
+}
+
+QVector<ChessMove> LocalPosition::legalMovesFrom(const Position& from) const {
+    QVector<ChessMove> moves = legalMoves();
+    moves.erase(std::remove_if(moves.begin(), moves.end(),
+                               [&from](const ChessMove& move) { return move.getFrom() != from; }),
+                moves.end());
+    return moves;
+}
+
+bool LocalPosition::isLegal(const ChessMove& move) const {
+    return legalMoves().contains(move);
+}
+
+bool LocalPosition::isCapture(const ChessMove& move) const {
+    if (!move.getTo().isValid()) return false;
+    int to = square(move.getTo());
+    return position.mailbox[to] != MoveGenPosition::NO_PIECE ||
+           (to == position.enPassantSquare && typeAt(move.getFrom()) == PieceType::PAWN);
+}
+
+QVector<Position> LocalPosition::premoveTargets(const Position& from) const {
+    QVector<Position> targets;
+    if (typeAt(from) == PieceType::EMPTY) {
+        return targets;
+    }
+    
+    uint64_t reach = position.premoveTargets(square(from));
+    while (reach) {
+        targets.append(toPosition(MoveGenPosition::popLsb(reach)));
+    }
+    return targets;
+}
+
+void LocalPosition::applyMove(const ChessMove& move) {
+    if (!move.getFrom().isValid() || !move.getTo().isValid() || typeAt(move.getFrom()) == PieceType::EMPTY) {
+        return;
+    }
+    
+    PieceType promotion = move.getPromotionType();
+    position.applyMove({ static_cast<int8_t>(square(move.getFrom())), static_cast<int8_t>(square(move.getTo())),
+                         static_cast<int8_t>(promotion == PieceType::EMPTY ? -1 : static_cast<int>(promotion)) });
+    ++plyCount;
 }
 
 // ChessBoardWidget implementation
+
+// Squares of a queued premove
+static const QColor PREMOVE_HIGHLIGHT_COLOR(255, 165, 0, 140);
+
 ChessBoardWidget::ChessBoardWidget(ThemeManager* themeManager, AudioManager* audioManager, QWidget* parent, Logger* logger)
     : QGraphicsView(parent), themeManager(themeManager), audioManager(audioManager),
       squareSize(60), flipped(false), playerColor(PieceColor::WHITE), interactive(true),
-      draggedPiece(nullptr), isDragging(false)
+      draggedPiece(nullptr), isDragging(false), pendingMove(false), highlightOverlay(nullptr),
+      boardBackground(nullptr), backgroundScale(0.0)
 {
     try {
         this->logger = logger;
@@ -1682,11 +2520,14 @@ ChessBoardWidget::ChessBoardWidget(ThemeManager* themeManager, AudioManager* aud
         
         setScene(scene);
         
-        // Set up view properties
+        // A few dozen items that keep moving; a BSP index would only cost time
+        scene->setItemIndexMethod(QGraphicsScene::NoIndex);
+        
+        // Set up view properties. Only the regions of changed items are repainted
         setRenderHint(QPainter::Antialiasing);
         setRenderHint(QPainter::SmoothPixmapTransform);
         setDragMode(QGraphicsView::NoDrag);
-        setViewportUpdateMode(QGraphicsView::FullViewportUpdate);
+        setViewportUpdateMode(QGraphicsView::SmartViewportUpdate);
         setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
         setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
         
@@ -1732,29 +2573,7 @@ ChessBoardWidget::~ChessBoardWidget()
             }
         }
         
-        // Clear highlights
-        for (QGraphicsRectItem* item : highlightItems) {
-            if (item) {
-                if (scene) {
-                    scene->removeItem(item);
-                }
-                delete item;
-            }
-        }
-        highlightItems.clear();
-        
-        // Clear hints
-        for (QGraphicsEllipseItem* item : hintItems) {
-            if (item) {
-                if (scene) {
-                    scene->removeItem(item);
-                }
-                delete item;
-            }
-        }
-        hintItems.clear();
-        
-        // Now safe to delete scene
+        // Now safe to delete scene, which also deletes the background and highlight overlay
         if (scene) {
             delete scene;
             scene = nullptr;
@@ -1805,32 +2624,19 @@ void ChessBoardWidget::resetBoard()
             }
         }
 
-        logger->info("ChessBoardWidget::resetBoard() - Clearing highlight items");
-        
-        // Clear highlight items manually
-        for (QGraphicsRectItem* item : highlightItems) {
-            if (item) {
-                scene->removeItem(item);
-                delete item;
-            }
-        }
-        highlightItems.clear();
-
-        logger->info("ChessBoardWidget::resetBoard() - Clearing hint items");
-        
-        // Clear hint items manually
-        for (QGraphicsEllipseItem* item : hintItems) {
-            if (item) {
-                scene->removeItem(item);
-                delete item;
-            }
-        }
-        hintItems.clear();
+        highlightedSquares.clear();
+        hintSquares.clear();
+        localPosition = LocalPosition();
+        pendingMove = false;
+        premove.reset();
         
         logger->info("ChessBoardWidget::resetBoard() - Now safe to clear scene");
         
-        // Now clear any remaining items in the scene (squares, labels, etc.)
+        // Now clear any remaining items in the scene (background, highlight overlay)
         scene->clear();
+        highlightOverlay = nullptr;
+        boardBackground = nullptr;
+        backgroundScale = 0.0;
         
         logger->info("ChessBoardWidget::resetBoard() - Setting up board");
         
@@ -1882,6 +2688,7 @@ void ChessBoardWidget::setupInitialPosition()
         for (int c = 0; c < 8; ++c) {
             setPiece(Position(6, c), PieceType::PAWN, PieceColor::BLACK);
         }
+        localPosition.reset();
         
         logger->info("ChessBoardWidget::setupInitialPosition() - Initial position set up successfully");
     } catch (const std::exception& e) {
@@ -1990,6 +2797,79 @@ void ChessBoardWidget::movePiece(const Position& from, const Position& to, bool
     }
 }
 
+void ChessBoardWidget::setPosition(const std::array<std::array<SquareContent, 8>, 8>& position, bool animate)
+{
+    // Lift the pieces off every square whose content changes. A piece that stays put
+    // is only moved back onto its square if a rejected drag left it elsewhere
+    QVector<ChessPieceItem*> lifted;
+    for (int r = 0; r < 8; ++r) {
+        for (int c = 0; c < 8; ++c) {
+            ChessPieceItem* piece = pieces[r][c];
+            const SquareContent& target = position[r][c];
+            if (!piece) {
+                continue;
+            }
+            if (piece->getType() != target.type || piece->getColor() != target.color) {
+                lifted.append(piece);
+                pieces[r][c] = nullptr;
+            } else if (piece != draggedPiece) {
+                Position boardPos = logicalToBoard(Position(r, c));
+                QPointF squarePos(boardPos.col * squareSize, boardPos.row * squareSize);
+                if (piece->pos() != squarePos) {
+                    piece->setPos(squarePos);
+                }
+            }
+        }
+    }
+    
+    // Fill the squares that are now empty but should not be, preferring a lifted piece
+    // of the same kind (the move, or the rook of a castling) over a new item
+    for (int r = 0; r < 8; ++r) {
+        for (int c = 0; c < 8; ++c) {
+            const SquareContent& target = position[r][c];
+            if (pieces[r][c] || target.type == PieceType::EMPTY) {
+                continue;
+            }
+            
+            int match = -1;
+            for (int i = 0; i < lifted.size(); ++i) {
+                ChessPieceItem* piece = lifted[i];
+                if (piece->getType() == target.type && piece->getColor() == target.color) {
+                    match = i;
+                    break;
+                }
+            }
+            
+            if (match < 0) {
+                setPiece(Position(r, c), target.type, target.color);
+                continue;
+            }
+            
+            // Slide from wherever the piece is, which is the drop point after a drag
+            ChessPieceItem* piece = lifted.takeAt(match);
+            pieces[r][c] = piece;
+            
+            Position boardTo = logicalToBoard(Position(r, c));
+            QPointF endPos(boardTo.col * squareSize, boardTo.row * squareSize);
+            if (animate) {
+                animatePieceMovement(piece, piece->pos(), endPos);
+            } else {
+                piece->setPos(endPos);
+            }
+        }
+    }
+    
+    // Whatever is left was captured or promoted
+    for (ChessPieceItem* piece : lifted) {
+        if (piece == draggedPiece) {
+            draggedPiece = nullptr;
+            isDragging = false;
+        }
+        scene->removeItem(piece);
+        delete piece;
+    }
+}
+
 void ChessBoardWidget::setSquareSize(int size)
 {
     squareSize = size;
@@ -2017,43 +2897,23 @@ bool ChessBoardWidget::isFlipped() const
 
 void ChessBoardWidget::highlightSquare(const Position& pos, const QColor& color)
 {
-    Position boardPos = logicalToBoard(pos);
-    
-    QGraphicsRectItem* highlight = new QGraphicsRectItem(
-        boardPos.col * squareSize,
-        boardPos.row * squareSize,
-        squareSize,
-        squareSize
-    );
-    
-    highlight->setBrush(QBrush(color));
-    highlight->setOpacity(0.5);
-    highlight->setZValue(0.5); // Above squares but below pieces
-    
-    scene->addItem(highlight);
-    highlightItems.append(highlight);
+    highlightedSquares.append(qMakePair(pos, color));
+    if (highlightOverlay) {
+        highlightOverlay->addMark({ logicalToBoard(pos), color, false });
+    }
 }
 
 void ChessBoardWidget::clearHighlights()
 {
-    try {
-        if (!scene) {
-            logger->warning("clearHighlights: scene is null");
-            return;
-        }
-        
-        for (QGraphicsRectItem* item : highlightItems) {
-            if (item) {
-                scene->removeItem(item);
-                delete item;
-            }
-        }
-        highlightItems.clear();
-        
-    } catch (const std::exception& e) {
-        logger->error(QString("Exception in clearHighlights(): %1").arg(e.what()));
-    } catch (...) {
-        logger->error("Unknown exception in clearHighlights()");
+    highlightedSquares.clear();
+    if (highlightOverlay) {
+        highlightOverlay->clearMarks(false);
+    }
+    
+    // A queued premove stays marked until it is played or dropped
+    if (premove) {
+        highlightSquare(premove->getFrom(), PREMOVE_HIGHLIGHT_COLOR);
+        highlightSquare(premove->getTo(), PREMOVE_HIGHLIGHT_COLOR);
     }
 }
 
@@ -2156,7 +3016,7 @@ void ChessBoardWidget::updateBoardLayout()
     try {
         if (logger) logger->info("ChessBoardWidget::updateBoardLayout() - Start");
         
-        // Update square positions
+        // Render the background for the new orientation
         createSquares();
         
         // Update piece positions based on the new orientation
@@ -2169,83 +3029,8 @@ void ChessBoardWidget::updateBoardLayout()
             }
         }
         
-        // Update highlight positions if any
-        QVector<QGraphicsRectItem*> oldHighlights = highlightItems;
-        highlightItems.clear();
-        
-        for (QGraphicsRectItem* item : oldHighlights) {
-            // Get the logical position of this highlight
-            QRectF rect = item->rect();
-            int col = static_cast<int>(rect.x() / squareSize);
-            int row = static_cast<int>(rect.y() / squareSize);
-            Position boardPos(row, col);
-            Position logicalPos = boardToLogical(boardPos);
-            
-            // Store the color of the highlight
-            QColor highlightColor = item->brush().color();
-            
-            // Remove old highlight
-            scene->removeItem(item);
-            delete item;
-            
-            // Add new highlight at the correct position
-            highlightSquare(logicalPos, highlightColor);
-        }
-        
-        // Update hint positions if any
-        QVector<QGraphicsEllipseItem*> oldHints = hintItems;
-        hintItems.clear();
-        
-        // Store positions and colors of hints to recreate them
-        QVector<QPair<Position, QColor>> hintsToRecreate;
-        
-        for (QGraphicsEllipseItem* item : oldHints) {
-            // Get the logical position of this hint
-            QRectF rect = item->rect();
-            // Calculate the center of the hint circle to get the square position
-            qreal centerX = rect.x() + rect.width() / 2;
-            qreal centerY = rect.y() + rect.height() / 2;
-            int col = static_cast<int>(centerX / squareSize);
-            int row = static_cast<int>(centerY / squareSize);
-            
-            Position boardPos(row, col);
-            Position logicalPos = boardToLogical(boardPos);
-            
-            // Store the color of the hint
-            QColor hintColor = item->brush().color();
-            
-            // Store the position and color for recreation
-            hintsToRecreate.append(qMakePair(logicalPos, hintColor));
-            
-            // Remove old hint
-            scene->removeItem(item);
-            delete item;
-        }
-        
-        // Recreate all hints at their correct positions
-        for (const auto& hintInfo : hintsToRecreate) {
-            Position pos = hintInfo.first;
-            QColor color = hintInfo.second;
-            
-            // Convert logical position to board position with the new orientation
-            Position boardPos = logicalToBoard(pos);
-            
-            // Create a new hint circle
-            QGraphicsEllipseItem* hint = new QGraphicsEllipseItem(
-                boardPos.col * squareSize + squareSize * 0.3,
-                boardPos.row * squareSize + squareSize * 0.3,
-                squareSize * 0.4,
-                squareSize * 0.4
-            );
-            
-            hint->setBrush(QBrush(color));
-            hint->setPen(Qt::NoPen);
-            hint->setOpacity(0.6);
-            hint->setZValue(0.5); // Above squares but below pieces
-            
-            scene->addItem(hint);
-            hintItems.append(hint);
-        }
+        // Highlights and hints are kept by logical square, so they only need redrawing
+        updateHighlightOverlay();
         
         // If there was a selected position, we may need to update the highlights for valid moves
         if (selectedPosition.isValid()) {
@@ -2272,6 +3057,9 @@ PieceColor ChessBoardWidget::getPlayerColor() const
 void ChessBoardWidget::setInteractive(bool interactive)
 {
     this->interactive = interactive;
+    if (!interactive) {
+        clearPremove();
+    }
 }
 
 bool ChessBoardWidget::isInteractive() const
@@ -2283,47 +3071,20 @@ void ChessBoardWidget::showMoveHints(const QVector<Position>& positions)
 {
     clearMoveHints();
     
+    QColor color = themeManager->getHighlightColor();
     for (const Position& pos : positions) {
-        Position boardPos = logicalToBoard(pos);
-        
-        // Create a hint circle
-        QGraphicsEllipseItem* hint = new QGraphicsEllipseItem(
-            boardPos.col * squareSize + squareSize * 0.3,
-            boardPos.row * squareSize + squareSize * 0.3,
-            squareSize * 0.4,
-            squareSize * 0.4
-        );
-        
-        hint->setBrush(QBrush(themeManager->getHighlightColor()));
-        hint->setPen(Qt::NoPen);
-        hint->setOpacity(0.6);
-        hint->setZValue(0.5); // Above squares but below pieces
-        
-        scene->addItem(hint);
-        hintItems.append(hint);
+        hintSquares.append(qMakePair(pos, color));
+        if (highlightOverlay) {
+            highlightOverlay->addMark({ logicalToBoard(pos), color, true });
+        }
     }
 }
 
 void ChessBoardWidget::clearMoveHints()
 {
-    try {
-        if (!scene) {
-            logger->warning("clearMoveHints: scene is null");
-            return;
-        }
-        
-        for (QGraphicsEllipseItem* item : hintItems) {
-            if (item) {
-                scene->removeItem(item);
-                delete item;
-            }
-        }
-        hintItems.clear();
-        
-    } catch (const std::exception& e) {
-        logger->error(QString("Exception in clearMoveHints(): %1").arg(e.what()));
-    } catch (...) {
-        logger->error("Unknown exception in clearMoveHints()");
+    hintSquares.clear();
+    if (highlightOverlay) {
+        highlightOverlay->clearMarks(true);
     }
 }
 
@@ -2383,11 +3144,16 @@ void ChessBoardWidget::updateTheme()
         
         logger->info(QString("ChessBoardWidget::updateTheme() - Board has pieces: %1").arg(hadPieces));
         
-        // Recreate the board with the new theme
-        resetBoard();
-        
-        // If there were pieces before, we might need to restore them
-        // (In a real game, this would be handled by the game state update)
+        // Redraw the background in the new colors; the pieces stay where they are and
+        // take their sprites from the theme manager's rebuilt atlas
+        createSquares();
+        for (int r = 0; r < 8; ++r) {
+            for (int c = 0; c < 8; ++c) {
+                if (pieces[r][c]) {
+                    pieces[r][c]->updateTheme();
+                }
+            }
+        }
         
         logger->info("ChessBoardWidget::updateTheme() - Finished");
         
@@ -2412,17 +3178,18 @@ void ChessBoardWidget::showPromotionDialog(const Position& from, const Position&
         PieceType promotionType = dialog.getSelectedPieceType();
         
         // Create the move with promotion
-        ChessMove move(from, to, promotionType);
-        
-        // Emit the move request
-        emit moveRequested(currentGameId, move);
+        submitMove(ChessMove(from, to, promotionType));
+    } else {
+        snapBack(from);
     }
 }
 
 void ChessBoardWidget::resizeEvent(QResizeEvent* event)
 {
     QGraphicsView::resizeEvent(event);
-    updateBoardSize();
+    
+    // The scene keeps its size; only the view's scale changes
+    fitBoardToView();
 }
 
 void ChessBoardWidget::mousePressEvent(QMouseEvent* event)
@@ -2452,353 +3219,94 @@ void ChessBoardWidget::mousePressEvent(QMouseEvent* event)
                     return;
                 }
                 
-                // Check if it's our turn before allowing selection
+                // With a local position the piece can also be picked up on the opponent's
+                // turn, as a premove; without one only on the player's turn
                 bool isPlayerTurn = false;
-                emit checkTurn(piece->getColor(), &isPlayerTurn);
+                if (localPosition.isLoaded()) {
+                    isPlayerTurn = true;
+                } else {
+                    emit checkTurn(piece->getColor(), &isPlayerTurn);
+                }
 
                 // Only proceed if it's the player's turn
                 if (isPlayerTurn) {
                     // Clear previous selection
-                    clearHighlights();
-                    
-                    // Store the selected position and start drag
-                    selectedPosition = pos;
-                    dragStartPosition = pos;
-                    draggedPiece = piece;
-                    isDragging = false; // Will become true on mouse move
-                    
-                    // Store original position for snap-back
-                    Position boardPos = logicalToBoard(pos);
-                    dragOriginalPos = QPointF(boardPos.col * squareSize, boardPos.row * squareSize);
-                    
-                    // Highlight valid moves
-                    highlightValidMoves(pos);
-                    
-                    // Log the selection
-                    if (logger)
-                    {
-                        logger->debug(QString("Selected piece at (%1,%2) of type %3 and color %4")
-                            .arg(pos.row)
-                            .arg(pos.col)
-                            .arg(static_cast<int>(piece->getType()))
-                            .arg(piece->getColor() == PieceColor::WHITE ? "white" : "black"));
-                    }
-                } else {
-                    // Not player's turn - don't allow selection
-                    if (logger) logger->debug("Cannot select piece - not your turn");
-                }
-            } else {
-                // Clicked on opponent's piece or empty square
-                if (selectedPosition.isValid()) {
-                    // Try to move the selected piece to this square
-                    handleDrop(pos);
-                    clearHighlights();
-                    selectedPosition = Position(); // Clear after move attempt
-                }
-            }
-        }
-    }
-
-    QGraphicsView::mousePressEvent(event);
-}
-
-void ChessBoardWidget::highlightValidMoves(const Position& from)
-{
-    try {
-        // Clear any existing highlights
-        clearHighlights();
-        
-        // Highlight the selected piece's square
-        highlightSquare(from, QColor(100, 100, 255, 128));
-        
-        ChessPieceItem* piece = getPieceAt(from);
-        if (!piece) {
-            logger->warning(QString("No piece found at position (%1,%2) in highlightValidMoves").arg(from.row).arg(from.col));
-            return;
-        }
-        
-        PieceType pieceType = piece->getType();
-        PieceColor pieceColor = piece->getColor();
-        
-        logger->debug(QString("Highlighting valid moves for %1 %2 at (%3,%4)")
-                     .arg(pieceColor == PieceColor::WHITE ? "white" : "black")
-                     .arg(static_cast<int>(pieceType))
-                     .arg(from.row)
-                     .arg(from.col));
-        
-        // Highlight different squares based on piece type
-        switch (pieceType) {
-            case PieceType::PAWN: {
-                // Pawns move differently based on color
-                int direction = (pieceColor == PieceColor::WHITE) ? 1 : -1;
-                
-                // Forward move (one square)
-                Position oneForward(from.row + direction, from.col);
-                if (oneForward.isValid() && !getPieceAt(oneForward)) {
-                    highlightSquare(oneForward, QColor(0, 255, 0, 100));
-                    
-                    // Two squares forward from starting position
-                    if ((pieceColor == PieceColor::WHITE && from.row == 1) ||
-                        (pieceColor == PieceColor::BLACK && from.row == 6)) {
-                        Position twoForward(from.row + 2 * direction, from.col);
-                        if (twoForward.isValid() && !getPieceAt(twoForward)) {
-                            highlightSquare(twoForward, QColor(0, 255, 0, 100));
-                        }
-                    }
-                }
-                
-                // Diagonal captures
-                Position captureLeft(from.row + direction, from.col - 1);
-                Position captureRight(from.row + direction, from.col + 1);
-                
-                if (captureLeft.isValid()) {
-                    ChessPieceItem* leftPiece = getPieceAt(captureLeft);
-                    if (leftPiece && leftPiece->getColor() != pieceColor) {
-                        highlightSquare(captureLeft, QColor(255, 0, 0, 100));
-                    }
-                }
-                
-                if (captureRight.isValid()) {
-                    ChessPieceItem* rightPiece = getPieceAt(captureRight);
-                    if (rightPiece && rightPiece->getColor() != pieceColor) {
-                        highlightSquare(captureRight, QColor(255, 0, 0, 100));
-                    }
-                }
-                
-                // En passant capture
-                // For white pawns on the 5th rank or black pawns on the 4th rank
-                if ((pieceColor == PieceColor::WHITE && from.row == 4) || 
-                    (pieceColor == PieceColor::BLACK && from.row == 3)) {
-                    
-                    // Check left side for en passant
-                    if (from.col > 0) {
-                        Position leftPos(from.row, from.col - 1);
-                        ChessPieceItem* leftPiece = getPieceAt(leftPos);
-                        
-                        // If there's an enemy pawn to the left that just moved two squares
-                        if (leftPiece && leftPiece->getType() == PieceType::PAWN && 
-                            leftPiece->getColor() != pieceColor) {
-                            
-                            // In a real implementation, we would check if this pawn just moved two squares
-                            // For this UI highlight, we'll just show it as a possibility
-                            // The server will validate the actual move
-                            Position enPassantTarget(from.row + direction, from.col - 1);
-                            highlightSquare(enPassantTarget, QColor(255, 0, 0, 100));
-                        }
-                    }
-                    
-                    // Check right side for en passant
-                    if (from.col < 7) {
-                        Position rightPos(from.row, from.col + 1);
-                        ChessPieceItem* rightPiece = getPieceAt(rightPos);
-                        
-                        // If there's an enemy pawn to the right that just moved two squares
-                        if (rightPiece && rightPiece->getType() == PieceType::PAWN && 
-                            rightPiece->getColor() != pieceColor) {
-                            
-                            // In a real implementation, we would check if this pawn just moved two squares
-                            // For this UI highlight, we'll just show it as a possibility
-                            // The server will validate the actual move
-                            Position enPassantTarget(from.row + direction, from.col + 1);
-                            highlightSquare(enPassantTarget, QColor(255, 0, 0, 100));
-                        }
-                    }
-                }
-                break;
-            }
-            
-            case PieceType::KNIGHT: {
-                // Knights move in L-shapes
-                const std::vector<std::pair<int, int>> knightMoves = {
-                    {2, 1}, {1, 2}, {-1, 2}, {-2, 1},
-                    {-2, -1}, {-1, -2}, {1, -2}, {2, -1}
-                };
-                
-                for (const auto& move : knightMoves) {
-                    Position newPos(from.row + move.first, from.col + move.second);
-                    if (newPos.isValid()) {
-                        ChessPieceItem* targetPiece = getPieceAt(newPos);
-                        if (!targetPiece) {
-                            // Empty square - valid move
-                            highlightSquare(newPos, QColor(0, 255, 0, 100));
-                        } else if (targetPiece->getColor() != pieceColor) {
-                            // Opponent's piece - can capture
-                            highlightSquare(newPos, QColor(255, 0, 0, 100));
-                        }
-                    }
-                }
-                break;
-            }
-            
-            case PieceType::BISHOP: {
-                // Bishops move diagonally
-                const std::vector<std::pair<int, int>> directions = {
-                    {1, 1}, {1, -1}, {-1, 1}, {-1, -1}
-                };
-                
-                for (const auto& dir : directions) {
-                    highlightDirectionalMoves(from, dir.first, dir.second, pieceColor);
-                }
-                break;
-            }
-            
-            case PieceType::ROOK: {
-                // Rooks move horizontally and vertically
-                const std::vector<std::pair<int, int>> directions = {
-                    {0, 1}, {1, 0}, {0, -1}, {-1, 0}
-                };
-                
-                for (const auto& dir : directions) {
-                    highlightDirectionalMoves(from, dir.first, dir.second, pieceColor);
-                }
-                break;
-            }
-            
-            case PieceType::QUEEN: {
-                // Queens move in all directions
-                const std::vector<std::pair<int, int>> directions = {
-                    {0, 1}, {1, 1}, {1, 0}, {1, -1},
-                    {0, -1}, {-1, -1}, {-1, 0}, {-1, 1}
-                };
-                
-                for (const auto& dir : directions) {
-                    highlightDirectionalMoves(from, dir.first, dir.second, pieceColor);
-                }
-                break;
-            }
-            
-            case PieceType::KING: {
-                // Kings move one square in any direction
-                const std::vector<std::pair<int, int>> directions = {
-                    {0, 1}, {1, 1}, {1, 0}, {1, -1},
-                    {0, -1}, {-1, -1}, {-1, 0}, {-1, 1}
-                };
-                
-                for (const auto& dir : directions) {
-                    Position newPos(from.row + dir.first, from.col + dir.second);
-                    if (newPos.isValid()) {
-                        ChessPieceItem* targetPiece = getPieceAt(newPos);
-                        if (!targetPiece) {
-                            // Empty square - valid move
-                            highlightSquare(newPos, QColor(0, 255, 0, 100));
-                        } else if (targetPiece->getColor() != pieceColor) {
-                            // Opponent's piece - can capture
-                            highlightSquare(newPos, QColor(255, 0, 0, 100));
-                        }
-                    }
-                }
-                
-                // Check for castling
-                // This is just for UI highlighting - the server will validate the actual move
-                if (pieceColor == PieceColor::WHITE) {
-                    // White king at starting position
-                    if (from.row == 0 && from.col == 4) {
-                        // Check kingside castling
-                        if (!getPieceAt(Position(0, 5)) && !getPieceAt(Position(0, 6)) && 
-                            getPieceAt(Position(0, 7)) && 
-                            getPieceAt(Position(0, 7))->getType() == PieceType::ROOK &&
-                            getPieceAt(Position(0, 7))->getColor() == PieceColor::WHITE) {
-                            
-                            highlightSquare(Position(0, 6), QColor(0, 255, 0, 100));
-                        }
-                        
-                        // Check queenside castling
-                        if (!getPieceAt(Position(0, 3)) && !getPieceAt(Position(0, 2)) && 
-                            !getPieceAt(Position(0, 1)) &&
-                            getPieceAt(Position(0, 0)) && 
-                            getPieceAt(Position(0, 0))->getType() == PieceType::ROOK &&
-                            getPieceAt(Position(0, 0))->getColor() == PieceColor::WHITE) {
-                            
-                            highlightSquare(Position(0, 2), QColor(0, 255, 0, 100));
-                        }
+                    clearHighlights();
+                    
+                    // Store the selected position and start drag
+                    selectedPosition = pos;
+                    dragStartPosition = pos;
+                    draggedPiece = piece;
+                    isDragging = false; // Will become true on mouse move
+                    
+                    // Store original position for snap-back
+                    Position boardPos = logicalToBoard(pos);
+                    dragOriginalPos = QPointF(boardPos.col * squareSize, boardPos.row * squareSize);
+                    
+                    // Highlight valid moves
+                    highlightValidMoves(pos);
+                    
+                    // Log the selection
+                    if (logger)
+                    {
+                        logger->debug(QString("Selected piece at (%1,%2) of type %3 and color %4")
+                            .arg(pos.row)
+                            .arg(pos.col)
+                            .arg(static_cast<int>(piece->getType()))
+                            .arg(piece->getColor() == PieceColor::WHITE ? "white" : "black"));
                     }
                 } else {
-                    // Black king at starting position
-                    if (from.row == 7 && from.col == 4) {
-                        // Check kingside castling
-                        if (!getPieceAt(Position(7, 5)) && !getPieceAt(Position(7, 6)) && 
-                            getPieceAt(Position(7, 7)) && 
-                            getPieceAt(Position(7, 7))->getType() == PieceType::ROOK &&
-                            getPieceAt(Position(7, 7))->getColor() == PieceColor::BLACK) {
-                            
-                            highlightSquare(Position(7, 6), QColor(0, 255, 0, 100));
-                        }
-                        
-                        // Check queenside castling
-                        if (!getPieceAt(Position(7, 3)) && !getPieceAt(Position(7, 2)) && 
-                            !getPieceAt(Position(7, 1)) &&
-                            getPieceAt(Position(7, 0)) && 
-                            getPieceAt(Position(7, 0))->getType() == PieceType::ROOK &&
-                            getPieceAt(Position(7, 0))->getColor() == PieceColor::BLACK) {
-                            
-                            highlightSquare(Position(7, 2), QColor(0, 255, 0, 100));
-                        }
-                    }
+                    // Not player's turn - don't allow selection
+                    if (logger) logger->debug("Cannot select piece - not your turn");
+                }
+            } else {
+                // Clicked on opponent's piece or empty square
+                if (selectedPosition.isValid()) {
+                    // Try to move the selected piece to this square
+                    handleDrop(pos);
+                    clearHighlights();
+                    selectedPosition = Position(); // Clear after move attempt
                 }
-                break;
             }
-            
-            default:
-                logger->warning(QString("Unknown piece type %1 in highlightValidMoves").arg(static_cast<int>(pieceType)));
-                break;
-        }
-        
-        // Log the number of highlighted squares
-        logger->debug(QString("Highlighted %1 valid moves for piece at (%2,%3)")
-                     .arg(highlightItems.size() - 1)  // Subtract 1 for the selected square highlight
-                     .arg(from.row)
-                     .arg(from.col));
-        
-    } catch (const std::exception& e) {
-        if (logger) {
-            logger->error(QString("Exception in highlightValidMoves(): %1").arg(e.what()));
-        } else {
-            qDebug() << "Exception in highlightValidMoves():" << e.what();
-        }
-    } catch (...) {
-        if (logger) {
-            logger->error("Unknown exception in highlightValidMoves()");
-        } else {
-            qDebug() << "Unknown exception in highlightValidMoves()";
         }
     }
+
+    QGraphicsView::mousePressEvent(event);
 }
 
-// Helper method to highlight moves in a specific direction (for bishop, rook, queen)
-void ChessBoardWidget::highlightDirectionalMoves(const Position& from, int rowDir, int colDir, PieceColor pieceColor) {
-    try {
-        Position pos(from.row + rowDir, from.col + colDir);
-        
-        while (pos.isValid()) {
-            ChessPieceItem* targetPiece = getPieceAt(pos);
-            
-            if (!targetPiece) {
-                // Empty square - valid move
-                highlightSquare(pos, QColor(0, 255, 0, 100));
-                pos.row += rowDir;
-                pos.col += colDir;
-            } else {
-                // Found a piece
-                if (targetPiece->getColor() != pieceColor) {
-                    // Opponent's piece - can capture
-                    highlightSquare(pos, QColor(255, 0, 0, 100));
-                }
-                break; // Stop in this direction
-            }
-        }
-    } catch (const std::exception& e) {
-        if (logger) {
-            logger->error(QString("Exception in highlightDirectionalMoves(): %1").arg(e.what()));
-        } else {
-            qDebug() << "Exception in highlightDirectionalMoves():" << e.what();
+void ChessBoardWidget::highlightValidMoves(const Position& from)
+{
+    // Clear any existing highlights
+    clearHighlights();
+    
+    // Highlight the selected piece's square
+    highlightSquare(from, QColor(100, 100, 255, 128));
+    
+    if (!localPosition.isLoaded()) {
+        return;
+    }
+    
+    // On the opponent's turn show where a premove could go; otherwise the legal moves
+    int count = 0;
+    if (localPosition.getSideToMove() != localPosition.colorAt(from)) {
+        for (const Position& target : localPosition.premoveTargets(from)) {
+            highlightSquare(target, PREMOVE_HIGHLIGHT_COLOR);
+            ++count;
         }
-    } catch (...) {
-        if (logger) {
-            logger->error("Unknown exception in highlightDirectionalMoves()");
-        } else {
-            qDebug() << "Unknown exception in highlightDirectionalMoves()";
+    } else {
+        for (const ChessMove& move : localPosition.legalMovesFrom(from)) {
+            // A promotion is listed once per piece but needs only one mark
+            if (move.getPromotionType() != PieceType::EMPTY && move.getPromotionType() != PieceType::QUEEN) {
+                continue;
+            }
+            highlightSquare(move.getTo(), localPosition.isCapture(move) ? QColor(255, 0, 0, 100) : QColor(0, 255, 0, 100));
+            ++count;
         }
     }
+    
+    if (logger) {
+        logger->debug(QString("Highlighted %1 moves for piece at (%2,%3)").arg(count).arg(from.row).arg(from.col));
+    }
 }
 
 void ChessBoardWidget::mouseMoveEvent(QMouseEvent* event)
@@ -2968,16 +3476,27 @@ void ChessBoardWidget::setupBoard()
             if (logger) logger->info("ChessBoardWidget::setupBoard() - Created new scene");
         }
         
-        // Create the board squares
-        createSquares();
+        // Background below everything, highlights above it but below the pieces
+        if (!boardBackground) {
+            boardBackground = new QGraphicsPixmapItem();
+            boardBackground->setZValue(0);
+            boardBackground->setTransformationMode(Qt::SmoothTransformation);
+            scene->addItem(boardBackground);
+        }
+        if (!highlightOverlay) {
+            highlightOverlay = new BoardHighlightItem(squareSize);
+            highlightOverlay->setZValue(0.5);
+            scene->addItem(highlightOverlay);
+        }
         
         if (logger) logger->info("ChessBoardWidget::setupBoard() - Setting scene rect");
         // Set the scene rect
         scene->setSceneRect(0, 0, 8 * squareSize, 8 * squareSize);
         
         if (logger) logger->info("ChessBoardWidget::setupBoard() - Fitting view");
-        // Fit the view to the scene
-        fitInView(scene->sceneRect(), Qt::KeepAspectRatio);
+        // Fit the view to the scene, which also renders the background
+        backgroundScale = 0.0;
+        fitBoardToView();
 
         if (logger) logger->info("ChessBoardWidget::setupBoard() - Finished");
     } catch (const std::exception& e) {
@@ -2994,9 +3513,6 @@ void ChessBoardWidget::updateBoardSize()
     // Update scene rect
     scene->setSceneRect(0, 0, 8 * squareSize, 8 * squareSize);
     
-    // Update square positions
-    createSquares();
-    
     // Update piece positions and sizes
     for (int r = 0; r < 8; ++r) {
         for (int c = 0; c < 8; ++c) {
@@ -3008,21 +3524,53 @@ void ChessBoardWidget::updateBoardSize()
         }
     }
     
-    // Update highlight positions
-    clearHighlights();
+    if (highlightOverlay) {
+        highlightOverlay->setSquareSize(squareSize);
+    }
+    updateHighlightOverlay();
     
-    // Update hint positions
-    clearMoveHints();
+    // Fit the view to the scene and render the background at the new size
+    backgroundScale = 0.0;
+    fitBoardToView();
+}
+
+void ChessBoardWidget::fitBoardToView()
+{
+    if (!scene) {
+        return;
+    }
     
-    // Fit the view to the scene
     fitInView(scene->sceneRect(), Qt::KeepAspectRatio);
+    
+    qreal scale = ThemeManager::roundRasterScale(std::hypot(transform().m11(), transform().m12()) *
+                                                 devicePixelRatioF());
+    if (!qFuzzyCompare(scale, backgroundScale)) {
+        backgroundScale = scale;
+        createSquares();
+    }
+}
+
+void ChessBoardWidget::updateHighlightOverlay()
+{
+    if (!highlightOverlay) {
+        return;
+    }
+    
+    QVector<BoardHighlightItem::Mark> marks;
+    for (const auto& highlight : highlightedSquares) {
+        marks.append({ logicalToBoard(highlight.first), highlight.second, false });
+    }
+    for (const auto& hint : hintSquares) {
+        marks.append({ logicalToBoard(hint.first), hint.second, true });
+    }
+    highlightOverlay->setMarks(marks);
 }
 
 void ChessBoardWidget::createSquares()
 {
     try {
-        if (!scene) {
-            logger->error("createSquares: scene is null");
+        if (!boardBackground) {
+            logger->error("createSquares: board background is null");
             return;
         }
         
@@ -3031,100 +3579,53 @@ void ChessBoardWidget::createSquares()
             return;
         }
         
-        logger->info("createSquares: Starting");
-        
-        // Remove existing squares and labels
-        // We need to be careful here - only remove items that are NOT pieces
-        QList<QGraphicsItem*> itemsToRemove;
-        
-        for (QGraphicsItem* item : scene->items()) {
-            // Check if this is a square (QGraphicsRectItem with zValue 0)
-            QGraphicsRectItem* rectItem = dynamic_cast<QGraphicsRectItem*>(item);
-            if (rectItem && rectItem->zValue() == 0) {
-                itemsToRemove.append(item);
-            }
-            
-            // Check if this is a label (QGraphicsTextItem with zValue 0.1)
-            QGraphicsTextItem* textItem = dynamic_cast<QGraphicsTextItem*>(item);
-            if (textItem && textItem->zValue() == 0.1) {
-                itemsToRemove.append(item);
-            }
-        }
-        
-        // Now remove and delete the items
-        for (QGraphicsItem* item : itemsToRemove) {
-            scene->removeItem(item);
-            delete item;
-        }
+        // Render at the resolution the board covers on screen
+        qreal scale = backgroundScale > 0.0 ? backgroundScale : devicePixelRatioF();
+        int boardSize = 8 * squareSize;
+        QPixmap background(QSize(boardSize, boardSize) * scale);
+        background.setDevicePixelRatio(scale);
         
-        logger->info(QString("createSquares: Removed %1 old squares/labels").arg(itemsToRemove.size()));
+        QPainter painter(&background);
+        painter.setRenderHint(QPainter::TextAntialiasing);
         
-        // Create new squares
         QColor lightColor = themeManager->getLightSquareColor();
         QColor darkColor = themeManager->getDarkSquareColor();
         
         for (int r = 0; r < 8; ++r) {
             for (int c = 0; c < 8; ++c) {
-                QGraphicsRectItem* square = new QGraphicsRectItem(
-                    c * squareSize, 
-                    r * squareSize, 
-                    squareSize, 
-                    squareSize
-                );
-                
-                if (!square) {
-                    logger->error(QString("Failed to create square at (%1,%2)").arg(r).arg(c));
-                    continue;
-                }
-                
-                square->setBrush(((r + c) % 2 == 0) ? lightColor : darkColor);
-                square->setPen(Qt::NoPen);
-                square->setZValue(0); // Ensure squares are below pieces
-                scene->addItem(square);
+                painter.fillRect(c * squareSize, r * squareSize, squareSize, squareSize,
+                                 ((r + c) % 2 == 0) ? lightColor : darkColor);
             }
         }
         
-        // Add rank and file labels with correct orientation
+        // Rank and file labels with correct orientation, drawn in the opposite square color
         QFont font;
         font.setPointSize(squareSize / 5);
+        painter.setFont(font);
+        qreal inset = squareSize * 0.08;
         
         for (int r = 0; r < 8; ++r) {
             // Rank labels (1-8)
             int displayRank = flipped ? (r + 1) : (8 - r);
-            QGraphicsTextItem* rankLabel = new QGraphicsTextItem(QString::number(displayRank));
-            
-            if (!rankLabel) {
-                logger->error(QString("Failed to create rank label for row %1").arg(r));
-                continue;
-            }
-            
-            rankLabel->setFont(font);
-            rankLabel->setDefaultTextColor((r % 2 == 0) ? darkColor : lightColor);
-            rankLabel->setPos(squareSize * 0.05, r * squareSize + squareSize * 0.05);
-            rankLabel->setZValue(0.1);
-            scene->addItem(rankLabel);
+            painter.setPen((r % 2 == 0) ? darkColor : lightColor);
+            painter.drawText(QRectF(inset, r * squareSize + inset, squareSize, squareSize),
+                             Qt::AlignLeft | Qt::AlignTop, QString::number(displayRank));
         }
         
         for (int c = 0; c < 8; ++c) {
             // File labels (a-h)
             char displayFile = flipped ? ('h' - c) : ('a' + c);
-            QGraphicsTextItem* fileLabel = new QGraphicsTextItem(QString(QChar(displayFile)));
-            
-            if (!fileLabel) {
-                logger->error(QString("Failed to create file label for col %1").arg(c));
-                continue;
-            }
-            
-            fileLabel->setFont(font);
-            fileLabel->setDefaultTextColor((c % 2 == 1) ? darkColor : lightColor);
-            fileLabel->setPos(c * squareSize + squareSize * 0.85, squareSize * 7.8);
-            fileLabel->setZValue(0.1);
-            scene->addItem(fileLabel);
+            painter.setPen((c % 2 == 1) ? darkColor : lightColor);
+            painter.drawText(QRectF(c * squareSize, 7 * squareSize, squareSize - inset, squareSize - inset),
+                             Qt::AlignRight | Qt::AlignBottom, QString(QChar(displayFile)));
         }
         
-        logger->info(QString("Created squares with flipped=%1, showing %2 perspective")
+        painter.end();
+        boardBackground->setPixmap(background);
+        
+        logger->debug(QString("Rendered board background with flipped=%1 at scale %2")
             .arg(flipped ? "true" : "false")
-            .arg(flipped ? "black" : "white"));
+            .arg(scale));
             
     } catch (const std::exception& e) {
         if (logger) {
@@ -3188,28 +3689,144 @@ void ChessBoardWidget::handleDrop(const Position& pos)
         return;
     }
     
+    Position from = selectedPosition;
+    ChessPieceItem* piece = getPieceAt(from);
+    if (!piece) {
+        return;
+    }
+    
+    // On the opponent's turn the move is queued as a premove, promoting to a queen
+    if (localPosition.isLoaded() && localPosition.getSideToMove() != piece->getColor()) {
+        snapBack(from);
+        if (!localPosition.premoveTargets(from).contains(pos)) {
+            clearPremove();
+            return;
+        }
+        
+        bool promotion = piece->getType() == PieceType::PAWN && (pos.row == 0 || pos.row == 7);
+        premove = ChessMove(from, pos, promotion ? PieceType::QUEEN : PieceType::EMPTY);
+        if (logger) logger->debug(QString("Queued premove %1").arg(premove->toAlgebraic()));
+        return;
+    }
+    
     // Check if this is a pawn promotion move
-    ChessPieceItem* piece = getPieceAt(selectedPosition);
-    if (piece && piece->getType() == PieceType::PAWN) {
+    if (piece->getType() == PieceType::PAWN) {
         int promotionRank = (piece->getColor() == PieceColor::WHITE) ? 7 : 0;
         if (pos.row == promotionRank) {
+            // A promotion the pawn cannot make does not need the dialog
+            if (localPosition.isLoaded() && !localPosition.isLegal(ChessMove(from, pos, PieceType::QUEEN))) {
+                submitMove(ChessMove(from, pos, PieceType::QUEEN));
+                selectedPosition = Position();
+                return;
+            }
+            
             // Show promotion dialog
-            showPromotionDialog(selectedPosition, pos, piece->getColor());
+            showPromotionDialog(from, pos, piece->getColor());
             selectedPosition = Position();
             return;
         }
     }
     
-    // Create the move
-    ChessMove move(selectedPosition, pos);
+    submitMove(ChessMove(from, pos));
+}
+
+bool ChessBoardWidget::submitMove(const ChessMove& move)
+{
+    if (localPosition.isLoaded()) {
+        if (!localPosition.isLegal(move)) {
+            if (logger) logger->debug(QString("Move %1 is not legal here, not sent").arg(move.toAlgebraic()));
+            snapBack(move.getFrom());
+            audioManager->playSoundEffect(AudioManager::SoundEffect::ERROR);
+            return false;
+        }
+        
+        // Show the move now; the server's answer either confirms it or rolls it back
+        bool capture = localPosition.isCapture(move);
+        localPosition.applyMove(move);
+        pendingMove = true;
+        showLocalPosition(true);
+        audioManager->playSoundEffect(capture ? AudioManager::SoundEffect::CAPTURE : AudioManager::SoundEffect::MOVE);
+    }
     
-    // Emit the move request
     emit moveRequested(currentGameId, move);
+    return true;
+}
+
+void ChessBoardWidget::snapBack(const Position& from)
+{
+    ChessPieceItem* piece = getPieceAt(from);
+    if (piece) {
+        Position boardPos = logicalToBoard(from);
+        piece->setPos(boardPos.col * squareSize, boardPos.row * squareSize);
+    }
+}
+
+void ChessBoardWidget::showLocalPosition(bool animate)
+{
+    std::array<std::array<SquareContent, 8>, 8> position;
+    for (int r = 0; r < 8; ++r) {
+        for (int c = 0; c < 8; ++c) {
+            position[r][c].type = localPosition.typeAt(Position(r, c));
+            position[r][c].color = localPosition.colorAt(Position(r, c));
+        }
+    }
+    setPosition(position, animate);
+}
+
+bool ChessBoardWidget::loadLocalPosition(const QJsonObject& gameState)
+{
+    LocalPosition incoming;
+    if (!incoming.loadGameState(gameState)) {
+        localPosition = LocalPosition();
+        pendingMove = false;
+        return true;
+    }
+    
+    // A state sent before the server played our move would undo it on screen
+    if (pendingMove && incoming.getPlyCount() < localPosition.getPlyCount()) {
+        return false;
+    }
+    
+    localPosition = incoming;
+    pendingMove = false;
+    return true;
+}
+
+void ChessBoardWidget::cancelPendingMove()
+{
+    pendingMove = false;
+}
+
+bool ChessBoardWidget::playPremove()
+{
+    if (!premove || !localPosition.isLoaded() || localPosition.getSideToMove() != playerColor) {
+        return false;
+    }
+    
+    ChessMove move = *premove;
+    clearPremove();
+    
+    if (!localPosition.isLegal(move)) {
+        if (logger) logger->debug(QString("Premove %1 is no longer legal, dropped").arg(move.toAlgebraic()));
+        return false;
+    }
+    
+    if (logger) logger->debug(QString("Playing premove %1").arg(move.toAlgebraic()));
+    return submitMove(move);
+}
+
+void ChessBoardWidget::clearPremove()
+{
+    if (!premove) {
+        return;
+    }
+    premove.reset();
+    clearHighlights();
+}
 
-    // Note: We don't reset selectedPosition here because we need to wait for server confirmation
-    // If the move is invalid, the piece will be reset in onMoveResult
-////// Reset selection
-//  selectedPosition = Position();
+bool ChessBoardWidget::hasPremove() const
+{
+    return premove.has_value();
 }
 
 void ChessBoardWidget::animatePieceMovement(ChessPieceItem* piece, const QPointF& startPos, const QPointF& endPos)
@@ -4813,7 +5430,7 @@ TimeControlType MatchmakingWidget::getSelectedTimeControl() const {
 
 // GameHistoryWidget implementation
 GameHistoryWidget::GameHistoryWidget(QWidget* parent)
-    : QWidget(parent) {
+    : QWidget(parent), nextCursor(0) {
     
     setupUI();
 }
@@ -4821,12 +5438,22 @@ GameHistoryWidget::GameHistoryWidget(QWidget* parent)
 GameHistoryWidget::~GameHistoryWidget() {
 }
 
-void GameHistoryWidget::setGameHistoryData(const QJsonArray& gameHistory) {
+void GameHistoryWidget::setGameHistoryData(const QJsonArray& gameHistory, qint64 nextCursor) {
+    this->nextCursor = nextCursor;
+    loadMoreButton->setEnabled(nextCursor > 0);
     populateGamesTable(gameHistory);
 }
 
+void GameHistoryWidget::appendGameHistoryData(const QJsonArray& gameHistory, qint64 nextCursor) {
+    this->nextCursor = nextCursor;
+    loadMoreButton->setEnabled(nextCursor > 0);
+    appendGamesToTable(gameHistory);
+}
+
 void GameHistoryWidget::clear() {
     gamesTable->setRowCount(0);
+    nextCursor = 0;
+    loadMoreButton->setEnabled(false);
 }
 
 void GameHistoryWidget::setupUI() {
@@ -4861,15 +5488,27 @@ void GameHistoryWidget::setupUI() {
     gamesTable->verticalHeader()->setVisible(false);
     gamesTable->setAlternatingRowColors(true);
     
+    // Older games are fetched a page at a time
+    loadMoreButton = new QPushButton("Load More", this);
+    loadMoreButton->setEnabled(false);
+    
     // Add widgets to main layout
     layout->addLayout(filterLayout);
     layout->addWidget(gamesTable);
+    layout->addWidget(loadMoreButton);
     
     setLayout(layout);
     
     // Connect signals
     connect(refreshButton, &QPushButton::clicked, this, &GameHistoryWidget::requestGameHistory);
     
+    connect(loadMoreButton, &QPushButton::clicked, this, [this]() {
+        if (nextCursor > 0) {
+            loadMoreButton->setEnabled(false);
+            emit requestMoreGameHistory(nextCursor);
+        }
+    });
+    
     connect(gamesTable, &QTableWidget::cellDoubleClicked, this, [this](int row, int column) {
         Q_UNUSED(column);
         
@@ -4882,40 +5521,47 @@ void GameHistoryWidget::setupUI() {
     
     connect(filterComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int index) {
         Q_UNUSED(index);
+        applyFilter();
+    });
+}
+
+void GameHistoryWidget::applyFilter() {
+    // Apply filter to the table
+    QString filter = filterComboBox->currentText();
+    
+    for (int row = 0; row < gamesTable->rowCount(); ++row) {
+        bool show = true;
         
-        // Apply filter to the table
-        QString filter = filterComboBox->currentText();
-        
-        for (int row = 0; row < gamesTable->rowCount(); ++row) {
-            bool show = true;
-            
-            if (filter != "All Games") {
-                QTableWidgetItem* resultItem = gamesTable->item(row, 3);
-                if (resultItem) {
-                    QString result = resultItem->text();
-                    
-                    if (filter == "Wins" && result != "Win") {
-                        show = false;
-                    } else if (filter == "Losses" && result != "Loss") {
-                        show = false;
-                    } else if (filter == "Draws" && result != "Draw") {
-                        show = false;
-                    } else if (filter == "In Progress" && result != "In Progress") {
-                        show = false;
-                    }
+        if (filter != "All Games") {
+            QTableWidgetItem* resultItem = gamesTable->item(row, 3);
+            if (resultItem) {
+                QString result = resultItem->text();
+                
+                if (filter == "Wins" && result != "Win") {
+                    show = false;
+                } else if (filter == "Losses" && result != "Loss") {
+                    show = false;
+                } else if (filter == "Draws" && result != "Draw") {
+                    show = false;
+                } else if (filter == "In Progress" && result != "In Progress") {
+                    show = false;
                 }
             }
-            
-            gamesTable->setRowHidden(row, !show);
         }
-    });
+        
+        gamesTable->setRowHidden(row, !show);
+    }
 }
 
 void GameHistoryWidget::populateGamesTable(const QJsonArray& games) {
     // Clear the table
     gamesTable->setRowCount(0);
     
-    // Add games
+    appendGamesToTable(games);
+}
+
+void GameHistoryWidget::appendGamesToTable(const QJsonArray& games) {
+    // Add games below the rows already shown
     for (const QJsonValue& value : games) {
         QJsonObject gameObj = value.toObject();
         
@@ -4973,9 +5619,7 @@ void GameHistoryWidget::populateGamesTable(const QJsonArray& games) {
     }
     
     // Apply current filter
-    int filterIndex = filterComboBox->currentIndex();
-    filterComboBox->setCurrentIndex(0);  // Reset to "All Games"
-    filterComboBox->setCurrentIndex(filterIndex);  // Re-apply filter
+    applyFilter();
 }
 
 // PromotionDialog implementation
@@ -5025,14 +5669,8 @@ void PromotionDialog::createPieceButton(PieceType type, const QString& label, QH
     QPushButton* button = new QPushButton(this);
     button->setMinimumSize(80, 80);
     
-    // Load piece SVG
-    QString svgFileName = ChessPiece(type, color).getSvgFileName(themeManager->getPieceThemePath());
-    QSvgRenderer renderer(svgFileName);
-    
-    QPixmap pixmap(64, 64);
-    pixmap.fill(Qt::transparent);
-    QPainter painter(&pixmap);
-    renderer.render(&painter);
+    // Piece sprite from the theme's atlas
+    QPixmap pixmap = themeManager->getPieceSprite(type, color, 64, devicePixelRatioF());
     
     button->setIcon(QIcon(pixmap));
     button->setIconSize(QSize(64, 64));
@@ -5394,7 +6032,7 @@ void SettingsDialog::saveSettings() {
 // GameManager implementation
 GameManager::GameManager(NetworkManager* networkManager, Logger* logger, QObject* parent)
     : QObject(parent), networkManager(networkManager), logger(logger),
-      playerColor(PieceColor::WHITE), gameActive(false) {
+      playerColor(PieceColor::WHITE), gameActive(false), stateSequence(-1) {
 }
 
 GameManager::~GameManager() {
@@ -5434,7 +6072,11 @@ void GameManager::startNewGame(const QJsonObject& gameData)
         // Store initial game state if available
         if (gameData.contains("gameState")) {
             currentGameState = gameData["gameState"].toObject();
+            stateSequence = currentGameState["sequence"].toInteger(-1);
+        } else {
+            stateSequence = -1;
         }
+        networkManager->setResumePoint(currentGameId, stateSequence);
         
         logger->info(QString("Starting new game: %1, You are playing as %2")
                     .arg(currentGameId)
@@ -5462,16 +6104,27 @@ void GameManager::updateGameState(const QJsonObject& gameState)
             return;
         }
         
+        // A delta is merged onto the last state; a gap means one was lost, so resync
+        QJsonObject fullState = gameState;
+        if (gameState["isDelta"].toBool() && !applyGameStateDelta(gameState, fullState)) {
+            logger->warning(QString("Game state delta %1 does not follow %2, requesting a full state")
+                .arg(gameState["sequence"].toInteger(-1)).arg(stateSequence));
+            networkManager->requestGameState(gameId);
+            return;
+        }
+        
         // Update current game state
-        currentGameState = gameState;
+        currentGameState = fullState;
+        stateSequence = fullState["sequence"].toInteger(-1);
+        networkManager->setResumePoint(gameId, stateSequence);
         
         // Parse move history if available
-        if (gameState.contains("moveHistory")) {
-            parseMoveHistory(gameState["moveHistory"].toArray());
+        if (fullState.contains("moveHistory")) {
+            parseMoveHistory(fullState["moveHistory"].toArray());
         }
         
         // Emit signal
-        emit gameStateUpdated(gameState);
+        emit gameStateUpdated(fullState);
         emit moveHistoryUpdated(moveHistory);
         
         logger->info("Game state updated successfully");
@@ -5482,6 +6135,71 @@ void GameManager::updateGameState(const QJsonObject& gameState)
     }
 }
 
+bool GameManager::applyGameStateDelta(const QJsonObject& delta, QJsonObject& merged) const
+{
+    if (stateSequence < 0 || !delta.contains("sequence") ||
+        delta["sequence"].toInteger() != stateSequence + 1) {
+        return false;
+    }
+    
+    merged = currentGameState;
+    
+    // Clocks, turn and status replace the previous values; captured lists come whole when they change
+    for (const QString& key : QStringList{ "sequence", "whiteRemainingTime", "blackRemainingTime", "currentTurn",
+                                           "isCheck", "isCheckmate", "isStalemate", "result", "drawOffered",
+                                           "whiteCaptured", "blackCaptured" }) {
+        if (delta.contains(key)) {
+            merged[key] = delta[key];
+        }
+    }
+    if (delta.contains("drawOfferingPlayer")) {
+        merged["drawOfferingPlayer"] = delta["drawOfferingPlayer"];
+    } else {
+        merged.remove("drawOfferingPlayer");
+    }
+    
+    // New moves start at moveIndex; anything past it came from a newer snapshot
+    QJsonArray history = merged["moveHistory"].toArray();
+    int moveIndex = delta["moveIndex"].toInt();
+    if (moveIndex > history.size()) {
+        return false;
+    }
+    while (history.size() > moveIndex) {
+        history.removeLast();
+    }
+    for (const QJsonValue& move : delta["moves"].toArray()) {
+        history.append(move);
+    }
+    merged["moveHistory"] = history;
+    
+    // Changed squares overwrite the board in place
+    QJsonArray board = merged["board"].toArray();
+    if (board.size() != 8) {
+        return false;
+    }
+    for (const QJsonValue& value : delta["squares"].toArray()) {
+        QJsonObject square = value.toObject();
+        int row = square["row"].toInt(-1);
+        int col = square["col"].toInt(-1);
+        if (row < 0 || row >= 8 || col < 0 || col >= 8) {
+            return false;
+        }
+        
+        QJsonObject pieceObj;
+        pieceObj["type"] = square["type"];
+        pieceObj["color"] = square["color"];
+        
+        QJsonArray rowArray = board[row].toArray();
+        rowArray[col] = pieceObj;
+        board[row] = rowArray;
+    }
+    merged["board"] = board;
+    
+    // Deltas don't carry the text board, so drop it rather than show a stale one
+    merged.remove("asciiBoard");
+    return true;
+}
+
 void GameManager::endGame(const QJsonObject& gameOverData) {
     // Set game as inactive
     gameActive = false;
@@ -5688,12 +6406,14 @@ MPChessClient::MPChessClient(QWidget* parent)
         connect(networkManager, &NetworkManager::authenticationResult, this, &MPChessClient::onAuthenticationResult);
         connect(networkManager, &NetworkManager::gameStarted, this, &MPChessClient::onGameStarted);
         connect(networkManager, &NetworkManager::gameStateUpdated, this, &MPChessClient::onGameStateUpdated);
+        connect(networkManager, &NetworkManager::gameStateDeltaReceived, gameManager, &GameManager::updateGameState);
         connect(networkManager, &NetworkManager::gameOver, this, &MPChessClient::onGameOver);
         connect(networkManager, &NetworkManager::moveResult, this, &MPChessClient::onMoveResult);
         connect(networkManager, &NetworkManager::moveRecommendationsReceived, this, &MPChessClient::onMoveRecommendationsReceived);
         connect(networkManager, &NetworkManager::matchmakingStatus, this, &MPChessClient::onMatchmakingStatusReceived);
         connect(networkManager, &NetworkManager::gameHistoryReceived, this, &MPChessClient::onGameHistoryReceived);
         connect(networkManager, &NetworkManager::gameAnalysisReceived, this, &MPChessClient::onGameAnalysisReceived);
+        connect(networkManager, &NetworkManager::gameAnalysisProgress, this, &MPChessClient::onGameAnalysisProgress);
         connect(networkManager, &NetworkManager::drawOfferReceived, this, &MPChessClient::onDrawOfferReceived);
         connect(networkManager, &NetworkManager::drawResponseReceived, this, &MPChessClient::onDrawResponseReceived);
         connect(networkManager, &NetworkManager::leaderboardReceived, this, &MPChessClient::onLeaderboardReceived);
@@ -6304,6 +7024,11 @@ void MPChessClient::onGameStateUpdated(const QJsonObject& gameState)
         // Update the board
         updateBoardFromGameState(gameState);
         
+        // The opponent has moved: send a queued premove before anything else is redrawn
+        if (!replayMode && gameManager->isGameActive()) {
+            boardWidget->playPremove();
+        }
+        
         // Update captured pieces
         updateCapturedPieces(gameState);
         
@@ -6385,7 +7110,9 @@ void MPChessClient::onMoveResult(bool success, const QString& message) {
         // Play error sound
         audioManager->playSoundEffect(AudioManager::SoundEffect::ERROR);
         
-        // Refresh board from last known good game state to fix any visual corruption
+        // Roll the board back to the last state the server sent, undoing the move
+        // that was shown before the server answered
+        boardWidget->cancelPendingMove();
         QJsonObject currentState = gameManager->getCurrentGameState();
         if (!currentState.isEmpty()) {
             updateBoardFromGameState(currentState);
@@ -6415,14 +7142,9 @@ void MPChessClient::onMoveRequested(const QString& gameId, const ChessMove& move
             logger->error("It's not your turn");
             showMessage("It's not your turn", true);
             
-            // Reset the piece to its original position
-            Position from = move.getFrom();
-            ChessPieceItem* piece = boardWidget->getPieceAt(from);
-            if (piece) {
-                Position boardPos = boardWidget->logicalToBoard(from);
-                piece->setPos(boardPos.col * boardWidget->getSquareSize(), 
-                             boardPos.row * boardWidget->getSquareSize());
-            }
+            // Undo the move on the board, which already shows it
+            boardWidget->cancelPendingMove();
+            updateBoardFromGameState(gameManager->getCurrentGameState());
             
             // Play error sound
             audioManager->playSoundEffect(AudioManager::SoundEffect::ERROR);
@@ -6667,14 +7389,27 @@ void MPChessClient::onRequestMatchmaking(bool join, TimeControlType timeControl)
     networkManager->requestMatchmaking(join, timeControl);
 }
 
-void MPChessClient::onGameHistoryReceived(const QJsonArray& gameHistory) {
+void MPChessClient::onGameHistoryReceived(const QJsonArray& gameHistory, qint64 nextCursor, bool append) {
     // Update game history widget
-    gameHistoryWidget->setGameHistoryData(gameHistory);
+    if (append) {
+        gameHistoryWidget->appendGameHistoryData(gameHistory, nextCursor);
+    } else {
+        gameHistoryWidget->setGameHistoryData(gameHistory, nextCursor);
+    }
 }
 
 void MPChessClient::onGameAnalysisReceived(const QJsonObject& analysis) {
     // Update analysis widget
     analysisWidget->setAnalysisData(analysis);
+    statusBar()->clearMessage();
+}
+
+void MPChessClient::onGameAnalysisProgress(const QString& gameId, int completed, int total) {
+    Q_UNUSED(gameId);
+    
+    // Long games take a while to analyze; show how far the server has got
+    int percent = total > 0 ? completed * 100 / total : 100;
+    statusBar()->showMessage(QString("Analyzing game... %1%").arg(percent));
 }
 
 void MPChessClient::onGameSelected(const QString& gameId) {
@@ -6690,6 +7425,11 @@ void MPChessClient::onRequestGameHistory() {
     networkManager->requestGameHistory();
 }
 
+void MPChessClient::onRequestMoreGameHistory(qint64 cursor) {
+    // Request the next page of older games
+    networkManager->requestGameHistory(cursor);
+}
+
 void MPChessClient::onRequestGameAnalysis(bool stockfish) {
     // Request game analysis
     QJsonObject data;
@@ -7002,6 +7742,7 @@ void MPChessClient::setupUI()
         connect(matchmakingWidget, &MatchmakingWidget::requestMatchmaking, this, &MPChessClient::onRequestMatchmaking);
         connect(gameHistoryWidget, &GameHistoryWidget::gameSelected, this, &MPChessClient::onGameSelected);
         connect(gameHistoryWidget, &GameHistoryWidget::requestGameHistory, this, &MPChessClient::onRequestGameHistory);
+        connect(gameHistoryWidget, &GameHistoryWidget::requestMoreGameHistory, this, &MPChessClient::onRequestMoreGameHistory);
         connect(analysisWidget, &AnalysisWidget::requestAnalysis, this, &MPChessClient::onRequestGameAnalysis);
         connect(leaderboardWidget, &LeaderboardWidget::requestAllPlayers, this, &MPChessClient::onRequestLeaderboard);
         
@@ -7432,14 +8173,14 @@ void MPChessClient::updateBoardFromGameState(const QJsonObject& gameState)
             return;
         }
         
-        // Clear the board but preserve player color and flip state
-        for (int r = 0; r < 8; ++r) {
-            for (int c = 0; c < 8; ++c) {
-                boardWidget->removePiece(Position(r, c));
-            }
+        // Keep showing a move still waiting for the server over an older state
+        if (!boardWidget->loadLocalPosition(gameState)) {
+            logger->info("updateBoardFromGameState - State predates the pending move, board kept");
+            return;
         }
         
-        // Set pieces
+        // Build the new position; the board then changes only the squares that differ
+        std::array<std::array<ChessBoardWidget::SquareContent, 8>, 8> position;
         for (int r = 0; r < 8; ++r) {
             QJsonArray rowArray = boardArray[r].toArray();
             if (rowArray.size() != 8) {
@@ -7472,11 +8213,12 @@ void MPChessClient::updateBoardFromGameState(const QJsonObject& gameState)
                     
                     PieceColor pieceColor = (color == "white") ? PieceColor::WHITE : PieceColor::BLACK;
                     
-                    // Set the piece at the correct position
-                    boardWidget->setPiece(Position(r, c), pieceType, pieceColor);
+                    position[r][c].type = pieceType;
+                    position[r][c].color = pieceColor;
                 }
             }
         }
+        boardWidget->setPosition(position);
         
         // Highlight last move if available
         if (gameState.contains("moveHistory") && !gameState["moveHistory"].toArray().isEmpty())
@@ -8,6 +8,9 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QtEndian>
 #include <QTimer>
 #include <QSettings>
 #include <QStackedWidget>
@@ -21,10 +24,13 @@
 #include <QGraphicsView>
 #include <QGraphicsScene>
 #include <QGraphicsItem>
+#include <QGraphicsPixmapItem>
 #include <QDragEnterEvent>
 #include <QDropEvent>
 #include <QMimeData>
 #include <QSvgRenderer>
+#include <QPixmap>
+#include <QHash>
 #include <QSoundEffect>
 #include <QMediaPlayer>
 #include <QAudioOutput>
@@ -70,6 +76,7 @@
 #include <QTextEdit>
 #include <QCoreApplication>
 
+#include <array>
 #include <vector>
 #include <map>
 #include <unordered_map>
@@ -85,6 +92,10 @@
 #include <sstream>
 #include <iostream>
 #include <iomanip>
+#include <cstring>
+#include <cctype>
+
+#include "MPChessMoveGen.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MPChessClient; }
@@ -191,7 +202,14 @@ enum class MessageType {
     DRAW_OFFER,
     DRAW_RESPONSE,
     LEADERBOARD_REQUEST,
-    LEADERBOARD_RESPONSE
+    LEADERBOARD_RESPONSE,
+    GAME_STATE_DELTA,
+    GAME_STATE_REQUEST,
+    SPECTATE,
+    GAME_ANALYSIS_PROGRESS,
+    NODE_REDIRECT,
+    TOURNAMENT,
+    TOURNAMENT_STATUS
 };
 
 /**
@@ -405,6 +423,112 @@ private:
     QString getCurrentTimestamp() const;
 };
 
+/**
+ * @brief Length-prefixed binary framing, negotiated per connection alongside JSON
+ *
+ * Frame layout (big-endian): uint32 size of the rest of the frame, uint8 MessageType,
+ * uint8 payload Encoding, payload. MOVE and MOVE_RESULT have packed payloads; GAME_STATE
+ * and every other type carry their fields as CBOR, with the GAME_STATE board packed into
+ * a 64-character placement string. Large CBOR payloads (history, analysis, leaderboard)
+ * can be sent compressed to clients that asked for it. A JSON message never starts with
+ * a zero byte and a frame always does, so a reader can tell them apart from the first byte.
+ */
+class WireProtocol {
+public:
+    enum class Encoding : uint8_t {
+        PACKED = 0,          // Type-specific packed fields
+        CBOR = 1,            // CBOR map of the message fields, without "type"
+        COMPRESSED_CBOR = 2  // The CBOR payload passed through qCompress()
+    };
+    
+    // Value of the "protocol" field a client sends with AUTHENTICATION to ask for binary frames
+    static constexpr const char* PROTOCOL_NAME = "binary-v1";
+    
+    // Value of the "compression" field a client sends with AUTHENTICATION if it can
+    // decode COMPRESSED_CBOR frames
+    static constexpr const char* COMPRESSION_NAME = "qcompress";
+    
+    // CBOR payloads smaller than this are never compressed (keeps MOVE/GAME_STATE cheap)
+    static constexpr int COMPRESSION_THRESHOLD = 8 * 1024;
+    
+    // Largest payload a compressed frame may expand to
+    static constexpr quint32 MAX_UNCOMPRESSED_SIZE = 32 * 1024 * 1024;
+    
+    // Length prefix plus type and encoding bytes
+    static constexpr int HEADER_SIZE = 6;
+    
+    // Largest frame either side will accept
+    static constexpr quint32 MAX_FRAME_SIZE = 4 * 1024 * 1024;
+    
+    // Encode a message (with its "type" field) as a complete frame; with compress set,
+    // large CBOR payloads are compressed when that makes them smaller
+    static QByteArray encode(const QJsonObject& message, bool compress = false);
+    
+    // Total size of the frame at data, 0 if the length prefix is not complete yet, -1 if it is too large
+    static qsizetype frameSize(const char* data, qsizetype available);
+    
+    // Decode a complete frame back into the message object the JSON path would have produced
+    static bool decode(const char* frame, qsizetype size, QJsonObject& message);
+    
+private:
+    static bool encodePacked(MessageType type, const QJsonObject& message, QByteArray& payload);
+    static bool decodePacked(MessageType type, const char* payload, qsizetype size, QJsonObject& message);
+    
+    // Pack "e7e8q" style moves into 16 bits: from (6), to (6), promotion (3)
+    static bool packMove(const QString& move, quint16& packed);
+    static QString unpackMove(quint16 packed);
+    
+    // Convert between the GAME_STATE board array and a 64-character placement string
+    static QString packBoard(const QJsonArray& board);
+    static QJsonArray unpackBoard(const QString& placement);
+};
+
+/**
+ * @brief Incremental receive buffer and message parser for the server connection
+ *
+ * Mirrors the server's MessageFramer: compact JSON objects and WireProtocol frames
+ * may arrive in any mix and split across reads. Each message boundary is found in a
+ * single pass over the new bytes, and each complete message is parsed once, in place.
+ */
+class MessageFramer {
+public:
+    enum class Status {
+        MESSAGE,     // A message was decoded
+        INCOMPLETE,  // Need more bytes
+        INVALID,     // A complete message could not be decoded; it was skipped
+        FATAL        // The stream cannot be framed (oversized or garbage)
+    };
+    
+    MessageFramer() : readOffset(0) { resetScan(); }
+    
+    // Append everything the device has available to the buffer
+    void readFrom(QIODevice* device);
+    
+    // Decode the next complete message, if any
+    Status next(QJsonObject& message, QString& error);
+    
+    // Drop everything buffered, for a new connection or after a FATAL status
+    void reset();
+    
+    qsizetype bufferedBytes() const { return buffer.size() - readOffset; }
+    
+private:
+    QByteArray buffer;
+    qsizetype readOffset;  // Start of the first unconsumed message
+    
+    // State of the JSON object scan, kept across reads so bytes are scanned once
+    qsizetype scanOffset;
+    int depth;
+    bool inString;
+    bool escaped;
+    
+    void resetScan() { scanOffset = -1; depth = 0; inString = false; escaped = false; }
+    void consume(qsizetype bytes);
+    
+    // Find the end of the JSON object at readOffset; -1 if it is not complete
+    qsizetype scanJsonObject();
+};
+
 /**
  * @brief Class for managing network communication with the server
  */
@@ -422,13 +546,17 @@ public:
     void authenticate(const QString& username, const QString& password, bool isRegistration = false);
     void sendMove(const QString& gameId, const ChessMove& move);
     void requestMatchmaking(bool join, TimeControlType timeControl = TimeControlType::RAPID);
-    void requestGameHistory();
+    void requestGameHistory(qint64 cursor = 0, int limit = 50);
     void requestGameAnalysis(const QString& gameId);
     void sendResignation(const QString& gameId);
     void sendDrawOffer(const QString& gameId);
     void sendDrawResponse(const QString& gameId, bool accepted);
     void requestLeaderboard(bool allPlayers = false, int count = 100);
+    void requestGameState(const QString& gameId);
     void sendPing();
+    
+    // The game and state sequence a reconnect resumes from
+    void setResumePoint(const QString& gameId, qint64 sequence);
 
 signals:
     void connected();
@@ -438,12 +566,14 @@ signals:
     void authenticationResult(bool success, const QString& message);
     void gameStarted(const QJsonObject& gameData);
     void gameStateUpdated(const QJsonObject& gameState);
+    void gameStateDeltaReceived(const QJsonObject& delta);
     void moveResult(bool success, const QString& message);
     void gameOver(const QJsonObject& gameOverData);
     void moveRecommendationsReceived(const QJsonArray& recommendations);
     void matchmakingStatus(const QJsonObject& statusData);
-    void gameHistoryReceived(const QJsonArray& gameHistory);
+    void gameHistoryReceived(const QJsonArray& gameHistory, qint64 nextCursor, bool append);
     void gameAnalysisReceived(const QJsonObject& analysis);
+    void gameAnalysisProgress(const QString& gameId, int completed, int total);
     void leaderboardReceived(const QJsonObject& leaderboard);
     void errorReceived(const QString& errorMessage);
     void chatMessageReceived(const QString& sender, const QString& message);
@@ -457,12 +587,35 @@ private slots:
     void onReadyRead();
     void onPingTimer();
     void emitConnectedSignal();
+    void attemptReconnect();
 
 private:
     Logger* logger;
     QTcpSocket* socket;
     QTimer* pingTimer;
-    QByteArray buffer;
+    MessageFramer framer;
+    bool binaryProtocol;  // Server accepted WireProtocol frames for this connection
+    
+    // A clustered server can send the client to another node, where it logs in again
+    // with the same credentials and repeats the matchmaking request that was redirected
+    QString authUsername;
+    QString authPassword;
+    QJsonObject matchmakingRequest;
+    bool redirecting;
+    bool resendMatchmaking;
+    
+    // A dropped connection is retried with the server's session token, which keeps the
+    // seat in a game in progress and replays the state the client missed
+    static constexpr int RECONNECT_ATTEMPTS = 5;
+    static constexpr int RECONNECT_DELAY_MS = 2000;
+    QString sessionToken;
+    QString resumeGameId;
+    qint64 resumeSequence;
+    QString serverHost;
+    int serverPort;
+    bool closingConnection;  // disconnectFromServer() was called; no reconnect
+    bool reconnecting;
+    int reconnectAttempts;
     
     void sendMessage(const QJsonObject& message);
     void processMessage(const QJsonObject& message);
@@ -472,17 +625,20 @@ private:
     void processAuthenticationResult(const QJsonObject& data);
     void processGameStart(const QJsonObject& data);
     void processGameState(const QJsonObject& data);
+    void processGameStateDelta(const QJsonObject& data);
     void processMoveResult(const QJsonObject& data);
     void processGameOver(const QJsonObject& data);
     void processMoveRecommendations(const QJsonObject& data);
     void processMatchmakingStatus(const QJsonObject& data);
     void processGameHistoryResponse(const QJsonObject& data);
     void processGameAnalysisResponse(const QJsonObject& data);
+    void processGameAnalysisProgress(const QJsonObject& data);
     void processLeaderboardResponse(const QJsonObject& data);
     void processError(const QJsonObject& data);
     void processChat(const QJsonObject& data);
     void processDrawOffer(const QJsonObject& data);
     void processDrawResponse(const QJsonObject& data);
+    void processNodeRedirect(const QJsonObject& data);
 };
 
 /**
@@ -533,6 +689,15 @@ private:
     QMediaPlayer* musicPlayer;
     QAudioOutput* musicOutput;
     
+    // Every effect is decoded once into SOUND_EFFECT_VOICES low-latency players that
+    // take turns, so a sound can start again while its last play is still running
+    static constexpr int SOUND_EFFECT_VOICES = 3;
+    struct SoundEffectVoices {
+        QVector<QSoundEffect*> voices;
+        int next = 0;
+    };
+    QMap<SoundEffect, SoundEffectVoices> soundEffects;
+    
     void loadSoundEffects();
 };
 
@@ -594,6 +759,14 @@ public:
     
     void setCustomPieceThemePath(const QString& path);
     
+    // A piece of the current theme rasterized at size device-independent pixels. Each
+    // sprite is rendered from its SVG once and kept until the piece theme changes
+    QPixmap getPieceSprite(PieceType type, PieceColor color, int size, qreal devicePixelRatio);
+    
+    // Round a rasterization scale up to an eighth, so resizing the window renders a
+    // new set of sprites every few pixels rather than on every pixel
+    static qreal roundRasterScale(qreal scale);
+    
     QColor getTextColor() const;
     QColor getBackgroundColor() const;
     QColor getPrimaryColor() const;
@@ -620,6 +793,12 @@ private:
     
     QString customPieceThemePath;
     
+    // Rasterized pieces by type, color, size and device pixel ratio. Sizes are few (the
+    // board's square size and the promotion dialog), so the atlas is simply dropped if
+    // resizing ever takes it past PIECE_SPRITE_LIMIT
+    static constexpr int PIECE_SPRITE_LIMIT = 12 * 8;
+    QHash<quint64, QPixmap> pieceSprites;
+    
     void loadThemeSettings();
     void saveThemeSettings();
     
@@ -661,10 +840,89 @@ private:
     PieceColor color;
     ThemeManager* themeManager;
     int squareSize;
-    QSvgRenderer renderer;
+    QPixmap sprite;  // Shared with every other item showing this piece at this size
     QPointF dragStartPosition;
     
-    void loadSvg();
+    // Take the sprite for the current theme and size from the theme manager's atlas
+    void loadSprite(qreal devicePixelRatio);
+};
+
+/**
+ * @brief One scene item drawing every highlighted square and move hint of the board
+ *
+ * Marks are given in board (screen) coordinates. Adding or removing a mark only
+ * invalidates its own square, so the view repaints just that region.
+ */
+class BoardHighlightItem : public QGraphicsItem {
+public:
+    struct Mark {
+        Position square;
+        QColor color;
+        bool hint;  // A dot in the middle of the square instead of filling it
+    };
+    
+    explicit BoardHighlightItem(int squareSize);
+    
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override;
+    
+    void setSquareSize(int size);
+    
+    void addMark(const Mark& mark);
+    void clearMarks(bool hints);
+    void setMarks(const QVector<Mark>& marks);
+
+private:
+    int squareSize;
+    QVector<Mark> marks;
+    
+    QRectF squareRect(const Position& square) const;
+};
+
+/**
+ * @brief Client-side copy of the game position, used to check moves before they are sent
+ *
+ * Moves come from MoveGenPosition, the generator MPChessPerft checks against the
+ * server's ChessBoard. GAME_STATE carries neither castling rights nor the en passant
+ * square, so both are derived from the move history when a state is loaded.
+ */
+class LocalPosition {
+public:
+    LocalPosition();
+
+    // The starting position with White to move
+    void reset();
+
+    // Take the board, side to move and move history of a GAME_STATE; false if it is malformed
+    bool loadGameState(const QJsonObject& gameState);
+    bool isLoaded() const;
+
+    PieceType typeAt(const Position& pos) const;
+    PieceColor colorAt(const Position& pos) const;
+    PieceColor getSideToMove() const;
+    int getPlyCount() const;
+
+    // Legal moves of the side to move; promotions appear once per promotion piece
+    QVector<ChessMove> legalMoves() const;
+    QVector<ChessMove> legalMovesFrom(const Position& from) const;
+    bool isLegal(const ChessMove& move) const;
+    bool isCapture(const ChessMove& move) const;
+
+    // Squares the piece on 'from' could reach once the opponent has moved, whatever
+    // that move is: its moves on an empty board, plus pawn captures and castling
+    QVector<Position> premoveTargets(const Position& from) const;
+
+    // Play a move without checking it, including the rook of a castling, the pawn
+    // taken en passant and a promotion (to a queen if the move names none)
+    void applyMove(const ChessMove& move);
+
+private:
+    MoveGenPosition position;
+    int plyCount;
+    bool loaded;
+
+    static int square(const Position& pos) { return pos.row * 8 + pos.col; }
+    static Position toPosition(int sq) { return Position(sq / 8, sq % 8); }
 };
 
 /**
@@ -684,6 +942,16 @@ public:
     void removePiece(const Position& pos);
     void movePiece(const Position& from, const Position& to, bool animate = true);
     
+    // What one square holds in a position passed to setPosition()
+    struct SquareContent {
+        PieceType type = PieceType::EMPTY;
+        PieceColor color = PieceColor::NONE;
+    };
+    
+    // Show a position, touching only the squares that differ from the board: pieces
+    // that moved keep their items and slide across, the rest are added or removed
+    void setPosition(const std::array<std::array<SquareContent, 8>, 8>& position, bool animate = true);
+    
     void setSquareSize(int size);
     int getSquareSize() const;
     
@@ -706,6 +974,18 @@ public:
     void showMoveHints(const QVector<Position>& positions);
     void clearMoveHints();
     
+    // Take the position of a GAME_STATE for local move checks. A state that is older
+    // than a move still waiting for the server is ignored and false is returned
+    bool loadLocalPosition(const QJsonObject& gameState);
+    
+    // Forget the move played locally but not yet confirmed, after the server rejected it
+    void cancelPendingMove();
+    
+    // Play the queued premove if it is legal now; false if there was none or it was dropped
+    bool playPremove();
+    void clearPremove();
+    bool hasPremove() const;
+    
     void setCurrentGameId(const QString& gameId);
     QString getCurrentGameId() const;
     
@@ -756,8 +1036,21 @@ private:
     bool isDragging;
     QPointF dragOriginalPos;
     
-    QVector<QGraphicsRectItem*> highlightItems;
-    QVector<QGraphicsEllipseItem*> hintItems;
+    // Highlights and move hints by logical square, all drawn by highlightOverlay
+    QVector<QPair<Position, QColor>> highlightedSquares;
+    QVector<QPair<Position, QColor>> hintSquares;
+    BoardHighlightItem* highlightOverlay;
+    
+    // Moves are checked and shown against this position before the server answers; a
+    // move played on it stays pending until a GAME_STATE at least that far arrives
+    LocalPosition localPosition;
+    bool pendingMove;
+    std::optional<ChessMove> premove;  // Sent as soon as it is the player's turn again
+    
+    // Squares and coordinates rendered into one pixmap, redrawn when the square size,
+    // orientation, board colors or on-screen scale change
+    QGraphicsPixmapItem* boardBackground;
+    qreal backgroundScale;
     
     ChessPieceItem* pieces[8][8];
     
@@ -766,12 +1059,23 @@ private:
     void createSquares();
     void updateBoardLayout();
     
+    // Scale the scene into the view, re-rendering the background if the scale changed
+    void fitBoardToView();
+    
+    // Rebuild highlightOverlay from the logical highlight and hint lists
+    void updateHighlightOverlay();
+    
     void startDrag(const Position& pos);
     void handleDrop(const Position& pos);
     
+    // Check a move against the local position, show it at once and send it; an
+    // illegal move is snapped back without a round trip to the server
+    bool submitMove(const ChessMove& move);
+    void snapBack(const Position& from);
+    void showLocalPosition(bool animate);
+    
     void animatePieceMovement(ChessPieceItem* piece, const QPointF& startPos, const QPointF& endPos);
     void highlightValidMoves(const Position& from);
-    void highlightDirectionalMoves(const Position& from, int rowDir, int colDir, PieceColor pieceColor);        // Helper method for highlighting directional moves (bishop, rook, queen)
 };
 
 /**
@@ -1049,20 +1353,26 @@ public:
     GameHistoryWidget(QWidget* parent = nullptr);
     ~GameHistoryWidget();
     
-    void setGameHistoryData(const QJsonArray& gameHistory);
+    void setGameHistoryData(const QJsonArray& gameHistory, qint64 nextCursor = 0);
+    void appendGameHistoryData(const QJsonArray& gameHistory, qint64 nextCursor);
     void clear();
 
 signals:
     void gameSelected(const QString& gameId);
     void requestGameHistory();
+    void requestMoreGameHistory(qint64 cursor);
 
 private:
     QTableWidget* gamesTable;
     QPushButton* refreshButton;
+    QPushButton* loadMoreButton;
     QComboBox* filterComboBox;
+    qint64 nextCursor;  // Cursor for the next older page, 0 once all games are shown
     
     void setupUI();
     void populateGamesTable(const QJsonArray& games);
+    void appendGamesToTable(const QJsonArray& games);
+    void applyFilter();
 };
 
 /**
@@ -1214,10 +1524,14 @@ private:
     bool gameActive;
     
     QJsonObject currentGameState;
+    qint64 stateSequence;  // Sequence of currentGameState; -1 until a full state arrives
     QVector<ChessMove> moveHistory;
     QJsonArray moveRecommendations;
     
     void parseMoveHistory(const QJsonArray& moveHistoryArray);
+    
+    // Apply a GAME_STATE_DELTA onto currentGameState; false on a sequence gap
+    bool applyGameStateDelta(const QJsonObject& delta, QJsonObject& merged) const;
 };
 
 /**
@@ -1282,10 +1596,12 @@ private slots:
     void onRequestMatchmaking(bool join, TimeControlType timeControl);
     
     // History and analysis slots
-    void onGameHistoryReceived(const QJsonArray& gameHistory);
+    void onGameHistoryReceived(const QJsonArray& gameHistory, qint64 nextCursor, bool append);
     void onGameAnalysisReceived(const QJsonObject& analysis);
+    void onGameAnalysisProgress(const QString& gameId, int completed, int total);
     void onGameSelected(const QString& gameId);
     void onRequestGameHistory();
+    void onRequestMoreGameHistory(qint64 cursor);
     void onRequestGameAnalysis(bool stockfish);
     
     // Leaderboard slots
@@ -0,0 +1,351 @@
+// MPChessMoveGen.cpp
+
+#include "MPChessMoveGen.h"
+
+#include <cstdlib>
+
+const MoveGenPosition::AttackTables& MoveGenPosition::attackTables() {
+    static const AttackTables tables = []() {
+        static const int knightOffsets[8][2] = { {2, 1}, {1, 2}, {-1, 2}, {-2, 1}, {-2, -1}, {-1, -2}, {1, -2}, {2, -1} };
+        static const int kingOffsets[8][2] = { {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1}, {-1, 0}, {-1, 1} };
+        auto onBoard = [](int row, int col) { return row >= 0 && row < 8 && col >= 0 && col < 8; };
+
+        AttackTables t{};
+        for (int sq = 0; sq < 64; ++sq) {
+            int row = sq / 8;
+            int col = sq % 8;
+            for (int i = 0; i < 8; ++i) {
+                int knightRow = row + knightOffsets[i][0];
+                int knightCol = col + knightOffsets[i][1];
+                if (onBoard(knightRow, knightCol)) t.knight[sq] |= 1ULL << (knightRow * 8 + knightCol);
+                int kingRow = row + kingOffsets[i][0];
+                int kingCol = col + kingOffsets[i][1];
+                if (onBoard(kingRow, kingCol)) t.king[sq] |= 1ULL << (kingRow * 8 + kingCol);
+
+                // Walk each ray, recording the squares passed on the way to every square on it
+                uint64_t ray = 0;
+                for (int r = kingRow, c = kingCol; onBoard(r, c); r += kingOffsets[i][0], c += kingOffsets[i][1]) {
+                    t.between[sq][r * 8 + c] = ray;
+                    ray |= 1ULL << (r * 8 + c);
+                }
+            }
+            for (int color = 0; color < 2; ++color) {
+                int captureRow = row + (color == WHITE ? 1 : -1);
+                if (captureRow < 0 || captureRow > 7) continue;
+                if (col > 0) t.pawn[color][sq] |= 1ULL << (captureRow * 8 + col - 1);
+                if (col < 7) t.pawn[color][sq] |= 1ULL << (captureRow * 8 + col + 1);
+            }
+        }
+        return t;
+    }();
+    return tables;
+}
+
+int MoveGenPosition::popLsb(uint64_t& bb) {
+#if defined(__GNUC__) || defined(__clang__)
+    int sq = __builtin_ctzll(bb);
+#else
+    int sq = 0;
+    while (!(bb & (1ULL << sq))) ++sq;
+#endif
+    bb &= bb - 1;
+    return sq;
+}
+
+uint64_t MoveGenPosition::slidingAttacks(int sq, uint64_t occupied, bool diagonal) {
+    static const int diagonalDirs[4][2] = { {1, 1}, {1, -1}, {-1, -1}, {-1, 1} };
+    static const int orthogonalDirs[4][2] = { {0, 1}, {1, 0}, {0, -1}, {-1, 0} };
+    const int (*dirs)[2] = diagonal ? diagonalDirs : orthogonalDirs;
+
+    uint64_t attacks = 0;
+    for (int d = 0; d < 4; ++d) {
+        int row = sq / 8 + dirs[d][0];
+        int col = sq % 8 + dirs[d][1];
+        while (row >= 0 && row < 8 && col >= 0 && col < 8) {
+            uint64_t b = 1ULL << (row * 8 + col);
+            attacks |= b;
+            if (occupied & b) {
+                break;
+            }
+            row += dirs[d][0];
+            col += dirs[d][1];
+        }
+    }
+    return attacks;
+}
+
+uint64_t MoveGenPosition::attackersTo(int sq, uint64_t occupied) const {
+    const AttackTables& t = attackTables();
+    uint64_t diagonal = piecesOf(BISHOP, WHITE) | piecesOf(BISHOP, BLACK) | piecesOf(QUEEN, WHITE) | piecesOf(QUEEN, BLACK);
+    uint64_t orthogonal = piecesOf(ROOK, WHITE) | piecesOf(ROOK, BLACK) | piecesOf(QUEEN, WHITE) | piecesOf(QUEEN, BLACK);
+    return (t.pawn[BLACK][sq] & piecesOf(PAWN, WHITE)) |
+           (t.pawn[WHITE][sq] & piecesOf(PAWN, BLACK)) |
+           (t.knight[sq] & (piecesOf(KNIGHT, WHITE) | piecesOf(KNIGHT, BLACK))) |
+           (t.king[sq] & (piecesOf(KING, WHITE) | piecesOf(KING, BLACK))) |
+           (slidingAttacks(sq, occupied, true) & diagonal & occupied) |
+           (slidingAttacks(sq, occupied, false) & orthogonal & occupied);
+}
+
+void MoveGenPosition::clear() {
+    pieces.fill(0);
+    occupancy.fill(0);
+    mailbox.fill(NO_PIECE);
+    sideToMove = WHITE;
+    castlingRights = 0;
+    enPassantSquare = -1;
+}
+
+void MoveGenPosition::addPiece(int sq, int type, int color) {
+    removePiece(sq);
+    int index = pieceIndex(type, color);
+    pieces[index] |= 1ULL << sq;
+    occupancy[color] |= 1ULL << sq;
+    mailbox[sq] = static_cast<uint8_t>(index);
+}
+
+void MoveGenPosition::removePiece(int sq) {
+    uint8_t index = mailbox[sq];
+    if (index == NO_PIECE) return;
+    pieces[index] &= ~(1ULL << sq);
+    occupancy[index / 6] &= ~(1ULL << sq);
+    mailbox[sq] = NO_PIECE;
+}
+
+void MoveGenPosition::reset() {
+    clear();
+    static const int backRank[8] = { ROOK, KNIGHT, BISHOP, QUEEN, KING, BISHOP, KNIGHT, ROOK };
+    for (int c = 0; c < 8; ++c) {
+        addPiece(c, backRank[c], WHITE);
+        addPiece(8 + c, PAWN, WHITE);
+        addPiece(48 + c, PAWN, BLACK);
+        addPiece(56 + c, backRank[c], BLACK);
+    }
+    castlingRights = WHITE_KINGSIDE | WHITE_QUEENSIDE | BLACK_KINGSIDE | BLACK_QUEENSIDE;
+}
+
+void MoveGenPosition::clearCastlingRights(int sq) {
+    switch (sq) {
+        case 4:  castlingRights &= ~(WHITE_KINGSIDE | WHITE_QUEENSIDE); break;
+        case 0:  castlingRights &= ~WHITE_QUEENSIDE; break;
+        case 7:  castlingRights &= ~WHITE_KINGSIDE; break;
+        case 60: castlingRights &= ~(BLACK_KINGSIDE | BLACK_QUEENSIDE); break;
+        case 56: castlingRights &= ~BLACK_QUEENSIDE; break;
+        case 63: castlingRights &= ~BLACK_KINGSIDE; break;
+        default: break;
+    }
+}
+
+uint64_t MoveGenPosition::premoveTargets(int sq) const {
+    int type = typeAt(sq);
+    int color = colorAt(sq);
+
+    const AttackTables& t = attackTables();
+    switch (type) {
+        case KNIGHT: return t.knight[sq];
+        case BISHOP: return slidingAttacks(sq, 0, true);
+        case ROOK:   return slidingAttacks(sq, 0, false);
+        case QUEEN:  return slidingAttacks(sq, 0, true) | slidingAttacks(sq, 0, false);
+        case KING: {
+            uint64_t reach = t.king[sq];
+            bool white = color == WHITE;
+            if (sq == (white ? 4 : 60)) {
+                if (castlingRights & (white ? WHITE_KINGSIDE : BLACK_KINGSIDE)) reach |= 1ULL << (sq + 2);
+                if (castlingRights & (white ? WHITE_QUEENSIDE : BLACK_QUEENSIDE)) reach |= 1ULL << (sq - 2);
+            }
+            return reach;
+        }
+        case PAWN: {
+            int forward = color == WHITE ? 8 : -8;
+            int startRow = color == WHITE ? 1 : 6;
+            uint64_t reach = t.pawn[color][sq];
+            if (sq + forward >= 0 && sq + forward < 64) reach |= 1ULL << (sq + forward);
+            if (sq / 8 == startRow) reach |= 1ULL << (sq + 2 * forward);
+            return reach;
+        }
+        default:
+            return 0;
+    }
+}
+
+void MoveGenPosition::applyMove(const MoveGenMove& move) {
+    int from = move.from;
+    int to = move.to;
+    if (from < 0 || from >= 64 || to < 0 || to >= 64) {
+        return;
+    }
+    int type = typeAt(from);
+    int color = colorAt(from);
+    if (type < 0) {
+        return;
+    }
+
+    if (type == PAWN && to == enPassantSquare) {
+        removePiece(to + (color == WHITE ? -8 : 8));
+    }
+    if (type == KING && std::abs(to - from) == 2) {
+        int rookFrom = to > from ? from + 3 : from - 4;
+        int rookTo = to > from ? from + 1 : from - 1;
+        removePiece(rookFrom);
+        addPiece(rookTo, ROOK, color);
+    }
+
+    removePiece(from);
+    if (type == PAWN && (to < 8 || to >= 56)) {
+        type = move.promotion < 0 ? QUEEN : move.promotion;
+    }
+    addPiece(to, type, color);
+
+    clearCastlingRights(from);
+    clearCastlingRights(to);
+    enPassantSquare = (typeAt(to) == PAWN && std::abs(to - from) == 16) ? (from + to) / 2 : -1;
+    sideToMove = color == WHITE ? BLACK : WHITE;
+}
+
+// Add a pawn move, expanding it into the four promotions on the last row
+static void addPawnMove(std::vector<MoveGenMove>& moves, int from, int to) {
+    if (to < 8 || to >= 56) {
+        for (int type : { MoveGenPosition::QUEEN, MoveGenPosition::ROOK, MoveGenPosition::BISHOP, MoveGenPosition::KNIGHT }) {
+            moves.push_back({ static_cast<int8_t>(from), static_cast<int8_t>(to), static_cast<int8_t>(type) });
+        }
+    } else {
+        moves.push_back({ static_cast<int8_t>(from), static_cast<int8_t>(to), -1 });
+    }
+}
+
+void MoveGenPosition::generateLegalMoves(std::vector<MoveGenMove>& moves) const
+{
+    moves.clear();
+
+    auto add = [&moves](int from, int to) {
+        moves.push_back({ static_cast<int8_t>(from), static_cast<int8_t>(to), -1 });
+    };
+
+    const AttackTables& t = attackTables();
+    int us = sideToMove;
+    int them = us == WHITE ? BLACK : WHITE;
+    uint64_t own = occupancy[us];
+    uint64_t enemy = occupancy[them];
+    uint64_t occupied = own | enemy;
+
+    uint64_t kingBit = piecesOf(KING, us);
+    if (!kingBit) {
+        return;
+    }
+    uint64_t kingCopy = kingBit;
+    int kingSq = popLsb(kingCopy);
+
+    // King moves: the destination must be safe with the king lifted off its square
+    uint64_t kingTargets = t.king[kingSq] & ~own;
+    while (kingTargets) {
+        int to = popLsb(kingTargets);
+        if (!(attackersTo(to, occupied ^ kingBit) & enemy)) {
+            add(kingSq, to);
+        }
+    }
+
+    uint64_t checkers = attackersTo(kingSq, occupied) & enemy;
+    if (checkers & (checkers - 1)) {
+        return;  // Double check: only the king can move
+    }
+
+    // Other pieces must capture the checker or block its ray when in check
+    uint64_t checkMask = ~0ULL;
+    if (checkers) {
+        uint64_t checkerCopy = checkers;
+        checkMask = checkers | t.between[kingSq][popLsb(checkerCopy)];
+    }
+
+    // Pinned pieces may only move along the line between the king and the pinner
+    uint64_t pinned = 0;
+    std::array<uint64_t, 64> pinRays;
+    uint64_t diagonal = piecesOf(BISHOP, them) | piecesOf(QUEEN, them);
+    uint64_t orthogonal = piecesOf(ROOK, them) | piecesOf(QUEEN, them);
+    uint64_t snipers = (slidingAttacks(kingSq, enemy, false) & orthogonal) |
+                       (slidingAttacks(kingSq, enemy, true) & diagonal);
+    while (snipers) {
+        int sniperSq = popLsb(snipers);
+        uint64_t between = t.between[kingSq][sniperSq];
+        uint64_t blockers = between & occupied;
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & own)) {
+            uint64_t blockerCopy = blockers;
+            pinned |= blockers;
+            pinRays[popLsb(blockerCopy)] = between | (1ULL << sniperSq);
+        }
+    }
+
+    auto allowedTargets = [&](int from) {
+        return (pinned & (1ULL << from)) ? checkMask & pinRays[from] : checkMask;
+    };
+
+    // Knights, bishops, rooks and queens
+    for (int type : { KNIGHT, BISHOP, ROOK, QUEEN }) {
+        uint64_t pieceSet = piecesOf(type, us);
+        while (pieceSet) {
+            int from = popLsb(pieceSet);
+            uint64_t targets;
+            switch (type) {
+                case KNIGHT: targets = t.knight[from]; break;
+                case BISHOP: targets = slidingAttacks(from, occupied, true); break;
+                case ROOK:   targets = slidingAttacks(from, occupied, false); break;
+                default:     targets = slidingAttacks(from, occupied, true) | slidingAttacks(from, occupied, false); break;
+            }
+            targets &= ~own & allowedTargets(from);
+
+            while (targets) {
+                add(from, popLsb(targets));
+            }
+        }
+    }
+
+    // Pawns
+    int forward = us == WHITE ? 8 : -8;
+    int startRow = us == WHITE ? 1 : 6;
+    uint64_t pawns = piecesOf(PAWN, us);
+    while (pawns) {
+        int from = popLsb(pawns);
+        uint64_t allowed = allowedTargets(from);
+
+        int to = from + forward;
+        if (to >= 0 && to < 64 && mailbox[to] == NO_PIECE) {
+            if (allowed & (1ULL << to)) {
+                addPawnMove(moves, from, to);
+            }
+            int doubleTo = to + forward;
+            if (from / 8 == startRow && mailbox[doubleTo] == NO_PIECE && (allowed & (1ULL << doubleTo))) {
+                add(from, doubleTo);
+            }
+        }
+
+        uint64_t captures = t.pawn[us][from] & enemy & allowed;
+        while (captures) {
+            addPawnMove(moves, from, popLsb(captures));
+        }
+
+        // En passant: replay the capture on the occupancy, since it can uncover
+        // a check along the row that pin detection does not see
+        if (enPassantSquare >= 0 && (t.pawn[us][from] & (1ULL << enPassantSquare))) {
+            int capturedSq = enPassantSquare - forward;
+            uint64_t after = (occupied ^ (1ULL << from) ^ (1ULL << capturedSq)) | (1ULL << enPassantSquare);
+            if (!(attackersTo(kingSq, after) & enemy & ~(1ULL << capturedSq))) {
+                add(from, enPassantSquare);
+            }
+        }
+    }
+
+    // Castling: not out of check, through an occupied square or across an attacked one
+    if (!checkers) {
+        bool white = us == WHITE;
+        int row = white ? 0 : 7;
+        auto empty = [&](int col) { return mailbox[row * 8 + col] == NO_PIECE; };
+        auto safe = [&](int col) { return !(attackersTo(row * 8 + col, occupied) & enemy); };
+
+        if ((castlingRights & (white ? WHITE_KINGSIDE : BLACK_KINGSIDE)) &&
+            empty(5) && empty(6) && safe(5) && safe(6)) {
+            add(kingSq, row * 8 + 6);
+        }
+        if ((castlingRights & (white ? WHITE_QUEENSIDE : BLACK_QUEENSIDE)) &&
+            empty(1) && empty(2) && empty(3) && safe(3) && safe(2)) {
+            add(kingSq, row * 8 + 2);
+        }
+    }
+}
@@ -0,0 +1,103 @@
+// MPChessMoveGen.h
+
+#ifndef MP_CHESS_MOVEGEN_H
+#define MP_CHESS_MOVEGEN_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A move from MoveGenPosition: squares are row * 8 + col, promotion a piece type or -1
+ */
+struct MoveGenMove {
+    int8_t from;
+    int8_t to;
+    int8_t promotion;
+
+    bool operator==(const MoveGenMove& other) const {
+        return from == other.from && to == other.to && promotion == other.promotion;
+    }
+    bool operator!=(const MoveGenMove& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Legal move generator shared by the client and the server's perft check
+ *
+ * Built on the standard library alone, so the client and server compile the same
+ * code with their own types around it. Piece types and colors are numbered as in
+ * the PieceType and PieceColor enums of both (pawn 0 to king 5, white 0, black 1),
+ * squares are row * 8 + col with row 0 White's back rank, and castling rights use
+ * BitboardPosition's flags. Moves other than the king's are limited by a check mask
+ * and pin rays.
+ */
+struct MoveGenPosition {
+    static constexpr int PAWN = 0;
+    static constexpr int KNIGHT = 1;
+    static constexpr int BISHOP = 2;
+    static constexpr int ROOK = 3;
+    static constexpr int QUEEN = 4;
+    static constexpr int KING = 5;
+    static constexpr int WHITE = 0;
+    static constexpr int BLACK = 1;
+
+    static constexpr uint8_t NO_PIECE = 12;
+    static constexpr uint8_t WHITE_KINGSIDE = 1;
+    static constexpr uint8_t WHITE_QUEENSIDE = 2;
+    static constexpr uint8_t BLACK_KINGSIDE = 4;
+    static constexpr uint8_t BLACK_QUEENSIDE = 8;
+
+    // Leaper attacks and the squares between two squares on a line, built on first use
+    struct AttackTables {
+        std::array<uint64_t, 64> knight;
+        std::array<uint64_t, 64> king;
+        std::array<std::array<uint64_t, 64>, 2> pawn;
+        std::array<std::array<uint64_t, 64>, 64> between;
+    };
+    static const AttackTables& attackTables();
+
+    std::array<uint64_t, 12> pieces;    // One bitboard per piece type and color
+    std::array<uint64_t, 2> occupancy;  // Occupied squares per color
+    std::array<uint8_t, 64> mailbox;    // Piece index per square, NO_PIECE if empty
+    int sideToMove;
+    uint8_t castlingRights;
+    int enPassantSquare;                // -1 if none
+
+    MoveGenPosition() { clear(); }
+
+    static int pieceIndex(int type, int color) { return color * 6 + type; }
+    static int popLsb(uint64_t& bb);
+
+    // Bishop or rook attacks from a square, walking each ray up to the first blocker
+    static uint64_t slidingAttacks(int sq, uint64_t occupied, bool diagonal);
+
+    // Piece type and color on a square, -1 if it is empty
+    int typeAt(int sq) const { return mailbox[sq] == NO_PIECE ? -1 : mailbox[sq] % 6; }
+    int colorAt(int sq) const { return mailbox[sq] == NO_PIECE ? -1 : mailbox[sq] / 6; }
+
+    uint64_t piecesOf(int type, int color) const { return pieces[pieceIndex(type, color)]; }
+    uint64_t attackersTo(int sq, uint64_t occupied) const;
+
+    void clear();
+    void addPiece(int sq, int type, int color);
+    void removePiece(int sq);
+
+    // The starting position with White to move
+    void reset();
+
+    // Update castling rights for a move from or to a king or rook home square
+    void clearCastlingRights(int sq);
+
+    // Legal moves of the side to move; promotions appear once per promotion piece
+    void generateLegalMoves(std::vector<MoveGenMove>& moves) const;
+
+    // Squares the piece on sq could reach once the opponent has moved, whatever that
+    // move is: its moves on an empty board, plus pawn captures and castling
+    uint64_t premoveTargets(int sq) const;
+
+    // Play a move without checking it, including the rook of a castling, the pawn
+    // taken en passant and a promotion (to a queen if the move names none)
+    void applyMove(const MoveGenMove& move);
+};
+
+#endif // MP_CHESS_MOVEGEN_H
@@ -0,0 +1,377 @@
+// MPChessBench.cpp
+//
+// Microbenchmarks of the server paths outside move generation that show up in
+// profiles: game state JSON, board serialization, network message logging,
+// matchmaking and leaderboard updates, each on a fixture of realistic size. Like
+// Google Benchmark, each benchmark runs its loop with more iterations until it
+// takes --min-time, and the report gives the time per iteration; --json writes the
+// results in Google Benchmark's JSON format for comparing runs and tracking trends.
+// MPChessPerft covers the move generator.
+
+#include "MPChessServer.h"
+
+#include <QTemporaryDir>
+#include <regex>
+
+/**
+ * @brief The timed loop of one benchmark run, in the shape of benchmark::State
+ */
+class BenchmarkState {
+public:
+    explicit BenchmarkState(int64_t iterations) : iterations(iterations), remaining(iterations) {}
+
+    // True while iterations remain; the clock starts on the first call
+    bool keepRunning() {
+        if (remaining == iterations) {
+            running = true;
+            started = std::chrono::steady_clock::now();
+        }
+        if (remaining-- > 0) {
+            return true;
+        }
+        pauseTiming();
+        return false;
+    }
+
+    // Leave per-iteration setup out of the measured time
+    void pauseTiming() {
+        if (running) {
+            elapsed += std::chrono::steady_clock::now() - started;
+            running = false;
+        }
+    }
+
+    void resumeTiming() {
+        if (!running) {
+            running = true;
+            started = std::chrono::steady_clock::now();
+        }
+    }
+
+    // Items handled by the whole run, reported as items per second
+    void setItemsProcessed(int64_t items) { itemsProcessed = items; }
+
+    int64_t getIterations() const { return iterations; }
+    int64_t getItemsProcessed() const { return itemsProcessed; }
+    double getSeconds() const { return std::chrono::duration<double>(elapsed).count(); }
+
+private:
+    int64_t iterations;
+    int64_t remaining;
+    int64_t itemsProcessed = 0;
+    bool running = false;
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::duration elapsed{0};
+};
+
+// Keep a result alive so the work that produced it is not optimized away
+template <typename T>
+static void doNotOptimize(const T& value)
+{
+    static const void* volatile sink;
+    sink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+/**
+ * @brief A game played out to a given number of plies with two players that own it
+ */
+struct GameFixture {
+    ChessPlayer white{"bench-white"};
+    ChessPlayer black{"bench-black"};
+    std::unique_ptr<ChessGame> game;
+};
+
+// A random game that is still going after the given number of plies; the same every run
+static const GameFixture& gameFixture(int plies)
+{
+    static std::map<int, std::unique_ptr<GameFixture>> fixtures;
+    std::unique_ptr<GameFixture>& fixture = fixtures[plies];
+    if (fixture) {
+        return *fixture;
+    }
+
+    for (uint32_t seed = 1;; ++seed) {
+        fixture = std::make_unique<GameFixture>();
+        fixture->game = std::make_unique<ChessGame>(&fixture->white, &fixture->black,
+                                                    "bench-" + std::to_string(plies), TimeControlType::CLASSICAL);
+        ChessGame& game = *fixture->game;
+        game.start();
+
+        std::mt19937 random(seed);
+        int played = 0;
+        while (played < plies && !game.isOver()) {
+            std::vector<ChessMove> moves = game.getBoard()->getAllValidMoves(game.getBoard()->getCurrentTurn());
+            ChessMove move = moves[std::uniform_int_distribution<size_t>(0, moves.size() - 1)(random)];
+            if (game.processMove(game.getCurrentPlayer(), move) != MoveValidationStatus::VALID) {
+                break;
+            }
+            ++played;
+        }
+        if (played == plies && !game.isOver()) {
+            return *fixture;
+        }
+    }
+}
+
+static constexpr int GAME_PLIES = 80;
+static constexpr int QUEUED_PLAYERS = 10000;
+static constexpr int LEADERBOARD_PLAYERS = 1000000;
+
+static void benchGameStateJson(BenchmarkState& state)
+{
+    const ChessGame& game = *gameFixture(GAME_PLIES).game;
+    while (state.keepRunning()) {
+        QJsonObject json = game.getGameStateJson();
+        doNotOptimize(json);
+    }
+}
+
+static void benchSerializeBoard(BenchmarkState& state)
+{
+    const ChessBoard& board = *gameFixture(GAME_PLIES).game->getBoard();
+    ChessSerializer serializer;
+    while (state.keepRunning()) {
+        QJsonObject json = serializer.serializeBoard(board);
+        doNotOptimize(json);
+    }
+}
+
+// Enqueue cost on the calling thread; the writer thread formats the entries
+static void benchLogNetworkMessage(BenchmarkState& state, int logLevel)
+{
+    static QTemporaryDir logDir;
+    static ChessLogger logger(logDir.filePath("bench.log").toStdString());
+    logger.setLogLevel(logLevel);
+
+    // A game state as the server sends it after a move
+    QJsonObject message;
+    message["type"] = static_cast<int>(MessageType::GAME_STATE);
+    message["gameState"] = gameFixture(GAME_PLIES).game->getGameStateJson();
+
+    // Drain the queue now and then so the run measures enqueueing, not dropping
+    static constexpr int64_t DRAIN_INTERVAL = 4096;
+    int64_t sinceDrain = 0;
+    while (state.keepRunning()) {
+        logger.logNetworkMessage("SEND", message);
+        if (++sinceDrain == DRAIN_INTERVAL) {
+            state.pauseTiming();
+            logger.flush();
+            sinceDrain = 0;
+            state.resumeTiming();
+        }
+    }
+    state.pauseTiming();
+    logger.flush();
+}
+
+// One matchmaking tick over a full queue with ratings spread like a real player base
+static void benchMatchPlayers(BenchmarkState& state)
+{
+    static std::vector<std::unique_ptr<ChessPlayer>> players;
+    if (players.empty()) {
+        std::mt19937 random(42);
+        std::normal_distribution<double> rating(1500.0, 300.0);
+        for (int i = 0; i < QUEUED_PLAYERS; ++i) {
+            players.push_back(std::make_unique<ChessPlayer>("queued-" + std::to_string(i)));
+            players.back()->setRating(std::clamp(static_cast<int>(rating(random)), 100, 3000));
+        }
+    }
+
+    ChessMatchmaker matchmaker;
+    size_t matched = 0;
+    while (state.keepRunning()) {
+        state.pauseTiming();
+        matchmaker.clearQueue();
+        for (const std::unique_ptr<ChessPlayer>& player : players) {
+            matchmaker.addPlayer(player.get());
+        }
+        state.resumeTiming();
+
+        auto matches = matchmaker.matchPlayers();
+        matched += matches.size();
+        doNotOptimize(matches);
+    }
+    state.setItemsProcessed(state.getIterations() * QUEUED_PLAYERS);
+    if (state.getIterations() > 0 && matched == 0) {
+        std::cerr << "matchPlayers() matched nobody" << std::endl;
+    }
+}
+
+// A rating change of one player in a full leaderboard
+static void benchLeaderboardUpdatePlayer(BenchmarkState& state)
+{
+    static QTemporaryDir dataDir;
+    static std::unique_ptr<ChessLeaderboard> leaderboard;
+    static std::vector<ChessPlayer> players;
+    if (!leaderboard) {
+        leaderboard = std::make_unique<ChessLeaderboard>(dataDir.path().toStdString());
+        std::mt19937 random(7);
+        std::normal_distribution<double> rating(1500.0, 300.0);
+        std::uniform_int_distribution<int> games(0, 200);
+        players.reserve(LEADERBOARD_PLAYERS);
+        for (int i = 0; i < LEADERBOARD_PLAYERS; ++i) {
+            QJsonObject json;
+            json["username"] = QString("ranked-%1").arg(i);
+            json["rating"] = std::clamp(static_cast<int>(rating(random)), 100, 3000);
+            json["wins"] = games(random);
+            json["losses"] = games(random);
+            json["draws"] = games(random) / 4;
+            players.push_back(ChessPlayer::fromJson(json));
+        }
+        leaderboard->updatePlayers(players);
+    }
+
+    std::mt19937 random(11);
+    std::uniform_int_distribution<size_t> pick(0, players.size() - 1);
+    std::uniform_int_distribution<int> change(-16, 16);
+    while (state.keepRunning()) {
+        state.pauseTiming();
+        ChessPlayer& player = players[pick(random)];
+        player.setRating(std::max(100, player.getRating() + change(random)));
+        state.resumeTiming();
+
+        leaderboard->updatePlayer(player);
+    }
+}
+
+/**
+ * @brief A registered benchmark and its result
+ */
+struct Benchmark {
+    std::string name;
+    std::function<void(BenchmarkState&)> run;
+};
+
+static const std::vector<Benchmark> BENCHMARKS = {
+    { "GameStateJson/" + std::to_string(GAME_PLIES), benchGameStateJson },
+    { "SerializeBoard/" + std::to_string(GAME_PLIES), benchSerializeBoard },
+    { "LogNetworkMessage/enabled", [](BenchmarkState& state) { benchLogNetworkMessage(state, 3); } },
+    { "LogNetworkMessage/disabled", [](BenchmarkState& state) { benchLogNetworkMessage(state, 0); } },
+    { "MatchPlayers/" + std::to_string(QUEUED_PLAYERS), benchMatchPlayers },
+    { "LeaderboardUpdatePlayer/" + std::to_string(LEADERBOARD_PLAYERS), benchLeaderboardUpdatePlayer }
+};
+
+// Grow the iteration count until one run takes minSeconds, as Google Benchmark does
+static BenchmarkState runBenchmark(const Benchmark& benchmark, double minSeconds)
+{
+    static constexpr int64_t MAX_ITERATIONS = 1000000000;
+    int64_t iterations = 1;
+    for (;;) {
+        BenchmarkState state(iterations);
+        benchmark.run(state);
+        double seconds = state.getSeconds();
+        if (seconds >= minSeconds || iterations >= MAX_ITERATIONS) {
+            return state;
+        }
+
+        double multiplier = seconds > 0 ? minSeconds * 1.4 / seconds : 10.0;
+        multiplier = std::min(std::max(multiplier, 2.0), 10.0);
+        iterations = std::min(MAX_ITERATIONS, static_cast<int64_t>(iterations * multiplier));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // Parse command line arguments
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Microbenchmarks of the Multiplayer Chess server hot paths");
+    parser.addHelpOption();
+
+    QCommandLineOption filterOption(QStringList() << "f" << "filter",
+                                    "Run only the benchmarks whose name matches this regular expression",
+                                    "regex", ".*");
+    parser.addOption(filterOption);
+
+    QCommandLineOption minTimeOption(QStringList() << "min-time",
+                                     "Seconds each benchmark runs for at least (default: 0.5)",
+                                     "seconds", "0.5");
+    parser.addOption(minTimeOption);
+
+    QCommandLineOption jsonOption(QStringList() << "json",
+                                  "Also write the results to this file in Google Benchmark's JSON format",
+                                  "file");
+    parser.addOption(jsonOption);
+
+    QCommandLineOption listOption(QStringList() << "list", "List the benchmarks and exit");
+    parser.addOption(listOption);
+
+    parser.process(app);
+
+    std::regex filter;
+    try {
+        filter = std::regex(parser.value(filterOption).toStdString());
+    } catch (const std::regex_error& e) {
+        std::cerr << "Invalid filter: " << e.what() << std::endl;
+        return 1;
+    }
+    double minSeconds = std::max(0.0, parser.value(minTimeOption).toDouble());
+
+    std::vector<const Benchmark*> selected;
+    for (const Benchmark& benchmark : BENCHMARKS) {
+        if (std::regex_search(benchmark.name, filter)) {
+            selected.push_back(&benchmark);
+        }
+    }
+    if (parser.isSet(listOption)) {
+        for (const Benchmark* benchmark : selected) {
+            std::cout << benchmark->name << std::endl;
+        }
+        return 0;
+    }
+    if (selected.empty()) {
+        std::cerr << "No benchmark matches " << parser.value(filterOption).toStdString() << std::endl;
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(36) << "Benchmark" << std::right << std::setw(16) << "Time"
+              << std::setw(14) << "Iterations" << std::setw(16) << "Items/s" << std::endl;
+    std::cout << std::string(82, '-') << std::endl;
+
+    QJsonArray results;
+    for (const Benchmark* benchmark : selected) {
+        BenchmarkState state = runBenchmark(*benchmark, minSeconds);
+        double nanoseconds = state.getSeconds() * 1e9 / std::max<int64_t>(state.getIterations(), 1);
+        double itemsPerSecond = state.getItemsProcessed() > 0 && state.getSeconds() > 0
+            ? state.getItemsProcessed() / state.getSeconds() : 0.0;
+
+        std::cout << std::left << std::setw(36) << benchmark->name << std::right << std::setw(13) << std::fixed
+                  << std::setprecision(0) << nanoseconds << " ns" << std::setw(14) << state.getIterations();
+        if (itemsPerSecond > 0) {
+            std::cout << std::setw(16) << std::setprecision(0) << itemsPerSecond;
+        }
+        std::cout << std::endl;
+
+        QJsonObject result;
+        result["name"] = QString::fromStdString(benchmark->name);
+        result["run_type"] = "iteration";
+        result["iterations"] = static_cast<qint64>(state.getIterations());
+        result["real_time"] = nanoseconds;
+        result["time_unit"] = "ns";
+        if (itemsPerSecond > 0) {
+            result["items_per_second"] = itemsPerSecond;
+        }
+        results.append(result);
+    }
+
+    if (parser.isSet(jsonOption)) {
+        QJsonObject context;
+        context["date"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+        context["executable"] = QCoreApplication::applicationFilePath();
+        context["num_cpus"] = QThread::idealThreadCount();
+        context["min_time"] = minSeconds;
+
+        QJsonObject report;
+        report["context"] = context;
+        report["benchmarks"] = results;
+
+        QSaveFile file(parser.value(jsonOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(report).toJson()) < 0 || !file.commit()) {
+            std::cerr << "Cannot write " << parser.value(jsonOption).toStdString() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
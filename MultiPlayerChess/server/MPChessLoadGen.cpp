@@ -0,0 +1,671 @@
+// MPChessLoadGen.cpp
+//
+// Headless load generator for the Multiplayer Chess server. Opens a configurable
+// number of simulated clients, registers or logs each one in, queues them through
+// MATCHMAKING_REQUEST and plays random legal moves at a configured pace. Reports
+// moves/sec, MOVE to MOVE_RESULT latency percentiles and the server's resident set
+// size, so hosts can be sized and networking changes measured.
+
+#include "MPChessServer.h"
+
+/**
+ * @brief Command line settings shared by all simulated clients
+ */
+struct LoadGenConfig {
+    QString host = "127.0.0.1";
+    quint16 port = 5000;
+    int clients = 1000;
+    int connectRate = 200;      // New connections per second
+    int thinkMs = 1000;         // Mean delay before a client plays its move
+    int maxPlies = 200;         // A client resigns once the game reaches this length
+    int games = 0;              // Games per client, 0 for no limit
+    int durationSeconds = 60;
+    int reportSeconds = 5;
+    qint64 serverPid = 0;       // Server process to sample VmRSS from, 0 to skip
+    QString userPrefix = "loadgen";
+    QString password = "loadgen-password";
+    QString timeControl = "rapid";
+    bool binary = false;
+    bool compression = false;
+    bool stateDelta = false;
+};
+
+/**
+ * @brief Counters and latency samples, kept for the current report interval and the whole run
+ */
+class LoadGenStats {
+public:
+    int connected = 0;
+    int authenticated = 0;
+    int inGame = 0;
+    uint64_t gamesStarted = 0;
+    uint64_t gamesFinished = 0;
+    uint64_t rejectedMoves = 0;
+    uint64_t authFailures = 0;
+    uint64_t errors = 0;
+    uint64_t disconnects = 0;
+    uint64_t resyncs = 0;
+    uint64_t bytesReceived = 0;
+
+    void recordMove(qint64 latencyMicros) {
+        intervalLatencies.push_back(latencyMicros);
+        totalLatencies.push_back(latencyMicros);
+    }
+
+    uint64_t intervalMoves() const { return intervalLatencies.size(); }
+    uint64_t totalMoves() const { return totalLatencies.size(); }
+
+    // Latency at the given percentile (0-100) in milliseconds, 0 without samples
+    double intervalPercentile(double percentile) { return percentileOf(intervalLatencies, percentile); }
+    double totalPercentile(double percentile) { return percentileOf(totalLatencies, percentile); }
+
+    void resetInterval() { intervalLatencies.clear(); }
+
+private:
+    std::vector<qint64> intervalLatencies;
+    std::vector<qint64> totalLatencies;
+
+    static double percentileOf(std::vector<qint64>& samples, double percentile) {
+        if (samples.empty()) {
+            return 0.0;
+        }
+        size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * samples.size()));
+        rank = std::clamp<size_t>(rank, 1, samples.size()) - 1;
+        std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+        return samples[rank] / 1000.0;
+    }
+};
+
+/**
+ * @brief One simulated player: a socket, a framer and a local copy of its current game
+ */
+class SimulatedClient : public QObject {
+public:
+    SimulatedClient(int index, const LoadGenConfig& config, LoadGenStats& stats, std::mt19937& rng)
+        : index(index), config(config), stats(stats), rng(rng), socket(new QTcpSocket(this)),
+          registering(true), authenticated(false), binaryProtocol(false), compressFrames(false),
+          inGame(false), moveScheduled(false), awaitingResult(false), plies(0), gamesPlayed(0),
+          myColor(PieceColor::WHITE) {
+        connect(socket, &QTcpSocket::connected, this, [this]() { handleConnected(); });
+        connect(socket, &QTcpSocket::readyRead, this, [this]() { handleReadyRead(); });
+        connect(socket, &QTcpSocket::disconnected, this, [this]() { handleDisconnected(); });
+        connect(socket, &QAbstractSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+            if (socket->state() != QAbstractSocket::ConnectedState) {
+                this->stats.errors++;
+            }
+        });
+    }
+
+    void start() {
+        socket->connectToHost(config.host, config.port);
+    }
+
+private:
+    int index;
+    const LoadGenConfig& config;
+    LoadGenStats& stats;
+    std::mt19937& rng;
+
+    QTcpSocket* socket;
+    MessageFramer framer;
+
+    bool registering;       // First attempt registers; an existing account falls back to login
+    bool authenticated;
+    bool binaryProtocol;
+    bool compressFrames;
+
+    // Current game
+    QString gameId;
+    bool inGame;
+    bool moveScheduled;
+    bool awaitingResult;
+    int plies;
+    int gamesPlayed;
+    PieceColor myColor;
+    ChessBoard board;
+    std::chrono::steady_clock::time_point moveSentAt;
+
+    QString username() const {
+        return config.userPrefix + "_" + QString::number(index);
+    }
+
+    void send(const QJsonObject& message) {
+        socket->write(MPChessServer::encodeMessage(message, binaryProtocol, compressFrames));
+    }
+
+    void handleConnected() {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        stats.connected++;
+        sendAuthentication();
+    }
+
+    void handleDisconnected() {
+        stats.connected--;
+        stats.disconnects++;
+        if (authenticated) {
+            stats.authenticated--;
+        }
+        if (inGame) {
+            stats.inGame--;
+        }
+        authenticated = false;
+        inGame = false;
+    }
+
+    void sendAuthentication() {
+        QJsonObject message;
+        message["type"] = static_cast<int>(MessageType::AUTHENTICATION);
+        message["username"] = username();
+        message["password"] = config.password;
+        message["register"] = registering;
+        if (config.binary) {
+            message["protocol"] = WireProtocol::PROTOCOL_NAME;
+            if (config.compression) {
+                message["compression"] = WireProtocol::COMPRESSION_NAME;
+            }
+        }
+        if (config.stateDelta) {
+            message["stateDelta"] = true;
+        }
+        send(message);
+    }
+
+    void joinQueue() {
+        QJsonObject message;
+        message["type"] = static_cast<int>(MessageType::MATCHMAKING_REQUEST);
+        message["join"] = true;
+        message["timeControl"] = config.timeControl;
+        send(message);
+    }
+
+    void requestGameState() {
+        stats.resyncs++;
+        QJsonObject message;
+        message["type"] = static_cast<int>(MessageType::GAME_STATE_REQUEST);
+        message["gameId"] = gameId;
+        send(message);
+    }
+
+    void handleReadyRead() {
+        stats.bytesReceived += socket->bytesAvailable();
+        framer.readFrom(socket);
+
+        QJsonObject message;
+        std::string error;
+        while (true) {
+            MessageFramer::Status status = framer.next(message, error);
+            if (status == MessageFramer::Status::INCOMPLETE) {
+                break;
+            }
+            if (status == MessageFramer::Status::FATAL) {
+                std::cerr << username().toStdString() << ": " << error << std::endl;
+                stats.errors++;
+                socket->abort();
+                break;
+            }
+            if (status == MessageFramer::Status::INVALID) {
+                stats.errors++;
+                continue;
+            }
+            handleMessage(message);
+        }
+    }
+
+    void handleMessage(const QJsonObject& message) {
+        switch (static_cast<MessageType>(message["type"].toInt())) {
+            case MessageType::AUTHENTICATION_RESULT:
+                handleAuthenticationResult(message);
+                break;
+
+            case MessageType::MATCHMAKING_STATUS:
+                if (message["status"].toString() == "already_in_game") {
+                    // Left over from an earlier run; pick the game up where it stands
+                    beginGame(message["gameId"].toString(), myColor);
+                    requestGameState();
+                } else if (message["status"].toString() == "error") {
+                    QTimer::singleShot(1000, this, [this]() { joinQueue(); });
+                }
+                break;
+
+            case MessageType::GAME_START:
+                beginGame(message["gameId"].toString(),
+                          message["yourColor"].toString() == "black" ? PieceColor::BLACK : PieceColor::WHITE);
+                if (message.contains("gameState")) {
+                    applyFullState(message["gameState"].toObject());
+                }
+                break;
+
+            case MessageType::GAME_STATE:
+                applyFullState(message["gameState"].toObject());
+                break;
+
+            case MessageType::GAME_STATE_DELTA:
+                applyDelta(message["delta"].toObject());
+                break;
+
+            case MessageType::MOVE_RESULT:
+                if (awaitingResult) {
+                    awaitingResult = false;
+                    auto elapsed = std::chrono::steady_clock::now() - moveSentAt;
+                    if (message["success"].toBool()) {
+                        stats.recordMove(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+                    } else {
+                        stats.rejectedMoves++;
+                        requestGameState();
+                    }
+                }
+                break;
+
+            case MessageType::GAME_OVER:
+                finishGame();
+                break;
+
+            case MessageType::ERROR:
+                stats.errors++;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void handleAuthenticationResult(const QJsonObject& message) {
+        if (!message["success"].toBool()) {
+            if (registering) {
+                // The account exists from an earlier run
+                registering = false;
+                sendAuthentication();
+            } else {
+                std::cerr << username().toStdString() << ": " << message["message"].toString().toStdString() << std::endl;
+                stats.authFailures++;
+                socket->disconnectFromHost();
+            }
+            return;
+        }
+
+        authenticated = true;
+        stats.authenticated++;
+        binaryProtocol = message["protocol"].toString() == WireProtocol::PROTOCOL_NAME;
+        compressFrames = message["compression"].toString() == WireProtocol::COMPRESSION_NAME;
+        joinQueue();
+    }
+
+    void beginGame(const QString& id, PieceColor color) {
+        if (!inGame) {
+            stats.inGame++;
+            stats.gamesStarted++;
+        }
+        gameId = id;
+        myColor = color;
+        inGame = true;
+        awaitingResult = false;
+        board.initialize();
+        plies = 0;
+    }
+
+    void finishGame() {
+        if (!inGame) {
+            return;
+        }
+        inGame = false;
+        awaitingResult = false;
+        stats.inGame--;
+        stats.gamesFinished++;
+        gamesPlayed++;
+
+        if (config.games == 0 || gamesPlayed < config.games) {
+            std::uniform_int_distribution<int> delay(50, 500);
+            QTimer::singleShot(delay(rng), this, [this]() {
+                if (authenticated && !inGame) {
+                    joinQueue();
+                }
+            });
+        } else {
+            socket->disconnectFromHost();
+        }
+    }
+
+    // Rebuild the local board from the move list of a full snapshot
+    void applyFullState(const QJsonObject& state) {
+        if (!inGame || state["gameId"].toString() != gameId) {
+            return;
+        }
+
+        if (state.contains("whitePlayer")) {
+            myColor = state["whitePlayer"].toString() == username() ? PieceColor::WHITE : PieceColor::BLACK;
+        }
+
+        board.initialize();
+        plies = 0;
+        for (const QJsonValue& value : state["moveHistory"].toArray()) {
+            if (!replayMove(value.toObject())) {
+                std::cerr << username().toStdString() << ": cannot replay the move history of " << gameId.toStdString() << std::endl;
+                stats.errors++;
+                return;
+            }
+        }
+        stateChanged(state["result"].toString());
+    }
+
+    // Apply the moves of a delta that the local board does not have yet
+    void applyDelta(const QJsonObject& delta) {
+        if (!inGame || delta["gameId"].toString() != gameId) {
+            return;
+        }
+
+        int moveIndex = delta["moveIndex"].toInt();
+        if (moveIndex > plies) {
+            requestGameState();
+            return;
+        }
+
+        QJsonArray moves = delta["moves"].toArray();
+        for (int i = plies - moveIndex; i < moves.size(); ++i) {
+            if (!replayMove(moves[i].toObject())) {
+                requestGameState();
+                return;
+            }
+        }
+        stateChanged(delta["result"].toString());
+    }
+
+    // Play a move from the server on the local board, using the generator's own move so
+    // castling, en passant and promotion are applied the same way
+    bool replayMove(const QJsonObject& moveObj) {
+        Position from = Position::fromAlgebraic(moveObj["from"].toString().toStdString());
+        Position to = Position::fromAlgebraic(moveObj["to"].toString().toStdString());
+        QString promotion = moveObj["promotion"].toString();
+
+        for (const ChessMove& move : board.getAllValidMoves(board.getCurrentTurn())) {
+            if (!(move.getFrom() == from) || !(move.getTo() == to)) {
+                continue;
+            }
+            if (move.getPromotionType() != PieceType::EMPTY && promotion != promotionName(move.getPromotionType())) {
+                continue;
+            }
+            ChessBoard::MoveUndo undo;
+            board.makeMove(move, undo);
+            plies++;
+            return true;
+        }
+        return false;
+    }
+
+    static QString promotionName(PieceType type) {
+        switch (type) {
+            case PieceType::KNIGHT: return "knight";
+            case PieceType::BISHOP: return "bishop";
+            case PieceType::ROOK:   return "rook";
+            default:                return "queen";
+        }
+    }
+
+    void stateChanged(const QString& result) {
+        if (!result.isEmpty() && result != "in_progress") {
+            finishGame();
+            return;
+        }
+        if (board.getCurrentTurn() == myColor && !moveScheduled && !awaitingResult) {
+            scheduleMove();
+        }
+    }
+
+    void scheduleMove() {
+        // Spread the think time so clients do not move in lockstep
+        std::uniform_int_distribution<int> delay(config.thinkMs / 2, config.thinkMs * 3 / 2);
+        moveScheduled = true;
+        QString scheduledGame = gameId;
+        QTimer::singleShot(delay(rng), this, [this, scheduledGame]() {
+            moveScheduled = false;
+            if (inGame && gameId == scheduledGame && !awaitingResult && board.getCurrentTurn() == myColor) {
+                playMove();
+            }
+        });
+    }
+
+    void playMove() {
+        QJsonObject message;
+        message["gameId"] = gameId;
+
+        std::vector<ChessMove> moves = board.getAllValidMoves(myColor);
+        if (plies >= config.maxPlies || moves.empty()) {
+            message["type"] = static_cast<int>(MessageType::RESIGN);
+            send(message);
+            return;
+        }
+
+        std::uniform_int_distribution<size_t> pick(0, moves.size() - 1);
+        message["type"] = static_cast<int>(MessageType::MOVE);
+        message["move"] = QString::fromStdString(moves[pick(rng)].toAlgebraic());
+
+        awaitingResult = true;
+        moveSentAt = std::chrono::steady_clock::now();
+        send(message);
+    }
+};
+
+/**
+ * @brief Ramps up the simulated clients and prints periodic and final reports
+ */
+class LoadGenerator : public QObject {
+public:
+    explicit LoadGenerator(const LoadGenConfig& config)
+        : config(config), rng(std::random_device{}()), started(0) {}
+
+    void start() {
+        startTime = std::chrono::steady_clock::now();
+        intervalStart = startTime;
+
+        // Connect in small batches so the server's accept queue is not flooded
+        connect(&rampTimer, &QTimer::timeout, this, [this]() { rampUp(); });
+        rampTimer.start(RAMP_TICK_MS);
+
+        connect(&reportTimer, &QTimer::timeout, this, [this]() { report(); });
+        reportTimer.start(config.reportSeconds * 1000);
+
+        QTimer::singleShot(config.durationSeconds * 1000, this, [this]() { finish(); });
+
+        std::cout << "Starting " << config.clients << " clients against " << config.host.toStdString()
+                  << ":" << config.port << " for " << config.durationSeconds << " s" << std::endl;
+    }
+
+private:
+    static constexpr int RAMP_TICK_MS = 50;
+
+    LoadGenConfig config;
+    LoadGenStats stats;
+    std::mt19937 rng;
+    std::vector<std::unique_ptr<SimulatedClient>> clients;
+    int started;
+
+    QTimer rampTimer;
+    QTimer reportTimer;
+    std::chrono::steady_clock::time_point startTime;
+    std::chrono::steady_clock::time_point intervalStart;
+
+    void rampUp() {
+        int batch = std::max(1, config.connectRate * RAMP_TICK_MS / 1000);
+        for (int i = 0; i < batch && started < config.clients; ++i, ++started) {
+            clients.push_back(std::make_unique<SimulatedClient>(started, config, stats, rng));
+            clients.back()->start();
+        }
+        if (started >= config.clients) {
+            rampTimer.stop();
+        }
+    }
+
+    // Resident set size of a process in kilobytes, -1 if it cannot be read
+    static qint64 readRssKb(qint64 pid) {
+        QFile status(QString("/proc/%1/status").arg(pid));
+        if (!status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            return -1;
+        }
+        while (!status.atEnd()) {
+            QByteArray line = status.readLine();
+            if (line.startsWith("VmRSS:")) {
+                return std::strtoll(line.constData() + 6, nullptr, 10);
+            }
+        }
+        return -1;
+    }
+
+    void printRss() {
+        if (config.serverPid <= 0) {
+            return;
+        }
+        qint64 rss = readRssKb(config.serverPid);
+        if (rss < 0) {
+            std::cout << "  server RSS n/a";
+        } else {
+            std::cout << "  server RSS " << std::fixed << std::setprecision(1) << rss / 1024.0 << " MB";
+        }
+    }
+
+    void report() {
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - intervalStart).count();
+        double elapsed = std::chrono::duration<double>(now - startTime).count();
+
+        std::cout << "[" << std::setw(5) << static_cast<int>(elapsed) << " s] "
+                  << "connected " << stats.connected << "  auth " << stats.authenticated
+                  << "  in game " << stats.inGame << "  "
+                  << std::fixed << std::setprecision(1) << std::setw(8)
+                  << (seconds > 0 ? stats.intervalMoves() / seconds : 0.0) << " moves/s  "
+                  << std::setprecision(2) << "p50 " << stats.intervalPercentile(50) << " ms  "
+                  << "p99 " << stats.intervalPercentile(99) << " ms";
+        printRss();
+        std::cout << std::endl;
+
+        stats.resetInterval();
+        intervalStart = now;
+    }
+
+    void finish() {
+        rampTimer.stop();
+        reportTimer.stop();
+        report();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "Total: " << stats.totalMoves() << " moves in " << std::fixed << std::setprecision(1) << seconds
+                  << " s (" << (seconds > 0 ? stats.totalMoves() / seconds : 0.0) << " moves/s)" << std::endl;
+        std::cout << "  MOVE -> MOVE_RESULT latency: " << std::setprecision(2)
+                  << "p50 " << stats.totalPercentile(50) << " ms  "
+                  << "p99 " << stats.totalPercentile(99) << " ms  "
+                  << "max " << stats.totalPercentile(100) << " ms" << std::endl;
+        std::cout << "  games started " << stats.gamesStarted << ", finished " << stats.gamesFinished
+                  << "; rejected moves " << stats.rejectedMoves << ", resyncs " << stats.resyncs
+                  << ", auth failures " << stats.authFailures << ", errors " << stats.errors
+                  << ", disconnects " << stats.disconnects << std::endl;
+        std::cout << "  received " << std::setprecision(1) << stats.bytesReceived / (1024.0 * 1024.0) << " MB";
+        printRss();
+        std::cout << std::endl;
+
+        QCoreApplication::quit();
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // Parse command line arguments
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator and throughput benchmark for the Multiplayer Chess server");
+    parser.addHelpOption();
+
+    QCommandLineOption hostOption(QStringList() << "H" << "host",
+                                  "Server address (default: 127.0.0.1)",
+                                  "host", "127.0.0.1");
+    parser.addOption(hostOption);
+
+    QCommandLineOption portOption(QStringList() << "p" << "port",
+                                  "Server port (default: 5000)",
+                                  "port", "5000");
+    parser.addOption(portOption);
+
+    QCommandLineOption clientsOption(QStringList() << "c" << "clients",
+                                     "Number of simulated clients (default: 1000)",
+                                     "count", "1000");
+    parser.addOption(clientsOption);
+
+    QCommandLineOption connectRateOption(QStringList() << "connect-rate",
+                                         "New connections per second during ramp-up (default: 200)",
+                                         "rate", "200");
+    parser.addOption(connectRateOption);
+
+    QCommandLineOption thinkOption(QStringList() << "t" << "think-ms",
+                                   "Mean delay in milliseconds before each move (default: 1000)",
+                                   "ms", "1000");
+    parser.addOption(thinkOption);
+
+    QCommandLineOption maxPliesOption(QStringList() << "max-plies",
+                                      "Resign once a game reaches this many plies (default: 200)",
+                                      "plies", "200");
+    parser.addOption(maxPliesOption);
+
+    QCommandLineOption gamesOption(QStringList() << "games",
+                                   "Games each client plays before disconnecting, 0 for no limit (default: 0)",
+                                   "count", "0");
+    parser.addOption(gamesOption);
+
+    QCommandLineOption durationOption(QStringList() << "d" << "duration",
+                                      "Run time in seconds (default: 60)",
+                                      "seconds", "60");
+    parser.addOption(durationOption);
+
+    QCommandLineOption reportOption(QStringList() << "r" << "report-interval",
+                                    "Seconds between progress reports (default: 5)",
+                                    "seconds", "5");
+    parser.addOption(reportOption);
+
+    QCommandLineOption serverPidOption(QStringList() << "server-pid",
+                                       "Process id of a local server to sample resident memory from",
+                                       "pid");
+    parser.addOption(serverPidOption);
+
+    QCommandLineOption prefixOption(QStringList() << "user-prefix",
+                                    "Prefix of the simulated usernames (default: loadgen)",
+                                    "prefix", "loadgen");
+    parser.addOption(prefixOption);
+
+    QCommandLineOption timeControlOption(QStringList() << "time-control",
+                                         "Time control to queue for (default: rapid)",
+                                         "name", "rapid");
+    parser.addOption(timeControlOption);
+
+    QCommandLineOption binaryOption(QStringList() << "binary",
+                                    "Negotiate the binary wire protocol");
+    parser.addOption(binaryOption);
+
+    QCommandLineOption compressionOption(QStringList() << "compression",
+                                         "Negotiate compressed binary frames (implies --binary)");
+    parser.addOption(compressionOption);
+
+    QCommandLineOption stateDeltaOption(QStringList() << "state-delta",
+                                        "Ask for GAME_STATE_DELTA instead of full states after moves");
+    parser.addOption(stateDeltaOption);
+
+    parser.process(app);
+
+    LoadGenConfig config;
+    config.host = parser.value(hostOption);
+    config.port = static_cast<quint16>(parser.value(portOption).toUInt());
+    config.clients = std::max(1, parser.value(clientsOption).toInt());
+    config.connectRate = std::max(1, parser.value(connectRateOption).toInt());
+    config.thinkMs = std::max(0, parser.value(thinkOption).toInt());
+    config.maxPlies = std::max(1, parser.value(maxPliesOption).toInt());
+    config.games = std::max(0, parser.value(gamesOption).toInt());
+    config.durationSeconds = std::max(1, parser.value(durationOption).toInt());
+    config.reportSeconds = std::max(1, parser.value(reportOption).toInt());
+    config.serverPid = parser.value(serverPidOption).toLongLong();
+    config.userPrefix = parser.value(prefixOption);
+    config.timeControl = parser.value(timeControlOption);
+    config.compression = parser.isSet(compressionOption);
+    config.binary = parser.isSet(binaryOption) || config.compression;
+    config.stateDelta = parser.isSet(stateDeltaOption);
+
+    LoadGenerator generator(config);
+    generator.start();
+
+    return app.exec();
+}
@@ -0,0 +1,271 @@
+// MPChessPerft.cpp
+//
+// Perft benchmark and correctness check for the ChessBoard move generator.
+// Counts the leaf nodes of the legal move tree from the standard position and a
+// suite of well-known FEN positions, compares them with the published counts and
+// reports the throughput of getAllValidMoves() with makeMove()/unmakeMove().
+// With --verify it also checks the client's shared MoveGenPosition at every node.
+
+#include "MPChessServer.h"
+#include "MPChessMoveGen.h"
+
+/**
+ * @brief A perft position with its published node counts
+ */
+struct PerftPosition {
+    const char* name;
+    const char* fen;
+    std::vector<uint64_t> nodes;  // nodes[d - 1] is the count at depth d
+};
+
+static const std::vector<PerftPosition> PERFT_SUITE = {
+    { "start", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      { 20, 400, 8902, 197281, 4865609, 119060324 } },
+    { "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      { 48, 2039, 97862, 4085603, 193690690 } },
+    { "endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      { 14, 191, 2812, 43238, 674624, 11030083 } },
+    { "promotions", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      { 6, 264, 9467, 422333, 15833292 } },
+    { "discovered", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      { 44, 1486, 62379, 2103487, 89941194 } },
+    { "middlegame", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+      { 46, 2079, 89890, 3894594, 164075551 } }
+};
+
+/**
+ * @brief Runs perft on one board, optionally verifying the incremental state at every node
+ */
+class PerftRunner {
+public:
+    explicit PerftRunner(bool verify) : verify(verify), failed(false) {}
+
+    // Count the leaf nodes of the legal move tree to the given depth
+    uint64_t perft(ChessBoard& board, int depth) {
+        if (depth == 0 || failed) {
+            return 1;
+        }
+
+        std::vector<ChessMove> moves = board.getAllValidMoves(board.getCurrentTurn());
+        if (verify) {
+            verifySharedMoves(board, moves);
+        }
+
+        uint64_t nodes = 0;
+        for (const ChessMove& move : moves) {
+            nodes += perftMove(board, move, depth);
+        }
+        return nodes;
+    }
+
+    // Print the node count below each root move, for comparing with another engine
+    uint64_t divide(ChessBoard& board, int depth) {
+        std::vector<ChessMove> moves = board.getAllValidMoves(board.getCurrentTurn());
+        uint64_t total = 0;
+        for (const ChessMove& move : moves) {
+            uint64_t nodes = perftMove(board, move, depth);
+            std::cout << "  " << move.toAlgebraic() << ": " << nodes << std::endl;
+            total += nodes;
+        }
+        return total;
+    }
+
+    bool hasFailed() const { return failed; }
+
+private:
+    bool verify;
+    bool failed;
+
+    uint64_t perftMove(ChessBoard& board, const ChessMove& move, int depth) {
+        BitboardPosition before;
+        MoveGenPosition shared;
+        if (verify) {
+            before = board.getBitboards();
+            shared = sharedPosition(before);
+        }
+
+        ChessBoard::MoveUndo undo;
+        board.makeMove(move, undo);
+        if (verify && board.getZobristKey() != board.getBitboards().computeZobristKey()) {
+            report("incremental Zobrist key differs from the recomputed key after", move);
+        }
+        if (verify) {
+            shared.applyMove(sharedMove(move));
+            if (!samePosition(shared, sharedPosition(board.getBitboards()))) {
+                report("MoveGenPosition::applyMove() differs from makeMove() after", move);
+            }
+        }
+
+        uint64_t nodes = perft(board, depth - 1);
+        board.unmakeMove(undo);
+
+        if (verify && !samePosition(before, board.getBitboards())) {
+            report("position not restored by unmakeMove() after", move);
+        }
+        return nodes;
+    }
+
+    void report(const std::string& what, const ChessMove& move) {
+        report(what + " " + move.toAlgebraic());
+    }
+
+    void report(const std::string& what) {
+        if (!failed) {
+            std::cerr << "Verification failed: " << what << std::endl;
+        }
+        failed = true;
+    }
+
+    // The client's generator must find exactly the moves ChessBoard does
+    void verifySharedMoves(const ChessBoard& board, const std::vector<ChessMove>& moves) {
+        std::vector<MoveGenMove> generated;
+        sharedPosition(board.getBitboards()).generateLegalMoves(generated);
+
+        std::vector<int> expected;
+        for (const ChessMove& move : moves) {
+            expected.push_back(moveCode(sharedMove(move)));
+        }
+        std::vector<int> actual;
+        for (const MoveGenMove& move : generated) {
+            actual.push_back(moveCode(move));
+        }
+        std::sort(expected.begin(), expected.end());
+        std::sort(actual.begin(), actual.end());
+        if (actual != expected) {
+            report("MoveGenPosition's legal moves differ from ChessBoard's in " + StockfishConnector::boardToFen(board));
+        }
+    }
+
+    static MoveGenPosition sharedPosition(const BitboardPosition& position) {
+        MoveGenPosition shared;
+        for (int sq = 0; sq < 64; ++sq) {
+            if (!position.isEmpty(sq)) {
+                shared.addPiece(sq, static_cast<int>(position.typeAt(sq)), static_cast<int>(position.colorAt(sq)));
+            }
+        }
+        shared.sideToMove = static_cast<int>(position.sideToMove);
+        shared.castlingRights = position.castlingRights;
+        shared.enPassantSquare = position.enPassantSquare;
+        return shared;
+    }
+
+    static MoveGenMove sharedMove(const ChessMove& move) {
+        PieceType promotion = move.getPromotionType();
+        return { static_cast<int8_t>(move.getFromSquare()), static_cast<int8_t>(move.getToSquare()),
+                 static_cast<int8_t>(promotion == PieceType::EMPTY ? -1 : static_cast<int>(promotion)) };
+    }
+
+    static int moveCode(const MoveGenMove& move) {
+        return move.from | (move.to << 6) | ((move.promotion + 1) << 12);
+    }
+
+    static bool samePosition(const MoveGenPosition& a, const MoveGenPosition& b) {
+        return a.pieces == b.pieces && a.sideToMove == b.sideToMove &&
+               a.castlingRights == b.castlingRights && a.enPassantSquare == b.enPassantSquare;
+    }
+
+    static bool samePosition(const BitboardPosition& a, const BitboardPosition& b) {
+        return a.pieces == b.pieces && a.occupancy == b.occupancy && a.allOccupancy == b.allOccupancy &&
+               a.unmoved == b.unmoved && a.mailbox == b.mailbox && a.sideToMove == b.sideToMove &&
+               a.castlingRights == b.castlingRights && a.enPassantSquare == b.enPassantSquare &&
+               a.zobristKey == b.zobristKey && a.midgameScore == b.midgameScore &&
+               a.endgameScore == b.endgameScore && a.phase == b.phase;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // Parse command line arguments
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Perft benchmark and move generator check for the Multiplayer Chess server");
+    parser.addHelpOption();
+
+    QCommandLineOption depthOption(QStringList() << "d" << "depth",
+                                   "Maximum perft depth (default: 4)",
+                                   "depth", "4");
+    parser.addOption(depthOption);
+
+    QCommandLineOption fenOption(QStringList() << "f" << "fen",
+                                 "Run a single FEN position instead of the suite",
+                                 "fen");
+    parser.addOption(fenOption);
+
+    QCommandLineOption divideOption(QStringList() << "divide",
+                                    "Print the node count below each root move at the final depth");
+    parser.addOption(divideOption);
+
+    QCommandLineOption verifyOption(QStringList() << "verify",
+                                    "Check the Zobrist key, unmakeMove() and the client's move generator at every node (slower)");
+    parser.addOption(verifyOption);
+
+    parser.process(app);
+
+    int maxDepth = std::max(1, parser.value(depthOption).toInt());
+
+    std::vector<PerftPosition> positions;
+    if (parser.isSet(fenOption)) {
+        positions.push_back({ "custom", nullptr, {} });
+    } else {
+        positions = PERFT_SUITE;
+    }
+    std::string customFen = parser.value(fenOption).toStdString();
+
+    uint64_t totalNodes = 0;
+    double totalSeconds = 0.0;
+    int mismatches = 0;
+
+    for (const PerftPosition& entry : positions) {
+        std::string fen = entry.fen ? entry.fen : customFen;
+        ChessBoard board;
+        if (!board.loadFromFen(fen)) {
+            std::cerr << "Invalid FEN: " << fen << std::endl;
+            return 1;
+        }
+
+        // Suite positions stop at their deepest published count
+        int depthLimit = entry.nodes.empty() ? maxDepth : std::min(maxDepth, static_cast<int>(entry.nodes.size()));
+        std::cout << entry.name << ": " << fen << std::endl;
+
+        PerftRunner runner(parser.isSet(verifyOption));
+        for (int depth = 1; depth <= depthLimit; ++depth) {
+            bool divide = parser.isSet(divideOption) && depth == depthLimit;
+
+            auto start = std::chrono::steady_clock::now();
+            uint64_t nodes = divide ? runner.divide(board, depth) : runner.perft(board, depth);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            totalNodes += nodes;
+            totalSeconds += seconds;
+
+            std::cout << "  depth " << depth << ": " << std::setw(12) << nodes << " nodes  "
+                      << std::fixed << std::setprecision(3) << std::setw(8) << seconds << " s  "
+                      << std::setw(12) << static_cast<uint64_t>(seconds > 0 ? nodes / seconds : 0) << " nps";
+
+            if (!entry.nodes.empty()) {
+                uint64_t expected = entry.nodes[depth - 1];
+                if (nodes == expected) {
+                    std::cout << "  OK";
+                } else {
+                    std::cout << "  MISMATCH (expected " << expected << ")";
+                    ++mismatches;
+                }
+            }
+            std::cout << std::endl;
+
+            if (runner.hasFailed()) {
+                return 1;
+            }
+        }
+    }
+
+    std::cout << "Total: " << totalNodes << " nodes in " << std::fixed << std::setprecision(3) << totalSeconds
+              << " s (" << static_cast<uint64_t>(totalSeconds > 0 ? totalNodes / totalSeconds : 0) << " nps)" << std::endl;
+
+    if (mismatches > 0) {
+        std::cout << mismatches << " node count mismatch(es)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
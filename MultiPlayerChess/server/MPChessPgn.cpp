@@ -0,0 +1,246 @@
+// MPChessPgn.cpp
+//
+// Bulk PGN export and import for the game history store, without starting the
+// server. Export reads the store one segment per thread and writes each game as
+// soon as it is converted, so memory stays flat however large the archive is;
+// games can be filtered by player and date range first. Import streams PGN files
+// one game at a time, converts bounded batches in parallel and appends them to the
+// store. Run it with the server stopped.
+
+#include "MPChessServer.h"
+
+/**
+ * @brief Which stored games an export includes
+ */
+struct ExportFilter {
+    std::unordered_set<std::string> players;  // Games of any of these players; empty for all
+    qint64 since = 0;                         // Milliseconds since the epoch, 0 for no bound
+    qint64 until = 0;
+
+    bool accepts(const GameHistoryStore::GameSummary& game) const {
+        if (!players.empty() && !players.count(game.whitePlayer) && !players.count(game.blackPlayer)) {
+            return false;
+        }
+        qint64 time = game.endTime != 0 ? game.endTime : game.startTime;
+        return (since == 0 || time >= since) && (until == 0 || time < until);
+    }
+};
+
+static constexpr int IMPORT_BATCH_SIZE = 256;
+
+static int exportGames(GameHistoryStore& store, const ExportFilter& filter, QIODevice& output)
+{
+    std::mutex outputMutex;
+    std::atomic<int> written(0);
+    std::atomic<int> failed(0);
+
+    // Segments are independent; each thread converts its games and writes them whole
+    std::vector<int> segments = store.getSegmentIds();
+    QtConcurrent::blockingMap(segments, [&](int segment) {
+        ChessSerializer serializer;
+        store.forEachGameInSegment(segment,
+            [&filter](const GameHistoryStore::GameSummary& game) { return filter.accepts(game); },
+            [&](const GameHistoryStore::GameSummary& game, const QJsonObject& gameJson) {
+                std::string pgn;
+                std::string error;
+                if (!serializer.gameJsonToPgn(gameJson, game.whiteRating, game.blackRating, pgn, error)) {
+                    std::cerr << "Skipped game " << game.gameId << ": " << error << std::endl;
+                    ++failed;
+                    return true;
+                }
+
+                std::lock_guard<std::mutex> lock(outputMutex);
+                output.write(pgn.data(), static_cast<qint64>(pgn.size()));
+                ++written;
+                return true;
+            });
+    });
+
+    std::cerr << "Exported " << written << " game(s)";
+    if (failed > 0) {
+        std::cerr << ", skipped " << failed;
+    }
+    std::cerr << std::endl;
+    return failed > 0 ? 1 : 0;
+}
+
+/**
+ * @brief One PGN game of an import batch, converted to the stored format
+ */
+struct ImportedGame {
+    std::string pgn;
+    QJsonObject gameJson;
+    int whiteElo = 0;
+    int blackElo = 0;
+    std::string error;
+};
+
+static int importGames(GameHistoryStore& store, const QStringList& files)
+{
+    int imported = 0;
+    int failed = 0;
+
+    for (const QString& fileName : files) {
+        QFile file;
+        bool opened = fileName == "-" ? file.open(stdin, QIODevice::ReadOnly)
+                                      : (file.setFileName(fileName), file.open(QIODevice::ReadOnly));
+        if (!opened) {
+            std::cerr << "Cannot open " << fileName.toStdString() << std::endl;
+            ++failed;
+            continue;
+        }
+
+        PgnReader reader(&file);
+        std::vector<ImportedGame> batch;
+        bool more = true;
+        while (more) {
+            // Read a batch, convert it on all cores, then append it in order
+            batch.clear();
+            std::string text;
+            while (static_cast<int>(batch.size()) < IMPORT_BATCH_SIZE && (more = reader.next(text))) {
+                batch.emplace_back();
+                batch.back().pgn = std::move(text);
+            }
+
+            QtConcurrent::blockingMap(batch, [](ImportedGame& game) {
+                ChessSerializer serializer;
+                if (!serializer.pgnToGameJson(game.pgn, game.gameJson, game.whiteElo, game.blackElo, game.error)) {
+                    game.gameJson = QJsonObject();
+                }
+            });
+
+            for (const ImportedGame& game : batch) {
+                if (game.gameJson.isEmpty()) {
+                    std::cerr << fileName.toStdString() << ": skipped a game: " << game.error << std::endl;
+                    ++failed;
+                    continue;
+                }
+                if (!store.saveGame(game.gameJson["gameId"].toString().toStdString(),
+                                    game.gameJson["whitePlayer"].toString().toStdString(),
+                                    game.gameJson["blackPlayer"].toString().toStdString(), game.gameJson,
+                                    game.whiteElo, game.blackElo)) {
+                    std::cerr << fileName.toStdString() << ": could not store "
+                              << game.gameJson["gameId"].toString().toStdString() << std::endl;
+                    ++failed;
+                    continue;
+                }
+                ++imported;
+            }
+        }
+    }
+
+    std::cerr << "Imported " << imported << " game(s)";
+    if (failed > 0) {
+        std::cerr << ", skipped " << failed;
+    }
+    std::cerr << std::endl;
+    return failed > 0 ? 1 : 0;
+}
+
+// Midnight UTC at the start of a yyyy-MM-dd date, or -1 if it does not parse
+static qint64 parseDate(const QString& text)
+{
+    QDate date = QDate::fromString(text, Qt::ISODate);
+    return date.isValid() ? QDateTime(date, QTime(0, 0), Qt::UTC).toMSecsSinceEpoch() : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // Parse command line arguments
+    QCommandLineParser parser;
+    parser.setApplicationDescription("PGN export and import for the Multiplayer Chess game history");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "export, or import followed by PGN files (- for standard input)");
+    parser.addPositionalArgument("files", "PGN files to import", "[files...]");
+
+    QCommandLineOption dataOption(QStringList() << "data",
+                                  "Server data directory (default: data)",
+                                  "path", "data");
+    parser.addOption(dataOption);
+
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Export to this file instead of standard output",
+                                    "file");
+    parser.addOption(outputOption);
+
+    QCommandLineOption playerOption(QStringList() << "p" << "player",
+                                    "Export only this player's games (may be repeated)",
+                                    "username");
+    parser.addOption(playerOption);
+
+    QCommandLineOption sinceOption(QStringList() << "since",
+                                   "Export only games that ended on or after this date (yyyy-MM-dd, UTC)",
+                                   "date");
+    parser.addOption(sinceOption);
+
+    QCommandLineOption untilOption(QStringList() << "until",
+                                   "Export only games that ended before this date (yyyy-MM-dd, UTC)",
+                                   "date");
+    parser.addOption(untilOption);
+
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads",
+                                     "Worker threads, 0 for one per core; with more than one, exported "
+                                     "segments are interleaved (default: 0)",
+                                     "count", "0");
+    parser.addOption(threadsOption);
+
+    parser.process(app);
+
+    QStringList arguments = parser.positionalArguments();
+    QString command = arguments.value(0);
+    if (command != "export" && command != "import") {
+        parser.showHelp(1);
+    }
+
+    int threads = parser.value(threadsOption).toInt();
+    if (threads > 0) {
+        QThreadPool::globalInstance()->setMaxThreadCount(threads);
+    }
+
+    QString historyPath = QDir(parser.value(dataOption)).filePath("game_history");
+    if (command == "export" && !QDir(historyPath).exists()) {
+        std::cerr << "No game history in " << parser.value(dataOption).toStdString() << std::endl;
+        return 1;
+    }
+    QDir().mkpath(historyPath);
+    GameHistoryStore store(historyPath.toStdString());
+
+    if (command == "import") {
+        if (arguments.size() < 2) {
+            std::cerr << "import needs at least one PGN file" << std::endl;
+            return 1;
+        }
+        return importGames(store, arguments.mid(1));
+    }
+
+    ExportFilter filter;
+    for (const QString& player : parser.values(playerOption)) {
+        filter.players.insert(player.toStdString());
+    }
+    auto readDate = [&parser](const QCommandLineOption& option, qint64& bound) {
+        if (!parser.isSet(option)) {
+            return true;
+        }
+        bound = parseDate(parser.value(option));
+        if (bound < 0) {
+            std::cerr << "Invalid date: " << parser.value(option).toStdString() << std::endl;
+            return false;
+        }
+        return true;
+    };
+    if (!readDate(sinceOption, filter.since) || !readDate(untilOption, filter.until)) {
+        return 1;
+    }
+
+    QFile output;
+    bool opened = parser.isSet(outputOption)
+        ? (output.setFileName(parser.value(outputOption)), output.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        : output.open(stdout, QIODevice::WriteOnly);
+    if (!opened) {
+        std::cerr << "Cannot write " << parser.value(outputOption).toStdString() << std::endl;
+        return 1;
+    }
+    return exportGames(store, filter, output);
+}
@@ -0,0 +1,259 @@
+// MPChessRerate.cpp
+//
+// Offline rating recomputation. Replays every finished game in the game history
+// store through ChessRatingSystem, in the order the games were saved, and writes
+// the resulting ratings to the player records and the leaderboard snapshot. Run it
+// with the server stopped, after changing ChessRatingSystem::getKFactor().
+//
+// A game only depends on the earlier games of its two players, so the registered
+// players are split into groups that never played outside their group and the
+// groups are replayed side by side. Players without a stored record (bots) are not
+// rerated; they keep the rating stored with each game.
+
+#include "MPChessServer.h"
+
+/**
+ * @brief Union-find over the registered players who appear in the store
+ */
+class PlayerGroups {
+public:
+    int add(const std::string& username) {
+        auto [it, inserted] = ids.try_emplace(username, static_cast<int>(parent.size()));
+        if (inserted) {
+            parent.push_back(it->second);
+        }
+        return it->second;
+    }
+
+    int find(int id) {
+        while (parent[id] != id) {
+            parent[id] = parent[parent[id]];
+            id = parent[id];
+        }
+        return id;
+    }
+
+    void join(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if (a != b) {
+            parent[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+    int idOf(const std::string& username) const {
+        auto it = ids.find(username);
+        return it != ids.end() ? it->second : -1;
+    }
+
+    size_t size() const { return parent.size(); }
+
+private:
+    std::unordered_map<std::string, int> ids;
+    std::vector<int> parent;
+};
+
+/**
+ * @brief The games of one group, in the order they were saved, and its new ratings
+ */
+struct ReplayGroup {
+    std::vector<const GameHistoryStore::GameSummary*> games;
+    std::unordered_map<std::string, int> ratings;
+};
+
+static GameResult resultFromSummary(const std::string& result)
+{
+    if (result == "white_win") {
+        return GameResult::WHITE_WIN;
+    }
+    if (result == "black_win") {
+        return GameResult::BLACK_WIN;
+    }
+    if (result == "draw") {
+        return GameResult::DRAW;
+    }
+    return GameResult::IN_PROGRESS;
+}
+
+// Replay a group's games from the starting rating of a new player
+static void replayGroup(ReplayGroup& group, const std::unordered_set<std::string>& registered)
+{
+    ChessRatingSystem ratingSystem;
+    int initialRating = ChessPlayer("").getRating();
+
+    for (const GameHistoryStore::GameSummary* game : group.games) {
+        bool whiteRated = registered.count(game->whitePlayer) > 0;
+        bool blackRated = registered.count(game->blackPlayer) > 0;
+
+        auto currentRating = [&](const std::string& username, bool rated, int stored) {
+            if (!rated) {
+                return stored;
+            }
+            return group.ratings.try_emplace(username, initialRating).first->second;
+        };
+        int whiteRating = currentRating(game->whitePlayer, whiteRated, game->whiteRating);
+        int blackRating = currentRating(game->blackPlayer, blackRated, game->blackRating);
+
+        auto [newWhiteRating, newBlackRating] =
+            ratingSystem.calculateNewRatings(whiteRating, blackRating, resultFromSummary(game->result));
+        if (whiteRated) {
+            group.ratings[game->whitePlayer] = newWhiteRating;
+        }
+        if (blackRated) {
+            group.ratings[game->blackPlayer] = newBlackRating;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // Parse command line arguments
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Recompute all ratings from the Multiplayer Chess game history");
+    parser.addHelpOption();
+
+    QCommandLineOption dataOption(QStringList() << "data",
+                                  "Server data directory (default: data)",
+                                  "path", "data");
+    parser.addOption(dataOption);
+
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads",
+                                     "Replay threads, 0 for one per core (default: 0)",
+                                     "count", "0");
+    parser.addOption(threadsOption);
+
+    QCommandLineOption topOption(QStringList() << "top",
+                                 "Print the players whose rating changes most (default: 10)",
+                                 "count", "10");
+    parser.addOption(topOption);
+
+    QCommandLineOption dryRunOption(QStringList() << "n" << "dry-run",
+                                    "Report the new ratings without writing them");
+    parser.addOption(dryRunOption);
+
+    parser.process(app);
+
+    QString dataPath = parser.value(dataOption);
+    std::string playersPath = QDir(dataPath).filePath("players").toStdString();
+    std::string historyPath = QDir(dataPath).filePath("game_history").toStdString();
+    if (!QDir(QString::fromStdString(playersPath)).exists() || !QDir(QString::fromStdString(historyPath)).exists()) {
+        std::cerr << "No server data in " << dataPath.toStdString() << std::endl;
+        return 1;
+    }
+
+    int threads = parser.value(threadsOption).toInt();
+    if (threads > 0) {
+        QThreadPool::globalInstance()->setMaxThreadCount(threads);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    ChessAuthenticator authenticator(playersPath);
+    GameHistoryStore historyStore(historyPath);
+
+    std::vector<std::string> usernames = authenticator.getAllPlayerUsernames();
+    std::unordered_set<std::string> registered(usernames.begin(), usernames.end());
+
+    // Finished games only; a game that was saved unfinished never changed a rating
+    std::vector<GameHistoryStore::GameSummary> summaries = historyStore.getAllSummaries();
+    summaries.erase(std::remove_if(summaries.begin(), summaries.end(),
+                                   [](const GameHistoryStore::GameSummary& game) {
+                                       return resultFromSummary(game.result) == GameResult::IN_PROGRESS;
+                                   }),
+                    summaries.end());
+
+    // Two registered players who met share a group; bots link nobody
+    PlayerGroups groups;
+    for (const GameHistoryStore::GameSummary& game : summaries) {
+        int white = registered.count(game.whitePlayer) ? groups.add(game.whitePlayer) : -1;
+        int black = registered.count(game.blackPlayer) ? groups.add(game.blackPlayer) : -1;
+        if (white >= 0 && black >= 0) {
+            groups.join(white, black);
+        }
+    }
+
+    std::unordered_map<int, size_t> groupIndex;
+    std::vector<ReplayGroup> replayGroups;
+    for (const GameHistoryStore::GameSummary& game : summaries) {
+        int player = groups.idOf(game.whitePlayer);
+        if (player < 0) {
+            player = groups.idOf(game.blackPlayer);
+        }
+        if (player < 0) {
+            continue;  // Nobody in this game is rerated
+        }
+        auto [it, inserted] = groupIndex.try_emplace(groups.find(player), replayGroups.size());
+        if (inserted) {
+            replayGroups.emplace_back();
+        }
+        replayGroups[it->second].games.push_back(&game);
+    }
+
+    QtConcurrent::blockingMap(replayGroups, [&registered](ReplayGroup& group) {
+        replayGroup(group, registered);
+    });
+
+    // Load the records of the rerated players in parallel and set their new ratings
+    std::vector<std::pair<std::string, int>> newRatings;
+    newRatings.reserve(groups.size());
+    for (const ReplayGroup& group : replayGroups) {
+        newRatings.insert(newRatings.end(), group.ratings.begin(), group.ratings.end());
+    }
+
+    std::vector<std::optional<ChessPlayer>> players =
+        QtConcurrent::blockingMapped<std::vector<std::optional<ChessPlayer>>>(
+            newRatings, [&authenticator](const std::pair<std::string, int>& entry) {
+                std::unique_ptr<ChessPlayer> player = authenticator.getPlayer(entry.first);
+                return player ? std::optional<ChessPlayer>(*player) : std::nullopt;
+            });
+
+    struct RatingChange {
+        std::string username;
+        int oldRating;
+        int newRating;
+    };
+    std::vector<RatingChange> changes;
+    std::vector<ChessPlayer> changedPlayers;
+    for (size_t i = 0; i < newRatings.size(); ++i) {
+        if (!players[i] || players[i]->getRating() == newRatings[i].second) {
+            continue;
+        }
+        changes.push_back({ newRatings[i].first, players[i]->getRating(), newRatings[i].second });
+        players[i]->setRating(newRatings[i].second);
+        changedPlayers.push_back(*players[i]);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Replayed " << summaries.size() << " games of " << newRatings.size() << " players in "
+              << replayGroups.size() << " groups (" << std::fixed << std::setprecision(3) << seconds << " s)"
+              << std::endl;
+    std::cout << changes.size() << " rating(s) changed" << std::endl;
+
+    std::sort(changes.begin(), changes.end(), [](const RatingChange& a, const RatingChange& b) {
+        int deltaA = std::abs(a.newRating - a.oldRating);
+        int deltaB = std::abs(b.newRating - b.oldRating);
+        return deltaA != deltaB ? deltaA > deltaB : a.username < b.username;
+    });
+    size_t top = std::min(changes.size(), static_cast<size_t>(std::max(0, parser.value(topOption).toInt())));
+    for (size_t i = 0; i < top; ++i) {
+        std::cout << "  " << std::left << std::setw(24) << changes[i].username << std::right << std::setw(6)
+                  << changes[i].oldRating << " -> " << std::setw(6) << changes[i].newRating << std::endl;
+    }
+
+    if (parser.isSet(dryRunOption) || changedPlayers.empty()) {
+        return 0;
+    }
+
+    // Write the records, then rebuild the rankings from them so the snapshot matches
+    authenticator.savePlayers(changedPlayers);
+    authenticator.flush();
+
+    ChessLeaderboard leaderboard(playersPath);
+    leaderboard.refreshLeaderboard();
+    leaderboard.saveSnapshot();
+
+    std::cout << "Wrote " << changedPlayers.size() << " player record(s) and the leaderboard snapshot" << std::endl;
+    return 0;
+}
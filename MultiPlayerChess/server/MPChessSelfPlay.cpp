@@ -0,0 +1,599 @@
+// MPChessSelfPlay.cpp
+//
+// Bot-vs-bot matches between two engine configurations, for measuring the speed and
+// strength of ChessAI across changes. Games run in parallel on ChessGame and ChessAI,
+// without a server or networking, and each opening is played twice with the colors
+// swapped. The report gives nodes per second, the average depth reached and the
+// percentiles of the time per move for each side, then the match score as an Elo
+// difference with a sequential probability ratio test (SPRT) of elo0 against elo1.
+//
+// Engine B can be an external UCI engine. Run with --uci, this tool is one itself,
+// playing as engine A: to compare two builds, point one build's --opponent at the
+// other build started with --uci. Each built-in engine searches with a transposition
+// table of its own, so neither side reads what the other, or another game, stored.
+
+#include "MPChessServer.h"
+
+/**
+ * @brief How one side of the match chooses its moves
+ */
+struct EngineConfig {
+    std::string name;
+    int skillLevel = 10;
+    int searchThreads = 1;
+    qint64 moveTimeMs = 0;  // Fixed time per move; 0 budgets from the clock like the server's bots
+    size_t hashSizeMB = TranspositionTable::DEFAULT_SIZE_MB;
+    std::string uciPath;    // External UCI engine in place of ChessAI
+};
+
+/**
+ * @brief Search statistics of one side, merged from all the games
+ */
+struct EngineStats {
+    int searchedMoves = 0;  // Moves that came from a search, not the book or a tablebase
+    long long depthSum = 0;
+    uint64_t nodes = 0;
+    double searchSeconds = 0.0;
+    std::vector<double> moveMs;  // Every move, as measured around the engine
+
+    void merge(const EngineStats& other) {
+        searchedMoves += other.searchedMoves;
+        depthSum += other.depthSum;
+        nodes += other.nodes;
+        searchSeconds += other.searchSeconds;
+        moveMs.insert(moveMs.end(), other.moveMs.begin(), other.moveMs.end());
+    }
+};
+
+/**
+ * @brief One side of a game: ChessAI in this process, or a UCI engine process
+ *
+ * Each worker thread creates its own, so an external engine belongs to the thread
+ * that talks to it and a built-in one has a transposition table no other engine uses.
+ */
+class MatchEngine {
+public:
+    explicit MatchEngine(const EngineConfig& config) : config(config), ai(config.skillLevel) {
+        ai.setSearchThreads(config.searchThreads);
+    }
+
+    bool start() {
+        if (config.uciPath.empty()) {
+            ai.setTranspositionTable(std::make_shared<TranspositionTable>(config.hashSizeMB));
+            return true;
+        }
+        uci = std::make_unique<StockfishConnector>(config.uciPath, config.searchThreads, 16);
+        return uci->initialize();
+    }
+
+    ChessMove think(const ChessBoard& board, qint64 budgetMs, EngineStats& stats) {
+        auto start = std::chrono::steady_clock::now();
+        ChessMove move;
+        if (uci) {
+            EngineSearchLimits limits;
+            limits.moveTimeMs = static_cast<int>(std::max<qint64>(budgetMs, 1));
+            EngineSearchResult result = uci->search(StockfishConnector::boardToFen(board),
+                                                    board.getCurrentTurn() == PieceColor::WHITE, limits, 1, 20);
+            move = result.bestMove;
+        } else {
+            move = ai.getBestMove(board, board.getCurrentTurn(), budgetMs);
+            const ChessAI::SearchInfo& info = ai.getLastSearchInfo();
+            if (info.depth > 0) {
+                stats.searchedMoves++;
+                stats.depthSum += info.depth;
+                stats.nodes += info.nodes;
+                stats.searchSeconds += info.seconds;
+            }
+        }
+        stats.moveMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return move;
+    }
+
+    const EngineConfig& getConfig() const { return config; }
+
+private:
+    EngineConfig config;
+    ChessAI ai;
+    std::unique_ptr<StockfishConnector> uci;
+};
+
+/**
+ * @brief Wins, draws and losses of engine A, and what they say about its strength
+ */
+struct MatchScore {
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+
+    int games() const { return wins + draws + losses; }
+
+    double score() const {
+        return games() > 0 ? (wins + 0.5 * draws) / games() : 0.5;
+    }
+
+    static double eloToScore(double elo) { return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0)); }
+
+    static double scoreToElo(double score) {
+        score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+        return -400.0 * std::log10(1.0 / score - 1.0);
+    }
+
+    double elo() const { return scoreToElo(score()); }
+
+    // Half-width of the 95% confidence interval of elo()
+    double eloMargin() const {
+        if (games() == 0) {
+            return 0.0;
+        }
+        double s = score();
+        double variance = (wins * (1.0 - s) * (1.0 - s) + draws * (0.5 - s) * (0.5 - s) + losses * s * s) / games();
+        double deviation = 1.96 * std::sqrt(variance / games());
+        return (scoreToElo(s + deviation) - scoreToElo(s - deviation)) / 2.0;
+    }
+
+    // Log-likelihood ratio of elo1 against elo0, in the normal approximation to the
+    // trinomial GSPRT. Half a game of each result is added so the first few games,
+    // all of one result, do not end the test
+    double llr(double elo0, double elo1) const {
+        double w = wins + 0.5;
+        double d = draws + 0.5;
+        double l = losses + 0.5;
+        double n = w + d + l;
+        double s = (w + 0.5 * d) / n;
+        double variance = (w * (1.0 - s) * (1.0 - s) + d * (0.5 - s) * (0.5 - s) + l * s * s) / n;
+        double s0 = eloToScore(elo0);
+        double s1 = eloToScore(elo1);
+        return (s1 - s0) * (2.0 * s - s0 - s1) / (2.0 * variance / n);
+    }
+};
+
+// Openings, each played from both sides, so deterministic engines still vary their games
+static const std::vector<std::vector<std::string>> OPENINGS = {
+    {},
+    { "e2e4", "e7e5", "g1f3", "b8c6", "f1b5" },
+    { "e2e4", "e7e5", "g1f3", "b8c6", "f1c4", "f8c5" },
+    { "e2e4", "c7c5", "g1f3", "d7d6", "d2d4", "c5d4", "f3d4" },
+    { "e2e4", "c7c5", "b1c3", "b8c6" },
+    { "e2e4", "e7e6", "d2d4", "d7d5" },
+    { "e2e4", "c7c6", "d2d4", "d7d5" },
+    { "d2d4", "d7d5", "c2c4", "e7e6", "b1c3", "g8f6" },
+    { "d2d4", "d7d5", "c2c4", "c7c6" },
+    { "d2d4", "g8f6", "c2c4", "g7g6", "b1c3", "f8g7" },
+    { "d2d4", "g8f6", "c2c4", "e7e6", "b1c3", "f8b4" },
+    { "c2c4", "e7e5", "b1c3", "g8f6" },
+    { "g1f3", "d7d5", "g2g3", "g8f6", "f1g2" },
+    { "e2e4", "d7d5", "e4d5", "d8d5", "b1c3" }
+};
+
+// The legal move of the side to move written as text, or an invalid move
+static ChessMove findMove(const ChessBoard& board, const std::string& text)
+{
+    for (const ChessMove& move : board.getAllValidMoves(board.getCurrentTurn())) {
+        if (move.toAlgebraic() == text) {
+            return move;
+        }
+    }
+    return ChessMove();
+}
+
+/**
+ * @brief How a game ended, from White's point of view
+ */
+struct GameOutcome {
+    GameResult result = GameResult::DRAW;
+    std::string reason;
+    int plies = 0;
+};
+
+static GameOutcome playGame(MatchEngine& white, MatchEngine& black, EngineStats& whiteStats, EngineStats& blackStats,
+                            const std::vector<std::string>& opening, TimeControlType timeControl, int maxPlies,
+                            const std::string& gameId)
+{
+    ChessPlayer whitePlayer(white.getConfig().name);
+    ChessPlayer blackPlayer(black.getConfig().name);
+    whitePlayer.setBot(true);
+    blackPlayer.setBot(true);
+
+    ChessGame game(&whitePlayer, &blackPlayer, gameId, timeControl);
+    game.start();
+
+    GameOutcome outcome;
+    for (const std::string& text : opening) {
+        game.processMove(game.getCurrentPlayer(), findMove(*game.getBoard(), text));
+    }
+
+    while (!game.isOver()) {
+        if (static_cast<int>(game.getBoard()->getMoveHistory().size()) >= maxPlies) {
+            game.end(GameResult::DRAW);
+            outcome.reason = "move limit";
+            break;
+        }
+
+        ChessPlayer* mover = game.getCurrentPlayer();
+        bool whiteToMove = mover == &whitePlayer;
+        MatchEngine& engine = whiteToMove ? white : black;
+        GameResult opponentWins = whiteToMove ? GameResult::BLACK_WIN : GameResult::WHITE_WIN;
+
+        // A fixed time per move plays without flags; otherwise the clock is the server's
+        qint64 moveTime = engine.getConfig().moveTimeMs;
+        qint64 budget = moveTime > 0 ? moveTime
+                                     : ChessAI::computeMoveTimeBudget(game.getLiveRemainingTime(mover), timeControl);
+        ChessMove move = engine.think(*game.getBoard(), budget, whiteToMove ? whiteStats : blackStats);
+
+        if (moveTime == 0 && game.hasPlayerTimedOut(mover)) {
+            game.end(opponentWins);
+            outcome.reason = "time";
+            break;
+        }
+        if (game.processMove(mover, move) != MoveValidationStatus::VALID) {
+            game.end(opponentWins);
+            outcome.reason = "illegal move " + move.toAlgebraic() + " by " + engine.getConfig().name;
+            break;
+        }
+    }
+
+    outcome.result = game.getResult();
+    outcome.plies = static_cast<int>(game.getBoard()->getMoveHistory().size());
+    if (outcome.reason.empty()) {
+        outcome.reason = game.getPositionStatus().checkmate ? "checkmate" : "draw";
+    }
+    return outcome;
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double>& sorted, double fraction)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static void printEngineStats(const EngineConfig& config, EngineStats& stats)
+{
+    std::sort(stats.moveMs.begin(), stats.moveMs.end());
+    std::cout << "  " << config.name << ": ";
+    if (config.uciPath.empty()) {
+        std::cout << "skill " << config.skillLevel << ", " << config.searchThreads << " thread(s)";
+    } else {
+        std::cout << config.uciPath;
+    }
+    std::cout << std::endl;
+
+    if (stats.searchedMoves > 0) {
+        std::cout << "    searched moves " << stats.searchedMoves << ", average depth " << std::fixed
+                  << std::setprecision(2) << static_cast<double>(stats.depthSum) / stats.searchedMoves << ", "
+                  << std::setprecision(0)
+                  << (stats.searchSeconds > 0 ? stats.nodes / stats.searchSeconds : 0.0) << " nodes/s" << std::endl;
+    }
+    std::cout << "    time per move (ms) p50 " << std::fixed << std::setprecision(1) << percentile(stats.moveMs, 0.5)
+              << ", p90 " << percentile(stats.moveMs, 0.9) << ", p99 " << percentile(stats.moveMs, 0.99)
+              << ", max " << (stats.moveMs.empty() ? 0.0 : stats.moveMs.back()) << std::endl;
+}
+
+// Act as a UCI engine playing with config's ChessAI, for another build's --opponent
+static int runUciEngine(const EngineConfig& config)
+{
+    ChessAI ai(config.skillLevel);
+    ai.setSearchThreads(config.searchThreads);
+    ChessBoard board;
+    board.initialize();
+
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream input(line);
+        std::string command;
+        input >> command;
+
+        if (command == "uci") {
+            std::cout << "id name MPChess ChessAI (skill " << config.skillLevel << ")" << std::endl;
+            std::cout << "uciok" << std::endl;
+        } else if (command == "isready") {
+            std::cout << "readyok" << std::endl;
+        } else if (command == "ucinewgame") {
+            board.initialize();
+        } else if (command == "position") {
+            // position startpos|fen <fen> [moves ...]
+            std::string token;
+            input >> token;
+            if (token == "startpos") {
+                board.initialize();
+                input >> token;
+            } else if (token == "fen") {
+                std::string fen;
+                while (input >> token && token != "moves") {
+                    fen += (fen.empty() ? "" : " ") + token;
+                }
+                if (!board.loadFromFen(fen)) {
+                    std::cerr << "Invalid FEN: " << fen << std::endl;
+                }
+            }
+            if (token == "moves") {
+                while (input >> token) {
+                    ChessMove move = findMove(board, token);
+                    if (!move.getFrom().isValid() || board.movePiece(move) != MoveValidationStatus::VALID) {
+                        std::cerr << "Illegal move in position: " << token << std::endl;
+                        break;
+                    }
+                }
+            }
+        } else if (command == "go") {
+            // go movetime <ms> | go wtime <ms> btime <ms> ...; anything else searches to the skill's depth
+            qint64 moveTime = config.moveTimeMs;
+            qint64 whiteTime = 0;
+            qint64 blackTime = 0;
+            std::string token;
+            while (input >> token) {
+                qint64 value = 0;
+                if (token == "movetime" && input >> value) moveTime = value;
+                else if (token == "wtime" && input >> value) whiteTime = value;
+                else if (token == "btime" && input >> value) blackTime = value;
+            }
+            qint64 clock = board.getCurrentTurn() == PieceColor::WHITE ? whiteTime : blackTime;
+            if (moveTime == 0 && clock > 0) {
+                moveTime = ChessAI::computeMoveTimeBudget(clock, TimeControlType::RAPID);
+            }
+
+            ChessMove move = ai.getBestMove(board, board.getCurrentTurn(), moveTime);
+            const ChessAI::SearchInfo& info = ai.getLastSearchInfo();
+            std::string text = move.getFrom().isValid() ? move.toAlgebraic() : "0000";
+            std::cout << "info depth " << info.depth << " nodes " << info.nodes << " time "
+                      << static_cast<qint64>(info.seconds * 1000) << " score cp "
+                      << static_cast<int>(std::lround(info.score * 100)) << " pv " << text << std::endl;
+            std::cout << "bestmove " << text << std::endl;
+        } else if (command == "quit") {
+            break;
+        }
+        // setoption is ignored: the engine plays with the settings it was started with
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // Parse command line arguments
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Bot-vs-bot matches between two ChessAI configurations");
+    parser.addHelpOption();
+
+    QCommandLineOption gamesOption(QStringList() << "n" << "games",
+                                   "Games to play at most, in pairs with colors swapped (default: 100)",
+                                   "count", "100");
+    parser.addOption(gamesOption);
+
+    QCommandLineOption concurrencyOption(QStringList() << "c" << "concurrency",
+                                         "Games played at once (default: cores divided by the search threads)",
+                                         "count", "0");
+    parser.addOption(concurrencyOption);
+
+    QCommandLineOption timeControlOption(QStringList() << "time-control",
+                                         "Clock of both sides: rapid, blitz, bullet, classical (default: bullet)",
+                                         "name", "bullet");
+    parser.addOption(timeControlOption);
+
+    QCommandLineOption skillAOption(QStringList() << "skill-a", "Skill level of engine A, 1-10 (default: 10)",
+                                    "level", "10");
+    parser.addOption(skillAOption);
+
+    QCommandLineOption skillBOption(QStringList() << "skill-b", "Skill level of engine B, 1-10 (default: 10)",
+                                    "level", "10");
+    parser.addOption(skillBOption);
+
+    QCommandLineOption threadsAOption(QStringList() << "threads-a", "Search threads of engine A (default: 1)",
+                                      "count", "1");
+    parser.addOption(threadsAOption);
+
+    QCommandLineOption threadsBOption(QStringList() << "threads-b", "Search threads of engine B (default: 1)",
+                                      "count", "1");
+    parser.addOption(threadsBOption);
+
+    QCommandLineOption moveTimeAOption(QStringList() << "move-time-a",
+                                       "Fixed milliseconds per move of engine A, 0 to budget from the clock (default: 0)",
+                                       "ms", "0");
+    parser.addOption(moveTimeAOption);
+
+    QCommandLineOption moveTimeBOption(QStringList() << "move-time-b",
+                                       "Fixed milliseconds per move of engine B, 0 to budget from the clock (default: 0)",
+                                       "ms", "0");
+    parser.addOption(moveTimeBOption);
+
+    QCommandLineOption opponentOption(QStringList() << "opponent",
+                                      "UCI engine to play as engine B, such as another build run with --uci",
+                                      "path");
+    parser.addOption(opponentOption);
+
+    QCommandLineOption uciOption(QStringList() << "uci",
+                                 "Run as a UCI engine with engine A's settings instead of playing a match");
+    parser.addOption(uciOption);
+
+    QCommandLineOption hashSizeOption(QStringList() << "hash-size",
+                                      "Transposition table size in MB of each built-in engine in each game thread (default: 64)",
+                                      "mb", "64");
+    parser.addOption(hashSizeOption);
+
+    QCommandLineOption bookOption(QStringList() << "book", "Opening book both built-in engines play from", "path");
+    parser.addOption(bookOption);
+
+    QCommandLineOption maxPliesOption(QStringList() << "max-plies",
+                                      "Half-moves after which a game is scored a draw (default: 400)",
+                                      "count", "400");
+    parser.addOption(maxPliesOption);
+
+    QCommandLineOption elo0Option(QStringList() << "elo0", "SPRT null hypothesis, A - B in Elo (default: 0)",
+                                  "elo", "0");
+    parser.addOption(elo0Option);
+
+    QCommandLineOption elo1Option(QStringList() << "elo1", "SPRT alternative hypothesis, A - B in Elo (default: 10)",
+                                  "elo", "10");
+    parser.addOption(elo1Option);
+
+    QCommandLineOption alphaOption(QStringList() << "alpha", "SPRT false positive rate (default: 0.05)",
+                                   "rate", "0.05");
+    parser.addOption(alphaOption);
+
+    QCommandLineOption betaOption(QStringList() << "beta", "SPRT false negative rate (default: 0.05)",
+                                  "rate", "0.05");
+    parser.addOption(betaOption);
+
+    QCommandLineOption sprtOption(QStringList() << "sprt",
+                                  "Stop as soon as the SPRT accepts a hypothesis; exit status 1 if it accepts elo0");
+    parser.addOption(sprtOption);
+
+    parser.process(app);
+
+    EngineConfig engineA;
+    engineA.name = "A";
+    engineA.skillLevel = std::min(std::max(parser.value(skillAOption).toInt(), 1), 10);
+    engineA.searchThreads = std::max(1, parser.value(threadsAOption).toInt());
+    engineA.moveTimeMs = std::max(0, parser.value(moveTimeAOption).toInt());
+
+    EngineConfig engineB;
+    engineB.name = "B";
+    engineB.skillLevel = std::min(std::max(parser.value(skillBOption).toInt(), 1), 10);
+    engineB.searchThreads = std::max(1, parser.value(threadsBOption).toInt());
+    engineB.moveTimeMs = std::max(0, parser.value(moveTimeBOption).toInt());
+    engineB.uciPath = parser.value(opponentOption).toStdString();
+
+    // The shared table is only searched in --uci mode; matches give each engine its own
+    int hashSize = parser.value(hashSizeOption).toInt();
+    if (hashSize > 0) {
+        engineA.hashSizeMB = static_cast<size_t>(hashSize);
+        engineB.hashSizeMB = static_cast<size_t>(hashSize);
+        ChessAI::getTranspositionTable().resize(static_cast<size_t>(hashSize));
+    }
+    if (parser.isSet(bookOption)) {
+        auto book = std::make_shared<OpeningBook>(parser.value(bookOption).toStdString());
+        if (!book->isOpen()) {
+            std::cerr << "Cannot open opening book " << parser.value(bookOption).toStdString() << std::endl;
+            return 1;
+        }
+        ChessAI::setOpeningBook(book);
+    }
+
+    if (parser.isSet(uciOption)) {
+        return runUciEngine(engineA);
+    }
+
+    static const QMap<QString, TimeControlType> timeControls = {
+        { "rapid", TimeControlType::RAPID }, { "blitz", TimeControlType::BLITZ },
+        { "bullet", TimeControlType::BULLET }, { "classical", TimeControlType::CLASSICAL }
+    };
+    if (!timeControls.contains(parser.value(timeControlOption))) {
+        std::cerr << "Unknown time control " << parser.value(timeControlOption).toStdString() << std::endl;
+        return 1;
+    }
+    TimeControlType timeControl = timeControls.value(parser.value(timeControlOption));
+
+    int totalGames = std::max(1, parser.value(gamesOption).toInt());
+    int maxPlies = std::max(1, parser.value(maxPliesOption).toInt());
+    int concurrency = parser.value(concurrencyOption).toInt();
+    if (concurrency <= 0) {
+        concurrency = std::max(1, QThread::idealThreadCount() / std::max(engineA.searchThreads, engineB.searchThreads));
+    }
+    concurrency = std::min(concurrency, totalGames);
+
+    double elo0 = parser.value(elo0Option).toDouble();
+    double elo1 = parser.value(elo1Option).toDouble();
+    double alpha = parser.value(alphaOption).toDouble();
+    double beta = parser.value(betaOption).toDouble();
+    double lowerBound = std::log(beta / (1.0 - alpha));
+    double upperBound = std::log((1.0 - beta) / alpha);
+    bool sprt = parser.isSet(sprtOption);
+
+    std::cout << "Playing " << totalGames << " game(s), " << concurrency << " at a time, "
+              << parser.value(timeControlOption).toStdString() << std::endl;
+
+    std::mutex resultsMutex;
+    MatchScore score;
+    EngineStats statsA;
+    EngineStats statsB;
+    std::map<std::string, int> reasons;
+    std::atomic<int> nextGame(0);
+    std::atomic<bool> stop(false);
+    std::atomic<bool> engineFailed(false);
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        MatchEngine a(engineA);
+        MatchEngine b(engineB);
+        if (!a.start() || !b.start()) {
+            engineFailed = true;
+            return;
+        }
+
+        EngineStats localA;
+        EngineStats localB;
+        int game;
+        while (!stop && (game = nextGame++) < totalGames) {
+            // Each opening twice, A playing White in the first game of the pair
+            const std::vector<std::string>& opening = OPENINGS[(game / 2) % OPENINGS.size()];
+            bool aIsWhite = game % 2 == 0;
+            GameOutcome outcome = aIsWhite
+                ? playGame(a, b, localA, localB, opening, timeControl, maxPlies, "selfplay-" + std::to_string(game))
+                : playGame(b, a, localB, localA, opening, timeControl, maxPlies, "selfplay-" + std::to_string(game));
+
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            GameResult aWins = aIsWhite ? GameResult::WHITE_WIN : GameResult::BLACK_WIN;
+            if (outcome.result == GameResult::DRAW) {
+                score.draws++;
+            } else if (outcome.result == aWins) {
+                score.wins++;
+            } else {
+                score.losses++;
+            }
+            reasons[outcome.reason]++;
+
+            double llr = score.llr(elo0, elo1);
+            std::cout << "Game " << score.games() << "/" << totalGames << " (" << (aIsWhite ? "A-B" : "B-A") << ") "
+                      << (outcome.result == GameResult::WHITE_WIN ? "1-0" :
+                          outcome.result == GameResult::BLACK_WIN ? "0-1" : "1/2-1/2")
+                      << " " << outcome.reason << " in " << outcome.plies << " plies; A +" << score.wins << " ="
+                      << score.draws << " -" << score.losses << ", Elo " << std::showpos << std::fixed
+                      << std::setprecision(1) << score.elo() << std::noshowpos << " +/- " << score.eloMargin()
+                      << ", LLR " << std::setprecision(2) << llr << std::endl;
+            if (sprt && (llr <= lowerBound || llr >= upperBound)) {
+                stop = true;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        statsA.merge(localA);
+        statsB.merge(localB);
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < concurrency; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    if (engineFailed && score.games() == 0) {
+        std::cerr << "Could not start the opponent engine " << engineB.uciPath << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::endl << "Played " << score.games() << " game(s) in " << std::fixed << std::setprecision(1)
+              << seconds << " s" << std::endl;
+    for (const auto& [reason, count] : reasons) {
+        std::cout << "  " << reason << ": " << count << std::endl;
+    }
+    printEngineStats(engineA, statsA);
+    printEngineStats(engineB, statsB);
+
+    double llr = score.llr(elo0, elo1);
+    std::cout << "Score of A: +" << score.wins << " =" << score.draws << " -" << score.losses << " ("
+              << std::setprecision(1) << score.score() * 100 << "%), Elo " << std::showpos << score.elo()
+              << std::noshowpos << " +/- " << score.eloMargin() << std::endl;
+    std::cout << "SPRT elo0 " << elo0 << " elo1 " << elo1 << ": LLR " << std::setprecision(2) << llr << " ["
+              << lowerBound << ", " << upperBound << "], "
+              << (llr >= upperBound ? "elo1 accepted" : llr <= lowerBound ? "elo0 accepted" : "inconclusive")
+              << std::endl;
+
+    return sprt && llr <= lowerBound ? 1 : 0;
+}
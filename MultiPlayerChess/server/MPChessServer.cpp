@@ -2,10 +2,122 @@
 
 #include "MPChessServer.h"
 
+#ifdef MPCHESS_HAVE_SYZYGY
+#include "tbprobe.h"
+#endif
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
 // Initialize static members
-std::mutex PerformanceMonitor::mutex;
-std::unordered_map<std::string, std::chrono::time_point<std::chrono::high_resolution_clock>> PerformanceMonitor::operationTimers;
-std::unordered_map<std::string, PerformanceMonitor::OperationStats> PerformanceMonitor::operationStats;
+std::mutex PerformanceMonitor::registryMutex;
+std::vector<PerformanceMonitor::ThreadStats*> PerformanceMonitor::threadStats;
+std::map<std::string, PerformanceMonitor::OperationStats> PerformanceMonitor::retiredStats;
+std::atomic<bool> ChessLogger::traceEnabled(false);
+thread_local unsigned int LatencyHistogram::ScopedTimer::sampleCounter = 0;
+LatencyHistogram ServerMetrics::moveRequestSeconds(1e-5);
+LatencyHistogram ServerMetrics::moveGenerationSeconds(1e-7);
+LatencyHistogram ServerMetrics::searchSeconds(1e-3);
+LatencyHistogram ServerMetrics::writeBacklogBytes(64);
+LatencyHistogram ServerMetrics::matchmakingWaitSeconds(0.25);
+std::atomic<uint64_t> ServerMetrics::searchNodes(0);
+LatencyHistogram ServerMetrics::botMoveQueueSeconds(1e-4);
+
+// Implementation of PerformanceMonitor class
+PerformanceMonitor::ThreadStats::ThreadStats() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    threadStats.push_back(this);
+}
+
+PerformanceMonitor::ThreadStats::~ThreadStats() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& [operation, operationStats] : stats) {
+        retiredStats[operation].merge(operationStats);
+    }
+    threadStats.erase(std::remove(threadStats.begin(), threadStats.end(), this), threadStats.end());
+}
+
+PerformanceMonitor::ThreadStats& PerformanceMonitor::localStats() {
+    thread_local ThreadStats local;
+    return local;
+}
+
+void PerformanceMonitor::record(const char* operation, double durationMs) {
+    ThreadStats& local = localStats();
+    std::lock_guard<std::mutex> lock(local.mutex);
+    local.stats[operation].add(durationMs);
+}
+
+std::string PerformanceMonitor::getStatsSummary() {
+    std::map<std::string, OperationStats> merged;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        merged = retiredStats;
+        for (ThreadStats* thread : threadStats) {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            for (const auto& [operation, operationStats] : thread->stats) {
+                merged[operation].merge(operationStats);
+            }
+        }
+    }
+    
+    std::stringstream ss;
+    ss << "Performance Statistics:\n";
+    for (const auto& [operation, stats] : merged) {
+        ss << operation << ": "
+           << "avg=" << (stats.total / stats.count) << "ms, "
+           << "min=" << stats.min << "ms, "
+           << "max=" << stats.max << "ms, "
+           << "count=" << stats.count << "\n";
+    }
+    
+    return ss.str();
+}
+
+void PerformanceMonitor::resetStats() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    retiredStats.clear();
+    for (ThreadStats* thread : threadStats) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        thread->stats.clear();
+    }
+}
+
+// Implementation of LatencyHistogram class
+LatencyHistogram::LatencyHistogram(double firstBound) : firstBound(firstBound), sum(0.0) {
+    for (std::atomic<uint64_t>& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::observe(double value) {
+    int index = 0;
+    if (value > firstBound) {
+        index = std::min(BUCKET_COUNT, static_cast<int>(std::ceil(2.0 * std::log2(value / firstBound))));
+    }
+    buckets[index].fetch_add(1, std::memory_order_relaxed);
+    
+    double current = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::writePrometheus(std::ostream& out, const char* name, const char* help) const {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " histogram\n";
+    
+    // Buckets are cumulative in the exposition format
+    uint64_t cumulative = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        out << name << "_bucket{le=\"" << firstBound * std::pow(2.0, i / 2.0) << "\"} " << cumulative << "\n";
+    }
+    cumulative += buckets[BUCKET_COUNT].load(std::memory_order_relaxed);
+    out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+    out << name << "_sum " << sum.load(std::memory_order_relaxed) << "\n";
+    out << name << "_count " << cumulative << "\n";
+}
 
 // Implementation of ChessPiece class
 ChessPiece::ChessPiece(PieceType type, PieceColor color)
@@ -337,33 +449,105 @@ public:
     }
 };
 
+// Create a new piece object of the given type and color
+static std::unique_ptr<ChessPiece> createPiece(PieceType type, PieceColor color)
+{
+    switch (type) {
+        case PieceType::PAWN:   return std::make_unique<Pawn>(color);
+        case PieceType::KNIGHT: return std::make_unique<Knight>(color);
+        case PieceType::BISHOP: return std::make_unique<Bishop>(color);
+        case PieceType::ROOK:   return std::make_unique<Rook>(color);
+        case PieceType::QUEEN:  return std::make_unique<Queen>(color);
+        case PieceType::KING:   return std::make_unique<King>(color);
+        default:                return nullptr;
+    }
+}
+
+// Shared immutable piece instances handed out by ChessBoard::getPiece().
+// The board itself only stores bitboards, so lookups never touch the heap.
+static const ChessPiece* getSharedPiece(PieceType type, PieceColor color, bool moved)
+{
+    static const std::array<std::unique_ptr<ChessPiece>, 24> sharedPieces = [] {
+        std::array<std::unique_ptr<ChessPiece>, 24> table;
+        for (int index = 0; index < 12; ++index) {
+            for (int m = 0; m < 2; ++m) {
+                auto piece = createPiece(static_cast<PieceType>(index % 6), static_cast<PieceColor>(index / 6));
+                piece->setMoved(m == 1);
+                table[index * 2 + m] = std::move(piece);
+            }
+        }
+        return table;
+    }();
+    
+    return sharedPieces[BitboardPosition::pieceIndex(type, color) * 2 + (moved ? 1 : 0)].get();
+}
+
 // Implementation of ChessMove class
-ChessMove::ChessMove() : from(-1, -1), to(-1, -1), promotionType(PieceType::EMPTY) {
+ChessMove::ChessMove() : packed(0) {
+}
+
+ChessMove::ChessMove(const Position& from, const Position& to, PieceType promotionType) : packed(0) {
+    if (from.isValid() && to.isValid()) {
+        *this = fromSquares(BitboardPosition::square(from), BitboardPosition::square(to), promotionType);
+    }
 }
 
-ChessMove::ChessMove(const Position& from, const Position& to, PieceType promotionType)
-    : from(from), to(to), promotionType(promotionType) {
+ChessMove ChessMove::fromSquares(int from, int to, PieceType promotionType) {
+    ChessMove move;
+    move.packed = static_cast<uint16_t>(VALID_FLAG | from | (to << 6));
+    move.setPromotionType(promotionType);
+    return move;
+}
+
+ChessMove ChessMove::fromPacked(uint16_t packed) {
+    ChessMove move;
+    if (packed & VALID_FLAG) {
+        move.packed = packed;
+    }
+    return move;
 }
 
 Position ChessMove::getFrom() const {
-    return from;
+    return isValid() ? BitboardPosition::toPosition(packed & 0x3F) : Position();
 }
 
 Position ChessMove::getTo() const {
-    return to;
+    return isValid() ? BitboardPosition::toPosition((packed >> 6) & 0x3F) : Position();
+}
+
+int ChessMove::getFromSquare() const {
+    return isValid() ? (packed & 0x3F) : -1;
+}
+
+int ChessMove::getToSquare() const {
+    return isValid() ? ((packed >> 6) & 0x3F) : -1;
 }
 
 PieceType ChessMove::getPromotionType() const {
-    return promotionType;
+    int code = (packed >> PROMOTION_SHIFT) & 0x07;
+    return code == 0 ? PieceType::EMPTY : static_cast<PieceType>(code - 1);
 }
 
 void ChessMove::setPromotionType(PieceType type) {
-    promotionType = type;
+    if (!isValid()) {
+        return;
+    }
+    int code = (type == PieceType::EMPTY) ? 0 : static_cast<int>(type) + 1;
+    packed = static_cast<uint16_t>((packed & ~(0x07 << PROMOTION_SHIFT)) | (code << PROMOTION_SHIFT));
+}
+
+bool ChessMove::isValid() const {
+    return (packed & VALID_FLAG) != 0;
+}
+
+uint16_t ChessMove::getPacked() const {
+    return packed;
 }
 
 std::string ChessMove::toAlgebraic() const {
-    std::string result = from.toAlgebraic() + to.toAlgebraic();
+    std::string result = getFrom().toAlgebraic() + getTo().toAlgebraic();
     
+    PieceType promotionType = getPromotionType();
     if (promotionType != PieceType::EMPTY) {
         char promotionChar;
         switch (promotionType) {
@@ -401,6 +585,10 @@ ChessMove ChessMove::fromAlgebraic(const std::string& algebraic) {
 }
 
 std::string ChessMove::toStandardNotation(const ChessBoard& board) const {
+    Position from = getFrom();
+    Position to = getTo();
+    PieceType promotionType = getPromotionType();
+    
     const ChessPiece* piece = board.getPiece(from);
     if (!piece) return "invalid";
     
@@ -497,15 +685,185 @@ std::string ChessMove::toStandardNotation(const ChessBoard& board) const {
 }
 
 bool ChessMove::operator==(const ChessMove& other) const {
-    return from == other.from && to == other.to && promotionType == other.promotionType;
+    return packed == other.packed;
 }
 
 bool ChessMove::operator!=(const ChessMove& other) const {
     return !(*this == other);
 }
 
+// Implementation of MonotonicArena class
+void* MonotonicArena::allocateInNextBlock(size_t bytes, size_t alignment)
+{
+    // Move on to the next block kept from earlier use that is large enough, or add one
+    size_t next = blocks.empty() ? 0 : current + 1;
+    while (next < blocks.size() && blocks[next].size < bytes + alignment) {
+        ++next;
+    }
+    if (next >= blocks.size()) {
+        size_t size = std::max(blockSize, bytes + alignment);
+        blocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[size]), size });
+        next = blocks.size() - 1;
+    }
+    
+    current = next;
+    offset = 0;
+    return allocate(bytes, alignment);
+}
+
+// Implementation of AttackTables struct
+
+// Magic multipliers found offline with buildSliderTable's search; verified again at startup
+static const uint64_t ROOK_MAGICS[64] = {
+    0x4100104100208000ULL, 0x9040002000401004ULL, 0x0880100009802001ULL, 0x2080100004080080ULL,
+    0x0280040081080002ULL, 0x0100020400080100ULL, 0x0880120000801100ULL, 0x0100024021860100ULL,
+    0x0000802040008009ULL, 0x9600802000400080ULL, 0x0090808010002000ULL, 0x0000801000080084ULL,
+    0x0810800400880080ULL, 0x0021000900040002ULL, 0x2000800200800100ULL, 0x4581000080410002ULL,
+    0x1040218001804000ULL, 0x2040008080402000ULL, 0x2180808010002000ULL, 0x00C80B0010010021ULL,
+    0x500E808008000400ULL, 0x4D02808002000400ULL, 0x0510040001108208ULL, 0x02001200004D2084ULL,
+    0x0000401080008020ULL, 0x2020022140005001ULL, 0x8000802200104201ULL, 0x0204090100100220ULL,
+    0x0100080080040081ULL, 0x0205040080020080ULL, 0x802010040002E801ULL, 0x0040004200042081ULL,
+    0x0008400428800088ULL, 0x0002830027004002ULL, 0x0800401602002082ULL, 0x0040080082801004ULL,
+    0x00201A000A002032ULL, 0x0002000402000810ULL, 0x1202000182000408ULL, 0x1400040046000881ULL,
+    0x4043B04002808002ULL, 0x0120A005D0044000ULL, 0x0100102001010040ULL, 0x0210008100080800ULL,
+    0x0001001008010004ULL, 0x0091004400090012ULL, 0x0C10010210040008ULL, 0x1063001880410006ULL,
+    0x1480409500260200ULL, 0x1012050020408200ULL, 0x2800802000300180ULL, 0x0008001000088080ULL,
+    0x0190080080040080ULL, 0x1005000400020900ULL, 0x00022250081B0400ULL, 0x0903089401004200ULL,
+    0x0808201441008202ULL, 0x0140028100442015ULL, 0x000101110A402001ULL, 0x010A091000850021ULL,
+    0x600A000810200402ULL, 0x0491000400080201ULL, 0x021100020000C421ULL, 0x0020040040210082ULL
+};
+
+static const uint64_t BISHOP_MAGICS[64] = {
+    0x0110020204340010ULL, 0x0002020801010410ULL, 0x0010014200200401ULL, 0x0108484100020000ULL,
+    0x0022021080050000ULL, 0x1202021104001081ULL, 0x70020A0220060440ULL, 0x004080480801080CULL,
+    0x1002070802040401ULL, 0x0418110200850E00ULL, 0x8000210200920C10ULL, 0x4420110414800805ULL,
+    0x9001042420C04003ULL, 0x0440051012100000ULL, 0x0001A04808080802ULL, 0x0C00010088014805ULL,
+    0x014101A034018211ULL, 0x011002341000C301ULL, 0x4101010818030010ULL, 0x2400880808210140ULL,
+    0x0005009490400000ULL, 0x8003020200808440ULL, 0x1400500405043040ULL, 0x1814840610841120ULL,
+    0x0004400084100444ULL, 0x000520539C882201ULL, 0x0000500208002441ULL, 0x0010040028440008ULL,
+    0x2081010000104010ULL, 0x2000910004806008ULL, 0x11C08400288C4420ULL, 0x0119010800208801ULL,
+    0x0004042004052040ULL, 0x0002012012900200ULL, 0x2200203000180180ULL, 0x0002208020980200ULL,
+    0x2234080201042008ULL, 0x6020880042020102ULL, 0x0602020212004800ULL, 0xE120808304088420ULL,
+    0x300804300503089AULL, 0x4006020A0B102024ULL, 0x5006010C02000102ULL, 0x1000402204202800ULL,
+    0x4100200414000040ULL, 0x100401004A000500ULL, 0x340850A400400480ULL, 0x2004008C00400108ULL,
+    0x1010480A90302001ULL, 0x0008841412022008ULL, 0x0022210088040000ULL, 0x0001110041108000ULL,
+    0x4001004008220020ULL, 0x40000A1041020500ULL, 0x0143100A12124009ULL, 0x0420220882128000ULL,
+    0x000201042D050800ULL, 0x02042203008A9020ULL, 0x00220003208410A0ULL, 0x10400802820A0A00ULL,
+    0x0164001805050400ULL, 0x880000C410428600ULL, 0x0000440410046100ULL, 0x620262080800808AULL
+};
+
+uint64_t AttackTables::slidingAttacks(int sq, uint64_t occupancy, bool diagonal) {
+    static const int diagonalDirs[4][2] = { {1, 1}, {1, -1}, {-1, -1}, {-1, 1} };
+    static const int orthogonalDirs[4][2] = { {0, 1}, {1, 0}, {0, -1}, {-1, 0} };
+    const int (*dirs)[2] = diagonal ? diagonalDirs : orthogonalDirs;
+    
+    uint64_t attacks = 0;
+    for (int d = 0; d < 4; ++d) {
+        int row = sq / 8 + dirs[d][0];
+        int col = sq % 8 + dirs[d][1];
+        while (row >= 0 && row < 8 && col >= 0 && col < 8) {
+            uint64_t b = 1ULL << (row * 8 + col);
+            attacks |= b;
+            if (occupancy & b) {
+                break;  // Blocker is attacked, squares behind it are not
+            }
+            row += dirs[d][0];
+            col += dirs[d][1];
+        }
+    }
+    return attacks;
+}
+
+AttackTables::SliderTable AttackTables::buildSliderTable(bool diagonal) {
+    SliderTable table;
+    uint64_t seed = diagonal ? 0x2545F4914F6CDD1DULL : 0x9E3779B97F4A7C15ULL;
+    uint32_t offset = 0;
+    std::vector<uint64_t> occupancies;
+    std::vector<uint64_t> references;
+    std::vector<uint32_t> usedEpoch;
+    
+    for (int sq = 0; sq < 64; ++sq) {
+        // Relevant occupancy: the rays without the board edge they run into
+        int row = sq / 8;
+        int col = sq % 8;
+        uint64_t edges = ((0xFFULL | 0xFF00000000000000ULL) & ~(0xFFULL << (row * 8))) |
+                         ((0x0101010101010101ULL | 0x8080808080808080ULL) & ~(0x0101010101010101ULL << col));
+        uint64_t mask = slidingAttacks(sq, 0, diagonal) & ~edges;
+        int bits = BitboardPosition::popCount(mask);
+        size_t size = size_t(1) << bits;
+        
+        table.masks[sq] = mask;
+        table.shifts[sq] = static_cast<uint8_t>(64 - bits);
+        table.offsets[sq] = offset;
+        table.magics[sq] = 0;
+        
+        // Enumerate every subset of the mask (Carry-Rippler)
+        occupancies.clear();
+        references.clear();
+        uint64_t subset = 0;
+        do {
+            occupancies.push_back(subset);
+            references.push_back(slidingAttacks(sq, subset, diagonal));
+            subset = (subset - mask) & mask;
+        } while (subset);
+        
+        table.attacks.resize(offset + size);
+        
+#if defined(__BMI2__)
+        for (size_t i = 0; i < occupancies.size(); ++i) {
+            table.attacks[offset + _pext_u64(occupancies[i], mask)] = references[i];
+        }
+#else
+        // Check that a magic maps every subset without a destructive collision
+        usedEpoch.assign(size, 0);
+        uint32_t epoch = 0;
+        auto tryMagic = [&](uint64_t magic) {
+            ++epoch;
+            for (size_t i = 0; i < occupancies.size(); ++i) {
+                size_t index = (occupancies[i] * magic) >> table.shifts[sq];
+                if (usedEpoch[index] != epoch) {
+                    usedEpoch[index] = epoch;
+                    table.attacks[offset + index] = references[i];
+                } else if (table.attacks[offset + index] != references[i]) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        
+        // Use the precomputed magic, searching for a new one only if it does not fit
+        uint64_t magic = diagonal ? BISHOP_MAGICS[sq] : ROOK_MAGICS[sq];
+        while (!tryMagic(magic)) {
+            do {
+                seed = splitMix64(seed);
+                magic = seed;
+                seed = splitMix64(seed);
+                magic &= seed;
+                seed = splitMix64(seed);
+                magic &= seed;
+            } while (BitboardPosition::popCount((mask * magic) & 0xFF00000000000000ULL) < 6);
+        }
+        table.magics[sq] = magic;
+#endif
+        
+        offset += static_cast<uint32_t>(size);
+    }
+    
+    return table;
+}
+
+const AttackTables::SliderTable& AttackTables::bishopTable() {
+    static const SliderTable table = buildSliderTable(true);
+    return table;
+}
+
+const AttackTables::SliderTable& AttackTables::rookTable() {
+    static const SliderTable table = buildSliderTable(false);
+    return table;
+}
+
 // Implementation of ChessBoard class
-ChessBoard::ChessBoard() : currentTurn(PieceColor::WHITE), enPassantTarget(-1, -1), halfMoveClock(0)
+ChessBoard::ChessBoard() : halfMoveClock(0)
 {
 //  initialize();
 }
@@ -515,52 +873,36 @@ void ChessBoard::initialize()
     try {
         MPChessServer* server = MPChessServer::getInstance();
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::initialize() - Starting board initialization");
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::initialize() - Starting board initialization");
         }
         
         // Clear the board
-        for (int r = 0; r < 8; ++r) {
-            for (int c = 0; c < 8; ++c) {
-                board[r][c] = nullptr;
-            }
-        }
+        position.clear();
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::initialize() - Board cleared, placing white pieces");
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::initialize() - Board cleared, placing white pieces");
         }
         
         // Place white pieces
         try {
-            // Use make_unique with explicit types
-            board[0][0] = std::make_unique<Rook>(PieceColor::WHITE);
-            board[0][1] = std::make_unique<Knight>(PieceColor::WHITE);
-            board[0][2] = std::make_unique<Bishop>(PieceColor::WHITE);
-            board[0][3] = std::make_unique<Queen>(PieceColor::WHITE);
-            board[0][4] = std::make_unique<King>(PieceColor::WHITE);
-            board[0][5] = std::make_unique<Bishop>(PieceColor::WHITE);
-            board[0][6] = std::make_unique<Knight>(PieceColor::WHITE);
-            board[0][7] = std::make_unique<Rook>(PieceColor::WHITE);
+            const std::array<PieceType, 8> backRank = {
+                PieceType::ROOK, PieceType::KNIGHT, PieceType::BISHOP, PieceType::QUEEN,
+                PieceType::KING, PieceType::BISHOP, PieceType::KNIGHT, PieceType::ROOK
+            };
             
             for (int c = 0; c < 8; ++c) {
-                board[1][c] = std::make_unique<Pawn>(PieceColor::WHITE);
+                position.addPiece(BitboardPosition::square(0, c), backRank[c], PieceColor::WHITE, true);
+                position.addPiece(BitboardPosition::square(1, c), PieceType::PAWN, PieceColor::WHITE, true);
             }
             
             if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessBoard::initialize() - White pieces placed, placing black pieces");
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::initialize() - White pieces placed, placing black pieces");
             }
             
             // Place black pieces
-            board[7][0] = std::make_unique<Rook>(PieceColor::BLACK);
-            board[7][1] = std::make_unique<Knight>(PieceColor::BLACK);
-            board[7][2] = std::make_unique<Bishop>(PieceColor::BLACK);
-            board[7][3] = std::make_unique<Queen>(PieceColor::BLACK);
-            board[7][4] = std::make_unique<King>(PieceColor::BLACK);
-            board[7][5] = std::make_unique<Bishop>(PieceColor::BLACK);
-            board[7][6] = std::make_unique<Knight>(PieceColor::BLACK);
-            board[7][7] = std::make_unique<Rook>(PieceColor::BLACK);
-            
             for (int c = 0; c < 8; ++c) {
-                board[6][c] = std::make_unique<Pawn>(PieceColor::BLACK);
+                position.addPiece(BitboardPosition::square(7, c), backRank[c], PieceColor::BLACK, true);
+                position.addPiece(BitboardPosition::square(6, c), PieceType::PAWN, PieceColor::BLACK, true);
             }
         } catch (const std::exception& e) {
             if (server && server->getLogger()) {
@@ -575,23 +917,25 @@ void ChessBoard::initialize()
         }
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::initialize() - All pieces placed, resetting game state");
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::initialize() - All pieces placed, resetting game state");
         }
         
         // Reset state
-        currentTurn = PieceColor::WHITE;
-        enPassantTarget = Position(-1, -1);
+        position.setSideToMove(PieceColor::WHITE);
+        position.setEnPassantSquare(-1);
+        position.refreshCastlingRights();
         moveHistory.clear();
         capturedWhitePieces.clear();
         capturedBlackPieces.clear();
         halfMoveClock = 0;
         boardStates.clear();
+        clearCaches();
         
         // Add initial board state
-        boardStates.push_back(getBoardStateString());
+        boardStates.push_back(position.zobristKey);
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::initialize() - Board initialization complete");
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::initialize() - Board initialization complete");
         }
     } catch (const std::exception& e) {
         MPChessServer* server = MPChessServer::getInstance();
@@ -608,9 +952,119 @@ void ChessBoard::initialize()
     }
 }
 
+bool ChessBoard::loadFromFen(const std::string& fen)
+{
+    std::istringstream fields(fen);
+    std::string placement, turn, castling, enPassant;
+    int halfMoves = 0;
+    if (!(fields >> placement >> turn)) {
+        return false;
+    }
+    fields >> castling >> enPassant >> halfMoves;
+    
+    BitboardPosition parsed;
+    
+    // Piece placement, from row 8 down to row 1
+    int row = 7;
+    int col = 0;
+    for (char c : placement) {
+        if (c == '/') {
+            if (col != 8 || --row < 0) return false;
+            col = 0;
+        } else if (c >= '1' && c <= '8') {
+            col += c - '0';
+            if (col > 8) return false;
+        } else {
+            PieceType type;
+            switch (std::tolower(static_cast<unsigned char>(c))) {
+                case 'p': type = PieceType::PAWN; break;
+                case 'n': type = PieceType::KNIGHT; break;
+                case 'b': type = PieceType::BISHOP; break;
+                case 'r': type = PieceType::ROOK; break;
+                case 'q': type = PieceType::QUEEN; break;
+                case 'k': type = PieceType::KING; break;
+                default: return false;
+            }
+            if (col >= 8) return false;
+            
+            PieceColor color = std::isupper(static_cast<unsigned char>(c)) ? PieceColor::WHITE : PieceColor::BLACK;
+            int startRow = (color == PieceColor::WHITE) ? 1 : 6;
+            parsed.addPiece(BitboardPosition::square(row, col), type, color, type == PieceType::PAWN && row == startRow);
+            ++col;
+        }
+    }
+    if (row != 0 || col != 8 ||
+        BitboardPosition::popCount(parsed.piecesOf(PieceType::KING, PieceColor::WHITE)) != 1 ||
+        BitboardPosition::popCount(parsed.piecesOf(PieceType::KING, PieceColor::BLACK)) != 1) {
+        return false;
+    }
+    
+    // Side to move
+    if (turn != "w" && turn != "b") return false;
+    parsed.setSideToMove(turn == "w" ? PieceColor::WHITE : PieceColor::BLACK);
+    
+    // Castling rights; the king and rook of each right are marked unmoved so hasMoved() agrees
+    uint8_t rights = 0;
+    auto grant = [&](uint8_t right, int rankRow, int rookCol, PieceColor color) {
+        int kingSq = BitboardPosition::square(rankRow, 4);
+        int rookSq = BitboardPosition::square(rankRow, rookCol);
+        if (parsed.typeAt(kingSq) != PieceType::KING || parsed.colorAt(kingSq) != color ||
+            parsed.typeAt(rookSq) != PieceType::ROOK || parsed.colorAt(rookSq) != color) {
+            return;
+        }
+        parsed.unmoved |= BitboardPosition::bit(kingSq) | BitboardPosition::bit(rookSq);
+        rights |= right;
+    };
+    for (char c : castling) {
+        switch (c) {
+            case 'K': grant(BitboardPosition::WHITE_KINGSIDE, 0, 7, PieceColor::WHITE); break;
+            case 'Q': grant(BitboardPosition::WHITE_QUEENSIDE, 0, 0, PieceColor::WHITE); break;
+            case 'k': grant(BitboardPosition::BLACK_KINGSIDE, 7, 7, PieceColor::BLACK); break;
+            case 'q': grant(BitboardPosition::BLACK_QUEENSIDE, 7, 0, PieceColor::BLACK); break;
+            case '-': break;
+            default: return false;
+        }
+    }
+    parsed.setCastlingRights(rights);
+    
+    // En passant target square
+    if (!enPassant.empty() && enPassant != "-") {
+        Position target = Position::fromAlgebraic(enPassant);
+        if (!target.isValid()) return false;
+        parsed.setEnPassantSquare(BitboardPosition::square(target));
+    }
+    
+    position = parsed;
+    moveHistory.clear();
+    capturedWhitePieces.clear();
+    capturedBlackPieces.clear();
+    halfMoveClock = std::max(0, halfMoves);
+    boardStates.clear();
+    boardStates.push_back(position.zobristKey);
+    
+    return true;
+}
+
 const ChessPiece* ChessBoard::getPiece(const Position& pos) const {
     if (!pos.isValid()) return nullptr;
-    return board[pos.row][pos.col].get();
+    
+    int sq = BitboardPosition::square(pos);
+    if (position.isEmpty(sq)) return nullptr;
+    
+    bool moved = (position.unmoved & BitboardPosition::bit(sq)) == 0;
+    return getSharedPiece(position.typeAt(sq), position.colorAt(sq), moved);
+}
+
+const BitboardPosition& ChessBoard::getBitboards() const {
+    return position;
+}
+
+uint64_t ChessBoard::getZobristKey() const {
+    return position.zobristKey;
+}
+
+int ChessBoard::getHalfMoveClock() const {
+    return halfMoveClock;
 }
 
 MoveValidationStatus ChessBoard::movePiece(const ChessMove& move, bool validateOnly)
@@ -630,18 +1084,23 @@ MoveValidationStatus ChessBoard::movePiece(const ChessMove& move, bool validateO
     }
     
     // Check if it's the correct player's turn
-    if (piece->getColor() != currentTurn) {
+    if (piece->getColor() != position.sideToMove) {
         return MoveValidationStatus::WRONG_TURN;
     }
     
-    // Check if the move is valid for the piece
-    std::vector<Position> possibleMoves = piece->getPossibleMoves(from, *this);
-    if (std::find(possibleMoves.begin(), possibleMoves.end(), to) == possibleMoves.end()) {
-        return MoveValidationStatus::INVALID_PATH;
-    }
+    // Check the move against the legal moves; promotion choice is resolved by makeMove
+    MoveList legalMoves;
+    generateLegalMoves(piece->getColor(), legalMoves);
+    bool isLegal = std::any_of(legalMoves.begin(), legalMoves.end(), [&](const ChessMove& legal) {
+        return legal.getFrom() == from && legal.getTo() == to;
+    });
     
-    // Check if the move would leave the king in check
-    if (wouldLeaveInCheck(move, piece->getColor())) {
+    if (!isLegal) {
+        // Tell a move the piece cannot make apart from one that exposes the king
+        std::vector<Position> possibleMoves = piece->getPossibleMoves(from, *this);
+        if (std::find(possibleMoves.begin(), possibleMoves.end(), to) == possibleMoves.end()) {
+            return MoveValidationStatus::INVALID_PATH;
+        }
         return MoveValidationStatus::KING_IN_CHECK;
     }
     
@@ -650,58 +1109,115 @@ MoveValidationStatus ChessBoard::movePiece(const ChessMove& move, bool validateO
         return MoveValidationStatus::VALID;
     }
     
-    // Store the captured piece (if any)
-    const ChessPiece* capturedPiece = nullptr;
-    if (isEnPassantCapture(move)) {
-        int captureRow = (piece->getColor() == PieceColor::WHITE) ? to.row - 1 : to.row + 1;
-        capturedPiece = getPiece(Position(captureRow, to.col));
+    MoveUndo undo;
+    makeMove(move, undo);
+
+    return MoveValidationStatus::VALID;
+}
+
+void ChessBoard::makeMove(const ChessMove& move, MoveUndo& undo)
+{
+    Position to = move.getTo();
+    int fromSq = move.getFromSquare();
+    int toSq = move.getToSquare();
+    
+    // Record everything needed to take the move back
+    undo.move = move;
+    undo.movedPiece = position.mailbox[fromSq];
+    undo.isCastling = isCastlingMove(move);
+    undo.isEnPassant = isEnPassantCapture(move);
+    undo.unmoved = position.unmoved;
+    undo.castlingRights = position.castlingRights;
+    undo.enPassantSquare = position.enPassantSquare;
+    undo.halfMoveClock = halfMoveClock;
+    
+    if (undo.isEnPassant) {
+        int captureRow = (position.sideToMove == PieceColor::WHITE) ? to.row - 1 : to.row + 1;
+        undo.capturedSquare = static_cast<int8_t>(BitboardPosition::square(captureRow, to.col));
     } else {
-        capturedPiece = getPiece(to);
+        undo.capturedSquare = static_cast<int8_t>(toSq);
     }
+    undo.capturedPiece = position.mailbox[undo.capturedSquare];
+    
+    const ChessPiece* capturedPiece = getPiece(BitboardPosition::toPosition(undo.capturedSquare));
     
     // Execute special moves
-    if (isCastlingMove(move)) {
+    if (undo.isCastling) {
         executeCastlingMove(move);
-    } else if (isEnPassantCapture(move)) {
+    } else if (undo.isEnPassant) {
         executeEnPassantCapture(move);
     } else {
         // Regular move
+        position.movePiece(fromSq, toSq);
+        
         // Handle promotion
         if (move.getPromotionType() != PieceType::EMPTY) {
-            std::unique_ptr<ChessPiece> promotedPiece;
-            switch (move.getPromotionType()) {
-                case PieceType::QUEEN:
-                    promotedPiece = std::make_unique<Queen>(piece->getColor());
-                    break;
-                case PieceType::ROOK:
-                    promotedPiece = std::make_unique<Rook>(piece->getColor());
-                    break;
-                case PieceType::BISHOP:
-                    promotedPiece = std::make_unique<Bishop>(piece->getColor());
-                    break;
-                case PieceType::KNIGHT:
-                    promotedPiece = std::make_unique<Knight>(piece->getColor());
-                    break;
-                default:
-                    promotedPiece = std::make_unique<Queen>(piece->getColor());
-                    break;
+            PieceType promotionType = move.getPromotionType();
+            if (promotionType == PieceType::PAWN || promotionType == PieceType::KING) {
+                promotionType = PieceType::QUEEN;
             }
-            promotedPiece->setMoved(true);
-            board[to.row][to.col] = std::move(promotedPiece);
-        } else {
-            // Move the piece
-            board[to.row][to.col] = std::move(board[from.row][from.col]);
-            board[to.row][to.col]->setMoved(true);
+            PieceColor color = position.colorAt(toSq);
+            position.removePiece(toSq);
+            position.addPiece(toSq, promotionType, color);
         }
     }
     
     // Update state
     updateStateAfterMove(move, capturedPiece);
 
-    // Clear caches since the board state has changed
-    clearCaches();
+    // Cached results are keyed on the Zobrist key, so they only need trimming
+    trimCaches();
+}
 
-    return MoveValidationStatus::VALID;
+void ChessBoard::unmakeMove(const MoveUndo& undo)
+{
+    Position from = undo.move.getFrom();
+    Position to = undo.move.getTo();
+    int fromSq = undo.move.getFromSquare();
+    int toSq = undo.move.getToSquare();
+    
+    PieceType movedType = static_cast<PieceType>(undo.movedPiece % 6);
+    PieceColor movedColor = static_cast<PieceColor>(undo.movedPiece / 6);
+    
+    // Put the moving piece back (this also undoes a promotion)
+    position.removePiece(toSq);
+    position.addPiece(fromSq, movedType, movedColor);
+    
+    // Put the rook back after castling
+    if (undo.isCastling) {
+        if (to.col > from.col) {
+            position.movePiece(BitboardPosition::square(from.row, to.col - 1), BitboardPosition::square(from.row, 7));
+        } else {
+            position.movePiece(BitboardPosition::square(from.row, to.col + 1), BitboardPosition::square(from.row, 0));
+        }
+    }
+    
+    // Restore the captured piece
+    if (undo.capturedPiece != BitboardPosition::NO_PIECE) {
+        PieceColor capturedColor = static_cast<PieceColor>(undo.capturedPiece / 6);
+        position.addPiece(undo.capturedSquare, static_cast<PieceType>(undo.capturedPiece % 6), capturedColor);
+        
+        std::vector<PieceType>& captured = (capturedColor == PieceColor::WHITE) ? capturedWhitePieces : capturedBlackPieces;
+        if (!captured.empty()) {
+            captured.pop_back();
+        }
+    }
+    
+    // Restore the position state
+    position.unmoved = undo.unmoved;
+    position.setCastlingRights(undo.castlingRights);
+    position.setEnPassantSquare(undo.enPassantSquare);
+    position.setSideToMove(movedColor);
+    halfMoveClock = undo.halfMoveClock;
+    
+    if (!moveHistory.empty()) {
+        moveHistory.pop_back();
+    }
+    if (!boardStates.empty()) {
+        boardStates.pop_back();
+    }
+    
+    trimCaches();
 }
 
 /*
@@ -713,7 +1229,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger())
     {
-        server->getLogger()->debug("ChessBoard::isUnderAttack() - Checking if position " + 
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Checking if position " + 
                                   pos.toAlgebraic() + " is under attack by " + 
                                   (attackerColor == PieceColor::WHITE ? "white" : "black"));
     }
@@ -723,7 +1239,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after recursion depth check: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after recursion depth check: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -736,7 +1252,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
         auto cacheIt = attackCache.find(cacheKey);
         if (cacheIt != attackCache.end()) {
             if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessBoard::isUnderAttack() - Cache hit for position " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Cache hit for position " + 
                                           pos.toAlgebraic());
             }
             decrementRecursionDepth();
@@ -744,7 +1260,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
             // End timing and log
             double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after cacheCheck: " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after cacheCheck: " + 
                                         std::to_string(duration) + "ms");
             }
 
@@ -752,7 +1268,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
         }
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::isUnderAttack() - Checking if position " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Checking if position " + 
                                       pos.toAlgebraic() + " is under attack by " + 
                                       (attackerColor == PieceColor::WHITE ? "white" : "black"));
         }
@@ -767,7 +1283,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
             const ChessPiece* piece = getPiece(leftAttacker);
             if (piece && piece->getType() == PieceType::PAWN && piece->getColor() == attackerColor) {
                 if (server && server->getLogger()) {
-                    server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a pawn at " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a pawn at " + 
                                               leftAttacker.toAlgebraic());
                 }
                 attackCache[cacheKey] = true;
@@ -776,7 +1292,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 // End timing and log
                 double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                 if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after left pawn attack check: " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after left pawn attack check: " + 
                                             std::to_string(duration) + "ms");
                 }
 
@@ -789,7 +1305,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
             const ChessPiece* piece = getPiece(rightAttacker);
             if (piece && piece->getType() == PieceType::PAWN && piece->getColor() == attackerColor) {
                 if (server && server->getLogger()) {
-                    server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a pawn at " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a pawn at " + 
                                               rightAttacker.toAlgebraic());
                 }
                 attackCache[cacheKey] = true;
@@ -798,7 +1314,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 // End timing and log
                 double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                 if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after right pawn attack check: " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after right pawn attack check: " + 
                                             std::to_string(duration) + "ms");
                 }
 
@@ -818,7 +1334,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 const ChessPiece* piece = getPiece(attackerPos);
                 if (piece && piece->getType() == PieceType::KNIGHT && piece->getColor() == attackerColor) {
                     if (server && server->getLogger()) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a knight at " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a knight at " + 
                                                   attackerPos.toAlgebraic());
                     }
                     attackCache[cacheKey] = true;
@@ -827,7 +1343,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                     // End timing and log
                     double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after Knight attack check: " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after Knight attack check: " + 
                                                 std::to_string(duration) + "ms");
                     }
 
@@ -847,7 +1363,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 const ChessPiece* piece = getPiece(attackerPos);
                 if (piece && piece->getType() == PieceType::KING && piece->getColor() == attackerColor) {
                     if (server && server->getLogger()) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a king at " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a king at " + 
                                                   attackerPos.toAlgebraic());
                     }
                     attackCache[cacheKey] = true;
@@ -856,7 +1372,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                     // End timing and log
                     double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after left King attack check: " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after left King attack check: " + 
                                                 std::to_string(duration) + "ms");
                     }
 
@@ -888,7 +1404,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 if ((isDiagonal && (piece->getType() == PieceType::BISHOP || piece->getType() == PieceType::QUEEN)) ||
                     (isOrthogonal && (piece->getType() == PieceType::ROOK || piece->getType() == PieceType::QUEEN))) {
                     if (server && server->getLogger()) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a " + 
                                                  std::string(piece->getType() == PieceType::BISHOP ? "bishop" : 
                                                             piece->getType() == PieceType::ROOK ? "rook" : "queen") + 
                                                  " at " + attackerPos.toAlgebraic());
@@ -899,7 +1415,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                     // End timing and log
                     double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after left sliding piece attack check: " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after left sliding piece attack check: " + 
                                                 std::to_string(duration) + "ms");
                     }
 
@@ -911,7 +1427,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
         }
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::isUnderAttack() - Position " + pos.toAlgebraic() + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position " + pos.toAlgebraic() + 
                                       " is not under attack");
         }
         
@@ -922,7 +1438,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after all attack checks: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after all attack checks: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -945,6 +1461,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
 }
 */
 
+/*
 bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) const
 {
     // Start timing
@@ -953,7 +1470,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3)
     {
-        server->getLogger()->debug("ChessBoard::isUnderAttack() - Checking if position " + 
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Checking if position " + 
                                   pos.toAlgebraic() + " is under attack by " + 
                                   (attackerColor == PieceColor::WHITE ? "white" : "black"));
     }
@@ -963,7 +1480,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after recursion depth check: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after recursion depth check: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -972,11 +1489,11 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
     
     try {
         // Check cache first
-        std::string cacheKey = generateAttackCacheKey(pos, attackerColor);
+        uint64_t cacheKey = generateAttackCacheKey(pos, attackerColor);
         auto cacheIt = attackCache.find(cacheKey);
         if (cacheIt != attackCache.end()) {
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::isUnderAttack() - Cache hit for position " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Cache hit for position " + 
                                           pos.toAlgebraic());
             }
             decrementRecursionDepth();
@@ -984,7 +1501,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
             // End timing and log
             double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after cacheCheck: " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after cacheCheck: " + 
                                         std::to_string(duration) + "ms");
             }
 
@@ -1001,7 +1518,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
             const ChessPiece* piece = getPiece(leftAttacker);
             if (piece && piece->getType() == PieceType::PAWN && piece->getColor() == attackerColor) {
                 if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a pawn at " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a pawn at " + 
                                               leftAttacker.toAlgebraic());
                 }
                 attackCache[cacheKey] = true;
@@ -1010,7 +1527,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 // End timing and log
                 double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                 if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after left pawn attack check: " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after left pawn attack check: " + 
                                             std::to_string(duration) + "ms");
                 }
 
@@ -1023,7 +1540,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
             const ChessPiece* piece = getPiece(rightAttacker);
             if (piece && piece->getType() == PieceType::PAWN && piece->getColor() == attackerColor) {
                 if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a pawn at " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a pawn at " + 
                                               rightAttacker.toAlgebraic());
                 }
                 attackCache[cacheKey] = true;
@@ -1032,7 +1549,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 // End timing and log
                 double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                 if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after right pawn attack check: " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after right pawn attack check: " + 
                                             std::to_string(duration) + "ms");
                 }
 
@@ -1052,7 +1569,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 const ChessPiece* piece = getPiece(attackerPos);
                 if (piece && piece->getType() == PieceType::KNIGHT && piece->getColor() == attackerColor) {
                     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a knight at " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a knight at " + 
                                                   attackerPos.toAlgebraic());
                     }
                     attackCache[cacheKey] = true;
@@ -1061,7 +1578,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                     // End timing and log
                     double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after Knight attack check: " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after Knight attack check: " + 
                                                 std::to_string(duration) + "ms");
                     }
 
@@ -1081,7 +1598,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 const ChessPiece* piece = getPiece(attackerPos);
                 if (piece && piece->getType() == PieceType::KING && piece->getColor() == attackerColor) {
                     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a king at " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a king at " + 
                                                   attackerPos.toAlgebraic());
                     }
                     attackCache[cacheKey] = true;
@@ -1090,7 +1607,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                     // End timing and log
                     double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after King attack check: " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after King attack check: " + 
                                                 std::to_string(duration) + "ms");
                     }
 
@@ -1122,7 +1639,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                 if ((isDiagonal && (piece->getType() == PieceType::BISHOP || piece->getType() == PieceType::QUEEN)) ||
                     (isOrthogonal && (piece->getType() == PieceType::ROOK || piece->getType() == PieceType::QUEEN))) {
                     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Position is under attack by a " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position is under attack by a " + 
                                                  std::string(piece->getType() == PieceType::BISHOP ? "bishop" : 
                                                             piece->getType() == PieceType::ROOK ? "rook" : "queen") + 
                                                  " at " + attackerPos.toAlgebraic());
@@ -1133,7 +1650,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
                     // End timing and log
                     double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
                     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                        server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after sliding piece attack check: " + 
+                        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after sliding piece attack check: " + 
                                                 std::to_string(duration) + "ms");
                     }
 
@@ -1145,7 +1662,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
         }
         
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isUnderAttack() - Position " + pos.toAlgebraic() + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Position " + pos.toAlgebraic() + 
                                       " is not under attack");
         }
         
@@ -1156,7 +1673,7 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isUnderAttack");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isUnderAttack() - Execution time after all attack checks: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isUnderAttack() - Execution time after all attack checks: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -1177,6 +1694,17 @@ bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) co
         return false;
     }
 }
+*/
+
+bool ChessBoard::isUnderAttack(const Position& pos, PieceColor attackerColor) const
+{
+    if (!pos.isValid() || attackerColor == PieceColor::NONE) {
+        return false;
+    }
+    
+    // A handful of table lookups; no cache or recursion guard needed
+    return position.isSquareAttacked(BitboardPosition::square(pos), attackerColor);
+}
 
 bool ChessBoard::incrementRecursionDepth(const std::string& functionName) const
 {
@@ -1211,28 +1739,40 @@ void ChessBoard::decrementRecursionDepth() const
     }
 }
 
-std::string ChessBoard::generateCheckCacheKey(PieceColor color) const
+uint64_t ChessBoard::generateCheckCacheKey(PieceColor color) const
 {
-    // Generate a unique key for the current board state and color
-    std::string key = getBoardStateString() + "_check_" + 
-                     (color == PieceColor::WHITE ? "white" : "black");
-    return key;
+    // Combine the position key with the color
+    return position.zobristKey ^ splitMix64(static_cast<uint64_t>(color));
 }
 
-std::string ChessBoard::generateAttackCacheKey(const Position& pos, PieceColor attackerColor) const
+uint64_t ChessBoard::generateAttackCacheKey(const Position& pos, PieceColor attackerColor) const
 {
-    // Generate a unique key for the current board state, position, and attacker color
-    std::string key = getBoardStateString() + "_attack_" + 
-                     pos.toAlgebraic() + "_" +
-                     (attackerColor == PieceColor::WHITE ? "white" : "black");
-    return key;
+    // Combine the position key with the square and attacker color
+    uint64_t salt = 0x100 + static_cast<uint64_t>(BitboardPosition::square(pos)) * 2 + static_cast<uint64_t>(attackerColor);
+    return position.zobristKey ^ splitMix64(salt);
 }
 
 void ChessBoard::clearCaches() const
 {
-    checkCache.clear();
-    attackCache.clear();
-    checkResultCache.clear();
+    // Replace the maps before resetting the arena so none of them points into it
+    checkCache = makeCacheMap();
+    attackCache = makeCacheMap();
+    checkResultCache = makeCacheMap();
+    cacheArena.reset();
+}
+
+ChessBoard::CacheMap ChessBoard::makeCacheMap() const
+{
+    return CacheMap(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(),
+                    ArenaAllocator<std::pair<const uint64_t, bool>>(cacheArena));
+}
+
+void ChessBoard::trimCaches() const
+{
+    // Entries never go stale, so only drop them once the caches grow too large
+    if (checkCache.size() + attackCache.size() + checkResultCache.size() > MAX_CACHE_ENTRIES) {
+        clearCaches();
+    }
 }
 
 void ChessBoard::recordBoardDelta(const Position& pos) const
@@ -1248,16 +1788,14 @@ void ChessBoard::recordBoardDelta(const Position& pos) const
     }
     
     // Record the current state at this position
+    int sq = BitboardPosition::square(pos);
     BoardDelta delta;
     delta.position = pos;
+    delta.oldPiece = position.mailbox[sq];
+    delta.oldUnmoved = (position.unmoved & BitboardPosition::bit(sq)) != 0;
     delta.isModified = false;
     
-    const ChessPiece* piece = getPiece(pos);
-    if (piece) {
-        delta.oldPiece = piece->clone();
-    }
-    
-    lastMoveDelta.push_back(std::move(delta));
+    lastMoveDelta.push_back(delta);
 }
 
 void ChessBoard::clearBoardDelta() const
@@ -1267,20 +1805,21 @@ void ChessBoard::clearBoardDelta() const
 
 void ChessBoard::restoreBoardDelta() const
 {
-    MPChessServer* server = MPChessServer::getInstance();
-    
-    if (server && server->getLogger()) {
-        server->getLogger()->debug("ChessBoard::restoreBoardDelta() - Restoring " + 
-                                  std::to_string(lastMoveDelta.size()) + " board positions");
-    }
+    MPCHESS_TRACE("ChessBoard::restoreBoardDelta() - Restoring " + 
+                  std::to_string(lastMoveDelta.size()) + " board positions");
     
     for (auto& delta : lastMoveDelta) {
         if (delta.isModified) {
             // Restore the old piece
             // We need to cast away const-ness here since we're modifying the board in a const method
             // This is safe because we're restoring the original state
-            auto& boardCell = const_cast<std::unique_ptr<ChessPiece>&>(board[delta.position.row][delta.position.col]);
-            boardCell = std::move(delta.oldPiece);
+            auto& bitboards = const_cast<BitboardPosition&>(position);
+            int sq = BitboardPosition::square(delta.position);
+            bitboards.removePiece(sq);
+            if (delta.oldPiece != BitboardPosition::NO_PIECE) {
+                bitboards.addPiece(sq, static_cast<PieceType>(delta.oldPiece % 6),
+                                   static_cast<PieceColor>(delta.oldPiece / 6), delta.oldUnmoved);
+            }
         }
     }
     
@@ -1296,7 +1835,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger())
     {
-        server->getLogger()->debug("ChessBoard::isInCheck() - Checking if " + 
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Checking if " + 
                                   std::string(color == PieceColor::WHITE ? "white" : "black") + 
                                   " king is in check");
     }
@@ -1306,7 +1845,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after recursion depth check: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after recursion depth check: " + 
                                     std::to_string(duration) + "ms");
         }
         return false;
@@ -1318,7 +1857,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         auto cacheIt = checkCache.find(cacheKey);
         if (cacheIt != checkCache.end()) {
             if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessBoard::isInCheck() - Cache hit for " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Cache hit for " + 
                                           std::string(color == PieceColor::WHITE ? "white" : "black"));
             }
             decrementRecursionDepth();
@@ -1326,7 +1865,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
             // End timing and log
             double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after checkCache: " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after checkCache: " + 
                                         std::to_string(duration) + "ms");
             }
 
@@ -1334,7 +1873,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         }
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - Checking if " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Checking if " + 
                                       std::string(color == PieceColor::WHITE ? "white" : "black") + 
                                       " king is in check");
         }
@@ -1350,7 +1889,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
             // End timing and log
             double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after kingPosInvalid: " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after kingPosInvalid: " + 
                                         std::to_string(duration) + "ms");
             }
 
@@ -1365,7 +1904,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         checkCache[cacheKey] = result;
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - " + 
                                       std::string(color == PieceColor::WHITE ? "White" : "Black") + 
                                       " king is " + (result ? "in check" : "not in check"));
         }
@@ -1375,7 +1914,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after isUnderAttack check for king: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after isUnderAttack check for king: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -1390,7 +1929,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after inner exception handler: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after inner exception handler: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -1405,7 +1944,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after outer exception handler: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after outer exception handler: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -1414,6 +1953,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
 }
 */
 
+/*
 bool ChessBoard::isInCheck(PieceColor color) const
 {
     // Start timing
@@ -1422,7 +1962,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3)
     {
-        server->getLogger()->debug("ChessBoard::isInCheck() - Checking if " + 
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Checking if " + 
                                   std::string(color == PieceColor::WHITE ? "white" : "black") + 
                                   " king is in check");
     }
@@ -1432,7 +1972,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after recursion depth check: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after recursion depth check: " + 
                                     std::to_string(duration) + "ms");
         }
         return false;
@@ -1440,11 +1980,11 @@ bool ChessBoard::isInCheck(PieceColor color) const
     
     try {
         // Check cache first
-        std::string cacheKey = generateCheckCacheKey(color);
+        uint64_t cacheKey = generateCheckCacheKey(color);
         auto cacheIt = checkCache.find(cacheKey);
         if (cacheIt != checkCache.end()) {
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::isInCheck() - Cache hit for " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Cache hit for " + 
                                           std::string(color == PieceColor::WHITE ? "white" : "black"));
             }
             decrementRecursionDepth();
@@ -1452,7 +1992,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
             // End timing and log
             double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after checkCache: " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after checkCache: " + 
                                         std::to_string(duration) + "ms");
             }
 
@@ -1470,7 +2010,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
             // End timing and log
             double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after kingPosInvalid: " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after kingPosInvalid: " + 
                                         std::to_string(duration) + "ms");
             }
 
@@ -1485,7 +2025,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         checkCache[cacheKey] = result;
         
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - " + 
                                       std::string(color == PieceColor::WHITE ? "White" : "Black") + 
                                       " king is " + (result ? "in check" : "not in check"));
         }
@@ -1495,7 +2035,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after isUnderAttack check for king: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after isUnderAttack check for king: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -1510,7 +2050,7 @@ bool ChessBoard::isInCheck(PieceColor color) const
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after inner exception handler: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after inner exception handler: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -1525,20 +2065,38 @@ bool ChessBoard::isInCheck(PieceColor color) const
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::isInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::isInCheck() - Execution time after outer exception handler: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheck() - Execution time after outer exception handler: " + 
                                     std::to_string(duration) + "ms");
         }
 
         return false;
     }
 }
+*/
+
+bool ChessBoard::isInCheck(PieceColor color) const
+{
+    uint64_t king = position.piecesOf(PieceType::KING, color);
+    if (!king) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->warning("ChessBoard::isInCheck() - King position is invalid");
+        }
+        return false;
+    }
+    
+    // Check if the king is under attack by the opposite color
+    PieceColor opponentColor = (color == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    return position.isSquareAttacked(BitboardPosition::lsb(king), opponentColor);
+}
 
+/*
 bool ChessBoard::isInCheckmate(PieceColor color) const
 {
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger())
     {
-        server->getLogger()->debug("ChessBoard::isInCheckmate() - Checking if " + 
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheckmate() - Checking if " + 
                                   std::string(color == PieceColor::WHITE ? "white" : "black") + 
                                   " is in checkmate");
     }
@@ -1556,7 +2114,7 @@ bool ChessBoard::isInCheckmate(PieceColor color) const
         // Check if the king is in check
         if (!isInCheck(color)) {
             if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessBoard::isInCheckmate() - King is not in check, so not checkmate");
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheckmate() - King is not in check, so not checkmate");
             }
             return false;
         }
@@ -1586,7 +2144,7 @@ bool ChessBoard::isInCheckmate(PieceColor color) const
                     ChessMove move(pos, to);
                     if (!wouldLeaveInCheck(move, color)) {
                         if (server && server->getLogger()) {
-                            server->getLogger()->debug("ChessBoard::isInCheckmate() - Found escape move: " + 
+                            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheckmate() - Found escape move: " + 
                                                      pos.toAlgebraic() + " to " + to.toAlgebraic());
                         }
                         return false;
@@ -1597,7 +2155,7 @@ bool ChessBoard::isInCheckmate(PieceColor color) const
         
         // If we get here, no move can escape check
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::isInCheckmate() - No escape moves found, it's checkmate");
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInCheckmate() - No escape moves found, it's checkmate");
         }
         return true;
     }
@@ -1614,13 +2172,29 @@ bool ChessBoard::isInCheckmate(PieceColor color) const
         return false;
     }
 }
+*/
+
+bool ChessBoard::isInCheckmate(PieceColor color) const
+{
+    // In check with no legal move; a missing king is an invalid board, not a mate
+    if (!position.piecesOf(PieceType::KING, color)) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->warning("ChessBoard::isInCheckmate() - King position invalid, cannot check checkmate");
+        }
+        return false;
+    }
+    
+    return isInCheck(color) && !hasLegalMoves(color);
+}
 
+/*
 bool ChessBoard::isInStalemate(PieceColor color) const
 {
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger())
     {
-        server->getLogger()->debug("ChessBoard::isInStalemate() - Checking if game is in stalemate");
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInStalemate() - Checking if game is in stalemate");
     }
 
     // First verify king exists - if not, board is in invalid state
@@ -1636,7 +2210,7 @@ bool ChessBoard::isInStalemate(PieceColor color) const
     {
         if (server && server->getLogger())
         {
-            server->getLogger()->debug("ChessBoard::isInStalemate() - Checking, we're not in check; returning...");
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInStalemate() - Checking, we're not in check; returning...");
         }
         return false;
     }
@@ -1654,7 +2228,7 @@ bool ChessBoard::isInStalemate(PieceColor color) const
                     {
                         if (server && server->getLogger())
                         {
-                            server->getLogger()->debug("ChessBoard::isInStalemate() - Its not wouldLeaveInCheck(), returning...");
+                            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInStalemate() - Its not wouldLeaveInCheck(), returning...");
                         }
                         return false;
                     }
@@ -1665,12 +2239,28 @@ bool ChessBoard::isInStalemate(PieceColor color) const
 
     if (server && server->getLogger())
     {
-        server->getLogger()->debug("ChessBoard::isInStalemate() - Yes, it is.");
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::isInStalemate() - Yes, it is.");
     }
     
     return true;
 }
+*/
+
+bool ChessBoard::isInStalemate(PieceColor color) const
+{
+    // Not in check with no legal move
+    if (!position.piecesOf(PieceType::KING, color)) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->warning("ChessBoard::isInStalemate() - King position invalid, cannot check stalemate");
+        }
+        return false;
+    }
+    
+    return !isInCheck(color) && !hasLegalMoves(color);
+}
 
+/*
 std::vector<ChessMove> ChessBoard::getAllValidMoves(PieceColor color) const
 {
     // Start timing
@@ -1679,7 +2269,7 @@ std::vector<ChessMove> ChessBoard::getAllValidMoves(PieceColor color) const
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger())
     {
-        server->getLogger()->debug("ChessBoard::getAllValidMoves() - Getting all valid moves for " +
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::getAllValidMoves() - Getting all valid moves for " +
                                   std::string(color == PieceColor::WHITE ? "white" : "black"));
     }
 
@@ -1726,59 +2316,247 @@ std::vector<ChessMove> ChessBoard::getAllValidMoves(PieceColor color) const
     // End timing and log
     double duration = PerformanceMonitor::endTimer("ChessBoard::getAllValidMoves");
     if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-        server->getLogger()->debug("ChessBoard::getAllValidMoves() - Found " + 
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::getAllValidMoves() - Found " + 
                                   std::to_string(validMoves.size()) + " valid moves in " + 
                                   std::to_string(duration) + "ms");
     }
 
     return validMoves;
 }
+*/
 
-Position ChessBoard::getKingPosition(PieceColor color) const {
-    for (int r = 0; r < 8; ++r) {
-        for (int c = 0; c < 8; ++c) {
-            Position pos(r, c);
-            const ChessPiece* piece = getPiece(pos);
-            if (piece && piece->getType() == PieceType::KING && piece->getColor() == color) {
-                return pos;
-            }
-        }
-    }
-    return Position(-1, -1);
+std::vector<ChessMove> ChessBoard::getAllValidMoves(PieceColor color) const
+{
+    LatencyHistogram::ScopedTimer timer(ServerMetrics::moveGenerationSeconds, ServerMetrics::MOVE_GENERATION_SAMPLE);
+    MoveList moves;
+    generateLegalMoves(color, moves);
+    return std::vector<ChessMove>(moves.begin(), moves.end());
 }
 
-bool ChessBoard::isCastlingMove(const ChessMove& move) const {
-    const ChessPiece* piece = getPiece(move.getFrom());
-    if (!piece || piece->getType() != PieceType::KING) return false;
-    
-    int colDiff = move.getTo().col - move.getFrom().col;
-    return std::abs(colDiff) == 2;
+ArenaVector<ChessMove> ChessBoard::getAllValidMoves(PieceColor color, MonotonicArena& arena) const
+{
+    LatencyHistogram::ScopedTimer timer(ServerMetrics::moveGenerationSeconds, ServerMetrics::MOVE_GENERATION_SAMPLE);
+    MoveList moves;
+    generateLegalMoves(color, moves);
+    return ArenaVector<ChessMove>(moves.begin(), moves.end(), ArenaAllocator<ChessMove>(arena));
+}
+
+// Add a pawn move, expanding it into the four promotions on the last row
+static void addPawnMove(MoveList& moves, int from, int to) {
+    if (to < 8 || to >= 56) {
+        moves.add(ChessMove::fromSquares(from, to, PieceType::QUEEN));
+        moves.add(ChessMove::fromSquares(from, to, PieceType::ROOK));
+        moves.add(ChessMove::fromSquares(from, to, PieceType::BISHOP));
+        moves.add(ChessMove::fromSquares(from, to, PieceType::KNIGHT));
+    } else {
+        moves.add(ChessMove::fromSquares(from, to));
+    }
 }
 
-bool ChessBoard::isEnPassantCapture(const ChessMove& move) const {
-    const ChessPiece* piece = getPiece(move.getFrom());
-    if (!piece || piece->getType() != PieceType::PAWN) return false;
-    
-    // Check if the move is a diagonal move to an empty square
-    if (move.getFrom().col != move.getTo().col && getPiece(move.getTo()) == nullptr) {
-        return move.getTo() == enPassantTarget;
+void ChessBoard::generateLegalMoves(PieceColor color, MoveList& moves) const
+{
+    moves.clear();
+    if (color == PieceColor::NONE) {
+        return;
     }
     
-    return false;
-}
-
-Position ChessBoard::getEnPassantTarget() const {
-    return enPassantTarget;
-}
-
-void ChessBoard::setEnPassantTarget(const Position& pos) {
-    enPassantTarget = pos;
-}
-
-std::string ChessBoard::getAsciiBoard() const {
-    std::stringstream ss;
+    const BitboardPosition& p = position;
+    PieceColor opponent = (color == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    int us = static_cast<int>(color);
+    uint64_t own = p.occupancy[us];
+    uint64_t enemy = p.occupancy[static_cast<int>(opponent)];
+    uint64_t occupied = p.allOccupancy;
     
-    ss << "  +---+---+---+---+---+---+---+---+\n";
+    uint64_t kingBit = p.piecesOf(PieceType::KING, color);
+    if (!kingBit) {
+        return;
+    }
+    int kingSq = BitboardPosition::lsb(kingBit);
+    
+    // King moves: the destination must be safe with the king lifted off its square
+    uint64_t kingTargets = AttackTables::KING_ATTACKS[kingSq] & ~own;
+    while (kingTargets) {
+        int to = BitboardPosition::popLsb(kingTargets);
+        if (!(p.attackersTo(to, occupied ^ kingBit) & enemy)) {
+            moves.add(ChessMove::fromSquares(kingSq, to));
+        }
+    }
+    
+    uint64_t checkers = p.attackersTo(kingSq, occupied) & enemy;
+    int checkerCount = BitboardPosition::popCount(checkers);
+    if (checkerCount > 1) {
+        return;  // Double check: only the king can move
+    }
+    
+    // Other pieces must capture the checker or block its ray when in check
+    uint64_t checkMask = ~0ULL;
+    if (checkerCount == 1) {
+        int checkerSq = BitboardPosition::lsb(checkers);
+        checkMask = checkers | AttackTables::BETWEEN[kingSq][checkerSq];
+    }
+    
+    // Pinned pieces may only move along the line between the king and the pinner
+    uint64_t pinned = 0;
+    std::array<uint64_t, 64> pinRays;
+    uint64_t snipers = (AttackTables::rookAttacks(kingSq, enemy) & p.orthogonalSliders() & enemy) |
+                       (AttackTables::bishopAttacks(kingSq, enemy) & p.diagonalSliders() & enemy);
+    while (snipers) {
+        int sniperSq = BitboardPosition::popLsb(snipers);
+        uint64_t between = AttackTables::BETWEEN[kingSq][sniperSq];
+        uint64_t blockers = between & occupied;
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & own)) {
+            int pinnedSq = BitboardPosition::lsb(blockers);
+            pinned |= blockers;
+            pinRays[pinnedSq] = between | BitboardPosition::bit(sniperSq);
+        }
+    }
+    
+    auto allowedTargets = [&](int from) {
+        return (pinned & BitboardPosition::bit(from)) ? checkMask & pinRays[from] : checkMask;
+    };
+    
+    // Knights, bishops, rooks and queens
+    for (PieceType type : { PieceType::KNIGHT, PieceType::BISHOP, PieceType::ROOK, PieceType::QUEEN }) {
+        uint64_t pieces = p.piecesOf(type, color);
+        while (pieces) {
+            int from = BitboardPosition::popLsb(pieces);
+            uint64_t targets;
+            switch (type) {
+                case PieceType::KNIGHT: targets = AttackTables::KNIGHT_ATTACKS[from]; break;
+                case PieceType::BISHOP: targets = AttackTables::bishopAttacks(from, occupied); break;
+                case PieceType::ROOK:   targets = AttackTables::rookAttacks(from, occupied); break;
+                default:                targets = AttackTables::queenAttacks(from, occupied); break;
+            }
+            targets &= ~own & allowedTargets(from);
+            
+            while (targets) {
+                moves.add(ChessMove::fromSquares(from, BitboardPosition::popLsb(targets)));
+            }
+        }
+    }
+    
+    // Pawns
+    int forward = (color == PieceColor::WHITE) ? 8 : -8;
+    int startRow = (color == PieceColor::WHITE) ? 1 : 6;
+    uint64_t pawns = p.piecesOf(PieceType::PAWN, color);
+    while (pawns) {
+        int from = BitboardPosition::popLsb(pawns);
+        uint64_t allowed = allowedTargets(from);
+        
+        int to = from + forward;
+        if (to >= 0 && to < 64 && p.isEmpty(to)) {
+            if (allowed & BitboardPosition::bit(to)) {
+                addPawnMove(moves, from, to);
+            }
+            int doubleTo = to + forward;
+            if (from / 8 == startRow && p.isEmpty(doubleTo) && (allowed & BitboardPosition::bit(doubleTo))) {
+                addPawnMove(moves, from, doubleTo);
+            }
+        }
+        
+        uint64_t captures = AttackTables::PAWN_ATTACKS[us][from] & enemy & allowed;
+        while (captures) {
+            addPawnMove(moves, from, BitboardPosition::popLsb(captures));
+        }
+        
+        // En passant: replay the capture on the occupancy, since it can uncover
+        // a check along the row that pin detection does not see
+        int epSq = p.enPassantSquare;
+        if (epSq >= 0 && color == p.sideToMove && (AttackTables::PAWN_ATTACKS[us][from] & BitboardPosition::bit(epSq))) {
+            int capturedSq = epSq - forward;
+            uint64_t after = (occupied ^ BitboardPosition::bit(from) ^ BitboardPosition::bit(capturedSq)) | 
+                             BitboardPosition::bit(epSq);
+            if (!(p.attackersTo(kingSq, after) & enemy & ~BitboardPosition::bit(capturedSq))) {
+                addPawnMove(moves, from, epSq);
+            }
+        }
+    }
+    
+    // Castling: not out of check, through an occupied square or across an attacked one
+    if (checkerCount == 0) {
+        bool white = color == PieceColor::WHITE;
+        uint8_t kingside = white ? BitboardPosition::WHITE_KINGSIDE : BitboardPosition::BLACK_KINGSIDE;
+        uint8_t queenside = white ? BitboardPosition::WHITE_QUEENSIDE : BitboardPosition::BLACK_QUEENSIDE;
+        int row = white ? 0 : 7;
+        auto safe = [&](int col) {
+            return !(p.attackersTo(BitboardPosition::square(row, col), occupied) & enemy);
+        };
+        
+        if ((p.castlingRights & kingside) &&
+            p.isEmpty(BitboardPosition::square(row, 5)) && p.isEmpty(BitboardPosition::square(row, 6)) &&
+            safe(5) && safe(6)) {
+            moves.add(ChessMove::fromSquares(kingSq, BitboardPosition::square(row, 6)));
+        }
+        if ((p.castlingRights & queenside) &&
+            p.isEmpty(BitboardPosition::square(row, 1)) && p.isEmpty(BitboardPosition::square(row, 2)) &&
+            p.isEmpty(BitboardPosition::square(row, 3)) && safe(3) && safe(2)) {
+            moves.add(ChessMove::fromSquares(kingSq, BitboardPosition::square(row, 2)));
+        }
+    }
+}
+
+bool ChessBoard::hasLegalMoves(PieceColor color) const
+{
+    MoveList moves;
+    generateLegalMoves(color, moves);
+    return !moves.empty();
+}
+
+PositionStatus ChessBoard::getPositionStatus() const
+{
+    PositionStatus status;
+    status.sideToMove = getCurrentTurn();
+    status.inCheck = isInCheck(status.sideToMove);
+    generateLegalMoves(status.sideToMove, status.legalMoves);
+    status.checkmate = status.inCheck && status.legalMoves.empty();
+    status.stalemate = !status.inCheck && status.legalMoves.empty();
+    status.insufficientMaterial = hasInsufficientMaterial();
+    status.threefoldRepetition = canClaimThreefoldRepetition();
+    status.fiftyMoveRule = canClaimFiftyMoveRule();
+    return status;
+}
+
+Position ChessBoard::getKingPosition(PieceColor color) const {
+    if (color == PieceColor::NONE) return Position(-1, -1);
+    
+    uint64_t kings = position.piecesOf(PieceType::KING, color);
+    if (!kings) return Position(-1, -1);
+    return BitboardPosition::toPosition(BitboardPosition::lsb(kings));
+}
+
+bool ChessBoard::isCastlingMove(const ChessMove& move) const {
+    const ChessPiece* piece = getPiece(move.getFrom());
+    if (!piece || piece->getType() != PieceType::KING) return false;
+    
+    int colDiff = move.getTo().col - move.getFrom().col;
+    return std::abs(colDiff) == 2;
+}
+
+bool ChessBoard::isEnPassantCapture(const ChessMove& move) const {
+    const ChessPiece* piece = getPiece(move.getFrom());
+    if (!piece || piece->getType() != PieceType::PAWN) return false;
+    
+    // Check if the move is a diagonal move to an empty square
+    if (move.getFrom().col != move.getTo().col && getPiece(move.getTo()) == nullptr) {
+        return move.getTo() == getEnPassantTarget();
+    }
+    
+    return false;
+}
+
+Position ChessBoard::getEnPassantTarget() const {
+    if (position.enPassantSquare < 0) return Position(-1, -1);
+    return BitboardPosition::toPosition(position.enPassantSquare);
+}
+
+void ChessBoard::setEnPassantTarget(const Position& pos) {
+    position.setEnPassantSquare(pos.isValid() ? BitboardPosition::square(pos) : -1);
+}
+
+std::string ChessBoard::getAsciiBoard() const {
+    std::stringstream ss;
+    
+    ss << "  +---+---+---+---+---+---+---+---+\n";
     
     for (int r = 7; r >= 0; --r) {
         ss << (r + 1) << " |";
@@ -1801,26 +2579,10 @@ std::unique_ptr<ChessBoard> ChessBoard::clone() const
 {
     auto cloneBoard = std::make_unique<ChessBoard>();
     
-    // Clear the cloned board
-    for (int r = 0; r < 8; ++r) {
-        for (int c = 0; c < 8; ++c) {
-            cloneBoard->board[r][c] = nullptr;
-        }
-    }
-    
-    // Copy pieces
-    for (int r = 0; r < 8; ++r) {
-        for (int c = 0; c < 8; ++c) {
-            const ChessPiece* piece = getPiece(Position(r, c));
-            if (piece) {
-                cloneBoard->board[r][c] = piece->clone();
-            }
-        }
-    }
+    // Copy pieces and position state
+    cloneBoard->position = position;
     
     // Copy state
-    cloneBoard->currentTurn = currentTurn;
-    cloneBoard->enPassantTarget = enPassantTarget;
     cloneBoard->moveHistory = moveHistory;
     cloneBoard->capturedWhitePieces = capturedWhitePieces;
     cloneBoard->capturedBlackPieces = capturedBlackPieces;
@@ -1831,11 +2593,11 @@ std::unique_ptr<ChessBoard> ChessBoard::clone() const
 }
 
 PieceColor ChessBoard::getCurrentTurn() const {
-    return currentTurn;
+    return position.sideToMove;
 }
 
 void ChessBoard::setCurrentTurn(PieceColor color) {
-    currentTurn = color;
+    position.setSideToMove(color);
 }
 
 const std::vector<ChessMove>& ChessBoard::getMoveHistory() const {
@@ -1847,38 +2609,32 @@ const std::vector<PieceType>& ChessBoard::getCapturedPieces(PieceColor color) co
 }
 
 bool ChessBoard::isGameOver() const {
-    return isInCheckmate(PieceColor::WHITE) || isInCheckmate(PieceColor::BLACK) ||
-           isInStalemate(PieceColor::WHITE) || isInStalemate(PieceColor::BLACK) ||
-           canClaimThreefoldRepetition() || canClaimFiftyMoveRule() || hasInsufficientMaterial();
+    return getGameResult() != GameResult::IN_PROGRESS;
 }
 
 GameResult ChessBoard::getGameResult() const {
-    if (isInCheckmate(PieceColor::WHITE)) {
-        return GameResult::BLACK_WIN;
-    } else if (isInCheckmate(PieceColor::BLACK)) {
-        return GameResult::WHITE_WIN;
-    } else if (isInStalemate(PieceColor::WHITE) || isInStalemate(PieceColor::BLACK) ||
-               canClaimThreefoldRepetition() || canClaimFiftyMoveRule() || hasInsufficientMaterial()) {
-        return GameResult::DRAW;
-    }
-    
-    return GameResult::IN_PROGRESS;
+    return getPositionStatus().getResult();
 }
 
 bool ChessBoard::canClaimThreefoldRepetition() const
 {
     if (boardStates.empty()) return false;
     
-    std::string currentState = boardStates.back();
-    int count = 0;
+    // Only positions since the last capture or pawn move can repeat, and only
+    // every second one has the same side to move
+    uint64_t currentState = boardStates.back();
+    int count = 1;
+    int last = static_cast<int>(boardStates.size()) - 1;
+    int earliest = std::max(0, last - halfMoveClock);
     
-    for (const std::string& state : boardStates) {
-        if (state == currentState) {
+    for (int i = last - 2; i >= earliest; i -= 2) {
+        if (boardStates[i] == currentState) {
             count++;
+            if (count >= 3) return true;
         }
     }
     
-    return count >= 3;
+    return false;
 }
 
 bool ChessBoard::canClaimFiftyMoveRule() const
@@ -1956,22 +2712,19 @@ void ChessBoard::executeCastlingMove(const ChessMove& move)
     const Position& to = move.getTo();
     
     // Move the king
-    board[to.row][to.col] = std::move(board[from.row][from.col]);
-    board[to.row][to.col]->setMoved(true);
+    position.movePiece(BitboardPosition::square(from), BitboardPosition::square(to));
     
     // Move the rook
     if (to.col > from.col) {
         // Kingside castling
         Position rookFrom(from.row, 7);
         Position rookTo(from.row, to.col - 1);
-        board[rookTo.row][rookTo.col] = std::move(board[rookFrom.row][rookFrom.col]);
-        board[rookTo.row][rookTo.col]->setMoved(true);
+        position.movePiece(BitboardPosition::square(rookFrom), BitboardPosition::square(rookTo));
     } else {
         // Queenside castling
         Position rookFrom(from.row, 0);
         Position rookTo(from.row, to.col + 1);
-        board[rookTo.row][rookTo.col] = std::move(board[rookFrom.row][rookFrom.col]);
-        board[rookTo.row][rookTo.col]->setMoved(true);
+        position.movePiece(BitboardPosition::square(rookFrom), BitboardPosition::square(rookTo));
     }
 }
 
@@ -1981,12 +2734,11 @@ void ChessBoard::executeEnPassantCapture(const ChessMove& move)
     const Position& to = move.getTo();
     
     // Move the pawn
-    board[to.row][to.col] = std::move(board[from.row][from.col]);
-    board[to.row][to.col]->setMoved(true);
+    position.movePiece(BitboardPosition::square(from), BitboardPosition::square(to));
     
     // Remove the captured pawn
-    int captureRow = (currentTurn == PieceColor::WHITE) ? to.row - 1 : to.row + 1;
-    board[captureRow][to.col] = nullptr;
+    int captureRow = (position.sideToMove == PieceColor::WHITE) ? to.row - 1 : to.row + 1;
+    position.removePiece(BitboardPosition::square(captureRow, to.col));
 }
 
 void ChessBoard::updateStateAfterMove(const ChessMove& move, const ChessPiece* capturedPiece)
@@ -2010,26 +2762,30 @@ void ChessBoard::updateStateAfterMove(const ChessMove& move, const ChessPiece* c
         if (std::abs(rowDiff) == 2) {
             // Pawn moved two squares, set en passant target
             int enPassantRow = (move.getFrom().row + move.getTo().row) / 2;
-            enPassantTarget = Position(enPassantRow, move.getFrom().col);
+            setEnPassantTarget(Position(enPassantRow, move.getFrom().col));
         } else {
-            enPassantTarget = Position(-1, -1);
+            setEnPassantTarget(Position(-1, -1));
         }
     } else {
-        enPassantTarget = Position(-1, -1);
+        setEnPassantTarget(Position(-1, -1));
     }
     
     // Update half-move clock
-    if (movedPiece && movedPiece->getType() == PieceType::PAWN || capturedPiece) {
+    if ((movedPiece && movedPiece->getType() == PieceType::PAWN) ||
+        move.getPromotionType() != PieceType::EMPTY || capturedPiece) {
         halfMoveClock = 0;
     } else {
         halfMoveClock++;
     }
     
+    // Update castling rights
+    position.refreshCastlingRights();
+    
     // Update current turn
-    currentTurn = (currentTurn == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    position.setSideToMove((position.sideToMove == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE);
     
     // Update board states for repetition detection
-    boardStates.push_back(getBoardStateString());
+    boardStates.push_back(position.zobristKey);
 }
 
 /*
@@ -2038,7 +2794,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger())
     {
-        server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Checking move for " + 
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Checking move for " + 
                                   std::string(color == PieceColor::WHITE ? "white" : "black") + 
                                   "...");
     }
@@ -2123,7 +2879,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger())
     {
-        server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Checking if move " + 
+        MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Checking if move " + 
                                   move.toAlgebraic() + " would leave " + 
                                   std::string(color == PieceColor::WHITE ? "white" : "black") + 
                                   " king in check");
@@ -2140,7 +2896,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Execution time after recursion depth check: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Execution time after recursion depth check: " + 
                                     std::to_string(duration) + "ms");
         }
 
@@ -2154,7 +2910,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
         auto cacheIt = checkResultCache.find(cacheKey);
         if (cacheIt != checkResultCache.end()) {
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Cache hit for move " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Cache hit for move " + 
                                           move.toAlgebraic() + ", result: " + 
                                           (cacheIt->second ? "would leave in check" : "would not leave in check"));
             }
@@ -2162,7 +2918,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
             // End timing for cache hit
             double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Cache hit execution time: " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Cache hit execution time: " + 
                                         std::to_string(duration) + "ms");
             }
             
@@ -2171,7 +2927,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
         }
         
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Cache miss, creating board clone");
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Cache miss, creating board clone");
         }
         
         // Create a clone of the board
@@ -2184,7 +2940,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
         // Handle special moves
         if (isCastlingMove(move)) {
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Processing castling move");
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Processing castling move");
             }
             
             // For castling, we need to check if the king is in check at any point during the move
@@ -2193,7 +2949,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
             // Check if the king is in check at the starting position
             if (tempBoard->isInCheck(color)) {
                 if (server && server->getLogger()) {
-                    server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - King already in check, castling not allowed");
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - King already in check, castling not allowed");
                 }
                 
                 // Cache the result
@@ -2202,7 +2958,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
                 // End timing
                 double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
                 if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Execution time (king already in check): " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Execution time (king already in check): " + 
                                             std::to_string(duration) + "ms");
                 }
                 
@@ -2222,7 +2978,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
             // Check if the king would be in check at the intermediate position
             if (tempBoard->isInCheck(color)) {
                 if (server && server->getLogger()) {
-                    server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - King would pass through check during castling");
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - King would pass through check during castling");
                 }
                 
                 // Cache the result
@@ -2231,7 +2987,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
                 // End timing
                 double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
                 if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Execution time (king passes through check): " + 
+                    MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Execution time (king passes through check): " + 
                                             std::to_string(duration) + "ms");
                 }
                 
@@ -2258,7 +3014,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
             
         } else if (isEnPassantCapture(move)) {
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Processing en passant capture");
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Processing en passant capture");
             }
             
             // Move the pawn
@@ -2273,7 +3029,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
             
         } else {
             if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Processing regular move");
+                MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Processing regular move");
             }
             
             // Regular move
@@ -2290,7 +3046,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
         checkResultCache[cacheKey] = result;
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Move " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Move " + 
                                       move.toAlgebraic() + " would " + 
                                       (result ? "leave king in check" : "not leave king in check"));
         }
@@ -2300,7 +3056,7 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
         // End timing and log
         double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
         if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Total execution time: " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessBoard::wouldLeaveInCheck() - Total execution time: " + 
                                     std::to_string(duration) + "ms");
         }
         
@@ -2326,17 +3082,13 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
 
 bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) const
 {
-    // Start timing
-    PerformanceMonitor::startTimer("ChessBoard::wouldLeaveInCheck");
+    PerformanceMonitor::ScopedTimer timer("ChessBoard::wouldLeaveInCheck");
 
     MPChessServer* server = MPChessServer::getInstance();
-    if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3)
-    {
-        server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Checking if move " + 
-                                  move.toAlgebraic() + " would leave " + 
-                                  std::string(color == PieceColor::WHITE ? "white" : "black") + 
-                                  " king in check");
-    }
+    MPCHESS_TRACE("ChessBoard::wouldLeaveInCheck() - Checking if move " + 
+                  move.toAlgebraic() + " would leave " + 
+                  std::string(color == PieceColor::WHITE ? "white" : "black") + 
+                  " king in check");
 
     // Check recursion depth
     if (!incrementRecursionDepth("wouldLeaveInCheck")) {
@@ -2346,41 +3098,27 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
             server->getLogger()->warning("ChessBoard::wouldLeaveInCheck() - Maximum recursion depth exceeded, assuming move would leave king in check");
         }
 
-        // End timing and log
-        double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
-        if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Execution time after recursion depth check: " + 
-                                    std::to_string(duration) + "ms");
-        }
-
         decrementRecursionDepth();
         return true;
     }
     
     try {
         // Check cache first
-        std::string cacheKey = generateCheckResultCacheKey(move, color);
+        uint64_t cacheKey = generateCheckResultCacheKey(move, color);
         auto cacheIt = checkResultCache.find(cacheKey);
         if (cacheIt != checkResultCache.end()) {
-            if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Cache hit for move " + 
-                                          move.toAlgebraic() + ", result: " + 
-                                          (cacheIt->second ? "would leave in check" : "would not leave in check"));
-            }
-            
-            // End timing for cache hit
-            double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
-            if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Cache hit execution time: " + 
-                                        std::to_string(duration) + "ms");
-            }
+            MPCHESS_TRACE("ChessBoard::wouldLeaveInCheck() - Cache hit for move " + 
+                          move.toAlgebraic() + ", result: " + 
+                          (cacheIt->second ? "would leave in check" : "would not leave in check"));
             
             decrementRecursionDepth();
             return cacheIt->second;
         }
         
-        // Create a clone of the board
-        auto tempBoard = clone();
+        // Create a scratch board holding only the position; history is not needed for the check test
+        ChessBoard scratchBoard;
+        scratchBoard.position = position;
+        ChessBoard* tempBoard = &scratchBoard;
         
         // Execute the move without validation
         const Position& from = move.getFrom();
@@ -2388,29 +3126,18 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
         
         // Handle special moves
         if (isCastlingMove(move)) {
-            if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Processing castling move");
-            }
+            MPCHESS_TRACE("ChessBoard::wouldLeaveInCheck() - Processing castling move");
             
             // For castling, we need to check if the king is in check at any point during the move
             int direction = (to.col > from.col) ? 1 : -1;
             
             // Check if the king is in check at the starting position
             if (tempBoard->isInCheck(color)) {
-                if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - King already in check, castling not allowed");
-                }
+                MPCHESS_TRACE("ChessBoard::wouldLeaveInCheck() - King already in check, castling not allowed");
                 
                 // Cache the result
                 checkResultCache[cacheKey] = true;
                 
-                // End timing
-                double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
-                if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Execution time (king already in check): " + 
-                                            std::to_string(duration) + "ms");
-                }
-                
                 decrementRecursionDepth();
                 return true;
             }
@@ -2419,36 +3146,21 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
             Position midPos(from.row, from.col + direction);
             
             // Move the king to the intermediate position
-            tempBoard->board[midPos.row][midPos.col] = std::move(tempBoard->board[from.row][from.col]);
-            if (tempBoard->board[midPos.row][midPos.col]) {
-                tempBoard->board[midPos.row][midPos.col]->setMoved(true);
-            }
+            tempBoard->position.movePiece(BitboardPosition::square(from), BitboardPosition::square(midPos));
             
             // Check if the king would be in check at the intermediate position
             if (tempBoard->isInCheck(color)) {
-                if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - King would pass through check during castling");
-                }
+                MPCHESS_TRACE("ChessBoard::wouldLeaveInCheck() - King would pass through check during castling");
                 
                 // Cache the result
                 checkResultCache[cacheKey] = true;
                 
-                // End timing
-                double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
-                if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                    server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Execution time (king passes through check): " + 
-                                            std::to_string(duration) + "ms");
-                }
-                
                 decrementRecursionDepth();
                 return true;
             }
             
             // Move the king to the final position
-            tempBoard->board[to.row][to.col] = std::move(tempBoard->board[midPos.row][midPos.col]);
-            if (tempBoard->board[to.row][to.col]) {
-                tempBoard->board[to.row][to.col]->setMoved(true);
-            }
+            tempBoard->position.movePiece(BitboardPosition::square(midPos), BitboardPosition::square(to));
             
             // Move the rook
             int rookFromCol = (direction > 0) ? 7 : 0;
@@ -2456,36 +3168,23 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
             
             Position rookFrom(from.row, rookFromCol);
             Position rookTo(from.row, rookToCol);
-            tempBoard->board[rookTo.row][rookTo.col] = std::move(tempBoard->board[rookFrom.row][rookFrom.col]);
-            if (tempBoard->board[rookTo.row][rookTo.col]) {
-                tempBoard->board[rookTo.row][rookTo.col]->setMoved(true);
-            }
+            tempBoard->position.movePiece(BitboardPosition::square(rookFrom), BitboardPosition::square(rookTo));
             
         } else if (isEnPassantCapture(move)) {
-            if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Processing en passant capture");
-            }
+            MPCHESS_TRACE("ChessBoard::wouldLeaveInCheck() - Processing en passant capture");
             
             // Move the pawn
-            tempBoard->board[to.row][to.col] = std::move(tempBoard->board[from.row][from.col]);
-            if (tempBoard->board[to.row][to.col]) {
-                tempBoard->board[to.row][to.col]->setMoved(true);
-            }
+            tempBoard->position.movePiece(BitboardPosition::square(from), BitboardPosition::square(to));
             
             // Remove the captured pawn
             int captureRow = (color == PieceColor::WHITE) ? to.row - 1 : to.row + 1;
-            tempBoard->board[captureRow][to.col] = nullptr;
+            tempBoard->position.removePiece(BitboardPosition::square(captureRow, to.col));
             
         } else {
-            if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-                server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Processing regular move");
-            }
+            MPCHESS_TRACE("ChessBoard::wouldLeaveInCheck() - Processing regular move");
             
             // Regular move
-            tempBoard->board[to.row][to.col] = std::move(tempBoard->board[from.row][from.col]);
-            if (tempBoard->board[to.row][to.col]) {
-                tempBoard->board[to.row][to.col]->setMoved(true);
-            }
+            tempBoard->position.movePiece(BitboardPosition::square(from), BitboardPosition::square(to));
         }
         
         // Check if the king is in check after the move
@@ -2494,21 +3193,12 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
         // Cache the result
         checkResultCache[cacheKey] = result;
         
-        if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Move " + 
-                                      move.toAlgebraic() + " would " + 
-                                      (result ? "leave king in check" : "not leave king in check"));
-        }
+        MPCHESS_TRACE("ChessBoard::wouldLeaveInCheck() - Move " + 
+                      move.toAlgebraic() + " would " + 
+                      (result ? "leave king in check" : "not leave king in check"));
         
         decrementRecursionDepth();
     
-        // End timing and log
-        double duration = PerformanceMonitor::endTimer("ChessBoard::wouldLeaveInCheck");
-        if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
-            server->getLogger()->debug("ChessBoard::wouldLeaveInCheck() - Total execution time: " + 
-                                    std::to_string(duration) + "ms");
-        }
-        
         return result;
     
     } catch (const std::exception& e) {
@@ -2528,13 +3218,15 @@ bool ChessBoard::wouldLeaveInCheck(const ChessMove& move, PieceColor color) cons
     }
 }
 
-std::string ChessBoard::generateCheckResultCacheKey(const ChessMove& move, PieceColor color) const
+uint64_t ChessBoard::generateCheckResultCacheKey(const ChessMove& move, PieceColor color) const
 {
-    // Generate a unique key for the current board state, move, and color
-    std::string key = getBoardStateString() + "_move_" + 
-                     move.toAlgebraic() + "_" +
-                     (color == PieceColor::WHITE ? "white" : "black");
-    return key;
+    // Combine the position key with the move and color
+    uint64_t salt = 0x10000 +
+                    (static_cast<uint64_t>(BitboardPosition::square(move.getFrom())) << 10) +
+                    (static_cast<uint64_t>(BitboardPosition::square(move.getTo())) << 4) +
+                    (static_cast<uint64_t>(move.getPromotionType()) << 1) +
+                    static_cast<uint64_t>(color);
+    return position.zobristKey ^ splitMix64(salt);
 }
 
 std::string ChessBoard::getBoardStateString() const
@@ -2542,35 +3234,23 @@ std::string ChessBoard::getBoardStateString() const
     std::stringstream ss;
     
     // Add piece positions
-    for (int r = 0; r < 8; ++r) {
-        for (int c = 0; c < 8; ++c) {
-            const ChessPiece* piece = getPiece(Position(r, c));
-            if (piece) {
-                ss << piece->getAsciiChar();
-            } else {
-                ss << '.';
-            }
-        }
+    static const char pieceChars[] = "PNBRQKpnbrqk.";
+    for (int sq = 0; sq < 64; ++sq) {
+        ss << pieceChars[position.mailbox[sq]];
     }
     
     // Add castling rights
-    const ChessPiece* whiteKing = getPiece(Position(0, 4));
-    const ChessPiece* blackKing = getPiece(Position(7, 4));
-    const ChessPiece* whiteKingsideRook = getPiece(Position(0, 7));
-    const ChessPiece* whiteQueensideRook = getPiece(Position(0, 0));
-    const ChessPiece* blackKingsideRook = getPiece(Position(7, 7));
-    const ChessPiece* blackQueensideRook = getPiece(Position(7, 0));
-    
-    ss << (whiteKing && !whiteKing->hasMoved() && whiteKingsideRook && !whiteKingsideRook->hasMoved() ? 'K' : '-');
-    ss << (whiteKing && !whiteKing->hasMoved() && whiteQueensideRook && !whiteQueensideRook->hasMoved() ? 'Q' : '-');
-    ss << (blackKing && !blackKing->hasMoved() && blackKingsideRook && !blackKingsideRook->hasMoved() ? 'k' : '-');
-    ss << (blackKing && !blackKing->hasMoved() && blackQueensideRook && !blackQueensideRook->hasMoved() ? 'q' : '-');
+    ss << ((position.castlingRights & BitboardPosition::WHITE_KINGSIDE) ? 'K' : '-');
+    ss << ((position.castlingRights & BitboardPosition::WHITE_QUEENSIDE) ? 'Q' : '-');
+    ss << ((position.castlingRights & BitboardPosition::BLACK_KINGSIDE) ? 'k' : '-');
+    ss << ((position.castlingRights & BitboardPosition::BLACK_QUEENSIDE) ? 'q' : '-');
     
     // Add en passant target
+    Position enPassantTarget = getEnPassantTarget();
     ss << (enPassantTarget.isValid() ? enPassantTarget.toAlgebraic() : "-");
     
     // Add current turn
-    ss << (currentTurn == PieceColor::WHITE ? 'w' : 'b');
+    ss << (position.sideToMove == PieceColor::WHITE ? 'w' : 'b');
     
     return ss.str();
 }
@@ -2668,14 +3348,6 @@ void ChessPlayer::setBot(bool isBot) {
     bot = isBot;
 }
 
-const std::vector<std::string>& ChessPlayer::getGameHistory() const {
-    return gameHistory;
-}
-
-void ChessPlayer::addGameToHistory(const std::string& gameId) {
-    gameHistory.push_back(gameId);
-}
-
 QJsonObject ChessPlayer::toJson() const {
     QJsonObject json;
     json["username"] = QString::fromStdString(username);
@@ -2686,12 +3358,6 @@ QJsonObject ChessPlayer::toJson() const {
     json["draws"] = draws;
     json["bot"] = bot;
     
-    QJsonArray historyArray;
-    for (const std::string& gameId : gameHistory) {
-        historyArray.append(QString::fromStdString(gameId));
-    }
-    json["gameHistory"] = historyArray;
-    
     return json;
 }
 
@@ -2706,11 +3372,6 @@ ChessPlayer ChessPlayer::fromJson(const QJsonObject& json) {
     player.draws = json["draws"].toInt();
     player.bot = json["bot"].toBool();
     
-    QJsonArray historyArray = json["gameHistory"].toArray();
-    for (const QJsonValue& value : historyArray) {
-        player.gameHistory.push_back(value.toString().toStdString());
-    }
-    
     return player;
 }
 
@@ -2719,12 +3380,14 @@ ChessGame::ChessGame(ChessPlayer* whitePlayer, ChessPlayer* blackPlayer,
                      const std::string& gameId, TimeControlType timeControl)
     : gameId(gameId), whitePlayer(whitePlayer), blackPlayer(blackPlayer),
       result(GameResult::IN_PROGRESS), timeControl(timeControl),
-      drawOffered(false), drawOfferingPlayer(nullptr)
+      drawOffered(false), drawOfferingPlayer(nullptr),
+      positionStatusPly(0), positionStatusKey(0), positionStatusValid(false),
+      stateSequence(0), sentMoveCount(0), sentWhiteCaptured(0), sentBlackCaptured(0)
 {
     MPChessServer* server = MPChessServer::getInstance();
     
     if (server && server->getLogger()) {
-        server->getLogger()->debug("ChessGame constructor - Creating game " + gameId);
+        MPCHESS_DEBUG(server->getLogger(), "ChessGame constructor - Creating game " + gameId);
     }
     
     if (!whitePlayer || !blackPlayer) {
@@ -2736,7 +3399,7 @@ ChessGame::ChessGame(ChessPlayer* whitePlayer, ChessPlayer* blackPlayer,
     
     try {
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessGame constructor - Creating ChessBoard for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "ChessGame constructor - Creating ChessBoard for game " + gameId);
         }
         
         board = std::make_unique<ChessBoard>();
@@ -2749,9 +3412,10 @@ ChessGame::ChessGame(ChessPlayer* whitePlayer, ChessPlayer* blackPlayer,
         }
 
         board->initialize();
+        resetStateBaseline();
 
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessGame constructor - ChessBoard created successfully for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "ChessGame constructor - ChessBoard created successfully for game " + gameId);
         }
     } catch (const std::exception& e) {
         if (server && server->getLogger()) {
@@ -2764,7 +3428,7 @@ ChessGame::ChessGame(ChessPlayer* whitePlayer, ChessPlayer* blackPlayer,
     lastMoveTime = startTime;
     
     if (server && server->getLogger()) {
-        server->getLogger()->debug("ChessGame constructor - Game " + gameId + " created successfully with players: " + 
+        MPCHESS_DEBUG(server->getLogger(), "ChessGame constructor - Game " + gameId + " created successfully with players: " + 
                                   whitePlayer->getUsername() + " (White) and " + blackPlayer->getUsername() + " (Black)");
     }
 }
@@ -2773,6 +3437,36 @@ ChessGame::~ChessGame() {
     // Players are managed externally
 }
 
+void ChessGame::reset(ChessPlayer* whitePlayer, ChessPlayer* blackPlayer,
+                      const std::string& gameId, TimeControlType timeControl)
+{
+    if (!whitePlayer || !blackPlayer) {
+        throw std::invalid_argument("Null player provided to ChessGame::reset");
+    }
+    
+    this->gameId = gameId;
+    this->whitePlayer = whitePlayer;
+    this->blackPlayer = blackPlayer;
+    this->timeControl = timeControl;
+    result = GameResult::IN_PROGRESS;
+    drawOffered = false;
+    drawOfferingPlayer = nullptr;
+    moveTimings.clear();
+    endTime = QDateTime();
+    
+    // Clients of the new game start from a full snapshot
+    stateCache.clear();
+    positionStatusValid = false;
+    recentDeltas.clear();
+    stateSequence = 0;
+    
+    board->initialize();
+    resetStateBaseline();
+    
+    startTime = QDateTime::currentDateTime();
+    lastMoveTime = startTime;
+}
+
 std::string ChessGame::getGameId() const {
     return gameId;
 }
@@ -2810,6 +3504,19 @@ TimeControlType ChessGame::getTimeControl() const {
     return timeControl;
 }
 
+const PositionStatus& ChessGame::getPositionStatus() const {
+    // Keyed by ply as well, since the same position can come back with a different repetition count
+    size_t ply = board->getMoveHistory().size();
+    uint64_t key = board->getZobristKey();
+    if (!positionStatusValid || positionStatusPly != ply || positionStatusKey != key) {
+        positionStatus = board->getPositionStatus();
+        positionStatusPly = ply;
+        positionStatusKey = key;
+        positionStatusValid = true;
+    }
+    return positionStatus;
+}
+
 MoveValidationStatus ChessGame::processMove(ChessPlayer* player, const ChessMove& move) {
     // Check if the game is over
     if (isOver()) {
@@ -2826,6 +3533,8 @@ MoveValidationStatus ChessGame::processMove(ChessPlayer* player, const ChessMove
     // Validate and execute the move
     MoveValidationStatus status = board->movePiece(move);
     if (status == MoveValidationStatus::VALID) {
+        invalidateStateCache();
+        
         // Record the time taken for this move
         QDateTime now = QDateTime::currentDateTime();
         qint64 timeTaken = lastMoveTime.msecsTo(now);
@@ -2837,20 +3546,21 @@ MoveValidationStatus ChessGame::processMove(ChessPlayer* player, const ChessMove
         // Update the last move time
         lastMoveTime = now;
         
-        // Check if the game is over
-        if (board->isInCheckmate(PieceColor::WHITE)) {
-            end(GameResult::BLACK_WIN);
-        } else if (board->isInCheckmate(PieceColor::BLACK)) {
-            end(GameResult::WHITE_WIN);
-        } else if (board->isInStalemate(PieceColor::WHITE) || board->isInStalemate(PieceColor::BLACK) ||
-                   board->canClaimThreefoldRepetition() || board->canClaimFiftyMoveRule() || 
-                   board->hasInsufficientMaterial()) {
-            end(GameResult::DRAW);
+        // Check if the game is over; the status is kept for the state messages that follow
+        GameResult positionResult = getPositionStatus().getResult();
+        if (positionResult != GameResult::IN_PROGRESS) {
+            end(positionResult);
         }
         
         // Reset draw offer
         drawOffered = false;
         drawOfferingPlayer = nullptr;
+        
+        // The opponent's clock is running now
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && !isOver()) {
+            server->scheduleClockDeadline(gameId, getClockDeadline());
+        }
     }
     
     return status;
@@ -2860,7 +3570,7 @@ void ChessGame::start()
 {
     MPChessServer* server = MPChessServer::getInstance();
     if (server && server->getLogger()) {
-        server->getLogger()->debug("ChessGame::start() - Starting game " + gameId);
+        MPCHESS_DEBUG(server->getLogger(), "ChessGame::start() - Starting game " + gameId);
     }
     
     try {
@@ -2868,7 +3578,7 @@ void ChessGame::start()
         lastMoveTime = startTime;
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessGame::start() - Initializing board for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "ChessGame::start() - Initializing board for game " + gameId);
         }
         
         // Initialize the board
@@ -2880,6 +3590,8 @@ void ChessGame::start()
                 throw std::runtime_error("Board is null");
             }
             board->initialize();
+            resetStateBaseline();
+            invalidateStateCache();
         } catch (const std::exception& e) {
             if (server && server->getLogger()) {
                 server->getLogger()->error("ChessGame::start() - Board initialization failed for game " + gameId + ": " + std::string(e.what()));
@@ -2888,14 +3600,14 @@ void ChessGame::start()
         }
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessGame::start() - Setting player colors for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "ChessGame::start() - Setting player colors for game " + gameId);
         }
         
         // Set the player colors
         if (whitePlayer) {
             whitePlayer->setColor(PieceColor::WHITE);
             if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessGame::start() - Set " + whitePlayer->getUsername() + " as WHITE for game " + gameId);
+                MPCHESS_DEBUG(server->getLogger(), "ChessGame::start() - Set " + whitePlayer->getUsername() + " as WHITE for game " + gameId);
             }
         } else {
             if (server && server->getLogger()) {
@@ -2906,7 +3618,7 @@ void ChessGame::start()
         if (blackPlayer) {
             blackPlayer->setColor(PieceColor::BLACK);
             if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessGame::start() - Set " + blackPlayer->getUsername() + " as BLACK for game " + gameId);
+                MPCHESS_DEBUG(server->getLogger(), "ChessGame::start() - Set " + blackPlayer->getUsername() + " as BLACK for game " + gameId);
             }
         } else {
             if (server && server->getLogger()) {
@@ -2915,14 +3627,17 @@ void ChessGame::start()
         }
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessGame::start() - Initializing time control for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "ChessGame::start() - Initializing time control for game " + gameId);
         }
         
         // Initialize the time control
         initializeTimeControl();
+        if (server) {
+            server->scheduleClockDeadline(gameId, getClockDeadline());
+        }
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessGame::start() - Game " + gameId + " started successfully");
+            MPCHESS_DEBUG(server->getLogger(), "ChessGame::start() - Game " + gameId + " started successfully");
         }
     } catch (const std::exception& e) {
         if (server && server->getLogger()) {
@@ -2941,6 +3656,7 @@ void ChessGame::end(GameResult result)
 {
     this->result = result;
     endTime = QDateTime::currentDateTime();
+    invalidateStateCache();
     
     // Update player statistics
     whitePlayer->updateStats(result);
@@ -2958,18 +3674,19 @@ QJsonObject ChessGame::getGameStateJson() const
     
     try {
         if (server && server->getLogger()) {
-            server->getLogger()->debug("getGameStateJson() - Generating game state for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Generating game state for game " + gameId);
         }
         
         json["gameId"] = QString::fromStdString(gameId);
+        json["sequence"] = static_cast<qint64>(stateSequence);
         
         // Player information with null checks and exception handling
         try {
             if (whitePlayer) {
                 json["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
-                json["whiteRemainingTime"] = static_cast<qint64>(whitePlayer->getRemainingTime());
+                json["whiteRemainingTime"] = getLiveRemainingTime(whitePlayer);
                 if (server && server->getLogger()) {
-                    server->getLogger()->debug("getGameStateJson() - White player: " + whitePlayer->getUsername() + 
+                    MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - White player: " + whitePlayer->getUsername() + 
                                               ", time: " + std::to_string(whitePlayer->getRemainingTime()));
                 }
             } else {
@@ -2990,9 +3707,9 @@ QJsonObject ChessGame::getGameStateJson() const
         try {
             if (blackPlayer) {
                 json["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
-                json["blackRemainingTime"] = static_cast<qint64>(blackPlayer->getRemainingTime());
+                json["blackRemainingTime"] = getLiveRemainingTime(blackPlayer);
                 if (server && server->getLogger()) {
-                    server->getLogger()->debug("getGameStateJson() - Black player: " + blackPlayer->getUsername() + 
+                    MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Black player: " + blackPlayer->getUsername() + 
                                               ", time: " + std::to_string(blackPlayer->getRemainingTime()));
                 }
             } else {
@@ -3017,9 +3734,10 @@ QJsonObject ChessGame::getGameStateJson() const
                 
                 // Add check status with proper error handling
                 try {
-                    json["isCheck"] = board->isInCheck(board->getCurrentTurn());
-                    json["isCheckmate"] = board->isInCheckmate(board->getCurrentTurn());
-                    json["isStalemate"] = board->isInStalemate(board->getCurrentTurn());
+                    const PositionStatus& status = getPositionStatus();
+                    json["isCheck"] = status.inCheck;
+                    json["isCheckmate"] = status.checkmate;
+                    json["isStalemate"] = status.stalemate;
                 } catch (const std::exception& e) {
                     json["isCheck"] = false;
                     json["isCheckmate"] = false;
@@ -3030,7 +3748,7 @@ QJsonObject ChessGame::getGameStateJson() const
                 }
                 
                 if (server && server->getLogger()) {
-                    server->getLogger()->debug("getGameStateJson() - Game " + gameId + " turn: " + 
+                    MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Game " + gameId + " turn: " + 
                                               (board->getCurrentTurn() == PieceColor::WHITE ? "white" : "black"));
                 }
             } else {
@@ -3065,7 +3783,7 @@ QJsonObject ChessGame::getGameStateJson() const
             }();
             
             if (server && server->getLogger()) {
-                server->getLogger()->debug("getGameStateJson() - Game " + gameId + " result: " + json["result"].toString().toStdString());
+                MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Game " + gameId + " result: " + json["result"].toString().toStdString());
             }
         } catch (const std::exception& e) {
             json["result"] = "in_progress";
@@ -3080,7 +3798,7 @@ QJsonObject ChessGame::getGameStateJson() const
             if (drawOffered && drawOfferingPlayer) {
                 json["drawOfferingPlayer"] = QString::fromStdString(drawOfferingPlayer->getUsername());
                 if (server && server->getLogger()) {
-                    server->getLogger()->debug("getGameStateJson() - Draw offered by " + drawOfferingPlayer->getUsername() + " in game " + gameId);
+                    MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Draw offered by " + drawOfferingPlayer->getUsername() + " in game " + gameId);
                 }
             }
         } catch (const std::exception& e) {
@@ -3092,7 +3810,7 @@ QJsonObject ChessGame::getGameStateJson() const
         
         // Board state - now with piece type information and proper orientation
         if (server && server->getLogger()) {
-            server->getLogger()->debug("getGameStateJson() - Building board array for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Building board array for game " + gameId);
         }
         
         QJsonArray boardArray;
@@ -3173,12 +3891,12 @@ QJsonObject ChessGame::getGameStateJson() const
         json["boardOrientation"] = "standard"; // Standard orientation (white at bottom)
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("getGameStateJson() - Board array built successfully for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Board array built successfully for game " + gameId);
         }
         
         // Add move history
         if (server && server->getLogger()) {
-            server->getLogger()->debug("getGameStateJson() - Building move history for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Building move history for game " + gameId);
         }
         
         QJsonArray moveHistoryArray;
@@ -3213,7 +3931,7 @@ QJsonObject ChessGame::getGameStateJson() const
         
         // Add captured pieces
         if (server && server->getLogger()) {
-            server->getLogger()->debug("getGameStateJson() - Building captured pieces arrays for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Building captured pieces arrays for game " + gameId);
         }
         
         QJsonArray whiteCapturedArray;
@@ -3267,7 +3985,7 @@ QJsonObject ChessGame::getGameStateJson() const
         // ASCII board representation
         if (board) {
             if (server && server->getLogger()) {
-                server->getLogger()->debug("getGameStateJson() - Getting ASCII board representation for game " + gameId);
+                MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Getting ASCII board representation for game " + gameId);
             }
             try {
                 json["asciiBoard"] = QString::fromStdString(board->getAsciiBoard());
@@ -3282,7 +4000,7 @@ QJsonObject ChessGame::getGameStateJson() const
         }
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("getGameStateJson() - Successfully generated game state for game " + gameId);
+            MPCHESS_DEBUG(server->getLogger(), "getGameStateJson() - Successfully generated game state for game " + gameId);
         }
     } catch (const std::exception& e) {
         // Comprehensive error handling for the entire function
@@ -3309,62 +4027,285 @@ QJsonObject ChessGame::getGameStateJson() const
     return json;
 }
 
-QJsonObject ChessGame::getGameHistoryJson() const
-{
-    QJsonObject json = getGameStateJson();
-    
-    // Add additional history information
-    json["startTime"] = startTime.toString(Qt::ISODate);
-    if (isOver()) {
-        json["endTime"] = endTime.toString(Qt::ISODate);
-        json["duration"] = startTime.secsTo(endTime);
-    }
-    
-    // Add move timings
-    QJsonArray moveTimingsArray;
-    for (const auto& [move, time] : moveTimings) {
-        QJsonObject timingObj;
-        timingObj["move"] = QString::fromStdString(move.toAlgebraic());
-        timingObj["timeMs"] = static_cast<qint64>(time);
-        moveTimingsArray.append(timingObj);
-    }
-    json["moveTimings"] = moveTimingsArray;
-    
-    return json;
-}
-
-const std::vector<std::pair<ChessMove, qint64>>& ChessGame::getMoveTimings() const {
-    return moveTimings;
-}
-
-std::string ChessGame::getBoardAscii() const {
-    return board->getAsciiBoard();
-}
-
-std::vector<std::pair<ChessMove, double>> ChessGame::getMoveRecommendations(ChessPlayer* player) const
+QJsonObject ChessGame::takeGameStateDelta()
 {
+    QJsonObject json;
     MPChessServer* server = MPChessServer::getInstance();
     
-    if (!player || !board) {
-        if (server && server->getLogger()) {
-            server->getLogger()->warning("ChessGame::getMoveRecommendations() - Null player or board");
+    auto typeName = [](PieceType type) -> QString {
+        switch (type) {
+            case PieceType::PAWN:   return "pawn";
+            case PieceType::KNIGHT: return "knight";
+            case PieceType::BISHOP: return "bishop";
+            case PieceType::ROOK:   return "rook";
+            case PieceType::QUEEN:  return "queen";
+            case PieceType::KING:   return "king";
+            default:                return "empty";
         }
-        return {};
-    }
+    };
     
     try {
-        if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessGame::getMoveRecommendations() - Generating recommendations for player " + 
-                                      player->getUsername());
-        }
-        
+        ++stateSequence;
+        invalidateStateCache();
+        json["isDelta"] = true;
+        json["gameId"] = QString::fromStdString(gameId);
+        json["sequence"] = static_cast<qint64>(stateSequence);
+        json["whiteRemainingTime"] = getLiveRemainingTime(whitePlayer);
+        json["blackRemainingTime"] = getLiveRemainingTime(blackPlayer);
+        json["currentTurn"] = (board->getCurrentTurn() == PieceColor::WHITE) ? "white" : "black";
+        const PositionStatus& status = getPositionStatus();
+        json["isCheck"] = status.inCheck;
+        json["isCheckmate"] = status.checkmate;
+        json["isStalemate"] = status.stalemate;
+        json["result"] = [this]() -> QString {
+            switch (result) {
+                case GameResult::WHITE_WIN: return "white_win";
+                case GameResult::BLACK_WIN: return "black_win";
+                case GameResult::DRAW: return "draw";
+                default: return "in_progress";
+            }
+        }();
+        json["drawOffered"] = drawOffered;
+        if (drawOffered && drawOfferingPlayer) {
+            json["drawOfferingPlayer"] = QString::fromStdString(drawOfferingPlayer->getUsername());
+        }
+        
+        // Moves since the last delta; moveIndex lets the client drop anything it
+        // already has from a snapshot that was newer than its deltas
+        const std::vector<ChessMove>& moveHistory = board->getMoveHistory();
+        QJsonArray movesArray;
+        for (size_t i = std::min(sentMoveCount, moveHistory.size()); i < moveHistory.size(); ++i) {
+            const ChessMove& move = moveHistory[i];
+            QJsonObject moveObj;
+            moveObj["from"] = QString::fromStdString(move.getFrom().toAlgebraic());
+            moveObj["to"] = QString::fromStdString(move.getTo().toAlgebraic());
+            moveObj["algebraic"] = QString::fromStdString(move.toStandardNotation(*board));
+            if (move.getPromotionType() != PieceType::EMPTY) {
+                moveObj["promotion"] = typeName(move.getPromotionType());
+            }
+            movesArray.append(moveObj);
+        }
+        json["moveIndex"] = static_cast<qint64>(std::min(sentMoveCount, moveHistory.size()));
+        json["moves"] = movesArray;
+        
+        // Squares whose contents changed; a diff covers castling, en passant and promotion
+        const std::array<uint8_t, 64>& placement = board->getBitboards().mailbox;
+        QJsonArray squaresArray;
+        for (int sq = 0; sq < 64; ++sq) {
+            if (placement[sq] == sentPlacement[sq]) {
+                continue;
+            }
+            PieceType type = board->getBitboards().typeAt(sq);
+            PieceColor color = board->getBitboards().colorAt(sq);
+            QJsonObject squareObj;
+            squareObj["row"] = sq / 8;
+            squareObj["col"] = sq % 8;
+            squareObj["type"] = typeName(type);
+            squareObj["color"] = color == PieceColor::WHITE ? "white" : (color == PieceColor::BLACK ? "black" : "none");
+            squaresArray.append(squareObj);
+        }
+        json["squares"] = squaresArray;
+        
+        // Captured lists only when they grew; they are short, so send them whole
+        const std::vector<PieceType>& whiteCaptured = board->getCapturedPieces(PieceColor::WHITE);
+        const std::vector<PieceType>& blackCaptured = board->getCapturedPieces(PieceColor::BLACK);
+        if (whiteCaptured.size() != sentWhiteCaptured) {
+            QJsonArray capturedArray;
+            for (PieceType type : whiteCaptured) {
+                capturedArray.append(typeName(type));
+            }
+            json["whiteCaptured"] = capturedArray;
+        }
+        if (blackCaptured.size() != sentBlackCaptured) {
+            QJsonArray capturedArray;
+            for (PieceType type : blackCaptured) {
+                capturedArray.append(typeName(type));
+            }
+            json["blackCaptured"] = capturedArray;
+        }
+        
+        resetStateBaseline();
+        
+        if (server && server->getLogger()) {
+            MPCHESS_DEBUG(server->getLogger(), "takeGameStateDelta() - Game " + gameId + " sequence " + std::to_string(stateSequence) +
+                                      ": " + std::to_string(movesArray.size()) + " move(s), " +
+                                      std::to_string(squaresArray.size()) + " square(s)");
+        }
+    } catch (const std::exception& e) {
+        if (server && server->getLogger()) {
+            server->getLogger()->error("takeGameStateDelta() - Exception building delta for game " + gameId + ": " + std::string(e.what()));
+        }
+        
+        // A delta without a sequence makes the client ask for a snapshot
+        json = QJsonObject();
+        json["isDelta"] = true;
+        json["gameId"] = QString::fromStdString(gameId);
+    }
+    
+    if (json.contains("sequence")) {
+        recentDeltas.push_back(json);
+        if (recentDeltas.size() > DELTA_HISTORY_SIZE) {
+            recentDeltas.pop_front();
+        }
+    }
+    
+    return json;
+}
+
+quint64 ChessGame::getStateSequence() const
+{
+    return stateSequence;
+}
+
+bool ChessGame::getDeltasSince(quint64 sequence, std::vector<QJsonObject>& deltas) const
+{
+    if (sequence > stateSequence) {
+        return false;
+    }
+    if (sequence < stateSequence &&
+        (recentDeltas.empty() || static_cast<quint64>(recentDeltas.front()["sequence"].toInteger()) > sequence + 1)) {
+        return false;
+    }
+    
+    for (const QJsonObject& delta : recentDeltas) {
+        if (static_cast<quint64>(delta["sequence"].toInteger()) > sequence) {
+            deltas.push_back(delta);
+        }
+    }
+    return true;
+}
+
+QJsonObject ChessGame::exportState() const
+{
+    QJsonObject state = getGameHistoryJson();
+    state["timeControl"] = static_cast<int>(timeControl);
+    state["sequence"] = static_cast<qint64>(stateSequence);
+    return state;
+}
+
+bool ChessGame::importState(const QJsonObject& state)
+{
+    board->initialize();
+    moveTimings.clear();
+    
+    for (const QJsonValue& value : state["moveTimings"].toArray()) {
+        QJsonObject timing = value.toObject();
+        ChessMove move = ChessMove::fromAlgebraic(timing["move"].toString().toStdString());
+        if (board->movePiece(move) != MoveValidationStatus::VALID) {
+            return false;
+        }
+        moveTimings.emplace_back(move, timing["timeMs"].toInteger());
+    }
+    
+    // The clocks were read when the game was exported; the handover itself is not charged
+    whitePlayer->setRemainingTime(state["whiteRemainingTime"].toInteger());
+    blackPlayer->setRemainingTime(state["blackRemainingTime"].toInteger());
+    QDateTime exportedStart = QDateTime::fromString(state["startTime"].toString(), Qt::ISODate);
+    if (exportedStart.isValid()) {
+        startTime = exportedStart;
+    }
+    lastMoveTime = QDateTime::currentDateTime();
+    
+    // Clients keep applying deltas from the sequence they have
+    stateSequence = static_cast<quint64>(state["sequence"].toInteger());
+    recentDeltas.clear();
+    invalidateStateCache();
+    resetStateBaseline();
+    return true;
+}
+
+QByteArray ChessGame::getEncodedGameState(const QString& orientation, bool binary) const
+{
+    size_t moveCount = board->getMoveHistory().size();
+    auto key = std::make_pair(orientation, binary);
+    
+    auto it = stateCache.find(key);
+    if (it != stateCache.end() && it->second.moveCount == moveCount) {
+        return it->second.bytes;
+    }
+    
+    QJsonObject gameState = getGameStateJson();
+    gameState["boardOrientation"] = orientation;
+    
+    QJsonObject message;
+    message["type"] = static_cast<int>(MessageType::GAME_STATE);
+    message["gameState"] = gameState;
+    
+    EncodedState& entry = stateCache[key];
+    entry.moveCount = moveCount;
+    entry.bytes = MPChessServer::encodeMessage(message, binary);
+    return entry.bytes;
+}
+
+void ChessGame::invalidateStateCache()
+{
+    stateCache.clear();
+}
+
+void ChessGame::resetStateBaseline()
+{
+    sentPlacement = board->getBitboards().mailbox;
+    sentMoveCount = board->getMoveHistory().size();
+    sentWhiteCaptured = board->getCapturedPieces(PieceColor::WHITE).size();
+    sentBlackCaptured = board->getCapturedPieces(PieceColor::BLACK).size();
+}
+
+QJsonObject ChessGame::getGameHistoryJson() const
+{
+    QJsonObject json = getGameStateJson();
+    
+    // Add additional history information
+    json["startTime"] = startTime.toString(Qt::ISODate);
+    if (isOver()) {
+        json["endTime"] = endTime.toString(Qt::ISODate);
+        json["duration"] = startTime.secsTo(endTime);
+    }
+    
+    // Add move timings
+    QJsonArray moveTimingsArray;
+    for (const auto& [move, time] : moveTimings) {
+        QJsonObject timingObj;
+        timingObj["move"] = QString::fromStdString(move.toAlgebraic());
+        timingObj["timeMs"] = static_cast<qint64>(time);
+        moveTimingsArray.append(timingObj);
+    }
+    json["moveTimings"] = moveTimingsArray;
+    
+    return json;
+}
+
+const std::vector<std::pair<ChessMove, qint64>>& ChessGame::getMoveTimings() const {
+    return moveTimings;
+}
+
+std::string ChessGame::getBoardAscii() const {
+    return board->getAsciiBoard();
+}
+
+std::vector<std::pair<ChessMove, double>> ChessGame::getMoveRecommendations(ChessPlayer* player) const
+{
+    MPChessServer* server = MPChessServer::getInstance();
+    
+    if (!player || !board) {
+        if (server && server->getLogger()) {
+            server->getLogger()->warning("ChessGame::getMoveRecommendations() - Null player or board");
+        }
+        return {};
+    }
+    
+    try {
+        if (server && server->getLogger()) {
+            MPCHESS_DEBUG(server->getLogger(), "ChessGame::getMoveRecommendations() - Generating recommendations for player " + 
+                                      player->getUsername());
+        }
+        
         // Check if it's the player's turn
         PieceColor playerColor = player->getColor();
         PieceColor currentTurn = board->getCurrentTurn();
         
         if (playerColor != currentTurn) {
             if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessGame::getMoveRecommendations() - Not player's turn, returning empty list");
+                MPCHESS_DEBUG(server->getLogger(), "ChessGame::getMoveRecommendations() - Not player's turn, returning empty list");
             }
             return {};
         }
@@ -3372,10 +4313,12 @@ std::vector<std::pair<ChessMove, double>> ChessGame::getMoveRecommendations(Ches
         // Use a simplified approach for recommendations to avoid deep recursion
         std::vector<ChessMove> validMoves;
         try {
-            validMoves = board->getAllValidMoves(playerColor);
+            // The side to move's legal moves were generated with the position status
+            const MoveList& legalMoves = getPositionStatus().legalMoves;
+            validMoves.assign(legalMoves.begin(), legalMoves.end());
             
             if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessGame::getMoveRecommendations() - Found " + 
+                MPCHESS_DEBUG(server->getLogger(), "ChessGame::getMoveRecommendations() - Found " + 
                                           std::to_string(validMoves.size()) + " valid moves");
             }
         }
@@ -3425,7 +4368,7 @@ std::vector<std::pair<ChessMove, double>> ChessGame::getMoveRecommendations(Ches
         }
         
         if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessGame::getMoveRecommendations() - Returning " + 
+            MPCHESS_DEBUG(server->getLogger(), "ChessGame::getMoveRecommendations() - Returning " + 
                                       std::to_string(recommendations.size()) + " recommendations");
         }
         
@@ -3448,6 +4391,7 @@ bool ChessGame::handleDrawOffer(ChessPlayer* player) {
     
     drawOffered = true;
     drawOfferingPlayer = player;
+    invalidateStateCache();
     return true;
 }
 
@@ -3459,6 +4403,7 @@ void ChessGame::handleDrawResponse(ChessPlayer* player, bool accepted) {
     } else {
         drawOffered = false;
         drawOfferingPlayer = nullptr;
+        invalidateStateCache();
     }
 }
 
@@ -3488,7 +4433,26 @@ void ChessGame::updateTimers() {
 }
 
 bool ChessGame::hasPlayerTimedOut(ChessPlayer* player) const {
-    return player->getRemainingTime() <= 0;
+    return getLiveRemainingTime(player) <= 0;
+}
+
+qint64 ChessGame::getLiveRemainingTime(const ChessPlayer* player) const {
+    if (!player) return 0;
+    
+    // Clocks are only charged when a turn ends; the running turn is measured from its start
+    qint64 remaining = player->getRemainingTime();
+    if (!isOver() && player == getCurrentPlayer()) {
+        remaining -= lastMoveTime.msecsTo(QDateTime::currentDateTime());
+    }
+    return std::max<qint64>(remaining, 0);
+}
+
+qint64 ChessGame::getClockDeadline() const {
+    ChessPlayer* currentPlayer = getCurrentPlayer();
+    if (isOver() || !currentPlayer) {
+        return -1;
+    }
+    return lastMoveTime.toMSecsSinceEpoch() + currentPlayer->getRemainingTime();
 }
 
 QJsonObject ChessGame::serialize() const {
@@ -3588,3377 +4552,8734 @@ void ChessGame::updatePlayerTime(ChessPlayer* player) {
     player->decrementTime(elapsed);
 }
 
-// Implementation of ChessAI class
-// Define the piece-square tables
-const std::array<std::array<double, 8>, 8> ChessAI::pawnTable = {{
-    {{ 0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0 }},
-    {{ 5.0,  5.0,  5.0,  5.0,  5.0,  5.0,  5.0,  5.0 }},
-    {{ 1.0,  1.0,  2.0,  3.0,  3.0,  2.0,  1.0,  1.0 }},
-    {{ 0.5,  0.5,  1.0,  2.5,  2.5,  1.0,  0.5,  0.5 }},
-    {{ 0.0,  0.0,  0.0,  2.0,  2.0,  0.0,  0.0,  0.0 }},
-    {{ 0.5, -0.5, -1.0,  0.0,  0.0, -1.0, -0.5,  0.5 }},
-    {{ 0.5,  1.0,  1.0, -2.0, -2.0,  1.0,  1.0,  0.5 }},
-    {{ 0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0 }}
-}};
-
-const std::array<std::array<double, 8>, 8> ChessAI::knightTable = {{
-    {{-5.0, -4.0, -3.0, -3.0, -3.0, -3.0, -4.0, -5.0 }},
-    {{-4.0, -2.0,  0.0,  0.0,  0.0,  0.0, -2.0, -4.0 }},
-    {{-3.0,  0.0,  1.0,  1.5,  1.5,  1.0,  0.0, -3.0 }},
-    {{-3.0,  0.5,  1.5,  2.0,  2.0,  1.5,  0.5, -3.0 }},
-    {{-3.0,  0.0,  1.5,  2.0,  2.0,  1.5,  0.0, -3.0 }},
-    {{-3.0,  0.5,  1.0,  1.5,  1.5,  1.0,  0.5, -3.0 }},
-    {{-4.0, -2.0,  0.0,  0.5,  0.5,  0.0, -2.0, -4.0 }},
-    {{-5.0, -4.0, -3.0, -3.0, -3.0, -3.0, -4.0, -5.0 }}
-}};
-
-const std::array<std::array<double, 8>, 8> ChessAI::bishopTable = {{
-    {{-2.0, -1.0, -1.0, -1.0, -1.0, -1.0, -1.0, -2.0 }},
-    {{-1.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -1.0 }},
-    {{-1.0,  0.0,  0.5,  1.0,  1.0,  0.5,  0.0, -1.0 }},
-    {{-1.0,  0.5,  0.5,  1.0,  1.0,  0.5,  0.5, -1.0 }},
-    {{-1.0,  0.0,  1.0,  1.0,  1.0,  1.0,  0.0, -1.0 }},
-    {{-1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0, -1.0 }},
-    {{-1.0,  0.5,  0.0,  0.0,  0.0,  0.0,  0.5, -1.0 }},
-    {{-2.0, -1.0, -1.0, -1.0, -1.0, -1.0, -1.0, -2.0 }}
-}};
-
-const std::array<std::array<double, 8>, 8> ChessAI::rookTable = {{
-    {{ 0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0 }},
-    {{ 0.5,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  0.5 }},
-    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
-    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
-    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
-    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
-    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
-    {{ 0.0,  0.0,  0.0,  0.5,  0.5,  0.0,  0.0,  0.0 }}
-}};
-
-const std::array<std::array<double, 8>, 8> ChessAI::queenTable = {{
-    {{-2.0, -1.0, -1.0, -0.5, -0.5, -1.0, -1.0, -2.0 }},
-    {{-1.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -1.0 }},
-    {{-1.0,  0.0,  0.5,  0.5,  0.5,  0.5,  0.0, -1.0 }},
-    {{-0.5,  0.0,  0.5,  0.5,  0.5,  0.5,  0.0, -0.5 }},
-    {{ 0.0,  0.0,  0.5,  0.5,  0.5,  0.5,  0.0, -0.5 }},
-    {{-1.0,  0.5,  0.5,  0.5,  0.5,  0.5,  0.0, -1.0 }},
-    {{-1.0,  0.0,  0.5,  0.0,  0.0,  0.0,  0.0, -1.0 }},
-    {{-2.0, -1.0, -1.0, -0.5, -0.5, -1.0, -1.0, -2.0 }}
-}};
-
-const std::array<std::array<double, 8>, 8> ChessAI::kingMiddleGameTable = {{
-    {{-3.0, -4.0, -4.0, -5.0, -5.0, -4.0, -4.0, -3.0 }},
-    {{-3.0, -4.0, -4.0, -5.0, -5.0, -4.0, -4.0, -3.0 }},
-    {{-3.0, -4.0, -4.0, -5.0, -5.0, -4.0, -4.0, -3.0 }},
-    {{-3.0, -4.0, -4.0, -5.0, -5.0, -4.0, -4.0, -3.0 }},
-    {{-2.0, -3.0, -3.0, -4.0, -4.0, -3.0, -3.0, -2.0 }},
-    {{-1.0, -2.0, -2.0, -2.0, -2.0, -2.0, -2.0, -1.0 }},
-    {{ 2.0,  2.0,  0.0,  0.0,  0.0,  0.0,  2.0,  2.0 }},
-    {{ 2.0,  3.0,  1.0,  0.0,  0.0,  1.0,  3.0,  2.0 }}
-}};
-
-const std::array<std::array<double, 8>, 8> ChessAI::kingEndGameTable = {{
-    {{-5.0, -4.0, -3.0, -2.0, -2.0, -3.0, -4.0, -5.0 }},
-    {{-3.0, -2.0, -1.0,  0.0,  0.0, -1.0, -2.0, -3.0 }},
-    {{-3.0, -1.0,  2.0,  3.0,  3.0,  2.0, -1.0, -3.0 }},
-    {{-3.0, -1.0,  3.0,  4.0,  4.0,  3.0, -1.0, -3.0 }},
-    {{-3.0, -1.0,  3.0,  4.0,  4.0,  3.0, -1.0, -3.0 }},
-    {{-3.0, -1.0,  2.0,  3.0,  3.0,  2.0, -1.0, -3.0 }},
-    {{-3.0, -3.0,  0.0,  0.0,  0.0,  0.0, -3.0, -3.0 }},
-    {{-5.0, -3.0, -3.0, -3.0, -3.0, -3.0, -3.0, -5.0 }}
-}};
-
-ChessAI::ChessAI(int skillLevel) : skillLevel(std::min(std::max(skillLevel, 1), 10)) {
+// Implementation of TranspositionTable class
+TranspositionTable::TranspositionTable(size_t sizeInMB) : slotCount(0), sizeInMB(0), generation(0) {
+    resize(sizeInMB);
 }
 
-ChessMove ChessAI::getBestMove(const ChessBoard& board, PieceColor color)
-{
-    // If Stockfish is available and skill level is high enough, use it
-    MPChessServer* server = MPChessServer::getInstance();
-    if (server && server->stockfishConnector && server->stockfishConnector->isInitialized() && skillLevel >= 8) {
-        server->stockfishConnector->setPosition(board);
-        server->stockfishConnector->setSkillLevel(skillLevel * 2);  // Convert our 1-10 scale to Stockfish's 0-20
-        return server->stockfishConnector->getBestMove();
+void TranspositionTable::resize(size_t sizeInMB) {
+    // Round the slot count down to a power of two so the index is a mask
+    size_t requested = std::max<size_t>(sizeInMB, 1) * 1024 * 1024 / sizeof(Slot);
+    size_t count = 1;
+    while (count * 2 <= requested) {
+        count *= 2;
     }
     
-    // Otherwise, use our built-in AI
-    std::vector<ChessMove> validMoves = board.getAllValidMoves(color);
-    if (validMoves.empty()) {
-        return ChessMove();  // No valid moves
+    entries.reset(new Slot[count]());
+    slotCount = count;
+    this->sizeInMB = count * sizeof(Slot) / (1024 * 1024);
+    clear();
+}
+
+void TranspositionTable::clear() {
+    for (size_t i = 0; i < slotCount; ++i) {
+        entries[i].check.store(0, std::memory_order_relaxed);
+        entries[i].data.store(0, std::memory_order_relaxed);
     }
+}
+
+void TranspositionTable::newSearch() {
+    generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool TranspositionTable::probe(uint64_t key, Entry& entry) const {
+    const Slot& slot = entries[key & (slotCount - 1)];
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    uint64_t check = slot.check.load(std::memory_order_relaxed);
     
-    // Introduce randomness based on skill level
-    if (skillLevel < 10 && !validMoves.empty()) {
-        // Chance to make a random move decreases with skill level
-        double randomChance = 0.5 * (10 - skillLevel) / 10.0;
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dis(0.0, 1.0);
-        
-        if (dis(gen) < randomChance) {
-            std::uniform_int_distribution<> moveIdx(0, validMoves.size() - 1);
-            return validMoves[moveIdx(gen)];
-        }
+    // An empty slot or a torn/overwritten write fails this test
+    if (data == 0 || (check ^ data) != key) {
+        return false;
     }
     
-    ChessMove bestMove;
-    double bestValue = color == PieceColor::WHITE ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity();
-    int depth = getSearchDepth();
+    unpackEntry(data, entry);
+    return true;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, double score, Bound bound, const ChessMove& bestMove) {
+    Slot& slot = entries[key & (slotCount - 1)];
+    uint8_t currentGeneration = generation.load(std::memory_order_relaxed) & 0x3F;
     
-    for (const ChessMove& move : validMoves) {
-        // Create a copy of the board and make the move
-        auto tempBoard = board.clone();
-        tempBoard->movePiece(move);
-        
-        // Evaluate the position after the move
-        double value = minimax(*tempBoard, depth - 1, 
-                              -std::numeric_limits<double>::infinity(), 
-                              std::numeric_limits<double>::infinity(), 
-                              color == PieceColor::WHITE ? false : true, color);
-        
-        // Update the best move
-        if ((color == PieceColor::WHITE && value > bestValue) ||
-            (color == PieceColor::BLACK && value < bestValue)) {
-            bestValue = value;
-            bestMove = move;
+    // Keep a deeper entry for the same position from the current search
+    uint64_t oldData = slot.data.load(std::memory_order_relaxed);
+    uint64_t oldCheck = slot.check.load(std::memory_order_relaxed);
+    if (oldData != 0 && (oldCheck ^ oldData) == key) {
+        int oldDepth = static_cast<int>((oldData >> 48) & 0xFF);
+        uint8_t oldGeneration = static_cast<uint8_t>((oldData >> 56) & 0x3F);
+        if (oldGeneration == currentGeneration && oldDepth > depth && bound != Bound::EXACT) {
+            return;
         }
     }
     
-    return bestMove;
+    uint64_t data = packEntry(score, depth, bound, bestMove, currentGeneration);
+    slot.check.store(key ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
 }
 
-void ChessAI::setSkillLevel(int level) {
-    skillLevel = std::min(std::max(level, 1), 10);
+int TranspositionTable::getUsagePermille() const {
+    size_t sample = std::min<size_t>(slotCount, 1000);
+    size_t used = 0;
+    for (size_t i = 0; i < sample; ++i) {
+        if (entries[i].data.load(std::memory_order_relaxed) != 0) {
+            used++;
+        }
+    }
+    return sample > 0 ? static_cast<int>(used * 1000 / sample) : 0;
 }
 
-int ChessAI::getSkillLevel() const {
-    return skillLevel;
+size_t TranspositionTable::getSizeInMB() const {
+    return sizeInMB;
 }
 
-double ChessAI::evaluatePosition(const ChessBoard& board, PieceColor color) const
-{
-    double score = 0.0;
+uint64_t TranspositionTable::packEntry(double score, int depth, Bound bound, const ChessMove& move, uint8_t generation) {
+    // Layout: score (32 bits float) | move (16 bits) | depth (8 bits) | generation (6 bits) | bound (2 bits)
+    float scoreAsFloat = static_cast<float>(score);
+    uint32_t scoreBits;
+    std::memcpy(&scoreBits, &scoreAsFloat, sizeof(scoreBits));
     
-    try {
-        // Count material
-        for (int r = 0; r < 8; ++r) {
-            for (int c = 0; c < 8; ++c) {
-                Position pos(r, c);
-                const ChessPiece* piece = board.getPiece(pos);
-                if (piece) {
-                    try {
-                        score += evaluatePiece(piece, pos, board);
-                    } catch (const std::exception& e) {
-                        // Log the error but continue
-                        MPChessServer* server = MPChessServer::getInstance();
-                        if (server && server->getLogger()) {
-                            server->getLogger()->error("evaluatePosition() - Exception evaluating piece: " + std::string(e.what()));
-                        }
-                    }
-                }
-            }
-        }
-        
-        // Adjust score for check/checkmate
-        if (board.isInCheckmate(PieceColor::WHITE)) {
-            return -10000.0;  // Black wins
-        } else if (board.isInCheckmate(PieceColor::BLACK)) {
-            return 10000.0;   // White wins
-        } else if (board.isInCheck(PieceColor::WHITE)) {
-            score -= 50.0;    // White is in check
-        } else if (board.isInCheck(PieceColor::BLACK)) {
-            score += 50.0;    // Black is in check
-        }
-        
-        // Adjust for stalemate
-        if (board.isInStalemate(PieceColor::WHITE) || board.isInStalemate(PieceColor::BLACK)) {
-            return 0.0;  // Draw
-        }
-        
-        // Mobility (number of legal moves)
-        std::vector<ChessMove> whiteMoves = board.getAllValidMoves(PieceColor::WHITE);
-        std::vector<ChessMove> blackMoves = board.getAllValidMoves(PieceColor::BLACK);
-        score += 0.1 * (whiteMoves.size() - blackMoves.size());
-    } catch (const std::exception& e) {
-        // Log the error but return a default score
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->error("evaluatePosition() - Exception: " + std::string(e.what()));
-        }
-        return 0.0;
-    } catch (...) {
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->error("evaluatePosition() - Unknown exception");
-        }
-        return 0.0;
+    uint64_t moveBits = move.getPacked();  // 0 for no move
+    
+    return static_cast<uint64_t>(scoreBits) |
+           (moveBits << 32) |
+           (static_cast<uint64_t>(std::min(std::max(depth, 0), 255)) << 48) |
+           (static_cast<uint64_t>(generation & 0x3F) << 56) |
+           (static_cast<uint64_t>(bound) << 62);
+}
+
+void TranspositionTable::unpackEntry(uint64_t data, Entry& entry) {
+    uint32_t scoreBits = static_cast<uint32_t>(data & 0xFFFFFFFFULL);
+    float scoreAsFloat;
+    std::memcpy(&scoreAsFloat, &scoreBits, sizeof(scoreAsFloat));
+    entry.score = scoreAsFloat;
+    
+    entry.bestMove = ChessMove::fromPacked(static_cast<uint16_t>((data >> 32) & 0xFFFF));
+    
+    entry.depth = static_cast<int>((data >> 48) & 0xFF);
+    entry.bound = static_cast<Bound>((data >> 62) & 0x03);
+}
+
+// Implementation of OpeningBook class
+OpeningBook::OpeningBook(const std::string& path)
+    : file(QString::fromStdString(path)), mapped(nullptr), entries(nullptr), count(0)
+{
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
     }
     
-    // Adjust score based on the perspective
-    return color == PieceColor::WHITE ? score : -score;
+    // Map the file rather than copying it; fall back to reading where mapping fails
+    qint64 size = file.size() - file.size() % ENTRY_SIZE;
+    mapped = size > 0 ? file.map(0, size) : nullptr;
+    const uchar* data = mapped;
+    if (!data && size > 0) {
+        copy = file.read(size);
+        data = reinterpret_cast<const uchar*>(copy.constData());
+        size = copy.size() - copy.size() % ENTRY_SIZE;
+    }
+    
+    // Keys only match books this server wrote, so anything else, Polyglot books included, is refused
+    if (!data || size < ENTRY_SIZE || qFromBigEndian<quint32>(data) != BOOK_MAGIC ||
+        qFromBigEndian<quint32>(data + 4) != BOOK_VERSION) {
+        return;
+    }
+    entries = data + ENTRY_SIZE;
+    count = static_cast<size_t>(size / ENTRY_SIZE) - 1;
 }
 
-double ChessAI::quickEvaluateMove(const ChessBoard& board, const ChessMove& move, PieceColor color) const
+OpeningBook::~OpeningBook()
 {
-    MPChessServer* server = MPChessServer::getInstance();
-    double score = 0.0;
+    if (mapped) {
+        file.unmap(const_cast<uchar*>(mapped));
+    }
+}
+
+bool OpeningBook::isOpen() const
+{
+    return count > 0;
+}
+
+size_t OpeningBook::size() const
+{
+    return count;
+}
+
+uint64_t OpeningBook::keyAt(size_t index) const
+{
+    return qFromBigEndian<quint64>(entries + index * ENTRY_SIZE);
+}
+
+std::vector<std::pair<ChessMove, int>> OpeningBook::lookup(const ChessBoard& board) const
+{
+    std::vector<std::pair<ChessMove, int>> moves;
+    if (count == 0) {
+        return moves;
+    }
     
-    try {
-        const Position& from = move.getFrom();
-        const Position& to = move.getTo();
-        
-        // Get the moving piece
-        const ChessPiece* piece = board.getPiece(from);
-        if (!piece) return 0.0;
-        
-        // 1. Material value of captured piece
-        const ChessPiece* capturedPiece = board.getPiece(to);
-        if (capturedPiece) {
-            switch (capturedPiece->getType()) {
-                case PieceType::PAWN:   score += 1.0; break;
-                case PieceType::KNIGHT: score += 3.0; break;
-                case PieceType::BISHOP: score += 3.25; break;
-                case PieceType::ROOK:   score += 5.0; break;
-                case PieceType::QUEEN:  score += 9.0; break;
-                default: break;
-            }
-        }
-        
-        // 2. Pawn promotion value
-        if (piece->getType() == PieceType::PAWN) {
-            if ((color == PieceColor::WHITE && to.row == 7) || 
-                (color == PieceColor::BLACK && to.row == 0)) {
-                score += 9.0; // Value of a queen
-            }
-        }
-        
-        // 3. Center control bonus
-        if ((to.row >= 3 && to.row <= 4) && (to.col >= 3 && to.col <= 4)) {
-            score += 0.3;
-        }
-        
-        // 4. Development bonus in opening
-        if (board.getMoveHistory().size() < 10) {
-            if (piece->getType() == PieceType::KNIGHT || piece->getType() == PieceType::BISHOP) {
-                score += 0.2;
-            }
+    // Binary search for the first entry of the position
+    uint64_t key = board.getZobristKey();
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (keyAt(mid) < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
-        
-        // 5. King safety in opening/middlegame
-        if (piece->getType() == PieceType::KING && board.getMoveHistory().size() < 20) {
-            // Penalize early king movement
-            score -= 0.5;
+    }
+    
+    // Book moves are checked against the legal ones, so a stray key collision is harmless
+    std::vector<ChessMove> legalMoves;
+    for (size_t i = low; i < count && keyAt(i) == key; ++i) {
+        const uchar* entry = entries + i * ENTRY_SIZE;
+        int weight = qFromBigEndian<quint16>(entry + 10);
+        if (weight == 0) {
+            continue;
         }
         
-        // 6. Castling bonus
-        if (piece->getType() == PieceType::KING && !piece->hasMoved()) {
-            if (std::abs(to.col - from.col) == 2) {
-                score += 1.0; // Bonus for castling
-            }
+        if (legalMoves.empty()) {
+            legalMoves = board.getAllValidMoves(board.getCurrentTurn());
         }
-        
-        // 7. Pawn advancement
-        if (piece->getType() == PieceType::PAWN) {
-            if (color == PieceColor::WHITE) {
-                score += 0.05 * to.row; // Bonus for advancing white pawns
-            } else {
-                score += 0.05 * (7 - to.row); // Bonus for advancing black pawns
+        ChessMove move = decodeMove(board, qFromBigEndian<quint16>(entry + 8));
+        for (const ChessMove& legal : legalMoves) {
+            if (legal.getFrom() == move.getFrom() && legal.getTo() == move.getTo() &&
+                legal.getPromotionType() == move.getPromotionType()) {
+                moves.emplace_back(legal, weight);
+                break;
             }
         }
-        
-        // 8. Mobility (simplified)
-        // Just count the number of squares the piece can move to from the destination
-        auto tempBoard = board.clone();
-        tempBoard->movePiece(move, true); // Just validate, don't actually move
-        
-        const ChessPiece* movedPiece = tempBoard->getPiece(to);
-        if (movedPiece) {
-            std::vector<Position> possibleMoves = movedPiece->getPossibleMoves(to, *tempBoard);
-            score += 0.05 * possibleMoves.size();
-        }
-        
-        if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessAI::quickEvaluateMove() - Move " + move.toAlgebraic() + 
-                                      " evaluated to " + std::to_string(score));
-        }
-        
-        return score;
-    } catch (const std::exception& e) {
-        if (server && server->getLogger()) {
-            server->getLogger()->error("ChessAI::quickEvaluateMove() - Exception: " + std::string(e.what()));
-        }
-        return 0.0;
-    } catch (...) {
-        if (server && server->getLogger()) {
-            server->getLogger()->error("ChessAI::quickEvaluateMove() - Unknown exception");
-        }
-        return 0.0;
     }
+    
+    std::stable_sort(moves.begin(), moves.end(),
+                     [](const auto& a, const auto& b) { return a.second > b.second; });
+    return moves;
 }
 
-/*
-std::vector<std::pair<ChessMove, double>> ChessAI::getMoveRecommendations(
-    const ChessBoard& board, PieceColor color, int maxRecommendations)
+ChessMove OpeningBook::pickMove(const ChessBoard& board) const
 {
-    std::vector<std::pair<ChessMove, double>> recommendations;
+    std::vector<std::pair<ChessMove, int>> moves = lookup(board);
     
-    try {
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessAI::getMoveRecommendations() - Generating recommendations for " + 
-                                      std::string(color == PieceColor::WHITE ? "white" : "black"));
-        }
-        
-        // Get all valid moves for the current color
-        std::vector<ChessMove> validMoves;
-        try {
-            validMoves = board.getAllValidMoves(color);
-            
-            if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessAI::getMoveRecommendations() - Found " + 
-                                          std::to_string(validMoves.size()) + " valid moves");
-            }
-        }
-        catch (const std::exception& e) {
-            if (server && server->getLogger()) {
-                server->getLogger()->error("ChessAI::getMoveRecommendations() - Exception getting valid moves: " + 
-                                         std::string(e.what()));
-            }
-            return recommendations;
+    int totalWeight = 0;
+    for (const auto& [move, weight] : moves) {
+        totalWeight += weight;
+    }
+    if (totalWeight == 0) {
+        return ChessMove();
+    }
+    
+    int pick = QRandomGenerator::global()->bounded(totalWeight);
+    for (const auto& [move, weight] : moves) {
+        if (pick < weight) {
+            return move;
         }
-        
-        // Use a simplified evaluation for each move
-        for (const ChessMove& move : validMoves) {
-            double score = 0.0;
-            
-            // Check if the move captures a piece
-            const Position& to = move.getTo();
-            const ChessPiece* capturedPiece = board.getPiece(to);
-            if (capturedPiece) {
-                // Add value for capturing pieces
-                switch (capturedPiece->getType()) {
-                    case PieceType::PAWN: score += 1.0; break;
-                    case PieceType::KNIGHT: score += 3.0; break;
-                    case PieceType::BISHOP: score += 3.25; break;
-                    case PieceType::ROOK: score += 5.0; break;
-                    case PieceType::QUEEN: score += 9.0; break;
-                    default: break;
-                }
-            }
-            
-            // Check if the move is a pawn promotion
-            if (move.getPromotionType() != PieceType::EMPTY) {
-                score += 8.0; // Heavily favor promotions
+        pick -= weight;
+    }
+    return moves.front().first;
+}
+
+bool OpeningBook::build(const std::string& path, GameHistoryStore& store, int maxPlies)
+{
+    // Weight of every (position, move) pair; the map keeps them in the order written
+    std::map<std::pair<uint64_t, quint16>, quint32> weights;
+    
+    store.forEachGame([&weights, maxPlies](const QJsonObject& gameJson) {
+        QString result = gameJson["result"].toString();
+        if (result == "in_progress") {
+            return true;
+        }
+        
+        ChessBoard board;
+        board.initialize();
+        ChessBoard::MoveUndo undo;
+        QJsonArray moves = gameJson["moveTimings"].toArray();
+        for (int ply = 0; ply < std::min(maxPlies, static_cast<int>(moves.size())); ++ply) {
+            ChessMove played = ChessMove::fromAlgebraic(moves[ply].toObject()["move"].toString().toStdString());
+            std::vector<ChessMove> legalMoves = board.getAllValidMoves(board.getCurrentTurn());
+            auto it = std::find_if(legalMoves.begin(), legalMoves.end(), [&played](const ChessMove& legal) {
+                return legal.getFrom() == played.getFrom() && legal.getTo() == played.getTo() &&
+                       legal.getPromotionType() == played.getPromotionType();
+            });
+            if (it == legalMoves.end()) {
+                break;
             }
+            ChessMove move = *it;
             
-            // Add positional score based on the destination square
-            const Position& from = move.getFrom();
-            const ChessPiece* piece = board.getPiece(from);
-            if (piece) {
-                // Center control bonus
-                if ((to.row >= 3 && to.row <= 4) && (to.col >= 3 && to.col <= 4)) {
-                    score += 0.5;
-                }
-                
-                // Pawn advancement bonus
-                if (piece->getType() == PieceType::PAWN) {
-                    if (color == PieceColor::WHITE) {
-                        score += 0.1 * to.row; // Bonus for advancing white pawns
-                    } else {
-                        score += 0.1 * (7 - to.row); // Bonus for advancing black pawns
-                    }
-                }
-                
-                // Development bonus for knights and bishops in opening
-                if ((piece->getType() == PieceType::KNIGHT || piece->getType() == PieceType::BISHOP) && 
-                    board.getMoveHistory().size() < 10) {
-                    score += 0.3;
-                }
-            }
+            bool whiteMoved = board.getCurrentTurn() == PieceColor::WHITE;
+            int score = (result == "draw") ? 1 :
+                        ((result == "white_win") == whiteMoved) ? 2 : 0;
+            weights[std::make_pair(board.getZobristKey(), encodeMove(board, move))] += score;
             
-            recommendations.emplace_back(move, score);
+            board.makeMove(move, undo);
         }
-        
-        // Sort by score (best moves first)
-        std::sort(recommendations.begin(), recommendations.end(),
-                 [](const auto& a, const auto& b) { return a.second > b.second; });
-        
-        // Limit the number of recommendations
-        if (recommendations.size() > maxRecommendations) {
-            recommendations.resize(maxRecommendations);
+        return true;
+    });
+    
+    // Scale the weights into 16 bits
+    quint32 maxWeight = 0;
+    for (const auto& [entry, weight] : weights) {
+        maxWeight = std::max(maxWeight, weight);
+    }
+    double scale = maxWeight > 0xFFFF ? 65535.0 / maxWeight : 1.0;
+    
+    // Header entry: magic and version, the rest zero
+    QByteArray data(ENTRY_SIZE, '\0');
+    data.reserve(static_cast<qsizetype>((weights.size() + 1) * ENTRY_SIZE));
+    qToBigEndian<quint32>(BOOK_MAGIC, data.data());
+    qToBigEndian<quint32>(BOOK_VERSION, data.data() + 4);
+    for (const auto& [entry, weight] : weights) {
+        quint16 scaled = static_cast<quint16>(std::lround(weight * scale));
+        if (scaled == 0) {
+            continue;
         }
         
-        if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessAI::getMoveRecommendations() - Generated " + 
-                                      std::to_string(recommendations.size()) + " recommendations");
-        }
-    } catch (const std::exception& e) {
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->error("ChessAI::getMoveRecommendations() - Exception: " + std::string(e.what()));
-        }
-    } catch (...) {
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->error("ChessAI::getMoveRecommendations() - Unknown exception");
-        }
+        uchar record[ENTRY_SIZE] = {};
+        qToBigEndian<quint64>(entry.first, record);
+        qToBigEndian<quint16>(entry.second, record + 8);
+        qToBigEndian<quint16>(scaled, record + 10);
+        data.append(reinterpret_cast<const char*>(record), ENTRY_SIZE);
     }
     
-    return recommendations;
+    QSaveFile out(QString::fromStdString(path));
+    if (!out.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    out.write(data);
+    return out.commit();
 }
-*/
 
-std::vector<std::pair<ChessMove, double>> ChessAI::getMoveRecommendations(
-    const ChessBoard& board, PieceColor color, int maxRecommendations)
+quint16 OpeningBook::encodeMove(const ChessBoard& board, const ChessMove& move)
 {
-    std::vector<std::pair<ChessMove, double>> recommendations;
-    
-    try {
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessAI::getMoveRecommendations() - Generating recommendations for " + 
-                                      std::string(color == PieceColor::WHITE ? "white" : "black"));
-        }
-        
-        // Get all valid moves for the current color
-        std::vector<ChessMove> validMoves;
-        try {
-            validMoves = board.getAllValidMoves(color);
-            
-            if (server && server->getLogger()) {
-                server->getLogger()->debug("ChessAI::getMoveRecommendations() - Found " + 
-                                          std::to_string(validMoves.size()) + " valid moves");
-            }
-        }
-        catch (const std::exception& e) {
-            if (server && server->getLogger()) {
-                server->getLogger()->error("ChessAI::getMoveRecommendations() - Exception getting valid moves: " + 
-                                         std::string(e.what()));
-            }
-            return recommendations;
-        }
-        
-        // Use quick evaluation for each move
-        for (const ChessMove& move : validMoves) {
-            double score = quickEvaluateMove(board, move, color);
-            recommendations.emplace_back(move, score);
-        }
-        
-        // Sort by score (best moves first)
-        std::sort(recommendations.begin(), recommendations.end(),
-                 [](const auto& a, const auto& b) { return a.second > b.second; });
-        
-        // Limit to requested number of recommendations
-        if (recommendations.size() > maxRecommendations) {
-            recommendations.resize(maxRecommendations);
-        }
-        
-        if (server && server->getLogger()) {
-            server->getLogger()->debug("ChessAI::getMoveRecommendations() - Returning " + 
-                                      std::to_string(recommendations.size()) + " recommendations");
-        }
-    } catch (const std::exception& e) {
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->error("ChessAI::getMoveRecommendations() - Exception: " + std::string(e.what()));
-        }
-    } catch (...) {
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->error("ChessAI::getMoveRecommendations() - Unknown exception");
-        }
-    }
+    Position from = move.getFrom();
+    Position to = move.getTo();
     
-    return recommendations;
-}
-
-double ChessAI::minimax(const ChessBoard& board, int depth, double alpha, double beta, 
-                       bool maximizingPlayer, PieceColor aiColor) {
-    if (depth == 0 || board.isGameOver()) {
-        return evaluatePosition(board, aiColor);
+    // Polyglot writes castling as the king moving onto its rook
+    if (board.isCastlingMove(move)) {
+        to.col = (to.col > from.col) ? 7 : 0;
     }
     
-    PieceColor currentColor = maximizingPlayer ? PieceColor::WHITE : PieceColor::BLACK;
-    std::vector<ChessMove> validMoves = board.getAllValidMoves(currentColor);
-    
-    if (validMoves.empty()) {
-        // No valid moves, but not checkmate or stalemate (should not happen)
-        return evaluatePosition(board, aiColor);
+    int promotion = 0;
+    switch (move.getPromotionType()) {
+        case PieceType::KNIGHT: promotion = 1; break;
+        case PieceType::BISHOP: promotion = 2; break;
+        case PieceType::ROOK: promotion = 3; break;
+        case PieceType::QUEEN: promotion = 4; break;
+        default: break;
     }
     
-    if (maximizingPlayer) {
-        double maxEval = -std::numeric_limits<double>::infinity();
-        for (const ChessMove& move : validMoves) {
-            auto tempBoard = board.clone();
-            tempBoard->movePiece(move);
-            double eval = minimax(*tempBoard, depth - 1, alpha, beta, false, aiColor);
-            maxEval = std::max(maxEval, eval);
-            alpha = std::max(alpha, eval);
-            if (beta <= alpha) {
-                break;  // Beta cutoff
-            }
-        }
-        return maxEval;
-    } else {
-        double minEval = std::numeric_limits<double>::infinity();
-        for (const ChessMove& move : validMoves) {
-            auto tempBoard = board.clone();
-            tempBoard->movePiece(move);
-            double eval = minimax(*tempBoard, depth - 1, alpha, beta, true, aiColor);
-            minEval = std::min(minEval, eval);
-            beta = std::min(beta, eval);
-            if (beta <= alpha) {
-                break;  // Alpha cutoff
-            }
-        }
-        return minEval;
-    }
-}
-
-int ChessAI::getSearchDepth() const {
-    // Adjust search depth based on skill level
-    switch (skillLevel) {
-        case 1: return 1;
-        case 2: return 1;
-        case 3: return 2;
-        case 4: return 2;
-        case 5: return 3;
-        case 6: return 3;
-        case 7: return 4;
-        case 8: return 4;
-        case 9: return 5;
-        case 10: return 5;
-        default: return 3;
-    }
+    return static_cast<quint16>(to.col | (to.row << 3) | (from.col << 6) | (from.row << 9) | (promotion << 12));
 }
 
-double ChessAI::evaluatePiece(const ChessPiece* piece, const Position& pos, const ChessBoard& board) const
+ChessMove OpeningBook::decodeMove(const ChessBoard& board, quint16 encoded)
 {
-    if (!piece) return 0.0;
+    Position to((encoded >> 3) & 7, encoded & 7);
+    Position from((encoded >> 9) & 7, (encoded >> 6) & 7);
     
-    double value = 0.0;
+    static const PieceType promotions[] = {
+        PieceType::EMPTY, PieceType::KNIGHT, PieceType::BISHOP, PieceType::ROOK, PieceType::QUEEN
+    };
+    int promotion = (encoded >> 12) & 7;
+    PieceType promotionType = promotion <= 4 ? promotions[promotion] : PieceType::EMPTY;
     
-    try {
-        // Base piece values
-        PieceType type;
-        try {
-            type = piece->getType();
-        } catch (const std::exception& e) {
-            // Use RTTI to determine piece type
-            if (dynamic_cast<const Pawn*>(piece)) {
-                type = PieceType::PAWN;
-            } else if (dynamic_cast<const Knight*>(piece)) {
-                type = PieceType::KNIGHT;
-            } else if (dynamic_cast<const Bishop*>(piece)) {
-                type = PieceType::BISHOP;
-            } else if (dynamic_cast<const Rook*>(piece)) {
-                type = PieceType::ROOK;
-            } else if (dynamic_cast<const Queen*>(piece)) {
-                type = PieceType::QUEEN;
-            } else if (dynamic_cast<const King*>(piece)) {
-                type = PieceType::KING;
-            } else {
-                type = PieceType::EMPTY;
-            }
-        }
-        
-        switch (type) {
-            case PieceType::PAWN:   value = 1.0; break;
-            case PieceType::KNIGHT: value = 3.0; break;
-            case PieceType::BISHOP: value = 3.25; break;
-            case PieceType::ROOK:   value = 5.0; break;
-            case PieceType::QUEEN:  value = 9.0; break;
-            case PieceType::KING:   value = 100.0; break;
-            case PieceType::EMPTY:  value = 0.0; break;
-            default: value = 0.0; break;
-        }
-        
-        // Adjust for position using piece-square tables
-        int row = pos.row;
-        int col = pos.col;
-        
-        // Flip the row for black pieces to use the same tables
-        PieceColor color;
-        try {
-            color = piece->getColor();
-        } catch (const std::exception& e) {
-            // Default to WHITE if we can't get the color
-            color = PieceColor::WHITE;
-        }
-        
-        if (color == PieceColor::BLACK) {
-            row = 7 - row;
-        }
-        
-        switch (type) {
-            case PieceType::PAWN:
-                value += pawnTable[row][col] * 0.1;
-                break;
-            case PieceType::KNIGHT:
-                value += knightTable[row][col] * 0.1;
-                break;
-            case PieceType::BISHOP:
-                value += bishopTable[row][col] * 0.1;
-                break;
-            case PieceType::ROOK:
-                value += rookTable[row][col] * 0.1;
-                break;
-            case PieceType::QUEEN:
-                value += queenTable[row][col] * 0.1;
-                break;
-            case PieceType::KING:
-                {
-                    // Use different tables for middle game and end game
-                    // Simple heuristic: if both sides have queens, it's middle game
-                    bool isEndGame = true;
-                    for (int r = 0; r < 8; ++r) {
-                        for (int c = 0; c < 8; ++c) {
-                            const ChessPiece* p = board.getPiece(Position(r, c));
-                            if (p && p->getType() == PieceType::QUEEN) {
-                                isEndGame = false;
-                                break;
-                            }
-                        }
-                        if (!isEndGame) break;
-                    }
-                    
-                    if (isEndGame) {
-                        value += kingEndGameTable[row][col] * 0.1;
-                    } else {
-                        value += kingMiddleGameTable[row][col] * 0.1;
-                    }
-                    break;
-                }
-            case PieceType::EMPTY:
-                value += 0.0;
-                break;
-        }
-    } catch (const std::exception& e) {
-        // Log the error but return a default value
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->error("evaluatePiece() - Exception: " + std::string(e.what()));
-        }
-        return 0.0;
-    } catch (...) {
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->getLogger()) {
-            server->getLogger()->error("evaluatePiece() - Unknown exception");
-        }
-        return 0.0;
+    // King takes own rook is castling; the board moves the king two squares
+    const ChessPiece* piece = board.getPiece(from);
+    const ChessPiece* target = board.getPiece(to);
+    if (piece && target && piece->getType() == PieceType::KING && target->getType() == PieceType::ROOK &&
+        piece->getColor() == target->getColor()) {
+        to.col = (to.col > from.col) ? 6 : 2;
     }
     
-    // Adjust sign based on color
-    return piece->getColor() == PieceColor::WHITE ? value : -value;
+    return ChessMove(from, to, promotionType);
 }
 
-// Implementation of ChessMatchmaker class
-ChessMatchmaker::ChessMatchmaker() {
-}
+// Implementation of EndgameTablebase class
+std::atomic<int> EndgameTablebase::largest(0);
 
-void ChessMatchmaker::addPlayer(ChessPlayer* player) {
-    // Check if player is already in the queue
-    if (std::find(playerQueue.begin(), playerQueue.end(), player) != playerQueue.end()) {
-        return;
-    }
+#ifdef MPCHESS_HAVE_SYZYGY
+// Bitboards in the form Fathom takes them; square 0 is a1 in both
+struct TablebasePosition {
+    uint64_t white, black, kings, queens, rooks, bishops, knights, pawns;
+    unsigned enPassant;
+    bool whiteToMove;
     
-    playerQueue.push_back(player);
-    queueTimes[player] = QDateTime::currentDateTime();
-}
-
-void ChessMatchmaker::removePlayer(ChessPlayer* player) {
-    auto it = std::find(playerQueue.begin(), playerQueue.end(), player);
-    if (it != playerQueue.end()) {
-        playerQueue.erase(it);
-        queueTimes.erase(player);
+    explicit TablebasePosition(const BitboardPosition& position) {
+        auto both = [&position](PieceType type) {
+            return position.pieces[BitboardPosition::pieceIndex(type, PieceColor::WHITE)] |
+                   position.pieces[BitboardPosition::pieceIndex(type, PieceColor::BLACK)];
+        };
+        white = position.occupancy[static_cast<int>(PieceColor::WHITE)];
+        black = position.occupancy[static_cast<int>(PieceColor::BLACK)];
+        kings = both(PieceType::KING);
+        queens = both(PieceType::QUEEN);
+        rooks = both(PieceType::ROOK);
+        bishops = both(PieceType::BISHOP);
+        knights = both(PieceType::KNIGHT);
+        pawns = both(PieceType::PAWN);
+        enPassant = position.enPassantSquare >= 0 ? static_cast<unsigned>(position.enPassantSquare) : 0;
+        whiteToMove = position.sideToMove == PieceColor::WHITE;
     }
-}
+};
+#endif
 
-std::vector<std::pair<ChessPlayer*, ChessPlayer*>> ChessMatchmaker::matchPlayers()
+bool EndgameTablebase::initialize(const std::string& path)
 {
-    std::vector<std::pair<ChessPlayer*, ChessPlayer*>> matches;
-    
-    // Make a copy of the queue to avoid modifying it while iterating
-    std::vector<ChessPlayer*> queue = playerQueue;
-    
-    // Track players that have been matched to avoid duplicates
-//  std::set<ChessPlayer*, std::less<ChessPlayer*>, std::allocator<ChessPlayer*>> matchedPlayers;
-    std::set<ChessPlayer*> matchedPlayers;
-    
-    for (size_t i = 0; i < queue.size(); ++i) {
-        ChessPlayer* player = queue[i];
-        
-        // Skip if player is null
-        if (!player) continue;
-        
-        // Skip if player has already been matched
-        if (matchedPlayers.find(player) != matchedPlayers.end()) {
-            continue;
-        }
-
-        // Skip if player is already in a game
-        MPChessServer* server = MPChessServer::getInstance();
-        if (server && server->isPlayerInGame(player)) {
-            continue;
-        }
-        
-        ChessPlayer* bestMatch = findBestMatch(player);
-        if (bestMatch && matchedPlayers.find(bestMatch) == matchedPlayers.end() && 
-            !(server && server->isPlayerInGame(bestMatch))) {
-            matches.emplace_back(player, bestMatch);
-            
-            // Mark both players as matched
-            matchedPlayers.insert(player);
-            matchedPlayers.insert(bestMatch);
-            
-            // Remove matched players from the queue
-            removePlayer(player);
-            removePlayer(bestMatch);
-        }
+#ifdef MPCHESS_HAVE_SYZYGY
+    if (!tb_init(path.c_str())) {
+        largest.store(0);
+        return false;
     }
-    
-    return matches;
+    largest.store(static_cast<int>(TB_LARGEST));
+    return TB_LARGEST > 0;
+#else
+    Q_UNUSED(path);
+    return false;
+#endif
 }
 
-std::vector<ChessPlayer*> ChessMatchmaker::checkTimeouts(int timeoutSeconds)
+int EndgameTablebase::maxPieces()
 {
-    std::vector<ChessPlayer*> timedOutPlayers;
-    QDateTime now = QDateTime::currentDateTime();
-    
-    for (auto it = queueTimes.begin(); it != queueTimes.end(); ) {
-        ChessPlayer* player = it->first;
-        QDateTime queueTime = it->second;
-        
-        if (queueTime.secsTo(now) > timeoutSeconds) {
-            timedOutPlayers.push_back(player);
-            it = queueTimes.erase(it);
-            
-            // Remove from playerQueue as well
-            auto queueIt = std::find(playerQueue.begin(), playerQueue.end(), player);
-            if (queueIt != playerQueue.end()) {
-                playerQueue.erase(queueIt);
-            }
-        } else {
-            ++it;
-        }
-    }
-    
-    return timedOutPlayers;
+    return largest.load(std::memory_order_relaxed);
 }
 
-int ChessMatchmaker::getQueueSize() const {
-    return static_cast<int>(playerQueue.size());
+bool EndgameTablebase::canProbe(const ChessBoard& board)
+{
+    const BitboardPosition& position = board.getBitboards();
+    int pieces = maxPieces();
+    return pieces > 0 && position.castlingRights == 0 &&
+           BitboardPosition::popCount(position.allOccupancy) <= pieces;
 }
 
-void ChessMatchmaker::clearQueue() {
-    playerQueue.clear();
-    queueTimes.clear();
+bool EndgameTablebase::probeWdl(const ChessBoard& board, Wdl& result)
+{
+#ifdef MPCHESS_HAVE_SYZYGY
+    if (!canProbe(board)) {
+        return false;
+    }
+    
+    // WDL tables assume a fresh fifty-move count, as they do in any search
+    TablebasePosition tb(board.getBitboards());
+    unsigned wdl = tb_probe_wdl(tb.white, tb.black, tb.kings, tb.queens, tb.rooks, tb.bishops,
+                                tb.knights, tb.pawns, 0, 0, tb.enPassant, tb.whiteToMove);
+    if (wdl == TB_RESULT_FAILED) {
+        return false;
+    }
+    result = static_cast<Wdl>(wdl);
+    return true;
+#else
+    Q_UNUSED(board);
+    Q_UNUSED(result);
+    return false;
+#endif
 }
 
-ChessPlayer* ChessMatchmaker::findBestMatch(ChessPlayer* player) const
+bool EndgameTablebase::probeRoot(const ChessBoard& board, ChessMove& move, Wdl& result)
 {
-    if (!player) return nullptr;
+#ifdef MPCHESS_HAVE_SYZYGY
+    if (!canProbe(board)) {
+        return false;
+    }
     
-    ChessPlayer* bestMatch = nullptr;
-    double bestScore = std::numeric_limits<double>::infinity();
-    QDateTime now = QDateTime::currentDateTime();
+    TablebasePosition tb(board.getBitboards());
+    unsigned probe;
+    {
+        // Fathom's root probe is not thread-safe, unlike tb_probe_wdl(), and bot
+        // searches on several scheduler threads can reach it at once
+        static std::mutex rootProbeMutex;
+        std::lock_guard<std::mutex> lock(rootProbeMutex);
+        probe = tb_probe_root(tb.white, tb.black, tb.kings, tb.queens, tb.rooks, tb.bishops,
+                              tb.knights, tb.pawns, static_cast<unsigned>(board.getHalfMoveClock()),
+                              0, tb.enPassant, tb.whiteToMove, nullptr);
+    }
+    if (probe == TB_RESULT_FAILED || probe == TB_RESULT_CHECKMATE || probe == TB_RESULT_STALEMATE) {
+        return false;
+    }
     
-    for (ChessPlayer* candidate : playerQueue) {
-        if (!candidate || candidate == player) continue;
-        
-        // Calculate rating difference score
-        double score = getRatingDifferenceScore(player->getRating(), candidate->getRating());
-        
-        // Consider waiting time as well
-        auto it = queueTimes.find(candidate);
-        if (it != queueTimes.end()) {
-            int waitTime = it->second.secsTo(now);
-            score -= waitTime * 0.1;  // Reduce score for players waiting longer
-        }
-        
-        if (score < bestScore) {
-            bestScore = score;
-            bestMatch = candidate;
+    static const PieceType promotions[] = {
+        PieceType::EMPTY, PieceType::QUEEN, PieceType::ROOK, PieceType::BISHOP, PieceType::KNIGHT
+    };
+    Position from = BitboardPosition::toPosition(static_cast<int>(TB_GET_FROM(probe)));
+    Position to = BitboardPosition::toPosition(static_cast<int>(TB_GET_TO(probe)));
+    unsigned promotion = TB_GET_PROMOTES(probe);
+    PieceType promotionType = promotion <= 4 ? promotions[promotion] : PieceType::EMPTY;
+    
+    // Return the board's own move so castling and en passant flags are right
+    for (const ChessMove& legal : board.getAllValidMoves(board.getCurrentTurn())) {
+        if (legal.getFrom() == from && legal.getTo() == to && legal.getPromotionType() == promotionType) {
+            move = legal;
+            result = static_cast<Wdl>(TB_GET_WDL(probe));
+            return true;
         }
     }
-    
-    return bestMatch;
+    return false;
+#else
+    Q_UNUSED(board);
+    Q_UNUSED(move);
+    Q_UNUSED(result);
+    return false;
+#endif
 }
 
-double ChessMatchmaker::getRatingDifferenceScore(int rating1, int rating2) const {
-    return std::abs(rating1 - rating2);
+double EndgameTablebase::score(Wdl result, int ply)
+{
+    switch (result) {
+        case Wdl::WIN: return WIN_SCORE - ply;
+        case Wdl::LOSS: return -WIN_SCORE + ply;
+        case Wdl::CURSED_WIN: return 1.0;
+        case Wdl::BLESSED_LOSS: return -1.0;
+        default: return 0.0;
+    }
 }
 
-// Implementation of ChessRatingSystem class
-ChessRatingSystem::ChessRatingSystem() {
-}
+// Implementation of ChessAI class
+// Define the piece-square tables
+const std::array<std::array<double, 8>, 8> ChessAI::pawnTable = {{
+    {{ 0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0 }},
+    {{ 5.0,  5.0,  5.0,  5.0,  5.0,  5.0,  5.0,  5.0 }},
+    {{ 1.0,  1.0,  2.0,  3.0,  3.0,  2.0,  1.0,  1.0 }},
+    {{ 0.5,  0.5,  1.0,  2.5,  2.5,  1.0,  0.5,  0.5 }},
+    {{ 0.0,  0.0,  0.0,  2.0,  2.0,  0.0,  0.0,  0.0 }},
+    {{ 0.5, -0.5, -1.0,  0.0,  0.0, -1.0, -0.5,  0.5 }},
+    {{ 0.5,  1.0,  1.0, -2.0, -2.0,  1.0,  1.0,  0.5 }},
+    {{ 0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0 }}
+}};
 
-std::pair<int, int> ChessRatingSystem::calculateNewRatings(int rating1, int rating2, GameResult result) {
-    double score1, score2;
-    
-    switch (result) {
-        case GameResult::WHITE_WIN:
-            score1 = 1.0;
-            score2 = 0.0;
-            break;
-        case GameResult::BLACK_WIN:
-            score1 = 0.0;
-            score2 = 1.0;
-            break;
-        case GameResult::DRAW:
-            score1 = 0.5;
-            score2 = 0.5;
-            break;
-        default:
-            // Game in progress, no rating change
-            return {rating1, rating2};
-    }
-    
-    double expected1 = calculateExpectedScore(rating1, rating2);
-    double expected2 = calculateExpectedScore(rating2, rating1);
-    
-    int k1 = getKFactor(rating1, 0);  // Assuming we don't track games played here
-    int k2 = getKFactor(rating2, 0);
-    
-    int newRating1 = static_cast<int>(rating1 + k1 * (score1 - expected1));
-    int newRating2 = static_cast<int>(rating2 + k2 * (score2 - expected2));
-    
-    return {newRating1, newRating2};
-}
+const std::array<std::array<double, 8>, 8> ChessAI::knightTable = {{
+    {{-5.0, -4.0, -3.0, -3.0, -3.0, -3.0, -4.0, -5.0 }},
+    {{-4.0, -2.0,  0.0,  0.0,  0.0,  0.0, -2.0, -4.0 }},
+    {{-3.0,  0.0,  1.0,  1.5,  1.5,  1.0,  0.0, -3.0 }},
+    {{-3.0,  0.5,  1.5,  2.0,  2.0,  1.5,  0.5, -3.0 }},
+    {{-3.0,  0.0,  1.5,  2.0,  2.0,  1.5,  0.0, -3.0 }},
+    {{-3.0,  0.5,  1.0,  1.5,  1.5,  1.0,  0.5, -3.0 }},
+    {{-4.0, -2.0,  0.0,  0.5,  0.5,  0.0, -2.0, -4.0 }},
+    {{-5.0, -4.0, -3.0, -3.0, -3.0, -3.0, -4.0, -5.0 }}
+}};
 
-double ChessRatingSystem::calculateExpectedScore(int rating1, int rating2) const {
-    return 1.0 / (1.0 + std::pow(10.0, (rating2 - rating1) / 400.0));
-}
+const std::array<std::array<double, 8>, 8> ChessAI::bishopTable = {{
+    {{-2.0, -1.0, -1.0, -1.0, -1.0, -1.0, -1.0, -2.0 }},
+    {{-1.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -1.0 }},
+    {{-1.0,  0.0,  0.5,  1.0,  1.0,  0.5,  0.0, -1.0 }},
+    {{-1.0,  0.5,  0.5,  1.0,  1.0,  0.5,  0.5, -1.0 }},
+    {{-1.0,  0.0,  1.0,  1.0,  1.0,  1.0,  0.0, -1.0 }},
+    {{-1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0, -1.0 }},
+    {{-1.0,  0.5,  0.0,  0.0,  0.0,  0.0,  0.5, -1.0 }},
+    {{-2.0, -1.0, -1.0, -1.0, -1.0, -1.0, -1.0, -2.0 }}
+}};
 
-int ChessRatingSystem::getKFactor(int rating, int gamesPlayed) const {
-    if (rating >= MASTER_RATING_THRESHOLD) {
-        return MASTER_K_FACTOR;
-    } else if (gamesPlayed >= GAMES_THRESHOLD) {
-        return EXPERIENCED_K_FACTOR;
-    } else {
-        return DEFAULT_K_FACTOR;
-    }
+const std::array<std::array<double, 8>, 8> ChessAI::rookTable = {{
+    {{ 0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0 }},
+    {{ 0.5,  1.0,  1.0,  1.0,  1.0,  1.0,  1.0,  0.5 }},
+    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
+    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
+    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
+    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
+    {{-0.5,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -0.5 }},
+    {{ 0.0,  0.0,  0.0,  0.5,  0.5,  0.0,  0.0,  0.0 }}
+}};
+
+const std::array<std::array<double, 8>, 8> ChessAI::queenTable = {{
+    {{-2.0, -1.0, -1.0, -0.5, -0.5, -1.0, -1.0, -2.0 }},
+    {{-1.0,  0.0,  0.0,  0.0,  0.0,  0.0,  0.0, -1.0 }},
+    {{-1.0,  0.0,  0.5,  0.5,  0.5,  0.5,  0.0, -1.0 }},
+    {{-0.5,  0.0,  0.5,  0.5,  0.5,  0.5,  0.0, -0.5 }},
+    {{ 0.0,  0.0,  0.5,  0.5,  0.5,  0.5,  0.0, -0.5 }},
+    {{-1.0,  0.5,  0.5,  0.5,  0.5,  0.5,  0.0, -1.0 }},
+    {{-1.0,  0.0,  0.5,  0.0,  0.0,  0.0,  0.0, -1.0 }},
+    {{-2.0, -1.0, -1.0, -0.5, -0.5, -1.0, -1.0, -2.0 }}
+}};
+
+const std::array<std::array<double, 8>, 8> ChessAI::kingMiddleGameTable = {{
+    {{-3.0, -4.0, -4.0, -5.0, -5.0, -4.0, -4.0, -3.0 }},
+    {{-3.0, -4.0, -4.0, -5.0, -5.0, -4.0, -4.0, -3.0 }},
+    {{-3.0, -4.0, -4.0, -5.0, -5.0, -4.0, -4.0, -3.0 }},
+    {{-3.0, -4.0, -4.0, -5.0, -5.0, -4.0, -4.0, -3.0 }},
+    {{-2.0, -3.0, -3.0, -4.0, -4.0, -3.0, -3.0, -2.0 }},
+    {{-1.0, -2.0, -2.0, -2.0, -2.0, -2.0, -2.0, -1.0 }},
+    {{ 2.0,  2.0,  0.0,  0.0,  0.0,  0.0,  2.0,  2.0 }},
+    {{ 2.0,  3.0,  1.0,  0.0,  0.0,  1.0,  3.0,  2.0 }}
+}};
+
+const std::array<std::array<double, 8>, 8> ChessAI::kingEndGameTable = {{
+    {{-5.0, -4.0, -3.0, -2.0, -2.0, -3.0, -4.0, -5.0 }},
+    {{-3.0, -2.0, -1.0,  0.0,  0.0, -1.0, -2.0, -3.0 }},
+    {{-3.0, -1.0,  2.0,  3.0,  3.0,  2.0, -1.0, -3.0 }},
+    {{-3.0, -1.0,  3.0,  4.0,  4.0,  3.0, -1.0, -3.0 }},
+    {{-3.0, -1.0,  3.0,  4.0,  4.0,  3.0, -1.0, -3.0 }},
+    {{-3.0, -1.0,  2.0,  3.0,  3.0,  2.0, -1.0, -3.0 }},
+    {{-3.0, -3.0,  0.0,  0.0,  0.0,  0.0, -3.0, -3.0 }},
+    {{-5.0, -3.0, -3.0, -3.0, -3.0, -3.0, -3.0, -5.0 }}
+}};
+
+const std::array<std::array<BitboardPosition::PieceSquareScore, 64>, 12> BitboardPosition::PIECE_SQUARE_SCORES =
+    ChessAI::buildPieceSquareScores();
+
+std::atomic<int> ChessAI::defaultSearchThreads(1);
+std::shared_ptr<OpeningBook> ChessAI::openingBook;
+
+ChessAI::ChessAI(int skillLevel) : skillLevel(std::min(std::max(skillLevel, 1), 10)), 
+                                   searchThreads(defaultSearchThreads.load()) {
 }
 
-// Implementation of ChessAnalysisEngine class
-ChessAnalysisEngine::ChessAnalysisEngine() : analysisAI(10) {
+void ChessAI::setOpeningBook(std::shared_ptr<OpeningBook> book)
+{
+    std::atomic_store(&openingBook, std::move(book));
 }
 
-QJsonObject ChessAnalysisEngine::analyzeGame(const ChessGame& game) {
-    QJsonObject analysis;
+std::shared_ptr<OpeningBook> ChessAI::getOpeningBook()
+{
+    return std::atomic_load(&openingBook);
+}
 
-    // If Stockfish is available, use it for analysis
-    MPChessServer* server = MPChessServer::getInstance();
-    if (server && server->stockfishConnector && server->stockfishConnector->isInitialized()) {
-        return server->stockfishConnector->analyzeGame(game);
+std::vector<std::pair<ChessMove, double>> ChessAI::getBookRecommendations(
+    const ChessBoard& board, PieceColor color, int maxRecommendations)
+{
+    std::vector<std::pair<ChessMove, double>> recommendations;
+    std::shared_ptr<OpeningBook> book = getOpeningBook();
+    if (!book || !book->isOpen() || board.getCurrentTurn() != color) {
+        return recommendations;
     }
-
-    // Otherwise, use our built-in analysis    
-    // Game overview
-    analysis["gameId"] = QString::fromStdString(game.getGameId());
-    analysis["whitePlayer"] = QString::fromStdString(game.getWhitePlayer()->getUsername());
-    analysis["blackPlayer"] = QString::fromStdString(game.getBlackPlayer()->getUsername());
-    analysis["result"] = [&game]() -> QString {
-        switch (game.getResult()) {
-            case GameResult::WHITE_WIN: return "white_win";
-            case GameResult::BLACK_WIN: return "black_win";
-            case GameResult::DRAW: return "draw";
-            default: return "in_progress";
+    
+    // Keep the book's order, most played first
+    for (const auto& [move, weight] : book->lookup(board)) {
+        if (static_cast<int>(recommendations.size()) >= maxRecommendations) {
+            break;
         }
-    }();
+        recommendations.emplace_back(move, quickEvaluateMove(board, move, color));
+    }
+    return recommendations;
+}
+
+ChessMove ChessAI::getBestMove(const ChessBoard& board, PieceColor color, qint64 timeBudgetMs)
+{
+    lastSearch = SearchInfo();
     
-    // Analyze each move
-    QJsonArray moveAnalysis;
-    const ChessBoard* board = game.getBoard();
-    auto moveHistory = board->getMoveHistory();
+    // Play from the opening book while the position is in it
+    std::shared_ptr<OpeningBook> book = getOpeningBook();
+    if (book && book->isOpen() && board.getCurrentTurn() == color) {
+        ChessMove bookMove = book->pickMove(board);
+        if (bookMove.getFrom().isValid()) {
+            return bookMove;
+        }
+    }
     
-    // Create a temporary board to replay the game
-    auto tempBoard = std::make_unique<ChessBoard>();
+    // In a tablebase endgame play the move that converts fastest without a search
+    if (board.getCurrentTurn() == color) {
+        ChessMove tablebaseMove;
+        EndgameTablebase::Wdl wdl;
+        if (EndgameTablebase::probeRoot(board, tablebaseMove, wdl)) {
+            return tablebaseMove;
+        }
+    }
     
-    for (size_t i = 0; i < moveHistory.size(); ++i) {
-        const ChessMove& move = moveHistory[i];
-        
-        // Analyze the position before the move
-        double evalBefore = evaluatePositionDeeply(*tempBoard, tempBoard->getCurrentTurn());
-        
-        // Make the move
-        tempBoard->movePiece(move);
-        
-        // Analyze the position after the move
-        double evalAfter = evaluatePositionDeeply(*tempBoard, tempBoard->getCurrentTurn());
-        
-        // Calculate evaluation change
-        double evalChange = evalAfter - evalBefore;
-        
-        // Classify the move
-        std::string classification = classifyMove(evalBefore, evalAfter);
+    // If Stockfish is available and skill level is high enough, use it
+    MPChessServer* server = MPChessServer::getInstance();
+    if (server && server->enginePool && server->enginePool->isAvailable() && skillLevel >= 8) {
+        // Convert our 1-10 scale to Stockfish's 0-20
+        auto engineStart = std::chrono::steady_clock::now();
+        std::optional<ChessMove> engineMove = server->enginePool->getBestMove(board, skillLevel * 2, timeBudgetMs);
+        if (engineMove) {
+            return *engineMove;
+        }
+        MPCHESS_DEBUG(server->getLogger(), "ChessAI::getBestMove() - Engine search failed, using the built-in search");
         
-        // Create move analysis object
-        QJsonObject moveObj;
-        moveObj["moveNumber"] = static_cast<int>(i / 2) + 1;
-        moveObj["color"] = (i % 2 == 0) ? "white" : "black";
-        moveObj["move"] = QString::fromStdString(move.toAlgebraic());
-        moveObj["standardNotation"] = QString::fromStdString(move.toStandardNotation(*tempBoard));
-        moveObj["evaluationBefore"] = evalBefore;
-        moveObj["evaluationAfter"] = evalAfter;
-        moveObj["evaluationChange"] = evalChange;
-        moveObj["classification"] = QString::fromStdString(classification);
-        moveObj["isCapture"] = isCapture(*tempBoard, move);
-        moveObj["isCheck"] = putsInCheck(*tempBoard, move);
+        // The built-in search only has what the wait for the engine left of the budget
+        if (timeBudgetMs > 0) {
+            qint64 waitedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - engineStart).count();
+            timeBudgetMs = std::max<qint64>(timeBudgetMs - waitedMs, 1);
+        }
+    }
+    
+    // Otherwise, use our built-in AI
+    PerformanceMonitor::ScopedTimer timer("ChessAI::getBestMove");
+    std::vector<ChessMove> validMoves = board.getAllValidMoves(color);
+    if (validMoves.empty()) {
+        return ChessMove();  // No valid moves
+    }
+    
+    // Introduce randomness based on skill level
+    if (skillLevel < 10 && !validMoves.empty()) {
+        // Chance to make a random move decreases with skill level
+        double randomChance = 0.5 * (10 - skillLevel) / 10.0;
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_real_distribution<> dis(0.0, 1.0);
         
-        moveAnalysis.append(moveObj);
+        if (dis(gen) < randomChance) {
+            std::uniform_int_distribution<> moveIdx(0, validMoves.size() - 1);
+            return validMoves[moveIdx(gen)];
+        }
     }
     
-    analysis["moveAnalysis"] = moveAnalysis;
+    // Try the move remembered from an earlier search of this position first
+    TranspositionTable& table = searchTable();
+    table.newSearch();
+    TranspositionTable::Entry entry;
+    ChessMove hashMove;
+    if (table.probe(board.getZobristKey(), entry)) {
+        hashMove = entry.bestMove;
+    }
+    orderMoves(board, validMoves.data(), validMoves.size(), hashMove, nullptr);
+    
+    SearchContext context;
+    auto searchStart = std::chrono::steady_clock::now();
+    if (timeBudgetMs > 0) {
+        context.hasDeadline = true;
+        context.deadline = searchStart + std::chrono::milliseconds(timeBudgetMs);
+    }
+    int maxDepth = getSearchDepth();
+    
+    // Lazy SMP: helpers search the same root into the shared transposition table,
+    // staggered in depth and root order so they explore different parts of the tree
+    std::atomic<bool> stopHelpers(false);
+    std::atomic<uint64_t> helperNodes(0);
+    std::vector<QFuture<void>> helpers;
+    for (int i = 1; i < searchThreads; ++i) {
+        std::shared_ptr<ChessBoard> helperBoard(board.clone());
+        std::vector<ChessMove> helperMoves = validMoves;
+        std::rotate(helperMoves.begin(), helperMoves.begin() + (i % helperMoves.size()), helperMoves.end());
+        
+        helpers.push_back(QtConcurrent::run(getSearchThreadPool(),
+            [this, helperBoard, helperMoves, i, maxDepth, &context, &stopHelpers, &helperNodes]() {
+                SearchContext helperContext;
+                helperContext.hasDeadline = context.hasDeadline;
+                helperContext.deadline = context.deadline;
+                helperContext.stopFlag = &stopHelpers;
+                
+                ChessMove helperBestMove;
+                double helperBestValue = 0.0;
+                iterativeDeepening(*helperBoard, helperMoves, 1 + (i % 2), maxDepth, 
+                                  helperContext, helperBestMove, helperBestValue);
+                helperNodes += helperContext.nodes;
+            }));
+    }
     
-    // Add mistakes analysis
-    analysis["mistakes"] = identifyMistakes(game);
+    // Fall back to the best-ordered move if not even depth 1 completes in time
+    ChessMove bestMove = validMoves.front();
+    double bestValue = 0.0;
     
-    // Add critical moments
-    analysis["criticalMoments"] = identifyCriticalMoments(game);
+    // Search on a single copy of the board, making and unmaking moves in place
+    auto searchBoard = board.clone();
+    int completedDepth = iterativeDeepening(*searchBoard, validMoves, 1, maxDepth, context, bestMove, bestValue);
     
-    // Add game summary
-    analysis["summary"] = QString::fromStdString(generateGameSummary(game));
+    stopHelpers = true;
+    for (QFuture<void>& helper : helpers) {
+        helper.waitForFinished();
+    }
     
-    return analysis;
+    double searchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - searchStart).count();
+    ServerMetrics::searchSeconds.observe(searchSeconds);
+    ServerMetrics::searchNodes.fetch_add(context.nodes + helperNodes, std::memory_order_relaxed);
+    lastSearch.depth = completedDepth;
+    lastSearch.nodes = context.nodes + helperNodes;
+    lastSearch.seconds = searchSeconds;
+    lastSearch.score = bestValue;
+    
+    if (server && server->getLogger() && server->getLogger()->getLogLevel() >= 3) {
+        qint64 elapsed = static_cast<qint64>(searchSeconds * 1000.0);
+        MPCHESS_DEBUG(server->getLogger(), "ChessAI::getBestMove() - " + bestMove.toAlgebraic() + 
+                                  " depth " + std::to_string(completedDepth) + "/" + std::to_string(maxDepth) +
+                                  ", nodes " + std::to_string(context.nodes + helperNodes) + 
+                                  ", threads " + std::to_string(searchThreads) + 
+                                  ", score " + std::to_string(bestValue) + 
+                                  ", time " + std::to_string(elapsed) + "ms" +
+                                  (context.aborted ? " (time budget reached)" : ""));
+    }
+    
+    return bestMove;
 }
 
-QJsonObject ChessAnalysisEngine::analyzeMove(const ChessBoard& boardBefore, const ChessMove& move) {
-    QJsonObject analysis;
-
-    // If Stockfish is available, use it for analysis
-    MPChessServer* server = MPChessServer::getInstance();
-    if (server && server->stockfishConnector && server->stockfishConnector->isInitialized()) {
-        // Create a copy of the board and make the move
-        auto boardAfter = boardBefore.clone();
-        boardAfter->movePiece(move);
-        
-        // Analyze both positions
-        QJsonObject beforeAnalysis = server->stockfishConnector->analyzePosition(boardBefore);
-        QJsonObject afterAnalysis = server->stockfishConnector->analyzePosition(*boardAfter);
+int ChessAI::iterativeDeepening(ChessBoard& board, std::vector<ChessMove> rootMoves, int startDepth, int maxDepth,
+                               SearchContext& context, ChessMove& bestMove, double& bestValue)
+{
+    TranspositionTable& table = searchTable();
+    uint64_t rootKey = board.getZobristKey();
+    bool maximizing = board.getCurrentTurn() == PieceColor::WHITE;
+    ChessBoard::MoveUndo undo;
+    int completedDepth = 0;
+    
+    // Each completed iteration seeds the ordering of the next one
+    for (int depth = startDepth; depth <= maxDepth; ++depth) {
+        ChessMove iterationBestMove;
+        double iterationBestValue = maximizing ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity();
+        double alpha = -std::numeric_limits<double>::infinity();
+        double beta = std::numeric_limits<double>::infinity();
         
-        // Combine the analyses
-        analysis["move"] = QString::fromStdString(move.toAlgebraic());
-        analysis["standardNotation"] = QString::fromStdString(move.toStandardNotation(boardBefore));
-        analysis["evaluationBefore"] = beforeAnalysis["evaluation"];
-        analysis["evaluationAfter"] = afterAnalysis["evaluation"];
-        analysis["evaluationChange"] = afterAnalysis["evaluation"].toDouble() - beforeAnalysis["evaluation"].toDouble();
+        for (const ChessMove& move : rootMoves) {
+            board.makeMove(move, undo);
+            
+            // Evaluate the position after the move; scores are always from White's point of view
+            double value = minimax(board, depth - 1, 1, alpha, beta, !maximizing, PieceColor::WHITE, context);
+            
+            board.unmakeMove(undo);
+            
+            if (context.aborted) {
+                break;
+            }
+            
+            // Update the best move
+            if ((maximizing && value > iterationBestValue) || (!maximizing && value < iterationBestValue)) {
+                iterationBestValue = value;
+                iterationBestMove = move;
+            }
+            
+            if (maximizing) {
+                alpha = std::max(alpha, value);
+            } else {
+                beta = std::min(beta, value);
+            }
+        }
         
-        // Classify the move
-        double evalChange = analysis["evaluationChange"].toDouble();
-        if (evalChange > 2.0) analysis["classification"] = "Brilliant";
-        else if (evalChange > 1.0) analysis["classification"] = "Good";
-        else if (evalChange > 0.3) analysis["classification"] = "Accurate";
-        else if (evalChange > -0.3) analysis["classification"] = "Normal";
-        else if (evalChange > -1.0) analysis["classification"] = "Inaccuracy";
-        else if (evalChange > -2.0) analysis["classification"] = "Mistake";
-        else analysis["classification"] = "Blunder";
+        // Stopped early: keep the result of the last completed iteration
+        if (context.aborted || !iterationBestMove.getFrom().isValid()) {
+            break;
+        }
         
-        analysis["isCapture"] = isCapture(boardBefore, move);
-        analysis["isCheck"] = putsInCheck(*boardAfter, move);
-        analysis["alternatives"] = beforeAnalysis["bestMoves"];
+        bestMove = iterationBestMove;
+        bestValue = iterationBestValue;
+        completedDepth = depth;
+        table.store(rootKey, depth, bestValue, TranspositionTable::Bound::EXACT, bestMove);
         
-        return analysis;
+        // Search the current best move first in the next iteration
+        auto bestIt = std::find(rootMoves.begin(), rootMoves.end(), bestMove);
+        std::rotate(rootMoves.begin(), bestIt, bestIt + 1);
     }
-
-    // Otherwise, use our built-in analysis
-    // Create a copy of the board and make the move
-    auto boardAfter = boardBefore.clone();
-    boardAfter->movePiece(move);
     
-    // Evaluate positions
-    double evalBefore = evaluatePositionDeeply(boardBefore, boardBefore.getCurrentTurn());
-    double evalAfter = evaluatePositionDeeply(*boardAfter, boardAfter->getCurrentTurn());
+    return completedDepth;
+}
+
+qint64 ChessAI::computeMoveTimeBudget(qint64 remainingTimeMs, TimeControlType timeControl) {
+    // Spread the clock over the moves still expected, capped per time control
+    qint64 movesToGo = 30;
+    qint64 maxBudget = 5000;
     
-    // Calculate evaluation change
-    double evalChange = evalAfter - evalBefore;
-    
-    // Classify the move
-    std::string classification = classifyMove(evalBefore, evalAfter);
-    
-    // Get alternative moves
-    std::vector<std::pair<ChessMove, double>> alternatives = 
-        getMoveRecommendations(boardBefore, boardBefore.getCurrentTurn(), 3);
-    
-    // Create the analysis object
-    analysis["move"] = QString::fromStdString(move.toAlgebraic());
-    analysis["standardNotation"] = QString::fromStdString(move.toStandardNotation(boardBefore));
-    analysis["evaluationBefore"] = evalBefore;
-    analysis["evaluationAfter"] = evalAfter;
-    analysis["evaluationChange"] = evalChange;
-    analysis["classification"] = QString::fromStdString(classification);
-    analysis["isCapture"] = isCapture(boardBefore, move);
-    analysis["isCheck"] = putsInCheck(*boardAfter, move);
-    
-    // Add alternative moves
-    QJsonArray alternativesArray;
-    for (const auto& [altMove, altEval] : alternatives) {
-        if (altMove == move) continue;  // Skip the actual move
-        
-        QJsonObject altObj;
-        altObj["move"] = QString::fromStdString(altMove.toAlgebraic());
-        altObj["standardNotation"] = QString::fromStdString(altMove.toStandardNotation(boardBefore));
-        altObj["evaluation"] = altEval;
-        alternativesArray.append(altObj);
+    switch (timeControl) {
+        case TimeControlType::BULLET:
+            movesToGo = 40;
+            maxBudget = 1000;
+            break;
+        case TimeControlType::BLITZ:
+            movesToGo = 35;
+            maxBudget = 3000;
+            break;
+        case TimeControlType::RAPID:
+            movesToGo = 30;
+            maxBudget = 5000;
+            break;
+        case TimeControlType::CLASSICAL:
+            movesToGo = 30;
+            maxBudget = 15000;
+            break;
+        case TimeControlType::CASUAL:
+            // Days per move; the clock is not a constraint
+            return 5000;
     }
-    analysis["alternatives"] = alternativesArray;
     
-    return analysis;
+    qint64 budget = std::min(remainingTimeMs / movesToGo, maxBudget);
+    return std::max<qint64>(budget, 50);
 }
 
-std::vector<std::pair<ChessMove, double>> ChessAnalysisEngine::getMoveRecommendations(
-    const ChessBoard& board, PieceColor color, int maxRecommendations) {
+void ChessAI::setSkillLevel(int level) {
+    skillLevel = std::min(std::max(level, 1), 10);
+}
 
-    // If Stockfish is available, use it for recommendations
-    MPChessServer* server = MPChessServer::getInstance();
-    if (server && server->stockfishConnector && server->stockfishConnector->isInitialized()) {
-        server->stockfishConnector->setPosition(board);
-        return server->stockfishConnector->getMoveRecommendations(maxRecommendations);
-    }
+int ChessAI::getSkillLevel() const {
+    return skillLevel;
+}
 
-    // Otherwise, use our built-in AI
-    return analysisAI.getMoveRecommendations(board, color, maxRecommendations);
+void ChessAI::setSearchThreads(int threads) {
+    searchThreads = std::min(std::max(threads, 1), 64);
 }
 
-QJsonObject ChessAnalysisEngine::identifyMistakes(const ChessGame& game) {
-    QJsonObject mistakes;
-    
-    QJsonArray blunders;
-    QJsonArray errors;
-    QJsonArray inaccuracies;
-    
-    const ChessBoard* board = game.getBoard();
-    auto moveHistory = board->getMoveHistory();
-    
-    // Create a temporary board to replay the game
-    auto tempBoard = std::make_unique<ChessBoard>();
-    
-    for (size_t i = 0; i < moveHistory.size(); ++i) {
-        const ChessMove& move = moveHistory[i];
-        
-        // Analyze the position before the move
-        double evalBefore = evaluatePositionDeeply(*tempBoard, tempBoard->getCurrentTurn());
-        
-        // Make the move
-        tempBoard->movePiece(move);
-        
-        // Analyze the position after the move
-        double evalAfter = evaluatePositionDeeply(*tempBoard, tempBoard->getCurrentTurn());
-        
-        // Calculate evaluation change
-        double evalChange = evalAfter - evalBefore;
-        
-        // Determine if this is a mistake
-        QJsonObject mistakeObj;
-        mistakeObj["moveNumber"] = static_cast<int>(i / 2) + 1;
-        mistakeObj["color"] = (i % 2 == 0) ? "white" : "black";
-        mistakeObj["move"] = QString::fromStdString(move.toAlgebraic());
-        mistakeObj["standardNotation"] = QString::fromStdString(move.toStandardNotation(*tempBoard));
-        mistakeObj["evaluationBefore"] = evalBefore;
-        mistakeObj["evaluationAfter"] = evalAfter;
-        mistakeObj["evaluationChange"] = evalChange;
+int ChessAI::getSearchThreads() const {
+    return searchThreads;
+}
+
+void ChessAI::setDefaultSearchThreads(int threads) {
+    defaultSearchThreads = std::min(std::max(threads, 1), 64);
+}
+
+int ChessAI::getDefaultSearchThreads() {
+    return defaultSearchThreads.load();
+}
+
+TranspositionTable& ChessAI::getTranspositionTable() {
+    static TranspositionTable table;
+    return table;
+}
+
+void ChessAI::setTranspositionTable(std::shared_ptr<TranspositionTable> table) {
+    ownTable = std::move(table);
+}
+
+QThreadPool* ChessAI::getSearchThreadPool() {
+    static QThreadPool* pool = []() {
+        QThreadPool* searchPool = new QThreadPool();
+        searchPool->setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+        return searchPool;
+    }();
+    return pool;
+}
+
+double ChessAI::evaluatePosition(const ChessBoard& board, PieceColor color) const
+{
+    const BitboardPosition& position = board.getBitboards();
+    
+    // Checkmate and stalemate come from one legal move generation per side, which mobility reuses
+    MoveList whiteMoves;
+    MoveList blackMoves;
+    board.generateLegalMoves(PieceColor::WHITE, whiteMoves);
+    board.generateLegalMoves(PieceColor::BLACK, blackMoves);
+    
+    bool whiteHasKing = position.piecesOf(PieceType::KING, PieceColor::WHITE) != 0;
+    bool blackHasKing = position.piecesOf(PieceType::KING, PieceColor::BLACK) != 0;
+    bool whiteInCheck = board.isInCheck(PieceColor::WHITE);
+    bool blackInCheck = board.isInCheck(PieceColor::BLACK);
+    
+    double score;
+    if (whiteHasKing && whiteInCheck && whiteMoves.empty()) {
+        score = -10000.0;  // Black wins
+    } else if (blackHasKing && blackInCheck && blackMoves.empty()) {
+        score = 10000.0;   // White wins
+    } else if ((whiteHasKing && !whiteInCheck && whiteMoves.empty()) ||
+               (blackHasKing && !blackInCheck && blackMoves.empty())) {
+        return 0.0;        // Stalemate
+    } else {
+        // Material and piece-square terms are running totals kept by the board
+        score = position.taperedScore() / 100.0;
         
-        // Classify based on evaluation change
-        if (std::abs(evalChange) >= 2.0) {
-            blunders.append(mistakeObj);
-        } else if (std::abs(evalChange) >= 1.0) {
-            errors.append(mistakeObj);
-        } else if (std::abs(evalChange) >= 0.5) {
-            inaccuracies.append(mistakeObj);
+        // Adjust score for check
+        if (whiteInCheck) {
+            score -= 50.0;    // White is in check
+        } else if (blackInCheck) {
+            score += 50.0;    // Black is in check
         }
+        
+        // Mobility (number of legal moves)
+        score += 0.1 * (whiteMoves.size() - blackMoves.size());
     }
     
-    mistakes["blunders"] = blunders;
-    mistakes["errors"] = errors;
-    mistakes["inaccuracies"] = inaccuracies;
-    
-    return mistakes;
+    // Adjust score based on the perspective
+    return color == PieceColor::WHITE ? score : -score;
 }
 
-QJsonObject ChessAnalysisEngine::identifyCriticalMoments(const ChessGame& game) {
-    QJsonObject criticalMoments;
-    
-    QJsonArray openingMoments;
-    QJsonArray middleGameMoments;
-    QJsonArray endGameMoments;
-    
-    const ChessBoard* board = game.getBoard();
-    auto moveHistory = board->getMoveHistory();
-    
-    // Create a temporary board to replay the game
-    auto tempBoard = std::make_unique<ChessBoard>();
+double ChessAI::evaluateStatic(const ChessBoard& board, PieceColor color) const
+{
+    double score = board.getBitboards().taperedScore() / 100.0;
     
-    // Track the largest evaluation swings
-    double largestSwing = 0.0;
-    size_t largestSwingIndex = 0;
+    // Adjust score for check
+    if (board.isInCheck(PieceColor::WHITE)) {
+        score -= 50.0;    // White is in check
+    } else if (board.isInCheck(PieceColor::BLACK)) {
+        score += 50.0;    // Black is in check
+    }
     
-    // Track material count to identify game phases
-    int phase = 0;  // 0: opening, 1: middlegame, 2: endgame
+    return color == PieceColor::WHITE ? score : -score;
+}
+
+std::array<std::array<BitboardPosition::PieceSquareScore, 64>, 12> ChessAI::buildPieceSquareScores()
+{
+    static const int materialValues[] = { 100, 300, 325, 500, 900, 10000 };
+    const std::array<std::array<double, 8>, 8>* midgameTables[] = {
+        &pawnTable, &knightTable, &bishopTable, &rookTable, &queenTable, &kingMiddleGameTable
+    };
+    const std::array<std::array<double, 8>, 8>* endgameTables[] = {
+        &pawnTable, &knightTable, &bishopTable, &rookTable, &queenTable, &kingEndGameTable
+    };
+    
+    std::array<std::array<BitboardPosition::PieceSquareScore, 64>, 12> scores;
+    for (int color = 0; color < 2; ++color) {
+        for (int type = 0; type < 6; ++type) {
+            int index = BitboardPosition::pieceIndex(static_cast<PieceType>(type), static_cast<PieceColor>(color));
+            int sign = (static_cast<PieceColor>(color) == PieceColor::WHITE) ? 1 : -1;
+            for (int sq = 0; sq < 64; ++sq) {
+                // Black uses the same tables with the rows flipped
+                int row = sq / 8;
+                int col = sq % 8;
+                if (static_cast<PieceColor>(color) == PieceColor::BLACK) {
+                    row = 7 - row;
+                }
+                
+                // Table entries are tenths of a pawn
+                int midgame = materialValues[type] + static_cast<int>(std::lround((*midgameTables[type])[row][col] * 10.0));
+                int endgame = materialValues[type] + static_cast<int>(std::lround((*endgameTables[type])[row][col] * 10.0));
+                scores[index][sq] = { static_cast<int16_t>(sign * midgame), static_cast<int16_t>(sign * endgame) };
+            }
+        }
+    }
+    return scores;
+}
+
+double ChessAI::quickEvaluateMove(const ChessBoard& board, const ChessMove& move, PieceColor color) const
+{
+    MPChessServer* server = MPChessServer::getInstance();
+    double score = 0.0;
     
-    for (size_t i = 0; i < moveHistory.size(); ++i) {
-        const ChessMove& move = moveHistory[i];
+    try {
+        const Position& from = move.getFrom();
+        const Position& to = move.getTo();
         
-        // Analyze the position before the move
-        double evalBefore = evaluatePositionDeeply(*tempBoard, tempBoard->getCurrentTurn());
+        // Get the moving piece
+        const ChessPiece* piece = board.getPiece(from);
+        if (!piece) return 0.0;
         
-        // Make the move
-        tempBoard->movePiece(move);
+        // 1. Material value of captured piece
+        const ChessPiece* capturedPiece = board.getPiece(to);
+        if (capturedPiece) {
+            switch (capturedPiece->getType()) {
+                case PieceType::PAWN:   score += 1.0; break;
+                case PieceType::KNIGHT: score += 3.0; break;
+                case PieceType::BISHOP: score += 3.25; break;
+                case PieceType::ROOK:   score += 5.0; break;
+                case PieceType::QUEEN:  score += 9.0; break;
+                default: break;
+            }
+        }
         
-        // Analyze the position after the move
-        double evalAfter = evaluatePositionDeeply(*tempBoard, tempBoard->getCurrentTurn());
+        // 2. Pawn promotion value
+        if (piece->getType() == PieceType::PAWN) {
+            if ((color == PieceColor::WHITE && to.row == 7) || 
+                (color == PieceColor::BLACK && to.row == 0)) {
+                score += 9.0; // Value of a queen
+            }
+        }
         
-        // Calculate evaluation change
-        double evalChange = evalAfter - evalBefore;
+        // 3. Center control bonus
+        if ((to.row >= 3 && to.row <= 4) && (to.col >= 3 && to.col <= 4)) {
+            score += 0.3;
+        }
         
-        // Track largest swing
-        if (std::abs(evalChange) > std::abs(largestSwing)) {
-            largestSwing = evalChange;
-            largestSwingIndex = i;
+        // 4. Development bonus in opening
+        if (board.getMoveHistory().size() < 10) {
+            if (piece->getType() == PieceType::KNIGHT || piece->getType() == PieceType::BISHOP) {
+                score += 0.2;
+            }
         }
         
-        // Create moment object
-        QJsonObject momentObj;
-        momentObj["moveNumber"] = static_cast<int>(i / 2) + 1;
-        momentObj["color"] = (i % 2 == 0) ? "white" : "black";
-        momentObj["move"] = QString::fromStdString(move.toAlgebraic());
-        momentObj["standardNotation"] = QString::fromStdString(move.toStandardNotation(*tempBoard));
-        momentObj["evaluationBefore"] = evalBefore;
-        momentObj["evaluationAfter"] = evalAfter;
-        momentObj["evaluationChange"] = evalChange;
+        // 5. King safety in opening/middlegame
+        if (piece->getType() == PieceType::KING && board.getMoveHistory().size() < 20) {
+            // Penalize early king movement
+            score -= 0.5;
+        }
         
-        // Determine game phase based on move number and material
-        if (i < 10) {
-            phase = 0;  // Opening
-        } else {
-            // Count material to determine phase
-            int materialCount = 0;
-            for (int r = 0; r < 8; ++r) {
-                for (int c = 0; c < 8; ++c) {
-                    const ChessPiece* piece = tempBoard->getPiece(Position(r, c));
-                    if (piece && piece->getType() != PieceType::KING) {
-                        materialCount++;
-                    }
-                }
-            }
-            
-            if (materialCount <= 12) {
-                phase = 2;  // Endgame
-            } else {
-                phase = 1;  // Middlegame
+        // 6. Castling bonus
+        if (piece->getType() == PieceType::KING && !piece->hasMoved()) {
+            if (std::abs(to.col - from.col) == 2) {
+                score += 1.0; // Bonus for castling
             }
         }
         
-        // Add to the appropriate phase array
-        if (std::abs(evalChange) >= 0.5) {  // Only add significant moments
-            if (phase == 0) {
-                openingMoments.append(momentObj);
-            } else if (phase == 1) {
-                middleGameMoments.append(momentObj);
+        // 7. Pawn advancement
+        if (piece->getType() == PieceType::PAWN) {
+            if (color == PieceColor::WHITE) {
+                score += 0.05 * to.row; // Bonus for advancing white pawns
             } else {
-                endGameMoments.append(momentObj);
+                score += 0.05 * (7 - to.row); // Bonus for advancing black pawns
             }
         }
+        
+        // 8. Mobility (simplified)
+        // Just count the number of squares the piece can move to from the destination
+        auto tempBoard = board.clone();
+        tempBoard->movePiece(move, true); // Just validate, don't actually move
+        
+        const ChessPiece* movedPiece = tempBoard->getPiece(to);
+        if (movedPiece) {
+            std::vector<Position> possibleMoves = movedPiece->getPossibleMoves(to, *tempBoard);
+            score += 0.05 * possibleMoves.size();
+        }
+        
+        MPCHESS_TRACE("ChessAI::quickEvaluateMove() - Move " + move.toAlgebraic() + 
+                      " evaluated to " + std::to_string(score));
+        
+        return score;
+    } catch (const std::exception& e) {
+        if (server && server->getLogger()) {
+            server->getLogger()->error("ChessAI::quickEvaluateMove() - Exception: " + std::string(e.what()));
+        }
+        return 0.0;
+    } catch (...) {
+        if (server && server->getLogger()) {
+            server->getLogger()->error("ChessAI::quickEvaluateMove() - Unknown exception");
+        }
+        return 0.0;
+    }
+}
+
+/*
+std::vector<std::pair<ChessMove, double>> ChessAI::getMoveRecommendations(
+    const ChessBoard& board, PieceColor color, int maxRecommendations)
+{
+    std::vector<std::pair<ChessMove, double>> recommendations;
+    
+    try {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            MPCHESS_DEBUG(server->getLogger(), "ChessAI::getMoveRecommendations() - Generating recommendations for " + 
+                                      std::string(color == PieceColor::WHITE ? "white" : "black"));
+        }
+        
+        // Get all valid moves for the current color
+        std::vector<ChessMove> validMoves;
+        try {
+            validMoves = board.getAllValidMoves(color);
+            
+            if (server && server->getLogger()) {
+                MPCHESS_DEBUG(server->getLogger(), "ChessAI::getMoveRecommendations() - Found " + 
+                                          std::to_string(validMoves.size()) + " valid moves");
+            }
+        }
+        catch (const std::exception& e) {
+            if (server && server->getLogger()) {
+                server->getLogger()->error("ChessAI::getMoveRecommendations() - Exception getting valid moves: " + 
+                                         std::string(e.what()));
+            }
+            return recommendations;
+        }
+        
+        // Use a simplified evaluation for each move
+        for (const ChessMove& move : validMoves) {
+            double score = 0.0;
+            
+            // Check if the move captures a piece
+            const Position& to = move.getTo();
+            const ChessPiece* capturedPiece = board.getPiece(to);
+            if (capturedPiece) {
+                // Add value for capturing pieces
+                switch (capturedPiece->getType()) {
+                    case PieceType::PAWN: score += 1.0; break;
+                    case PieceType::KNIGHT: score += 3.0; break;
+                    case PieceType::BISHOP: score += 3.25; break;
+                    case PieceType::ROOK: score += 5.0; break;
+                    case PieceType::QUEEN: score += 9.0; break;
+                    default: break;
+                }
+            }
+            
+            // Check if the move is a pawn promotion
+            if (move.getPromotionType() != PieceType::EMPTY) {
+                score += 8.0; // Heavily favor promotions
+            }
+            
+            // Add positional score based on the destination square
+            const Position& from = move.getFrom();
+            const ChessPiece* piece = board.getPiece(from);
+            if (piece) {
+                // Center control bonus
+                if ((to.row >= 3 && to.row <= 4) && (to.col >= 3 && to.col <= 4)) {
+                    score += 0.5;
+                }
+                
+                // Pawn advancement bonus
+                if (piece->getType() == PieceType::PAWN) {
+                    if (color == PieceColor::WHITE) {
+                        score += 0.1 * to.row; // Bonus for advancing white pawns
+                    } else {
+                        score += 0.1 * (7 - to.row); // Bonus for advancing black pawns
+                    }
+                }
+                
+                // Development bonus for knights and bishops in opening
+                if ((piece->getType() == PieceType::KNIGHT || piece->getType() == PieceType::BISHOP) && 
+                    board.getMoveHistory().size() < 10) {
+                    score += 0.3;
+                }
+            }
+            
+            recommendations.emplace_back(move, score);
+        }
+        
+        // Sort by score (best moves first)
+        std::sort(recommendations.begin(), recommendations.end(),
+                 [](const auto& a, const auto& b) { return a.second > b.second; });
+        
+        // Limit the number of recommendations
+        if (recommendations.size() > maxRecommendations) {
+            recommendations.resize(maxRecommendations);
+        }
+        
+        if (server && server->getLogger()) {
+            MPCHESS_DEBUG(server->getLogger(), "ChessAI::getMoveRecommendations() - Generated " + 
+                                      std::to_string(recommendations.size()) + " recommendations");
+        }
+    } catch (const std::exception& e) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->error("ChessAI::getMoveRecommendations() - Exception: " + std::string(e.what()));
+        }
+    } catch (...) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->error("ChessAI::getMoveRecommendations() - Unknown exception");
+        }
+    }
+    
+    return recommendations;
+}
+*/
+
+std::vector<std::pair<ChessMove, double>> ChessAI::getMoveRecommendations(
+    const ChessBoard& board, PieceColor color, int maxRecommendations)
+{
+    std::vector<std::pair<ChessMove, double>> recommendations = getBookRecommendations(board, color, maxRecommendations);
+    if (!recommendations.empty()) {
+        return recommendations;
+    }
+    
+    try {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            MPCHESS_DEBUG(server->getLogger(), "ChessAI::getMoveRecommendations() - Generating recommendations for " + 
+                                      std::string(color == PieceColor::WHITE ? "white" : "black"));
+        }
+        
+        // Get all valid moves for the current color
+        std::vector<ChessMove> validMoves;
+        try {
+            validMoves = board.getAllValidMoves(color);
+            
+            if (server && server->getLogger()) {
+                MPCHESS_DEBUG(server->getLogger(), "ChessAI::getMoveRecommendations() - Found " + 
+                                          std::to_string(validMoves.size()) + " valid moves");
+            }
+        }
+        catch (const std::exception& e) {
+            if (server && server->getLogger()) {
+                server->getLogger()->error("ChessAI::getMoveRecommendations() - Exception getting valid moves: " + 
+                                         std::string(e.what()));
+            }
+            return recommendations;
+        }
+        
+        // Use quick evaluation for each move
+        for (const ChessMove& move : validMoves) {
+            double score = quickEvaluateMove(board, move, color);
+            recommendations.emplace_back(move, score);
+        }
+        
+        // Sort by score (best moves first)
+        std::sort(recommendations.begin(), recommendations.end(),
+                 [](const auto& a, const auto& b) { return a.second > b.second; });
+        
+        // Limit to requested number of recommendations
+        if (recommendations.size() > maxRecommendations) {
+            recommendations.resize(maxRecommendations);
+        }
+        
+        if (server && server->getLogger()) {
+            MPCHESS_DEBUG(server->getLogger(), "ChessAI::getMoveRecommendations() - Returning " + 
+                                      std::to_string(recommendations.size()) + " recommendations");
+        }
+    } catch (const std::exception& e) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->error("ChessAI::getMoveRecommendations() - Exception: " + std::string(e.what()));
+        }
+    } catch (...) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->error("ChessAI::getMoveRecommendations() - Unknown exception");
+        }
+    }
+    
+    return recommendations;
+}
+
+std::vector<std::pair<ChessMove, double>> ChessAI::searchMoveRecommendations(
+    const ChessBoard& board, PieceColor color, int maxRecommendations, int depth,
+    const std::atomic<bool>* stopFlag)
+{
+    PerformanceMonitor::ScopedTimer timer("ChessAI::searchMoveRecommendations");
+    std::vector<std::pair<ChessMove, double>> recommendations;
+    
+    try {
+        std::vector<ChessMove> validMoves = board.getAllValidMoves(color);
+        if (validMoves.empty()) {
+            return recommendations;
+        }
+        
+        TranspositionTable::Entry entry;
+        ChessMove hashMove;
+        if (searchTable().probe(board.getZobristKey(), entry)) {
+            hashMove = entry.bestMove;
+        }
+        orderMoves(board, validMoves.data(), validMoves.size(), hashMove, nullptr);
+        
+        // Root split: worker w scores moves w, w + workers, w + 2 * workers, ...
+        std::vector<double> scores(validMoves.size(), 0.0);
+        bool maximizing = color == PieceColor::WHITE;
+        int workers = std::max(1, std::min(searchThreads, static_cast<int>(validMoves.size())));
+        
+        auto scoreMoves = [this, &validMoves, &scores, workers, depth, maximizing, stopFlag](std::shared_ptr<ChessBoard> workerBoard, int worker) {
+            SearchContext context;
+            context.stopFlag = stopFlag;
+            ChessBoard::MoveUndo undo;
+            for (size_t i = worker; i < validMoves.size() && !context.aborted; i += workers) {
+                workerBoard->makeMove(validMoves[i], undo);
+                double value = minimax(*workerBoard, depth - 1, 1, 
+                                      -std::numeric_limits<double>::infinity(), 
+                                      std::numeric_limits<double>::infinity(), 
+                                      !maximizing, PieceColor::WHITE, context);
+                workerBoard->unmakeMove(undo);
+                
+                // Report scores from the moving side's point of view
+                scores[i] = maximizing ? value : -value;
+            }
+        };
+        
+        std::vector<QFuture<void>> helpers;
+        for (int worker = 1; worker < workers; ++worker) {
+            std::shared_ptr<ChessBoard> workerBoard(board.clone());
+            helpers.push_back(QtConcurrent::run(getSearchThreadPool(), scoreMoves, workerBoard, worker));
+        }
+        scoreMoves(std::shared_ptr<ChessBoard>(board.clone()), 0);
+        for (QFuture<void>& helper : helpers) {
+            helper.waitForFinished();
+        }
+        
+        // A stopped search leaves some moves unscored
+        if (stopFlag && stopFlag->load()) {
+            return recommendations;
+        }
+        
+        for (size_t i = 0; i < validMoves.size(); ++i) {
+            recommendations.emplace_back(validMoves[i], scores[i]);
+        }
+        
+        // Sort by score (best moves first)
+        std::stable_sort(recommendations.begin(), recommendations.end(),
+                        [](const auto& a, const auto& b) { return a.second > b.second; });
+        
+        // Limit to requested number of recommendations
+        if (recommendations.size() > static_cast<size_t>(maxRecommendations)) {
+            recommendations.resize(maxRecommendations);
+        }
+    } catch (const std::exception& e) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->error("ChessAI::searchMoveRecommendations() - Exception: " + std::string(e.what()));
+        }
+    } catch (...) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->error("ChessAI::searchMoveRecommendations() - Unknown exception");
+        }
+    }
+    
+    return recommendations;
+}
+
+double ChessAI::minimax(ChessBoard& board, int depth, int ply, double alpha, double beta, 
+                       bool maximizingPlayer, PieceColor aiColor, SearchContext& context) {
+    // Check the deadline every few nodes; an aborted search returns no usable score
+    ++context.nodes;
+    if ((context.nodes & 15) == 0 &&
+        ((context.stopFlag && context.stopFlag->load(std::memory_order_relaxed)) ||
+         (context.hasDeadline && std::chrono::steady_clock::now() >= context.deadline))) {
+        context.aborted = true;
+    }
+    if (context.aborted) {
+        return 0.0;
+    }
+    
+    // Reuse results from earlier searches of the same position
+    TranspositionTable& table = searchTable();
+    uint64_t key = board.getZobristKey();
+    TranspositionTable::Entry entry;
+    ChessMove hashMove;
+    if (table.probe(key, entry)) {
+        if (entry.depth >= depth) {
+            if (entry.bound == TranspositionTable::Bound::EXACT) {
+                return entry.score;
+            } else if (entry.bound == TranspositionTable::Bound::LOWER) {
+                alpha = std::max(alpha, entry.score);
+            } else {
+                beta = std::min(beta, entry.score);
+            }
+            if (beta <= alpha) {
+                return entry.score;
+            }
+        }
+        hashMove = entry.bestMove;
+    }
+    
+    // A tablebase result is exact, so the search below this node can be skipped
+    EndgameTablebase::Wdl wdl;
+    if (EndgameTablebase::probeWdl(board, wdl)) {
+        double eval = EndgameTablebase::score(wdl, ply);
+        if (board.getCurrentTurn() != aiColor) {
+            eval = -eval;
+        }
+        table.store(key, MAX_SEARCH_PLY, eval, TranspositionTable::Bound::EXACT, ChessMove());
+        return eval;
+    }
+    
+    bool gameOver = board.isGameOver();
+    if (depth == 0 && !gameOver) {
+        // Lazy evaluation: skip move generation for mobility when it cannot bring the score into the window
+        double eval = evaluateStatic(board, aiColor);
+        if (eval + LAZY_EVAL_MARGIN <= alpha || eval - LAZY_EVAL_MARGIN >= beta) {
+            return eval;
+        }
+    }
+    
+    if (depth == 0 || gameOver) {
+        double eval = evaluatePosition(board, aiColor);
+        table.store(key, 0, eval, TranspositionTable::Bound::EXACT, ChessMove());
+        return eval;
+    }
+    
+    PieceColor currentColor = maximizingPlayer ? PieceColor::WHITE : PieceColor::BLACK;
+    // The move list lives in the search arena until this node returns
+    MonotonicArena::Scope arenaScope(context.arena);
+    ArenaVector<ChessMove> validMoves = board.getAllValidMoves(currentColor, context.arena);
+    
+    if (validMoves.empty()) {
+        // No valid moves, but not checkmate or stalemate (should not happen)
+        return evaluatePosition(board, aiColor);
+    }
+    
+    orderMoves(board, validMoves.data(), validMoves.size(), hashMove,
+               ply < MAX_SEARCH_PLY ? &context.killerMoves[ply] : nullptr);
+    
+    double alphaOrig = alpha;
+    double betaOrig = beta;
+    ChessMove bestMove;
+    ChessBoard::MoveUndo undo;
+    double bestEval;
+    
+    if (maximizingPlayer) {
+        bestEval = -std::numeric_limits<double>::infinity();
+        for (const ChessMove& move : validMoves) {
+            board.makeMove(move, undo);
+            double eval = minimax(board, depth - 1, ply + 1, alpha, beta, false, aiColor, context);
+            board.unmakeMove(undo);
+            if (context.aborted) {
+                return 0.0;
+            }
+            if (eval > bestEval) {
+                bestEval = eval;
+                bestMove = move;
+            }
+            alpha = std::max(alpha, eval);
+            if (beta <= alpha) {
+                storeKillerMove(board, move, ply, context);
+                break;  // Beta cutoff
+            }
+        }
+    } else {
+        bestEval = std::numeric_limits<double>::infinity();
+        for (const ChessMove& move : validMoves) {
+            board.makeMove(move, undo);
+            double eval = minimax(board, depth - 1, ply + 1, alpha, beta, true, aiColor, context);
+            board.unmakeMove(undo);
+            if (context.aborted) {
+                return 0.0;
+            }
+            if (eval < bestEval) {
+                bestEval = eval;
+                bestMove = move;
+            }
+            beta = std::min(beta, eval);
+            if (beta <= alpha) {
+                storeKillerMove(board, move, ply, context);
+                break;  // Alpha cutoff
+            }
+        }
+    }
+    
+    TranspositionTable::Bound bound = TranspositionTable::Bound::EXACT;
+    if (bestEval <= alphaOrig) {
+        bound = TranspositionTable::Bound::UPPER;
+    } else if (bestEval >= betaOrig) {
+        bound = TranspositionTable::Bound::LOWER;
+    }
+    table.store(key, depth, bestEval, bound, bestMove);
+    
+    return bestEval;
+}
+
+// Value of the piece captured by a move, or -1 if it is not a capture
+static int capturedPieceValue(const BitboardPosition& position, const ChessMove& move) {
+    static const int values[] = { 100, 320, 330, 500, 900, 20000 };
+    
+    int to = move.getToSquare();
+    if (!position.isEmpty(to)) {
+        return values[static_cast<int>(position.typeAt(to))];
+    }
+    
+    int from = move.getFromSquare();
+    if (to == position.enPassantSquare && position.typeAt(from) == PieceType::PAWN) {
+        return values[static_cast<int>(PieceType::PAWN)];
+    }
+    
+    return -1;
+}
+
+void ChessAI::orderMoves(const ChessBoard& board, ChessMove* moves, size_t count, 
+                        const ChessMove& hashMove, const std::array<ChessMove, 2>* killers) {
+    static const int attackerValues[] = { 100, 320, 330, 500, 900, 20000 };
+    const BitboardPosition& position = board.getBitboards();
+    
+    // Scores with the original index, on the stack; the index keeps equal scores in generation order
+    count = std::min(count, static_cast<size_t>(MoveList::CAPACITY));
+    std::array<std::pair<int, int>, MoveList::CAPACITY> scored;
+    
+    for (size_t i = 0; i < count; ++i) {
+        const ChessMove& move = moves[i];
+        int score = 0;
+        int victim = capturedPieceValue(position, move);
+        
+        if (move == hashMove) {
+            score = 1000000;
+        } else if (victim >= 0) {
+            // Most valuable victim first, least valuable attacker breaks ties
+            PieceType attacker = position.typeAt(BitboardPosition::square(move.getFrom()));
+            score = 100000 + victim * 10 - attackerValues[static_cast<int>(attacker)] / 10;
+        } else if (move.getPromotionType() != PieceType::EMPTY) {
+            score = 90000;
+        } else if (killers && move == (*killers)[0]) {
+            score = 80000;
+        } else if (killers && move == (*killers)[1]) {
+            score = 79000;
+        }
+        
+        scored[i] = { score, static_cast<int>(i) };
+    }
+    
+    std::sort(scored.begin(), scored.begin() + count, [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    
+    std::array<ChessMove, MoveList::CAPACITY> ordered;
+    for (size_t i = 0; i < count; ++i) {
+        ordered[i] = moves[scored[i].second];
+    }
+    std::copy(ordered.begin(), ordered.begin() + count, moves);
+}
+
+void ChessAI::storeKillerMove(const ChessBoard& board, const ChessMove& move, int ply, SearchContext& context) {
+    // Only quiet moves are killers; captures are already ordered by MVV-LVA
+    if (ply >= MAX_SEARCH_PLY || capturedPieceValue(board.getBitboards(), move) >= 0 ||
+        move.getPromotionType() != PieceType::EMPTY) {
+        return;
+    }
+    
+    std::array<ChessMove, 2>& killers = context.killerMoves[ply];
+    if (killers[0] != move) {
+        killers[1] = killers[0];
+        killers[0] = move;
+    }
+}
+
+int ChessAI::getSearchDepth() const {
+    // Adjust search depth based on skill level
+    switch (skillLevel) {
+        case 1: return 1;
+        case 2: return 1;
+        case 3: return 2;
+        case 4: return 2;
+        case 5: return 3;
+        case 6: return 3;
+        case 7: return 4;
+        case 8: return 4;
+        case 9: return 5;
+        case 10: return 5;
+        default: return 3;
+    }
+}
+
+// Implementation of ChessMatchmaker class
+ChessMatchmaker::ChessMatchmaker() {
+}
+
+void ChessMatchmaker::addPlayer(ChessPlayer* player) {
+    // Check if player is already in the queue
+    if (!player || ratingPositions.find(player) != ratingPositions.end()) {
+        return;
+    }
+    
+    ratingPositions[player] = ratingIndex.emplace(player->getRating(), player);
+    queueTimes[player] = QDateTime::currentDateTime();
+}
+
+void ChessMatchmaker::removePlayer(ChessPlayer* player) {
+    auto it = ratingPositions.find(player);
+    if (it != ratingPositions.end()) {
+        ratingIndex.erase(it->second);
+        ratingPositions.erase(it);
+        queueTimes.erase(player);
+    }
+}
+
+std::vector<std::pair<ChessPlayer*, ChessPlayer*>> ChessMatchmaker::matchPlayers()
+{
+    std::vector<std::pair<ChessPlayer*, ChessPlayer*>> matches;
+    MPChessServer* server = MPChessServer::getInstance();
+    QDateTime now = QDateTime::currentDateTime();
+    
+    // Longest-waiting players choose first, with the widest windows
+    std::vector<std::pair<QDateTime, ChessPlayer*>> queue;
+    queue.reserve(queueTimes.size());
+    for (const auto& [player, queuedAt] : queueTimes) {
+        queue.emplace_back(queuedAt, player);
+    }
+    std::sort(queue.begin(), queue.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first < b.first : a.second->getUsername() < b.second->getUsername();
+    });
+    
+    for (const auto& [queuedAt, player] : queue) {
+        // Skip players already matched this tick
+        if (ratingPositions.find(player) == ratingPositions.end()) {
+            continue;
+        }
+        
+        // Skip if player is already in a game
+        if (server && server->isPlayerInGame(player)) {
+            continue;
+        }
+        
+        ChessPlayer* bestMatch = findBestMatch(player, getRatingWindow(queuedAt.secsTo(now)));
+        if (bestMatch) {
+            matches.emplace_back(player, bestMatch);
+            ServerMetrics::matchmakingWaitSeconds.observe(queuedAt.msecsTo(now) / 1000.0);
+            ServerMetrics::matchmakingWaitSeconds.observe(queueTimes[bestMatch].msecsTo(now) / 1000.0);
+            
+            // Remove matched players from the queue
+            removePlayer(player);
+            removePlayer(bestMatch);
+        }
+    }
+    
+    return matches;
+}
+
+std::vector<ChessPlayer*> ChessMatchmaker::checkTimeouts(int timeoutSeconds)
+{
+    std::vector<ChessPlayer*> timedOutPlayers;
+    QDateTime now = QDateTime::currentDateTime();
+    
+    for (const auto& [player, queueTime] : queueTimes) {
+        if (queueTime.secsTo(now) > timeoutSeconds) {
+            timedOutPlayers.push_back(player);
+            ServerMetrics::matchmakingWaitSeconds.observe(queueTime.msecsTo(now) / 1000.0);
+        }
+    }
+    
+    for (ChessPlayer* player : timedOutPlayers) {
+        removePlayer(player);
+    }
+    
+    return timedOutPlayers;
+}
+
+int ChessMatchmaker::getQueueSize() const {
+    return static_cast<int>(queueTimes.size());
+}
+
+void ChessMatchmaker::clearQueue() {
+    ratingIndex.clear();
+    ratingPositions.clear();
+    queueTimes.clear();
+}
+
+ChessPlayer* ChessMatchmaker::findBestMatch(ChessPlayer* player, int maxDifference) const
+{
+    if (!player) return nullptr;
+    
+    auto own = ratingPositions.find(player);
+    if (own == ratingPositions.end()) return nullptr;
+    
+    int rating = own->second->first;
+    MPChessServer* server = MPChessServer::getInstance();
+    auto usable = [player, server](ChessPlayer* candidate) {
+        return candidate && candidate != player && !(server && server->isPlayerInGame(candidate));
+    };
+    
+    // Walk outwards from the player's rating in both directions; the first usable
+    // candidate on each side is the closest one there
+    auto above = ratingIndex.lower_bound(rating);
+    auto below = std::make_reverse_iterator(above);
+    while (above != ratingIndex.end() && !usable(above->second)) {
+        ++above;
+    }
+    while (below != ratingIndex.rend() && !usable(below->second)) {
+        ++below;
+    }
+    
+    ChessPlayer* bestMatch = nullptr;
+    double bestScore = std::numeric_limits<double>::infinity();
+    if (above != ratingIndex.end() && above->first - rating <= maxDifference) {
+        bestScore = getRatingDifferenceScore(rating, above->first);
+        bestMatch = above->second;
+    }
+    if (below != ratingIndex.rend() && rating - below->first <= maxDifference &&
+        getRatingDifferenceScore(rating, below->first) < bestScore) {
+        bestMatch = below->second;
+    }
+    
+    return bestMatch;
+}
+
+int ChessMatchmaker::getRatingWindow(qint64 waitSeconds) const {
+    qint64 window = BASE_RATING_WINDOW + std::max<qint64>(0, waitSeconds) * RATING_WINDOW_GROWTH_PER_SECOND;
+    return static_cast<int>(std::min<qint64>(window, MAX_RATING_WINDOW));
+}
+
+double ChessMatchmaker::getRatingDifferenceScore(int rating1, int rating2) const {
+    return std::abs(rating1 - rating2);
+}
+
+// Implementation of ChessTournament class
+ChessTournament::ChessTournament(const std::string& tournamentId, int rounds, TimeControlType timeControl,
+                                 qint64 startTime)
+    : tournamentId(tournamentId), rounds(std::max(1, rounds)), timeControl(timeControl), startTime(startTime),
+      currentRound(0), unfinishedGames(0) {
+}
+
+bool ChessTournament::isFinished() const {
+    return currentRound >= rounds && isRoundComplete();
+}
+
+bool ChessTournament::addPlayer(const std::string& username, int rating) {
+    if (currentRound >= rounds) {
+        return false;
+    }
+    
+    auto [it, inserted] = participants.try_emplace(username);
+    Participant& participant = it->second;
+    if (!inserted && !participant.withdrawn) {
+        return false;
+    }
+    
+    // A player who withdrew can come back with the points scored before
+    participant.username = username;
+    participant.rating = rating;
+    participant.withdrawn = false;
+    return true;
+}
+
+bool ChessTournament::withdrawPlayer(const std::string& username) {
+    auto it = participants.find(username);
+    if (it == participants.end() || it->second.withdrawn) {
+        return false;
+    }
+    it->second.withdrawn = true;
+    return true;
+}
+
+bool ChessTournament::hasPlayer(const std::string& username) const {
+    auto it = participants.find(username);
+    return it != participants.end() && !it->second.withdrawn;
+}
+
+std::vector<const ChessTournament::Participant*> ChessTournament::rankedPlayers(bool includeWithdrawn) const {
+    std::vector<const Participant*> ranked;
+    ranked.reserve(participants.size());
+    for (const auto& [username, participant] : participants) {
+        if (includeWithdrawn || !participant.withdrawn) {
+            ranked.push_back(&participant);
+        }
+    }
+    std::sort(ranked.begin(), ranked.end(), [](const Participant* a, const Participant* b) {
+        if (a->score != b->score) return a->score > b->score;
+        if (a->rating != b->rating) return a->rating > b->rating;
+        return a->username < b->username;
+    });
+    return ranked;
+}
+
+std::vector<std::string> ChessTournament::getActivePlayers() const {
+    std::vector<std::string> usernames;
+    for (const Participant* participant : rankedPlayers(false)) {
+        usernames.push_back(participant->username);
+    }
+    return usernames;
+}
+
+std::vector<ChessTournament::Pairing> ChessTournament::pairNextRound() {
+    std::vector<Pairing> pairings;
+    if (currentRound >= rounds || !isRoundComplete()) {
+        return pairings;
+    }
+    
+    std::vector<const Participant*> ranked = rankedPlayers(false);
+    ++currentRound;
+    
+    // The lowest-ranked player without a bye sits out an odd round
+    if (ranked.size() % 2 == 1) {
+        auto byeIt = std::find_if(ranked.rbegin(), ranked.rend(),
+                                  [](const Participant* participant) { return !participant->hadBye; });
+        if (byeIt == ranked.rend()) {
+            byeIt = ranked.rbegin();
+        }
+        Participant& bye = participants.at((*byeIt)->username);
+        bye.hadBye = true;
+        bye.score += 1.0;
+        pairings.push_back({ bye.username, std::string() });
+        ranked.erase(std::next(byeIt).base());
+    }
+    
+    // Down the ranking, each player meets the next one still unpaired they have not
+    // played; if they have played everyone left, the next one regardless
+    std::vector<bool> paired(ranked.size(), false);
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        if (paired[i]) {
+            continue;
+        }
+        size_t opponent = ranked.size();
+        for (size_t j = i + 1; j < ranked.size(); ++j) {
+            if (paired[j]) {
+                continue;
+            }
+            if (opponent == ranked.size()) {
+                opponent = j;
+            }
+            if (!ranked[i]->opponents.count(ranked[j]->username)) {
+                opponent = j;
+                break;
+            }
+        }
+        if (opponent == ranked.size()) {
+            break;  // Unreachable: an even number of players remain
+        }
+        paired[i] = paired[opponent] = true;
+        
+        Participant& first = participants.at(ranked[i]->username);
+        Participant& second = participants.at(ranked[opponent]->username);
+        
+        // Colors balance out: the player who has had white less often takes it
+        bool firstIsWhite = first.whiteGames - first.blackGames <= second.whiteGames - second.blackGames;
+        Participant& white = firstIsWhite ? first : second;
+        Participant& black = firstIsWhite ? second : first;
+        white.whiteGames++;
+        black.blackGames++;
+        white.opponents.insert(black.username);
+        black.opponents.insert(white.username);
+        pairings.push_back({ white.username, black.username });
+    }
+    
+    unfinishedGames = static_cast<int>(ranked.size() / 2);
+    return pairings;
+}
+
+void ChessTournament::recordResult(const std::string& white, const std::string& black, GameResult result) {
+    auto whiteIt = participants.find(white);
+    auto blackIt = participants.find(black);
+    if (whiteIt == participants.end() || blackIt == participants.end() || unfinishedGames == 0) {
+        return;
+    }
+    
+    switch (result) {
+        case GameResult::WHITE_WIN:
+            whiteIt->second.score += 1.0;
+            break;
+        case GameResult::BLACK_WIN:
+            blackIt->second.score += 1.0;
+            break;
+        case GameResult::DRAW:
+            whiteIt->second.score += 0.5;
+            blackIt->second.score += 0.5;
+            break;
+        default:
+            break;
+    }
+    --unfinishedGames;
+}
+
+QJsonObject ChessTournament::toJson(bool includeStandings) const {
+    QJsonObject json;
+    json["tournamentId"] = QString::fromStdString(tournamentId);
+    json["rounds"] = rounds;
+    json["round"] = currentRound;
+    json["timeControl"] = [this]() -> QString {
+        switch (timeControl) {
+            case TimeControlType::RAPID: return "rapid";
+            case TimeControlType::BLITZ: return "blitz";
+            case TimeControlType::BULLET: return "bullet";
+            case TimeControlType::CLASSICAL: return "classical";
+            case TimeControlType::CASUAL: return "casual";
+            default: return "rapid";
+        }
+    }();
+    json["startTime"] = static_cast<double>(startTime);
+    json["status"] = isFinished() ? "finished" : hasStarted() ? "running" : "scheduled";
+    json["players"] = static_cast<int>(participants.size());
+    if (!includeStandings) {
+        return json;
+    }
+    
+    QJsonArray standings;
+    for (const Participant* participant : rankedPlayers(true)) {
+        QJsonObject entry;
+        entry["username"] = QString::fromStdString(participant->username);
+        entry["rating"] = participant->rating;
+        entry["score"] = participant->score;
+        entry["games"] = participant->whiteGames + participant->blackGames;
+        entry["withdrawn"] = participant->withdrawn;
+        standings.append(entry);
+    }
+    json["standings"] = standings;
+    return json;
+}
+
+// Implementation of ChessRatingSystem class
+ChessRatingSystem::ChessRatingSystem() {
+}
+
+std::pair<int, int> ChessRatingSystem::calculateNewRatings(int rating1, int rating2, GameResult result) {
+    double score1, score2;
+    
+    switch (result) {
+        case GameResult::WHITE_WIN:
+            score1 = 1.0;
+            score2 = 0.0;
+            break;
+        case GameResult::BLACK_WIN:
+            score1 = 0.0;
+            score2 = 1.0;
+            break;
+        case GameResult::DRAW:
+            score1 = 0.5;
+            score2 = 0.5;
+            break;
+        default:
+            // Game in progress, no rating change
+            return {rating1, rating2};
+    }
+    
+    double expected1 = calculateExpectedScore(rating1, rating2);
+    double expected2 = calculateExpectedScore(rating2, rating1);
+    
+    int k1 = getKFactor(rating1, 0);  // Assuming we don't track games played here
+    int k2 = getKFactor(rating2, 0);
+    
+    int newRating1 = static_cast<int>(rating1 + k1 * (score1 - expected1));
+    int newRating2 = static_cast<int>(rating2 + k2 * (score2 - expected2));
+    
+    return {newRating1, newRating2};
+}
+
+double ChessRatingSystem::calculateExpectedScore(int rating1, int rating2) const {
+    return 1.0 / (1.0 + std::pow(10.0, (rating2 - rating1) / 400.0));
+}
+
+int ChessRatingSystem::getKFactor(int rating, int gamesPlayed) const {
+    if (rating >= MASTER_RATING_THRESHOLD) {
+        return MASTER_K_FACTOR;
+    } else if (gamesPlayed >= GAMES_THRESHOLD) {
+        return EXPERIENCED_K_FACTOR;
+    } else {
+        return DEFAULT_K_FACTOR;
+    }
+}
+
+// Implementation of ChessAnalysisEngine class
+ChessAnalysisEngine::ChessAnalysisEngine() : analysisAI(10) {
+}
+
+QJsonObject ChessAnalysisEngine::analyzeGame(const ChessGame& game, const ProgressCallback& progress) {
+    QJsonObject analysis;
+
+    // If Stockfish is available, use it for analysis
+    MPChessServer* server = MPChessServer::getInstance();
+    if (server && server->enginePool && server->enginePool->isAvailable()) {
+        return server->enginePool->analyzeGame(game, progress);
+    }
+
+    // Otherwise, use our built-in analysis    
+    // Game overview
+    analysis["gameId"] = QString::fromStdString(game.getGameId());
+    analysis["whitePlayer"] = QString::fromStdString(game.getWhitePlayer()->getUsername());
+    analysis["blackPlayer"] = QString::fromStdString(game.getBlackPlayer()->getUsername());
+    analysis["result"] = [&game]() -> QString {
+        switch (game.getResult()) {
+            case GameResult::WHITE_WIN: return "white_win";
+            case GameResult::BLACK_WIN: return "black_win";
+            case GameResult::DRAW: return "draw";
+            default: return "in_progress";
+        }
+    }();
+    
+    // Every part of the analysis comes from the same per-ply evaluations
+    GameReplay replay = replayGame(game, progress);
+    
+    // Analyze each move
+    QJsonArray moveAnalysis;
+    for (size_t i = 0; i < replay.moves.size(); ++i) {
+        double evalBefore = replay.evaluations[i];
+        double evalAfter = replay.evaluations[i + 1];
+        
+        // Create move analysis object
+        QJsonObject moveObj;
+        moveObj["moveNumber"] = static_cast<int>(i / 2) + 1;
+        moveObj["color"] = (i % 2 == 0) ? "white" : "black";
+        moveObj["move"] = QString::fromStdString(replay.moves[i].toAlgebraic());
+        moveObj["standardNotation"] = QString::fromStdString(replay.notation[i]);
+        moveObj["evaluationBefore"] = evalBefore;
+        moveObj["evaluationAfter"] = evalAfter;
+        moveObj["evaluationChange"] = evalAfter - evalBefore;
+        moveObj["classification"] = QString::fromStdString(classifyMove(evalBefore, evalAfter));
+        moveObj["isCapture"] = static_cast<bool>(replay.captures[i]);
+        moveObj["isCheck"] = static_cast<bool>(replay.checks[i]);
+        
+        moveAnalysis.append(moveObj);
+    }
+    
+    analysis["moveAnalysis"] = moveAnalysis;
+    
+    // Add mistakes analysis
+    QJsonObject mistakes = identifyMistakes(replay);
+    analysis["mistakes"] = mistakes;
+    
+    // Add critical moments
+    QJsonObject criticalMoments = identifyCriticalMoments(replay);
+    analysis["criticalMoments"] = criticalMoments;
+    
+    // Add game summary
+    analysis["summary"] = QString::fromStdString(generateGameSummary(game, mistakes, criticalMoments));
+    
+    return analysis;
+}
+
+ChessAnalysisEngine::GameReplay ChessAnalysisEngine::replayGame(const ChessGame& game, const ProgressCallback& progress) {
+    GameReplay replay;
+    replay.moves = game.getBoard()->getMoveHistory();
+    
+    size_t moveCount = replay.moves.size();
+    int totalWork = static_cast<int>(moveCount) + 1;
+    replay.evaluations.reserve(moveCount + 1);
+    replay.notation.reserve(moveCount);
+    replay.captures.reserve(moveCount);
+    replay.checks.reserve(moveCount);
+    replay.piecesAfter.reserve(moveCount);
+    
+    // Create a temporary board to replay the game
+    auto tempBoard = std::make_unique<ChessBoard>();
+    tempBoard->initialize();
+    ChessBoard::MoveUndo undo;
+    
+    for (size_t i = 0; i < moveCount; ++i) {
+        const ChessMove& move = replay.moves[i];
+        
+        // The evaluation after one move is the evaluation before the next
+        replay.evaluations.push_back(evaluatePositionDeeply(*tempBoard, tempBoard->getCurrentTurn()));
+        if (progress) {
+            progress(static_cast<int>(i) + 1, totalWork);
+        }
+        
+        replay.notation.push_back(move.toStandardNotation(*tempBoard));
+        replay.captures.push_back(isCapture(*tempBoard, move));
+        PieceColor opponentColor = (tempBoard->getCurrentTurn() == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+        
+        // Make the move in place; moves from the history were validated when played
+        tempBoard->makeMove(move, undo);
+        
+        replay.checks.push_back(tempBoard->isInCheck(opponentColor));
+        replay.piecesAfter.push_back(BitboardPosition::popCount(tempBoard->getBitboards().allOccupancy) - 2);
+    }
+    
+    replay.evaluations.push_back(evaluatePositionDeeply(*tempBoard, tempBoard->getCurrentTurn()));
+    if (progress) {
+        progress(totalWork, totalWork);
+    }
+    
+    return replay;
+}
+
+QJsonObject ChessAnalysisEngine::analyzeMove(const ChessBoard& boardBefore, const ChessMove& move) {
+    QJsonObject analysis;
+
+    // If Stockfish is available, use it for analysis
+    MPChessServer* server = MPChessServer::getInstance();
+    if (server && server->enginePool && server->enginePool->isAvailable()) {
+        // Create a copy of the board and make the move
+        auto boardAfter = boardBefore.clone();
+        boardAfter->movePiece(move);
+        
+        // Analyze both positions
+        QJsonObject beforeAnalysis = server->enginePool->analyzePosition(boardBefore);
+        QJsonObject afterAnalysis = server->enginePool->analyzePosition(*boardAfter);
+        double moverSign = boardBefore.getCurrentTurn() == PieceColor::WHITE ? 1.0 : -1.0;
+        
+        // Combine the analyses
+        analysis["move"] = QString::fromStdString(move.toAlgebraic());
+        analysis["standardNotation"] = QString::fromStdString(move.toStandardNotation(boardBefore));
+        analysis["evaluationBefore"] = beforeAnalysis["evaluation"];
+        analysis["evaluationAfter"] = afterAnalysis["evaluation"];
+        analysis["evaluationChange"] = moverSign * (afterAnalysis["evaluation"].toDouble() - beforeAnalysis["evaluation"].toDouble());
+        
+        // Classify the move
+        double evalChange = analysis["evaluationChange"].toDouble();
+        if (evalChange > 2.0) analysis["classification"] = "Brilliant";
+        else if (evalChange > 1.0) analysis["classification"] = "Good";
+        else if (evalChange > 0.3) analysis["classification"] = "Accurate";
+        else if (evalChange > -0.3) analysis["classification"] = "Normal";
+        else if (evalChange > -1.0) analysis["classification"] = "Inaccuracy";
+        else if (evalChange > -2.0) analysis["classification"] = "Mistake";
+        else analysis["classification"] = "Blunder";
+        
+        analysis["isCapture"] = isCapture(boardBefore, move);
+        analysis["isCheck"] = putsInCheck(*boardAfter, move);
+        analysis["alternatives"] = beforeAnalysis["bestMoves"];
+        
+        return analysis;
+    }
+
+    // Otherwise, use our built-in analysis
+    // Create a copy of the board and make the move
+    auto boardAfter = boardBefore.clone();
+    boardAfter->movePiece(move);
+    
+    // Evaluate positions
+    double evalBefore = evaluatePositionDeeply(boardBefore, boardBefore.getCurrentTurn());
+    double evalAfter = evaluatePositionDeeply(*boardAfter, boardAfter->getCurrentTurn());
+    
+    // Calculate evaluation change
+    double evalChange = evalAfter - evalBefore;
+    
+    // Classify the move
+    std::string classification = classifyMove(evalBefore, evalAfter);
+    
+    // Get alternative moves
+    std::vector<std::pair<ChessMove, double>> alternatives = 
+        getMoveRecommendations(boardBefore, boardBefore.getCurrentTurn(), 3);
+    
+    // Create the analysis object
+    analysis["move"] = QString::fromStdString(move.toAlgebraic());
+    analysis["standardNotation"] = QString::fromStdString(move.toStandardNotation(boardBefore));
+    analysis["evaluationBefore"] = evalBefore;
+    analysis["evaluationAfter"] = evalAfter;
+    analysis["evaluationChange"] = evalChange;
+    analysis["classification"] = QString::fromStdString(classification);
+    analysis["isCapture"] = isCapture(boardBefore, move);
+    analysis["isCheck"] = putsInCheck(*boardAfter, move);
+    
+    // Add alternative moves
+    QJsonArray alternativesArray;
+    for (const auto& [altMove, altEval] : alternatives) {
+        if (altMove == move) continue;  // Skip the actual move
+        
+        QJsonObject altObj;
+        altObj["move"] = QString::fromStdString(altMove.toAlgebraic());
+        altObj["standardNotation"] = QString::fromStdString(altMove.toStandardNotation(boardBefore));
+        altObj["evaluation"] = altEval;
+        alternativesArray.append(altObj);
+    }
+    analysis["alternatives"] = alternativesArray;
+    
+    return analysis;
+}
+
+std::vector<std::pair<ChessMove, double>> ChessAnalysisEngine::getMoveRecommendations(
+    const ChessBoard& board, PieceColor color, int maxRecommendations, const std::atomic<bool>* stopFlag) {
+
+    // Book moves need no search
+    std::vector<std::pair<ChessMove, double>> bookMoves = analysisAI.getBookRecommendations(board, color, maxRecommendations);
+    if (!bookMoves.empty()) {
+        return bookMoves;
+    }
+
+    // If Stockfish is available, use it for recommendations
+    MPChessServer* server = MPChessServer::getInstance();
+    if (server && server->enginePool && server->enginePool->isAvailable()) {
+        return server->enginePool->getMoveRecommendations(board, maxRecommendations, stopFlag);
+    }
+
+    // Otherwise, use our built-in AI with a shallow search split across the search threads
+    return analysisAI.searchMoveRecommendations(board, color, maxRecommendations, RECOMMENDATION_SEARCH_DEPTH, stopFlag);
+}
+
+QJsonObject ChessAnalysisEngine::identifyMistakes(const ChessGame& game) {
+    return identifyMistakes(replayGame(game));
+}
+
+QJsonObject ChessAnalysisEngine::identifyMistakes(const GameReplay& replay) {
+    QJsonObject mistakes;
+    
+    QJsonArray blunders;
+    QJsonArray errors;
+    QJsonArray inaccuracies;
+    
+    for (size_t i = 0; i < replay.moves.size(); ++i) {
+        double evalBefore = replay.evaluations[i];
+        double evalAfter = replay.evaluations[i + 1];
+        
+        // Calculate evaluation change
+        double evalChange = evalAfter - evalBefore;
+        
+        // Determine if this is a mistake
+        QJsonObject mistakeObj;
+        mistakeObj["moveNumber"] = static_cast<int>(i / 2) + 1;
+        mistakeObj["color"] = (i % 2 == 0) ? "white" : "black";
+        mistakeObj["move"] = QString::fromStdString(replay.moves[i].toAlgebraic());
+        mistakeObj["standardNotation"] = QString::fromStdString(replay.notation[i]);
+        mistakeObj["evaluationBefore"] = evalBefore;
+        mistakeObj["evaluationAfter"] = evalAfter;
+        mistakeObj["evaluationChange"] = evalChange;
+        
+        // Classify based on evaluation change
+        if (std::abs(evalChange) >= 2.0) {
+            blunders.append(mistakeObj);
+        } else if (std::abs(evalChange) >= 1.0) {
+            errors.append(mistakeObj);
+        } else if (std::abs(evalChange) >= 0.5) {
+            inaccuracies.append(mistakeObj);
+        }
+    }
+    
+    mistakes["blunders"] = blunders;
+    mistakes["errors"] = errors;
+    mistakes["inaccuracies"] = inaccuracies;
+    
+    return mistakes;
+}
+
+QJsonObject ChessAnalysisEngine::identifyCriticalMoments(const ChessGame& game) {
+    return identifyCriticalMoments(replayGame(game));
+}
+
+QJsonObject ChessAnalysisEngine::identifyCriticalMoments(const GameReplay& replay) {
+    QJsonObject criticalMoments;
+    
+    QJsonArray openingMoments;
+    QJsonArray middleGameMoments;
+    QJsonArray endGameMoments;
+    
+    // Track the largest evaluation swings
+    double largestSwing = 0.0;
+    size_t largestSwingIndex = 0;
+    
+    // Track material count to identify game phases
+    int phase = 0;  // 0: opening, 1: middlegame, 2: endgame
+    
+    for (size_t i = 0; i < replay.moves.size(); ++i) {
+        double evalBefore = replay.evaluations[i];
+        double evalAfter = replay.evaluations[i + 1];
+        
+        // Calculate evaluation change
+        double evalChange = evalAfter - evalBefore;
+        
+        // Track largest swing
+        if (std::abs(evalChange) > std::abs(largestSwing)) {
+            largestSwing = evalChange;
+            largestSwingIndex = i;
+        }
+        
+        // Create moment object
+        QJsonObject momentObj;
+        momentObj["moveNumber"] = static_cast<int>(i / 2) + 1;
+        momentObj["color"] = (i % 2 == 0) ? "white" : "black";
+        momentObj["move"] = QString::fromStdString(replay.moves[i].toAlgebraic());
+        momentObj["standardNotation"] = QString::fromStdString(replay.notation[i]);
+        momentObj["evaluationBefore"] = evalBefore;
+        momentObj["evaluationAfter"] = evalAfter;
+        momentObj["evaluationChange"] = evalChange;
+        
+        // Determine game phase based on move number and material
+        if (i < 10) {
+            phase = 0;  // Opening
+        } else if (replay.piecesAfter[i] <= 12) {
+            phase = 2;  // Endgame
+        } else {
+            phase = 1;  // Middlegame
+        }
+        
+        // Add to the appropriate phase array
+        if (std::abs(evalChange) >= 0.5) {  // Only add significant moments
+            if (phase == 0) {
+                openingMoments.append(momentObj);
+            } else if (phase == 1) {
+                middleGameMoments.append(momentObj);
+            } else {
+                endGameMoments.append(momentObj);
+            }
+        }
+    }
+    
+    criticalMoments["opening"] = openingMoments;
+    criticalMoments["middleGame"] = middleGameMoments;
+    criticalMoments["endGame"] = endGameMoments;
+    
+    // Add the largest swing
+    if (largestSwingIndex < replay.moves.size()) {
+        const ChessMove& move = replay.moves[largestSwingIndex];
+        QJsonObject largestSwingObj;
+        largestSwingObj["moveNumber"] = static_cast<int>(largestSwingIndex / 2) + 1;
+        largestSwingObj["color"] = (largestSwingIndex % 2 == 0) ? "white" : "black";
+        largestSwingObj["move"] = QString::fromStdString(move.toAlgebraic());
+        largestSwingObj["evaluationChange"] = largestSwing;
+        criticalMoments["largestSwing"] = largestSwingObj;
+    }
+    
+    return criticalMoments;
+}
+
+std::string ChessAnalysisEngine::generateGameSummary(const ChessGame& game) {
+    GameReplay replay = replayGame(game);
+    return generateGameSummary(game, identifyMistakes(replay), identifyCriticalMoments(replay));
+}
+
+std::string ChessAnalysisEngine::generateGameSummary(const ChessGame& game, const QJsonObject& mistakes,
+                                                     const QJsonObject& criticalMoments) {
+    std::stringstream summary;
+    
+    // Get basic game info
+    summary << "Game between " << game.getWhitePlayer()->getUsername() << " (White) and "
+            << game.getBlackPlayer()->getUsername() << " (Black)\n";
+    
+    // Get result
+    switch (game.getResult()) {
+        case GameResult::WHITE_WIN:
+            summary << "Result: 1-0 (White won)\n";
+            break;
+        case GameResult::BLACK_WIN:
+            summary << "Result: 0-1 (Black won)\n";
+            break;
+        case GameResult::DRAW:
+            summary << "Result: 1/2-1/2 (Draw)\n";
+            break;
+        default:
+            summary << "Result: Game in progress\n";
+            break;
+    }
+    
+    // Get mistake counts
+    int blunderCount = mistakes["blunders"].toArray().size();
+    int errorCount = mistakes["errors"].toArray().size();
+    int inaccuracyCount = mistakes["inaccuracies"].toArray().size();
+    
+    summary << "\nGame Statistics:\n";
+    summary << "- White blunders: " << countPlayerMistakes(mistakes["blunders"].toArray(), "white") << "\n";
+    summary << "- White errors: " << countPlayerMistakes(mistakes["errors"].toArray(), "white") << "\n";
+    summary << "- White inaccuracies: " << countPlayerMistakes(mistakes["inaccuracies"].toArray(), "white") << "\n";
+    summary << "- Black blunders: " << countPlayerMistakes(mistakes["blunders"].toArray(), "black") << "\n";
+    summary << "- Black errors: " << countPlayerMistakes(mistakes["errors"].toArray(), "black") << "\n";
+    summary << "- Black inaccuracies: " << countPlayerMistakes(mistakes["inaccuracies"].toArray(), "black") << "\n";
+    
+    // Add critical moment
+    if (criticalMoments.contains("largestSwing")) {
+        QJsonObject largestSwing = criticalMoments["largestSwing"].toObject();
+        summary << "\nCritical Moment:\n";
+        summary << "Move " << largestSwing["moveNumber"].toInt() << " by " 
+                << largestSwing["color"].toString().toStdString() << ": " 
+                << largestSwing["move"].toString().toStdString() << "\n";
+        summary << "This move caused an evaluation change of " 
+                << largestSwing["evaluationChange"].toDouble() << "\n";
+    }
+    
+    // Add overall assessment
+    summary << "\nOverall Assessment:\n";
+    if (blunderCount == 0 && errorCount <= 1) {
+        summary << "Excellent game with very few mistakes.\n";
+    } else if (blunderCount <= 1 && errorCount <= 3) {
+        summary << "Good game with some minor errors.\n";
+    } else if (blunderCount <= 3) {
+        summary << "Average game with several mistakes.\n";
+    } else {
+        summary << "Game had multiple significant mistakes.\n";
+    }
+    
+    return summary.str();
+}
+
+double ChessAnalysisEngine::evaluatePositionDeeply(const ChessBoard& board, PieceColor color) {
+    // Positions in the tablebase have an exact result
+    EndgameTablebase::Wdl wdl;
+    if (EndgameTablebase::probeWdl(board, wdl)) {
+        double eval = EndgameTablebase::score(wdl, 0);
+        return board.getCurrentTurn() == color ? eval : -eval;
+    }
+    
+    return analysisAI.evaluatePosition(board, color);
+}
+
+std::string ChessAnalysisEngine::classifyMove(double evalBefore, double evalAfter) {
+    double diff = evalAfter - evalBefore;
+    
+    if (diff > 2.0) return "Brilliant";
+    if (diff > 1.0) return "Good";
+    if (diff > 0.3) return "Accurate";
+    if (diff > -0.3) return "Normal";
+    if (diff > -1.0) return "Inaccuracy";
+    if (diff > -2.0) return "Mistake";
+    return "Blunder";
+}
+
+bool ChessAnalysisEngine::isCapture(const ChessBoard& board, const ChessMove& move) {
+    return board.getPiece(move.getTo()) != nullptr || board.isEnPassantCapture(move);
+}
+
+bool ChessAnalysisEngine::putsInCheck(const ChessBoard& board, const ChessMove& move) {
+    // Get the color of the piece being moved
+    const ChessPiece* piece = board.getPiece(move.getFrom());
+    if (!piece) return false;
+    
+    PieceColor color = piece->getColor();
+    PieceColor opponentColor = (color == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    
+    // Create a copy of the board and make the move
+    auto tempBoard = board.clone();
+    tempBoard->movePiece(move);
+    
+    // Check if the opponent is in check
+    return tempBoard->isInCheck(opponentColor);
+}
+
+int ChessAnalysisEngine::countPlayerMistakes(const QJsonArray& mistakes, const QString& color) {
+    int count = 0;
+    for (const QJsonValue& value : mistakes) {
+        QJsonObject mistake = value.toObject();
+        if (mistake["color"].toString() == color) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Implementation of ChessSerializer class
+ChessSerializer::ChessSerializer() {
+}
+
+QJsonObject ChessSerializer::serializeGame(const ChessGame& game) {
+    return game.serialize();
+}
+
+std::unique_ptr<ChessGame> ChessSerializer::deserializeGame(const QJsonObject& json, 
+                                                         ChessPlayer* whitePlayer, 
+                                                         ChessPlayer* blackPlayer) {
+    return ChessGame::deserialize(json, whitePlayer, blackPlayer);
+}
+
+bool ChessSerializer::saveGameToFile(const ChessGame& game, const std::string& filename) {
+    QJsonObject json = serializeGame(game);
+    QJsonDocument doc(json);
+    
+    QFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    
+    file.write(doc.toJson());
+    return true;
+}
+
+std::unique_ptr<ChessGame> ChessSerializer::loadGameFromFile(const std::string& filename,
+                                                          ChessPlayer* whitePlayer,
+                                                          ChessPlayer* blackPlayer) {
+    QFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+    
+    QByteArray data = file.readAll();
+    QJsonDocument doc = QJsonDocument::fromJson(data);
+    
+    if (doc.isNull() || !doc.isObject()) {
+        return nullptr;
+    }
+    
+    return deserializeGame(doc.object(), whitePlayer, blackPlayer);
+}
+
+QJsonObject ChessSerializer::serializePlayer(const ChessPlayer& player) {
+    return player.toJson();
+}
+
+std::unique_ptr<ChessPlayer> ChessSerializer::deserializePlayer(const QJsonObject& json) {
+    ChessPlayer player = ChessPlayer::fromJson(json);
+    return std::make_unique<ChessPlayer>(player);
+}
+
+bool ChessSerializer::savePlayerToFile(const ChessPlayer& player, const std::string& filename) {
+    QJsonObject json = serializePlayer(player);
+    QJsonDocument doc(json);
+    
+    QFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    
+    file.write(doc.toJson());
+    return true;
+}
+
+std::unique_ptr<ChessPlayer> ChessSerializer::loadPlayerFromFile(const std::string& filename) {
+    QFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+    
+    QByteArray data = file.readAll();
+    QJsonDocument doc = QJsonDocument::fromJson(data);
+    
+    if (doc.isNull() || !doc.isObject()) {
+        return nullptr;
+    }
+    
+    return deserializePlayer(doc.object());
+}
+
+QJsonObject ChessSerializer::serializeBoard(const ChessBoard& board) {
+    QJsonObject json;
+    
+    // Serialize pieces
+    QJsonArray piecesArray;
+    for (int r = 0; r < 8; ++r) {
+        for (int c = 0; c < 8; ++c) {
+            Position pos(r, c);
+            const ChessPiece* piece = board.getPiece(pos);
+            if (piece) {
+                piecesArray.append(serializePiece(piece, pos));
+            }
+        }
+    }
+    json["pieces"] = piecesArray;
+    
+    // Serialize current turn
+    json["currentTurn"] = (board.getCurrentTurn() == PieceColor::WHITE) ? "white" : "black";
+    
+    // Serialize en passant target
+    Position enPassantTarget = board.getEnPassantTarget();
+    if (enPassantTarget.isValid()) {
+        json["enPassantTarget"] = QString::fromStdString(enPassantTarget.toAlgebraic());
+    } else {
+        json["enPassantTarget"] = "";
+    }
+    
+    // Serialize move history
+    QJsonArray moveHistoryArray;
+    for (const ChessMove& move : board.getMoveHistory()) {
+        moveHistoryArray.append(serializeMove(move));
+    }
+    json["moveHistory"] = moveHistoryArray;
+    
+    // Serialize captured pieces
+    QJsonArray whiteCapturedArray;
+    for (PieceType type : board.getCapturedPieces(PieceColor::WHITE)) {
+        whiteCapturedArray.append([type]() -> QString {
+            switch (type) {
+                case PieceType::PAWN: return "pawn";
+                case PieceType::KNIGHT: return "knight";
+                case PieceType::BISHOP: return "bishop";
+                case PieceType::ROOK: return "rook";
+                case PieceType::QUEEN: return "queen";
+                case PieceType::KING: return "king";
+                case PieceType::EMPTY: return "";
+                default: return "";
+            }
+        }());
+    }
+    json["whiteCaptured"] = whiteCapturedArray;
+    
+    QJsonArray blackCapturedArray;
+    for (PieceType type : board.getCapturedPieces(PieceColor::BLACK)) {
+        blackCapturedArray.append([type]() -> QString {
+            switch (type) {
+                case PieceType::PAWN: return "pawn";
+                case PieceType::KNIGHT: return "knight";
+                case PieceType::BISHOP: return "bishop";
+                case PieceType::ROOK: return "rook";
+                case PieceType::QUEEN: return "queen";
+                case PieceType::KING: return "king";
+                case PieceType::EMPTY: return "";
+                default: return "";
+            }
+        }());
+    }
+    json["blackCaptured"] = blackCapturedArray;
+    
+    return json;
+}
+
+std::unique_ptr<ChessBoard> ChessSerializer::deserializeBoard(const QJsonObject& json) {
+    auto board = std::make_unique<ChessBoard>();
+    
+    // Clear the board
+    board->position.clear();
+    
+    // Deserialize pieces
+    QJsonArray piecesArray = json["pieces"].toArray();
+    for (const QJsonValue& value : piecesArray) {
+        QJsonObject pieceObj = value.toObject();
+        Position pos = Position::fromAlgebraic(pieceObj["position"].toString().toStdString());
+        if (pos.isValid()) {
+            std::unique_ptr<ChessPiece> piece = deserializePiece(pieceObj);
+            if (piece) {
+                board->position.addPiece(BitboardPosition::square(pos), piece->getType(),
+                                         piece->getColor(), !piece->hasMoved());
+            }
+        }
+    }
+    board->position.refreshCastlingRights();
+    
+    // Deserialize current turn
+    board->setCurrentTurn(json["currentTurn"].toString() == "white" ? PieceColor::WHITE : PieceColor::BLACK);
+    
+    // Deserialize en passant target
+    std::string enPassantStr = json["enPassantTarget"].toString().toStdString();
+    if (!enPassantStr.empty()) {
+        board->setEnPassantTarget(Position::fromAlgebraic(enPassantStr));
+    }
+    
+    // Deserialize move history
+    QJsonArray moveHistoryArray = json["moveHistory"].toArray();
+    for (const QJsonValue& value : moveHistoryArray) {
+        board->moveHistory.push_back(deserializeMove(value.toObject()));
+    }
+    
+    // Deserialize captured pieces
+    QJsonArray whiteCapturedArray = json["whiteCaptured"].toArray();
+    for (const QJsonValue& value : whiteCapturedArray) {
+        std::string typeStr = value.toString().toStdString();
+        PieceType type = PieceType::PAWN;  // Default
+        if (typeStr == "pawn") type = PieceType::PAWN;
+        else if (typeStr == "knight") type = PieceType::KNIGHT;
+        else if (typeStr == "bishop") type = PieceType::BISHOP;
+        else if (typeStr == "rook") type = PieceType::ROOK;
+        else if (typeStr == "queen") type = PieceType::QUEEN;
+        
+        board->capturedWhitePieces.push_back(type);
+    }
+    
+    QJsonArray blackCapturedArray = json["blackCaptured"].toArray();
+    for (const QJsonValue& value : blackCapturedArray) {
+        std::string typeStr = value.toString().toStdString();
+        PieceType type = PieceType::PAWN;  // Default
+        if (typeStr == "pawn") type = PieceType::PAWN;
+        else if (typeStr == "knight") type = PieceType::KNIGHT;
+        else if (typeStr == "bishop") type = PieceType::BISHOP;
+        else if (typeStr == "rook") type = PieceType::ROOK;
+        else if (typeStr == "queen") type = PieceType::QUEEN;
+        
+        board->capturedBlackPieces.push_back(type);
+    }
+    
+    // Seed the repetition history with the restored position
+    board->boardStates.push_back(board->position.zobristKey);
+    
+    return board;
+}
+
+QJsonObject ChessSerializer::serializePiece(const ChessPiece* piece, const Position& pos) {
+    QJsonObject json;
+    
+    json["position"] = QString::fromStdString(pos.toAlgebraic());
+    json["type"] = [piece]() -> QString {
+        switch (piece->getType()) {
+            case PieceType::PAWN: return "pawn";
+            case PieceType::KNIGHT: return "knight";
+            case PieceType::BISHOP: return "bishop";
+            case PieceType::ROOK: return "rook";
+            case PieceType::QUEEN: return "queen";
+            case PieceType::KING: return "king";
+            default: return "empty";
+        }
+    }();
+    
+    json["color"] = (piece->getColor() == PieceColor::WHITE) ? "white" : "black";
+    json["moved"] = piece->hasMoved();
+    
+    return json;
+}
+
+std::unique_ptr<ChessPiece> ChessSerializer::deserializePiece(const QJsonObject& json) {
+    std::string typeStr = json["type"].toString().toStdString();
+    std::string colorStr = json["color"].toString().toStdString();
+    bool moved = json["moved"].toBool();
+    
+    PieceColor color = (colorStr == "white") ? PieceColor::WHITE : PieceColor::BLACK;
+    std::unique_ptr<ChessPiece> piece;
+    
+    if (typeStr == "pawn") {
+        piece = std::make_unique<Pawn>(color);
+    } else if (typeStr == "knight") {
+        piece = std::make_unique<Knight>(color);
+    } else if (typeStr == "bishop") {
+        piece = std::make_unique<Bishop>(color);
+    } else if (typeStr == "rook") {
+        piece = std::make_unique<Rook>(color);
+    } else if (typeStr == "queen") {
+        piece = std::make_unique<Queen>(color);
+    } else if (typeStr == "king") {
+        piece = std::make_unique<King>(color);
+    } else {
+        return nullptr;
+    }
+    
+    piece->setMoved(moved);
+    return piece;
+}
+
+QJsonObject ChessSerializer::serializeMove(const ChessMove& move) {
+    QJsonObject json;
+    
+    json["from"] = QString::fromStdString(move.getFrom().toAlgebraic());
+    json["to"] = QString::fromStdString(move.getTo().toAlgebraic());
+    
+    if (move.getPromotionType() != PieceType::EMPTY) {
+        json["promotion"] = [move]() -> QString {
+            switch (move.getPromotionType()) {
+                case PieceType::QUEEN: return "queen";
+                case PieceType::ROOK: return "rook";
+                case PieceType::BISHOP: return "bishop";
+                case PieceType::KNIGHT: return "knight";
+                default: return "";
+            }
+        }();
+    }
+    
+    return json;
+}
+
+ChessMove ChessSerializer::deserializeMove(const QJsonObject& json) {
+    Position from = Position::fromAlgebraic(json["from"].toString().toStdString());
+    Position to = Position::fromAlgebraic(json["to"].toString().toStdString());
+    
+    PieceType promotionType = PieceType::EMPTY;
+    if (json.contains("promotion")) {
+        std::string promotionStr = json["promotion"].toString().toStdString();
+        if (promotionStr == "queen") promotionType = PieceType::QUEEN;
+        else if (promotionStr == "rook") promotionType = PieceType::ROOK;
+        else if (promotionStr == "bishop") promotionType = PieceType::BISHOP;
+        else if (promotionStr == "knight") promotionType = PieceType::KNIGHT;
+    }
+    
+    return ChessMove(from, to, promotionType);
+}
+
+// PGN export and import of stored games
+static const char* pgnResultToken(const QString& result) {
+    if (result == "white_win") return "1-0";
+    if (result == "black_win") return "0-1";
+    if (result == "draw") return "1/2-1/2";
+    return "*";
+}
+
+static QString resultFromPgnToken(const std::string& token) {
+    if (token == "1-0") return "white_win";
+    if (token == "0-1") return "black_win";
+    if (token == "1/2-1/2") return "draw";
+    return "in_progress";
+}
+
+// Base time in seconds of each time control, as written in the TimeControl tag
+static const std::pair<const char*, const char*> PGN_TIME_CONTROLS[] = {
+    { "rapid", "600" }, { "blitz", "300" }, { "bullet", "60" }, { "classical", "5400" }, { "casual", "-" }
+};
+
+static void appendPgnTag(std::string& pgn, const char* name, const std::string& value) {
+    pgn += '[';
+    pgn += name;
+    pgn += " \"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            pgn += '\\';
+        }
+        pgn += c;
+    }
+    pgn += "\"]\n";
+}
+
+static char pgnPieceLetter(PieceType type) {
+    switch (type) {
+        case PieceType::KNIGHT: return 'N';
+        case PieceType::BISHOP: return 'B';
+        case PieceType::ROOK:   return 'R';
+        case PieceType::QUEEN:  return 'Q';
+        case PieceType::KING:   return 'K';
+        default:                return '\0';
+    }
+}
+
+static PieceType pieceFromPgnLetter(char letter) {
+    switch (letter) {
+        case 'N': return PieceType::KNIGHT;
+        case 'B': return PieceType::BISHOP;
+        case 'R': return PieceType::ROOK;
+        case 'Q': return PieceType::QUEEN;
+        case 'K': return PieceType::KING;
+        default:  return PieceType::EMPTY;
+    }
+}
+
+std::string ChessSerializer::sanWithoutSuffix(const ChessBoard& board, const ChessMove& move,
+                                              const MoveList& legalMoves) {
+    Position from = move.getFrom();
+    Position to = move.getTo();
+    PieceType type = board.getPiece(from)->getType();
+    
+    if (type == PieceType::KING && std::abs(to.col - from.col) == 2) {
+        return to.col > from.col ? "O-O" : "O-O-O";
+    }
+    
+    std::string san;
+    bool isCapture = board.getPiece(to) != nullptr || board.isEnPassantCapture(move);
+    if (type == PieceType::PAWN) {
+        if (isCapture) {
+            san += static_cast<char>('a' + from.col);
+        }
+    } else {
+        san += pgnPieceLetter(type);
+        
+        // Name the file if that tells the movers apart, else the rank, else both
+        bool ambiguous = false;
+        bool sameFile = false;
+        bool sameRank = false;
+        for (const ChessMove& other : legalMoves) {
+            Position otherFrom = other.getFrom();
+            if (other.getTo() != to || otherFrom == from || board.getPiece(otherFrom)->getType() != type) {
+                continue;
+            }
+            ambiguous = true;
+            sameFile = sameFile || otherFrom.col == from.col;
+            sameRank = sameRank || otherFrom.row == from.row;
+        }
+        if (ambiguous) {
+            if (!sameFile) {
+                san += static_cast<char>('a' + from.col);
+            } else if (!sameRank) {
+                san += static_cast<char>('1' + from.row);
+            } else {
+                san += from.toAlgebraic();
+            }
+        }
+    }
+    
+    if (isCapture) {
+        san += 'x';
+    }
+    san += to.toAlgebraic();
+    if (move.getPromotionType() != PieceType::EMPTY) {
+        san += '=';
+        san += pgnPieceLetter(move.getPromotionType());
+    }
+    return san;
+}
+
+ChessMove ChessSerializer::moveFromSan(const ChessBoard& board, const std::string& san, const MoveList& legalMoves) {
+    std::string token = san;
+    while (!token.empty() && std::strchr("+#!?", token.back())) {
+        token.pop_back();
+    }
+    
+    // Castling is a two-square king move
+    int castlingDirection = 0;
+    if (token == "O-O" || token == "0-0") {
+        castlingDirection = 1;
+    } else if (token == "O-O-O" || token == "0-0-0") {
+        castlingDirection = -1;
+    }
+    if (castlingDirection != 0) {
+        for (const ChessMove& move : legalMoves) {
+            if (board.getPiece(move.getFrom())->getType() == PieceType::KING &&
+                move.getTo().col - move.getFrom().col == 2 * castlingDirection) {
+                return move;
+            }
+        }
+        return ChessMove();
+    }
+    
+    PieceType type = PieceType::PAWN;
+    size_t start = 0;
+    if (!token.empty() && pieceFromPgnLetter(token[0]) != PieceType::EMPTY) {
+        type = pieceFromPgnLetter(token[0]);
+        start = 1;
+    }
+    
+    // "e8=Q", and also "e8Q" as some writers produce
+    PieceType promotion = PieceType::EMPTY;
+    if (type == PieceType::PAWN && token.size() >= 3 && pieceFromPgnLetter(token.back()) != PieceType::EMPTY) {
+        promotion = pieceFromPgnLetter(token.back());
+        token.pop_back();
+        if (token.back() == '=') {
+            token.pop_back();
+        }
+    }
+    
+    if (token.size() < start + 2) {
+        return ChessMove();
+    }
+    Position to = Position::fromAlgebraic(token.substr(token.size() - 2));
+    if (!to.isValid()) {
+        return ChessMove();
+    }
+    
+    // What is left names the mover's file, rank or square; the full square makes
+    // coordinate notation such as "e2e4" work too
+    int fromCol = -1;
+    int fromRow = -1;
+    for (size_t i = start; i < token.size() - 2; ++i) {
+        char c = token[i];
+        if (c >= 'a' && c <= 'h') {
+            fromCol = c - 'a';
+        } else if (c >= '1' && c <= '8') {
+            fromRow = c - '1';
+        } else if (c != 'x' && c != '-' && c != ':') {
+            return ChessMove();
+        }
+    }
+    
+    ChessMove match;
+    int matches = 0;
+    for (const ChessMove& move : legalMoves) {
+        Position from = move.getFrom();
+        if (move.getTo() != to || board.getPiece(from)->getType() != type ||
+            (fromCol >= 0 && from.col != fromCol) || (fromRow >= 0 && from.row != fromRow)) {
+            continue;
+        }
+        
+        // A promotion written without its piece is taken to be a queen
+        PieceType wanted = promotion;
+        if (wanted == PieceType::EMPTY && move.getPromotionType() != PieceType::EMPTY) {
+            wanted = PieceType::QUEEN;
+        }
+        if (move.getPromotionType() == wanted) {
+            match = move;
+            ++matches;
+        }
+    }
+    return matches == 1 ? match : ChessMove();
+}
+
+bool ChessSerializer::gameJsonToPgn(const QJsonObject& gameJson, int whiteElo, int blackElo, std::string& pgn,
+                                    std::string& error) {
+    QString result = gameJson["result"].toString("in_progress");
+    QString timeControl = gameJson["timeControl"].toString();
+    QDateTime startTime = QDateTime::fromString(gameJson["startTime"].toString(), Qt::ISODate);
+    
+    // Seven tag roster first, then what the import needs to restore the game
+    pgn.clear();
+    appendPgnTag(pgn, "Event", "Multiplayer Chess " + (timeControl.isEmpty() ? "game" : timeControl.toStdString() + " game"));
+    appendPgnTag(pgn, "Site", "MPChess");
+    appendPgnTag(pgn, "Date", startTime.isValid() ? startTime.toUTC().toString("yyyy.MM.dd").toStdString() : "????.??.??");
+    appendPgnTag(pgn, "Round", "-");
+    appendPgnTag(pgn, "White", gameJson["whitePlayer"].toString("?").toStdString());
+    appendPgnTag(pgn, "Black", gameJson["blackPlayer"].toString("?").toStdString());
+    appendPgnTag(pgn, "Result", pgnResultToken(result));
+    if (whiteElo > 0) {
+        appendPgnTag(pgn, "WhiteElo", std::to_string(whiteElo));
+    }
+    if (blackElo > 0) {
+        appendPgnTag(pgn, "BlackElo", std::to_string(blackElo));
+    }
+    for (const auto& [name, seconds] : PGN_TIME_CONTROLS) {
+        if (timeControl == name) {
+            appendPgnTag(pgn, "TimeControl", seconds);
+        }
+    }
+    appendPgnTag(pgn, "GameId", gameJson["gameId"].toString().toStdString());
+    if (startTime.isValid()) {
+        appendPgnTag(pgn, "StartTime", startTime.toUTC().toString(Qt::ISODate).toStdString());
+    }
+    if (gameJson.contains("endTime")) {
+        appendPgnTag(pgn, "EndTime", QDateTime::fromString(gameJson["endTime"].toString(), Qt::ISODate)
+                                         .toUTC().toString(Qt::ISODate).toStdString());
+    }
+    pgn += '\n';
+    
+    // Movetext in lines of at most 79 characters. One move generation per ply serves
+    // the legality check, the disambiguation and the check or mate suffix
+    ChessBoard board;
+    board.initialize();
+    MoveList legalMoves;
+    board.generateLegalMoves(board.getCurrentTurn(), legalMoves);
+    
+    std::string line;
+    auto appendToken = [&pgn, &line](const std::string& token) {
+        if (!line.empty() && line.size() + 1 + token.size() > 79) {
+            pgn += line;
+            pgn += '\n';
+            line.clear();
+        }
+        if (!line.empty()) {
+            line += ' ';
+        }
+        line += token;
+    };
+    
+    QJsonArray moves = gameJson["moveHistory"].toArray();
+    for (int ply = 0; ply < moves.size(); ++ply) {
+        ChessMove move = deserializeMove(moves[ply].toObject());
+        if (std::find(legalMoves.begin(), legalMoves.end(), move) == legalMoves.end()) {
+            error = "illegal move " + move.toAlgebraic() + " at ply " + std::to_string(ply + 1);
+            return false;
+        }
+        
+        std::string san = sanWithoutSuffix(board, move, legalMoves);
+        ChessBoard::MoveUndo undo;
+        board.makeMove(move, undo);
+        board.generateLegalMoves(board.getCurrentTurn(), legalMoves);
+        if (board.isInCheck(board.getCurrentTurn())) {
+            san += legalMoves.empty() ? '#' : '+';
+        }
+        
+        if (ply % 2 == 0) {
+            appendToken(std::to_string(ply / 2 + 1) + ".");
+        }
+        appendToken(san);
+    }
+    appendToken(pgnResultToken(result));
+    pgn += line;
+    pgn += "\n\n";
+    return true;
+}
+
+bool ChessSerializer::pgnToGameJson(const std::string& pgn, QJsonObject& gameJson, int& whiteElo, int& blackElo,
+                                    std::string& error) {
+    std::map<std::string, std::string> tags;
+    std::string movetext;
+    
+    // Tag pairs are whole lines; everything else is movetext
+    std::istringstream input(pgn);
+    std::string line;
+    while (std::getline(input, line)) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] != '[') {
+            movetext += line;
+            movetext += '\n';
+            continue;
+        }
+        
+        size_t nameEnd = line.find_first_of(" \t", first);
+        size_t quote = nameEnd == std::string::npos ? std::string::npos : line.find('"', nameEnd);
+        if (quote == std::string::npos) {
+            error = "malformed tag: " + line;
+            return false;
+        }
+        std::string value;
+        size_t i = quote + 1;
+        for (; i < line.size() && line[i] != '"'; ++i) {
+            if (line[i] == '\\' && i + 1 < line.size()) {
+                ++i;
+            }
+            value += line[i];
+        }
+        if (i >= line.size()) {
+            error = "unterminated tag: " + line;
+            return false;
+        }
+        tags[line.substr(first + 1, nameEnd - first - 1)] = value;
+    }
+    
+    ChessBoard board;
+    board.initialize();
+    MoveList legalMoves;
+    board.generateLegalMoves(board.getCurrentTurn(), legalMoves);
+    
+    QJsonArray moveHistory;
+    std::string resultToken = "*";
+    size_t pos = 0;
+    while (pos < movetext.size()) {
+        char c = movetext[pos];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++pos;
+        } else if (c == '{') {
+            size_t end = movetext.find('}', pos);
+            pos = end == std::string::npos ? movetext.size() : end + 1;
+        } else if (c == ';') {
+            size_t end = movetext.find('\n', pos);
+            pos = end == std::string::npos ? movetext.size() : end + 1;
+        } else if (c == '(') {
+            // Variations are skipped, comments inside them included
+            int depth = 0;
+            for (; pos < movetext.size(); ++pos) {
+                if (movetext[pos] == '{') {
+                    size_t end = movetext.find('}', pos);
+                    pos = end == std::string::npos ? movetext.size() - 1 : end;
+                } else if (movetext[pos] == '(') {
+                    ++depth;
+                } else if (movetext[pos] == ')' && --depth == 0) {
+                    ++pos;
+                    break;
+                }
+            }
+        } else if (c == '$') {
+            for (++pos; pos < movetext.size() && std::isdigit(static_cast<unsigned char>(movetext[pos])); ++pos) {
+            }
+        } else {
+            size_t end = pos;
+            while (end < movetext.size() && !std::isspace(static_cast<unsigned char>(movetext[end])) &&
+                   !std::strchr("{}();$", movetext[end])) {
+                ++end;
+            }
+            std::string token = movetext.substr(pos, end - pos);
+            pos = end;
+            
+            if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") {
+                resultToken = token;
+                break;
+            }
+            
+            // Move numbers may be glued to the move ("12.e4", "12...e5")
+            size_t digits = token.find_first_not_of("0123456789");
+            if (digits == std::string::npos) {
+                continue;
+            }
+            if (token[digits] == '.') {
+                size_t moveStart = token.find_first_not_of('.', digits);
+                token = moveStart == std::string::npos ? std::string() : token.substr(moveStart);
+            }
+            if (token.empty()) {
+                continue;
+            }
+            
+            ChessMove move = moveFromSan(board, token, legalMoves);
+            if (!move.isValid()) {
+                error = "unreadable move " + token + " at ply " + std::to_string(moveHistory.size() + 1);
+                return false;
+            }
+            
+            QJsonObject moveObj = serializeMove(move);
+            std::string san = sanWithoutSuffix(board, move, legalMoves);
+            ChessBoard::MoveUndo undo;
+            board.makeMove(move, undo);
+            board.generateLegalMoves(board.getCurrentTurn(), legalMoves);
+            if (board.isInCheck(board.getCurrentTurn())) {
+                san += legalMoves.empty() ? '#' : '+';
+            }
+            moveObj["algebraic"] = QString::fromStdString(san);
+            moveHistory.append(moveObj);
+        }
+    }
+    
+    QString result = resultFromPgnToken(tags.count("Result") ? tags["Result"] : resultToken);
+    
+    // Our own exports keep their id; anything else gets one derived from its text, so
+    // importing the same file twice replaces the games instead of duplicating them.
+    // Ids end up in file names, so only plain ones are kept
+    std::string gameId = tags["GameId"];
+    if (gameId.empty() || gameId.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") !=
+                              std::string::npos) {
+        QByteArray digest = QCryptographicHash::hash(QByteArray::fromStdString(pgn), QCryptographicHash::Sha1);
+        gameId = "pgn-" + digest.toHex().left(16).toStdString();
+    }
+    
+    QString timeControl = "rapid";
+    for (const auto& [name, seconds] : PGN_TIME_CONTROLS) {
+        if (tags["TimeControl"] == seconds) {
+            timeControl = name;
+        }
+    }
+    
+    QDateTime startTime = QDateTime::fromString(QString::fromStdString(tags["StartTime"]), Qt::ISODate);
+    if (!startTime.isValid()) {
+        startTime = QDateTime(QDate::fromString(QString::fromStdString(tags["Date"]), "yyyy.MM.dd"), QTime(0, 0), Qt::UTC);
+    }
+    QDateTime endTime = QDateTime::fromString(QString::fromStdString(tags["EndTime"]), Qt::ISODate);
+    
+    gameJson = QJsonObject();
+    gameJson["gameId"] = QString::fromStdString(gameId);
+    gameJson["whitePlayer"] = QString::fromStdString(tags.count("White") ? tags["White"] : "?");
+    gameJson["blackPlayer"] = QString::fromStdString(tags.count("Black") ? tags["Black"] : "?");
+    gameJson["timeControl"] = timeControl;
+    gameJson["result"] = result;
+    gameJson["currentTurn"] = board.getCurrentTurn() == PieceColor::WHITE ? "white" : "black";
+    gameJson["moveHistory"] = moveHistory;
+    if (startTime.isValid()) {
+        gameJson["startTime"] = startTime.toString(Qt::ISODate);
+    }
+    if (result != "in_progress") {
+        if (!endTime.isValid()) {
+            endTime = startTime;
+        }
+        if (endTime.isValid()) {
+            gameJson["endTime"] = endTime.toString(Qt::ISODate);
+        }
+    }
+    
+    whiteElo = QString::fromStdString(tags["WhiteElo"]).toInt();
+    blackElo = QString::fromStdString(tags["BlackElo"]).toInt();
+    return true;
+}
+
+bool PgnReader::next(std::string& game) {
+    game.clear();
+    bool inMovetext = false;
+    
+    while (true) {
+        QByteArray line;
+        if (hasPendingLine) {
+            line = pendingLine;
+            hasPendingLine = false;
+        } else {
+            line = device->readLine();
+            if (line.isEmpty()) {
+                break;  // End of the input
+            }
+        }
+        
+        QByteArray trimmed = line.trimmed();
+        if (trimmed.startsWith('%')) {
+            continue;
+        }
+        if (trimmed.startsWith('[') && inMovetext) {
+            pendingLine = line;
+            hasPendingLine = true;
+            break;
+        }
+        if (!trimmed.isEmpty() && !trimmed.startsWith('[')) {
+            inMovetext = true;
+        }
+        if (!trimmed.isEmpty() || !game.empty()) {
+            game.append(trimmed.constData(), trimmed.size());
+            game += '\n';
+        }
+    }
+    
+    return game.find_first_not_of(" \t\r\n") != std::string::npos;
+}
+
+// Implementation of WireProtocol class
+QByteArray WireProtocol::encode(const QJsonObject& message, bool compress)
+{
+    MessageType type = static_cast<MessageType>(message["type"].toInt());
+    
+    QByteArray payload;
+    Encoding encoding = Encoding::PACKED;
+    if (!encodePacked(type, message, payload)) {
+        encoding = Encoding::CBOR;
+        
+        QJsonObject fields = message;
+        fields.remove("type");
+        if (type == MessageType::GAME_STATE && fields["gameState"].toObject().contains("board")) {
+            // The board is 64 small objects in JSON; send the placement instead
+            QJsonObject gameState = fields["gameState"].toObject();
+            gameState["board"] = packBoard(gameState["board"].toArray());
+            gameState.remove("asciiBoard");
+            fields["gameState"] = gameState;
+        }
+        payload = QCborMap::fromJsonObject(fields).toCborValue().toCbor();
+        
+        if (compress && payload.size() >= COMPRESSION_THRESHOLD) {
+            QByteArray compressed = qCompress(payload);
+            if (compressed.size() < payload.size()) {
+                payload = compressed;
+                encoding = Encoding::COMPRESSED_CBOR;
+            }
+        }
+    }
+    
+    QByteArray frame;
+    frame.reserve(HEADER_SIZE + payload.size());
+    frame.resize(4);
+    qToBigEndian<quint32>(static_cast<quint32>(2 + payload.size()), frame.data());
+    frame.append(static_cast<char>(type));
+    frame.append(static_cast<char>(encoding));
+    frame.append(payload);
+    return frame;
+}
+
+qsizetype WireProtocol::frameSize(const char* data, qsizetype available)
+{
+    if (available < 4) {
+        return 0;
+    }
+    
+    quint32 size = qFromBigEndian<quint32>(data);
+    if (size < 2 || size > MAX_FRAME_SIZE) {
+        return -1;
+    }
+    return 4 + static_cast<qsizetype>(size);
+}
+
+bool WireProtocol::decode(const char* frame, qsizetype size, QJsonObject& message)
+{
+    if (size < HEADER_SIZE || frameSize(frame, size) != size) {
+        return false;
+    }
+    
+    MessageType type = static_cast<MessageType>(static_cast<quint8>(frame[4]));
+    Encoding encoding = static_cast<Encoding>(static_cast<quint8>(frame[5]));
+    const char* payload = frame + HEADER_SIZE;
+    qsizetype payloadSize = size - HEADER_SIZE;
+    
+    if (encoding == Encoding::PACKED) {
+        message = QJsonObject();
+        if (!decodePacked(type, payload, payloadSize, message)) {
+            return false;
+        }
+    } else if (encoding == Encoding::CBOR || encoding == Encoding::COMPRESSED_CBOR) {
+        QByteArray cbor = QByteArray::fromRawData(payload, payloadSize);
+        if (encoding == Encoding::COMPRESSED_CBOR) {
+            // qCompress() output starts with the expanded size; refuse anything oversized
+            if (payloadSize < 4 || qFromBigEndian<quint32>(payload) > MAX_UNCOMPRESSED_SIZE) {
+                return false;
+            }
+            cbor = qUncompress(cbor);
+            if (cbor.isEmpty()) {
+                return false;
+            }
+        }
+        
+        QCborValue value = QCborValue::fromCbor(cbor);
+        if (!value.isMap()) {
+            return false;
+        }
+        message = value.toMap().toJsonObject();
+        if (type == MessageType::GAME_STATE && message["gameState"].toObject()["board"].isString()) {
+            QJsonObject gameState = message["gameState"].toObject();
+            gameState["board"] = unpackBoard(gameState["board"].toString());
+            message["gameState"] = gameState;
+        }
+    } else {
+        return false;
+    }
+    
+    message["type"] = static_cast<int>(type);
+    return true;
+}
+
+bool WireProtocol::encodePacked(MessageType type, const QJsonObject& message, QByteArray& payload)
+{
+    if (type == MessageType::MOVE) {
+        // uint8 gameId length, gameId, uint16 move
+        QByteArray gameId = message["gameId"].toString().toUtf8();
+        quint16 move;
+        if (message.size() != 3 || gameId.size() > 255 || !packMove(message["move"].toString(), move)) {
+            return false;
+        }
+        
+        payload.resize(1 + gameId.size() + 2);
+        payload[0] = static_cast<char>(gameId.size());
+        std::memcpy(payload.data() + 1, gameId.constData(), gameId.size());
+        qToBigEndian<quint16>(move, payload.data() + 1 + gameId.size());
+        return true;
+    }
+    
+    if (type == MessageType::MOVE_RESULT) {
+        // uint8 success, then the optional message text
+        bool hasText = message.contains("message");
+        if (message.size() != (hasText ? 3 : 2) || !message["success"].isBool()) {
+            return false;
+        }
+        
+        payload.append(static_cast<char>(message["success"].toBool() ? 1 : 0));
+        if (hasText) {
+            payload.append(message["message"].toString().toUtf8());
+        }
+        return true;
+    }
+    
+    return false;
+}
+
+bool WireProtocol::decodePacked(MessageType type, const char* payload, qsizetype size, QJsonObject& message)
+{
+    if (type == MessageType::MOVE) {
+        if (size < 1) return false;
+        int gameIdLength = static_cast<quint8>(payload[0]);
+        if (size != 1 + gameIdLength + 2) return false;
+        
+        message["gameId"] = QString::fromUtf8(payload + 1, gameIdLength);
+        message["move"] = unpackMove(qFromBigEndian<quint16>(payload + 1 + gameIdLength));
+        return true;
+    }
+    
+    if (type == MessageType::MOVE_RESULT) {
+        if (size < 1) return false;
+        message["success"] = payload[0] != 0;
+        if (size > 1) {
+            message["message"] = QString::fromUtf8(payload + 1, size - 1);
+        }
+        return true;
+    }
+    
+    return false;
+}
+
+bool WireProtocol::packMove(const QString& move, quint16& packed)
+{
+    static const char promotions[] = "qrbn";
+    
+    QByteArray text = move.toLatin1();
+    if (text.size() != 4 && text.size() != 5) return false;
+    
+    int squares[2];
+    for (int i = 0; i < 2; ++i) {
+        int col = text[i * 2] - 'a';
+        int row = text[i * 2 + 1] - '1';
+        if (col < 0 || col > 7 || row < 0 || row > 7) return false;
+        squares[i] = row * 8 + col;
+    }
+    
+    int promotion = 0;
+    if (text.size() == 5) {
+        const char* found = std::strchr(promotions, text[4]);
+        if (!found || !*found) return false;
+        promotion = static_cast<int>(found - promotions) + 1;
+    }
+    
+    packed = static_cast<quint16>(squares[0] | (squares[1] << 6) | (promotion << 12));
+    return true;
+}
+
+QString WireProtocol::unpackMove(quint16 packed)
+{
+    static const char promotions[] = "qrbn";
+    
+    std::string text;
+    for (int sq : { packed & 0x3F, (packed >> 6) & 0x3F }) {
+        text += static_cast<char>('a' + sq % 8);
+        text += static_cast<char>('1' + sq / 8);
+    }
+    
+    int promotion = (packed >> 12) & 0x7;
+    if (promotion >= 1 && promotion <= 4) {
+        text += promotions[promotion - 1];
+    }
+    return QString::fromStdString(text);
+}
+
+QString WireProtocol::packBoard(const QJsonArray& board)
+{
+    std::string placement(64, '.');
+    for (int r = 0; r < 8 && r < board.size(); ++r) {
+        QJsonArray row = board[r].toArray();
+        for (int c = 0; c < 8 && c < row.size(); ++c) {
+            QJsonObject piece = row[c].toObject();
+            QString type = piece["type"].toString();
+            
+            char symbol = '.';
+            if (type == "pawn") symbol = 'p';
+            else if (type == "knight") symbol = 'n';
+            else if (type == "bishop") symbol = 'b';
+            else if (type == "rook") symbol = 'r';
+            else if (type == "queen") symbol = 'q';
+            else if (type == "king") symbol = 'k';
+            
+            if (symbol != '.' && piece["color"].toString() == "white") {
+                symbol = static_cast<char>(std::toupper(symbol));
+            }
+            placement[r * 8 + c] = symbol;
+        }
+    }
+    return QString::fromStdString(placement);
+}
+
+QJsonArray WireProtocol::unpackBoard(const QString& placement)
+{
+    std::string text = placement.toStdString();
+    text.resize(64, '.');
+    
+    QJsonArray board;
+    for (int r = 0; r < 8; ++r) {
+        QJsonArray row;
+        for (int c = 0; c < 8; ++c) {
+            char symbol = text[r * 8 + c];
+            QJsonObject piece;
+            
+            switch (std::tolower(static_cast<unsigned char>(symbol))) {
+                case 'p': piece["type"] = "pawn"; break;
+                case 'n': piece["type"] = "knight"; break;
+                case 'b': piece["type"] = "bishop"; break;
+                case 'r': piece["type"] = "rook"; break;
+                case 'q': piece["type"] = "queen"; break;
+                case 'k': piece["type"] = "king"; break;
+                default:  piece["type"] = "empty"; break;
+            }
+            
+            if (piece["type"].toString() == "empty") {
+                piece["color"] = "none";
+            } else {
+                piece["color"] = std::isupper(static_cast<unsigned char>(symbol)) ? "white" : "black";
+            }
+            row.append(piece);
+        }
+        board.append(row);
+    }
+    return board;
+}
+
+// Implementation of MessageFramer class
+void MessageFramer::readFrom(QIODevice* device)
+{
+    // Drop consumed bytes before growing the buffer, so it stays bounded by the unread input
+    if (readOffset > 0) {
+        buffer.remove(0, readOffset);
+        if (scanOffset >= 0) {
+            scanOffset -= readOffset;
+        }
+        readOffset = 0;
+    }
+    
+    qint64 available = device->bytesAvailable();
+    if (available <= 0) {
+        return;
+    }
+    
+    qsizetype oldSize = buffer.size();
+    buffer.resize(oldSize + available);
+    qint64 bytesRead = device->read(buffer.data() + oldSize, available);
+    buffer.resize(oldSize + std::max<qint64>(0, bytesRead));
+}
+
+MessageFramer::Status MessageFramer::next(QJsonObject& message, std::string& error)
+{
+    // Skip the newlines between compact JSON messages
+    while (readOffset < buffer.size() && std::isspace(static_cast<unsigned char>(buffer[readOffset]))) {
+        ++readOffset;
+    }
+    if (readOffset >= buffer.size()) {
+        return Status::INCOMPLETE;
+    }
+    
+    const char* start = buffer.constData() + readOffset;
+    qsizetype available = buffer.size() - readOffset;
+    
+    // A zero byte starts a binary frame
+    if (*start == '\0') {
+        qsizetype frameSize = WireProtocol::frameSize(start, available);
+        if (frameSize < 0) {
+            error = "binary frame exceeds " + std::to_string(WireProtocol::MAX_FRAME_SIZE) + " bytes";
+            return Status::FATAL;
+        }
+        if (frameSize == 0 || frameSize > available) {
+            return Status::INCOMPLETE;
+        }
+        
+        bool decoded = WireProtocol::decode(start, frameSize, message);
+        consume(frameSize);
+        if (!decoded) {
+            error = "malformed binary frame";
+            return Status::INVALID;
+        }
+        return Status::MESSAGE;
+    }
+    
+    if (*start != '{') {
+        error = "unexpected byte " + std::to_string(static_cast<unsigned char>(*start)) + " between messages";
+        return Status::FATAL;
+    }
+    
+    qsizetype end = scanJsonObject();
+    if (end < 0) {
+        if (available > static_cast<qsizetype>(WireProtocol::MAX_FRAME_SIZE)) {
+            error = "JSON message exceeds " + std::to_string(WireProtocol::MAX_FRAME_SIZE) + " bytes";
+            return Status::FATAL;
+        }
+        return Status::INCOMPLETE;
+    }
+    
+    // Parse in place; fromRawData does not copy the bytes
+    qsizetype length = end - readOffset;
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(start, length), &parseError);
+    consume(length);
+    
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        error = "invalid JSON: " + parseError.errorString().toStdString();
+        return Status::INVALID;
+    }
+    
+    message = doc.object();
+    return Status::MESSAGE;
+}
+
+void MessageFramer::consume(qsizetype bytes)
+{
+    readOffset += bytes;
+    resetScan();
+}
+
+qsizetype MessageFramer::scanJsonObject()
+{
+    // Resume where the last call stopped instead of rescanning the partial message
+    if (scanOffset < 0) {
+        scanOffset = readOffset;
+    }
+    
+    const char* data = buffer.constData();
+    for (; scanOffset < buffer.size(); ++scanOffset) {
+        char c = data[scanOffset];
+        
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            ++depth;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                return ++scanOffset;
+            }
+        }
+    }
+    
+    return -1;
+}
+
+// Implementation of TokenBucket class
+void TokenBucket::refill(qint64 nowMs)
+{
+    if (lastRefillMs >= 0 && nowMs > lastRefillMs) {
+        tokens = std::min(capacity, tokens + (nowMs - lastRefillMs) * refillPerSecond / 1000.0);
+    }
+    lastRefillMs = nowMs;
+}
+
+bool TokenBucket::tryConsume(qint64 nowMs)
+{
+    refill(nowMs);
+    if (tokens < 1.0) {
+        return false;
+    }
+    tokens -= 1.0;
+    return true;
+}
+
+qint64 TokenBucket::msUntilToken(qint64 nowMs)
+{
+    refill(nowMs);
+    if (tokens >= 1.0) {
+        return 0;
+    }
+    return static_cast<qint64>(std::ceil((1.0 - tokens) * 1000.0 / refillPerSecond));
+}
+
+// Implementation of InboundConnection class
+InboundConnection::InboundConnection() : throttled(false), retryScheduled(false)
+{
+    // Burst size and sustained rate per second for each class
+    buckets[static_cast<size_t>(MessageClass::GAMEPLAY)] = TokenBucket(40, 20);
+    buckets[static_cast<size_t>(MessageClass::SESSION)] = TokenBucket(10, 2);
+    buckets[static_cast<size_t>(MessageClass::CHAT)] = TokenBucket(10, 2);
+    buckets[static_cast<size_t>(MessageClass::QUERY)] = TokenBucket(10, 2);
+    buckets[static_cast<size_t>(MessageClass::ANALYSIS)] = TokenBucket(2, 0.1);
+}
+
+InboundConnection::MessageClass InboundConnection::classify(MessageType type)
+{
+    switch (type) {
+        case MessageType::MOVE:
+        case MessageType::RESIGN:
+        case MessageType::DRAW_OFFER:
+        case MessageType::DRAW_RESPONSE:
+        case MessageType::GAME_STATE_REQUEST:
+        case MessageType::PING:
+        case MessageType::PONG:
+            return MessageClass::GAMEPLAY;
+        case MessageType::CHAT:
+            return MessageClass::CHAT;
+        case MessageType::GAME_HISTORY_REQUEST:
+        case MessageType::LEADERBOARD_REQUEST:
+            return MessageClass::QUERY;
+        case MessageType::GAME_ANALYSIS_REQUEST:
+            return MessageClass::ANALYSIS;
+        default:
+            return MessageClass::SESSION;
+    }
+}
+
+qint64 InboundConnection::nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool InboundConnection::process(QTcpSocket* socket, const std::function<bool(const QJsonObject&)>& deliver,
+                                ChessLogger* logger)
+{
+    while (true) {
+        // A throttled socket is left alone so its kernel buffer fills up
+        if (!throttled) {
+            framer.readFrom(socket);
+        }
+        
+        qint64 now = nowMs();
+        
+        // Messages that were waiting go first, in order
+        while (!queued.isEmpty() && bucketFor(queued.head()).tryConsume(now)) {
+            if (!deliver(queued.dequeue())) {
+                return true;
+            }
+        }
+        
+        while (queued.size() < MAX_QUEUED_MESSAGES) {
+            QJsonObject message;
+            std::string error;
+            MessageFramer::Status status = framer.next(message, error);
+            
+            if (status == MessageFramer::Status::INCOMPLETE) {
+                break;
+            }
+            
+            if (status == MessageFramer::Status::INVALID) {
+                logger->error("Discarding message from " + socket->peerAddress().toString().toStdString() + ": " + error);
+                continue;
+            }
+            
+            if (status == MessageFramer::Status::FATAL) {
+                logger->error("Closing connection from " + socket->peerAddress().toString().toStdString() + ": " + error);
+                return false;
+            }
+            
+            if (queued.isEmpty() && bucketFor(message).tryConsume(now)) {
+                if (!deliver(message)) {
+                    return true;
+                }
+            } else {
+                queued.enqueue(message);
+            }
+        }
+        
+        if (!queued.isEmpty()) {
+            if (!throttled) {
+                throttled = true;
+                socket->setReadBufferSize(THROTTLED_READ_BUFFER_SIZE);
+                logger->warning("Throttling input from " + socket->peerAddress().toString().toStdString());
+            }
+            return true;
+        }
+        
+        if (!throttled) {
+            return true;
+        }
+        
+        // Caught up: read normally again and take whatever arrived in the meantime
+        throttled = false;
+        socket->setReadBufferSize(0);
+    }
+}
+
+qint64 InboundConnection::scheduleRetry()
+{
+    if (queued.isEmpty() || retryScheduled) {
+        return -1;
+    }
+    retryScheduled = true;
+    return std::max<qint64>(1, bucketFor(queued.head()).msUntilToken(nowMs()));
+}
+
+// Implementation of ChessLogger class
+ChessLogger::ChessLogger(const std::string& logFilePath)
+    : logLevel(0), queue(QUEUE_CAPACITY), enqueuedCount(0), droppedCount(0),
+      stopping(false), writtenCount(0), cachedSecond(-1)
+{
+    logFile.open(logFilePath, std::ios::out | std::ios::app);
+    if (!logFile.is_open()) {
+        std::cerr << "Failed to open log file: " << logFilePath << std::endl;
+    }
+    
+    writerThread = std::thread(&ChessLogger::writerLoop, this);
+    
+    log(">>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Multiplayer Chess Server Logger initialized <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<");
+}
+
+ChessLogger::~ChessLogger()
+{
+    log("Chess Server Logger shutting down");
+    
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        stopping = true;
+    }
+    writerWake.notify_one();
+    writerThread.join();
+    
+    if (logFile.is_open()) {
+        logFile.close();
+    }
+}
+
+void ChessLogger::enqueue(const char* tag, int console, std::string message, QJsonObject json)
+{
+    LogEntry entry;
+    entry.time = std::chrono::system_clock::now();
+    entry.tag = tag;
+    entry.console = console;
+    entry.message = std::move(message);
+    entry.json = std::move(json);
+    
+    if (queue.tryPush(std::move(entry))) {
+        enqueuedCount.fetch_add(1, std::memory_order_release);
+    } else {
+        droppedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ChessLogger::log(const std::string& message, bool console)
+{
+    enqueue("INFO", console ? 1 : 0, message);
+}
+
+void ChessLogger::error(const std::string& message, bool console)
+{
+    enqueue("ERROR", console ? 2 : 0, message);
+}
+
+void ChessLogger::warning(const std::string& message, bool console)
+{
+    enqueue("WARNING", console ? 1 : 0, message);
+}
+
+void ChessLogger::debug(const std::string& message, bool console)
+{
+    if (logLevel < 1) return;  // Skip debug messages if log level is too low
+    
+    enqueue("DEBUG", console ? 1 : 0, message);
+}
+
+void ChessLogger::logGameState(const ChessGame& game)
+{
+    if (logLevel < 2) return;  // Skip detailed game state if log level is too low
+    
+    // The game changes after this returns, so its state is captured here
+    std::string gameId = game.getGameId();
+    std::string whitePlayer = game.getWhitePlayer()->getUsername();
+    std::string blackPlayer = game.getBlackPlayer()->getUsername();
+    std::string currentTurn = (game.getBoard()->getCurrentTurn() == PieceColor::WHITE) ? "White" : "Black";
+    std::string asciiBoard = game.getBoardAscii();
+    
+    std::stringstream ss;
+    ss << "Game State [" << gameId << "]:\n"
+       << "White: " << whitePlayer << ", Black: " << blackPlayer << "\n"
+       << "Current Turn: " << currentTurn << "\n"
+       << asciiBoard;
+    
+    enqueue("GAME", 0, ss.str());
+}
+
+void ChessLogger::logPlayerAction(const ChessPlayer& player, const std::string& action)
+{
+    enqueue("PLAYER", 0, "Player " + player.getUsername() + ": " + action);
+}
+
+void ChessLogger::logServerEvent(const std::string& event)
+{
+    enqueue("SERVER", 0, event);
+}
+
+void ChessLogger::logNetworkMessage(const std::string& direction, const QJsonObject& message) {
+    if (logLevel < 3) return;  // Skip network messages if log level is too low
+    
+    // Copying the object only shares its data; toJson() runs on the writer thread
+    enqueue("NETWORK", 0, direction, message);
+}
+
+void ChessLogger::setLogLevel(int level)
+{
+    logLevel = level;
+    traceEnabled = level >= TRACE_LOG_LEVEL;
+}
+
+int ChessLogger::getLogLevel() const
+{
+    return logLevel;
+}
+
+void ChessLogger::trace(const std::string& message)
+{
+    MPChessServer* server = MPChessServer::getInstance();
+    if (server && server->getLogger()) {
+        MPCHESS_DEBUG(server->getLogger(), message);
+    }
+}
+
+void ChessLogger::flush()
+{
+    uint64_t target = enqueuedCount.load(std::memory_order_acquire);
+    
+    std::unique_lock<std::mutex> lock(writerMutex);
+    writerWake.notify_one();
+    writerDrained.wait(lock, [this, target]() { return writtenCount >= target || stopping; });
+}
+
+void ChessLogger::writerLoop()
+{
+    // Entries written before the file is flushed and waiters are told
+    const int BATCH_SIZE = 256;
+    
+    while (true) {
+        int written = 0;
+        LogEntry entry;
+        while (written < BATCH_SIZE && queue.tryPop(entry)) {
+            writeEntry(entry);
+            ++written;
+        }
+        
+        if (written > 0) {
+            std::lock_guard<std::mutex> lock(writerMutex);
+            writtenCount += written;
+            if (written == BATCH_SIZE) {
+                continue;  // More may be waiting; flush once the queue is drained
+            }
+        }
+        
+        uint64_t dropped = droppedCount.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            LogEntry note;
+            note.time = std::chrono::system_clock::now();
+            note.tag = "WARNING";
+            note.console = 1;
+            note.message = std::to_string(dropped) + " log messages dropped, the log queue was full";
+            writeEntry(note);
+        }
+        
+        // Drained: one flush covers the whole batch
+        if (logFile.is_open()) {
+            logFile.flush();
+        }
+        std::cout.flush();
+        
+        std::unique_lock<std::mutex> lock(writerMutex);
+        writerDrained.notify_all();
+        if (stopping && writtenCount >= enqueuedCount.load(std::memory_order_acquire)) {
+            break;
+        }
+        
+        // Producers never signal, so idle wake-ups are on a short timer; flush() and
+        // shutdown wake the writer directly
+        writerWake.wait_for(lock, std::chrono::milliseconds(20));
+    }
+}
+
+void ChessLogger::writeEntry(const LogEntry& entry)
+{
+    std::string line = formatTimestamp(entry.time) + " [" + entry.tag + "] " + entry.message;
+    if (!entry.json.isEmpty()) {
+        line += ": " + QJsonDocument(entry.json).toJson(QJsonDocument::Compact).toStdString();
+    }
+    line += '\n';
+    
+    if (logFile.is_open()) {
+        logFile << line;
+    }
+    
+    if (entry.console == 1) {
+        std::cout << line;
+    } else if (entry.console == 2) {
+        std::cerr << line;
+    }
+}
+
+std::string ChessLogger::formatTimestamp(std::chrono::system_clock::time_point time)
+{
+    auto time_c = std::chrono::system_clock::to_time_t(time);
+    auto time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()) % 1000;
+    
+    // The date and time only change once a second
+    if (time_c != cachedSecond) {
+        std::stringstream ss;
+        ss << std::put_time(std::localtime(&time_c), "%Y-%m-%d %H:%M:%S");
+        cachedSecond = time_c;
+        cachedSecondText = ss.str();
+    }
+    
+    char millis[5];
+    std::snprintf(millis, sizeof(millis), ".%03d", static_cast<int>(time_ms.count()));
+    return cachedSecondText + millis;
+}
+
+// Implementation of ChessAuthenticator class
+ChessAuthenticator::ChessAuthenticator(const std::string& userDbPath)
+    : userDbPath(userDbPath), indexData(nullptr), indexSize(0), indexCount(0), passwordJournalEntries(0),
+      stopping(false), writerBusy(false), flushWaiters(0), kdfCost(DEFAULT_KDF_COST)
+{
+    // Create the directory if it doesn't exist
+    QDir dir(QString::fromStdString(userDbPath));
+    if (!dir.exists()) {
+        dir.mkpath(".");
+    }
+    
+    loadPasswordDb();
+    
+    writerThread = std::thread(&ChessAuthenticator::writerLoop, this);
+}
+
+ChessAuthenticator::~ChessAuthenticator()
+{
+    {
+        std::lock_guard<std::mutex> lock(persistMutex);
+        stopping = true;
+    }
+    writerWake.notify_all();
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+    
+    // Fold the journal back into the index so the next start replays nothing
+    if (passwordJournalEntries > 0) {
+        savePasswordDb();
+    }
+    unmapUserIndex();
+}
+
+bool ChessAuthenticator::authenticatePlayer(const std::string& username, const std::string& password) {
+    std::string storedHash;
+    {
+        std::lock_guard<std::mutex> lock(authMutex);
+        if (!findPasswordHashLocked(username, storedHash)) {
+            return false;  // User not found
+        }
+    }
+    
+    // The key derivation runs without the lock, so logins are checked in parallel
+    bool upgrade = false;
+    if (!verifyPassword(password, storedHash, upgrade)) {
+        return false;
+    }
+    
+    // Old or cheaper hashes are replaced now that the password is known
+    if (upgrade) {
+        std::string hash = hashPassword(password);
+        std::lock_guard<std::mutex> lock(authMutex);
+        std::string currentHash;
+        if (findPasswordHashLocked(username, currentHash) && currentHash == storedHash) {
+            passwordCache[username] = hash;
+            markPasswordChanged(username, hash);
+        }
+    }
+    return true;
+}
+
+bool ChessAuthenticator::registerPlayer(const std::string& username, const std::string& password) {
+    std::string existingHash;
+    {
+        // A taken name is refused before any hashing is spent on it
+        std::lock_guard<std::mutex> lock(authMutex);
+        if (findPasswordHashLocked(username, existingHash)) {
+            return false;  // User already exists
+        }
+    }
+    
+    std::string hash = hashPassword(password);
+    
+    std::lock_guard<std::mutex> lock(authMutex);
+    if (findPasswordHashLocked(username, existingHash)) {
+        return false;  // Registered while the hash was computed
+    }
+    passwordCache[username] = hash;
+    
+    // Create a new player; both records are written by the persistence thread
+    ChessPlayer player(username);
+    savePlayer(player);
+    markPasswordChanged(username, hash);
+    return true;
+}
+
+bool ChessAuthenticator::usernameExists(const std::string& username) {
+    std::lock_guard<std::mutex> lock(authMutex);
+    std::string hash;
+    return findPasswordHashLocked(username, hash);
+}
+
+std::unique_ptr<ChessPlayer> ChessAuthenticator::getPlayer(const std::string& username) {
+    // A save that has not reached the disk yet is newer than the file
+    {
+        std::lock_guard<std::mutex> lock(persistMutex);
+        if (deletedPlayers.find(username) != deletedPlayers.end()) {
+            return nullptr;
+        }
+        auto it = dirtyPlayers.find(username);
+        if (it != dirtyPlayers.end()) {
+            return std::make_unique<ChessPlayer>(ChessPlayer::fromJson(it->second));
+        }
+        it = writingPlayers.find(username);
+        if (it != writingPlayers.end()) {
+            return std::make_unique<ChessPlayer>(ChessPlayer::fromJson(it->second));
+        }
+    }
+    
+    std::string playerFilePath = getPlayerFilePath(username);
+    
+    QFile file(QString::fromStdString(playerFilePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+    
+    QByteArray data = file.readAll();
+    QJsonDocument doc = QJsonDocument::fromJson(data);
+    
+    if (doc.isNull() || !doc.isObject()) {
+        return nullptr;
+    }
+    
+    ChessPlayer player = ChessPlayer::fromJson(doc.object());
+    return std::make_unique<ChessPlayer>(player);
+}
+
+bool ChessAuthenticator::savePlayer(const ChessPlayer& player) {
+    // Only the latest state matters, so later saves replace an unwritten earlier one
+    QJsonObject json = player.toJson();
+    {
+        std::lock_guard<std::mutex> lock(persistMutex);
+        dirtyPlayers[player.getUsername()] = json;
+        deletedPlayers.erase(player.getUsername());
+    }
+    writerWake.notify_one();
+    return true;
+}
+
+bool ChessAuthenticator::savePlayers(const std::vector<ChessPlayer>& players) {
+    if (players.empty()) {
+        return true;
+    }
+    
+    // Serialized before the lock, so the writer thread is held up only by the inserts
+    std::vector<QJsonObject> records;
+    records.reserve(players.size());
+    for (const ChessPlayer& player : players) {
+        records.push_back(player.toJson());
+    }
+    {
+        std::lock_guard<std::mutex> lock(persistMutex);
+        for (size_t i = 0; i < players.size(); ++i) {
+            dirtyPlayers[players[i].getUsername()] = std::move(records[i]);
+            deletedPlayers.erase(players[i].getUsername());
+        }
+    }
+    writerWake.notify_one();
+    return true;
+}
+
+std::vector<std::string> ChessAuthenticator::getAllPlayerUsernames() {
+    std::lock_guard<std::mutex> lock(authMutex);
+    
+    // Indexed players the overlay has not changed, then the overlay's live entries
+    std::vector<std::string> usernames;
+    for (quint32 i = 0; i < indexCount; ++i) {
+        std::string_view username;
+        std::string_view hash;
+        if (indexRecord(i, username, hash) && passwordCache.find(std::string(username)) == passwordCache.end()) {
+            usernames.emplace_back(username);
+        }
+    }
+    for (const auto& pair : passwordCache) {
+        if (!pair.second.empty()) {
+            usernames.push_back(pair.first);
+        }
+    }
+    
+    return usernames;
+}
+
+bool ChessAuthenticator::deletePlayer(const std::string& username) {
+    std::lock_guard<std::mutex> lock(authMutex);
+    
+    std::string hash;
+    if (!findPasswordHashLocked(username, hash)) {
+        return false;  // User not found
+    }
+    
+    // The empty hash hides the indexed entry until the index is rewritten
+    passwordCache[username] = "";
+    markPasswordChanged(username, "");
+    
+    // The player file is removed by the persistence thread
+    {
+        std::lock_guard<std::mutex> persistLock(persistMutex);
+        dirtyPlayers.erase(username);
+        deletedPlayers.insert(username);
+    }
+    writerWake.notify_one();
+    
+    return true;
+}
+
+std::string ChessAuthenticator::getPasswordHash(const std::string& username) {
+    std::lock_guard<std::mutex> lock(authMutex);
+    std::string hash;
+    findPasswordHashLocked(username, hash);
+    return hash;
+}
+
+void ChessAuthenticator::importPlayer(const ChessPlayer& player, const std::string& passwordHash) {
+    std::lock_guard<std::mutex> lock(authMutex);
+    
+    std::string storedHash;
+    if (!passwordHash.empty() &&
+        (!findPasswordHashLocked(player.getUsername(), storedHash) || storedHash != passwordHash)) {
+        passwordCache[player.getUsername()] = passwordHash;
+        markPasswordChanged(player.getUsername(), passwordHash);
+    }
+    savePlayer(player);
+}
+
+void ChessAuthenticator::setKdfCost(int cost) {
+    kdfCost = std::min(std::max(cost, MIN_KDF_COST), MAX_KDF_COST);
+}
+
+int ChessAuthenticator::getKdfCost() const {
+    return kdfCost;
+}
+
+void ChessAuthenticator::flush() {
+    std::unique_lock<std::mutex> lock(persistMutex);
+    ++flushWaiters;
+    writerWake.notify_one();
+    writerDrained.wait(lock, [this] { return stopping || (!writerBusy && !hasPendingWritesLocked()); });
+    --flushWaiters;
+}
+
+void ChessAuthenticator::markPasswordChanged(const std::string& username, const std::string& hash) {
+    {
+        std::lock_guard<std::mutex> lock(persistMutex);
+        passwordChanges.emplace_back(username, hash);
+    }
+    writerWake.notify_one();
+}
+
+bool ChessAuthenticator::hasPendingWritesLocked() const {
+    return !dirtyPlayers.empty() || !deletedPlayers.empty() || !passwordChanges.empty();
+}
+
+void ChessAuthenticator::writerLoop() {
+    std::unique_lock<std::mutex> lock(persistMutex);
+    
+    while (true) {
+        writerWake.wait(lock, [this] { return stopping || hasPendingWritesLocked(); });
+        
+        // Give the rest of a burst (both players at a game end, a save right after
+        // a registration) time to arrive so it is written once
+        if (!stopping && flushWaiters == 0) {
+            writerWake.wait_for(lock, std::chrono::milliseconds(FLUSH_DELAY_MS),
+                                [this] { return stopping || flushWaiters > 0; });
+        }
+        
+        if (!hasPendingWritesLocked()) {
+            writerDrained.notify_all();
+            if (stopping) {
+                break;
+            }
+            continue;
+        }
+        
+        writingPlayers.swap(dirtyPlayers);
+        std::unordered_set<std::string> deletions;
+        deletions.swap(deletedPlayers);
+        std::vector<std::pair<std::string, std::string>> changes;
+        changes.swap(passwordChanges);
+        writerBusy = true;
+        lock.unlock();
+        
+        // Logins first, so a player file never exists without its password entry
+        if (!changes.empty()) {
+            appendPasswordJournal(changes);
+            if (passwordJournalEntries >= PASSWORD_JOURNAL_LIMIT) {
+                savePasswordDb();
+            }
+        }
+        
+        for (const std::string& username : deletions) {
+            QFile::remove(QString::fromStdString(getPlayerFilePath(username)));
+        }
+        
+        for (const auto& [username, json] : writingPlayers) {
+            QString path = QString::fromStdString(getPlayerFilePath(username));
+            if (!writeFileAtomically(path, QJsonDocument(json).toJson())) {
+                MPChessServer* server = MPChessServer::getInstance();
+                if (server && server->getLogger()) {
+                    server->getLogger()->error("ChessAuthenticator - Failed to write " + path.toStdString());
+                }
+            }
+        }
+        
+        lock.lock();
+        writingPlayers.clear();
+        writerBusy = false;
+        writerDrained.notify_all();
+    }
+}
+
+bool ChessAuthenticator::writeFileAtomically(const QString& path, const QByteArray& data) {
+    // QSaveFile writes beside the target and renames over it on commit
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    if (file.write(data) != data.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+std::string ChessAuthenticator::hashPassword(const std::string& password, const std::string& salt) {
+    std::string passwordSalt = salt.empty() ? generateSalt() : salt;
+    int cost = kdfCost;
+    QByteArray key = deriveScryptKey(QByteArray::fromStdString(password), QByteArray::fromStdString(passwordSalt),
+                                     cost, KDF_BLOCK_SIZE, KDF_PARALLELISM, KDF_KEY_LENGTH);
+    
+    return "$scrypt$" + std::to_string(cost) + "$" + std::to_string(KDF_BLOCK_SIZE) + "$" +
+           std::to_string(KDF_PARALLELISM) + "$" + passwordSalt + "$" + key.toHex().toStdString();
+}
+
+bool ChessAuthenticator::verifyPassword(const std::string& password, const std::string& storedHash,
+                                        bool& upgrade) const {
+    std::string expected;
+    std::string computed;
+    
+    if (storedHash.rfind("$scrypt$", 0) == 0) {
+        // $scrypt$cost$r$p$salt$key
+        std::vector<std::string> fields;
+        size_t start = 8;
+        while (fields.size() < 4) {
+            size_t end = storedHash.find('$', start);
+            if (end == std::string::npos) {
+                return false;
+            }
+            fields.push_back(storedHash.substr(start, end - start));
+            start = end + 1;
+        }
+        expected = storedHash.substr(start);
+        
+        // Bounded, so a damaged or hostile record cannot ask for unbounded memory
+        int cost = std::atoi(fields[0].c_str());
+        int r = std::atoi(fields[1].c_str());
+        int p = std::atoi(fields[2].c_str());
+        if (cost < 1 || cost > MAX_KDF_COST || r < 1 || r > 32 || p < 1 || p > 16) {
+            return false;
+        }
+        
+        QByteArray key = deriveScryptKey(QByteArray::fromStdString(password), QByteArray::fromStdString(fields[3]),
+                                         cost, r, p, static_cast<int>(expected.size() / 2));
+        computed = key.toHex().toStdString();
+        upgrade = cost != kdfCost || r != KDF_BLOCK_SIZE || p != KDF_PARALLELISM;
+    } else {
+        // Salted SHA-256: the first 16 characters are the salt
+        expected = storedHash;
+        computed = legacyHashPassword(password, storedHash.substr(0, 16));
+        upgrade = true;
+    }
+    
+    // Compared in full whatever the first difference, so timing does not reveal it
+    if (computed.size() != expected.size()) {
+        return false;
+    }
+    unsigned char difference = 0;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        difference |= static_cast<unsigned char>(computed[i] ^ expected[i]);
+    }
+    return difference == 0;
+}
+
+std::string ChessAuthenticator::legacyHashPassword(const std::string& password, const std::string& salt) {
+    std::string saltedPassword = salt + password;
+    QByteArray hash = QCryptographicHash::hash(
+        QByteArray::fromStdString(saltedPassword),
+        QCryptographicHash::Sha256
+    );
+    
+    return salt + QString(hash.toHex()).toStdString();
+}
+
+// Salsa20/8 core, applied in place to one 64-byte block
+static void salsa208(uint32_t block[16])
+{
+    auto rotl = [](uint32_t value, int bits) { return (value << bits) | (value >> (32 - bits)); };
+    uint32_t x[16];
+    std::memcpy(x, block, sizeof(x));
+    
+    for (int round = 0; round < 8; round += 2) {
+        // Columns
+        x[4] ^= rotl(x[0] + x[12], 7);   x[8] ^= rotl(x[4] + x[0], 9);
+        x[12] ^= rotl(x[8] + x[4], 13);  x[0] ^= rotl(x[12] + x[8], 18);
+        x[9] ^= rotl(x[5] + x[1], 7);    x[13] ^= rotl(x[9] + x[5], 9);
+        x[1] ^= rotl(x[13] + x[9], 13);  x[5] ^= rotl(x[1] + x[13], 18);
+        x[14] ^= rotl(x[10] + x[6], 7);  x[2] ^= rotl(x[14] + x[10], 9);
+        x[6] ^= rotl(x[2] + x[14], 13);  x[10] ^= rotl(x[6] + x[2], 18);
+        x[3] ^= rotl(x[15] + x[11], 7);  x[7] ^= rotl(x[3] + x[15], 9);
+        x[11] ^= rotl(x[7] + x[3], 13);  x[15] ^= rotl(x[11] + x[7], 18);
+        
+        // Rows
+        x[1] ^= rotl(x[0] + x[3], 7);    x[2] ^= rotl(x[1] + x[0], 9);
+        x[3] ^= rotl(x[2] + x[1], 13);   x[0] ^= rotl(x[3] + x[2], 18);
+        x[6] ^= rotl(x[5] + x[4], 7);    x[7] ^= rotl(x[6] + x[5], 9);
+        x[4] ^= rotl(x[7] + x[6], 13);   x[5] ^= rotl(x[4] + x[7], 18);
+        x[11] ^= rotl(x[10] + x[9], 7);  x[8] ^= rotl(x[11] + x[10], 9);
+        x[9] ^= rotl(x[8] + x[11], 13);  x[10] ^= rotl(x[9] + x[8], 18);
+        x[12] ^= rotl(x[15] + x[14], 7); x[13] ^= rotl(x[12] + x[15], 9);
+        x[14] ^= rotl(x[13] + x[12], 13); x[15] ^= rotl(x[14] + x[13], 18);
+    }
+    
+    for (int i = 0; i < 16; ++i) {
+        block[i] += x[i];
+    }
+}
+
+// scrypt BlockMix: the 2r blocks are chained through Salsa20/8, even outputs first
+static void scryptBlockMix(const uint32_t* in, uint32_t* out, int r)
+{
+    uint32_t x[16];
+    std::memcpy(x, in + (2 * r - 1) * 16, sizeof(x));
+    for (int i = 0; i < 2 * r; ++i) {
+        for (int j = 0; j < 16; ++j) {
+            x[j] ^= in[i * 16 + j];
+        }
+        salsa208(x);
+        std::memcpy(out + ((i % 2) * r + i / 2) * 16, x, sizeof(x));
+    }
+}
+
+// scrypt ROMix over one 128r-byte block, using a table of 2^log2N blocks
+static void scryptRoMix(char* block, int r, int log2N)
+{
+    const size_t words = 32 * static_cast<size_t>(r);
+    const uint64_t n = 1ULL << log2N;
+    std::vector<uint32_t> table(words * n);
+    std::vector<uint32_t> x(words);
+    std::vector<uint32_t> y(words);
+    
+    for (size_t i = 0; i < words; ++i) {
+        x[i] = qFromLittleEndian<quint32>(block + i * 4);
+    }
+    
+    for (uint64_t i = 0; i < n; ++i) {
+        std::memcpy(&table[i * words], x.data(), words * 4);
+        scryptBlockMix(x.data(), y.data(), r);
+        x.swap(y);
+    }
+    
+    // Each step reads the entry the previous one selects, so the whole table must be kept
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t j = x[words - 16] & (n - 1);
+        for (size_t k = 0; k < words; ++k) {
+            x[k] ^= table[j * words + k];
+        }
+        scryptBlockMix(x.data(), y.data(), r);
+        x.swap(y);
+    }
+    
+    for (size_t i = 0; i < words; ++i) {
+        qToLittleEndian<quint32>(x[i], block + i * 4);
+    }
+}
+
+QByteArray ChessAuthenticator::deriveScryptKey(const QByteArray& password, const QByteArray& salt, int log2N, int r,
+                                               int p, int keyLength) {
+    // scrypt (RFC 7914): PBKDF2-HMAC-SHA256 around p independent ROMix blocks
+    const int blockSize = 128 * r;
+    QByteArray blocks = QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256, password, salt, 1,
+                                                           static_cast<quint64>(blockSize) * p);
+    if (blocks.size() != blockSize * p) {
+        return QByteArray();
+    }
+    
+    for (int i = 0; i < p; ++i) {
+        scryptRoMix(blocks.data() + i * blockSize, r, log2N);
+    }
+    
+    return QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256, password, blocks, 1,
+                                              static_cast<quint64>(keyLength));
+}
+
+std::string ChessAuthenticator::generateSalt(int length) {
+    const std::string chars = 
+        "0123456789"
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+        "abcdefghijklmnopqrstuvwxyz";
+    
+    std::random_device rd;
+    std::mt19937 generator(rd());
+    std::uniform_int_distribution<> distribution(0, chars.size() - 1);
+    
+    std::string salt;
+    salt.reserve(length);
+    
+    for (int i = 0; i < length; ++i) {
+        salt += chars[distribution(generator)];
+    }
+    
+    return salt;
+}
+
+void ChessAuthenticator::loadPasswordDb() {
+    // Nothing in the index is read until someone logs in
+    bool imported = false;
+    if (!mapUserIndex()) {
+        // Hashes were kept in passwords.json before the index; it is read only while there is none
+        QFile file(QString::fromStdString(userDbPath + "/passwords.json"));
+        if (file.open(QIODevice::ReadOnly)) {
+            QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+            if (!doc.isNull() && doc.isObject()) {
+                QJsonObject json = doc.object();
+                for (auto it = json.begin(); it != json.end(); ++it) {
+                    passwordCache[it.key().toStdString()] = it.value().toString().toStdString();
+                }
+                imported = true;
+            }
+        }
+    }
+    
+    // Changes made since the index was last written
+    replayPasswordJournal();
+    
+    if (imported) {
+        savePasswordDb();
+    }
+}
+
+void ChessAuthenticator::savePasswordDb() {
+    // The index is only replaced here, so it can be read without the lock while the
+    // new one is built; the overlay is copied, in username order, to merge with it
+    std::map<std::string, std::string> changes;
+    {
+        std::lock_guard<std::mutex> lock(authMutex);
+        changes.insert(passwordCache.begin(), passwordCache.end());
+    }
+    
+    QByteArray records;
+    std::vector<quint32> offsets;
+    auto appendRecord = [&](std::string_view username, std::string_view hash) {
+        if (username.size() > 0xFFFF || hash.size() > 0xFFFF) {
+            return;
+        }
+        char length[2];
+        offsets.push_back(static_cast<quint32>(records.size()));
+        qToLittleEndian<quint16>(static_cast<quint16>(username.size()), length);
+        records.append(length, 2);
+        records.append(username.data(), static_cast<qsizetype>(username.size()));
+        qToLittleEndian<quint16>(static_cast<quint16>(hash.size()), length);
+        records.append(length, 2);
+        records.append(hash.data(), static_cast<qsizetype>(hash.size()));
+    };
+    
+    quint32 next = 0;
+    auto change = changes.begin();
+    while (next < indexCount || change != changes.end()) {
+        std::string_view username;
+        std::string_view hash;
+        bool indexed = next < indexCount && indexRecord(next, username, hash);
+        if (next < indexCount && !indexed) {
+            ++next;  // A damaged record is dropped
+            continue;
+        }
+        
+        if (change != changes.end() && (!indexed || std::string_view(change->first) <= username)) {
+            if (indexed && std::string_view(change->first) == username) {
+                ++next;
+            }
+            if (!change->second.empty()) {
+                appendRecord(change->first, change->second);
+            }
+            ++change;
+        } else {
+            appendRecord(username, hash);
+            ++next;
+        }
+    }
+    
+    // Magic, version, record count, reserved, then the record offsets and the records:
+    // name length and name, hash length and hash
+    qint64 tableSize = static_cast<qint64>(offsets.size()) * 4;
+    QByteArray data(INDEX_HEADER_SIZE + tableSize, '\0');
+    qToLittleEndian<quint32>(INDEX_MAGIC, data.data());
+    qToLittleEndian<quint32>(INDEX_VERSION, data.data() + 4);
+    qToLittleEndian<quint32>(static_cast<quint32>(offsets.size()), data.data() + 8);
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        qToLittleEndian<quint32>(static_cast<quint32>(INDEX_HEADER_SIZE + tableSize + offsets[i]),
+                                 data.data() + INDEX_HEADER_SIZE + i * 4);
+    }
+    data.append(records);
+    
+    QSaveFile file(getUserIndexPath());
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+        file.cancelWriting();
+        return;
+    }
+    
+    {
+        // Some platforms cannot replace a mapped file, so the old index is let go first
+        std::lock_guard<std::mutex> lock(authMutex);
+        unmapUserIndex();
+        bool committed = file.commit();
+        mapUserIndex();
+        if (!committed) {
+            return;
+        }
+        
+        // Changes made while the index was written stay in the overlay
+        for (const auto& [username, hash] : changes) {
+            auto it = passwordCache.find(username);
+            if (it != passwordCache.end() && it->second == hash) {
+                passwordCache.erase(it);
+            }
+        }
+    }
+    
+    // Everything in the journal is now in the index. Replaying it again after a
+    // crash before this truncation is harmless, as entries only set or remove a hash
+    QFile journal(QString::fromStdString(getPasswordJournalPath()));
+    if (journal.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        passwordJournalEntries = 0;
+    }
+}
+
+bool ChessAuthenticator::findPasswordHashLocked(const std::string& username, std::string& hash) const {
+    auto it = passwordCache.find(username);
+    if (it != passwordCache.end()) {
+        hash = it->second;
+        return !hash.empty();
+    }
+    return findInIndex(username, hash);
+}
+
+bool ChessAuthenticator::indexRecord(quint32 index, std::string_view& username, std::string_view& hash) const {
+    qint64 offset = qFromLittleEndian<quint32>(indexData + INDEX_HEADER_SIZE + static_cast<qint64>(index) * 4);
+    if (offset + 2 > indexSize) {
+        return false;
+    }
+    quint16 nameSize = qFromLittleEndian<quint16>(indexData + offset);
+    if (offset + 2 + nameSize + 2 > indexSize) {
+        return false;
+    }
+    quint16 hashSize = qFromLittleEndian<quint16>(indexData + offset + 2 + nameSize);
+    if (offset + 4 + nameSize + hashSize > indexSize) {
+        return false;
+    }
+    
+    username = std::string_view(indexData + offset + 2, nameSize);
+    hash = std::string_view(indexData + offset + 4 + nameSize, hashSize);
+    return true;
+}
+
+bool ChessAuthenticator::findInIndex(const std::string& username, std::string& hash) const {
+    // Only the pages the search touches are read from disk
+    quint32 low = 0;
+    quint32 high = indexCount;
+    while (low < high) {
+        quint32 middle = low + (high - low) / 2;
+        std::string_view name;
+        std::string_view storedHash;
+        if (!indexRecord(middle, name, storedHash)) {
+            return false;
+        }
+        
+        int order = name.compare(username);
+        if (order == 0) {
+            hash.assign(storedHash.data(), storedHash.size());
+            return true;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return false;
+}
+
+bool ChessAuthenticator::mapUserIndex() {
+    auto file = std::make_unique<QFile>(getUserIndexPath());
+    if (!file->open(QIODevice::ReadOnly) || file->size() < INDEX_HEADER_SIZE) {
+        return false;
+    }
+    
+    qint64 size = file->size();
+    uchar* mapped = file->map(0, size);
+    if (!mapped) {
+        return false;
+    }
+    
+    const char* data = reinterpret_cast<const char*>(mapped);
+    quint32 count = qFromLittleEndian<quint32>(data + 8);
+    if (qFromLittleEndian<quint32>(data) != INDEX_MAGIC || qFromLittleEndian<quint32>(data + 4) != INDEX_VERSION ||
+        INDEX_HEADER_SIZE + static_cast<qint64>(count) * 4 > size) {
+        file->unmap(mapped);
+        return false;
+    }
+    
+    indexFile = std::move(file);
+    indexData = data;
+    indexSize = size;
+    indexCount = count;
+    return true;
+}
+
+void ChessAuthenticator::unmapUserIndex() {
+    if (indexFile && indexData) {
+        indexFile->unmap(reinterpret_cast<uchar*>(const_cast<char*>(indexData)));
+    }
+    indexFile.reset();
+    indexData = nullptr;
+    indexSize = 0;
+    indexCount = 0;
+}
+
+void ChessAuthenticator::appendPasswordJournal(const std::vector<std::pair<std::string, std::string>>& changes) {
+    // One compact JSON object per line; a deletion has no hash
+    QByteArray data;
+    for (const auto& [username, hash] : changes) {
+        QJsonObject entry;
+        entry["username"] = QString::fromStdString(username);
+        if (!hash.empty()) {
+            entry["hash"] = QString::fromStdString(hash);
+        }
+        data.append(QJsonDocument(entry).toJson(QJsonDocument::Compact));
+        data.append('\n');
+    }
+    
+    QFile journal(QString::fromStdString(getPasswordJournalPath()));
+    if (!journal.open(QIODevice::WriteOnly | QIODevice::Append) ||
+        journal.write(data) != data.size() || !journal.flush()) {
+        // Fall back to a full rewrite, which covers these changes too
+        savePasswordDb();
+        return;
+    }
+    passwordJournalEntries += changes.size();
+}
+
+void ChessAuthenticator::replayPasswordJournal() {
+    QFile journal(QString::fromStdString(getPasswordJournalPath()));
+    if (!journal.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QByteArray data = journal.readAll();
+    
+    // A torn last line from a crash mid-append fails to parse and is skipped
+    qsizetype start = 0;
+    while (start < data.size()) {
+        qsizetype end = data.indexOf('\n', start);
+        if (end < 0) {
+            end = data.size();
+        }
+        QJsonDocument doc = QJsonDocument::fromJson(data.mid(start, end - start));
+        start = end + 1;
+        if (!doc.isObject()) {
+            continue;
+        }
+        
+        QJsonObject entry = doc.object();
+        std::string username = entry["username"].toString().toStdString();
+        if (username.empty()) {
+            continue;
+        }
+        passwordCache[username] = entry.contains("hash") ? entry["hash"].toString().toStdString() : std::string();
+        ++passwordJournalEntries;
+    }
+}
+
+std::string ChessAuthenticator::getPasswordJournalPath() const {
+    return userDbPath + "/passwords.log";
+}
+
+QString ChessAuthenticator::getUserIndexPath() const {
+    return QString::fromStdString(userDbPath + "/users.index");
+}
+
+std::string ChessAuthenticator::getPlayerFilePath(const std::string& username) {
+    return userDbPath + "/player_" + username + ".json";
+}
+
+MPChessServer* MPChessServer::mpChessServerInstance = nullptr;
+
+// Implementation of MPChessServer class
+MPChessServer::MPChessServer(QObject* parent, const std::string& stockfishPath, const EnginePoolConfig& engineConfig) : QObject(parent), server(nullptr),
+    networkThreadCount(0), authSerial(0), authTasksQueued(0), authPeakQueueDepth(0), authCompleted(0), authRejected(0), authTotalMs(0),
+    totalGamesPlayed(0), totalPlayersRegistered(0), peakConcurrentPlayers(0), totalMovesPlayed(0),
+    metricsPort(0), metricsServer(nullptr)
+{    
+    // Initialize directories
+    initializeServerDirectories();
+
+    // Set the singleton instance
+    mpChessServerInstance = this;
+    
+    // Initialize logger
+    logger = std::make_unique<ChessLogger>(getLogsPath() + "/server.log");
+    logger->setLogLevel(3);  // Increase log level for more detailed logging
+
+    // Initialize the worker threads for bots, recommendations and analysis
+    workScheduler = std::make_unique<WorkScheduler>(DEFAULT_WORKER_THREADS);
+    logger->log("Work scheduler initialized with " + std::to_string(workScheduler->getThreadCount()) + " threads");
+    
+    // Password hashing is memory-hard, so only a few run at once
+    authPool = new QThreadPool(this);
+    authPool->setMaxThreadCount(2);
+
+    // Initialize performance timer
+    performanceTimer = new QTimer(this);
+    connect(performanceTimer, &QTimer::timeout, this, &MPChessServer::logPerformanceStats);
+    performanceTimer->start(300000); // Log every 5 minutes
+
+    // Initialize authenticator
+    authenticator = std::make_unique<ChessAuthenticator>(getPlayerDataPath());
+    
+    // Initialize leaderboard
+    leaderboard = std::make_unique<ChessLeaderboard>(getPlayerDataPath());
+    
+    // Open the game history store
+    historyStore = std::make_unique<GameHistoryStore>(getGameHistoryPath());
+    
+    // Initialize matchmaker
+    matchmaker = std::make_unique<ChessMatchmaker>();
+    
+    // Initialize rating system
+    ratingSystem = std::make_unique<ChessRatingSystem>();
+    
+    // Initialize analysis engine
+    analysisEngine = std::make_unique<ChessAnalysisEngine>();
+    
+    // Initialize serializer
+    serializer = std::make_unique<ChessSerializer>();
+    
+    // Start the Stockfish engine pool if path is provided
+    if (!stockfishPath.empty()) {
+        enginePool = std::make_unique<EnginePool>(stockfishPath, engineConfig);
+        if (enginePool->start()) {
+            logger->log("EnginePool started " + std::to_string(enginePool->getLiveEngineCount()) + " of " +
+                        std::to_string(enginePool->getEngineCount()) + " engines at: " + stockfishPath, true);
+        } else {
+            logger->error("Failed to start EnginePool with engine at: " + stockfishPath, true);
+            enginePool.reset();
+        }
+    }
+    
+    // Initialize timers
+    matchmakingTimer = new QTimer(this);
+    connect(matchmakingTimer, &QTimer::timeout, this, &MPChessServer::handleMatchmakingTimer);
+    
+    gameTimer = new QTimer(this);
+    connect(gameTimer, &QTimer::timeout, this, &MPChessServer::handleGameTimerUpdate);
+    
+    statusTimer = new QTimer(this);
+    connect(statusTimer, &QTimer::timeout, this, &MPChessServer::handleServerStatusUpdate);
+    
+    leaderboardTimer = new QTimer(this);
+    connect(leaderboardTimer, &QTimer::timeout, this, &MPChessServer::handleLeaderboardRefresh);
+    
+    clusterTimer = new QTimer(this);
+    connect(clusterTimer, &QTimer::timeout, this, &MPChessServer::handleClusterHeartbeat);
+    
+    playerUpdateTimer = new QTimer(this);
+    playerUpdateTimer->setSingleShot(true);
+    connect(playerUpdateTimer, &QTimer::timeout, this, &MPChessServer::flushPlayerUpdates);
+    
+    logger->log("MPChessServer initialized");
+}
+
+MPChessServer::~MPChessServer()
+{
+    logger->log("MPChessServer destructor - starting shutdown");
+    logger->flush();
+    
+    logger->log("MPChessServer destructor - calling stop()");
+    logger->flush();
+    stop();
+    
+    // Players who disconnected while the server stopped are still queued
+    flushPlayerUpdates();
+
+    logger->log("MPChessServer destructor - stopping the work scheduler");
+    logger->flush();
+    // Let the running tasks return, stopping the recommendation searches first; queued
+    // work is dropped
+    for (auto& [key, pending] : pendingRecommendations) {
+        pending.job->cancelled = true;
+    }
+    if (workScheduler) {
+        workScheduler->shutdown();
+    }
+    if (authPool) {
+        authPool->waitForDone();
+    }
+
+    logger->log("MPChessServer destructor - stopping and deleting timers");
+    logger->flush();
+    if (matchmakingTimer) {
+        matchmakingTimer->stop();
+        delete matchmakingTimer;
+    }
+    if (gameTimer) {
+        gameTimer->stop();
+        delete gameTimer;
+    }
+    if (statusTimer) {
+        statusTimer->stop();
+        delete statusTimer;
+    }
+    if (leaderboardTimer) {
+        leaderboardTimer->stop();
+        delete leaderboardTimer;
+    }
+    if (performanceTimer) {
+        performanceTimer->stop();
+        delete performanceTimer;
+    }
+    
+    logger->log("MPChessServer destructor - logging final performance stats");
+    logger->flush();
+    // Log final performance stats
+    logPerformanceStats();
+    
+    logger->log("MPChessServer destructor - clearing singleton instance");
+    logger->flush();
+    // Clear the singleton instance if this is the current instance
+    if (mpChessServerInstance == this) {
+        mpChessServerInstance = nullptr;
+    }
+    
+    logger->log("MPChessServer destructor - completed successfully");
+    logger->flush();
+}
+
+void MPChessServer::logPerformanceStats()
+{
+    if (logger && logger->getLogLevel() >= 2) {
+        std::string stats = PerformanceMonitor::getStatsSummary();
+        const TranspositionTable& table = ChessAI::getTranspositionTable();
+        int usage = table.getUsagePermille();
+        stats += "Transposition table: size=" + std::to_string(table.getSizeInMB()) + "MB, " +
+                 "used=" + std::to_string(usage / 10) + "." + std::to_string(usage % 10) + "%\n";
+        logger->log("Performance Statistics:\n" + stats);
+        
+        // Reset stats after logging if desired
+        // PerformanceMonitor::resetStats();
+    }
+}
+
+bool MPChessServer::isPlayerInGame(ChessPlayer* player) const
+{
+    if (!player) return false;
+    
+    // Games that ended on the board keep their entry until the player starts another
+    auto it = playerToGameId.find(player);
+    if (it == playerToGameId.end()) return false;
+    auto game = activeGames.find(it.value());
+    return game != activeGames.end() && !game->second->isOver();
+}
+
+bool MPChessServer::start(int port)
+{
+    if (server) {
+        logger->warning("Server already running");
+        return false;
+    }
+    
+    server = new QTcpServer(this);
+    
+    connect(server, &QTcpServer::newConnection, this, &MPChessServer::handleNewConnection);
+    
+    if (!server->listen(QHostAddress::Any, port)) {
+        logger->error("Failed to start server: " + server->errorString().toStdString());
+        delete server;
+        server = nullptr;
+        return false;
+    }
+    
+    startTime = QDateTime::currentDateTime();
+    
+    // Socket I/O moves to the network threads; game state stays in this thread
+    if (networkThreadCount > 0) {
+        networkWorkers = std::make_unique<NetworkWorkerPool>(this, networkThreadCount);
+        logger->log("Serving sockets on " + std::to_string(networkWorkers->size()) + " network threads", true);
+    }
+    
+    // The metrics listener is optional; the server runs without it if the port is taken
+    if (metricsPort > 0) {
+        metricsServer = new QTcpServer(this);
+        connect(metricsServer, &QTcpServer::newConnection, this, &MPChessServer::handleMetricsConnection);
+        if (metricsServer->listen(QHostAddress::Any, metricsPort)) {
+            logger->log("Serving metrics on port " + std::to_string(metricsPort), true);
+        } else {
+            logger->error("Failed to listen for metrics on port " + std::to_string(metricsPort) + ": " +
+                          metricsServer->errorString().toStdString());
+            delete metricsServer;
+            metricsServer = nullptr;
+        }
+    }
+    
+    // Start timers
+    matchmakingTimer->start(1000);  // Check matchmaking every second
+    gameTimer->start(100);          // Update game timers every 100ms
+    statusTimer->start(60000);      // Update server status every minute
+    leaderboardTimer->start(600000); // Refresh leaderboard every 10 minutes
+    
+    // Join the cluster now that the port clients are redirected to is known
+    if (!clusterRoot.empty()) {
+        std::string nodeId = clusterNodeId.empty() ? clusterHost + "-" + std::to_string(port) : clusterNodeId;
+        cluster = std::make_unique<ClusterDirectory>(clusterRoot, nodeId, clusterHost, port);
+        if (cluster->isOpen()) {
+            handleClusterHeartbeat();
+            clusterTimer->start(ClusterDirectory::HEARTBEAT_INTERVAL_MS);
+            logger->log("Joined cluster " + clusterRoot + " as node " + nodeId + " (" +
+                        std::to_string(cluster->getLiveNodes().size()) + " nodes live)", true);
+        } else {
+            logger->error("Cluster directory " + clusterRoot + " is not accessible; running standalone");
+            cluster.reset();
+        }
+    }
+    
+    logger->log("Server started on port " + std::to_string(port), true);
+    return true;
+}
+
+void MPChessServer::stop()
+{
+    if (!server) {
+        return;
     }
     
-    criticalMoments["opening"] = openingMoments;
-    criticalMoments["middleGame"] = middleGameMoments;
-    criticalMoments["endGame"] = endGameMoments;
-    
-    // Add the largest swing
-    if (largestSwingIndex < moveHistory.size()) {
-        const ChessMove& move = moveHistory[largestSwingIndex];
-        QJsonObject largestSwingObj;
-        largestSwingObj["moveNumber"] = static_cast<int>(largestSwingIndex / 2) + 1;
-        largestSwingObj["color"] = (largestSwingIndex % 2 == 0) ? "white" : "black";
-        largestSwingObj["move"] = QString::fromStdString(move.toAlgebraic());
-        largestSwingObj["evaluationChange"] = largestSwing;
-        criticalMoments["largestSwing"] = largestSwingObj;
+    // Stop timers
+    matchmakingTimer->stop();
+    gameTimer->stop();
+    statusTimer->stop();
+    leaderboardTimer->stop();
+    
+    // Apply the queued player records while the cluster log is still open
+    flushPlayerUpdates();
+    
+    // Leave the cluster first, so no node sends clients here while this one stops
+    if (cluster) {
+        clusterTimer->stop();
+        for (const auto& session : clusterSessions) {
+            for (const std::string& username : session.second) {
+                cluster->clearSession(username);
+            }
+        }
+        clusterSessions.clear();
+        cluster->leave();
+        cluster.reset();
     }
     
-    return criticalMoments;
+    // Disconnect all clients
+    for (auto it = socketToPlayer.begin(); it != socketToPlayer.end(); ++it) {
+        QTcpSocket* socket = it.key();
+        if (socket) {
+            runOnSocketThread(socket, [socket]() { socket->disconnectFromHost(); });
+        }
+    }
+    
+    // Clear all games
+    activeGames.clear();
+    
+    // Clear all players
+    socketToPlayer.clear();
+    usernamesToPlayers.clear();
+    playerToGameId.clear();
+    
+    // Stop the server
+    server->close();
+    if (metricsServer) {
+        metricsServer->close();
+        delete metricsServer;
+        metricsServer = nullptr;
+    }
+    
+    // Finish the network threads
+    networkWorkers.reset();
+    delete server;
+    server = nullptr;
+    
+    // Player records are written behind; make sure the last ones are on disk
+    authenticator->flush();
+    
+    logger->log("Server stopped", true);
 }
 
-std::string ChessAnalysisEngine::generateGameSummary(const ChessGame& game) {
-    std::stringstream summary;
+void MPChessServer::setLogLevel(int level)
+{
+    if (logger) {
+        logger->setLogLevel(level);
+        logger->log("Log level set to " + std::to_string(level), true);
+    }
+}
+
+bool MPChessServer::isRunning() const
+{
+    return server != nullptr && server->isListening();
+}
+
+int MPChessServer::getPort() const
+{
+    return server ? server->serverPort() : -1;
+}
+
+int MPChessServer::getConnectedClientCount() const
+{
+    return socketToPlayer.size();
+}
+
+int MPChessServer::getActiveGameCount() const
+{
+    return activeGames.size();
+}
+
+qint64 MPChessServer::getUptime() const
+{
+    return startTime.secsTo(QDateTime::currentDateTime());
+}
+
+QJsonObject MPChessServer::getServerStats() const
+{
+    QJsonObject stats;
     
-    // Get basic game info
-    summary << "Game between " << game.getWhitePlayer()->getUsername() << " (White) and "
-            << game.getBlackPlayer()->getUsername() << " (Black)\n";
+    stats["uptime"] = getUptime();
+    stats["connectedClients"] = getConnectedClientCount();
+    stats["activeGames"] = getActiveGameCount();
+    stats["totalGamesPlayed"] = totalGamesPlayed;
+    stats["totalPlayersRegistered"] = totalPlayersRegistered;
+    stats["peakConcurrentPlayers"] = peakConcurrentPlayers;
+    stats["totalMovesPlayed"] = totalMovesPlayed;
+    stats["playersInMatchmaking"] = matchmaker->getQueueSize();
     
-    // Get result
-    switch (game.getResult()) {
-        case GameResult::WHITE_WIN:
-            summary << "Result: 1-0 (White won)\n";
-            break;
-        case GameResult::BLACK_WIN:
-            summary << "Result: 0-1 (Black won)\n";
-            break;
-        case GameResult::DRAW:
-            summary << "Result: 1/2-1/2 (Draw)\n";
-            break;
-        default:
-            summary << "Result: Game in progress\n";
-            break;
+    // Logins queued or being hashed, and how long completed ones took
+    stats["authQueueDepth"] = authTasksQueued;
+    stats["authPeakQueueDepth"] = authPeakQueueDepth;
+    stats["authCompleted"] = authCompleted;
+    stats["authRejected"] = authRejected;
+    stats["authAverageMs"] = authCompleted > 0 ? static_cast<double>(authTotalMs) / authCompleted : 0.0;
+    
+    return stats;
+}
+
+// Append one gauge or counter in the Prometheus text format
+static void writePrometheusMetric(std::ostream& out, const char* name, const char* type, const char* help,
+                                  double value)
+{
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+    out << name << " " << value << "\n";
+}
+
+std::string MPChessServer::getMetricsText() const
+{
+    std::ostringstream out;
+    out << std::setprecision(10);
+    
+    writePrometheusMetric(out, "mpchess_uptime_seconds", "gauge", "Seconds since the server started", getUptime());
+    writePrometheusMetric(out, "mpchess_connected_clients", "gauge", "Connected clients", getConnectedClientCount());
+    writePrometheusMetric(out, "mpchess_active_games", "gauge", "Games in progress or recently finished",
+                          getActiveGameCount());
+    writePrometheusMetric(out, "mpchess_matchmaking_queue", "gauge", "Players waiting for a match",
+                          matchmaker->getQueueSize());
+    writePrometheusMetric(out, "mpchess_games_total", "counter", "Games played since the server started",
+                          totalGamesPlayed);
+    writePrometheusMetric(out, "mpchess_moves_total", "counter", "Moves played since the server started",
+                          totalMovesPlayed);
+    
+    writePrometheusMetric(out, "mpchess_bot_move_queued_tasks", "gauge", "Bot searches waiting for a thread",
+                          static_cast<double>(workScheduler->getQueueLength(WorkLane::BOT_MOVE)));
+    writePrometheusMetric(out, "mpchess_bot_move_active_threads", "gauge", "Threads searching bot moves",
+                          workScheduler->getActiveCount(WorkLane::BOT_MOVE));
+    writePrometheusMetric(out, "mpchess_recommendation_queued_tasks", "gauge",
+                          "Recommendation searches waiting for a thread",
+                          static_cast<double>(workScheduler->getQueueLength(WorkLane::RECOMMENDATION)));
+    writePrometheusMetric(out, "mpchess_recommendation_active_threads", "gauge",
+                          "Threads searching recommendations", workScheduler->getActiveCount(WorkLane::RECOMMENDATION));
+    writePrometheusMetric(out, "mpchess_analysis_queued_tasks", "gauge", "Game analyses waiting for a thread",
+                          static_cast<double>(workScheduler->getQueueLength(WorkLane::ANALYSIS)));
+    writePrometheusMetric(out, "mpchess_analysis_active_threads", "gauge", "Threads analysing games",
+                          workScheduler->getActiveCount(WorkLane::ANALYSIS));
+    writePrometheusMetric(out, "mpchess_auth_queue_depth", "gauge", "Logins queued or being hashed",
+                          static_cast<double>(authTasksQueued));
+    writePrometheusMetric(out, "mpchess_auth_rejected_total", "counter", "Logins turned away with a full queue",
+                          static_cast<double>(authRejected));
+    
+    // Nodes per second is rate(mpchess_search_nodes_total) / rate(mpchess_search_seconds_sum)
+    writePrometheusMetric(out, "mpchess_search_nodes_total", "counter", "Nodes searched by the built-in engine",
+                          static_cast<double>(ServerMetrics::searchNodes.load(std::memory_order_relaxed)));
+    
+    ServerMetrics::moveRequestSeconds.writePrometheus(out, "mpchess_move_request_seconds",
+                                                      "Time to handle a MOVE message");
+    ServerMetrics::moveGenerationSeconds.writePrometheus(out, "mpchess_move_generation_seconds",
+                                                         "Time of sampled getAllValidMoves() calls");
+    ServerMetrics::searchSeconds.writePrometheus(out, "mpchess_search_seconds",
+                                                 "Duration of built-in engine searches");
+    ServerMetrics::writeBacklogBytes.writePrometheus(out, "mpchess_socket_write_backlog_bytes",
+                                                     "Bytes in a socket's send buffer after a write");
+    ServerMetrics::matchmakingWaitSeconds.writePrometheus(out, "mpchess_matchmaking_wait_seconds",
+                                                          "Time players spent in the matchmaking queue");
+    ServerMetrics::botMoveQueueSeconds.writePrometheus(out, "mpchess_bot_move_queue_seconds",
+                                                       "Time bot searches waited for a worker thread");
+    
+    return out.str();
+}
+
+void MPChessServer::handleMetricsConnection()
+{
+    while (QTcpSocket* socket = metricsServer->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        
+        // A client that never finishes its request is dropped; the timer dies with the socket
+        QTimer::singleShot(METRICS_REQUEST_TIMEOUT_MS, socket, [socket]() { socket->abort(); });
+        
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            // Answer once the request headers are in; scrapers send no body
+            QByteArray request = socket->peek(socket->bytesAvailable());
+            int headerEnd = request.indexOf("\r\n\r\n");
+            if (headerEnd < 0) {
+                if (request.size() > 8192) {
+                    socket->abort();
+                }
+                return;
+            }
+            socket->read(headerEnd + 4);
+            
+            QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+            QByteArray path = requestLine.size() > 1 ? requestLine[1] : QByteArray();
+            int query = path.indexOf('?');
+            if (query >= 0) {
+                path.truncate(query);
+            }
+            
+            QByteArray status = "200 OK";
+            QByteArray body;
+            if (requestLine.size() < 3 || requestLine[0] != "GET") {
+                status = "405 Method Not Allowed";
+            } else if (path != "/metrics") {
+                status = "404 Not Found";
+            } else {
+                body = QByteArray::fromStdString(getMetricsText());
+            }
+            
+            socket->write("HTTP/1.1 " + status + "\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n" + body);
+            socket->disconnectFromHost();
+        });
+    }
+}
+
+bool MPChessServer::buildOpeningBook(const std::string& path, int maxPlies)
+{
+    if (!historyStore) {
+        return false;
     }
     
-    // Analyze the game
-    QJsonObject analysis = analyzeGame(game);
+    bool built = OpeningBook::build(path, *historyStore, maxPlies);
+    if (built) {
+        logger->log("Opening book " + path + " built from the game history", true);
+    }
+    return built;
+}
+
+void MPChessServer::setClusterDirectory(const std::string& rootPath, const std::string& nodeId, const std::string& host)
+{
+    clusterRoot = rootPath;
+    clusterNodeId = nodeId;
+    clusterHost = host;
+}
+
+void MPChessServer::handleClusterHeartbeat()
+{
+    if (!cluster) {
+        return;
+    }
     
-    // Get mistake counts
-    QJsonObject mistakes = analysis["mistakes"].toObject();
-    int blunderCount = mistakes["blunders"].toArray().size();
-    int errorCount = mistakes["errors"].toArray().size();
-    int inaccuracyCount = mistakes["inaccuracies"].toArray().size();
+    cluster->heartbeat(getConnectedClientCount(), getActiveGameCount());
+    for (const QJsonObject& event : cluster->poll()) {
+        applyClusterEvent(event);
+    }
+}
+
+void MPChessServer::sendNodeRedirect(QTcpSocket* socket, const ClusterDirectory::NodeInfo& node,
+                                     const QJsonObject& details)
+{
+    QJsonObject message = details;
+    message["type"] = static_cast<int>(MessageType::NODE_REDIRECT);
+    message["nodeId"] = QString::fromStdString(node.nodeId);
+    message["host"] = QString::fromStdString(node.host);
+    message["port"] = node.port;
+    sendMessage(socket, message);
+}
+
+void MPChessServer::publishPlayer(const ChessPlayer& player)
+{
+    publishPlayers({ player });
+}
+
+void MPChessServer::publishPlayers(const std::vector<ChessPlayer>& players)
+{
+    if (!cluster) {
+        return;
+    }
     
-    summary << "\nGame Statistics:\n";
-    summary << "- White blunders: " << countPlayerMistakes(mistakes["blunders"].toArray(), "white") << "\n";
-    summary << "- White errors: " << countPlayerMistakes(mistakes["errors"].toArray(), "white") << "\n";
-    summary << "- White inaccuracies: " << countPlayerMistakes(mistakes["inaccuracies"].toArray(), "white") << "\n";
-    summary << "- Black blunders: " << countPlayerMistakes(mistakes["blunders"].toArray(), "black") << "\n";
-    summary << "- Black errors: " << countPlayerMistakes(mistakes["errors"].toArray(), "black") << "\n";
-    summary << "- Black inaccuracies: " << countPlayerMistakes(mistakes["inaccuracies"].toArray(), "black") << "\n";
+    // The hash travels with the record so the player can log in on any node
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    std::vector<QJsonObject> events;
+    events.reserve(players.size());
+    for (const ChessPlayer& player : players) {
+        if (player.isBot()) {
+            continue;
+        }
+        playerEventTimes[player.getUsername()] = now;
+        
+        QJsonObject event;
+        event["type"] = "player";
+        event["time"] = now;
+        event["player"] = player.toJson();
+        event["passwordHash"] = QString::fromStdString(authenticator->getPasswordHash(player.getUsername()));
+        events.push_back(event);
+    }
+    
+    if (!events.empty()) {
+        cluster->publish(events);
+    }
+}
+
+void MPChessServer::applyClusterEvent(const QJsonObject& event)
+{
+    if (event["type"].toString() != "player") {
+        return;
+    }
+    
+    ChessPlayer player = ChessPlayer::fromJson(event["player"].toObject());
+    std::string username = player.getUsername();
+    qint64 time = event["time"].toInteger();
+    if (username.empty()) {
+        return;
+    }
+    
+    // Logs are replayed node by node, so only a record newer than the one applied counts
+    auto it = playerEventTimes.find(username);
+    if (it != playerEventTimes.end() && it->second >= time) {
+        return;
+    }
+    playerEventTimes[username] = time;
+    
+    authenticator->importPlayer(player, event["passwordHash"].toString().toStdString());
+    leaderboard->updatePlayer(player);
+    
+    // Someone also logged in here keeps the rating they earned on the other node
+    ChessPlayer* localPlayer = usernamesToPlayers.value(username, nullptr);
+    if (localPlayer) {
+        localPlayer->setRating(player.getRating());
+    }
+    
+    MPCHESS_DEBUG(logger, "applyClusterEvent() - Updated player " + username + " from another node");
+}
+
+int MPChessServer::drain()
+{
+    if (!cluster || !cluster->isOpen()) {
+        return 0;
+    }
+    
+    // No new games start here, and the other nodes stop routing players to this one.
+    // The ratings of the games already finished reach the log before it is left
+    matchmakingTimer->stop();
+    clusterTimer->stop();
+    flushPlayerUpdates();
+    cluster->leave();
+    
+    int migrated = 0;
+    for (auto it = activeGames.begin(); it != activeGames.end();) {
+        ChessGame* game = it->second.get();
+        std::string gameId = it->first;
+        ClusterDirectory::NodeInfo target;
+        if (game->isOver() || !cluster->pickOtherNode(gameId, target)) {
+            ++it;
+            continue;
+        }
+        
+        // The handoff carries the moves, clocks and the tokens the players will present
+        QJsonObject handoff = game->exportState();
+        handoff["white"] = game->getWhitePlayer()->toJson();
+        handoff["black"] = game->getBlackPlayer()->toJson();
+        QJsonObject tokens;
+        for (ChessPlayer* player : { game->getWhitePlayer(), game->getBlackPlayer() }) {
+            if (!player->isBot()) {
+                auto tokenIt = playerSessionTokens.find(player->getUsername());
+                std::string token = tokenIt != playerSessionTokens.end() ? tokenIt->second
+                                                                         : issueSessionToken(player->getUsername());
+                tokens[QString::fromStdString(player->getUsername())] = QString::fromStdString(token);
+            }
+        }
+        handoff["sessionTokens"] = tokens;
+        
+        if (!cluster->saveHandoff(gameId, handoff)) {
+            logger->error("drain() - Could not write the handoff for game " + gameId);
+            ++it;
+            continue;
+        }
+        
+        for (ChessPlayer* player : { game->getWhitePlayer(), game->getBlackPlayer() }) {
+            if (!player->isBot() && player->getSocket()) {
+                sendNodeRedirect(player->getSocket(), target,
+                                 QJsonObject{{"gameId", QString::fromStdString(gameId)}, {"resume", true}});
+            }
+        }
+        
+        // The game now belongs to the target node; its players are saved when they disconnect
+        for (auto playerIt = playerToGameId.begin(); playerIt != playerToGameId.end();) {
+            if (playerIt.value() == gameId) {
+                playerIt = playerToGameId.erase(playerIt);
+            } else {
+                ++playerIt;
+            }
+        }
+        clusterSessions.erase(gameId);
+        it = activeGames.erase(it);
+        
+        logger->log("Migrating game " + gameId + " to node " + target.nodeId);
+        ++migrated;
+    }
+    
+    return migrated;
+}
+
+bool MPChessServer::adoptMigratedGame(const std::string& gameId, const std::string& token)
+{
+    QJsonObject handoff;
+    if (activeGames.find(gameId) != activeGames.end() || !cluster->loadHandoff(gameId, handoff)) {
+        return false;
+    }
+    
+    // Only a player of the game can bring it over
+    QJsonObject tokens = handoff["sessionTokens"].toObject();
+    bool known = false;
+    for (auto it = tokens.begin(); it != tokens.end(); ++it) {
+        known = known || it.value().toString().toStdString() == token;
+    }
+    if (!known) {
+        return false;
+    }
+    
+    std::vector<ChessPlayer*> createdPlayers;
+    auto adoptPlayer = [this, &createdPlayers](const QJsonObject& json) -> ChessPlayer* {
+        ChessPlayer record = ChessPlayer::fromJson(json);
+        if (record.isBot()) {
+            return createBotPlayer((record.getRating() - 1000) / 100);
+        }
+        
+        ChessPlayer* player = usernamesToPlayers.value(record.getUsername(), nullptr);
+        if (player) {
+            return player;
+        }
+        
+        std::unique_ptr<ChessPlayer> playerData = authenticator->getPlayer(record.getUsername());
+        player = new ChessPlayer(playerData ? *playerData : record);
+        player->setSocket(nullptr);
+        usernamesToPlayers[record.getUsername()] = player;
+        createdPlayers.push_back(player);
+        return player;
+    };
+    ChessPlayer* whitePlayer = adoptPlayer(handoff["white"].toObject());
+    ChessPlayer* blackPlayer = adoptPlayer(handoff["black"].toObject());
+    TimeControlType timeControl = static_cast<TimeControlType>(handoff["timeControl"].toInt());
+    
+    std::unique_ptr<ChessGame> game;
+    if (!gamePool.empty()) {
+        game = std::move(gamePool.back());
+        gamePool.pop_back();
+        game->reset(whitePlayer, blackPlayer, gameId, timeControl);
+    } else {
+        game = std::make_unique<ChessGame>(whitePlayer, blackPlayer, gameId, timeControl);
+    }
+    game->start();
+    
+    if (isPlayerInGame(whitePlayer) || isPlayerInGame(blackPlayer) || !game->importState(handoff)) {
+        logger->error("adoptMigratedGame() - Could not restore game " + gameId);
+        for (ChessPlayer* player : createdPlayers) {
+            usernamesToPlayers.remove(player->getUsername());
+            delete player;
+        }
+        return false;
+    }
+    
+    whitePlayer->setColor(PieceColor::WHITE);
+    blackPlayer->setColor(PieceColor::BLACK);
+    activeGames[gameId] = std::move(game);
+    playerToGameId[whitePlayer] = gameId;
+    playerToGameId[blackPlayer] = gameId;
+    
+    qint64 expires = QDateTime::currentMSecsSinceEpoch() + SESSION_TOKEN_LIFETIME_MS;
+    for (ChessPlayer* player : { whitePlayer, blackPlayer }) {
+        if (player->isBot()) {
+            continue;
+        }
+        
+        std::string username = player->getUsername();
+        cluster->setSession(username, gameId);
+        clusterSessions[gameId].push_back(username);
+        
+        std::string playerToken = tokens[QString::fromStdString(username)].toString().toStdString();
+        sessionTokens[playerToken] = { username, expires };
+        playerSessionTokens[username] = playerToken;
+        
+        // Players that do not come back forfeit as if they had dropped here
+        if (!player->getSocket()) {
+            holdDisconnectedPlayer(player);
+        }
+    }
+    cluster->removeHandoff(gameId);
+    
+    ChessGame* adopted = activeGames[gameId].get();
+    scheduleClockDeadline(gameId, adopted->getClockDeadline());
+    if (adopted->getCurrentPlayer()->isBot()) {
+        QTimer::singleShot(0, this, [this, gameId]() { processBotMove(gameId); });
+    }
+    
+    logger->log("Adopted game " + gameId + " migrated from another node after " +
+                std::to_string(adopted->getMoveTimings().size()) + " moves");
+    return true;
+}
+
+QString MPChessServer::getBoardOrientationForPlayer(ChessPlayer* player, const std::string& gameId) const
+{
+    if (!player) {
+        logger->error("getBoardOrientationForPlayer() - Null player");
+        return "standard";
+    }
+    
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end()) {
+        logger->error("getBoardOrientationForPlayer() - Game not found: " + gameId);
+        return "standard";
+    }
     
-    // Add critical moment
-    if (analysis["criticalMoments"].toObject().contains("largestSwing")) {
-        QJsonObject largestSwing = analysis["criticalMoments"].toObject()["largestSwing"].toObject();
-        summary << "\nCritical Moment:\n";
-        summary << "Move " << largestSwing["moveNumber"].toInt() << " by " 
-                << largestSwing["color"].toString().toStdString() << ": " 
-                << largestSwing["move"].toString().toStdString() << "\n";
-        summary << "This move caused an evaluation change of " 
-                << largestSwing["evaluationChange"].toDouble() << "\n";
+    ChessGame* game = it->second.get();
+    if (!game) {
+        logger->error("getBoardOrientationForPlayer() - Null game object for ID: " + gameId);
+        return "standard";
     }
     
-    // Add overall assessment
-    summary << "\nOverall Assessment:\n";
-    if (blunderCount == 0 && errorCount <= 1) {
-        summary << "Excellent game with very few mistakes.\n";
-    } else if (blunderCount <= 1 && errorCount <= 3) {
-        summary << "Good game with some minor errors.\n";
-    } else if (blunderCount <= 3) {
-        summary << "Average game with several mistakes.\n";
+    // White player sees the board in standard orientation (white at bottom)
+    // Black player sees the board flipped (black at bottom)
+    if (player == game->getWhitePlayer()) {
+        return "standard";
+    } else if (player == game->getBlackPlayer()) {
+        return "flipped";
     } else {
-        summary << "Game had multiple significant mistakes.\n";
+        logger->warning("getBoardOrientationForPlayer() - Player " + player->getUsername() + 
+                       " is not part of game " + gameId);
+        return "standard";
     }
-    
-    return summary.str();
-}
-
-double ChessAnalysisEngine::evaluatePositionDeeply(const ChessBoard& board, PieceColor color) {
-    return analysisAI.evaluatePosition(board, color);
 }
 
-std::string ChessAnalysisEngine::classifyMove(double evalBefore, double evalAfter) {
-    double diff = evalAfter - evalBefore;
+void MPChessServer::sendGameStateToPlayers(const std::string& gameId,
+                                           std::unordered_map<QTcpSocket*, QByteArray>* pending)
+{
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end()) {
+        logger->error("sendGameStateToPlayers() - Game not found: " + gameId);
+        return;
+    }
     
-    if (diff > 2.0) return "Brilliant";
-    if (diff > 1.0) return "Good";
-    if (diff > 0.3) return "Accurate";
-    if (diff > -0.3) return "Normal";
-    if (diff > -1.0) return "Inaccuracy";
-    if (diff > -2.0) return "Mistake";
-    return "Blunder";
-}
-
-bool ChessAnalysisEngine::isCapture(const ChessBoard& board, const ChessMove& move) {
-    return board.getPiece(move.getTo()) != nullptr || board.isEnPassantCapture(move);
-}
-
-bool ChessAnalysisEngine::putsInCheck(const ChessBoard& board, const ChessMove& move) {
-    // Get the color of the piece being moved
-    const ChessPiece* piece = board.getPiece(move.getFrom());
-    if (!piece) return false;
+    ChessGame* game = it->second.get();
+    if (!game) {
+        logger->error("sendGameStateToPlayers() - Null game object for ID: " + gameId);
+        return;
+    }
     
-    PieceColor color = piece->getColor();
-    PieceColor opponentColor = (color == PieceColor::WHITE) ? PieceColor::BLACK : PieceColor::WHITE;
+    ChessPlayer* whitePlayer = game->getWhitePlayer();
+    ChessPlayer* blackPlayer = game->getBlackPlayer();
     
-    // Create a copy of the board and make the move
-    auto tempBoard = board.clone();
-    tempBoard->movePiece(move);
+    if (!whitePlayer || !blackPlayer) {
+        logger->error("sendGameStateToPlayers() - Null player(s) in game " + gameId);
+        return;
+    }
     
-    // Check if the opponent is in check
-    return tempBoard->isInCheck(opponentColor);
-}
-
-int ChessAnalysisEngine::countPlayerMistakes(const QJsonArray& mistakes, const QString& color) {
-    int count = 0;
-    for (const QJsonValue& value : mistakes) {
-        QJsonObject mistake = value.toObject();
-        if (mistake["color"].toString() == color) {
-            count++;
+    try {
+        MPCHESS_DEBUG(logger, "sendGameStateToPlayers() - Preparing game state messages for game " + gameId);
+        
+        // The delta is taken on every broadcast so its sequence numbers stay contiguous
+        QJsonObject deltaMessage;
+        deltaMessage["type"] = static_cast<int>(MessageType::GAME_STATE_DELTA);
+        deltaMessage["delta"] = game->takeGameStateDelta();
+        
+        // Each wire format is encoded at most once per broadcast (index 1 = binary)
+        QByteArray encodedDelta[2];
+        
+        for (ChessPlayer* player : { whitePlayer, blackPlayer }) {
+            QTcpSocket* socket = player->getSocket();
+            if (!socket) {
+                logger->warning("sendGameStateToPlayers() - Player has no socket: " + player->getUsername());
+                continue;
+            }
+            
+            bool binary = binaryProtocolSockets.contains(socket);
+            if (stateDeltaSockets.contains(socket)) {
+                MPCHESS_DEBUG(logger, "sendGameStateToPlayers() - Sending game state delta to " + player->getUsername());
+                QByteArray& encoded = encodedDelta[binary ? 1 : 0];
+                if (encoded.isEmpty()) {
+                    encoded = encodeMessage(deltaMessage, binary);
+                }
+                if (pending) {
+                    (*pending)[socket].append(encoded);
+                } else {
+                    sendMessage(socket, encoded);
+                }
+                continue;
+            }
+            
+            // Clients that did not negotiate deltas get the game's cached full state
+            MPCHESS_DEBUG(logger, "sendGameStateToPlayers() - Sending game state to " + player->getUsername());
+            QByteArray encoded = game->getEncodedGameState(getBoardOrientationForPlayer(player, gameId), binary);
+            if (pending) {
+                (*pending)[socket].append(encoded);
+            } else {
+                sendMessage(socket, encoded);
+            }
         }
+        
+        sendGameStateToSpectators(gameId);
+        
+        MPCHESS_DEBUG(logger, "sendGameStateToPlayers() - Game state sent successfully for game " + gameId);
+    } catch (const std::exception& e) {
+        logger->error("sendGameStateToPlayers() - Exception: " + std::string(e.what()));
+    } catch (...) {
+        logger->error("sendGameStateToPlayers() - Unknown exception");
     }
-    return count;
 }
 
-// Implementation of ChessSerializer class
-ChessSerializer::ChessSerializer() {
+void MPChessServer::sendGameStateToSpectators(const std::string& gameId)
+{
+    auto it = gameSpectators.find(gameId);
+    auto gameIt = activeGames.find(gameId);
+    if (it == gameSpectators.end() || gameIt == activeGames.end()) {
+        return;
+    }
+    
+    ChessGame* game = gameIt->second.get();
+    
+    // Iterate a copy: a failed write can disconnect a socket and remove it from the set
+    const QSet<QTcpSocket*> spectators = it->second;
+    for (QTcpSocket* socket : spectators) {
+        // The game caches one encoding per wire format, so every spectator shares the same bytes
+        sendSpectatorSnapshot(socket, game->getEncodedGameState("standard", binaryProtocolSockets.contains(socket)));
+    }
+    
+    MPCHESS_DEBUG(logger, "sendGameStateToSpectators() - Game " + gameId + ": sent to " +
+                  std::to_string(spectators.size()) + " spectator(s)");
 }
 
-QJsonObject ChessSerializer::serializeGame(const ChessGame& game) {
-    return game.serialize();
+void MPChessServer::sendSpectatorSnapshot(QTcpSocket* socket, const QByteArray& encoded)
+{
+    // The backlog is checked on the socket's own thread. A watcher that can't keep up
+    // skips updates instead of queueing them and is caught up once its buffer drains
+    runOnSocketThread(socket, [socket, encoded]() {
+        if (socket->bytesToWrite() > SPECTATOR_BACKLOG_LIMIT) {
+            socket->setProperty("spectatorLagging", true);
+            return;
+        }
+        socket->setProperty("spectatorLagging", false);
+        writeCoalesced(socket, encoded);
+    });
 }
 
-std::unique_ptr<ChessGame> ChessSerializer::deserializeGame(const QJsonObject& json, 
-                                                         ChessPlayer* whitePlayer, 
-                                                         ChessPlayer* blackPlayer) {
-    return ChessGame::deserialize(json, whitePlayer, blackPlayer);
+void MPChessServer::catchUpSpectator(QTcpSocket* socket)
+{
+    // Whatever it missed is superseded by the latest snapshot
+    auto gameIt = activeGames.find(spectatorToGameId.value(socket));
+    if (gameIt != activeGames.end()) {
+        MPCHESS_TRACE("Catching up lagging spectator of game " + gameIt->first);
+        sendSpectatorSnapshot(socket, gameIt->second->getEncodedGameState("standard", binaryProtocolSockets.contains(socket)));
+    }
 }
 
-bool ChessSerializer::saveGameToFile(const ChessGame& game, const std::string& filename) {
-    QJsonObject json = serializeGame(game);
-    QJsonDocument doc(json);
-    
-    QFile file(QString::fromStdString(filename));
-    if (!file.open(QIODevice::WriteOnly)) {
-        return false;
+void MPChessServer::generateMoveRecommendationsAsync(const std::string& gameId, ChessPlayer* player)
+{
+    if (!player) {
+        logger->error("generateMoveRecommendationsAsync() - Null player");
+        return;
     }
     
-    file.write(doc.toJson());
-    return true;
-}
-
-std::unique_ptr<ChessGame> ChessSerializer::loadGameFromFile(const std::string& filename,
-                                                          ChessPlayer* whitePlayer,
-                                                          ChessPlayer* blackPlayer) {
-    QFile file(QString::fromStdString(filename));
-    if (!file.open(QIODevice::ReadOnly)) {
-        return nullptr;
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end()) {
+        logger->error("generateMoveRecommendationsAsync() - Game not found: " + gameId);
+        return;
     }
     
-    QByteArray data = file.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
+    ChessGame* game = it->second.get();
+    if (!game) {
+        logger->error("generateMoveRecommendationsAsync() - Null game object for ID: " + gameId);
+        return;
+    }
     
-    if (doc.isNull() || !doc.isObject()) {
-        return nullptr;
+    // Check if it's the player's turn
+    if (game->getCurrentPlayer() != player) {
+        MPCHESS_DEBUG(logger, "generateMoveRecommendationsAsync() - Not player's turn, skipping recommendations");
+        return;
     }
     
-    return deserializeGame(doc.object(), whitePlayer, blackPlayer);
-}
-
-QJsonObject ChessSerializer::serializePlayer(const ChessPlayer& player) {
-    return player.toJson();
-}
-
-std::unique_ptr<ChessPlayer> ChessSerializer::deserializePlayer(const QJsonObject& json) {
-    ChessPlayer player = ChessPlayer::fromJson(json);
-    return std::make_unique<ChessPlayer>(player);
-}
-
-bool ChessSerializer::savePlayerToFile(const ChessPlayer& player, const std::string& filename) {
-    QJsonObject json = serializePlayer(player);
-    QJsonDocument doc(json);
+    // Served at once when it was worked out on the opponent's time
+    uint64_t key = game->getBoard()->getZobristKey();
+    auto cached = speculativeRecommendations.find(key);
+    if (cached != speculativeRecommendations.end()) {
+        MPCHESS_DEBUG(logger, "generateMoveRecommendationsAsync() - Speculative hit for game " + gameId);
+        std::vector<std::pair<ChessMove, double>> recommendations = cached->second;
+        sendMoveRecommendations(gameId, player, recommendations);
+        return;
+    }
     
-    QFile file(QString::fromStdString(filename));
-    if (!file.open(QIODevice::WriteOnly)) {
-        return false;
+    // Or as soon as the search already running for this position finishes
+    auto pending = pendingRecommendations.find(key);
+    if (pending != pendingRecommendations.end()) {
+        MPCHESS_DEBUG(logger, "generateMoveRecommendationsAsync() - Joining the search running for game " + gameId);
+        pending->second.waiters.emplace_back(gameId, player);
+        return;
     }
     
-    file.write(doc.toJson());
-    return true;
+    MPCHESS_DEBUG(logger, "generateMoveRecommendationsAsync() - Starting async recommendation generation for game " + gameId);
+    
+    auto job = std::make_shared<RecommendationJob>();
+    addPendingRecommendation(key, job, gameId, static_cast<int>(game->getBoard()->getMoveHistory().size()));
+    pendingRecommendations[key].waiters.emplace_back(gameId, player);
+    
+    // Create a task for recommendation generation
+    MoveRecommendationTask* task = new MoveRecommendationTask(
+        *game->getBoard(), player->getColor(), 5, analysisEngine.get(), job);
+    
+    // Connect to the task's signal
+    connect(task, &MoveRecommendationTask::recommendationsReady, 
+            this, [this, gameId, key, job](const std::vector<std::pair<ChessMove, double>>& recommendations) {
+        MPCHESS_DEBUG(logger, "Async recommendations ready for game " + gameId);
+        finishRecommendation(key, job, recommendations);
+    });
+    
+    // Start the task
+    startPoolTask(task, WorkLane::RECOMMENDATION);
 }
 
-std::unique_ptr<ChessPlayer> ChessSerializer::loadPlayerFromFile(const std::string& filename) {
-    QFile file(QString::fromStdString(filename));
-    if (!file.open(QIODevice::ReadOnly)) {
-        return nullptr;
+void MPChessServer::sendMoveRecommendations(const std::string& gameId, ChessPlayer* player,
+                                            const std::vector<std::pair<ChessMove, double>>& recommendations)
+{
+    // Check if the player is still connected and in the same game
+    if (!player->getSocket() || !playerToGameId.contains(player) || playerToGameId[player] != gameId) {
+        MPCHESS_DEBUG(logger, "Player disconnected or changed games, discarding recommendations");
+        return;
     }
     
-    QByteArray data = file.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
+    auto gameIt = activeGames.find(gameId);
     
-    if (doc.isNull() || !doc.isObject()) {
-        return nullptr;
+    // Send recommendations to the player
+    QJsonObject recommendationsMessage;
+    recommendationsMessage["type"] = static_cast<int>(MessageType::MOVE_RECOMMENDATIONS);
+    
+    QJsonArray recommendationsArray;
+    for (const auto& [move, evaluation] : recommendations) {
+        QJsonObject recObj;
+        recObj["move"] = QString::fromStdString(move.toAlgebraic());
+        recObj["evaluation"] = evaluation;
+        
+        // Get the standard notation if possible
+        if (gameIt != activeGames.end() && gameIt->second) {
+            recObj["standardNotation"] = QString::fromStdString(
+                move.toStandardNotation(*gameIt->second->getBoard()));
+        } else {
+            recObj["standardNotation"] = QString::fromStdString(move.toAlgebraic());
+        }
+        
+        recommendationsArray.append(recObj);
     }
     
-    return deserializePlayer(doc.object());
+    recommendationsMessage["recommendations"] = recommendationsArray;
+    sendMessage(player->getSocket(), recommendationsMessage);
+    
+    // The player's best moves are the opponent's likely ones to answer; work on
+    // those answers while this player thinks
+    if (gameIt == activeGames.end() || !gameIt->second || gameIt->second->isOver()) {
+        return;
+    }
+    ChessGame* game = gameIt->second.get();
+    ChessPlayer* opponent = (game->getWhitePlayer() == player) ? game->getBlackPlayer() : game->getWhitePlayer();
+    if (opponent && opponent->getSocket()) {
+        std::vector<ChessMove> replies;
+        for (const auto& [move, evaluation] : recommendations) {
+            if (static_cast<int>(replies.size()) == SPECULATIVE_REPLIES) break;
+            replies.push_back(move);
+        }
+        if (!replies.empty()) {
+            speculateRecommendations(gameId, opponent, replies);
+        }
+    }
 }
 
-QJsonObject ChessSerializer::serializeBoard(const ChessBoard& board) {
-    QJsonObject json;
+void MPChessServer::speculateRecommendations(const std::string& gameId, ChessPlayer* waitingPlayer,
+                                             const std::vector<ChessMove>& replies)
+{
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end() || !it->second || !waitingPlayer) {
+        return;
+    }
     
-    // Serialize pieces
-    QJsonArray piecesArray;
-    for (int r = 0; r < 8; ++r) {
-        for (int c = 0; c < 8; ++c) {
-            Position pos(r, c);
-            const ChessPiece* piece = board.getPiece(pos);
-            if (piece) {
-                piecesArray.append(serializePiece(piece, pos));
+    // The positions are those after the opponent's next move
+    int ply = static_cast<int>(it->second->getBoard()->getMoveHistory().size()) + 1;
+    auto job = std::make_shared<RecommendationJob>();
+    
+    // Positions already known or being searched are not worked out again
+    std::vector<ChessMove> newReplies;
+    if (!replies.empty()) {
+        auto board = it->second->getBoard()->clone();
+        ChessBoard::MoveUndo undo;
+        for (const ChessMove& reply : replies) {
+            board->makeMove(reply, undo);
+            uint64_t key = board->getZobristKey();
+            board->unmakeMove(undo);
+            
+            if (!speculativeRecommendations.count(key) && !pendingRecommendations.count(key)) {
+                addPendingRecommendation(key, job, gameId, ply);
+                newReplies.push_back(reply);
             }
         }
+        if (newReplies.empty()) {
+            return;
+        }
     }
-    json["pieces"] = piecesArray;
     
-    // Serialize current turn
-    json["currentTurn"] = (board.getCurrentTurn() == PieceColor::WHITE) ? "white" : "black";
+    SpeculativeRecommendationTask* task = new SpeculativeRecommendationTask(
+        *it->second->getBoard(), newReplies, SPECULATIVE_REPLIES, 5, analysisEngine.get(), job);
+    
+    MPCHESS_DEBUG(logger, "speculateRecommendations() - Precomputing replies for " + waitingPlayer->getUsername() +
+                  " in game " + gameId);
+    
+    connect(task, &SpeculativeRecommendationTask::repliesChosen,
+            this, [this, job, gameId, ply](const std::vector<uint64_t>& keys) {
+        for (uint64_t key : keys) {
+            if (!speculativeRecommendations.count(key) && !pendingRecommendations.count(key)) {
+                addPendingRecommendation(key, job, gameId, ply);
+            }
+        }
+        
+        // The opponent may have moved already
+        if (job->livePositions == 0) {
+            job->cancelled = true;
+        } else {
+            retireRecommendations(gameId);
+        }
+    });
+    
+    connect(task, &SpeculativeRecommendationTask::speculationReady,
+            this, [this, job](uint64_t key, const std::vector<std::pair<ChessMove, double>>& recommendations) {
+        finishRecommendation(key, job, recommendations);
+    });
     
-    // Serialize en passant target
-    Position enPassantTarget = board.getEnPassantTarget();
-    if (enPassantTarget.isValid()) {
-        json["enPassantTarget"] = QString::fromStdString(enPassantTarget.toAlgebraic());
-    } else {
-        json["enPassantTarget"] = "";
+    // Behind the recommendations players are waiting for
+    startPoolTask(task, WorkLane::RECOMMENDATION, 0, -1);
+}
+
+void MPChessServer::storeSpeculativeRecommendations(uint64_t key,
+                                                    const std::vector<std::pair<ChessMove, double>>& recommendations)
+{
+    if (speculativeRecommendations.emplace(key, recommendations).second) {
+        speculativeOrder.push_back(key);
     }
     
-    // Serialize move history
-    QJsonArray moveHistoryArray;
-    for (const ChessMove& move : board.getMoveHistory()) {
-        moveHistoryArray.append(serializeMove(move));
+    while (speculativeOrder.size() > SPECULATIVE_CACHE_SIZE) {
+        speculativeRecommendations.erase(speculativeOrder.front());
+        speculativeOrder.pop_front();
     }
-    json["moveHistory"] = moveHistoryArray;
-    
-    // Serialize captured pieces
-    QJsonArray whiteCapturedArray;
-    for (PieceType type : board.getCapturedPieces(PieceColor::WHITE)) {
-        whiteCapturedArray.append([type]() -> QString {
-            switch (type) {
-                case PieceType::PAWN: return "pawn";
-                case PieceType::KNIGHT: return "knight";
-                case PieceType::BISHOP: return "bishop";
-                case PieceType::ROOK: return "rook";
-                case PieceType::QUEEN: return "queen";
-                case PieceType::KING: return "king";
-                case PieceType::EMPTY: return "";
-                default: return "";
-            }
-        }());
+}
+
+void MPChessServer::addPendingRecommendation(uint64_t key, const std::shared_ptr<RecommendationJob>& job,
+                                             const std::string& gameId, int ply)
+{
+    PendingRecommendation& pending = pendingRecommendations[key];
+    pending.job = job;
+    pending.gameId = gameId;
+    pending.ply = ply;
+    ++job->livePositions;
+}
+
+void MPChessServer::finishRecommendation(uint64_t key, const std::shared_ptr<RecommendationJob>& job,
+                                         const std::vector<std::pair<ChessMove, double>>& recommendations)
+{
+    // Results of a cancelled search are partial and not kept
+    if (!job->cancelled.load() && !recommendations.empty()) {
+        storeSpeculativeRecommendations(key, recommendations);
     }
-    json["whiteCaptured"] = whiteCapturedArray;
     
-    QJsonArray blackCapturedArray;
-    for (PieceType type : board.getCapturedPieces(PieceColor::BLACK)) {
-        blackCapturedArray.append([type]() -> QString {
-            switch (type) {
-                case PieceType::PAWN: return "pawn";
-                case PieceType::KNIGHT: return "knight";
-                case PieceType::BISHOP: return "bishop";
-                case PieceType::ROOK: return "rook";
-                case PieceType::QUEEN: return "queen";
-                case PieceType::KING: return "king";
-                case PieceType::EMPTY: return "";
-                default: return "";
-            }
-        }());
+    // The position may have been retired, or taken over by another search since
+    auto pending = pendingRecommendations.find(key);
+    if (pending == pendingRecommendations.end() || pending->second.job != job) {
+        return;
     }
-    json["blackCaptured"] = blackCapturedArray;
+    std::vector<std::pair<std::string, ChessPlayer*>> waiters = std::move(pending->second.waiters);
+    pendingRecommendations.erase(pending);
+    --job->livePositions;
     
-    return json;
+    // A player who got here first gets the result now, or a search of their own if it failed
+    for (const auto& [waiterGameId, waiter] : waiters) {
+        if (recommendations.empty() || job->cancelled.load()) {
+            generateMoveRecommendationsAsync(waiterGameId, waiter);
+        } else {
+            sendMoveRecommendations(waiterGameId, waiter, recommendations);
+        }
+    }
 }
 
-std::unique_ptr<ChessBoard> ChessSerializer::deserializeBoard(const QJsonObject& json) {
-    auto board = std::make_unique<ChessBoard>();
-    
-    // Clear the board
-    for (int r = 0; r < 8; ++r) {
-        for (int c = 0; c < 8; ++c) {
-            board->board[r][c] = nullptr;
+void MPChessServer::retireRecommendations(const std::string& gameId)
+{
+    auto gameIt = activeGames.find(gameId);
+    bool over = gameIt == activeGames.end() || !gameIt->second || gameIt->second->isOver();
+    uint64_t currentKey = over ? 0 : gameIt->second->getBoard()->getZobristKey();
+    int currentPly = over ? std::numeric_limits<int>::max()
+                          : static_cast<int>(gameIt->second->getBoard()->getMoveHistory().size());
+    
+    for (auto it = pendingRecommendations.begin(); it != pendingRecommendations.end();) {
+        PendingRecommendation& pending = it->second;
+        bool current = !over && it->first == currentKey;
+        
+        // Players of this game no longer wait for positions it has left
+        if (!current) {
+            pending.waiters.erase(std::remove_if(pending.waiters.begin(), pending.waiters.end(),
+                                                 [&gameId](const std::pair<std::string, ChessPlayer*>& waiter) {
+                                                     return waiter.first == gameId;
+                                                 }),
+                                  pending.waiters.end());
+        }
+        
+        // A position this game has moved past, now wanted by nobody
+        if (pending.gameId == gameId && !current && pending.ply <= currentPly && pending.waiters.empty()) {
+            if (--pending.job->livePositions == 0) {
+                pending.job->cancelled = true;
+            }
+            it = pendingRecommendations.erase(it);
+        } else {
+            ++it;
         }
     }
+}
+
+void MPChessServer::handleNewConnection()
+{
+    QTcpSocket* socket = server->nextPendingConnection();
     
-    // Deserialize pieces
-    QJsonArray piecesArray = json["pieces"].toArray();
-    for (const QJsonValue& value : piecesArray) {
-        QJsonObject pieceObj = value.toObject();
-        Position pos = Position::fromAlgebraic(pieceObj["position"].toString().toStdString());
-        if (pos.isValid()) {
-            board->board[pos.row][pos.col] = deserializePiece(pieceObj);
-        }
+    if (!socket) {
+        logger->error("Invalid socket from new connection");
+        return;
     }
     
-    // Deserialize current turn
-    board->setCurrentTurn(json["currentTurn"].toString() == "white" ? PieceColor::WHITE : PieceColor::BLACK);
+    logger->log("New client connected: " + socket->peerAddress().toString().toStdString());
     
-    // Deserialize en passant target
-    std::string enPassantStr = json["enPassantTarget"].toString().toStdString();
-    if (!enPassantStr.empty()) {
-        board->setEnPassantTarget(Position::fromAlgebraic(enPassantStr));
+    // Writes are already batched per event-loop pass, so Nagle would only add delay
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    
+    if (networkWorkers) {
+        networkWorkers->addSocket(socket);
+        return;
     }
     
-    // Deserialize move history
-    QJsonArray moveHistoryArray = json["moveHistory"].toArray();
-    for (const QJsonValue& value : moveHistoryArray) {
-        board->moveHistory.push_back(deserializeMove(value.toObject()));
+    connect(socket, &QTcpSocket::readyRead, this, &MPChessServer::handleClientData);
+    connect(socket, &QTcpSocket::disconnected, this, &MPChessServer::handleClientDisconnected);
+}
+
+void MPChessServer::handleClientDisconnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) {
+        logger->error("Invalid socket in disconnect handler");
+        return;
     }
     
-    // Deserialize captured pieces
-    QJsonArray whiteCapturedArray = json["whiteCaptured"].toArray();
-    for (const QJsonValue& value : whiteCapturedArray) {
-        std::string typeStr = value.toString().toStdString();
-        PieceType type = PieceType::PAWN;  // Default
-        if (typeStr == "pawn") type = PieceType::PAWN;
-        else if (typeStr == "knight") type = PieceType::KNIGHT;
-        else if (typeStr == "bishop") type = PieceType::BISHOP;
-        else if (typeStr == "rook") type = PieceType::ROOK;
-        else if (typeStr == "queen") type = PieceType::QUEEN;
+    removeClient(socket, socket->peerAddress().toString().toStdString());
+}
+
+void MPChessServer::removeClient(QTcpSocket* socket, const std::string& peerAddress)
+{
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (player && player->getSocket() != socket) {
+        // The player already logged in again on another connection
+        MPCHESS_DEBUG(logger, "Superseded connection closed for " + player->getUsername());
+    } else if (player && isPlayerInGame(player)) {
+        logger->log("Player disconnected during a game: " + player->getUsername());
+        
+        // The game goes on while the player has a chance to reconnect
+        holdDisconnectedPlayer(player);
+    } else if (player) {
+        logger->log("Player disconnected: " + player->getUsername());
         
-        board->capturedWhitePieces.push_back(type);
+        // Clean up resources
+        cleanupDisconnectedPlayer(player);
+    } else {
+        logger->log("Unknown client disconnected: " + peerAddress);
     }
     
-    QJsonArray blackCapturedArray = json["blackCaptured"].toArray();
-    for (const QJsonValue& value : blackCapturedArray) {
-        std::string typeStr = value.toString().toStdString();
-        PieceType type = PieceType::PAWN;  // Default
-        if (typeStr == "pawn") type = PieceType::PAWN;
-        else if (typeStr == "knight") type = PieceType::KNIGHT;
-        else if (typeStr == "bishop") type = PieceType::BISHOP;
-        else if (typeStr == "rook") type = PieceType::ROOK;
-        else if (typeStr == "queen") type = PieceType::QUEEN;
-        
-        board->capturedBlackPieces.push_back(type);
+    // Remove the socket from the maps
+    removeSpectator(socket);
+    for (QList<QTcpSocket*>& waiters : analysisWaiters) {
+        waiters.removeAll(socket);
+    }
+    socketToPlayer.remove(socket);
+    auto authIt = authRequests.find(socket);
+    if (authIt != authRequests.end()) {
+        authIt->second.cancelled->store(true);
+        authRequests.erase(authIt);
     }
+    binaryProtocolSockets.remove(socket);
+    stateDeltaSockets.remove(socket);
+    compressionSockets.remove(socket);
+    receiveBuffers.remove(socket);
     
-    return board;
+    // Delete the socket (in its own thread)
+    socket->deleteLater();
 }
 
-QJsonObject ChessSerializer::serializePiece(const ChessPiece* piece, const Position& pos) {
-    QJsonObject json;
+std::string MPChessServer::issueSessionToken(const std::string& username)
+{
+    // A new login replaces the token the player had
+    auto existing = playerSessionTokens.find(username);
+    if (existing != playerSessionTokens.end()) {
+        sessionTokens.erase(existing->second);
+    }
     
-    json["position"] = QString::fromStdString(pos.toAlgebraic());
-    json["type"] = [piece]() -> QString {
-        switch (piece->getType()) {
-            case PieceType::PAWN: return "pawn";
-            case PieceType::KNIGHT: return "knight";
-            case PieceType::BISHOP: return "bishop";
-            case PieceType::ROOK: return "rook";
-            case PieceType::QUEEN: return "queen";
-            case PieceType::KING: return "king";
-            default: return "empty";
-        }
-    }();
+    QByteArray bytes;
+    for (int i = 0; i < 2; ++i) {
+        quint64 value = QRandomGenerator::system()->generate64();
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    std::string token = bytes.toHex().toStdString();
     
-    json["color"] = (piece->getColor() == PieceColor::WHITE) ? "white" : "black";
-    json["moved"] = piece->hasMoved();
+    sessionTokens[token] = { username, QDateTime::currentMSecsSinceEpoch() + SESSION_TOKEN_LIFETIME_MS };
+    playerSessionTokens[username] = token;
+    return token;
+}
+
+bool MPChessServer::checkSessionToken(const std::string& token, const std::string& gameId, std::string& username)
+{
+    auto it = sessionTokens.find(token);
     
-    return json;
+    // A game handed over by a draining node brings its players' tokens along
+    if (it == sessionTokens.end() && cluster && !gameId.empty() && adoptMigratedGame(gameId, token)) {
+        it = sessionTokens.find(token);
+    }
+    
+    if (it == sessionTokens.end() || it->second.expires < QDateTime::currentMSecsSinceEpoch()) {
+        return false;
+    }
+    
+    username = it->second.username;
+    return true;
 }
 
-std::unique_ptr<ChessPiece> ChessSerializer::deserializePiece(const QJsonObject& json) {
-    std::string typeStr = json["type"].toString().toStdString();
-    std::string colorStr = json["color"].toString().toStdString();
-    bool moved = json["moved"].toBool();
+void MPChessServer::holdDisconnectedPlayer(ChessPlayer* player)
+{
+    player->setSocket(nullptr);
     
-    PieceColor color = (colorStr == "white") ? PieceColor::WHITE : PieceColor::BLACK;
-    std::unique_ptr<ChessPiece> piece;
+    qint64 deadline = QDateTime::currentMSecsSinceEpoch() + RECONNECT_GRACE_MS;
+    std::string username = player->getUsername();
+    reconnectDeadlines[username] = deadline;
+    QTimer::singleShot(RECONNECT_GRACE_MS, this, [this, username, deadline]() {
+        expireReconnectGrace(username, deadline);
+    });
     
-    if (typeStr == "pawn") {
-        piece = std::make_unique<Pawn>(color);
-    } else if (typeStr == "knight") {
-        piece = std::make_unique<Knight>(color);
-    } else if (typeStr == "bishop") {
-        piece = std::make_unique<Bishop>(color);
-    } else if (typeStr == "rook") {
-        piece = std::make_unique<Rook>(color);
-    } else if (typeStr == "queen") {
-        piece = std::make_unique<Queen>(color);
-    } else if (typeStr == "king") {
-        piece = std::make_unique<King>(color);
-    } else {
-        return nullptr;
+    auto gameIt = playerToGameId.find(player);
+    auto it = gameIt != playerToGameId.end() ? activeGames.find(gameIt.value()) : activeGames.end();
+    if (it == activeGames.end()) {
+        return;
     }
     
-    piece->setMoved(moved);
-    return piece;
+    ChessPlayer* opponent = it->second->getOpponentPlayer(player);
+    if (opponent && opponent->getSocket()) {
+        QJsonObject message;
+        message["type"] = static_cast<int>(MessageType::CHAT);
+        message["sender"] = "Server";
+        message["message"] = QString::fromStdString(username + " disconnected and has " +
+                                                    std::to_string(RECONNECT_GRACE_MS / 1000) + " seconds to reconnect");
+        sendMessage(opponent->getSocket(), message);
+    }
 }
 
-QJsonObject ChessSerializer::serializeMove(const ChessMove& move) {
-    QJsonObject json;
+void MPChessServer::expireReconnectGrace(const std::string& username, qint64 deadline)
+{
+    // A later disconnection restarted the grace period
+    auto it = reconnectDeadlines.find(username);
+    if (it == reconnectDeadlines.end() || it->second != deadline) {
+        return;
+    }
+    reconnectDeadlines.erase(it);
     
-    json["from"] = QString::fromStdString(move.getFrom().toAlgebraic());
-    json["to"] = QString::fromStdString(move.getTo().toAlgebraic());
+    ChessPlayer* player = usernamesToPlayers.value(username, nullptr);
+    if (player && !player->getSocket()) {
+        logger->log("Reconnect grace period expired for " + username);
+        cleanupDisconnectedPlayer(player);
+    }
+}
+
+void MPChessServer::resendGameState(QTcpSocket* socket, ChessPlayer* player, qint64 lastSequence)
+{
+    auto gameIt = playerToGameId.find(player);
+    auto it = gameIt != playerToGameId.end() ? activeGames.find(gameIt.value()) : activeGames.end();
+    if (it == activeGames.end()) {
+        return;
+    }
     
-    if (move.getPromotionType() != PieceType::EMPTY) {
-        json["promotion"] = [move]() -> QString {
-            switch (move.getPromotionType()) {
-                case PieceType::QUEEN: return "queen";
-                case PieceType::ROOK: return "rook";
-                case PieceType::BISHOP: return "bishop";
-                case PieceType::KNIGHT: return "knight";
-                default: return "";
-            }
-        }();
+    ChessGame* game = it->second.get();
+    bool binary = binaryProtocolSockets.contains(socket);
+    
+    // A client that missed only a few moves replays the deltas it did not get
+    std::vector<QJsonObject> deltas;
+    if (lastSequence >= 0 && stateDeltaSockets.contains(socket) &&
+        game->getDeltasSince(static_cast<quint64>(lastSequence), deltas)) {
+        for (const QJsonObject& delta : deltas) {
+            QJsonObject deltaMessage;
+            deltaMessage["type"] = static_cast<int>(MessageType::GAME_STATE_DELTA);
+            deltaMessage["delta"] = delta;
+            sendMessage(socket, deltaMessage);
+        }
+        MPCHESS_DEBUG(logger, "resendGameState() - Replayed " + std::to_string(deltas.size()) + " deltas to " +
+                      player->getUsername());
+        return;
     }
     
-    return json;
+    sendMessage(socket, game->getEncodedGameState(getBoardOrientationForPlayer(player, it->first), binary));
+    MPCHESS_DEBUG(logger, "resendGameState() - Sent a full game state to " + player->getUsername());
 }
 
-ChessMove ChessSerializer::deserializeMove(const QJsonObject& json) {
-    Position from = Position::fromAlgebraic(json["from"].toString().toStdString());
-    Position to = Position::fromAlgebraic(json["to"].toString().toStdString());
+void MPChessServer::handleClientData()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket) {
+        logger->error("Invalid socket in data handler");
+        return;
+    }
     
-    PieceType promotionType = PieceType::EMPTY;
-    if (json.contains("promotion")) {
-        std::string promotionStr = json["promotion"].toString().toStdString();
-        if (promotionStr == "queen") promotionType = PieceType::QUEEN;
-        else if (promotionStr == "rook") promotionType = PieceType::ROOK;
-        else if (promotionStr == "bishop") promotionType = PieceType::BISHOP;
-        else if (promotionStr == "knight") promotionType = PieceType::KNIGHT;
+    readClient(socket);
+}
+
+void MPChessServer::readClient(QTcpSocket* socket)
+{
+    // Messages split across reads complete later
+    bool framed = receiveBuffers[socket].process(socket, [this, socket](const QJsonObject& message) {
+        // Log the message
+        logger->logNetworkMessage("RECEIVED", message);
+        
+        // Process the message
+        processClientMessage(socket, message);
+        
+        // A handler may have dropped the connection
+        return receiveBuffers.contains(socket);
+    }, logger.get());
+    
+    if (!framed) {
+        receiveBuffers.remove(socket);
+        socket->abort();
+        return;
+    }
+    
+    auto it = receiveBuffers.find(socket);
+    if (it == receiveBuffers.end()) {
+        return;
     }
     
-    return ChessMove(from, to, promotionType);
+    qint64 delay = it.value().scheduleRetry();
+    if (delay >= 0) {
+        QTimer::singleShot(delay, this, [this, socket]() {
+            auto it = receiveBuffers.find(socket);
+            if (it != receiveBuffers.end()) {
+                it.value().retryStarted();
+                readClient(socket);
+            }
+        });
+    }
 }
 
-// Implementation of ChessLogger class
-ChessLogger::ChessLogger(const std::string& logFilePath) : logLevel(0)
+void MPChessServer::handleWorkerMessage(QTcpSocket* socket, const QJsonObject& message)
 {
-    logFile.open(logFilePath, std::ios::out | std::ios::app);
-    if (!logFile.is_open()) {
-        std::cerr << "Failed to open log file: " << logFilePath << std::endl;
-    }
+    // Log the message
+    logger->logNetworkMessage("RECEIVED", message);
     
-    log(">>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Multiplayer Chess Server Logger initialized <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<");
+    // Process the message
+    processClientMessage(socket, message);
 }
 
-ChessLogger::~ChessLogger()
+NetworkWorker::NetworkWorker(MPChessServer* server)
+    : QObject(nullptr), server(server)
 {
-    if (logFile.is_open()) {
-        log("Chess Server Logger shutting down");
-        logFile.close();
-    }
 }
 
-void ChessLogger::log(const std::string& message, bool console)
+void NetworkWorker::adoptSocket(QTcpSocket* socket, const InboundConnection& pending)
 {
-    std::lock_guard<std::mutex> lock(logMutex);
+    // A retry the previous owner scheduled will not find the socket there
+    receiveBuffers[socket] = pending;
+    receiveBuffers[socket].retryStarted();
     
-    std::string timestamp = getCurrentTimestamp();
-    std::string logMessage = timestamp + " [INFO] " + message;
+    connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readSocket(socket); });
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { handleDisconnected(socket); });
     
-    if (logFile.is_open()) {
-        logFile << logMessage << std::endl;
+    // Input, or a disconnect, that arrived while the socket was between threads
+    readSocket(socket);
+    if (socket->state() == QAbstractSocket::UnconnectedState && receiveBuffers.contains(socket)) {
+        handleDisconnected(socket);
     }
+}
+
+void NetworkWorker::handleDisconnected(QTcpSocket* socket)
+{
+    std::string peerAddress = socket->peerAddress().toString().toStdString();
+    receiveBuffers.remove(socket);
+    disconnect(socket, nullptr, this, nullptr);
     
-    if (console) {
-        std::cout << logMessage << std::endl;
-    }
+    // Queued after every message this worker posted for the socket
+    MPChessServer* target = server;
+    QMetaObject::invokeMethod(target, [target, socket, peerAddress]() {
+        target->removeClient(socket, peerAddress);
+    }, Qt::QueuedConnection);
 }
 
-void ChessLogger::error(const std::string& message, bool console)
+void NetworkWorker::transferSocket(QTcpSocket* socket, NetworkWorker* target)
 {
-    std::lock_guard<std::mutex> lock(logMutex);
+    // Nothing to move if it is already here or has disconnected
+    if (target == this || !receiveBuffers.contains(socket)) {
+        return;
+    }
     
-    std::string timestamp = getCurrentTimestamp();
-    std::string logMessage = timestamp + " [ERROR] " + message;
+    InboundConnection pending = receiveBuffers.take(socket);
+    disconnect(socket, nullptr, this, nullptr);
+    socket->moveToThread(target->thread());
     
-    if (logFile.is_open()) {
-        logFile << logMessage << std::endl;
+    QMetaObject::invokeMethod(target, [target, socket, pending]() {
+        target->adoptSocket(socket, pending);
+    }, Qt::QueuedConnection);
+}
+
+void NetworkWorker::readSocket(QTcpSocket* socket)
+{
+    auto it = receiveBuffers.find(socket);
+    if (it == receiveBuffers.end()) {
+        return;
     }
     
-    if (console) {
-        std::cerr << logMessage << std::endl;
+    bool framed = it.value().process(socket, [this, socket](const QJsonObject& message) {
+        // Game state is only touched in the server's thread
+        MPChessServer* target = server;
+        QMetaObject::invokeMethod(target, [target, socket, message]() {
+            target->handleWorkerMessage(socket, message);
+        }, Qt::QueuedConnection);
+        return true;
+    }, server->getLogger().get());
+    
+    if (!framed) {
+        receiveBuffers.erase(it);
+        socket->abort();
+        return;
     }
+    
+    scheduleRetry(socket);
 }
 
-void ChessLogger::warning(const std::string& message, bool console)
+void NetworkWorker::scheduleRetry(QTcpSocket* socket)
 {
-    std::lock_guard<std::mutex> lock(logMutex);
-    
-    std::string timestamp = getCurrentTimestamp();
-    std::string logMessage = timestamp + " [WARNING] " + message;
-    
-    if (logFile.is_open()) {
-        logFile << logMessage << std::endl;
+    auto it = receiveBuffers.find(socket);
+    if (it == receiveBuffers.end()) {
+        return;
     }
     
-    if (console) {
-        std::cout << logMessage << std::endl;
+    qint64 delay = it.value().scheduleRetry();
+    if (delay >= 0) {
+        // Looked up again when it fires; the socket may have moved to another worker
+        QTimer::singleShot(delay, this, [this, socket]() {
+            auto it = receiveBuffers.find(socket);
+            if (it != receiveBuffers.end()) {
+                it.value().retryStarted();
+                readSocket(socket);
+            }
+        });
     }
 }
 
-void ChessLogger::debug(const std::string& message, bool console)
+NetworkWorkerPool::NetworkWorkerPool(MPChessServer* server, int threadCount)
+    : nextWorker(0)
 {
-    if (logLevel < 1) return;  // Skip debug messages if log level is too low
-    
-    std::lock_guard<std::mutex> lock(logMutex);
-    
-    std::string timestamp = getCurrentTimestamp();
-    std::string logMessage = timestamp + " [DEBUG] " + message;
-    
-    if (logFile.is_open()) {
-        logFile << logMessage << std::endl;
+    for (int i = 0; i < std::max(1, threadCount); ++i) {
+        QThread* thread = new QThread();
+        thread->setObjectName(QString("network-%1").arg(i));
+        
+        NetworkWorker* worker = new NetworkWorker(server);
+        worker->moveToThread(thread);
+        thread->start();
+        
+        threads.push_back(thread);
+        workers.push_back(worker);
     }
-    
-    if (console) {
-        std::cout << logMessage << std::endl;
+}
+
+NetworkWorkerPool::~NetworkWorkerPool()
+{
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->quit();
+        threads[i]->wait();
+        delete workers[i];
+        delete threads[i];
     }
 }
 
-void ChessLogger::logGameState(const ChessGame& game)
+void NetworkWorkerPool::addSocket(QTcpSocket* socket)
 {
-    if (logLevel < 2) return;  // Skip detailed game state if log level is too low
+    NetworkWorker* worker = workers[nextWorker++ % workers.size()];
     
-    std::lock_guard<std::mutex> lock(logMutex);
+    // A socket can only change threads without a parent
+    socket->setParent(nullptr);
+    socket->moveToThread(worker->thread());
     
-    std::string timestamp = getCurrentTimestamp();
-    std::string gameId = game.getGameId();
-    std::string whitePlayer = game.getWhitePlayer()->getUsername();
-    std::string blackPlayer = game.getBlackPlayer()->getUsername();
-    std::string currentTurn = (game.getBoard()->getCurrentTurn() == PieceColor::WHITE) ? "White" : "Black";
-    std::string asciiBoard = game.getBoardAscii();
+    QMetaObject::invokeMethod(worker, [worker, socket]() {
+        worker->adoptSocket(socket, InboundConnection());
+    }, Qt::QueuedConnection);
+}
+
+void NetworkWorkerPool::assignToGame(QTcpSocket* socket, const std::string& gameId)
+{
+    if (!socket) {
+        return;
+    }
     
-    std::stringstream ss;
-    ss << "Game State [" << gameId << "]:\n"
-       << "White: " << whitePlayer << ", Black: " << blackPlayer << "\n"
-       << "Current Turn: " << currentTurn << "\n"
-       << asciiBoard;
+    NetworkWorker* target = workers[std::hash<std::string>()(gameId) % workers.size()];
     
-    if (logFile.is_open()) {
-        logFile << timestamp << " [GAME] " << ss.str() << std::endl;
+    // The move has to start in the thread that owns the socket now
+    QMetaObject::invokeMethod(socket, [this, socket, target]() {
+        NetworkWorker* source = workerForThread(QThread::currentThread());
+        if (source) {
+            source->transferSocket(socket, target);
+        }
+    }, Qt::QueuedConnection);
+}
+
+NetworkWorker* NetworkWorkerPool::workerForThread(QThread* thread) const
+{
+    for (size_t i = 0; i < threads.size(); ++i) {
+        if (threads[i] == thread) {
+            return workers[i];
+        }
     }
+    return nullptr;
 }
 
-void ChessLogger::logPlayerAction(const ChessPlayer& player, const std::string& action)
+// Implementation of WorkScheduler class
+WorkScheduler::WorkScheduler(int threadCount)
+    : nextSequence(0), stopping(false)
 {
-    std::lock_guard<std::mutex> lock(logMutex);
-    
-    std::string timestamp = getCurrentTimestamp();
-    std::string username = player.getUsername();
+    int threads = std::max(2, threadCount);
     
-    std::stringstream ss;
-    ss << "Player " << username << ": " << action;
+    // Bot moves may use every thread; recommendations and analysis never take the
+    // thread held back for bots, and analysis at most half of the threads
+    lanes[static_cast<int>(WorkLane::BOT_MOVE)].cap = threads;
+    lanes[static_cast<int>(WorkLane::RECOMMENDATION)].cap = threads - BOT_RESERVED_THREADS;
+    lanes[static_cast<int>(WorkLane::ANALYSIS)].cap = std::max(1, threads / 2);
     
-    if (logFile.is_open()) {
-        logFile << timestamp << " [PLAYER] " << ss.str() << std::endl;
+    // Home lanes are spread so an idle lane's threads steal, while every kind of work
+    // has threads that prefer it
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(&WorkScheduler::workerLoop, this, static_cast<WorkLane>(i % LANE_COUNT));
     }
 }
 
-void ChessLogger::logServerEvent(const std::string& event)
+WorkScheduler::~WorkScheduler()
 {
-    std::lock_guard<std::mutex> lock(logMutex);
-    
-    std::string timestamp = getCurrentTimestamp();
+    shutdown();
+}
+
+void WorkScheduler::submit(WorkLane lane, QRunnable* task, qint64 deadline, int priority)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stopping) {
+            Task queued{ deadline > 0 ? deadline : std::numeric_limits<qint64>::max(), priority, nextSequence++, task };
+            lanes[static_cast<int>(lane)].tasks.push(queued);
+            task = nullptr;
+        }
+    }
+    if (!task) {
+        workAvailable.notify_one();
+    } else if (task->autoDelete()) {
+        delete task;
+    }
+}
+
+void WorkScheduler::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping && workers.empty()) {
+            return;
+        }
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
     
-    if (logFile.is_open()) {
-        logFile << timestamp << " [SERVER] " << event << std::endl;
+    for (Lane& lane : lanes) {
+        while (!lane.tasks.empty()) {
+            QRunnable* task = lane.tasks.top().runnable;
+            lane.tasks.pop();
+            if (task->autoDelete()) {
+                delete task;
+            }
+        }
     }
 }
 
-void ChessLogger::logNetworkMessage(const std::string& direction, const QJsonObject& message) {
-    if (logLevel < 3) return;  // Skip network messages if log level is too low
+size_t WorkScheduler::getQueueLength(WorkLane lane) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lanes[static_cast<int>(lane)].tasks.size();
+}
+
+int WorkScheduler::getActiveCount(WorkLane lane) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lanes[static_cast<int>(lane)].active;
+}
+
+bool WorkScheduler::canRun(int lane) const
+{
+    const Lane& candidate = lanes[lane];
+    if (candidate.tasks.empty() || candidate.active >= candidate.cap) {
+        return false;
+    }
+    if (lane == static_cast<int>(WorkLane::BOT_MOVE)) {
+        return true;
+    }
     
-    std::lock_guard<std::mutex> lock(logMutex);
+    int background = 0;
+    for (int i = 0; i < LANE_COUNT; ++i) {
+        if (i != static_cast<int>(WorkLane::BOT_MOVE)) {
+            background += lanes[i].active;
+        }
+    }
+    return background < static_cast<int>(workers.size()) - BOT_RESERVED_THREADS;
+}
+
+void WorkScheduler::workerLoop(WorkLane home)
+{
+    // Bot moves first, then the home lane, then the others by urgency
+    std::array<int, LANE_COUNT> order;
+    order[0] = static_cast<int>(WorkLane::BOT_MOVE);
+    int next = 1;
+    if (home != WorkLane::BOT_MOVE) {
+        order[next++] = static_cast<int>(home);
+    }
+    for (int lane = 0; lane < LANE_COUNT; ++lane) {
+        if (std::find(order.begin(), order.begin() + next, lane) == order.begin() + next) {
+            order[next++] = lane;
+        }
+    }
     
-    std::string timestamp = getCurrentTimestamp();
-    QJsonDocument doc(message);
-    QString jsonString = doc.toJson(QJsonDocument::Compact);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        int lane = -1;
+        workAvailable.wait(lock, [this, &order, &lane] {
+            if (stopping) {
+                return true;
+            }
+            for (int candidate : order) {
+                if (canRun(candidate)) {
+                    lane = candidate;
+                    return true;
+                }
+            }
+            return false;
+        });
+        if (stopping) {
+            break;
+        }
+        
+        QRunnable* task = lanes[lane].tasks.top().runnable;
+        lanes[lane].tasks.pop();
+        lanes[lane].active++;
+        lock.unlock();
+        
+        task->run();
+        if (task->autoDelete()) {
+            delete task;
+        }
+        
+        lock.lock();
+        lanes[lane].active--;
+        
+        // The finished task may have been what held back work in a capped lane
+        workAvailable.notify_one();
+    }
+}
+
+void MPChessServer::handleMatchmakingTimer()
+{
+    MPCHESS_DEBUG(logger, "Matchmaking timer triggered - checking for matches and timeouts");
     
-    if (logFile.is_open()) {
-        logFile << timestamp << " [NETWORK] " << direction << ": " 
-                << jsonString.toStdString() << std::endl;
+    try {
+        // Check for timed out players and match them with bots
+        std::vector<ChessPlayer*> timedOutPlayers = matchmaker->checkTimeouts(60); // 60 seconds timeout
+        for (ChessPlayer* player : timedOutPlayers) {
+            if (!player) {
+                logger->error("Null player in timed out players list");
+                continue;
+            }
+            
+            // Skip if player is already in a game
+            if (isPlayerInGame(player)) {
+                MPCHESS_DEBUG(logger, "Player " + player->getUsername() + " is already in a game, skipping bot match");
+                continue;
+            }
+            
+            logger->log("Player timed out in matchmaking: " + player->getUsername());
+            
+            try {
+                // Create a bot player
+                ChessPlayer* botPlayer = createBotPlayer(player->getRating() / 200);  // Scale skill level based on rating
+                
+                if (!botPlayer) {
+                    logger->error("Failed to create bot player for timed out player: " + player->getUsername());
+                    continue;
+                }
+                
+                // Create a game between the player and the bot
+                try {
+                    createGame(player, botPlayer, TimeControlType::RAPID);
+                    
+                    // Send matchmaking status to the player
+                    QJsonObject message;
+                    message["type"] = static_cast<int>(MessageType::MATCHMAKING_STATUS);
+                    message["status"] = "matched_with_bot";
+                    message["opponent"] = QString::fromStdString(botPlayer->getUsername());
+                    
+                    if (player->getSocket()) {
+                        sendMessage(player->getSocket(), message);
+                    } else {
+                        logger->warning("Player has no socket: " + player->getUsername());
+                    }
+                } catch (const std::exception& e) {
+                    logger->error("Failed to create game with bot: " + std::string(e.what()));
+                }
+            } catch (const std::exception& e) {
+                logger->error("Exception in bot matching: " + std::string(e.what()));
+            } catch (...) {
+                logger->error("Unknown exception in bot matching");
+            }
+        }
+        
+        // Try to match players
+        std::vector<std::pair<ChessPlayer*, ChessPlayer*>> matches;
+        try {
+            matches = matchmaker->matchPlayers();
+            MPCHESS_DEBUG(logger, "Matchmaker found " + std::to_string(matches.size()) + " potential matches");
+        } catch (const std::exception& e) {
+            logger->error("Exception in matchPlayers: " + std::string(e.what()));
+            return;
+        }
+        
+        for (const auto& match : matches) {
+            ChessPlayer* player1 = match.first;
+            ChessPlayer* player2 = match.second;
+            
+            if (!player1 || !player2) {
+                logger->error("Null player in match");
+                continue;
+            }
+            
+            // Double-check that neither player is already in a game
+            if (isPlayerInGame(player1) || isPlayerInGame(player2)) {
+                logger->warning("Skipping match because at least one player is already in a game");
+                continue;
+            }
+            
+            logger->log("Matched players: " + player1->getUsername() + " vs " + player2->getUsername());
+            
+            try {
+                // Create a game between the players
+                std::string gameId = createGame(player1, player2, TimeControlType::RAPID);
+                MPCHESS_DEBUG(logger, "Created game with ID: " + gameId);
+                
+                // Send matchmaking status to both players
+                QJsonObject message1;
+                message1["type"] = static_cast<int>(MessageType::MATCHMAKING_STATUS);
+                message1["status"] = "matched";
+                message1["opponent"] = QString::fromStdString(player2->getUsername());
+                message1["gameId"] = QString::fromStdString(gameId);
+                
+                QJsonObject message2;
+                message2["type"] = static_cast<int>(MessageType::MATCHMAKING_STATUS);
+                message2["status"] = "matched";
+                message2["opponent"] = QString::fromStdString(player1->getUsername());
+                message2["gameId"] = QString::fromStdString(gameId);
+                
+                if (player1->getSocket()) {
+                    sendMessage(player1->getSocket(), message1);
+                } else {
+                    logger->warning("Player1 has no socket: " + player1->getUsername());
+                }
+                
+                if (player2->getSocket()) {
+                    sendMessage(player2->getSocket(), message2);
+                } else {
+                    logger->warning("Player2 has no socket: " + player2->getUsername());
+                }
+            } catch (const std::exception& e) {
+                logger->error("Exception in creating game: " + std::string(e.what()));
+            } catch (...) {
+                logger->error("Unknown exception in creating game");
+            }
+        }
+    } catch (const std::exception& e) {
+        logger->error("Exception in handleMatchmakingTimer: " + std::string(e.what()));
+    } catch (...) {
+        logger->error("Unknown exception in handleMatchmakingTimer");
     }
 }
 
-void ChessLogger::setLogLevel(int level)
-{
-    logLevel = level;
-}
-
-int ChessLogger::getLogLevel() const
+void MPChessServer::scheduleClockDeadline(const std::string& gameId, qint64 deadline)
 {
-    return logLevel;
+    if (deadline >= 0) {
+        clockDeadlines.emplace(deadline, gameId);
+    }
 }
 
-void ChessLogger::flush()
+void MPChessServer::handleGameTimerUpdate()
 {
-    std::lock_guard<std::mutex> lock(logMutex);
-    
-    if (logFile.is_open()) {
-        logFile.flush();
+    // Only games whose side to move has reached its deadline are touched
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    while (!clockDeadlines.empty() && clockDeadlines.top().first <= now) {
+        std::pair<qint64, std::string> entry = clockDeadlines.top();
+        clockDeadlines.pop();
+        
+        auto it = activeGames.find(entry.second);
+        if (it == activeGames.end()) {
+            continue;
+        }
+        
+        // A move since this entry was pushed has scheduled a later deadline
+        ChessGame* game = it->second.get();
+        if (!game->isOver() && game->getClockDeadline() == entry.first) {
+            game->updateTimers();
+            
+            // Check if a player has timed out
+            ChessPlayer* whitePlayer = game->getWhitePlayer();
+            ChessPlayer* blackPlayer = game->getBlackPlayer();
+            
+            if (game->hasPlayerTimedOut(whitePlayer)) {
+                logger->log("White player timed out: " + whitePlayer->getUsername());
+                game->end(GameResult::BLACK_WIN);
+                
+                // Send game over message to both players
+                QJsonObject message;
+                message["type"] = static_cast<int>(MessageType::GAME_OVER);
+                message["result"] = "black_win";
+                message["reason"] = "timeout";
+                
+                if (whitePlayer->getSocket()) {
+                    sendMessage(whitePlayer->getSocket(), message);
+                }
+                
+                if (blackPlayer->getSocket()) {
+                    sendMessage(blackPlayer->getSocket(), message);
+                }
+                
+                // Update ratings
+                updatePlayerRatings(game);
+                
+                // Save game history
+                saveGameHistory(*game);
+            } else if (game->hasPlayerTimedOut(blackPlayer)) {
+                logger->log("Black player timed out: " + blackPlayer->getUsername());
+                game->end(GameResult::WHITE_WIN);
+                
+                // Send game over message to both players
+                QJsonObject message;
+                message["type"] = static_cast<int>(MessageType::GAME_OVER);
+                message["result"] = "white_win";
+                message["reason"] = "timeout";
+                
+                if (whitePlayer->getSocket()) {
+                    sendMessage(whitePlayer->getSocket(), message);
+                }
+                
+                if (blackPlayer->getSocket()) {
+                    sendMessage(blackPlayer->getSocket(), message);
+                }
+                
+                // Update ratings
+                updatePlayerRatings(game);
+                
+                // Save game history
+                saveGameHistory(*game);
+            }
+        }
     }
 }
 
-std::string ChessLogger::getCurrentTimestamp() const
-{
-    auto now = std::chrono::system_clock::now();
-    auto now_c = std::chrono::system_clock::to_time_t(now);
-    auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+void MPChessServer::handleServerStatusUpdate() {
+    // Log server status
+    QJsonObject stats = getServerStats();
     
     std::stringstream ss;
-    ss << std::put_time(std::localtime(&now_c), "%Y-%m-%d %H:%M:%S");
-    ss << '.' << std::setfill('0') << std::setw(3) << now_ms.count();
-    
-    return ss.str();
-}
-
-// Implementation of ChessAuthenticator class
-ChessAuthenticator::ChessAuthenticator(const std::string& userDbPath) : userDbPath(userDbPath)
-{
-    // Create the directory if it doesn't exist
-    QDir dir(QString::fromStdString(userDbPath));
-    if (!dir.exists()) {
-        dir.mkpath(".");
-    }
+    ss << "Server Status: "
+       << "Uptime: " << stats["uptime"].toInt() << "s, "
+       << "Connected Clients: " << stats["connectedClients"].toInt() << ", "
+       << "Active Games: " << stats["activeGames"].toInt() << ", "
+       << "Total Games: " << stats["totalGamesPlayed"].toInt();
     
-    loadPasswordDb();
-}
-
-ChessAuthenticator::~ChessAuthenticator()
-{
-    savePasswordDb();
-}
-
-bool ChessAuthenticator::authenticatePlayer(const std::string& username, const std::string& password) {
-    std::lock_guard<std::mutex> lock(authMutex);
+    logger->log(ss.str());
     
-    if (passwordCache.find(username) == passwordCache.end()) {
-        return false;  // User not found
+    // Drop session tokens that can no longer be used
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = sessionTokens.begin(); it != sessionTokens.end();) {
+        if (it->second.expires < now) {
+            auto current = playerSessionTokens.find(it->second.username);
+            if (current != playerSessionTokens.end() && current->second == it->first) {
+                playerSessionTokens.erase(current);
+            }
+            it = sessionTokens.erase(it);
+        } else {
+            ++it;
+        }
     }
-    
-    std::string storedHash = passwordCache[username];
-    std::string salt = storedHash.substr(0, 16);  // First 16 characters are the salt
-    std::string hash = hashPassword(password, salt);
-    
-    return hash == storedHash;
 }
 
-bool ChessAuthenticator::registerPlayer(const std::string& username, const std::string& password) {
-    std::lock_guard<std::mutex> lock(authMutex);
-    
-    if (passwordCache.find(username) != passwordCache.end()) {
-        return false;  // User already exists
+void MPChessServer::processClientMessage(QTcpSocket* socket, const QJsonObject& message) {
+    if (!message.contains("type")) {
+        logger->error("Message missing type field");
+        return;
     }
     
-    std::string salt = generateSalt();
-    std::string hash = hashPassword(password, salt);
-    passwordCache[username] = hash;
-    
-    // Create a new player
-    ChessPlayer player(username);
-    
-    // Save the player data
-    if (!savePlayer(player)) {
-        passwordCache.erase(username);
-        return false;
-    }
+    MessageType type = static_cast<MessageType>(message["type"].toInt());
     
-    savePasswordDb();
-    return true;
-}
+    switch (type) {
+        case MessageType::AUTHENTICATION:
+            processAuthRequest(socket, message);
+            break;
+            
+        case MessageType::MOVE: {
+            LatencyHistogram::ScopedTimer timer(ServerMetrics::moveRequestSeconds);
+            processMoveRequest(socket, message);
+            break;
+        }
+            
+        case MessageType::MATCHMAKING_REQUEST:
+            processMatchmakingRequest(socket, message);
+            break;
+            
+        case MessageType::GAME_HISTORY_REQUEST:
+            processGameHistoryRequest(socket, message);
+            break;
+            
+        case MessageType::GAME_ANALYSIS_REQUEST:
+            processGameAnalysisRequest(socket, message);
+            break;
+            
+        case MessageType::RESIGN:
+            processResignRequest(socket, message);
+            break;
+            
+        case MessageType::DRAW_OFFER:
+            processDrawOfferRequest(socket, message);
+            break;
+            
+        case MessageType::DRAW_RESPONSE:
+            processDrawResponseRequest(socket, message);
+            break;
 
-bool ChessAuthenticator::usernameExists(const std::string& username) {
-    std::lock_guard<std::mutex> lock(authMutex);
-    return passwordCache.find(username) != passwordCache.end();
-}
+        case MessageType::LEADERBOARD_REQUEST:
+            processLeaderboardRequest(socket, message);
+            break;
 
-std::unique_ptr<ChessPlayer> ChessAuthenticator::getPlayer(const std::string& username) {
-    std::string playerFilePath = getPlayerFilePath(username);
-    
-    QFile file(QString::fromStdString(playerFilePath));
-    if (!file.open(QIODevice::ReadOnly)) {
-        return nullptr;
-    }
-    
-    QByteArray data = file.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    
-    if (doc.isNull() || !doc.isObject()) {
-        return nullptr;
-    }
-    
-    ChessPlayer player = ChessPlayer::fromJson(doc.object());
-    return std::make_unique<ChessPlayer>(player);
-}
+        case MessageType::GAME_STATE_REQUEST:
+            processGameStateRequest(socket, message);
+            break;
 
-bool ChessAuthenticator::savePlayer(const ChessPlayer& player) {
-    std::string playerFilePath = getPlayerFilePath(player.getUsername());
-    
-    QJsonObject json = player.toJson();
-    QJsonDocument doc(json);
-    
-    QFile file(QString::fromStdString(playerFilePath));
-    if (!file.open(QIODevice::WriteOnly)) {
-        return false;
-    }
-    
-    file.write(doc.toJson());
-    return true;
-}
+        case MessageType::SPECTATE:
+            processSpectateRequest(socket, message);
+            break;
 
-std::vector<std::string> ChessAuthenticator::getAllPlayerUsernames() {
-    std::lock_guard<std::mutex> lock(authMutex);
-    
-    std::vector<std::string> usernames;
-    for (const auto& pair : passwordCache) {
-        usernames.push_back(pair.first);
-    }
-    
-    return usernames;
-}
+        case MessageType::TOURNAMENT:
+            processTournamentRequest(socket, message);
+            break;
 
-bool ChessAuthenticator::deletePlayer(const std::string& username) {
-    std::lock_guard<std::mutex> lock(authMutex);
-    
-    if (passwordCache.find(username) == passwordCache.end()) {
-        return false;  // User not found
-    }
-    
-    // Remove from password cache
-    passwordCache.erase(username);
-    savePasswordDb();
-    
-    // Delete player file
-    std::string playerFilePath = getPlayerFilePath(username);
-    QFile file(QString::fromStdString(playerFilePath));
-    if (file.exists()) {
-        return file.remove();
+        case MessageType::PING:
+            // Respond with a pong
+            {
+                QJsonObject response;
+                response["type"] = static_cast<int>(MessageType::PONG);
+                sendMessage(socket, response);
+            }
+            break;
+            
+        default:
+            logger->warning("Unknown message type: " + std::to_string(static_cast<int>(type)));
+            break;
     }
-    
-    return true;
-}
-
-std::string ChessAuthenticator::hashPassword(const std::string& password, const std::string& salt) {
-    std::string saltedPassword = salt + password;
-    QByteArray hash = QCryptographicHash::hash(
-        QByteArray::fromStdString(saltedPassword),
-        QCryptographicHash::Sha256
-    );
-    
-    return salt + QString(hash.toHex()).toStdString();
 }
 
-std::string ChessAuthenticator::generateSalt(int length) {
-    const std::string chars = 
-        "0123456789"
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-        "abcdefghijklmnopqrstuvwxyz";
-    
-    std::random_device rd;
-    std::mt19937 generator(rd());
-    std::uniform_int_distribution<> distribution(0, chars.size() - 1);
-    
-    std::string salt;
-    salt.reserve(length);
-    
-    for (int i = 0; i < length; ++i) {
-        salt += chars[distribution(generator)];
-    }
-    
-    return salt;
+void MPChessServer::handleLeaderboardRefresh() {
+    // Rankings are kept current by updatePlayer; only the snapshot needs writing
+    logger->log("Saving leaderboard snapshot");
+    leaderboard->saveSnapshot();
 }
 
-void ChessAuthenticator::loadPasswordDb() {
-    std::string passwordDbPath = userDbPath + "/passwords.json";
-    
-    QFile file(QString::fromStdString(passwordDbPath));
-    if (!file.open(QIODevice::ReadOnly)) {
-        return;  // File doesn't exist yet
+void MPChessServer::sendMessage(QTcpSocket* socket, const QJsonObject& message) {
+    if (!socket) {
+        logger->error("Attempted to send message to null socket");
+        return;
     }
     
-    QByteArray data = file.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
+    // Log the message
+    logger->logNetworkMessage("SENT", message);
     
-    if (doc.isNull() || !doc.isObject()) {
+    // Send the data in the format this client negotiated; with network threads the
+    // encoding happens on the socket's thread too
+    bool binary = binaryProtocolSockets.contains(socket);
+    bool compress = compressionSockets.contains(socket);
+    runOnSocketThread(socket, [socket, message, binary, compress]() {
+        writeCoalesced(socket, encodeMessage(message, binary, compress));
+    });
+}
+
+void MPChessServer::sendMessage(QTcpSocket* socket, const QByteArray& encoded) {
+    if (!socket) {
+        logger->error("Attempted to send message to null socket");
         return;
     }
     
-    QJsonObject json = doc.object();
-    for (auto it = json.begin(); it != json.end(); ++it) {
-        std::string username = it.key().toStdString();
-        std::string hash = it.value().toString().toStdString();
-        passwordCache[username] = hash;
-    }
+    MPCHESS_TRACE("Sending " + std::to_string(encoded.size()) + " pre-encoded bytes");
+    
+    runOnSocketThread(socket, [socket, encoded]() {
+        writeCoalesced(socket, encoded);
+    });
 }
 
-void ChessAuthenticator::savePasswordDb() {
-    std::string passwordDbPath = userDbPath + "/passwords.json";
-    
-    QJsonObject json;
-    for (const auto& pair : passwordCache) {
-        json[QString::fromStdString(pair.first)] = QString::fromStdString(pair.second);
+void MPChessServer::writeCoalesced(QTcpSocket* socket, const QByteArray& data) {
+    // write() only appends to the socket's buffer. The flush is queued behind the
+    // events already pending, so everything sent while handling them (move result,
+    // state, recommendations) leaves in one syscall and segment
+    socket->write(data);
+    ServerMetrics::writeBacklogBytes.observe(static_cast<double>(socket->bytesToWrite()));
+    if (!socket->property("flushScheduled").toBool()) {
+        socket->setProperty("flushScheduled", true);
+        QMetaObject::invokeMethod(socket, [socket]() {
+            socket->setProperty("flushScheduled", false);
+            socket->flush();
+        }, Qt::QueuedConnection);
     }
-    
-    QJsonDocument doc(json);
-    
-    QFile file(QString::fromStdString(passwordDbPath));
-    if (!file.open(QIODevice::WriteOnly)) {
-        return;
+}
+
+void MPChessServer::runOnSocketThread(QTcpSocket* socket, std::function<void()> task) {
+    if (socket->thread() == QThread::currentThread()) {
+        task();
+    } else {
+        QMetaObject::invokeMethod(socket, std::move(task), Qt::QueuedConnection);
     }
-    
-    file.write(doc.toJson());
 }
 
-std::string ChessAuthenticator::getPlayerFilePath(const std::string& username) {
-    return userDbPath + "/player_" + username + ".json";
+void MPChessServer::setNetworkThreads(int count) {
+    networkThreadCount = std::max(0, count);
 }
 
-MPChessServer* MPChessServer::mpChessServerInstance = nullptr;
+void MPChessServer::setWorkerThreads(int count) {
+    workScheduler = std::make_unique<WorkScheduler>(count);
+    logger->log("Work scheduler set to " + std::to_string(workScheduler->getThreadCount()) + " threads");
+}
 
-// Implementation of MPChessServer class
-MPChessServer::MPChessServer(QObject* parent, const std::string& stockfishPath) : QObject(parent), server(nullptr),
-    totalGamesPlayed(0), totalPlayersRegistered(0), peakConcurrentPlayers(0), totalMovesPlayed(0)
-{    
-    // Initialize directories
-    initializeServerDirectories();
+void MPChessServer::setAuthThreads(int count) {
+    authPool->setMaxThreadCount(std::max(1, count));
+}
 
-    // Set the singleton instance
-    mpChessServerInstance = this;
-    
-    // Initialize logger
-    logger = std::make_unique<ChessLogger>(getLogsPath() + "/server.log");
-    logger->setLogLevel(3);  // Increase log level for more detailed logging
+void MPChessServer::setPasswordKdfCost(int cost) {
+    authenticator->setKdfCost(cost);
+}
 
-    // Initialize thread pool
-    threadPool = new QThreadPool(this);
-    threadPool->setMaxThreadCount(4); // Adjust based on your server's capabilities
-    logger->log("Thread pool initialized with " + std::to_string(threadPool->maxThreadCount()) + " threads");
+void MPChessServer::setMetricsPort(int port) {
+    metricsPort = std::max(0, port);
+}
 
-    // Initialize performance timer
-    performanceTimer = new QTimer(this);
-    connect(performanceTimer, &QTimer::timeout, this, &MPChessServer::logPerformanceStats);
-    performanceTimer->start(300000); // Log every 5 minutes
+void MPChessServer::startPoolTask(QRunnable* task, WorkLane lane, qint64 deadline, int priority) {
+    workScheduler->submit(lane, task, deadline, priority);
+}
 
-    // Initialize authenticator
-    authenticator = std::make_unique<ChessAuthenticator>(getPlayerDataPath());
-    
-    // Initialize leaderboard
-    leaderboard = std::make_unique<ChessLeaderboard>(getPlayerDataPath());
-    
-    // Initialize matchmaker
-    matchmaker = std::make_unique<ChessMatchmaker>();
-    
-    // Initialize rating system
-    ratingSystem = std::make_unique<ChessRatingSystem>();
-    
-    // Initialize analysis engine
-    analysisEngine = std::make_unique<ChessAnalysisEngine>();
-    
-    // Initialize serializer
-    serializer = std::make_unique<ChessSerializer>();
-    
-    // Initialize Stockfish connector if path is provided
-    if (!stockfishPath.empty()) {
-        stockfishConnector = std::make_unique<StockfishConnector>(stockfishPath);
-        if (stockfishConnector->initialize()) {
-            logger->log("StockfishConnector initialized with engine at: " + stockfishPath, true);
-        } else {
-            logger->error("Failed to initialize StockfishConnector with engine at: " + stockfishPath, true);
-            stockfishConnector.reset();
-        }
+QByteArray MPChessServer::encodeMessage(const QJsonObject& message, bool binary, bool compress) {
+    if (binary) {
+        return WireProtocol::encode(message, compress);
     }
     
-    // Initialize timers
-    matchmakingTimer = new QTimer(this);
-    connect(matchmakingTimer, &QTimer::timeout, this, &MPChessServer::handleMatchmakingTimer);
-    
-    gameTimer = new QTimer(this);
-    connect(gameTimer, &QTimer::timeout, this, &MPChessServer::handleGameTimerUpdate);
-    
-    statusTimer = new QTimer(this);
-    connect(statusTimer, &QTimer::timeout, this, &MPChessServer::handleServerStatusUpdate);
-    
-    leaderboardTimer = new QTimer(this);
-    connect(leaderboardTimer, &QTimer::timeout, this, &MPChessServer::handleLeaderboardRefresh);
-    
-    logger->log("MPChessServer initialized");
+    QByteArray data = QJsonDocument(message).toJson(QJsonDocument::Compact);
+    data.append('\n');
+    return data;
 }
 
-MPChessServer::~MPChessServer()
+/*
+std::string MPChessServer::createGame(ChessPlayer* player1, ChessPlayer* player2, TimeControlType timeControl)
 {
-    logger->log("MPChessServer destructor - starting shutdown");
-    logger->flush();
-    
-    logger->log("MPChessServer destructor - calling stop()");
-    logger->flush();
-    stop();
-
-    logger->log("MPChessServer destructor - waiting for thread pool");
-    logger->flush();
-    // Wait for thread pool to finish
-    if (threadPool) {
-        threadPool->waitForDone();
+    if (!player1 || !player2) {
+        logger->error("createGame() - Attempted to create game with null player(s)");
+        throw std::invalid_argument("Null player(s) provided to createGame");
     }
 
-    logger->log("MPChessServer destructor - stopping and deleting timers");
-    logger->flush();
-    if (matchmakingTimer) {
-        matchmakingTimer->stop();
-        delete matchmakingTimer;
-    }
-    if (gameTimer) {
-        gameTimer->stop();
-        delete gameTimer;
-    }
-    if (statusTimer) {
-        statusTimer->stop();
-        delete statusTimer;
-    }
-    if (leaderboardTimer) {
-        leaderboardTimer->stop();
-        delete leaderboardTimer;
-    }
-    if (performanceTimer) {
-        performanceTimer->stop();
-        delete performanceTimer;
+    // Check if either player is already in a game
+    if (isPlayerInGame(player1)) {
+        logger->error("createGame() - Player " + player1->getUsername() + " is already in a game");
+        throw std::runtime_error("Player " + player1->getUsername() + " is already in a game");
     }
     
-    logger->log("MPChessServer destructor - logging final performance stats");
-    logger->flush();
-    // Log final performance stats
-    logPerformanceStats();
-    
-    logger->log("MPChessServer destructor - clearing singleton instance");
-    logger->flush();
-    // Clear the singleton instance if this is the current instance
-    if (mpChessServerInstance == this) {
-        mpChessServerInstance = nullptr;
+    if (isPlayerInGame(player2)) {
+        logger->error("createGame() - Player " + player2->getUsername() + " is already in a game");
+        throw std::runtime_error("Player " + player2->getUsername() + " is already in a game");
     }
     
-    logger->log("MPChessServer destructor - completed successfully");
-    logger->flush();
-}
+    MPCHESS_DEBUG(logger, "createGame() - Creating game between " + player1->getUsername() + " and " + player2->getUsername());
+    
+    try {
+        // Generate a unique game ID
+        std::string gameId = QUuid::createUuid().toString(QUuid::WithoutBraces).toStdString();
+        MPCHESS_DEBUG(logger, "createGame() - Generated game ID: " + gameId);
+        
+        // Randomly assign colors
+        bool player1IsWhite = QRandomGenerator::global()->bounded(2) == 0;
+        ChessPlayer* whitePlayer = player1IsWhite ? player1 : player2;
+        ChessPlayer* blackPlayer = player1IsWhite ? player2 : player1;
+        
+        MPCHESS_DEBUG(logger, "createGame() - Assigned colors: " + whitePlayer->getUsername() + " (White), " + 
+                     blackPlayer->getUsername() + " (Black)");
+        
+        // Set player colors before creating the game
+        whitePlayer->setColor(PieceColor::WHITE);
+        blackPlayer->setColor(PieceColor::BLACK);
+        
+        // Create the game with try-catch
+        std::unique_ptr<ChessGame> game;
+        try {
+            MPCHESS_DEBUG(logger, "createGame() - Constructing ChessGame object for game " + gameId);
+            game = std::make_unique<ChessGame>(whitePlayer, blackPlayer, gameId, timeControl);
+            MPCHESS_DEBUG(logger, "createGame() - ChessGame object created successfully for game " + gameId);
+        } catch (const std::exception& e) {
+            logger->error("createGame() - Exception creating ChessGame for game " + gameId + ": " + std::string(e.what()));
+            throw;
+        } catch (...) {
+            logger->error("createGame() - Unknown exception creating ChessGame for game " + gameId);
+            throw std::runtime_error("Unknown error creating game");
+        }
+        
+        // Start the game with try-catch
+        try {
+            MPCHESS_DEBUG(logger, "createGame() - Starting game " + gameId);
+            game->start();
+            MPCHESS_DEBUG(logger, "createGame() - Game " + gameId + " started successfully");
+        } catch (const std::exception& e) {
+            logger->error("createGame() - Exception starting game " + gameId + ": " + std::string(e.what()));
+            throw;
+        } catch (...) {
+            logger->error("createGame() - Unknown exception starting game " + gameId);
+            throw std::runtime_error("Unknown error starting game");
+        }
+        
+        // Store the game
+        MPCHESS_DEBUG(logger, "createGame() - Storing game " + gameId + " in active games map");
+        activeGames[gameId] = std::move(game);
+        playerToGameId[whitePlayer] = gameId;
+        playerToGameId[blackPlayer] = gameId;
+        
+        // Send game start message to both players
+        MPCHESS_DEBUG(logger, "createGame() - Preparing game start messages for game " + gameId);
+        QJsonObject message;
+        message["type"] = static_cast<int>(MessageType::GAME_START);
+        message["gameId"] = QString::fromStdString(gameId);
+        message["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
+        message["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
+        message["timeControl"] = [timeControl]() -> QString {
+            switch (timeControl) {
+                case TimeControlType::RAPID: return "rapid";
+                case TimeControlType::BLITZ: return "blitz";
+                case TimeControlType::BULLET: return "bullet";
+                case TimeControlType::CLASSICAL: return "classical";
+                case TimeControlType::CASUAL: return "casual";
+                default: return "rapid";
+            }
+        }();
+        
+        if (whitePlayer->getSocket()) {
+            MPCHESS_DEBUG(logger, "createGame() - Sending game start message to white player: " + whitePlayer->getUsername());
+            message["yourColor"] = "white";
+            sendMessage(whitePlayer->getSocket(), message);
+        } else {
+            logger->warning("createGame() - White player has no socket: " + whitePlayer->getUsername());
+        }
+        
+        if (blackPlayer->getSocket()) {
+            MPCHESS_DEBUG(logger, "createGame() - Sending game start message to black player: " + blackPlayer->getUsername());
+            message["yourColor"] = "black";
+            sendMessage(blackPlayer->getSocket(), message);
+        } else {
+            logger->warning("createGame() - Black player has no socket: " + blackPlayer->getUsername());
+        }
+        
+        // Send initial game state
+        try {
+            MPCHESS_DEBUG(logger, "createGame() - Preparing initial game state message for game " + gameId);
+            QJsonObject gameStateMessage;
+            gameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
+            
+            MPCHESS_DEBUG(logger, "createGame() - Getting game state JSON for game " + gameId);
+            gameStateMessage["gameState"] = activeGames[gameId]->getGameStateJson();
+            MPCHESS_DEBUG(logger, "createGame() - Successfully got game state JSON for game " + gameId);
+            
+            if (whitePlayer->getSocket()) {
+                MPCHESS_DEBUG(logger, "createGame() - Sending game state to white player: " + whitePlayer->getUsername());
+                sendMessage(whitePlayer->getSocket(), gameStateMessage);
+            }
+            
+            if (blackPlayer->getSocket()) {
+                MPCHESS_DEBUG(logger, "createGame() - Sending game state to black player: " + blackPlayer->getUsername());
+                sendMessage(blackPlayer->getSocket(), gameStateMessage);
+            }
+        } catch (const std::exception& e) {
+            logger->error("createGame() - Exception sending game state for game " + gameId + ": " + std::string(e.what()));
+            // Continue despite error in sending game state
+        }
+        
+        // Send move recommendations to white player (first to move) asynchronously
+        if (whitePlayer->getSocket()) {
+            try {
+                MPCHESS_DEBUG(logger, "createGame() - Scheduling async move recommendations for white player in game " + gameId);
+                generateMoveRecommendationsAsync(gameId, whitePlayer);
+            } catch (const std::exception& e) {
+                logger->error("createGame() - Exception scheduling move recommendations for game " + gameId + ": " + std::string(e.what()));
+                // Continue despite error in recommendations
+            }
+        }
+/ *
+        // Send move recommendations to white player (first to move) - SIMPLIFIED VERSION
+        if (whitePlayer->getSocket()) {
+            try {
+                MPCHESS_DEBUG(logger, "createGame() - Generating simplified move recommendations for white player in game " + gameId);
+                
+                // Get valid moves directly from the board
+                std::vector<ChessMove> validMoves = activeGames[gameId]->getBoard()->getAllValidMoves(PieceColor::WHITE);
+                
+                // Take just the first few moves without deep evaluation
+                std::vector<std::pair<ChessMove, double>> recommendations;
+                int count = 0;
+                for (const auto& move : validMoves) {
+                    recommendations.emplace_back(move, 0.0);
+                    count++;
+                    if (count >= 5) break;
+                }
+                
+                QJsonObject recommendationsMessage;
+                recommendationsMessage["type"] = static_cast<int>(MessageType::MOVE_RECOMMENDATIONS);
+                
+                QJsonArray recommendationsArray;
+                for (const auto& [move, evaluation] : recommendations) {
+                    QJsonObject recObj;
+                    recObj["move"] = QString::fromStdString(move.toAlgebraic());
+                    recObj["evaluation"] = evaluation;
+                    recObj["standardNotation"] = QString::fromStdString(
+                        move.toStandardNotation(*activeGames[gameId]->getBoard()));
+                    recommendationsArray.append(recObj);
+                }
+                
+                recommendationsMessage["recommendations"] = recommendationsArray;
+                MPCHESS_DEBUG(logger, "createGame() - Sending move recommendations to white player: " + whitePlayer->getUsername());
+                sendMessage(whitePlayer->getSocket(), recommendationsMessage);
+            } catch (const std::exception& e) {
+                logger->error("createGame() - Exception generating move recommendations for game " + gameId + ": " + std::string(e.what()));
+                // Continue despite error in recommendations
+            }
+        }
+// * /
+        
+        // Log the game creation
+        logger->log("Created game " + gameId + ": " + whitePlayer->getUsername() + 
+                   " (White) vs " + blackPlayer->getUsername() + " (Black)");
+        
+        // Increment total games played
+        totalGamesPlayed++;
 
-void MPChessServer::logPerformanceStats()
-{
-    if (logger && logger->getLogLevel() >= 2) {
-        std::string stats = PerformanceMonitor::getStatsSummary();
-        logger->log("Performance Statistics:\n" + stats);
+        // Make sure to remove players from matchmaking queue if they're still there
+        matchmaker->removePlayer(player1);
+        matchmaker->removePlayer(player2);
         
-        // Reset stats after logging if desired
-        // PerformanceMonitor::resetStats();
+        return gameId;
+    } catch (const std::exception& e) {
+        logger->error("createGame() - Exception in createGame: " + std::string(e.what()));
+        throw;
+    } catch (...) {
+        logger->error("createGame() - Unknown exception in createGame");
+        throw std::runtime_error("Unknown error creating game");
     }
 }
+*/
 
-bool MPChessServer::isPlayerInGame(ChessPlayer* player) const
-{
-    if (!player) return false;
-    return playerToGameId.contains(player);
-}
-
-bool MPChessServer::start(int port)
+/*
+std::string MPChessServer::createGame(ChessPlayer* player1, ChessPlayer* player2, TimeControlType timeControl)
 {
-    if (server) {
-        logger->warning("Server already running");
-        return false;
-    }
-    
-    server = new QTcpServer(this);
-    
-    connect(server, &QTcpServer::newConnection, this, &MPChessServer::handleNewConnection);
-    
-    if (!server->listen(QHostAddress::Any, port)) {
-        logger->error("Failed to start server: " + server->errorString().toStdString());
-        delete server;
-        server = nullptr;
-        return false;
+    if (!player1 || !player2) {
+        logger->error("createGame() - Attempted to create game with null player(s)");
+        throw std::invalid_argument("Null player(s) provided to createGame");
     }
-    
-    startTime = QDateTime::currentDateTime();
-    
-    // Start timers
-    matchmakingTimer->start(1000);  // Check matchmaking every second
-    gameTimer->start(100);          // Update game timers every 100ms
-    statusTimer->start(60000);      // Update server status every minute
-    leaderboardTimer->start(600000); // Refresh leaderboard every 10 minutes
-    
-    logger->log("Server started on port " + std::to_string(port), true);
-    return true;
-}
 
-void MPChessServer::stop()
-{
-    if (!server) {
-        return;
+    // Check if either player is already in a game
+    if (isPlayerInGame(player1)) {
+        logger->error("createGame() - Player " + player1->getUsername() + " is already in a game");
+        throw std::runtime_error("Player " + player1->getUsername() + " is already in a game");
     }
     
-    // Stop timers
-    matchmakingTimer->stop();
-    gameTimer->stop();
-    statusTimer->stop();
-    leaderboardTimer->stop();
-    
-    // Disconnect all clients
-    for (auto it = socketToPlayer.begin(); it != socketToPlayer.end(); ++it) {
-        QTcpSocket* socket = it.key();
-        if (socket) {
-            socket->disconnectFromHost();
-        }
+    if (isPlayerInGame(player2)) {
+        logger->error("createGame() - Player " + player2->getUsername() + " is already in a game");
+        throw std::runtime_error("Player " + player2->getUsername() + " is already in a game");
     }
     
-    // Clear all games
-    activeGames.clear();
-    
-    // Clear all players
-    socketToPlayer.clear();
-    usernamesToPlayers.clear();
-    playerToGameId.clear();
-    
-    // Stop the server
-    server->close();
-    delete server;
-    server = nullptr;
+    MPCHESS_DEBUG(logger, "createGame() - Creating game between " + player1->getUsername() + " and " + player2->getUsername());
     
-    logger->log("Server stopped", true);
-}
+    try {
+        // Generate a unique game ID
+        std::string gameId = QUuid::createUuid().toString(QUuid::WithoutBraces).toStdString();
+        MPCHESS_DEBUG(logger, "createGame() - Generated game ID: " + gameId);
+        
+        // Randomly assign colors
+        bool player1IsWhite = QRandomGenerator::global()->bounded(2) == 0;
+        ChessPlayer* whitePlayer = player1IsWhite ? player1 : player2;
+        ChessPlayer* blackPlayer = player1IsWhite ? player2 : player1;
+        
+        MPCHESS_DEBUG(logger, "createGame() - Assigned colors: " + whitePlayer->getUsername() + " (White), " + 
+                     blackPlayer->getUsername() + " (Black)");
+        
+        // Set player colors before creating the game
+        whitePlayer->setColor(PieceColor::WHITE);
+        blackPlayer->setColor(PieceColor::BLACK);
+        
+        // Create the game with try-catch
+        std::unique_ptr<ChessGame> game;
+        try {
+            MPCHESS_DEBUG(logger, "createGame() - Constructing ChessGame object for game " + gameId);
+            game = std::make_unique<ChessGame>(whitePlayer, blackPlayer, gameId, timeControl);
+            MPCHESS_DEBUG(logger, "createGame() - ChessGame object created successfully for game " + gameId);
+        } catch (const std::exception& e) {
+            logger->error("createGame() - Exception creating ChessGame for game " + gameId + ": " + std::string(e.what()));
+            throw;
+        } catch (...) {
+            logger->error("createGame() - Unknown exception creating ChessGame for game " + gameId);
+            throw std::runtime_error("Unknown error creating game");
+        }
+        
+        // Start the game with try-catch
+        try {
+            MPCHESS_DEBUG(logger, "createGame() - Starting game " + gameId);
+            game->start();
+            MPCHESS_DEBUG(logger, "createGame() - Game " + gameId + " started successfully");
+        } catch (const std::exception& e) {
+            logger->error("createGame() - Exception starting game " + gameId + ": " + std::string(e.what()));
+            throw;
+        } catch (...) {
+            logger->error("createGame() - Unknown exception starting game " + gameId);
+            throw std::runtime_error("Unknown error starting game");
+        }
+        
+        // Store the game
+        MPCHESS_DEBUG(logger, "createGame() - Storing game " + gameId + " in active games map");
+        activeGames[gameId] = std::move(game);
+        playerToGameId[whitePlayer] = gameId;
+        playerToGameId[blackPlayer] = gameId;
+        
+        // Send game start message to both players
+        MPCHESS_DEBUG(logger, "createGame() - Preparing game start messages for game " + gameId);
+        
+        // White player message
+        QJsonObject whiteMessage;
+        whiteMessage["type"] = static_cast<int>(MessageType::GAME_START);
+        whiteMessage["gameId"] = QString::fromStdString(gameId);
+        whiteMessage["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
+        whiteMessage["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
+        whiteMessage["yourColor"] = "white";
+        whiteMessage["boardOrientation"] = "standard"; // White pieces at bottom
+        whiteMessage["timeControl"] = [timeControl]() -> QString {
+            switch (timeControl) {
+                case TimeControlType::RAPID: return "rapid";
+                case TimeControlType::BLITZ: return "blitz";
+                case TimeControlType::BULLET: return "bullet";
+                case TimeControlType::CLASSICAL: return "classical";
+                case TimeControlType::CASUAL: return "casual";
+                default: return "rapid";
+            }
+        }();
+        
+        // Black player message
+        QJsonObject blackMessage;
+        blackMessage["type"] = static_cast<int>(MessageType::GAME_START);
+        blackMessage["gameId"] = QString::fromStdString(gameId);
+        blackMessage["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
+        blackMessage["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
+        blackMessage["yourColor"] = "black";
+        blackMessage["boardOrientation"] = "flipped"; // Black pieces at bottom
+        blackMessage["timeControl"] = whiteMessage["timeControl"];
+        
+        if (whitePlayer->getSocket()) {
+            MPCHESS_DEBUG(logger, "createGame() - Sending game start message to white player: " + whitePlayer->getUsername());
+            sendMessage(whitePlayer->getSocket(), whiteMessage);
+        } else {
+            logger->warning("createGame() - White player has no socket: " + whitePlayer->getUsername());
+        }
+        
+        if (blackPlayer->getSocket()) {
+            MPCHESS_DEBUG(logger, "createGame() - Sending game start message to black player: " + blackPlayer->getUsername());
+            sendMessage(blackPlayer->getSocket(), blackMessage);
+        } else {
+            logger->warning("createGame() - Black player has no socket: " + blackPlayer->getUsername());
+        }
+        
+        // Send initial game state
+        try {
+            MPCHESS_DEBUG(logger, "createGame() - Preparing initial game state message for game " + gameId);
+            
+            // Get the base game state
+            QJsonObject baseGameState = activeGames[gameId]->getGameStateJson();
+            
+            // Create white player's game state
+            QJsonObject whiteGameStateMessage;
+            whiteGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
+            whiteGameStateMessage["gameState"] = baseGameState;
+            whiteGameStateMessage["gameState"].toObject()["boardOrientation"] = "standard";
+            
+            // Create black player's game state
+            QJsonObject blackGameStateMessage;
+            blackGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
+            blackGameStateMessage["gameState"] = baseGameState;
+            blackGameStateMessage["gameState"].toObject()["boardOrientation"] = "flipped";
+            
+            if (whitePlayer->getSocket()) {
+                MPCHESS_DEBUG(logger, "createGame() - Sending game state to white player: " + whitePlayer->getUsername());
+                sendMessage(whitePlayer->getSocket(), whiteGameStateMessage);
+            }
+            
+            if (blackPlayer->getSocket()) {
+                MPCHESS_DEBUG(logger, "createGame() - Sending game state to black player: " + blackPlayer->getUsername());
+                sendMessage(blackPlayer->getSocket(), blackGameStateMessage);
+            }
+        } catch (const std::exception& e) {
+            logger->error("createGame() - Exception sending game state for game " + gameId + ": " + std::string(e.what()));
+            // Continue despite error in sending game state
+        }
+        
+        // Send move recommendations to white player (first to move) asynchronously
+        if (whitePlayer->getSocket()) {
+            try {
+                MPCHESS_DEBUG(logger, "createGame() - Scheduling async move recommendations for white player in game " + gameId);
+                generateMoveRecommendationsAsync(gameId, whitePlayer);
+            } catch (const std::exception& e) {
+                logger->error("createGame() - Exception scheduling move recommendations for game " + gameId + ": " + std::string(e.what()));
+                // Continue despite error in recommendations
+            }
+        }
+        
+        // Log the game creation
+        logger->log("Created game " + gameId + ": " + whitePlayer->getUsername() + 
+                   " (White) vs " + blackPlayer->getUsername() + " (Black)");
+        
+        // Increment total games played
+        totalGamesPlayed++;
 
-void MPChessServer::setLogLevel(int level)
-{
-    if (logger) {
-        logger->setLogLevel(level);
-        logger->log("Log level set to " + std::to_string(level), true);
+        // Make sure to remove players from matchmaking queue if they're still there
+        matchmaker->removePlayer(player1);
+        matchmaker->removePlayer(player2);
+        
+        return gameId;
+    } catch (const std::exception& e) {
+        logger->error("createGame() - Exception in createGame: " + std::string(e.what()));
+        throw;
+    } catch (...) {
+        logger->error("createGame() - Unknown exception in createGame");
+        throw std::runtime_error("Unknown error creating game");
     }
 }
+*/
 
-bool MPChessServer::isRunning() const
-{
-    return server != nullptr && server->isListening();
-}
-
-int MPChessServer::getPort() const
-{
-    return server ? server->serverPort() : -1;
-}
-
-int MPChessServer::getConnectedClientCount() const
-{
-    return socketToPlayer.size();
-}
-
-int MPChessServer::getActiveGameCount() const
-{
-    return activeGames.size();
-}
-
-qint64 MPChessServer::getUptime() const
-{
-    return startTime.secsTo(QDateTime::currentDateTime());
-}
-
-QJsonObject MPChessServer::getServerStats() const
-{
-    QJsonObject stats;
-    
-    stats["uptime"] = getUptime();
-    stats["connectedClients"] = getConnectedClientCount();
-    stats["activeGames"] = getActiveGameCount();
-    stats["totalGamesPlayed"] = totalGamesPlayed;
-    stats["totalPlayersRegistered"] = totalPlayersRegistered;
-    stats["peakConcurrentPlayers"] = peakConcurrentPlayers;
-    stats["totalMovesPlayed"] = totalMovesPlayed;
-    stats["playersInMatchmaking"] = matchmaker->getQueueSize();
-    
-    return stats;
-}
-
-QString MPChessServer::getBoardOrientationForPlayer(ChessPlayer* player, const std::string& gameId) const
+std::string MPChessServer::createGame(ChessPlayer* player1, ChessPlayer* player2, TimeControlType timeControl)
 {
-    if (!player) {
-        logger->error("getBoardOrientationForPlayer() - Null player");
-        return "standard";
-    }
-    
-    auto it = activeGames.find(gameId);
-    if (it == activeGames.end()) {
-        logger->error("getBoardOrientationForPlayer() - Game not found: " + gameId);
-        return "standard";
-    }
-    
-    ChessGame* game = it->second.get();
-    if (!game) {
-        logger->error("getBoardOrientationForPlayer() - Null game object for ID: " + gameId);
-        return "standard";
-    }
-    
-    // White player sees the board in standard orientation (white at bottom)
-    // Black player sees the board flipped (black at bottom)
-    if (player == game->getWhitePlayer()) {
-        return "standard";
-    } else if (player == game->getBlackPlayer()) {
-        return "flipped";
-    } else {
-        logger->warning("getBoardOrientationForPlayer() - Player " + player->getUsername() + 
-                       " is not part of game " + gameId);
-        return "standard";
+    if (!player1 || !player2) {
+        logger->error("createGame() - Attempted to create game with null player(s)");
+        throw std::invalid_argument("Null player(s) provided to createGame");
     }
-}
 
-void MPChessServer::sendGameStateToPlayers(const std::string& gameId)
-{
-    auto it = activeGames.find(gameId);
-    if (it == activeGames.end()) {
-        logger->error("sendGameStateToPlayers() - Game not found: " + gameId);
-        return;
+    // Check if either player is already in a game
+    if (isPlayerInGame(player1)) {
+        logger->error("createGame() - Player " + player1->getUsername() + " is already in a game");
+        throw std::runtime_error("Player " + player1->getUsername() + " is already in a game");
     }
     
-    ChessGame* game = it->second.get();
-    if (!game) {
-        logger->error("sendGameStateToPlayers() - Null game object for ID: " + gameId);
-        return;
+    if (isPlayerInGame(player2)) {
+        logger->error("createGame() - Player " + player2->getUsername() + " is already in a game");
+        throw std::runtime_error("Player " + player2->getUsername() + " is already in a game");
     }
     
-    ChessPlayer* whitePlayer = game->getWhitePlayer();
-    ChessPlayer* blackPlayer = game->getBlackPlayer();
-    
-    if (!whitePlayer || !blackPlayer) {
-        logger->error("sendGameStateToPlayers() - Null player(s) in game " + gameId);
-        return;
-    }
+    MPCHESS_DEBUG(logger, "createGame() - Creating game between " + player1->getUsername() + " and " + player2->getUsername());
     
     try {
-        logger->debug("sendGameStateToPlayers() - Preparing game state messages for game " + gameId);
-        
-        // Get the base game state
-        QJsonObject baseGameState = game->getGameStateJson();
+        // Generate a unique game ID
+        std::string gameId = QUuid::createUuid().toString(QUuid::WithoutBraces).toStdString();
+        MPCHESS_DEBUG(logger, "createGame() - Generated game ID: " + gameId);
         
-        // Create white player's game state message
-        QJsonObject whiteGameStateMessage;
-        whiteGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
-        whiteGameStateMessage["gameState"] = baseGameState;
-        whiteGameStateMessage["gameState"].toObject()["boardOrientation"] = "standard";
+        // Randomly assign colors
+        bool player1IsWhite = QRandomGenerator::global()->bounded(2) == 0;
+        ChessPlayer* whitePlayer = player1IsWhite ? player1 : player2;
+        ChessPlayer* blackPlayer = player1IsWhite ? player2 : player1;
         
-        // Create black player's game state message
-        QJsonObject blackGameStateMessage;
-        blackGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
-        blackGameStateMessage["gameState"] = baseGameState;
-        blackGameStateMessage["gameState"].toObject()["boardOrientation"] = "flipped";
+        MPCHESS_DEBUG(logger, "createGame() - Assigned colors: " + whitePlayer->getUsername() + " (White), " + 
+                     blackPlayer->getUsername() + " (Black)");
         
-        if (whitePlayer->getSocket()) {
-            logger->debug("sendGameStateToPlayers() - Sending game state to white player: " + whitePlayer->getUsername());
-            sendMessage(whitePlayer->getSocket(), whiteGameStateMessage);
-        } else {
-            logger->warning("sendGameStateToPlayers() - White player has no socket: " + whitePlayer->getUsername());
-        }
+        ChessGame* game = startGame(acquireGame(whitePlayer, blackPlayer, gameId, timeControl));
+        announceGames({ game });
         
-        if (blackPlayer->getSocket()) {
-            logger->debug("sendGameStateToPlayers() - Sending game state to black player: " + blackPlayer->getUsername());
-            sendMessage(blackPlayer->getSocket(), blackGameStateMessage);
+        return gameId;
+    } catch (const std::exception& e) {
+        logger->error("createGame() - Exception in createGame: " + std::string(e.what()));
+        throw;
+    } catch (...) {
+        logger->error("createGame() - Unknown exception in createGame");
+        throw std::runtime_error("Unknown error creating game");
+    }
+}
+
+std::unique_ptr<ChessGame> MPChessServer::acquireGame(ChessPlayer* whitePlayer, ChessPlayer* blackPlayer,
+                                                      const std::string& gameId, TimeControlType timeControl)
+{
+    // Set player colors before creating the game
+    whitePlayer->setColor(PieceColor::WHITE);
+    blackPlayer->setColor(PieceColor::BLACK);
+    
+    // Create the game with try-catch, reusing a retired game object when there is one
+    std::unique_ptr<ChessGame> game;
+    try {
+        if (!gamePool.empty()) {
+            MPCHESS_DEBUG(logger, "acquireGame() - Reusing a pooled ChessGame object for game " + gameId);
+            game = std::move(gamePool.back());
+            gamePool.pop_back();
+            game->reset(whitePlayer, blackPlayer, gameId, timeControl);
         } else {
-            logger->warning("sendGameStateToPlayers() - Black player has no socket: " + blackPlayer->getUsername());
+            MPCHESS_DEBUG(logger, "acquireGame() - Constructing ChessGame object for game " + gameId);
+            game = std::make_unique<ChessGame>(whitePlayer, blackPlayer, gameId, timeControl);
         }
-        
-        logger->debug("sendGameStateToPlayers() - Game state sent successfully for game " + gameId);
+        MPCHESS_DEBUG(logger, "acquireGame() - ChessGame object created successfully for game " + gameId);
     } catch (const std::exception& e) {
-        logger->error("sendGameStateToPlayers() - Exception: " + std::string(e.what()));
+        logger->error("acquireGame() - Exception creating ChessGame for game " + gameId + ": " + std::string(e.what()));
+        throw;
     } catch (...) {
-        logger->error("sendGameStateToPlayers() - Unknown exception");
+        logger->error("acquireGame() - Unknown exception creating ChessGame for game " + gameId);
+        throw std::runtime_error("Unknown error creating game");
     }
+    
+    return game;
 }
 
-void MPChessServer::generateMoveRecommendationsAsync(const std::string& gameId, ChessPlayer* player)
+ChessGame* MPChessServer::startGame(std::unique_ptr<ChessGame> game)
 {
-    if (!player) {
-        logger->error("generateMoveRecommendationsAsync() - Null player");
-        return;
-    }
+    std::string gameId = game->getGameId();
+    ChessPlayer* whitePlayer = game->getWhitePlayer();
+    ChessPlayer* blackPlayer = game->getBlackPlayer();
     
-    auto it = activeGames.find(gameId);
-    if (it == activeGames.end()) {
-        logger->error("generateMoveRecommendationsAsync() - Game not found: " + gameId);
-        return;
+    // Start the game with try-catch
+    try {
+        MPCHESS_DEBUG(logger, "startGame() - Starting game " + gameId);
+        game->start();
+        MPCHESS_DEBUG(logger, "startGame() - Game " + gameId + " started successfully");
+    } catch (const std::exception& e) {
+        logger->error("startGame() - Exception starting game " + gameId + ": " + std::string(e.what()));
+        throw;
+    } catch (...) {
+        logger->error("startGame() - Unknown exception starting game " + gameId);
+        throw std::runtime_error("Unknown error starting game");
     }
     
-    ChessGame* game = it->second.get();
-    if (!game) {
-        logger->error("generateMoveRecommendationsAsync() - Null game object for ID: " + gameId);
-        return;
+    // Store the game
+    MPCHESS_DEBUG(logger, "startGame() - Storing game " + gameId + " in active games map");
+    ChessGame* started = game.get();
+    activeGames[gameId] = std::move(game);
+    playerToGameId[whitePlayer] = gameId;
+    playerToGameId[blackPlayer] = gameId;
+    
+    // Other nodes send the players back here if they reconnect elsewhere
+    if (cluster) {
+        for (ChessPlayer* player : { whitePlayer, blackPlayer }) {
+            if (!player->isBot()) {
+                cluster->setSession(player->getUsername(), gameId);
+                clusterSessions[gameId].push_back(player->getUsername());
+            }
+        }
     }
     
-    // Check if it's the player's turn
-    if (game->getCurrentPlayer() != player) {
-        logger->debug("generateMoveRecommendationsAsync() - Not player's turn, skipping recommendations");
-        return;
+    // Both players' sockets share the network thread of the game's shard
+    if (networkWorkers) {
+        networkWorkers->assignToGame(whitePlayer->getSocket(), gameId);
+        networkWorkers->assignToGame(blackPlayer->getSocket(), gameId);
     }
     
-    logger->debug("generateMoveRecommendationsAsync() - Starting async recommendation generation for game " + gameId);
+    // Log the game creation
+    logger->log("Created game " + gameId + ": " + whitePlayer->getUsername() + 
+               " (White) vs " + blackPlayer->getUsername() + " (Black)");
     
-    // Create a task for recommendation generation
-    MoveRecommendationTask* task = new MoveRecommendationTask(
-        *game->getBoard(), player->getColor(), 5, analysisEngine.get());
+    // Increment total games played
+    totalGamesPlayed++;
+
+    // Make sure to remove players from matchmaking queue if they're still there
+    matchmaker->removePlayer(whitePlayer);
+    matchmaker->removePlayer(blackPlayer);
     
-    // Connect to the task's signal
-    connect(task, &MoveRecommendationTask::recommendationsReady, 
-            this, [this, gameId, player](const std::vector<std::pair<ChessMove, double>>& recommendations) {
+    return started;
+}
+
+void MPChessServer::announceGames(const std::vector<ChessGame*>& games,
+                                  std::unordered_map<QTcpSocket*, QByteArray> pending)
+{
+    // Messages are encoded here and gathered per socket, so a player receives their
+    // whole batch in one task on the socket's thread
+    for (ChessGame* game : games) {
+        std::string gameId = game->getGameId();
+        ChessPlayer* whitePlayer = game->getWhitePlayer();
+        ChessPlayer* blackPlayer = game->getBlackPlayer();
         
-        logger->debug("Async recommendations ready for game " + gameId);
+        MPCHESS_DEBUG(logger, "announceGames() - Preparing game start messages for game " + gameId);
         
-        // Check if the player is still connected and in the same game
-        if (!player->getSocket() || !playerToGameId.contains(player) || playerToGameId[player] != gameId) {
-            logger->debug("Player disconnected or changed games, discarding recommendations");
-            return;
-        }
+        QJsonObject message;
+        message["type"] = static_cast<int>(MessageType::GAME_START);
+        message["gameId"] = QString::fromStdString(gameId);
+        message["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
+        message["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
+        message["timeControl"] = [timeControl = game->getTimeControl()]() -> QString {
+            switch (timeControl) {
+                case TimeControlType::RAPID: return "rapid";
+                case TimeControlType::BLITZ: return "blitz";
+                case TimeControlType::BULLET: return "bullet";
+                case TimeControlType::CLASSICAL: return "classical";
+                case TimeControlType::CASUAL: return "casual";
+                default: return "rapid";
+            }
+        }();
         
-        // Send recommendations to the player
-        QJsonObject recommendationsMessage;
-        recommendationsMessage["type"] = static_cast<int>(MessageType::MOVE_RECOMMENDATIONS);
+        // The initial snapshot gives delta clients a base for the first GAME_STATE_DELTA
+        message["gameState"] = game->getGameStateJson();
         
-        QJsonArray recommendationsArray;
-        for (const auto& [move, evaluation] : recommendations) {
-            QJsonObject recObj;
-            recObj["move"] = QString::fromStdString(move.toAlgebraic());
-            recObj["evaluation"] = evaluation;
-            
-            // Get the standard notation if possible
-            auto gameIt = activeGames.find(gameId);
-            if (gameIt != activeGames.end() && gameIt->second) {
-                recObj["standardNotation"] = QString::fromStdString(
-                    move.toStandardNotation(*gameIt->second->getBoard()));
-            } else {
-                recObj["standardNotation"] = QString::fromStdString(move.toAlgebraic());
+        auto tournamentIt = tournamentGames.find(gameId);
+        if (tournamentIt != tournamentGames.end()) {
+            message["tournamentId"] = QString::fromStdString(tournamentIt->second);
+            message["round"] = tournaments.at(tournamentIt->second)->getCurrentRound();
+        }
+        
+        for (ChessPlayer* player : { whitePlayer, blackPlayer }) {
+            QTcpSocket* socket = player->getSocket();
+            if (!socket) {
+                if (!player->isBot()) {
+                    logger->warning("announceGames() - Player has no socket: " + player->getUsername());
+                }
+                continue;
             }
             
-            recommendationsArray.append(recObj);
+            bool isWhite = player == whitePlayer;
+            message["yourColor"] = isWhite ? "white" : "black";
+            message["boardOrientation"] = isWhite ? "standard" : "flipped";  // Own pieces at bottom
+            
+            logger->logNetworkMessage("SENT", message);
+            pending[socket].append(encodeMessage(message, binaryProtocolSockets.contains(socket),
+                                                 compressionSockets.contains(socket)));
         }
         
-        recommendationsMessage["recommendations"] = recommendationsArray;
-        sendMessage(player->getSocket(), recommendationsMessage);
-        
-        // Remove the task from the map
-        recommendationTasks.remove(gameId);
-    });
+        // Initial game state for both players, in the same write
+        sendGameStateToPlayers(gameId, &pending);
+    }
     
-    // Store the task in the map
-    recommendationTasks[gameId] = task;
+    for (auto& [socket, data] : pending) {
+        runOnSocketThread(socket, [socket, data = std::move(data)]() {
+            writeCoalesced(socket, data);
+        });
+    }
     
-    // Start the task
-    threadPool->start(task);
+    for (ChessGame* game : games) {
+        std::string gameId = game->getGameId();
+        ChessPlayer* whitePlayer = game->getWhitePlayer();
+        
+        // Send move recommendations to white player (first to move) asynchronously
+        if (whitePlayer->getSocket()) {
+            try {
+                MPCHESS_DEBUG(logger, "announceGames() - Scheduling async move recommendations for white player in game " + gameId);
+                generateMoveRecommendationsAsync(gameId, whitePlayer);
+            } catch (const std::exception& e) {
+                logger->error("announceGames() - Exception scheduling move recommendations for game " + gameId + ": " + std::string(e.what()));
+                // Continue despite error in recommendations
+            }
+        }
+        
+        // A bot playing white opens the game
+        if (whitePlayer->isBot()) {
+            processBotMove(gameId);
+        }
+    }
 }
 
-void MPChessServer::handleNewConnection()
-{
-    QTcpSocket* socket = server->nextPendingConnection();
+void MPChessServer::endGame(const std::string& gameId, GameResult result) {
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end()) {
+        logger->error("Attempted to end non-existent game: " + gameId);
+        return;
+    }
+    
+    ChessGame* game = it->second.get();
+    if (game->isOver()) {
+        return;  // Game already over
+    }
+    
+    // End the game
+    game->end(result);
+    
+    // Get the players
+    ChessPlayer* whitePlayer = game->getWhitePlayer();
+    ChessPlayer* blackPlayer = game->getBlackPlayer();
+    
+    // Send game over message to both players
+    QJsonObject message;
+    message["type"] = static_cast<int>(MessageType::GAME_OVER);
     
-    if (!socket) {
-        logger->error("Invalid socket from new connection");
-        return;
+    switch (result) {
+        case GameResult::WHITE_WIN:
+            message["result"] = "white_win";
+            break;
+        case GameResult::BLACK_WIN:
+            message["result"] = "black_win";
+            break;
+        case GameResult::DRAW:
+            message["result"] = "draw";
+            break;
+        default:
+            message["result"] = "unknown";
+            break;
     }
     
-    connect(socket, &QTcpSocket::readyRead, this, &MPChessServer::handleClientData);
-    connect(socket, &QTcpSocket::disconnected, this, &MPChessServer::handleClientDisconnected);
-    
-    logger->log("New client connected: " + socket->peerAddress().toString().toStdString());
-}
-
-void MPChessServer::handleClientDisconnected()
-{
-    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
-    if (!socket) {
-        logger->error("Invalid socket in disconnect handler");
-        return;
+    if (whitePlayer->getSocket()) {
+        sendMessage(whitePlayer->getSocket(), message);
     }
     
-    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
-    if (player) {
-        logger->log("Player disconnected: " + player->getUsername());
-        
-        // Clean up resources
-        cleanupDisconnectedPlayer(player);
-    } else {
-        logger->log("Unknown client disconnected: " + socket->peerAddress().toString().toStdString());
+    if (blackPlayer->getSocket()) {
+        sendMessage(blackPlayer->getSocket(), message);
     }
     
-    // Remove the socket from the map
-    socketToPlayer.remove(socket);
+    // Update ratings
+    updatePlayerRatings(game);
     
-    // Delete the socket
-    socket->deleteLater();
+    // Save game history
+    saveGameHistory(*game);
+    
+    // Clean up
+    playerToGameId.remove(whitePlayer);
+    playerToGameId.remove(blackPlayer);
+    
+    // Log the game end
+    logger->log("Game " + gameId + " ended with result: " + message["result"].toString().toStdString());
 }
 
-void MPChessServer::handleClientData()
-{
-    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
-    if (!socket) {
-        logger->error("Invalid socket in data handler");
+void MPChessServer::processAuthRequest(QTcpSocket* socket, const QJsonObject& data) {
+    std::string username = data["username"].toString().toStdString();
+    std::string password = data["password"].toString().toStdString();
+    bool isRegistration = data["register"].toBool();
+    
+    // A session token lets a dropped client back in without the password, and without hashing
+    std::string sessionToken = data["sessionToken"].toString().toStdString();
+    std::string tokenUsername;
+    if (!isRegistration && !sessionToken.empty() &&
+        checkSessionToken(sessionToken, data["gameId"].toString().toStdString(), tokenUsername) &&
+        tokenUsername == username) {
+        completeAuthRequest(socket, data, true, true, QJsonObject());
+        return;
+    }
+    
+    // Under a login storm the queue sheds load instead of growing without bound; every
+    // task in the pool counts until it reports back, replaced ones included
+    if (authTasksQueued >= AUTH_QUEUE_LIMIT) {
+        ++authRejected;
+        QJsonObject response;
+        response["type"] = static_cast<int>(MessageType::AUTHENTICATION_RESULT);
+        response["success"] = false;
+        response["message"] = "Server is busy, please try again";
+        sendMessage(socket, response);
+        logger->warning("Authentication queue full, turned away " + username);
         return;
     }
     
-    // Read all available data
-    QByteArray data = socket->readAll();
+    // A newer request from the same socket replaces this one, and the older task skips its hash
+    quint64 serial = ++authSerial;
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    auto previous = authRequests.find(socket);
+    if (previous != authRequests.end()) {
+        previous->second.cancelled->store(true);
+    }
+    authRequests[socket] = AuthRequest{ serial, cancelled };
+    ++authTasksQueued;
+    authPeakQueueDepth = std::max(authPeakQueueDepth, authTasksQueued);
+    qint64 queuedAt = QDateTime::currentMSecsSinceEpoch();
     
-    // Handle multiple JSON messages that might be concatenated
-    int offset = 0;
-    while (offset < data.size()) {
-        // Try to parse JSON starting from current offset
-        QJsonParseError parseError;
-        QJsonDocument doc = QJsonDocument::fromJson(data.mid(offset), &parseError);
+    AuthenticationTask* task = new AuthenticationTask(authenticator.get(), username, password, isRegistration, cancelled);
+    connect(task, &AuthenticationTask::authenticationReady, this,
+            [this, socket, data, serial, queuedAt](bool success, const QJsonObject& playerRecord) {
+        --authTasksQueued;
         
-        if (doc.isNull() || !doc.isObject()) {
-            // If parsing failed, log the error and skip this data
-            logger->error("Invalid JSON received from client at offset " + std::to_string(offset) + 
-                         ": " + data.mid(offset, 100).toStdString() + 
-                         " (error: " + parseError.errorString().toStdString() + ")");
-            break;
+        // The socket may have closed, or sent another request, while the password was hashed
+        auto it = authRequests.find(socket);
+        if (it == authRequests.end() || it->second.serial != serial) {
+            return;
         }
+        authRequests.erase(it);
         
-        QJsonObject message = doc.object();
-        
-        // Log the message
-        logger->logNetworkMessage("RECEIVED", message);
-        
-        // Process the message
-        processClientMessage(socket, message);
-        
-        // Move offset forward by the number of bytes consumed
-        offset += parseError.offset;
-        
-        // If no more data was consumed, break to avoid infinite loop
-        if (parseError.offset <= 0) {
-            break;
-        }
-    }
+        ++authCompleted;
+        authTotalMs += QDateTime::currentMSecsSinceEpoch() - queuedAt;
+        completeAuthRequest(socket, data, success, false, playerRecord);
+    });
+    
+    authPool->start(task);
 }
 
-void MPChessServer::handleMatchmakingTimer()
-{
-    logger->debug("Matchmaking timer triggered - checking for matches and timeouts");
+void MPChessServer::completeAuthRequest(QTcpSocket* socket, const QJsonObject& data, bool authenticated, bool resumed,
+                                        const QJsonObject& playerRecord) {
+    std::string username = data["username"].toString().toStdString();
+    bool isRegistration = data["register"].toBool();
     
-    try {
-        // Check for timed out players and match them with bots
-        std::vector<ChessPlayer*> timedOutPlayers = matchmaker->checkTimeouts(60); // 60 seconds timeout
-        for (ChessPlayer* player : timedOutPlayers) {
-            if (!player) {
-                logger->error("Null player in timed out players list");
-                continue;
-            }
+    QJsonObject response;
+    response["type"] = static_cast<int>(MessageType::AUTHENTICATION_RESULT);
+    
+    if (isRegistration) {
+        // Registration
+        if (authenticated) {
+            response["success"] = true;
+            response["message"] = "Registration successful";
+            response["sessionToken"] = QString::fromStdString(issueSessionToken(username));
             
-            // Skip if player is already in a game
-            if (isPlayerInGame(player)) {
-                logger->debug("Player " + player->getUsername() + " is already in a game, skipping bot match");
-                continue;
-            }
+            // Create a new player
+            ChessPlayer* player = new ChessPlayer(username, socket);
+            socketToPlayer[socket] = player;
+            usernamesToPlayers[username] = player;
             
-            logger->log("Player timed out in matchmaking: " + player->getUsername());
+            // Increment total players registered
+            totalPlayersRegistered++;
+            publishPlayer(*player);
             
-            try {
-                // Create a bot player
-                ChessPlayer* botPlayer = createBotPlayer(player->getRating() / 200);  // Scale skill level based on rating
-                
-                if (!botPlayer) {
-                    logger->error("Failed to create bot player for timed out player: " + player->getUsername());
-                    continue;
-                }
-                
-                // Create a game between the player and the bot
-                try {
-                    createGame(player, botPlayer, TimeControlType::RAPID);
-                    
-                    // Send matchmaking status to the player
-                    QJsonObject message;
-                    message["type"] = static_cast<int>(MessageType::MATCHMAKING_STATUS);
-                    message["status"] = "matched_with_bot";
-                    message["opponent"] = QString::fromStdString(botPlayer->getUsername());
-                    
-                    if (player->getSocket()) {
-                        sendMessage(player->getSocket(), message);
-                    } else {
-                        logger->warning("Player has no socket: " + player->getUsername());
-                    }
-                } catch (const std::exception& e) {
-                    logger->error("Failed to create game with bot: " + std::string(e.what()));
-                }
-            } catch (const std::exception& e) {
-                logger->error("Exception in bot matching: " + std::string(e.what()));
-            } catch (...) {
-                logger->error("Unknown exception in bot matching");
-            }
+            // Update peak concurrent players
+            peakConcurrentPlayers = std::max(peakConcurrentPlayers, getConnectedClientCount());
+            
+            logger->log("Player registered: " + username);
+        } else {
+            response["success"] = false;
+            response["message"] = "Username already exists";
+            logger->warning("Registration failed for username: " + username);
         }
-        
-        // Try to match players
-        std::vector<std::pair<ChessPlayer*, ChessPlayer*>> matches;
-        try {
-            matches = matchmaker->matchPlayers();
-            logger->debug("Matchmaker found " + std::to_string(matches.size()) + " potential matches");
-        } catch (const std::exception& e) {
-            logger->error("Exception in matchPlayers: " + std::string(e.what()));
+    } else {
+        // A player whose game is hosted by another node logs in again there. A client
+        // that was redirected already stays, so nodes that disagree cannot bounce it
+        ClusterDirectory::NodeInfo sessionNode;
+        std::string sessionGameId;
+        if (authenticated && cluster && !resumed && !data["redirected"].toBool() && !usernamesToPlayers.contains(username) &&
+            cluster->findSession(username, sessionNode, sessionGameId) && !cluster->isLocal(sessionNode)) {
+            sendNodeRedirect(socket, sessionNode, QJsonObject{{"gameId", QString::fromStdString(sessionGameId)}});
+            logger->log("Redirected " + username + " to node " + sessionNode.nodeId + " for game " + sessionGameId);
             return;
         }
         
-        for (const auto& match : matches) {
-            ChessPlayer* player1 = match.first;
-            ChessPlayer* player2 = match.second;
-            
-            if (!player1 || !player2) {
-                logger->error("Null player in match");
-                continue;
-            }
-            
-            // Double-check that neither player is already in a game
-            if (isPlayerInGame(player1) || isPlayerInGame(player2)) {
-                logger->warning("Skipping match because at least one player is already in a game");
-                continue;
-            }
-            
-            logger->log("Matched players: " + player1->getUsername() + " vs " + player2->getUsername());
-            
-            try {
-                // Create a game between the players
-                std::string gameId = createGame(player1, player2, TimeControlType::RAPID);
-                logger->debug("Created game with ID: " + gameId);
-                
-                // Send matchmaking status to both players
-                QJsonObject message1;
-                message1["type"] = static_cast<int>(MessageType::MATCHMAKING_STATUS);
-                message1["status"] = "matched";
-                message1["opponent"] = QString::fromStdString(player2->getUsername());
-                message1["gameId"] = QString::fromStdString(gameId);
-                
-                QJsonObject message2;
-                message2["type"] = static_cast<int>(MessageType::MATCHMAKING_STATUS);
-                message2["status"] = "matched";
-                message2["opponent"] = QString::fromStdString(player1->getUsername());
-                message2["gameId"] = QString::fromStdString(gameId);
-                
-                if (player1->getSocket()) {
-                    sendMessage(player1->getSocket(), message1);
-                } else {
-                    logger->warning("Player1 has no socket: " + player1->getUsername());
-                }
-                
-                if (player2->getSocket()) {
-                    sendMessage(player2->getSocket(), message2);
-                } else {
-                    logger->warning("Player2 has no socket: " + player2->getUsername());
-                }
-            } catch (const std::exception& e) {
-                logger->error("Exception in creating game: " + std::string(e.what()));
-            } catch (...) {
-                logger->error("Unknown exception in creating game");
+        if (authenticated) {
+            response["success"] = true;
+            response["message"] = "Authentication successful";
+            response["sessionToken"] = QString::fromStdString(issueSessionToken(username));
+            if (resumed) {
+                response["resumed"] = true;
             }
-        }
-    } catch (const std::exception& e) {
-        logger->error("Exception in handleMatchmakingTimer: " + std::string(e.what()));
-    } catch (...) {
-        logger->error("Unknown exception in handleMatchmakingTimer");
-    }
-}
-
-void MPChessServer::handleGameTimerUpdate()
-{
-    // Update timers for all active games
-    for (auto it = activeGames.begin(); it != activeGames.end(); ++it) {
-        ChessGame* game = it->second.get();
-        if (!game->isOver()) {
-            game->updateTimers();
-            
-            // Check if a player has timed out
-            ChessPlayer* whitePlayer = game->getWhitePlayer();
-            ChessPlayer* blackPlayer = game->getBlackPlayer();
             
-            if (game->hasPlayerTimedOut(whitePlayer)) {
-                logger->log("White player timed out: " + whitePlayer->getUsername());
-                game->end(GameResult::BLACK_WIN);
-                
-                // Send game over message to both players
-                QJsonObject message;
-                message["type"] = static_cast<int>(MessageType::GAME_OVER);
-                message["result"] = "black_win";
-                message["reason"] = "timeout";
-                
-                if (whitePlayer->getSocket()) {
-                    sendMessage(whitePlayer->getSocket(), message);
-                }
+            // Check if the player is already logged in
+            if (usernamesToPlayers.contains(username)) {
+                // Disconnect the old socket
+                ChessPlayer* existingPlayer = usernamesToPlayers[username];
+                QTcpSocket* oldSocket = existingPlayer->getSocket();
                 
-                if (blackPlayer->getSocket()) {
-                    sendMessage(blackPlayer->getSocket(), message);
+                if (oldSocket && oldSocket != socket) {
+                    // Send a message to the old socket
+                    QJsonObject disconnectMessage;
+                    disconnectMessage["type"] = static_cast<int>(MessageType::ERROR);
+                    disconnectMessage["message"] = "You have been logged in from another location";
+                    sendMessage(oldSocket, disconnectMessage);
+                    
+                    // Disconnect the old socket; it no longer speaks for the player
+                    socketToPlayer.remove(oldSocket);
+                    runOnSocketThread(oldSocket, [oldSocket]() { oldSocket->disconnectFromHost(); });
                 }
                 
-                // Update ratings
-                updatePlayerRatings(game);
-                
-                // Save game history
-                saveGameHistory(*game);
-            } else if (game->hasPlayerTimedOut(blackPlayer)) {
-                logger->log("Black player timed out: " + blackPlayer->getUsername());
-                game->end(GameResult::WHITE_WIN);
-                
-                // Send game over message to both players
-                QJsonObject message;
-                message["type"] = static_cast<int>(MessageType::GAME_OVER);
-                message["result"] = "white_win";
-                message["reason"] = "timeout";
+                // Update the player's socket, ending any reconnect grace period
+                existingPlayer->setSocket(socket);
+                socketToPlayer[socket] = existingPlayer;
+                reconnectDeadlines.erase(username);
                 
-                if (whitePlayer->getSocket()) {
-                    sendMessage(whitePlayer->getSocket(), message);
+                // Rejoin the network thread of the game in progress
+                if (networkWorkers && playerToGameId.contains(existingPlayer)) {
+                    networkWorkers->assignToGame(socket, playerToGameId[existingPlayer]);
                 }
                 
-                if (blackPlayer->getSocket()) {
-                    sendMessage(blackPlayer->getSocket(), message);
+                logger->log("Player reconnected: " + username);
+            } else {
+                // The player data was read in authPool along with the password check
+                if (!playerRecord.isEmpty()) {
+                    ChessPlayer* player = new ChessPlayer(ChessPlayer::fromJson(playerRecord));
+                    player->setSocket(socket);
+                    socketToPlayer[socket] = player;
+                    usernamesToPlayers[username] = player;
+                } else {
+                    // Create a new player if data not found
+                    ChessPlayer* player = new ChessPlayer(username, socket);
+                    socketToPlayer[socket] = player;
+                    usernamesToPlayers[username] = player;
                 }
                 
-                // Update ratings
-                updatePlayerRatings(game);
-                
-                // Save game history
-                saveGameHistory(*game);
+                logger->log("Player authenticated: " + username);
             }
+            
+            // Update peak concurrent players
+            peakConcurrentPlayers = std::max(peakConcurrentPlayers, getConnectedClientCount());
+        } else {
+            response["success"] = false;
+            response["message"] = "Invalid username or password";
+            logger->warning("Authentication failed for username: " + username);
         }
     }
-}
-
-void MPChessServer::handleServerStatusUpdate() {
-    // Log server status
-    QJsonObject stats = getServerStats();
     
-    std::stringstream ss;
-    ss << "Server Status: "
-       << "Uptime: " << stats["uptime"].toInt() << "s, "
-       << "Connected Clients: " << stats["connectedClients"].toInt() << ", "
-       << "Active Games: " << stats["activeGames"].toInt() << ", "
-       << "Total Games: " << stats["totalGamesPlayed"].toInt();
+    // The result still goes out as JSON; binary frames start with the next message
+    bool binaryProtocol = response["success"].toBool() &&
+                          data["protocol"].toString() == WireProtocol::PROTOCOL_NAME;
+    if (binaryProtocol) {
+        response["protocol"] = WireProtocol::PROTOCOL_NAME;
+    }
     
-    logger->log(ss.str());
+    // Compression rides on binary frames; JSON-line clients are never sent it
+    bool compression = binaryProtocol && data["compression"].toString() == WireProtocol::COMPRESSION_NAME;
+    if (compression) {
+        response["compression"] = WireProtocol::COMPRESSION_NAME;
+    }
+    
+    // Clients that can apply GAME_STATE_DELTA get it instead of full states after moves
+    bool stateDelta = response["success"].toBool() && data["stateDelta"].toBool();
+    if (stateDelta) {
+        response["stateDelta"] = true;
+        stateDeltaSockets.insert(socket);
+    } else {
+        stateDeltaSockets.remove(socket);
+    }
+    
+    sendMessage(socket, response);
+    
+    if (binaryProtocol) {
+        binaryProtocolSockets.insert(socket);
+        MPCHESS_DEBUG(logger, "Using binary protocol for " + username);
+    }
+    
+    if (compression) {
+        compressionSockets.insert(socket);
+    } else {
+        compressionSockets.remove(socket);
+    }
+    
+    // A reconnecting client catches up on the game it was watching
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (response["success"].toBool() && player && data.contains("lastSequence")) {
+        auto gameIt = playerToGameId.find(player);
+        bool sameGame = gameIt != playerToGameId.end() &&
+                        gameIt.value() == data["gameId"].toString().toStdString();
+        resendGameState(socket, player, sameGame ? data["lastSequence"].toInteger() : -1);
+    }
 }
 
-void MPChessServer::processClientMessage(QTcpSocket* socket, const QJsonObject& message) {
-    if (!message.contains("type")) {
-        logger->error("Message missing type field");
+/*
+void MPChessServer::processMoveRequest(QTcpSocket* socket, const QJsonObject& data)
+{
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (!player) {
+        logger->error("Move request from unauthenticated socket");
         return;
     }
     
-    MessageType type = static_cast<MessageType>(message["type"].toInt());
+    std::string gameId = data["gameId"].toString().toStdString();
+    std::string moveStr = data["move"].toString().toStdString();
     
-    switch (type) {
-        case MessageType::AUTHENTICATION:
-            processAuthRequest(socket, message);
-            break;
+    // Find the game
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end()) {
+        logger->error("Move request for non-existent game: " + gameId);
+        
+        QJsonObject response;
+        response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
+        response["success"] = false;
+        response["message"] = "Game not found";
+        sendMessage(socket, response);
+        return;
+    }
+    
+    ChessGame* game = it->second.get();
+    
+    // Parse the move
+    ChessMove move = ChessMove::fromAlgebraic(moveStr);
+    
+    // Process the move
+    MoveValidationStatus status = game->processMove(player, move);
+    
+    // Prepare response
+    QJsonObject response;
+    response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
+    
+    switch (status) {
+        case MoveValidationStatus::VALID:
+            response["success"] = true;
             
-        case MessageType::MOVE:
-            processMoveRequest(socket, message);
-            break;
+            // Increment total moves played
+            totalMovesPlayed++;
             
-        case MessageType::MATCHMAKING_REQUEST:
-            processMatchmakingRequest(socket, message);
+            // Send updated game state to both players
+            {
+                QJsonObject gameStateMessage;
+                gameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
+                gameStateMessage["gameState"] = game->getGameStateJson();
+                
+                ChessPlayer* whitePlayer = game->getWhitePlayer();
+                ChessPlayer* blackPlayer = game->getBlackPlayer();
+                
+                if (whitePlayer->getSocket()) {
+                    sendMessage(whitePlayer->getSocket(), gameStateMessage);
+                }
+                
+                if (blackPlayer->getSocket()) {
+                    sendMessage(blackPlayer->getSocket(), gameStateMessage);
+                }
+                
+/ *
+                // Send move recommendations to the next player
+                ChessPlayer* nextPlayer = game->getCurrentPlayer();
+                if (nextPlayer && nextPlayer->getSocket() && !game->isOver()) {
+                    std::vector<std::pair<ChessMove, double>> recommendations = 
+                        game->getMoveRecommendations(nextPlayer);
+                    
+                    QJsonObject recommendationsMessage;
+                    recommendationsMessage["type"] = static_cast<int>(MessageType::MOVE_RECOMMENDATIONS);
+                    
+                    QJsonArray recommendationsArray;
+                    for (const auto& [recMove, evaluation] : recommendations) {
+                        QJsonObject recObj;
+                        recObj["move"] = QString::fromStdString(recMove.toAlgebraic());
+                        recObj["evaluation"] = evaluation;
+                        recObj["standardNotation"] = QString::fromStdString(
+                            recMove.toStandardNotation(*game->getBoard()));
+                        recommendationsArray.append(recObj);
+                    }
+                    
+                    recommendationsMessage["recommendations"] = recommendationsArray;
+                    sendMessage(nextPlayer->getSocket(), recommendationsMessage);
+                }
+* /
+
+                // Send move recommendations to the next player asynchronously
+                ChessPlayer* nextPlayer = game->getCurrentPlayer();
+                if (nextPlayer && nextPlayer->getSocket() && !game->isOver()) {
+                    try {
+                        generateMoveRecommendationsAsync(gameId, nextPlayer);
+                    } catch (const std::exception& e) {
+                        logger->error("processMoveRequest() - Exception scheduling move recommendations: " + std::string(e.what()));
+                    }
+                }
+
+                // If the game is over, update ratings and save history
+                if (game->isOver()) {
+                    updatePlayerRatings(game);
+                    saveGameHistory(*game);
+                }
+            }
             break;
             
-        case MessageType::GAME_HISTORY_REQUEST:
-            processGameHistoryRequest(socket, message);
+        case MoveValidationStatus::INVALID_PIECE:
+            response["success"] = false;
+            response["message"] = "No piece at the source position";
             break;
             
-        case MessageType::GAME_ANALYSIS_REQUEST:
-            processGameAnalysisRequest(socket, message);
+        case MoveValidationStatus::INVALID_DESTINATION:
+            response["success"] = false;
+            response["message"] = "Invalid destination";
             break;
             
-        case MessageType::RESIGN:
-            processResignRequest(socket, message);
+        case MoveValidationStatus::INVALID_PATH:
+            response["success"] = false;
+            response["message"] = "Invalid move for this piece";
             break;
             
-        case MessageType::DRAW_OFFER:
-            processDrawOfferRequest(socket, message);
+        case MoveValidationStatus::KING_IN_CHECK:
+            response["success"] = false;
+            response["message"] = "Move would leave your king in check";
             break;
             
-        case MessageType::DRAW_RESPONSE:
-            processDrawResponseRequest(socket, message);
-            break;
-
-        case MessageType::LEADERBOARD_REQUEST:
-            processLeaderboardRequest(socket, message);
+        case MoveValidationStatus::WRONG_TURN:
+            response["success"] = false;
+            response["message"] = "It's not your turn";
             break;
-
-        case MessageType::PING:
-            // Respond with a pong
-            {
-                QJsonObject response;
-                response["type"] = static_cast<int>(MessageType::PONG);
-                sendMessage(socket, response);
-            }
+            
+        case MoveValidationStatus::GAME_OVER:
+            response["success"] = false;
+            response["message"] = "The game is already over";
             break;
             
         default:
-            logger->warning("Unknown message type: " + std::to_string(static_cast<int>(type)));
+            response["success"] = false;
+            response["message"] = "Unknown error";
             break;
     }
+    
+    sendMessage(socket, response);
+    
+    // Log the move
+    if (status == MoveValidationStatus::VALID) {
+        logger->log("Player " + player->getUsername() + " made move " + moveStr + 
+                   " in game " + gameId);
+    } else {
+        logger->warning("Player " + player->getUsername() + " attempted invalid move " + 
+                       moveStr + " in game " + gameId + ": " + response["message"].toString().toStdString());
+    }
 }
+*/
 
-void MPChessServer::handleLeaderboardRefresh() {
-    logger->log("Refreshing leaderboard");
-    leaderboard->refreshLeaderboard();
-}
-
-void MPChessServer::sendMessage(QTcpSocket* socket, const QJsonObject& message) {
-    if (!socket) {
-        logger->error("Attempted to send message to null socket");
+/*
+void MPChessServer::processMoveRequest(QTcpSocket* socket, const QJsonObject& data)
+{
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (!player) {
+        logger->error("Move request from unauthenticated socket");
+        return;
+    }
+    
+    std::string gameId = data["gameId"].toString().toStdString();
+    std::string moveStr = data["move"].toString().toStdString();
+    
+    // Find the game
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end()) {
+        logger->error("Move request for non-existent game: " + gameId);
+        
+        QJsonObject response;
+        response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
+        response["success"] = false;
+        response["message"] = "Game not found";
+        sendMessage(socket, response);
         return;
     }
     
-    // Log the message
-    logger->logNetworkMessage("SENT", message);
-    
-    // Convert to JSON
-    QJsonDocument doc(message);
-    QByteArray data = doc.toJson();
+    ChessGame* game = it->second.get();
     
-    // Send the data
-    socket->write(data);
-    socket->flush();
-}
-
-/*
-std::string MPChessServer::createGame(ChessPlayer* player1, ChessPlayer* player2, TimeControlType timeControl)
-{
-    if (!player1 || !player2) {
-        logger->error("createGame() - Attempted to create game with null player(s)");
-        throw std::invalid_argument("Null player(s) provided to createGame");
-    }
-
-    // Check if either player is already in a game
-    if (isPlayerInGame(player1)) {
-        logger->error("createGame() - Player " + player1->getUsername() + " is already in a game");
-        throw std::runtime_error("Player " + player1->getUsername() + " is already in a game");
-    }
+    // Parse the move
+    ChessMove move = ChessMove::fromAlgebraic(moveStr);
     
-    if (isPlayerInGame(player2)) {
-        logger->error("createGame() - Player " + player2->getUsername() + " is already in a game");
-        throw std::runtime_error("Player " + player2->getUsername() + " is already in a game");
-    }
+    // Process the move
+    MoveValidationStatus status = game->processMove(player, move);
     
-    logger->debug("createGame() - Creating game between " + player1->getUsername() + " and " + player2->getUsername());
+    // Prepare response
+    QJsonObject response;
+    response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
     
-    try {
-        // Generate a unique game ID
-        std::string gameId = QUuid::createUuid().toString(QUuid::WithoutBraces).toStdString();
-        logger->debug("createGame() - Generated game ID: " + gameId);
-        
-        // Randomly assign colors
-        bool player1IsWhite = QRandomGenerator::global()->bounded(2) == 0;
-        ChessPlayer* whitePlayer = player1IsWhite ? player1 : player2;
-        ChessPlayer* blackPlayer = player1IsWhite ? player2 : player1;
-        
-        logger->debug("createGame() - Assigned colors: " + whitePlayer->getUsername() + " (White), " + 
-                     blackPlayer->getUsername() + " (Black)");
-        
-        // Set player colors before creating the game
-        whitePlayer->setColor(PieceColor::WHITE);
-        blackPlayer->setColor(PieceColor::BLACK);
-        
-        // Create the game with try-catch
-        std::unique_ptr<ChessGame> game;
-        try {
-            logger->debug("createGame() - Constructing ChessGame object for game " + gameId);
-            game = std::make_unique<ChessGame>(whitePlayer, blackPlayer, gameId, timeControl);
-            logger->debug("createGame() - ChessGame object created successfully for game " + gameId);
-        } catch (const std::exception& e) {
-            logger->error("createGame() - Exception creating ChessGame for game " + gameId + ": " + std::string(e.what()));
-            throw;
-        } catch (...) {
-            logger->error("createGame() - Unknown exception creating ChessGame for game " + gameId);
-            throw std::runtime_error("Unknown error creating game");
-        }
-        
-        // Start the game with try-catch
-        try {
-            logger->debug("createGame() - Starting game " + gameId);
-            game->start();
-            logger->debug("createGame() - Game " + gameId + " started successfully");
-        } catch (const std::exception& e) {
-            logger->error("createGame() - Exception starting game " + gameId + ": " + std::string(e.what()));
-            throw;
-        } catch (...) {
-            logger->error("createGame() - Unknown exception starting game " + gameId);
-            throw std::runtime_error("Unknown error starting game");
-        }
-        
-        // Store the game
-        logger->debug("createGame() - Storing game " + gameId + " in active games map");
-        activeGames[gameId] = std::move(game);
-        playerToGameId[whitePlayer] = gameId;
-        playerToGameId[blackPlayer] = gameId;
-        
-        // Send game start message to both players
-        logger->debug("createGame() - Preparing game start messages for game " + gameId);
-        QJsonObject message;
-        message["type"] = static_cast<int>(MessageType::GAME_START);
-        message["gameId"] = QString::fromStdString(gameId);
-        message["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
-        message["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
-        message["timeControl"] = [timeControl]() -> QString {
-            switch (timeControl) {
-                case TimeControlType::RAPID: return "rapid";
-                case TimeControlType::BLITZ: return "blitz";
-                case TimeControlType::BULLET: return "bullet";
-                case TimeControlType::CLASSICAL: return "classical";
-                case TimeControlType::CASUAL: return "casual";
-                default: return "rapid";
-            }
-        }();
-        
-        if (whitePlayer->getSocket()) {
-            logger->debug("createGame() - Sending game start message to white player: " + whitePlayer->getUsername());
-            message["yourColor"] = "white";
-            sendMessage(whitePlayer->getSocket(), message);
-        } else {
-            logger->warning("createGame() - White player has no socket: " + whitePlayer->getUsername());
-        }
-        
-        if (blackPlayer->getSocket()) {
-            logger->debug("createGame() - Sending game start message to black player: " + blackPlayer->getUsername());
-            message["yourColor"] = "black";
-            sendMessage(blackPlayer->getSocket(), message);
-        } else {
-            logger->warning("createGame() - Black player has no socket: " + blackPlayer->getUsername());
-        }
-        
-        // Send initial game state
-        try {
-            logger->debug("createGame() - Preparing initial game state message for game " + gameId);
-            QJsonObject gameStateMessage;
-            gameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
-            
-            logger->debug("createGame() - Getting game state JSON for game " + gameId);
-            gameStateMessage["gameState"] = activeGames[gameId]->getGameStateJson();
-            logger->debug("createGame() - Successfully got game state JSON for game " + gameId);
+    switch (status) {
+        case MoveValidationStatus::VALID:
+            response["success"] = true;
             
-            if (whitePlayer->getSocket()) {
-                logger->debug("createGame() - Sending game state to white player: " + whitePlayer->getUsername());
-                sendMessage(whitePlayer->getSocket(), gameStateMessage);
-            }
+            // Increment total moves played
+            totalMovesPlayed++;
             
-            if (blackPlayer->getSocket()) {
-                logger->debug("createGame() - Sending game state to black player: " + blackPlayer->getUsername());
-                sendMessage(blackPlayer->getSocket(), gameStateMessage);
-            }
-        } catch (const std::exception& e) {
-            logger->error("createGame() - Exception sending game state for game " + gameId + ": " + std::string(e.what()));
-            // Continue despite error in sending game state
-        }
-        
-        // Send move recommendations to white player (first to move) asynchronously
-        if (whitePlayer->getSocket()) {
-            try {
-                logger->debug("createGame() - Scheduling async move recommendations for white player in game " + gameId);
-                generateMoveRecommendationsAsync(gameId, whitePlayer);
-            } catch (const std::exception& e) {
-                logger->error("createGame() - Exception scheduling move recommendations for game " + gameId + ": " + std::string(e.what()));
-                // Continue despite error in recommendations
-            }
-        }
-/ *
-        // Send move recommendations to white player (first to move) - SIMPLIFIED VERSION
-        if (whitePlayer->getSocket()) {
-            try {
-                logger->debug("createGame() - Generating simplified move recommendations for white player in game " + gameId);
+            // Send updated game state to both players with proper orientation
+            {
+                ChessPlayer* whitePlayer = game->getWhitePlayer();
+                ChessPlayer* blackPlayer = game->getBlackPlayer();
                 
-                // Get valid moves directly from the board
-                std::vector<ChessMove> validMoves = activeGames[gameId]->getBoard()->getAllValidMoves(PieceColor::WHITE);
+                // Get the base game state
+                QJsonObject baseGameState = game->getGameStateJson();
                 
-                // Take just the first few moves without deep evaluation
-                std::vector<std::pair<ChessMove, double>> recommendations;
-                int count = 0;
-                for (const auto& move : validMoves) {
-                    recommendations.emplace_back(move, 0.0);
-                    count++;
-                    if (count >= 5) break;
-                }
+                // Create white player's game state message
+                QJsonObject whiteGameStateMessage;
+                whiteGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
+                whiteGameStateMessage["gameState"] = baseGameState;
+                whiteGameStateMessage["gameState"].toObject()["boardOrientation"] = "standard";
                 
-                QJsonObject recommendationsMessage;
-                recommendationsMessage["type"] = static_cast<int>(MessageType::MOVE_RECOMMENDATIONS);
+                // Create black player's game state message
+                QJsonObject blackGameStateMessage;
+                blackGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
+                blackGameStateMessage["gameState"] = baseGameState;
+                blackGameStateMessage["gameState"].toObject()["boardOrientation"] = "flipped";
                 
-                QJsonArray recommendationsArray;
-                for (const auto& [move, evaluation] : recommendations) {
-                    QJsonObject recObj;
-                    recObj["move"] = QString::fromStdString(move.toAlgebraic());
-                    recObj["evaluation"] = evaluation;
-                    recObj["standardNotation"] = QString::fromStdString(
-                        move.toStandardNotation(*activeGames[gameId]->getBoard()));
-                    recommendationsArray.append(recObj);
+                if (whitePlayer->getSocket()) {
+                    sendMessage(whitePlayer->getSocket(), whiteGameStateMessage);
                 }
                 
-                recommendationsMessage["recommendations"] = recommendationsArray;
-                logger->debug("createGame() - Sending move recommendations to white player: " + whitePlayer->getUsername());
-                sendMessage(whitePlayer->getSocket(), recommendationsMessage);
-            } catch (const std::exception& e) {
-                logger->error("createGame() - Exception generating move recommendations for game " + gameId + ": " + std::string(e.what()));
-                // Continue despite error in recommendations
-            }
-        }
-// * /
-        
-        // Log the game creation
-        logger->log("Created game " + gameId + ": " + whitePlayer->getUsername() + 
-                   " (White) vs " + blackPlayer->getUsername() + " (Black)");
-        
-        // Increment total games played
-        totalGamesPlayed++;
+                if (blackPlayer->getSocket()) {
+                    sendMessage(blackPlayer->getSocket(), blackGameStateMessage);
+                }
+                
+                // Send move recommendations to the next player asynchronously
+                ChessPlayer* nextPlayer = game->getCurrentPlayer();
+                if (nextPlayer && nextPlayer->getSocket() && !game->isOver()) {
+                    try {
+                        generateMoveRecommendationsAsync(gameId, nextPlayer);
+                    } catch (const std::exception& e) {
+                        logger->error("processMoveRequest() - Exception scheduling move recommendations: " + std::string(e.what()));
+                    }
+                }
 
-        // Make sure to remove players from matchmaking queue if they're still there
-        matchmaker->removePlayer(player1);
-        matchmaker->removePlayer(player2);
-        
-        return gameId;
-    } catch (const std::exception& e) {
-        logger->error("createGame() - Exception in createGame: " + std::string(e.what()));
-        throw;
-    } catch (...) {
-        logger->error("createGame() - Unknown exception in createGame");
-        throw std::runtime_error("Unknown error creating game");
+                // If the game is over, update ratings and save history
+                if (game->isOver()) {
+                    updatePlayerRatings(game);
+                    saveGameHistory(*game);
+                }
+            }
+            break;
+            
+        case MoveValidationStatus::INVALID_PIECE:
+            response["success"] = false;
+            response["message"] = "No piece at the source position";
+            break;
+            
+        case MoveValidationStatus::INVALID_DESTINATION:
+            response["success"] = false;
+            response["message"] = "Invalid destination";
+            break;
+            
+        case MoveValidationStatus::INVALID_PATH:
+            response["success"] = false;
+            response["message"] = "Invalid move for this piece";
+            break;
+            
+        case MoveValidationStatus::KING_IN_CHECK:
+            response["success"] = false;
+            response["message"] = "Move would leave your king in check";
+            break;
+            
+        case MoveValidationStatus::WRONG_TURN:
+            response["success"] = false;
+            response["message"] = "It's not your turn";
+            break;
+            
+        case MoveValidationStatus::GAME_OVER:
+            response["success"] = false;
+            response["message"] = "The game is already over";
+            break;
+            
+        default:
+            response["success"] = false;
+            response["message"] = "Unknown error";
+            break;
+    }
+    
+    sendMessage(socket, response);
+    
+    // Log the move
+    if (status == MoveValidationStatus::VALID) {
+        logger->log("Player " + player->getUsername() + " made move " + moveStr + 
+                   " in game " + gameId);
+    } else {
+        logger->warning("Player " + player->getUsername() + " attempted invalid move " + 
+                       moveStr + " in game " + gameId + ": " + response["message"].toString().toStdString());
     }
 }
 */
 
-/*
-std::string MPChessServer::createGame(ChessPlayer* player1, ChessPlayer* player2, TimeControlType timeControl)
+void MPChessServer::processMoveRequest(QTcpSocket* socket, const QJsonObject& data)
 {
-    if (!player1 || !player2) {
-        logger->error("createGame() - Attempted to create game with null player(s)");
-        throw std::invalid_argument("Null player(s) provided to createGame");
-    }
-
-    // Check if either player is already in a game
-    if (isPlayerInGame(player1)) {
-        logger->error("createGame() - Player " + player1->getUsername() + " is already in a game");
-        throw std::runtime_error("Player " + player1->getUsername() + " is already in a game");
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (!player) {
+        logger->error("Move request from unauthenticated socket");
+        return;
     }
     
-    if (isPlayerInGame(player2)) {
-        logger->error("createGame() - Player " + player2->getUsername() + " is already in a game");
-        throw std::runtime_error("Player " + player2->getUsername() + " is already in a game");
+    std::string gameId = data["gameId"].toString().toStdString();
+    std::string moveStr = data["move"].toString().toStdString();
+    
+    // Find the game
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end()) {
+        logger->error("Move request for non-existent game: " + gameId);
+        
+        QJsonObject response;
+        response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
+        response["success"] = false;
+        response["message"] = "Game not found";
+        sendMessage(socket, response);
+        return;
     }
     
-    logger->debug("createGame() - Creating game between " + player1->getUsername() + " and " + player2->getUsername());
+    ChessGame* game = it->second.get();
     
-    try {
-        // Generate a unique game ID
-        std::string gameId = QUuid::createUuid().toString(QUuid::WithoutBraces).toStdString();
-        logger->debug("createGame() - Generated game ID: " + gameId);
-        
-        // Randomly assign colors
-        bool player1IsWhite = QRandomGenerator::global()->bounded(2) == 0;
-        ChessPlayer* whitePlayer = player1IsWhite ? player1 : player2;
-        ChessPlayer* blackPlayer = player1IsWhite ? player2 : player1;
-        
-        logger->debug("createGame() - Assigned colors: " + whitePlayer->getUsername() + " (White), " + 
-                     blackPlayer->getUsername() + " (Black)");
-        
-        // Set player colors before creating the game
-        whitePlayer->setColor(PieceColor::WHITE);
-        blackPlayer->setColor(PieceColor::BLACK);
-        
-        // Create the game with try-catch
-        std::unique_ptr<ChessGame> game;
-        try {
-            logger->debug("createGame() - Constructing ChessGame object for game " + gameId);
-            game = std::make_unique<ChessGame>(whitePlayer, blackPlayer, gameId, timeControl);
-            logger->debug("createGame() - ChessGame object created successfully for game " + gameId);
-        } catch (const std::exception& e) {
-            logger->error("createGame() - Exception creating ChessGame for game " + gameId + ": " + std::string(e.what()));
-            throw;
-        } catch (...) {
-            logger->error("createGame() - Unknown exception creating ChessGame for game " + gameId);
-            throw std::runtime_error("Unknown error creating game");
-        }
-        
-        // Start the game with try-catch
-        try {
-            logger->debug("createGame() - Starting game " + gameId);
-            game->start();
-            logger->debug("createGame() - Game " + gameId + " started successfully");
-        } catch (const std::exception& e) {
-            logger->error("createGame() - Exception starting game " + gameId + ": " + std::string(e.what()));
-            throw;
-        } catch (...) {
-            logger->error("createGame() - Unknown exception starting game " + gameId);
-            throw std::runtime_error("Unknown error starting game");
-        }
-        
-        // Store the game
-        logger->debug("createGame() - Storing game " + gameId + " in active games map");
-        activeGames[gameId] = std::move(game);
-        playerToGameId[whitePlayer] = gameId;
-        playerToGameId[blackPlayer] = gameId;
-        
-        // Send game start message to both players
-        logger->debug("createGame() - Preparing game start messages for game " + gameId);
-        
-        // White player message
-        QJsonObject whiteMessage;
-        whiteMessage["type"] = static_cast<int>(MessageType::GAME_START);
-        whiteMessage["gameId"] = QString::fromStdString(gameId);
-        whiteMessage["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
-        whiteMessage["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
-        whiteMessage["yourColor"] = "white";
-        whiteMessage["boardOrientation"] = "standard"; // White pieces at bottom
-        whiteMessage["timeControl"] = [timeControl]() -> QString {
-            switch (timeControl) {
-                case TimeControlType::RAPID: return "rapid";
-                case TimeControlType::BLITZ: return "blitz";
-                case TimeControlType::BULLET: return "bullet";
-                case TimeControlType::CLASSICAL: return "classical";
-                case TimeControlType::CASUAL: return "casual";
-                default: return "rapid";
+    // Parse the move
+    ChessMove move = ChessMove::fromAlgebraic(moveStr);
+    
+    // Process the move
+    MoveValidationStatus status = game->processMove(player, move);
+    
+    // Prepare response
+    QJsonObject response;
+    response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
+    
+    switch (status) {
+        case MoveValidationStatus::VALID:
+            response["success"] = true;
+            
+            // Increment total moves played
+            totalMovesPlayed++;
+            
+            // Send updated game state to both players
+            sendGameStateToPlayers(gameId);
+            
+            // Searches for positions the game has just left are no longer needed
+            retireRecommendations(gameId);
+            
+            // Send move recommendations to the next player asynchronously
+            {
+                ChessPlayer* nextPlayer = game->getCurrentPlayer();
+                if (nextPlayer && nextPlayer->getSocket() && !game->isOver()) {
+                    try {
+                        generateMoveRecommendationsAsync(gameId, nextPlayer);
+                    } catch (const std::exception& e) {
+                        logger->error("processMoveRequest() - Exception scheduling move recommendations: " + std::string(e.what()));
+                    }
+                } else if (nextPlayer && !game->isOver()) {
+                    // No recommendations to learn the bot's likely replies from; let the task find them
+                    speculateRecommendations(gameId, player, std::vector<ChessMove>());
+                }
+
+                // If the game is over, update ratings and save history
+                if (game->isOver()) {
+                    updatePlayerRatings(game);
+                    saveGameHistory(*game);
+                }
             }
-        }();
-        
-        // Black player message
-        QJsonObject blackMessage;
-        blackMessage["type"] = static_cast<int>(MessageType::GAME_START);
-        blackMessage["gameId"] = QString::fromStdString(gameId);
-        blackMessage["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
-        blackMessage["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
-        blackMessage["yourColor"] = "black";
-        blackMessage["boardOrientation"] = "flipped"; // Black pieces at bottom
-        blackMessage["timeControl"] = whiteMessage["timeControl"];
-        
-        if (whitePlayer->getSocket()) {
-            logger->debug("createGame() - Sending game start message to white player: " + whitePlayer->getUsername());
-            sendMessage(whitePlayer->getSocket(), whiteMessage);
-        } else {
-            logger->warning("createGame() - White player has no socket: " + whitePlayer->getUsername());
+            break;
+            
+        case MoveValidationStatus::INVALID_PIECE:
+            response["success"] = false;
+            response["message"] = "No piece at the source position";
+            break;
+            
+        case MoveValidationStatus::INVALID_DESTINATION:
+            response["success"] = false;
+            response["message"] = "Invalid destination";
+            break;
+            
+        case MoveValidationStatus::INVALID_PATH:
+            response["success"] = false;
+            response["message"] = "Invalid move for this piece";
+            break;
+            
+        case MoveValidationStatus::KING_IN_CHECK:
+            response["success"] = false;
+            response["message"] = "Move would leave your king in check";
+            break;
+            
+        case MoveValidationStatus::WRONG_TURN:
+            response["success"] = false;
+            response["message"] = "It's not your turn";
+            break;
+            
+        case MoveValidationStatus::GAME_OVER:
+            response["success"] = false;
+            response["message"] = "The game is already over";
+            break;
+            
+        default:
+            response["success"] = false;
+            response["message"] = "Unknown error";
+            break;
+    }
+    
+    sendMessage(socket, response);
+    
+    // Log the move
+    if (status == MoveValidationStatus::VALID) {
+        logger->log("Player " + player->getUsername() + " made move " + moveStr + 
+                   " in game " + gameId);
+    } else {
+        logger->warning("Player " + player->getUsername() + " attempted invalid move " + 
+                       moveStr + " in game " + gameId + ": " + response["message"].toString().toStdString());
+    }
+    
+    // Let a bot opponent reply once the player has their result
+    if (status == MoveValidationStatus::VALID && !game->isOver()) {
+        ChessPlayer* nextPlayer = game->getCurrentPlayer();
+        if (nextPlayer && nextPlayer->isBot()) {
+            processBotMove(gameId);
         }
+    }
+}
+
+void MPChessServer::processMatchmakingRequest(QTcpSocket* socket, const QJsonObject& data)
+{
+    MPCHESS_DEBUG(logger, "Processing matchmaking request");
+    
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (!player) {
+        logger->error("Matchmaking request from unauthenticated socket");
         
-        if (blackPlayer->getSocket()) {
-            logger->debug("createGame() - Sending game start message to black player: " + blackPlayer->getUsername());
-            sendMessage(blackPlayer->getSocket(), blackMessage);
-        } else {
-            logger->warning("createGame() - Black player has no socket: " + blackPlayer->getUsername());
+        QJsonObject errorResponse;
+        errorResponse["type"] = static_cast<int>(MessageType::ERROR);
+        errorResponse["message"] = "You must be authenticated to use matchmaking";
+        sendMessage(socket, errorResponse);
+        return;
+    }
+    
+    bool join = data["join"].toBool();
+    MPCHESS_DEBUG(logger, "Player " + player->getUsername() + (join ? " joining " : " leaving ") + "matchmaking queue");
+    
+    QJsonObject response;
+    response["type"] = static_cast<int>(MessageType::MATCHMAKING_STATUS);
+    
+    if (join) {
+        // Check if the player is already in a game
+        if (isPlayerInGame(player)) {
+            std::string gameId = playerToGameId[player];
+            logger->warning("Player " + player->getUsername() + " tried to join matchmaking while in game " + gameId);
+            
+            response["status"] = "already_in_game";
+            response["message"] = "You are already in a game";
+            response["gameId"] = QString::fromStdString(gameId);
+            sendMessage(socket, response);
+            return;
+        }
+        
+        // Each rating band is matched on the node that owns it, so players close in
+        // rating meet in one queue wherever they connected
+        if (cluster && !data["redirected"].toBool()) {
+            std::string queueKey = "rating/" + std::to_string(player->getRating() / MATCHMAKING_RATING_BAND);
+            ClusterDirectory::NodeInfo owner = cluster->ownerOf(queueKey);
+            if (!cluster->isLocal(owner)) {
+                sendNodeRedirect(socket, owner, QJsonObject{{"matchmaking", true}});
+                logger->log("Redirected " + player->getUsername() + " to node " + owner.nodeId + " for matchmaking");
+                return;
+            }
         }
         
-        // Send initial game state
         try {
-            logger->debug("createGame() - Preparing initial game state message for game " + gameId);
+            // Add the player to the matchmaking queue
+            matchmaker->addPlayer(player);
             
-            // Get the base game state
-            QJsonObject baseGameState = activeGames[gameId]->getGameStateJson();
+            response["status"] = "queued";
+            response["message"] = "You have been added to the matchmaking queue";
+            response["queueSize"] = matchmaker->getQueueSize();
             
-            // Create white player's game state
-            QJsonObject whiteGameStateMessage;
-            whiteGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
-            whiteGameStateMessage["gameState"] = baseGameState;
-            whiteGameStateMessage["gameState"].toObject()["boardOrientation"] = "standard";
+            logger->log("Player " + player->getUsername() + " joined matchmaking queue");
+        } catch (const std::exception& e) {
+            logger->error("Exception adding player to matchmaking: " + std::string(e.what()));
             
-            // Create black player's game state
-            QJsonObject blackGameStateMessage;
-            blackGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
-            blackGameStateMessage["gameState"] = baseGameState;
-            blackGameStateMessage["gameState"].toObject()["boardOrientation"] = "flipped";
+            response["status"] = "error";
+            response["message"] = "An error occurred while joining the matchmaking queue";
+        }
+    } else {
+        try {
+            // Remove the player from the matchmaking queue
+            matchmaker->removePlayer(player);
             
-            if (whitePlayer->getSocket()) {
-                logger->debug("createGame() - Sending game state to white player: " + whitePlayer->getUsername());
-                sendMessage(whitePlayer->getSocket(), whiteGameStateMessage);
-            }
+            response["status"] = "left";
+            response["message"] = "You have left the matchmaking queue";
             
-            if (blackPlayer->getSocket()) {
-                logger->debug("createGame() - Sending game state to black player: " + blackPlayer->getUsername());
-                sendMessage(blackPlayer->getSocket(), blackGameStateMessage);
-            }
+            logger->log("Player " + player->getUsername() + " left matchmaking queue");
         } catch (const std::exception& e) {
-            logger->error("createGame() - Exception sending game state for game " + gameId + ": " + std::string(e.what()));
-            // Continue despite error in sending game state
+            logger->error("Exception removing player from matchmaking: " + std::string(e.what()));
+            
+            response["status"] = "error";
+            response["message"] = "An error occurred while leaving the matchmaking queue";
         }
-        
-        // Send move recommendations to white player (first to move) asynchronously
-        if (whitePlayer->getSocket()) {
-            try {
-                logger->debug("createGame() - Scheduling async move recommendations for white player in game " + gameId);
-                generateMoveRecommendationsAsync(gameId, whitePlayer);
-            } catch (const std::exception& e) {
-                logger->error("createGame() - Exception scheduling move recommendations for game " + gameId + ": " + std::string(e.what()));
-                // Continue despite error in recommendations
+    }
+    
+    sendMessage(socket, response);
+}
+
+std::string MPChessServer::scheduleTournament(int rounds, TimeControlType timeControl, qint64 startTime)
+{
+    std::string tournamentId = QUuid::createUuid().toString(QUuid::WithoutBraces).toStdString();
+    tournaments[tournamentId] = std::make_unique<ChessTournament>(tournamentId, rounds, timeControl, startTime);
+    
+    qint64 delay = std::max<qint64>(0, startTime - QDateTime::currentMSecsSinceEpoch());
+    QTimer::singleShot(static_cast<int>(std::min<qint64>(delay, std::numeric_limits<int>::max())), this,
+                       [this, tournamentId]() {
+        startTournamentRound(tournamentId);
+    });
+    
+    logger->log("Scheduled tournament " + tournamentId + ": " + std::to_string(rounds) + " rounds, starting at " +
+                QDateTime::fromMSecsSinceEpoch(startTime).toString(Qt::ISODate).toStdString());
+    return tournamentId;
+}
+
+void MPChessServer::startTournamentRound(const std::string& tournamentId)
+{
+    auto it = tournaments.find(tournamentId);
+    if (it == tournaments.end()) {
+        return;
+    }
+    ChessTournament* tournament = it->second.get();
+    
+    // One status message for every participant, encoded once per wire format
+    auto broadcastStatus = [this, tournament](const QJsonObject& message,
+                                              std::unordered_map<QTcpSocket*, QByteArray>& pending) {
+        logger->logNetworkMessage("SENT", message);
+        QByteArray encoded[3];  // Text, binary, compressed binary
+        for (const std::string& username : tournament->getActivePlayers()) {
+            ChessPlayer* player = usernamesToPlayers.value(username, nullptr);
+            QTcpSocket* socket = player ? player->getSocket() : nullptr;
+            if (!socket) {
+                continue;
+            }
+            bool binary = binaryProtocolSockets.contains(socket);
+            bool compress = binary && compressionSockets.contains(socket);
+            QByteArray& bytes = encoded[binary ? (compress ? 2 : 1) : 0];
+            if (bytes.isEmpty()) {
+                bytes = encodeMessage(message, binary, compress);
             }
+            pending[socket].append(bytes);
+        }
+    };
+    
+    QJsonObject status;
+    status["type"] = static_cast<int>(MessageType::TOURNAMENT_STATUS);
+    
+    if (tournament->isFinished()) {
+        status["action"] = "finished";
+        status["tournament"] = tournament->toJson();
+        std::unordered_map<QTcpSocket*, QByteArray> pending;
+        broadcastStatus(status, pending);
+        for (auto& [socket, data] : pending) {
+            runOnSocketThread(socket, [socket, data = std::move(data)]() {
+                writeCoalesced(socket, data);
+            });
+        }
+        logger->log("Tournament " + tournamentId + " finished");
+        return;
+    }
+    
+    // The whole round is paired at once
+    std::vector<ChessTournament::Pairing> pairings = tournament->pairNextRound();
+    int round = tournament->getCurrentRound();
+    
+    // A player who is offline or still in another game forfeits, and is withdrawn until
+    // they join again
+    auto available = [this](const std::string& username) -> ChessPlayer* {
+        ChessPlayer* player = usernamesToPlayers.value(username, nullptr);
+        return player && player->getSocket() && !isPlayerInGame(player) ? player : nullptr;
+    };
+    
+    QJsonArray byes;
+    QJsonArray forfeits;
+    std::vector<std::pair<ChessPlayer*, ChessPlayer*>> games;
+    games.reserve(pairings.size());
+    for (const ChessTournament::Pairing& pairing : pairings) {
+        if (pairing.black.empty()) {
+            byes.append(QString::fromStdString(pairing.white));
+            continue;
+        }
+        ChessPlayer* whitePlayer = available(pairing.white);
+        ChessPlayer* blackPlayer = available(pairing.black);
+        if (whitePlayer && blackPlayer) {
+            games.emplace_back(whitePlayer, blackPlayer);
+            continue;
         }
         
-        // Log the game creation
-        logger->log("Created game " + gameId + ": " + whitePlayer->getUsername() + 
-                   " (White) vs " + blackPlayer->getUsername() + " (Black)");
-        
-        // Increment total games played
-        totalGamesPlayed++;
-
-        // Make sure to remove players from matchmaking queue if they're still there
-        matchmaker->removePlayer(player1);
-        matchmaker->removePlayer(player2);
-        
-        return gameId;
-    } catch (const std::exception& e) {
-        logger->error("createGame() - Exception in createGame: " + std::string(e.what()));
-        throw;
-    } catch (...) {
-        logger->error("createGame() - Unknown exception in createGame");
-        throw std::runtime_error("Unknown error creating game");
+        GameResult result = whitePlayer ? GameResult::WHITE_WIN : blackPlayer ? GameResult::BLACK_WIN
+                                                                             : GameResult::IN_PROGRESS;
+        tournament->recordResult(pairing.white, pairing.black, result);
+        for (const std::string& username : { pairing.white, pairing.black }) {
+            if (!available(username)) {
+                tournament->withdrawPlayer(username);
+                forfeits.append(QString::fromStdString(username));
+            }
+        }
+    }
+    
+    // Take every game object first, so the clocks of the round start together
+    std::vector<std::unique_ptr<ChessGame>> acquired;
+    acquired.reserve(games.size());
+    for (const auto& [whitePlayer, blackPlayer] : games) {
+        std::string gameId = QUuid::createUuid().toString(QUuid::WithoutBraces).toStdString();
+        acquired.push_back(acquireGame(whitePlayer, blackPlayer, gameId, tournament->getTimeControl()));
+    }
+    
+    std::vector<ChessGame*> started;
+    started.reserve(acquired.size());
+    for (std::unique_ptr<ChessGame>& game : acquired) {
+        tournamentGames[game->getGameId()] = tournamentId;
+        started.push_back(startGame(std::move(game)));
+    }
+    
+    status["action"] = "round";
+    status["tournament"] = tournament->toJson(false);
+    status["byes"] = byes;
+    status["forfeits"] = forfeits;
+    std::unordered_map<QTcpSocket*, QByteArray> pending;
+    broadcastStatus(status, pending);
+    announceGames(started, std::move(pending));
+    
+    logger->log("Tournament " + tournamentId + " round " + std::to_string(round) + ": started " +
+                std::to_string(started.size()) + " game(s), " + std::to_string(byes.size()) + " bye(s), " +
+                std::to_string(forfeits.size()) + " forfeit(s)");
+    
+    // A round decided without any games moves straight on
+    if (tournament->isRoundComplete()) {
+        QTimer::singleShot(TOURNAMENT_ROUND_BREAK_MS, this, [this, tournamentId]() {
+            startTournamentRound(tournamentId);
+        });
     }
 }
-*/
 
-std::string MPChessServer::createGame(ChessPlayer* player1, ChessPlayer* player2, TimeControlType timeControl)
+void MPChessServer::recordTournamentGame(const ChessGame& game)
 {
-    if (!player1 || !player2) {
-        logger->error("createGame() - Attempted to create game with null player(s)");
-        throw std::invalid_argument("Null player(s) provided to createGame");
+    auto it = tournamentGames.find(game.getGameId());
+    if (it == tournamentGames.end()) {
+        return;
+    }
+    std::string tournamentId = it->second;
+    tournamentGames.erase(it);
+    
+    auto tournamentIt = tournaments.find(tournamentId);
+    if (tournamentIt == tournaments.end()) {
+        return;
+    }
+    ChessTournament* tournament = tournamentIt->second.get();
+    tournament->recordResult(game.getWhitePlayer()->getUsername(), game.getBlackPlayer()->getUsername(),
+                             game.getResult());
+    
+    // The next round is paired after a break once the last game of this one ends
+    if (tournament->isRoundComplete()) {
+        logger->log("Tournament " + tournamentId + " round " + std::to_string(tournament->getCurrentRound()) +
+                    " complete");
+        QTimer::singleShot(TOURNAMENT_ROUND_BREAK_MS, this, [this, tournamentId]() {
+            startTournamentRound(tournamentId);
+        });
     }
+}
 
-    // Check if either player is already in a game
-    if (isPlayerInGame(player1)) {
-        logger->error("createGame() - Player " + player1->getUsername() + " is already in a game");
-        throw std::runtime_error("Player " + player1->getUsername() + " is already in a game");
+void MPChessServer::processTournamentRequest(QTcpSocket* socket, const QJsonObject& data)
+{
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (!player) {
+        logger->error("Tournament request from unauthenticated socket");
+        
+        QJsonObject errorResponse;
+        errorResponse["type"] = static_cast<int>(MessageType::ERROR);
+        errorResponse["message"] = "You must be authenticated to take part in tournaments";
+        sendMessage(socket, errorResponse);
+        return;
     }
     
-    if (isPlayerInGame(player2)) {
-        logger->error("createGame() - Player " + player2->getUsername() + " is already in a game");
-        throw std::runtime_error("Player " + player2->getUsername() + " is already in a game");
+    QString action = data["action"].toString();
+    QJsonObject response;
+    response["type"] = static_cast<int>(MessageType::TOURNAMENT_STATUS);
+    response["action"] = action;
+    
+    if (action == "list") {
+        QJsonArray list;
+        for (const auto& [tournamentId, tournament] : tournaments) {
+            list.append(tournament->toJson(false));
+        }
+        response["success"] = true;
+        response["tournaments"] = list;
+        sendMessage(socket, response);
+        return;
     }
     
-    logger->debug("createGame() - Creating game between " + player1->getUsername() + " and " + player2->getUsername());
+    std::string tournamentId = data["tournamentId"].toString().toStdString();
+    auto it = tournaments.find(tournamentId);
+    if (it == tournaments.end()) {
+        response["success"] = false;
+        response["message"] = "Tournament not found";
+        sendMessage(socket, response);
+        return;
+    }
+    ChessTournament* tournament = it->second.get();
     
-    try {
-        // Generate a unique game ID
-        std::string gameId = QUuid::createUuid().toString(QUuid::WithoutBraces).toStdString();
-        logger->debug("createGame() - Generated game ID: " + gameId);
+    if (action == "join") {
+        if (tournament->addPlayer(player->getUsername(), player->getRating())) {
+            response["success"] = true;
+            response["message"] = tournament->hasStarted() ? "You will be paired from the next round"
+                                                           : "You have joined the tournament";
+            logger->log("Player " + player->getUsername() + " joined tournament " + tournamentId);
+        } else {
+            response["success"] = false;
+            response["message"] = tournament->hasPlayer(player->getUsername()) ? "You are already in this tournament"
+                                                                               : "The tournament is closed";
+        }
+    } else if (action == "leave") {
+        response["success"] = tournament->withdrawPlayer(player->getUsername());
+        if (response["success"].toBool()) {
+            response["message"] = "You have left the tournament";
+            logger->log("Player " + player->getUsername() + " left tournament " + tournamentId);
+        } else {
+            response["message"] = "You are not in this tournament";
+        }
+    } else if (action == "status") {
+        response["success"] = true;
+    } else {
+        response["success"] = false;
+        response["message"] = "Unknown tournament action";
+        sendMessage(socket, response);
+        return;
+    }
+    
+    response["tournament"] = tournament->toJson();
+    sendMessage(socket, response);
+}
+
+void MPChessServer::processGameHistoryRequest(QTcpSocket* socket, const QJsonObject& data) {
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (!player) {
+        logger->error("Game history request from unauthenticated socket");
+        return;
+    }
+    
+    QJsonObject response;
+    response["type"] = static_cast<int>(MessageType::GAME_HISTORY_RESPONSE);
+    
+    if (data.contains("gameId")) {
+        // Request for a specific game
+        std::string gameId = data["gameId"].toString().toStdString();
         
-        // Randomly assign colors
-        bool player1IsWhite = QRandomGenerator::global()->bounded(2) == 0;
-        ChessPlayer* whitePlayer = player1IsWhite ? player1 : player2;
-        ChessPlayer* blackPlayer = player1IsWhite ? player2 : player1;
+        // Check if the game is active
+        auto it = activeGames.find(gameId);
+        if (it != activeGames.end()) {
+            // Game is active
+            response["success"] = true;
+            response["gameHistory"] = it->second->getGameHistoryJson();
+        } else {
+            // Try to load the game from the history store
+            QJsonObject gameObj;
+            if (historyStore->loadGame(gameId, gameObj)) {
+                response["success"] = true;
+                response["gameHistory"] = gameObj;
+            } else {
+                response["success"] = false;
+                response["message"] = historyStore->contains(gameId) ? "Failed to read game history" : "Game not found";
+            }
+        }
+    } else {
+        // Request for a page of the player's games, newest first. Only headers are sent;
+        // the client asks for a gameId to get the moves
+        QJsonArray gameHistories;
+        quint64 cursor = static_cast<quint64>(data["cursor"].toDouble());
+        int limit = std::clamp(data["limit"].toInt(50), 1, 200);
         
-        logger->debug("createGame() - Assigned colors: " + whitePlayer->getUsername() + " (White), " + 
-                     blackPlayer->getUsername() + " (Black)");
+        // Games still in progress lead the first page
+        if (cursor == 0) {
+            for (auto it = activeGames.begin(); it != activeGames.end(); ++it) {
+                ChessGame* game = it->second.get();
+                ChessPlayer* whitePlayer = game->getWhitePlayer();
+                ChessPlayer* blackPlayer = game->getBlackPlayer();
+                
+                // Only include games that the player is part of
+                if (game->isOver() || (whitePlayer != player && blackPlayer != player)) {
+                    continue;
+                }
+                
+                QJsonObject gameObj;
+                gameObj["gameId"] = QString::fromStdString(game->getGameId());
+                gameObj["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
+                gameObj["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
+                gameObj["opponent"] = QString::fromStdString(whitePlayer == player ? blackPlayer->getUsername()
+                                                                                   : whitePlayer->getUsername());
+                gameObj["result"] = "in_progress";
+                gameObj["active"] = true;
+                gameObj["whiteRating"] = whitePlayer->getRating();
+                gameObj["blackRating"] = blackPlayer->getRating();
+                gameObj["moves"] = static_cast<int>(game->getBoard()->getMoveHistory().size());
+                
+                gameHistories.append(gameObj);
+            }
+        }
         
-        // Set player colors before creating the game
-        whitePlayer->setColor(PieceColor::WHITE);
-        blackPlayer->setColor(PieceColor::BLACK);
+        // Past games come from the summary table; no game records are read
+        quint64 nextCursor = 0;
+        std::vector<GameHistoryStore::GameSummary> page =
+            historyStore->getPlayerGames(player->getUsername(), cursor, limit, nextCursor);
+        for (const GameHistoryStore::GameSummary& summary : page) {
+            QJsonObject summaryObj;
+            summaryObj["gameId"] = QString::fromStdString(summary.gameId);
+            summaryObj["whitePlayer"] = QString::fromStdString(summary.whitePlayer);
+            summaryObj["blackPlayer"] = QString::fromStdString(summary.blackPlayer);
+            summaryObj["opponent"] = QString::fromStdString(summary.whitePlayer == player->getUsername() ? summary.blackPlayer
+                                                                                                         : summary.whitePlayer);
+            summaryObj["result"] = QString::fromStdString(summary.result);
+            summaryObj["active"] = false;
+            if (summary.startTime > 0) {
+                summaryObj["startTime"] = QDateTime::fromMSecsSinceEpoch(summary.startTime).toString(Qt::ISODate);
+            }
+            if (summary.endTime > 0) {
+                summaryObj["endTime"] = QDateTime::fromMSecsSinceEpoch(summary.endTime).toString(Qt::ISODate);
+            }
+            if (summary.whiteRating > 0) {
+                summaryObj["whiteRating"] = summary.whiteRating;
+            }
+            if (summary.blackRating > 0) {
+                summaryObj["blackRating"] = summary.blackRating;
+            }
+            summaryObj["moves"] = summary.moveCount;
+            
+            gameHistories.append(summaryObj);
+        }
         
-        // Create the game with try-catch
-        std::unique_ptr<ChessGame> game;
-        try {
-            logger->debug("createGame() - Constructing ChessGame object for game " + gameId);
-            game = std::make_unique<ChessGame>(whitePlayer, blackPlayer, gameId, timeControl);
-            logger->debug("createGame() - ChessGame object created successfully for game " + gameId);
-        } catch (const std::exception& e) {
-            logger->error("createGame() - Exception creating ChessGame for game " + gameId + ": " + std::string(e.what()));
-            throw;
-        } catch (...) {
-            logger->error("createGame() - Unknown exception creating ChessGame for game " + gameId);
-            throw std::runtime_error("Unknown error creating game");
+        // Echo the cursor so the client can tell a continuation from a fresh list
+        if (cursor != 0) {
+            response["cursor"] = static_cast<qint64>(cursor);
         }
         
-        // Start the game with try-catch
-        try {
-            logger->debug("createGame() - Starting game " + gameId);
-            game->start();
-            logger->debug("createGame() - Game " + gameId + " started successfully");
-        } catch (const std::exception& e) {
-            logger->error("createGame() - Exception starting game " + gameId + ": " + std::string(e.what()));
-            throw;
-        } catch (...) {
-            logger->error("createGame() - Unknown exception starting game " + gameId);
-            throw std::runtime_error("Unknown error starting game");
+        // More games remain; the client passes this back as the cursor
+        if (nextCursor != 0) {
+            response["nextCursor"] = static_cast<qint64>(nextCursor);
         }
         
-        // Store the game
-        logger->debug("createGame() - Storing game " + gameId + " in active games map");
-        activeGames[gameId] = std::move(game);
-        playerToGameId[whitePlayer] = gameId;
-        playerToGameId[blackPlayer] = gameId;
+        response["success"] = true;
+        response["gameHistories"] = gameHistories;
+    }
+    
+    sendMessage(socket, response);
+}
+
+void MPChessServer::processGameAnalysisRequest(QTcpSocket* socket, const QJsonObject& data) {
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (!player) {
+        logger->error("Game analysis request from unauthenticated socket");
+        return;
+    }
+    
+    QJsonObject response;
+    response["type"] = static_cast<int>(MessageType::GAME_ANALYSIS_RESPONSE);
+    
+    std::string gameId = data["gameId"].toString().toStdString();
+    response["gameId"] = QString::fromStdString(gameId);
+    
+    // The analysis itself runs on the ANALYSIS lane, on a serialized copy of the game
+    QJsonObject gameObj;
+    bool finished = false;
+    
+    // Check if the game is active
+    auto it = activeGames.find(gameId);
+    if (it != activeGames.end()) {
+        // Game is active
+        ChessGame* game = it->second.get();
         
-        // Send game start message to both players
-        logger->debug("createGame() - Preparing game start messages for game " + gameId);
+        // Only allow analysis if the game is over or the player is part of the game
+        ChessPlayer* whitePlayer = game->getWhitePlayer();
+        ChessPlayer* blackPlayer = game->getBlackPlayer();
         
-        // White player message
-        QJsonObject whiteMessage;
-        whiteMessage["type"] = static_cast<int>(MessageType::GAME_START);
-        whiteMessage["gameId"] = QString::fromStdString(gameId);
-        whiteMessage["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
-        whiteMessage["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
-        whiteMessage["yourColor"] = "white";
-        whiteMessage["boardOrientation"] = "standard"; // White pieces at bottom
-        whiteMessage["timeControl"] = [timeControl]() -> QString {
-            switch (timeControl) {
-                case TimeControlType::RAPID: return "rapid";
-                case TimeControlType::BLITZ: return "blitz";
-                case TimeControlType::BULLET: return "bullet";
-                case TimeControlType::CLASSICAL: return "classical";
-                case TimeControlType::CASUAL: return "casual";
-                default: return "rapid";
+        if (game->isOver() || whitePlayer == player || blackPlayer == player) {
+            gameObj = game->serialize();
+            finished = game->isOver();
+        } else {
+            response["success"] = false;
+            response["message"] = "You are not allowed to analyze this game";
+            sendMessage(socket, response);
+            return;
+        }
+    } else {
+        // Try to load the game from the history store
+        if (historyStore->loadGame(gameId, gameObj)) {
+            // Check if the player was part of the game
+            QString whitePlayer = gameObj["whitePlayer"].toString();
+            QString blackPlayer = gameObj["blackPlayer"].toString();
+            finished = gameObj["result"].toString() != "in_progress";
+            
+            if (!(whitePlayer == QString::fromStdString(player->getUsername()) ||
+                  blackPlayer == QString::fromStdString(player->getUsername()) ||
+                  finished)) {
+                response["success"] = false;
+                response["message"] = "You are not allowed to analyze this game";
+                sendMessage(socket, response);
+                return;
             }
-        }();
-        
-        // Black player message
-        QJsonObject blackMessage;
-        blackMessage["type"] = static_cast<int>(MessageType::GAME_START);
-        blackMessage["gameId"] = QString::fromStdString(gameId);
-        blackMessage["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
-        blackMessage["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
-        blackMessage["yourColor"] = "black";
-        blackMessage["boardOrientation"] = "flipped"; // Black pieces at bottom
-        blackMessage["timeControl"] = whiteMessage["timeControl"];
-        
-        if (whitePlayer->getSocket()) {
-            logger->debug("createGame() - Sending game start message to white player: " + whitePlayer->getUsername());
-            sendMessage(whitePlayer->getSocket(), whiteMessage);
         } else {
-            logger->warning("createGame() - White player has no socket: " + whitePlayer->getUsername());
+            response["success"] = false;
+            response["message"] = "Game not found";
+            sendMessage(socket, response);
+            return;
+        }
+    }
+    
+    // A finished game never changes, so its saved analysis is still current
+    QJsonObject cached;
+    if (finished && historyStore->loadAnalysis(gameId, cached)) {
+        MPCHESS_DEBUG(logger, "Serving saved analysis for game " + gameId);
+        response["success"] = true;
+        response["analysis"] = cached;
+        sendMessage(socket, response);
+        return;
+    }
+    
+    startGameAnalysis(gameId, gameObj, socket);
+}
+
+void MPChessServer::startGameAnalysis(const std::string& gameId, const QJsonObject& gameJson, QTcpSocket* socket)
+{
+    // Join the analysis already running for this game
+    auto waiting = analysisWaiters.find(gameId);
+    if (waiting != analysisWaiters.end()) {
+        if (!waiting->contains(socket)) {
+            waiting->append(socket);
         }
+        return;
+    }
+    analysisWaiters[gameId] = QList<QTcpSocket*>() << socket;
+    
+    bool finished = gameJson["result"].toString() != "in_progress";
+    logger->log("Starting analysis of game " + gameId);
+    
+    GameAnalysisTask* task = new GameAnalysisTask(gameJson);
+    
+    connect(task, &GameAnalysisTask::progress, this, [this, gameId](int completed, int total) {
+        QJsonObject progressMessage;
+        progressMessage["type"] = static_cast<int>(MessageType::GAME_ANALYSIS_PROGRESS);
+        progressMessage["gameId"] = QString::fromStdString(gameId);
+        progressMessage["completed"] = completed;
+        progressMessage["total"] = total;
         
-        if (blackPlayer->getSocket()) {
-            logger->debug("createGame() - Sending game start message to black player: " + blackPlayer->getUsername());
-            sendMessage(blackPlayer->getSocket(), blackMessage);
-        } else {
-            logger->warning("createGame() - Black player has no socket: " + blackPlayer->getUsername());
+        for (QTcpSocket* waiter : analysisWaiters.value(gameId)) {
+            sendMessage(waiter, progressMessage);
         }
+    });
+    
+    connect(task, &GameAnalysisTask::analysisReady, this, [this, gameId, finished](const QJsonObject& analysis) {
+        QList<QTcpSocket*> waiters = analysisWaiters.take(gameId);
         
-        // Send initial game state to both players
-        sendGameStateToPlayers(gameId);
+        QJsonObject response;
+        response["type"] = static_cast<int>(MessageType::GAME_ANALYSIS_RESPONSE);
+        response["gameId"] = QString::fromStdString(gameId);
         
-        // Send move recommendations to white player (first to move) asynchronously
-        if (whitePlayer->getSocket()) {
-            try {
-                logger->debug("createGame() - Scheduling async move recommendations for white player in game " + gameId);
-                generateMoveRecommendationsAsync(gameId, whitePlayer);
-            } catch (const std::exception& e) {
-                logger->error("createGame() - Exception scheduling move recommendations for game " + gameId + ": " + std::string(e.what()));
-                // Continue despite error in recommendations
+        if (analysis.isEmpty()) {
+            logger->error("Analysis of game " + gameId + " failed");
+            response["success"] = false;
+            response["message"] = "Failed to load game for analysis";
+        } else {
+            logger->log("Finished analysis of game " + gameId);
+            response["success"] = true;
+            response["analysis"] = analysis;
+            
+            if (finished && !historyStore->saveAnalysis(gameId, analysis)) {
+                MPCHESS_DEBUG(logger, "Analysis of game " + gameId + " not saved; the game is not in the history store");
             }
         }
         
-        // Log the game creation
-        logger->log("Created game " + gameId + ": " + whitePlayer->getUsername() + 
-                   " (White) vs " + blackPlayer->getUsername() + " (Black)");
-        
-        // Increment total games played
-        totalGamesPlayed++;
-
-        // Make sure to remove players from matchmaking queue if they're still there
-        matchmaker->removePlayer(player1);
-        matchmaker->removePlayer(player2);
-        
-        return gameId;
-    } catch (const std::exception& e) {
-        logger->error("createGame() - Exception in createGame: " + std::string(e.what()));
-        throw;
-    } catch (...) {
-        logger->error("createGame() - Unknown exception in createGame");
-        throw std::runtime_error("Unknown error creating game");
-    }
+        for (QTcpSocket* waiter : waiters) {
+            sendMessage(waiter, response);
+        }
+    });
+    
+    startPoolTask(task, WorkLane::ANALYSIS);
 }
 
-void MPChessServer::endGame(const std::string& gameId, GameResult result) {
+void MPChessServer::processResignRequest(QTcpSocket* socket, const QJsonObject& data) {
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (!player) {
+        logger->error("Resign request from unauthenticated socket");
+        return;
+    }
+    
+    std::string gameId = data["gameId"].toString().toStdString();
+    
+    // Find the game
     auto it = activeGames.find(gameId);
     if (it == activeGames.end()) {
-        logger->error("Attempted to end non-existent game: " + gameId);
+        logger->error("Resign request for non-existent game: " + gameId);
+        
+        QJsonObject response;
+        response["type"] = static_cast<int>(MessageType::ERROR);
+        response["message"] = "Game not found";
+        sendMessage(socket, response);
         return;
     }
     
     ChessGame* game = it->second.get();
-    if (game->isOver()) {
-        return;  // Game already over
-    }
-    
-    // End the game
-    game->end(result);
     
-    // Get the players
-    ChessPlayer* whitePlayer = game->getWhitePlayer();
-    ChessPlayer* blackPlayer = game->getBlackPlayer();
+    // Handle resignation
+    game->handleResignation(player);
     
     // Send game over message to both players
-    QJsonObject message;
-    message["type"] = static_cast<int>(MessageType::GAME_OVER);
+    QJsonObject gameOverMessage;
+    gameOverMessage["type"] = static_cast<int>(MessageType::GAME_OVER);
+    gameOverMessage["result"] = (player == game->getWhitePlayer()) ? "black_win" : "white_win";
+    gameOverMessage["reason"] = "resignation";
     
-    switch (result) {
-        case GameResult::WHITE_WIN:
-            message["result"] = "white_win";
-            break;
-        case GameResult::BLACK_WIN:
-            message["result"] = "black_win";
-            break;
-        case GameResult::DRAW:
-            message["result"] = "draw";
-            break;
-        default:
-            message["result"] = "unknown";
-            break;
-    }
+    ChessPlayer* whitePlayer = game->getWhitePlayer();
+    ChessPlayer* blackPlayer = game->getBlackPlayer();
     
     if (whitePlayer->getSocket()) {
-        sendMessage(whitePlayer->getSocket(), message);
+        sendMessage(whitePlayer->getSocket(), gameOverMessage);
     }
     
     if (blackPlayer->getSocket()) {
-        sendMessage(blackPlayer->getSocket(), message);
+        sendMessage(blackPlayer->getSocket(), gameOverMessage);
     }
     
     // Update ratings
@@ -6967,414 +13288,178 @@ void MPChessServer::endGame(const std::string& gameId, GameResult result) {
     // Save game history
     saveGameHistory(*game);
     
-    // Clean up
-    playerToGameId.remove(whitePlayer);
-    playerToGameId.remove(blackPlayer);
-    
-    // Log the game end
-    logger->log("Game " + gameId + " ended with result: " + message["result"].toString().toStdString());
-}
-
-void MPChessServer::processAuthRequest(QTcpSocket* socket, const QJsonObject& data) {
-    std::string username = data["username"].toString().toStdString();
-    std::string password = data["password"].toString().toStdString();
-    bool isRegistration = data["register"].toBool();
-    
-    QJsonObject response;
-    response["type"] = static_cast<int>(MessageType::AUTHENTICATION_RESULT);
-    
-    if (isRegistration) {
-        // Registration
-        if (authenticator->registerPlayer(username, password)) {
-            response["success"] = true;
-            response["message"] = "Registration successful";
-            
-            // Create a new player
-            ChessPlayer* player = new ChessPlayer(username, socket);
-            socketToPlayer[socket] = player;
-            usernamesToPlayers[username] = player;
-            
-            // Increment total players registered
-            totalPlayersRegistered++;
-            
-            // Update peak concurrent players
-            peakConcurrentPlayers = std::max(peakConcurrentPlayers, getConnectedClientCount());
-            
-            logger->log("Player registered: " + username);
-        } else {
-            response["success"] = false;
-            response["message"] = "Username already exists";
-            logger->warning("Registration failed for username: " + username);
-        }
-    } else {
-        // Authentication
-        if (authenticator->authenticatePlayer(username, password)) {
-            response["success"] = true;
-            response["message"] = "Authentication successful";
-            
-            // Check if the player is already logged in
-            if (usernamesToPlayers.contains(username)) {
-                // Disconnect the old socket
-                ChessPlayer* existingPlayer = usernamesToPlayers[username];
-                QTcpSocket* oldSocket = existingPlayer->getSocket();
-                
-                if (oldSocket && oldSocket != socket) {
-                    // Send a message to the old socket
-                    QJsonObject disconnectMessage;
-                    disconnectMessage["type"] = static_cast<int>(MessageType::ERROR);
-                    disconnectMessage["message"] = "You have been logged in from another location";
-                    sendMessage(oldSocket, disconnectMessage);
-                    
-                    // Disconnect the old socket
-                    oldSocket->disconnectFromHost();
-                }
-                
-                // Update the player's socket
-                existingPlayer->setSocket(socket);
-                socketToPlayer[socket] = existingPlayer;
-                
-                logger->log("Player reconnected: " + username);
-            } else {
-                // Load the player data
-                std::unique_ptr<ChessPlayer> playerData = authenticator->getPlayer(username);
-                if (playerData) {
-                    ChessPlayer* player = new ChessPlayer(*playerData);
-                    player->setSocket(socket);
-                    socketToPlayer[socket] = player;
-                    usernamesToPlayers[username] = player;
-                } else {
-                    // Create a new player if data not found
-                    ChessPlayer* player = new ChessPlayer(username, socket);
-                    socketToPlayer[socket] = player;
-                    usernamesToPlayers[username] = player;
-                }
-                
-                logger->log("Player authenticated: " + username);
-            }
-            
-            // Update peak concurrent players
-            peakConcurrentPlayers = std::max(peakConcurrentPlayers, getConnectedClientCount());
-        } else {
-            response["success"] = false;
-            response["message"] = "Invalid username or password";
-            logger->warning("Authentication failed for username: " + username);
-        }
-    }
-    
-    sendMessage(socket, response);
+    // Spectators see the result in the final snapshot
+    sendGameStateToSpectators(gameId);
+    
+    // Log the resignation
+    logger->log("Player " + player->getUsername() + " resigned in game " + gameId);
 }
 
-/*
-void MPChessServer::processMoveRequest(QTcpSocket* socket, const QJsonObject& data)
-{
+void MPChessServer::processGameStateRequest(QTcpSocket* socket, const QJsonObject& data) {
     ChessPlayer* player = socketToPlayer.value(socket, nullptr);
     if (!player) {
-        logger->error("Move request from unauthenticated socket");
+        logger->error("Game state request from unauthenticated socket");
         return;
     }
     
     std::string gameId = data["gameId"].toString().toStdString();
-    std::string moveStr = data["move"].toString().toStdString();
     
     // Find the game
     auto it = activeGames.find(gameId);
-    if (it == activeGames.end()) {
-        logger->error("Move request for non-existent game: " + gameId);
+    if (it == activeGames.end() ||
+        (it->second->getWhitePlayer() != player && it->second->getBlackPlayer() != player)) {
+        logger->warning("Game state request for unknown game " + gameId + " from " + player->getUsername());
         
         QJsonObject response;
-        response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
-        response["success"] = false;
+        response["type"] = static_cast<int>(MessageType::ERROR);
         response["message"] = "Game not found";
         sendMessage(socket, response);
         return;
     }
     
-    ChessGame* game = it->second.get();
-    
-    // Parse the move
-    ChessMove move = ChessMove::fromAlgebraic(moveStr);
-    
-    // Process the move
-    MoveValidationStatus status = game->processMove(player, move);
-    
-    // Prepare response
-    QJsonObject response;
-    response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
-    
-    switch (status) {
-        case MoveValidationStatus::VALID:
-            response["success"] = true;
-            
-            // Increment total moves played
-            totalMovesPlayed++;
-            
-            // Send updated game state to both players
-            {
-                QJsonObject gameStateMessage;
-                gameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
-                gameStateMessage["gameState"] = game->getGameStateJson();
-                
-                ChessPlayer* whitePlayer = game->getWhitePlayer();
-                ChessPlayer* blackPlayer = game->getBlackPlayer();
-                
-                if (whitePlayer->getSocket()) {
-                    sendMessage(whitePlayer->getSocket(), gameStateMessage);
-                }
-                
-                if (blackPlayer->getSocket()) {
-                    sendMessage(blackPlayer->getSocket(), gameStateMessage);
-                }
-                
-/ *
-                // Send move recommendations to the next player
-                ChessPlayer* nextPlayer = game->getCurrentPlayer();
-                if (nextPlayer && nextPlayer->getSocket() && !game->isOver()) {
-                    std::vector<std::pair<ChessMove, double>> recommendations = 
-                        game->getMoveRecommendations(nextPlayer);
-                    
-                    QJsonObject recommendationsMessage;
-                    recommendationsMessage["type"] = static_cast<int>(MessageType::MOVE_RECOMMENDATIONS);
-                    
-                    QJsonArray recommendationsArray;
-                    for (const auto& [recMove, evaluation] : recommendations) {
-                        QJsonObject recObj;
-                        recObj["move"] = QString::fromStdString(recMove.toAlgebraic());
-                        recObj["evaluation"] = evaluation;
-                        recObj["standardNotation"] = QString::fromStdString(
-                            recMove.toStandardNotation(*game->getBoard()));
-                        recommendationsArray.append(recObj);
-                    }
-                    
-                    recommendationsMessage["recommendations"] = recommendationsArray;
-                    sendMessage(nextPlayer->getSocket(), recommendationsMessage);
-                }
-* /
-
-                // Send move recommendations to the next player asynchronously
-                ChessPlayer* nextPlayer = game->getCurrentPlayer();
-                if (nextPlayer && nextPlayer->getSocket() && !game->isOver()) {
-                    try {
-                        generateMoveRecommendationsAsync(gameId, nextPlayer);
-                    } catch (const std::exception& e) {
-                        logger->error("processMoveRequest() - Exception scheduling move recommendations: " + std::string(e.what()));
-                    }
-                }
-
-                // If the game is over, update ratings and save history
-                if (game->isOver()) {
-                    updatePlayerRatings(game);
-                    saveGameHistory(*game);
-                }
-            }
-            break;
-            
-        case MoveValidationStatus::INVALID_PIECE:
-            response["success"] = false;
-            response["message"] = "No piece at the source position";
-            break;
-            
-        case MoveValidationStatus::INVALID_DESTINATION:
-            response["success"] = false;
-            response["message"] = "Invalid destination";
-            break;
-            
-        case MoveValidationStatus::INVALID_PATH:
-            response["success"] = false;
-            response["message"] = "Invalid move for this piece";
-            break;
-            
-        case MoveValidationStatus::KING_IN_CHECK:
-            response["success"] = false;
-            response["message"] = "Move would leave your king in check";
-            break;
-            
-        case MoveValidationStatus::WRONG_TURN:
-            response["success"] = false;
-            response["message"] = "It's not your turn";
-            break;
-            
-        case MoveValidationStatus::GAME_OVER:
-            response["success"] = false;
-            response["message"] = "The game is already over";
-            break;
-            
-        default:
-            response["success"] = false;
-            response["message"] = "Unknown error";
-            break;
-    }
-    
-    sendMessage(socket, response);
+    // A full snapshot carries the current sequence, so later deltas apply on top of it
+    sendMessage(socket, it->second->getEncodedGameState(getBoardOrientationForPlayer(player, gameId),
+                                                        binaryProtocolSockets.contains(socket)));
     
-    // Log the move
-    if (status == MoveValidationStatus::VALID) {
-        logger->log("Player " + player->getUsername() + " made move " + moveStr + 
-                   " in game " + gameId);
-    } else {
-        logger->warning("Player " + player->getUsername() + " attempted invalid move " + 
-                       moveStr + " in game " + gameId + ": " + response["message"].toString().toStdString());
-    }
+    MPCHESS_DEBUG(logger, "Sent game state snapshot of game " + gameId + " to " + player->getUsername() +
+                  " at sequence " + std::to_string(it->second->getStateSequence()));
 }
-*/
 
-/*
-void MPChessServer::processMoveRequest(QTcpSocket* socket, const QJsonObject& data)
-{
+void MPChessServer::processSpectateRequest(QTcpSocket* socket, const QJsonObject& data) {
     ChessPlayer* player = socketToPlayer.value(socket, nullptr);
     if (!player) {
-        logger->error("Move request from unauthenticated socket");
+        logger->error("Spectate request from unauthenticated socket");
+        return;
+    }
+    
+    // A socket watches one game at a time
+    removeSpectator(socket);
+    
+    if (data["stop"].toBool()) {
+        logger->log("Player " + player->getUsername() + " stopped spectating");
         return;
     }
     
     std::string gameId = data["gameId"].toString().toStdString();
-    std::string moveStr = data["move"].toString().toStdString();
     
     // Find the game
     auto it = activeGames.find(gameId);
     if (it == activeGames.end()) {
-        logger->error("Move request for non-existent game: " + gameId);
+        logger->error("Spectate request for non-existent game: " + gameId);
         
         QJsonObject response;
-        response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
-        response["success"] = false;
-        response["message"] = "Game not found";
-        sendMessage(socket, response);
-        return;
-    }
-    
-    ChessGame* game = it->second.get();
-    
-    // Parse the move
-    ChessMove move = ChessMove::fromAlgebraic(moveStr);
-    
-    // Process the move
-    MoveValidationStatus status = game->processMove(player, move);
-    
-    // Prepare response
-    QJsonObject response;
-    response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
-    
-    switch (status) {
-        case MoveValidationStatus::VALID:
-            response["success"] = true;
-            
-            // Increment total moves played
-            totalMovesPlayed++;
-            
-            // Send updated game state to both players with proper orientation
-            {
-                ChessPlayer* whitePlayer = game->getWhitePlayer();
-                ChessPlayer* blackPlayer = game->getBlackPlayer();
-                
-                // Get the base game state
-                QJsonObject baseGameState = game->getGameStateJson();
-                
-                // Create white player's game state message
-                QJsonObject whiteGameStateMessage;
-                whiteGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
-                whiteGameStateMessage["gameState"] = baseGameState;
-                whiteGameStateMessage["gameState"].toObject()["boardOrientation"] = "standard";
-                
-                // Create black player's game state message
-                QJsonObject blackGameStateMessage;
-                blackGameStateMessage["type"] = static_cast<int>(MessageType::GAME_STATE);
-                blackGameStateMessage["gameState"] = baseGameState;
-                blackGameStateMessage["gameState"].toObject()["boardOrientation"] = "flipped";
-                
-                if (whitePlayer->getSocket()) {
-                    sendMessage(whitePlayer->getSocket(), whiteGameStateMessage);
-                }
-                
-                if (blackPlayer->getSocket()) {
-                    sendMessage(blackPlayer->getSocket(), blackGameStateMessage);
-                }
-                
-                // Send move recommendations to the next player asynchronously
-                ChessPlayer* nextPlayer = game->getCurrentPlayer();
-                if (nextPlayer && nextPlayer->getSocket() && !game->isOver()) {
-                    try {
-                        generateMoveRecommendationsAsync(gameId, nextPlayer);
-                    } catch (const std::exception& e) {
-                        logger->error("processMoveRequest() - Exception scheduling move recommendations: " + std::string(e.what()));
-                    }
-                }
-
-                // If the game is over, update ratings and save history
-                if (game->isOver()) {
-                    updatePlayerRatings(game);
-                    saveGameHistory(*game);
-                }
-            }
-            break;
-            
-        case MoveValidationStatus::INVALID_PIECE:
-            response["success"] = false;
-            response["message"] = "No piece at the source position";
-            break;
-            
-        case MoveValidationStatus::INVALID_DESTINATION:
-            response["success"] = false;
-            response["message"] = "Invalid destination";
-            break;
-            
-        case MoveValidationStatus::INVALID_PATH:
-            response["success"] = false;
-            response["message"] = "Invalid move for this piece";
-            break;
-            
-        case MoveValidationStatus::KING_IN_CHECK:
-            response["success"] = false;
-            response["message"] = "Move would leave your king in check";
-            break;
-            
-        case MoveValidationStatus::WRONG_TURN:
-            response["success"] = false;
-            response["message"] = "It's not your turn";
-            break;
-            
-        case MoveValidationStatus::GAME_OVER:
-            response["success"] = false;
-            response["message"] = "The game is already over";
-            break;
-            
-        default:
-            response["success"] = false;
-            response["message"] = "Unknown error";
-            break;
+        response["type"] = static_cast<int>(MessageType::ERROR);
+        response["message"] = "Game not found";
+        sendMessage(socket, response);
+        return;
     }
     
-    sendMessage(socket, response);
+    gameSpectators[gameId].insert(socket);
+    spectatorToGameId[socket] = gameId;
     
-    // Log the move
-    if (status == MoveValidationStatus::VALID) {
-        logger->log("Player " + player->getUsername() + " made move " + moveStr + 
-                   " in game " + gameId);
+    // Runs on the socket's thread; only a lagging spectator that has drained comes back here
+    spectatorDrainConnections[socket] = connect(socket, &QTcpSocket::bytesWritten, socket, [this, socket]() {
+        if (socket->property("spectatorLagging").toBool() && socket->bytesToWrite() <= SPECTATOR_BACKLOG_LIMIT) {
+            socket->setProperty("spectatorLagging", false);
+            QMetaObject::invokeMethod(this, [this, socket]() { catchUpSpectator(socket); }, Qt::QueuedConnection);
+        }
+    });
+    
+    // Start the spectator off with the current snapshot
+    sendSpectatorSnapshot(socket, it->second->getEncodedGameState("standard", binaryProtocolSockets.contains(socket)));
+    
+    logger->log("Player " + player->getUsername() + " is spectating game " + gameId + " (" +
+                std::to_string(gameSpectators[gameId].size()) + " spectator(s))");
+}
+
+void MPChessServer::removeSpectator(QTcpSocket* socket) {
+    auto it = spectatorToGameId.find(socket);
+    if (it == spectatorToGameId.end()) {
+        return;
+    }
+    
+    std::string gameId = it.value();
+    spectatorToGameId.erase(it);
+    disconnect(spectatorDrainConnections.take(socket));
+    
+    auto spectatorsIt = gameSpectators.find(gameId);
+    if (spectatorsIt != gameSpectators.end()) {
+        spectatorsIt->second.remove(socket);
+        if (spectatorsIt->second.isEmpty()) {
+            gameSpectators.erase(spectatorsIt);
+        }
+    }
+}
+
+void MPChessServer::processDrawOfferRequest(QTcpSocket* socket, const QJsonObject& data) {
+    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+    if (!player) {
+        logger->error("Draw offer request from unauthenticated socket");
+        return;
+    }
+    
+    std::string gameId = data["gameId"].toString().toStdString();
+    
+    // Find the game
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end()) {
+        logger->error("Draw offer request for non-existent game: " + gameId);
+        
+        QJsonObject response;
+        response["type"] = static_cast<int>(MessageType::ERROR);
+        response["message"] = "Game not found";
+        sendMessage(socket, response);
+        return;
+    }
+    
+    ChessGame* game = it->second.get();
+    
+    // Handle draw offer
+    if (game->handleDrawOffer(player)) {
+        // Send draw offer message to the opponent
+        QJsonObject drawOfferMessage;
+        drawOfferMessage["type"] = static_cast<int>(MessageType::DRAW_OFFER);
+        drawOfferMessage["offeredBy"] = QString::fromStdString(player->getUsername());
+        
+        ChessPlayer* opponent = game->getOpponentPlayer(player);
+        if (opponent->getSocket()) {
+            sendMessage(opponent->getSocket(), drawOfferMessage);
+        }
+        
+        // Send confirmation to the offering player
+        QJsonObject confirmationMessage;
+        confirmationMessage["type"] = static_cast<int>(MessageType::DRAW_OFFER);
+        confirmationMessage["status"] = "sent";
+        sendMessage(socket, confirmationMessage);
+        
+        // Log the draw offer
+        logger->log("Player " + player->getUsername() + " offered a draw in game " + gameId);
     } else {
-        logger->warning("Player " + player->getUsername() + " attempted invalid move " + 
-                       moveStr + " in game " + gameId + ": " + response["message"].toString().toStdString());
+        // Send error message
+        QJsonObject errorMessage;
+        errorMessage["type"] = static_cast<int>(MessageType::ERROR);
+        errorMessage["message"] = "Cannot offer draw at this time";
+        sendMessage(socket, errorMessage);
     }
 }
-*/
 
-void MPChessServer::processMoveRequest(QTcpSocket* socket, const QJsonObject& data)
-{
+void MPChessServer::processDrawResponseRequest(QTcpSocket* socket, const QJsonObject& data) {
     ChessPlayer* player = socketToPlayer.value(socket, nullptr);
     if (!player) {
-        logger->error("Move request from unauthenticated socket");
+        logger->error("Draw response request from unauthenticated socket");
         return;
     }
     
     std::string gameId = data["gameId"].toString().toStdString();
-    std::string moveStr = data["move"].toString().toStdString();
+    bool accepted = data["accepted"].toBool();
     
     // Find the game
     auto it = activeGames.find(gameId);
     if (it == activeGames.end()) {
-        logger->error("Move request for non-existent game: " + gameId);
+        logger->error("Draw response request for non-existent game: " + gameId);
         
         QJsonObject response;
-        response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
-        response["success"] = false;
+        response["type"] = static_cast<int>(MessageType::ERROR);
         response["message"] = "Game not found";
         sendMessage(socket, response);
         return;
@@ -7382,1698 +13467,2790 @@ void MPChessServer::processMoveRequest(QTcpSocket* socket, const QJsonObject& da
     
     ChessGame* game = it->second.get();
     
-    // Parse the move
-    ChessMove move = ChessMove::fromAlgebraic(moveStr);
+    // Handle draw response
+    game->handleDrawResponse(player, accepted);
     
-    // Process the move
-    MoveValidationStatus status = game->processMove(player, move);
+    if (accepted) {
+        // Send game over message to both players
+        QJsonObject gameOverMessage;
+        gameOverMessage["type"] = static_cast<int>(MessageType::GAME_OVER);
+        gameOverMessage["result"] = "draw";
+        gameOverMessage["reason"] = "agreement";
+        
+        ChessPlayer* whitePlayer = game->getWhitePlayer();
+        ChessPlayer* blackPlayer = game->getBlackPlayer();
+        
+        if (whitePlayer->getSocket()) {
+            sendMessage(whitePlayer->getSocket(), gameOverMessage);
+        }
+        
+        if (blackPlayer->getSocket()) {
+            sendMessage(blackPlayer->getSocket(), gameOverMessage);
+        }
+        
+        // Update ratings
+        updatePlayerRatings(game);
+        
+        // Save game history
+        saveGameHistory(*game);
+        
+        // Spectators see the result in the final snapshot
+        sendGameStateToSpectators(gameId);
+        
+        // Log the draw agreement
+        logger->log("Draw agreed in game " + gameId);
+    } else {
+        // Send draw declined message to the offering player
+        QJsonObject declinedMessage;
+        declinedMessage["type"] = static_cast<int>(MessageType::DRAW_RESPONSE);
+        declinedMessage["accepted"] = false;
+        
+        ChessPlayer* opponent = game->getOpponentPlayer(player);
+        if (opponent->getSocket()) {
+            sendMessage(opponent->getSocket(), declinedMessage);
+        }
+        
+        // Log the draw decline
+        logger->log("Player " + player->getUsername() + " declined draw offer in game " + gameId);
+    }
+}
+
+ChessPlayer* MPChessServer::createBotPlayer(int skillLevel) {
+    // Ensure skill level is in valid range
+    skillLevel = std::min(std::max(skillLevel, 1), 10);
     
-    // Prepare response
-    QJsonObject response;
-    response["type"] = static_cast<int>(MessageType::MOVE_RESULT);
+    // Reuse a bot of this skill level that is not playing
+    std::vector<std::unique_ptr<ChessPlayer>>& bots = botPlayers[skillLevel];
+    for (const std::unique_ptr<ChessPlayer>& bot : bots) {
+        if (!isPlayerInGame(bot.get())) {
+            bot->setRating(1000 + skillLevel * 100);
+            return bot.get();
+        }
+    }
     
-    switch (status) {
-        case MoveValidationStatus::VALID:
-            response["success"] = true;
-            
-            // Increment total moves played
-            totalMovesPlayed++;
-            
-            // Send updated game state to both players
-            sendGameStateToPlayers(gameId);
-            
-            // Send move recommendations to the next player asynchronously
-            {
-                ChessPlayer* nextPlayer = game->getCurrentPlayer();
-                if (nextPlayer && nextPlayer->getSocket() && !game->isOver()) {
-                    try {
-                        generateMoveRecommendationsAsync(gameId, nextPlayer);
-                    } catch (const std::exception& e) {
-                        logger->error("processMoveRequest() - Exception scheduling move recommendations: " + std::string(e.what()));
-                    }
-                }
+    // Generate a bot username
+    std::string botUsername = "Bot_" + std::to_string(skillLevel) + "_" + std::to_string(bots.size() + 1);
+    
+    // Create the bot player
+    auto botPlayer = std::make_unique<ChessPlayer>(botUsername);
+    botPlayer->setBot(true);
+    botPlayer->setRating(1000 + skillLevel * 100);  // Simple rating based on skill level
+    
+    // Store the bot player
+    usernamesToPlayers[botUsername] = botPlayer.get();
+    bots.push_back(std::move(botPlayer));
+    
+    logger->log("Created bot player: " + botUsername + " with skill level " + std::to_string(skillLevel));
+    
+    return bots.back().get();
+}
 
-                // If the game is over, update ratings and save history
-                if (game->isOver()) {
-                    updatePlayerRatings(game);
-                    saveGameHistory(*game);
-                }
-            }
-            break;
-            
-        case MoveValidationStatus::INVALID_PIECE:
-            response["success"] = false;
-            response["message"] = "No piece at the source position";
-            break;
-            
-        case MoveValidationStatus::INVALID_DESTINATION:
-            response["success"] = false;
-            response["message"] = "Invalid destination";
-            break;
-            
-        case MoveValidationStatus::INVALID_PATH:
-            response["success"] = false;
-            response["message"] = "Invalid move for this piece";
-            break;
-            
-        case MoveValidationStatus::KING_IN_CHECK:
-            response["success"] = false;
-            response["message"] = "Move would leave your king in check";
-            break;
-            
-        case MoveValidationStatus::WRONG_TURN:
-            response["success"] = false;
-            response["message"] = "It's not your turn";
-            break;
-            
-        case MoveValidationStatus::GAME_OVER:
-            response["success"] = false;
-            response["message"] = "The game is already over";
-            break;
-            
-        default:
-            response["success"] = false;
-            response["message"] = "Unknown error";
-            break;
+void MPChessServer::retireGame(const std::string& gameId) {
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end() || !it->second->isOver()) {
+        return;
+    }
+    
+    // Spectators stop watching the finished game
+    auto spectatorsIt = gameSpectators.find(gameId);
+    if (spectatorsIt != gameSpectators.end()) {
+        QSet<QTcpSocket*> spectators = spectatorsIt->second;
+        for (QTcpSocket* socket : spectators) {
+            removeSpectator(socket);
+        }
+    }
+    
+    // Resignations and disconnections leave the players mapped to the game
+    for (auto playerIt = playerToGameId.begin(); playerIt != playerToGameId.end();) {
+        if (playerIt.value() == gameId) {
+            playerIt = playerToGameId.erase(playerIt);
+        } else {
+            ++playerIt;
+        }
+    }
+    
+    // The players' next game may be on any node
+    auto sessionsIt = clusterSessions.find(gameId);
+    if (sessionsIt != clusterSessions.end()) {
+        for (const std::string& username : sessionsIt->second) {
+            cluster->clearSession(username);
+        }
+        clusterSessions.erase(sessionsIt);
+    }
+    
+    std::unique_ptr<ChessGame> game = std::move(it->second);
+    activeGames.erase(it);
+    if (gamePool.size() < GAME_POOL_SIZE) {
+        gamePool.push_back(std::move(game));
+    }
+    
+    MPCHESS_DEBUG(logger, "retireGame() - Retired finished game " + gameId);
+}
+
+void MPChessServer::processBotMove(const std::string& gameId) {
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end()) {
+        logger->error("processBotMove() - Game not found: " + gameId);
+        return;
+    }
+    
+    ChessGame* game = it->second.get();
+    ChessPlayer* botPlayer = game->getCurrentPlayer();
+    if (!botPlayer || !botPlayer->isBot() || game->isOver() || !botSearches.insert(gameId).second) {
+        return;
+    }
+    
+    // Bots are created with a rating of 1000 plus 100 per skill level
+    int skillLevel = std::min(std::max((botPlayer->getRating() - 1000) / 100, 1), 10);
+    size_t ply = game->getBoard()->getMoveHistory().size();
+    qint64 remainingTime = game->getLiveRemainingTime(botPlayer);
+    TimeControlType timeControl = game->getTimeControl();
+    
+    // The search runs on its own copy of the board, ahead of the bots whose flags fall first
+    std::shared_ptr<ChessBoard> board(game->getBoard()->clone());
+    auto queuedAt = std::chrono::steady_clock::now();
+    startPoolTask(QRunnable::create([this, gameId, ply, board, skillLevel, remainingTime, timeControl, queuedAt]() {
+        // Time spent waiting for a thread came off the bot's clock
+        double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - queuedAt).count();
+        ServerMetrics::botMoveQueueSeconds.observe(waited);
+        qint64 timeBudget = ChessAI::computeMoveTimeBudget(
+            std::max<qint64>(0, remainingTime - static_cast<qint64>(waited * 1000)), timeControl);
+        
+        ChessAI ai(skillLevel);
+        ChessMove move = ai.getBestMove(*board, board->getCurrentTurn(), timeBudget);
+        QMetaObject::invokeMethod(this, [this, gameId, ply, move, timeBudget]() {
+            applyBotMove(gameId, ply, move, timeBudget);
+        }, Qt::QueuedConnection);
+    }), WorkLane::BOT_MOVE, game->getClockDeadline());
+}
+
+void MPChessServer::applyBotMove(const std::string& gameId, size_t ply, const ChessMove& move, qint64 timeBudget) {
+    botSearches.erase(gameId);
+    
+    // The game may have ended, or been retired, while the bot was thinking
+    auto it = activeGames.find(gameId);
+    if (it == activeGames.end() || it->second->isOver() ||
+        it->second->getBoard()->getMoveHistory().size() != ply) {
+        return;
+    }
+    
+    ChessGame* game = it->second.get();
+    ChessPlayer* botPlayer = game->getCurrentPlayer();
+    if (!botPlayer || !botPlayer->isBot()) {
+        return;
+    }
+    
+    MoveValidationStatus status = game->processMove(botPlayer, move);
+    if (status != MoveValidationStatus::VALID) {
+        logger->error("applyBotMove() - Bot " + botPlayer->getUsername() + " produced invalid move " + 
+                     move.toAlgebraic() + " in game " + gameId);
+        return;
     }
     
-    sendMessage(socket, response);
+    totalMovesPlayed++;
+    logger->log("Bot " + botPlayer->getUsername() + " made move " + move.toAlgebraic() + 
+               " in game " + gameId + " (budget " + std::to_string(timeBudget) + "ms)");
     
-    // Log the move
-    if (status == MoveValidationStatus::VALID) {
-        logger->log("Player " + player->getUsername() + " made move " + moveStr + 
-                   " in game " + gameId);
+    sendGameStateToPlayers(gameId);
+    retireRecommendations(gameId);
+    
+    if (game->isOver()) {
+        updatePlayerRatings(game);
+        saveGameHistory(*game);
     } else {
-        logger->warning("Player " + player->getUsername() + " attempted invalid move " + 
-                       moveStr + " in game " + gameId + ": " + response["message"].toString().toStdString());
+        ChessPlayer* nextPlayer = game->getCurrentPlayer();
+        if (nextPlayer && nextPlayer->getSocket()) {
+            try {
+                generateMoveRecommendationsAsync(gameId, nextPlayer);
+            } catch (const std::exception& e) {
+                logger->error("applyBotMove() - Exception scheduling move recommendations: " + std::string(e.what()));
+            }
+        }
     }
 }
 
-void MPChessServer::processMatchmakingRequest(QTcpSocket* socket, const QJsonObject& data)
-{
-    logger->debug("Processing matchmaking request");
+void MPChessServer::saveGameHistory(const ChessGame& game) {
+    std::string gameId = game.getGameId();
+    ChessPlayer* whitePlayer = game.getWhitePlayer();
+    ChessPlayer* blackPlayer = game.getBlackPlayer();
     
-    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
-    if (!player) {
-        logger->error("Matchmaking request from unauthenticated socket");
-        
-        QJsonObject errorResponse;
-        errorResponse["type"] = static_cast<int>(MessageType::ERROR);
-        errorResponse["message"] = "You must be authenticated to use matchmaking";
-        sendMessage(socket, errorResponse);
+    // The game is over; stop the recommendation searches still running for it, and
+    // recycle the game object once late requests for it have had time to arrive
+    retireRecommendations(gameId);
+    QTimer::singleShot(FINISHED_GAME_RETENTION_MS, this, [this, gameId]() {
+        retireGame(gameId);
+    });
+    
+    // A tournament game counts towards its round
+    recordTournamentGame(game);
+    
+    // Append the game to the history store, which also indexes it for both players
+    QJsonObject gameJson = game.getGameHistoryJson();
+    if (!historyStore->saveGame(gameId, whitePlayer->getUsername(), blackPlayer->getUsername(), gameJson,
+                                whitePlayer->getRating(), blackPlayer->getRating())) {
+        logger->error("Failed to save game history: " + gameId);
         return;
     }
     
-    bool join = data["join"].toBool();
-    logger->debug("Player " + player->getUsername() + (join ? " joining " : " leaving ") + "matchmaking queue");
+    // The players' data goes out with the next batch, together with their new ratings
+    queuePlayerUpdate(*whitePlayer);
+    queuePlayerUpdate(*blackPlayer);
     
-    QJsonObject response;
-    response["type"] = static_cast<int>(MessageType::MATCHMAKING_STATUS);
+    logger->log("Saved game history: " + gameId);
+}
+
+QJsonArray MPChessServer::loadAllGameHistories() {
+    QJsonArray histories;
     
-    if (join) {
-        // Check if the player is already in a game
-        if (isPlayerInGame(player)) {
-            std::string gameId = playerToGameId[player];
-            logger->warning("Player " + player->getUsername() + " tried to join matchmaking while in game " + gameId);
-            
-            response["status"] = "already_in_game";
-            response["message"] = "You are already in a game";
-            response["gameId"] = QString::fromStdString(gameId);
-            sendMessage(socket, response);
-            return;
-        }
-        
-        try {
-            // Add the player to the matchmaking queue
-            matchmaker->addPlayer(player);
-            
-            response["status"] = "queued";
-            response["message"] = "You have been added to the matchmaking queue";
-            response["queueSize"] = matchmaker->getQueueSize();
-            
-            logger->log("Player " + player->getUsername() + " joined matchmaking queue");
-        } catch (const std::exception& e) {
-            logger->error("Exception adding player to matchmaking: " + std::string(e.what()));
-            
-            response["status"] = "error";
-            response["message"] = "An error occurred while joining the matchmaking queue";
-        }
-    } else {
-        try {
-            // Remove the player from the matchmaking queue
-            matchmaker->removePlayer(player);
-            
-            response["status"] = "left";
-            response["message"] = "You have left the matchmaking queue";
-            
-            logger->log("Player " + player->getUsername() + " left matchmaking queue");
-        } catch (const std::exception& e) {
-            logger->error("Exception removing player from matchmaking: " + std::string(e.what()));
-            
-            response["status"] = "error";
-            response["message"] = "An error occurred while leaving the matchmaking queue";
-        }
+    historyStore->forEachGame([&histories](const QJsonObject& gameJson) {
+        histories.append(gameJson);
+        return true;
+    });
+    
+    return histories;
+}
+
+void MPChessServer::updatePlayerRatings(ChessGame* game) {
+    if (!game->isOver()) {
+        return;
     }
     
-    sendMessage(socket, response);
+    ChessPlayer* whitePlayer = game->getWhitePlayer();
+    ChessPlayer* blackPlayer = game->getBlackPlayer();
+    
+    // Get current ratings
+    int whiteRating = whitePlayer->getRating();
+    int blackRating = blackPlayer->getRating();
+    
+    // Calculate new ratings
+    auto [newWhiteRating, newBlackRating] = 
+        ratingSystem->calculateNewRatings(whiteRating, blackRating, game->getResult());
+    
+    // Update player ratings; the next game and matchmaking see them at once, while the
+    // leaderboard and the player files catch up with the next batch
+    whitePlayer->setRating(newWhiteRating);
+    blackPlayer->setRating(newBlackRating);
+    queuePlayerUpdate(*whitePlayer);
+    queuePlayerUpdate(*blackPlayer);
+    
+    logger->log("Updated ratings: " + whitePlayer->getUsername() + " " + 
+               std::to_string(whiteRating) + " -> " + std::to_string(newWhiteRating) + ", " +
+               blackPlayer->getUsername() + " " + std::to_string(blackRating) + 
+               " -> " + std::to_string(newBlackRating));
 }
 
-void MPChessServer::processGameHistoryRequest(QTcpSocket* socket, const QJsonObject& data) {
+void MPChessServer::queuePlayerUpdate(const ChessPlayer& player) {
+    // A later record of the same player replaces the queued one
+    pendingPlayerUpdates.insert_or_assign(player.getUsername(), player);
+    
+    if (pendingPlayerUpdates.size() >= PLAYER_UPDATE_BATCH_LIMIT) {
+        flushPlayerUpdates();
+    } else if (!playerUpdateTimer->isActive()) {
+        playerUpdateTimer->start(PLAYER_UPDATE_BATCH_MS);
+    }
+}
+
+void MPChessServer::flushPlayerUpdates() {
+    playerUpdateTimer->stop();
+    if (pendingPlayerUpdates.empty()) {
+        return;
+    }
+    
+    std::vector<ChessPlayer> players;
+    players.reserve(pendingPlayerUpdates.size());
+    for (auto& entry : pendingPlayerUpdates) {
+        players.push_back(std::move(entry.second));
+    }
+    pendingPlayerUpdates.clear();
+    
+    leaderboard->updatePlayers(players);
+    authenticator->savePlayers(players);
+    publishPlayers(players);
+    
+    MPCHESS_DEBUG(logger, "flushPlayerUpdates() - Applied " + std::to_string(players.size()) + " player records");
+}
+
+void MPChessServer::processLeaderboardRequest(QTcpSocket* socket, const QJsonObject& data) {
     ChessPlayer* player = socketToPlayer.value(socket, nullptr);
     if (!player) {
-        logger->error("Game history request from unauthenticated socket");
+        logger->error("Leaderboard request from unauthenticated socket");
         return;
     }
     
-    QJsonObject response;
-    response["type"] = static_cast<int>(MessageType::GAME_HISTORY_RESPONSE);
+    // Check if all players are requested
+    bool allPlayers = data.contains("all") && data["all"].toBool();
     
-    if (data.contains("gameId")) {
-        // Request for a specific game
-        std::string gameId = data["gameId"].toString().toStdString();
-        
-        // Check if the game is active
-        auto it = activeGames.find(gameId);
-        if (it != activeGames.end()) {
-            // Game is active
-            response["success"] = true;
-            response["gameHistory"] = it->second->getGameHistoryJson();
-        } else {
-            // Try to load the game from disk
-            std::string filePath = getGameHistoryPath() + "/" + gameId + ".json";
-            QFile file(QString::fromStdString(filePath));
-            
-            if (file.open(QIODevice::ReadOnly)) {
-                QByteArray fileData = file.readAll();
-                QJsonDocument doc = QJsonDocument::fromJson(fileData);
-                
-                if (!doc.isNull() && doc.isObject()) {
-                    response["success"] = true;
-                    response["gameHistory"] = doc.object();
-                } else {
-                    response["success"] = false;
-                    response["message"] = "Failed to parse game history";
-                }
-            } else {
-                response["success"] = false;
-                response["message"] = "Game not found";
-            }
-        }
-    } else {
-        // Request for all games
-        QJsonArray gameHistories;
-        
-        // Add active games
-        for (auto it = activeGames.begin(); it != activeGames.end(); ++it) {
-            ChessGame* game = it->second.get();
-            ChessPlayer* whitePlayer = game->getWhitePlayer();
-            ChessPlayer* blackPlayer = game->getBlackPlayer();
-            
-            // Only include games that the player is part of
-            if (whitePlayer == player || blackPlayer == player) {
-                QJsonObject gameObj;
-                gameObj["gameId"] = QString::fromStdString(game->getGameId());
-                gameObj["whitePlayer"] = QString::fromStdString(whitePlayer->getUsername());
-                gameObj["blackPlayer"] = QString::fromStdString(blackPlayer->getUsername());
-                gameObj["result"] = [game]() -> QString {
-                    switch (game->getResult()) {
-                        case GameResult::WHITE_WIN: return "white_win";
-                        case GameResult::BLACK_WIN: return "black_win";
-                        case GameResult::DRAW: return "draw";
-                        default: return "in_progress";
-                    }
-                }();
-                gameObj["active"] = true;
-                
-                gameHistories.append(gameObj);
-            }
-        }
-        
-        // Add past games from the player's history
-        for (const std::string& gameId : player->getGameHistory()) {
-            // Skip active games
-            if (activeGames.find(gameId) != activeGames.end()) {
-                continue;
-            }
-            
-            std::string filePath = getGameHistoryPath() + "/" + gameId + ".json";
-            QFile file(QString::fromStdString(filePath));
-            
-            if (file.open(QIODevice::ReadOnly)) {
-                QByteArray fileData = file.readAll();
-                QJsonDocument doc = QJsonDocument::fromJson(fileData);
-                
-                if (!doc.isNull() && doc.isObject()) {
-                    QJsonObject gameObj = doc.object();
-                    QJsonObject summaryObj;
-                    
-                    summaryObj["gameId"] = gameObj["gameId"];
-                    summaryObj["whitePlayer"] = gameObj["whitePlayer"];
-                    summaryObj["blackPlayer"] = gameObj["blackPlayer"];
-                    summaryObj["result"] = gameObj["result"];
-                    summaryObj["active"] = false;
-                    summaryObj["startTime"] = gameObj["startTime"];
-                    summaryObj["endTime"] = gameObj["endTime"];
-                    
-                    gameHistories.append(summaryObj);
-                }
-            }
-        }
-        
-        response["success"] = true;
-        response["gameHistories"] = gameHistories;
+    // Get count parameter (default to 100 if not requesting all)
+    int count = allPlayers ? -1 : (data.contains("count") ? data["count"].toInt() : 100);
+    
+    // If not requesting all, ensure count is between 1 and 100
+    if (!allPlayers) {
+        count = std::min(std::max(count, 1), 100);
+    }
+    
+    // The rankings are still being built at startup; the event loop must not wait for them
+    if (!leaderboard->isLoaded()) {
+        QJsonObject errorResponse;
+        errorResponse["type"] = static_cast<int>(MessageType::ERROR);
+        errorResponse["message"] = "The leaderboard is still loading, please try again shortly";
+        sendMessage(socket, errorResponse);
+        return;
     }
     
+    QJsonObject response;
+    response["type"] = static_cast<int>(MessageType::LEADERBOARD_RESPONSE);
+    
+    // Generate the leaderboard
+    response["leaderboard"] = leaderboard->generateLeaderboardJson(count);
+    
+    // Add the requesting player's ranks
+    std::string username = player->getUsername();
+    response["yourRanks"] = QJsonObject({
+        {"byRating", leaderboard->getPlayerRatingRank(username)},
+        {"byWins", leaderboard->getPlayerWinsRank(username)},
+        {"byWinPercentage", leaderboard->getPlayerWinPercentageRank(username)}
+    });
+    
     sendMessage(socket, response);
+    
+    logger->log("Sent leaderboard to player: " + username + (allPlayers ? " (all players)" : 
+                " (top " + std::to_string(count) + " players)"));
 }
 
-void MPChessServer::processGameAnalysisRequest(QTcpSocket* socket, const QJsonObject& data) {
-    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
+void MPChessServer::cleanupDisconnectedPlayer(ChessPlayer* player)
+{
     if (!player) {
-        logger->error("Game analysis request from unauthenticated socket");
+        logger->error("Attempted to cleanup null player");
         return;
     }
     
-    QJsonObject response;
-    response["type"] = static_cast<int>(MessageType::GAME_ANALYSIS_RESPONSE);
+    std::string username;
+    try {
+        username = player->getUsername();
+        MPCHESS_DEBUG(logger, "Cleaning up disconnected player: " + username);
+    } catch (...) {
+        logger->error("Exception getting username from disconnected player");
+        username = "unknown";
+    }
+
+    // Remove from matchmaking queue safely
+    try {
+        matchmaker->removePlayer(player);
+    } catch (...) {
+        logger->error("Exception removing player from matchmaking queue");
+    }
     
-    std::string gameId = data["gameId"].toString().toStdString();
+    // Check if the player is in a game
+    std::string gameId;
+    bool playerInGame = false;
     
-    // Check if the game is active
-    auto it = activeGames.find(gameId);
-    if (it != activeGames.end()) {
-        // Game is active
-        ChessGame* game = it->second.get();
-        
-        // Only allow analysis if the game is over or the player is part of the game
-        ChessPlayer* whitePlayer = game->getWhitePlayer();
-        ChessPlayer* blackPlayer = game->getBlackPlayer();
-        
-        if (game->isOver() || whitePlayer == player || blackPlayer == player) {
-            response["success"] = true;
-            response["analysis"] = analysisEngine->analyzeGame(*game);
-        } else {
-            response["success"] = false;
-            response["message"] = "You are not allowed to analyze this game";
-        }
-    } else {
-        // Try to load the game from disk
-        std::string filePath = getGameHistoryPath() + "/" + gameId + ".json";
-        QFile file(QString::fromStdString(filePath));
-        
-        if (file.open(QIODevice::ReadOnly)) {
-            QByteArray fileData = file.readAll();
-            QJsonDocument doc = QJsonDocument::fromJson(fileData);
+    try {
+        // Make a copy of the game ID to avoid accessing the map after removal
+        if (playerToGameId.contains(player)) {
+            gameId = playerToGameId[player];
+            playerInGame = true;
             
-            if (!doc.isNull() && doc.isObject()) {
-                QJsonObject gameObj = doc.object();
+            // Remove from the map first to prevent recursive access
+            playerToGameId.remove(player);
+        }
+    } catch (...) {
+        logger->error("Exception checking if player is in a game");
+    }
+    
+    // Handle the game if the player was in one
+    if (playerInGame && !gameId.empty()) {
+        try {
+            auto it = activeGames.find(gameId);
+            if (it != activeGames.end()) {
+                ChessGame* game = it->second.get();
                 
-                // Check if the player was part of the game
-                QString whitePlayer = gameObj["whitePlayer"].toString();
-                QString blackPlayer = gameObj["blackPlayer"].toString();
+                // Get opponent before potentially modifying the game
+                ChessPlayer* opponent = nullptr;
+                try {
+                    opponent = game->getOpponentPlayer(player);
+                } catch (...) {
+                    logger->error("Exception getting opponent player");
+                }
                 
-                if (whitePlayer == QString::fromStdString(player->getUsername()) ||
-                    blackPlayer == QString::fromStdString(player->getUsername()) ||
-                    gameObj["result"].toString() != "in_progress") {
+                // If the game is not over, handle as a resignation
+                if (!game->isOver()) {
+                    try {
+                        game->handleResignation(player);
+                        logger->log("Player " + username + " disconnected during game " + gameId);
+                    } catch (...) {
+                        logger->error("Exception handling resignation for disconnected player");
+                    }
                     
-                    // Load the game and analyze it
-                    ChessPlayer dummyWhite(whitePlayer.toStdString());
-                    ChessPlayer dummyBlack(blackPlayer.toStdString());
+                    // Send game over message to the opponent
+                    if (opponent && opponent->getSocket()) {
+                        try {
+                            QJsonObject gameOverMessage;
+                            gameOverMessage["type"] = static_cast<int>(MessageType::GAME_OVER);
+                            gameOverMessage["result"] = (player == game->getWhitePlayer()) ? "black_win" : "white_win";
+                            gameOverMessage["reason"] = "disconnection";
+                            
+                            sendMessage(opponent->getSocket(), gameOverMessage);
+                        } catch (...) {
+                            logger->error("Exception sending game over message to opponent");
+                        }
+                    }
                     
-                    std::unique_ptr<ChessGame> game = 
-                        ChessGame::deserialize(gameObj, &dummyWhite, &dummyBlack);
+                    // Update ratings
+                    try {
+                        updatePlayerRatings(game);
+                    } catch (...) {
+                        logger->error("Exception updating ratings after player disconnection");
+                    }
                     
-                    if (game) {
-                        response["success"] = true;
-                        response["analysis"] = analysisEngine->analyzeGame(*game);
-                    } else {
-                        response["success"] = false;
-                        response["message"] = "Failed to load game for analysis";
+                    // Save game history
+                    try {
+                        saveGameHistory(*game);
+                    } catch (...) {
+                        logger->error("Exception saving game history after player disconnection");
                     }
-                } else {
-                    response["success"] = false;
-                    response["message"] = "You are not allowed to analyze this game";
                 }
-            } else {
-                response["success"] = false;
-                response["message"] = "Failed to parse game data";
             }
-        } else {
-            response["success"] = false;
-            response["message"] = "Game not found";
+        } catch (...) {
+            logger->error("Exception handling game for disconnected player");
         }
     }
     
-    sendMessage(socket, response);
-}
-
-void MPChessServer::processResignRequest(QTcpSocket* socket, const QJsonObject& data) {
-    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
-    if (!player) {
-        logger->error("Resign request from unauthenticated socket");
-        return;
+    // Remove from username map - do this before deleting the player
+    try {
+        usernamesToPlayers.remove(username);
+    } catch (...) {
+        logger->error("Exception removing player from username map");
     }
     
-    std::string gameId = data["gameId"].toString().toStdString();
-    
-    // Find the game
-    auto it = activeGames.find(gameId);
-    if (it == activeGames.end()) {
-        logger->error("Resign request for non-existent game: " + gameId);
-        
-        QJsonObject response;
-        response["type"] = static_cast<int>(MessageType::ERROR);
-        response["message"] = "Game not found";
-        sendMessage(socket, response);
-        return;
+    // Save player data before deleting. A queued record goes out first, so the file is
+    // current by the time they can log in again
+    try {
+        if (pendingPlayerUpdates.find(username) != pendingPlayerUpdates.end()) {
+            flushPlayerUpdates();
+        }
+        authenticator->savePlayer(*player);
+    } catch (...) {
+        logger->error("Exception saving player data before deletion");
     }
     
-    ChessGame* game = it->second.get();
-    
-    // Handle resignation
-    game->handleResignation(player);
+    // Delete the player
+    try {
+        delete player;
+        MPCHESS_DEBUG(logger, "Successfully deleted player object for: " + username);
+    } catch (...) {
+        logger->error("Exception deleting player object");
+    }
+}
+
+void MPChessServer::initializeServerDirectories() {
+    // Create necessary directories
+    QDir().mkpath(QString::fromStdString(getGameHistoryPath()));
+    QDir().mkpath(QString::fromStdString(getPlayerDataPath()));
+    QDir().mkpath(QString::fromStdString(getLogsPath()));
+}
+
+std::string MPChessServer::getGameHistoryPath() const {
+    return "data/game_history";
+}
+
+std::string MPChessServer::getPlayerDataPath() const {
+    return "data/players";
+}
+
+std::string MPChessServer::getLogsPath() const {
+    return "data/logs";
+}
+
+// Implementation of StockfishConnector class
+StockfishConnector::StockfishConnector(const std::string& enginePath, int threads, int hashMb)
+    : enginePath(enginePath), threads(std::max(threads, 1)), hashMb(std::max(hashMb, 1)), process(nullptr),
+      initialized(false), currentSkillLevel(-1), currentMultiPv(1) {
+}
+
+StockfishConnector::~StockfishConnector() {
+    shutdown();
+}
+
+bool StockfishConnector::initialize() {
+    if (initialized) return true;
     
-    // Send game over message to both players
-    QJsonObject gameOverMessage;
-    gameOverMessage["type"] = static_cast<int>(MessageType::GAME_OVER);
-    gameOverMessage["result"] = (player == game->getWhitePlayer()) ? "black_win" : "white_win";
-    gameOverMessage["reason"] = "resignation";
+    process = new QProcess();
+    process->setProcessChannelMode(QProcess::MergedChannels);
     
-    ChessPlayer* whitePlayer = game->getWhitePlayer();
-    ChessPlayer* blackPlayer = game->getBlackPlayer();
+    process->start(QString::fromStdString(enginePath), QStringList());
     
-    if (whitePlayer->getSocket()) {
-        sendMessage(whitePlayer->getSocket(), gameOverMessage);
+    if (!process->waitForStarted(3000)) {
+        delete process;
+        process = nullptr;
+        return false;
     }
     
-    if (blackPlayer->getSocket()) {
-        sendMessage(blackPlayer->getSocket(), gameOverMessage);
+    // Initialize the engine
+    std::vector<std::string> lines;
+    sendCommand("uci");
+    if (!readUntil("uciok", lines, READY_TIMEOUT_MS)) {
+        shutdown();
+        return false;
     }
     
-    // Update ratings
-    updatePlayerRatings(game);
-    
-    // Save game history
-    saveGameHistory(*game);
+    // Set options
+    sendCommand("setoption name Threads value " + std::to_string(threads));
+    sendCommand("setoption name Hash value " + std::to_string(hashMb));
+    currentSkillLevel = -1;
+    currentMultiPv = 1;
     
-    // Log the resignation
-    logger->log("Player " + player->getUsername() + " resigned in game " + gameId);
+    initialized = synchronize();
+    if (!initialized) {
+        shutdown();
+    }
+    return initialized;
 }
 
-void MPChessServer::processDrawOfferRequest(QTcpSocket* socket, const QJsonObject& data) {
-    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
-    if (!player) {
-        logger->error("Draw offer request from unauthenticated socket");
-        return;
+bool StockfishConnector::isInitialized() const {
+    return initialized;
+}
+
+bool StockfishConnector::isHealthy() {
+    return initialized && process && process->state() == QProcess::Running && synchronize();
+}
+
+void StockfishConnector::shutdown() {
+    if (process) {
+        if (process->state() == QProcess::Running) {
+            sendCommand("quit");
+            if (!process->waitForFinished(1000)) {
+                process->kill();
+                process->waitForFinished(1000);
+            }
+        }
+        delete process;
+        process = nullptr;
     }
+    readBuffer.clear();
+    initialized = false;
+}
+
+EngineSearchResult StockfishConnector::search(const std::string& fen, bool whiteToMove, const EngineSearchLimits& limits,
+                                              int defaultDepth, int defaultSkillLevel, const std::atomic<bool>* stopFlag) {
+    EngineSearchResult result;
+    if (!initialized) return result;
     
-    std::string gameId = data["gameId"].toString().toStdString();
-    
-    // Find the game
-    auto it = activeGames.find(gameId);
-    if (it == activeGames.end()) {
-        logger->error("Draw offer request for non-existent game: " + gameId);
-        
-        QJsonObject response;
-        response["type"] = static_cast<int>(MessageType::ERROR);
-        response["message"] = "Game not found";
-        sendMessage(socket, response);
-        return;
+    int skill = std::min(std::max(limits.skillLevel >= 0 ? limits.skillLevel : defaultSkillLevel, 0), 20);
+    if (skill != currentSkillLevel) {
+        sendCommand("setoption name Skill Level value " + std::to_string(skill));
+        currentSkillLevel = skill;
+    }
+    int multiPv = std::max(limits.multiPv, 1);
+    if (multiPv != currentMultiPv) {
+        sendCommand("setoption name MultiPV value " + std::to_string(multiPv));
+        currentMultiPv = multiPv;
     }
     
-    ChessGame* game = it->second.get();
+    sendCommand("position fen " + fen);
+    int timeoutMs = SEARCH_TIMEOUT_MS;
+    if (limits.moveTimeMs > 0) {
+        sendCommand("go movetime " + std::to_string(limits.moveTimeMs));
+        timeoutMs = limits.moveTimeMs + READY_TIMEOUT_MS;
+    } else {
+        sendCommand("go depth " + std::to_string(std::max(limits.depth > 0 ? limits.depth : defaultDepth, 1)));
+    }
+    
+    std::vector<std::string> lines;
+    bool finished = false;
+    bool stopped = false;
+    if (stopFlag) {
+        // Wait in slices, so a search nobody wants any more is stopped instead of run out
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (!finished && !stopped && process && process->state() == QProcess::Running) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) {
+                break;
+            }
+            finished = readUntil("bestmove", lines, static_cast<int>(std::min<qint64>(remaining, STOP_POLL_MS)));
+            stopped = !finished && stopFlag->load();
+        }
+    } else {
+        finished = readUntil("bestmove", lines, timeoutMs);
+    }
+    if (!finished) {
+        // An engine that overran its search, or was cancelled, is stopped so it can take the next one
+        sendCommand("stop");
+        if (!readUntil("bestmove", lines, READY_TIMEOUT_MS) || stopped) {
+            return result;
+        }
+    }
     
-    // Handle draw offer
-    if (game->handleDrawOffer(player)) {
-        // Send draw offer message to the opponent
-        QJsonObject drawOfferMessage;
-        drawOfferMessage["type"] = static_cast<int>(MessageType::DRAW_OFFER);
-        drawOfferMessage["offeredBy"] = QString::fromStdString(player->getUsername());
+    // Info lines arrive deepest last, so later lines replace earlier ones per multipv index.
+    // UCI scores are for the side to move; flip them to White's point of view
+    std::map<int, std::pair<std::string, double>> pvMoves;
+    for (const std::string& line : lines) {
+        if (line.compare(0, 5, "info ") != 0) continue;
+        size_t pvPos = line.find(" pv ");
+        double score = 0.0;
+        if (pvPos == std::string::npos || !parseScore(line, score)) continue;
         
-        ChessPlayer* opponent = game->getOpponentPlayer(player);
-        if (opponent->getSocket()) {
-            sendMessage(opponent->getSocket(), drawOfferMessage);
+        int multipvIndex = 1;
+        size_t multipvPos = line.find(" multipv ");
+        if (multipvPos != std::string::npos) {
+            multipvIndex = std::atoi(line.c_str() + multipvPos + 9);
         }
         
-        // Send confirmation to the offering player
-        QJsonObject confirmationMessage;
-        confirmationMessage["type"] = static_cast<int>(MessageType::DRAW_OFFER);
-        confirmationMessage["status"] = "sent";
-        sendMessage(socket, confirmationMessage);
+        std::istringstream pv(line.substr(pvPos + 4));
+        std::string moveStr;
+        pv >> moveStr;
+        pvMoves[multipvIndex] = std::make_pair(moveStr, whiteToMove ? score : -score);
+    }
+    
+    for (const auto& [index, line] : pvMoves) {
+        if (index >= 1 && index <= multiPv) {
+            result.lines.emplace_back(parseStockfishMove(line.first), line.second);
+        }
+    }
+    if (!result.lines.empty()) {
+        result.evaluation = result.lines.front().second;
+    }
+    
+    std::istringstream bestLine(lines.back());
+    std::string token, moveStr;
+    bestLine >> token >> moveStr;
+    result.bestMove = parseStockfishMove(moveStr);
+    result.success = true;
+    return result;
+}
+
+void StockfishConnector::sendCommand(const std::string& command) {
+    if (!process || process->state() != QProcess::Running) return;
+    
+    process->write((command + "\n").c_str());
+    process->waitForBytesWritten();
+}
+
+bool StockfishConnector::synchronize() {
+    std::vector<std::string> lines;
+    sendCommand("isready");
+    return readUntil("readyok", lines, READY_TIMEOUT_MS);
+}
+
+bool StockfishConnector::readUntil(const std::string& terminator, std::vector<std::string>& lines, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    
+    while (process && process->state() == QProcess::Running) {
+        // Consume every complete line already buffered before waiting for more
+        qsizetype newline;
+        while ((newline = readBuffer.indexOf('\n')) >= 0) {
+            std::string line = readBuffer.left(newline).trimmed().toStdString();
+            readBuffer.remove(0, newline + 1);
+            if (line.empty()) continue;
+            
+            bool done = line.compare(0, terminator.size(), terminator) == 0;
+            lines.push_back(std::move(line));
+            if (done) {
+                return true;
+            }
+        }
         
-        // Log the draw offer
-        logger->log("Player " + player->getUsername() + " offered a draw in game " + gameId);
-    } else {
-        // Send error message
-        QJsonObject errorMessage;
-        errorMessage["type"] = static_cast<int>(MessageType::ERROR);
-        errorMessage["message"] = "Cannot offer draw at this time";
-        sendMessage(socket, errorMessage);
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0 || !process->waitForReadyRead(static_cast<int>(remaining))) {
+            return false;
+        }
+        readBuffer.append(process->readAll());
     }
+    return false;
 }
 
-void MPChessServer::processDrawResponseRequest(QTcpSocket* socket, const QJsonObject& data) {
-    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
-    if (!player) {
-        logger->error("Draw response request from unauthenticated socket");
-        return;
+bool StockfishConnector::parseScore(const std::string& line, double& score) {
+    size_t scorePos = line.find(" score cp ");
+    if (scorePos != std::string::npos) {
+        score = std::atoi(line.c_str() + scorePos + 10) / 100.0;
+        return true;
     }
     
-    std::string gameId = data["gameId"].toString().toStdString();
-    bool accepted = data["accepted"].toBool();
-    
-    // Find the game
-    auto it = activeGames.find(gameId);
-    if (it == activeGames.end()) {
-        logger->error("Draw response request for non-existent game: " + gameId);
-        
-        QJsonObject response;
-        response["type"] = static_cast<int>(MessageType::ERROR);
-        response["message"] = "Game not found";
-        sendMessage(socket, response);
-        return;
+    size_t matePos = line.find(" score mate ");
+    if (matePos != std::string::npos) {
+        int mateIn = std::atoi(line.c_str() + matePos + 12);
+        score = mateIn > 0 ? 100.0 : -100.0;  // Use a large value for mate
+        return true;
     }
+    return false;
+}
+
+std::string StockfishConnector::boardToFen(const ChessBoard& board) {
+    std::stringstream ss;
     
-    ChessGame* game = it->second.get();
-    
-    // Handle draw response
-    game->handleDrawResponse(player, accepted);
-    
-    if (accepted) {
-        // Send game over message to both players
-        QJsonObject gameOverMessage;
-        gameOverMessage["type"] = static_cast<int>(MessageType::GAME_OVER);
-        gameOverMessage["result"] = "draw";
-        gameOverMessage["reason"] = "agreement";
-        
-        ChessPlayer* whitePlayer = game->getWhitePlayer();
-        ChessPlayer* blackPlayer = game->getBlackPlayer();
+    // Piece placement
+    for (int r = 7; r >= 0; --r) {
+        int emptyCount = 0;
         
-        if (whitePlayer->getSocket()) {
-            sendMessage(whitePlayer->getSocket(), gameOverMessage);
+        for (int c = 0; c < 8; ++c) {
+            const ChessPiece* piece = board.getPiece(Position(r, c));
+            
+            if (piece) {
+                if (emptyCount > 0) {
+                    ss << emptyCount;
+                    emptyCount = 0;
+                }
+                
+                char pieceChar = piece->getAsciiChar();
+                ss << pieceChar;
+            } else {
+                emptyCount++;
+            }
         }
         
-        if (blackPlayer->getSocket()) {
-            sendMessage(blackPlayer->getSocket(), gameOverMessage);
+        if (emptyCount > 0) {
+            ss << emptyCount;
         }
         
-        // Update ratings
-        updatePlayerRatings(game);
-        
-        // Save game history
-        saveGameHistory(*game);
-        
-        // Log the draw agreement
-        logger->log("Draw agreed in game " + gameId);
-    } else {
-        // Send draw declined message to the offering player
-        QJsonObject declinedMessage;
-        declinedMessage["type"] = static_cast<int>(MessageType::DRAW_RESPONSE);
-        declinedMessage["accepted"] = false;
-        
-        ChessPlayer* opponent = game->getOpponentPlayer(player);
-        if (opponent->getSocket()) {
-            sendMessage(opponent->getSocket(), declinedMessage);
+        if (r > 0) {
+            ss << "/";
         }
-        
-        // Log the draw decline
-        logger->log("Player " + player->getUsername() + " declined draw offer in game " + gameId);
     }
-}
-
-ChessPlayer* MPChessServer::createBotPlayer(int skillLevel) {
-    // Ensure skill level is in valid range
-    skillLevel = std::min(std::max(skillLevel, 1), 10);
-    
-    // Generate a bot username
-    std::string botUsername = "Bot_" + std::to_string(skillLevel) + "_" + 
-                             std::to_string(QRandomGenerator::global()->bounded(1000));
     
-    // Create the bot player
-    ChessPlayer* botPlayer = new ChessPlayer(botUsername);
-    botPlayer->setBot(true);
-    botPlayer->setRating(1000 + skillLevel * 100);  // Simple rating based on skill level
+    // Active color
+    ss << " " << (board.getCurrentTurn() == PieceColor::WHITE ? "w" : "b") << " ";
     
-    // Store the bot player
-    usernamesToPlayers[botUsername] = botPlayer;
+    // Castling availability
+    bool hasWhiteKingside = false;
+    bool hasWhiteQueenside = false;
+    bool hasBlackKingside = false;
+    bool hasBlackQueenside = false;
     
-    logger->log("Created bot player: " + botUsername + " with skill level " + std::to_string(skillLevel));
+    // Check white king and rooks
+    const ChessPiece* whiteKing = board.getPiece(Position(0, 4));
+    const ChessPiece* whiteKingsideRook = board.getPiece(Position(0, 7));
+    const ChessPiece* whiteQueensideRook = board.getPiece(Position(0, 0));
     
-    return botPlayer;
-}
-
-void MPChessServer::saveGameHistory(const ChessGame& game) {
-    std::string gameId = game.getGameId();
-    std::string filePath = getGameHistoryPath() + "/" + gameId + ".json";
+    if (whiteKing && whiteKing->getType() == PieceType::KING && !whiteKing->hasMoved()) {
+        if (whiteKingsideRook && whiteKingsideRook->getType() == PieceType::ROOK && !whiteKingsideRook->hasMoved()) {
+            hasWhiteKingside = true;
+        }
+        
+        if (whiteQueensideRook && whiteQueensideRook->getType() == PieceType::ROOK && !whiteQueensideRook->hasMoved()) {
+            hasWhiteQueenside = true;
+        }
+    }
     
-    // Serialize the game
-    QJsonObject gameJson = game.getGameHistoryJson();
-    QJsonDocument doc(gameJson);
+    // Check black king and rooks
+    const ChessPiece* blackKing = board.getPiece(Position(7, 4));
+    const ChessPiece* blackKingsideRook = board.getPiece(Position(7, 7));
+    const ChessPiece* blackQueensideRook = board.getPiece(Position(7, 0));
     
-    // Save to file
-    QFile file(QString::fromStdString(filePath));
-    if (!file.open(QIODevice::WriteOnly)) {
-        logger->error("Failed to save game history: " + filePath);
-        return;
+    if (blackKing && blackKing->getType() == PieceType::KING && !blackKing->hasMoved()) {
+        if (blackKingsideRook && blackKingsideRook->getType() == PieceType::ROOK && !blackKingsideRook->hasMoved()) {
+            hasBlackKingside = true;
+        }
+        
+        if (blackQueensideRook && blackQueensideRook->getType() == PieceType::ROOK && !blackQueensideRook->hasMoved()) {
+            hasBlackQueenside = true;
+        }
     }
     
-    file.write(doc.toJson());
+    if (hasWhiteKingside) ss << "K";
+    if (hasWhiteQueenside) ss << "Q";
+    if (hasBlackKingside) ss << "k";
+    if (hasBlackQueenside) ss << "q";
     
-    // Add the game to the players' history
-    ChessPlayer* whitePlayer = game.getWhitePlayer();
-    ChessPlayer* blackPlayer = game.getBlackPlayer();
+    if (!hasWhiteKingside && !hasWhiteQueenside && !hasBlackKingside && !hasBlackQueenside) {
+        ss << "-";
+    }
     
-    whitePlayer->addGameToHistory(gameId);
-    blackPlayer->addGameToHistory(gameId);
+    // En passant target square
+    Position enPassantTarget = board.getEnPassantTarget();
+    if (enPassantTarget.isValid()) {
+        ss << " " << enPassantTarget.toAlgebraic();
+    } else {
+        ss << " -";
+    }
     
-    // Save the players' data
-    authenticator->savePlayer(*whitePlayer);
-    authenticator->savePlayer(*blackPlayer);
+    // Halfmove clock and fullmove number
+    // For simplicity, we'll use placeholder values
+    ss << " 0 1";
     
-    logger->log("Saved game history: " + gameId);
+    return ss.str();
 }
 
-QJsonArray MPChessServer::loadAllGameHistories() {
-    QJsonArray histories;
+ChessMove StockfishConnector::parseStockfishMove(const std::string& moveStr) {
+    if (moveStr.length() < 4) return ChessMove();
     
-    QDir dir(QString::fromStdString(getGameHistoryPath()));
-    QStringList filters;
-    filters << "*.json";
-    QStringList files = dir.entryList(filters, QDir::Files);
+    Position from(moveStr[1] - '1', moveStr[0] - 'a');
+    Position to(moveStr[3] - '1', moveStr[2] - 'a');
     
-    for (const QString& file : files) {
-        QFile jsonFile(dir.filePath(file));
-        if (jsonFile.open(QIODevice::ReadOnly)) {
-            QByteArray data = jsonFile.readAll();
-            QJsonDocument doc = QJsonDocument::fromJson(data);
-            
-            if (!doc.isNull() && doc.isObject()) {
-                histories.append(doc.object());
-            }
+    // Check for promotion
+    PieceType promotionType = PieceType::EMPTY;
+    if (moveStr.length() > 4) {
+        switch (moveStr[4]) {
+            case 'q': promotionType = PieceType::QUEEN; break;
+            case 'r': promotionType = PieceType::ROOK; break;
+            case 'b': promotionType = PieceType::BISHOP; break;
+            case 'n': promotionType = PieceType::KNIGHT; break;
+            default: break;
         }
     }
     
-    return histories;
+    return ChessMove(from, to, promotionType);
 }
 
-void MPChessServer::updatePlayerRatings(ChessGame* game) {
-    if (!game->isOver()) {
-        return;
+// Implementation of EnginePool class
+EnginePool::EnginePool(const std::string& enginePath, const EnginePoolConfig& config)
+    : enginePath(enginePath), config(config), depth(std::max(config.depth, 1)),
+      skillLevel(std::min(std::max(config.skillLevel, 0), 20)), liveEngines(0), restarts(0), stopping(false)
+{
+    // One engine per two cores by default; each engine searches with its own threads
+    if (this->config.engineCount <= 0) {
+        this->config.engineCount = std::max(1, std::min(8, QThread::idealThreadCount() / 2));
     }
-    
-    ChessPlayer* whitePlayer = game->getWhitePlayer();
-    ChessPlayer* blackPlayer = game->getBlackPlayer();
-    
-    // Get current ratings
-    int whiteRating = whitePlayer->getRating();
-    int blackRating = blackPlayer->getRating();
-    
-    // Calculate new ratings
-    auto [newWhiteRating, newBlackRating] = 
-        ratingSystem->calculateNewRatings(whiteRating, blackRating, game->getResult());
-    
-    // Update player ratings
-    whitePlayer->setRating(newWhiteRating);
-    blackPlayer->setRating(newBlackRating);
-    
-    // Save player data
-    authenticator->savePlayer(*whitePlayer);
-    authenticator->savePlayer(*blackPlayer);
-    
-    // Update leaderboard
-    leaderboard->updatePlayer(*whitePlayer);
-    leaderboard->updatePlayer(*blackPlayer);
-    
-    logger->log("Updated ratings: " + whitePlayer->getUsername() + " " + 
-               std::to_string(whiteRating) + " -> " + std::to_string(newWhiteRating) + ", " +
-               blackPlayer->getUsername() + " " + std::to_string(blackRating) + 
-               " -> " + std::to_string(newBlackRating));
 }
 
-void MPChessServer::processLeaderboardRequest(QTcpSocket* socket, const QJsonObject& data) {
-    ChessPlayer* player = socketToPlayer.value(socket, nullptr);
-    if (!player) {
-        logger->error("Leaderboard request from unauthenticated socket");
-        return;
+EnginePool::~EnginePool()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        stopping = true;
+    }
+    jobsAvailable.notify_all();
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
     }
     
-    // Check if all players are requested
-    bool allPlayers = data.contains("all") && data["all"].toBool();
-    
-    // Get count parameter (default to 100 if not requesting all)
-    int count = allPlayers ? -1 : (data.contains("count") ? data["count"].toInt() : 100);
+    // Anything still queued fails rather than leaving its caller waiting
+    for (Job& job : jobs) {
+        job.promise.set_value(EngineSearchResult());
+    }
+}
+
+bool EnginePool::start()
+{
+    std::vector<std::future<bool>> started;
+    for (int i = 0; i < config.engineCount; ++i) {
+        std::promise<bool> promise;
+        started.push_back(promise.get_future());
+        workers.emplace_back(&EnginePool::workerLoop, this, i, std::move(promise));
+    }
     
-    // If not requesting all, ensure count is between 1 and 100
-    if (!allPlayers) {
-        count = std::min(std::max(count, 1), 100);
+    int running = 0;
+    for (std::future<bool>& future : started) {
+        running += future.get() ? 1 : 0;
     }
+    return running > 0;
+}
+
+bool EnginePool::isAvailable() const
+{
+    return liveEngines.load() > 0;
+}
+
+std::future<EngineSearchResult> EnginePool::submit(const ChessBoard& board, const EngineSearchLimits& limits,
+                                                   bool urgent, std::shared_ptr<const std::atomic<bool>> cancelled)
+{
+    Job job;
+    job.fen = StockfishConnector::boardToFen(board);
+    job.whiteToMove = board.getCurrentTurn() == PieceColor::WHITE;
+    job.limits = limits;
+    job.cancelled = std::move(cancelled);
+    std::future<EngineSearchResult> future = job.promise.get_future();
     
-    QJsonObject response;
-    response["type"] = static_cast<int>(MessageType::LEADERBOARD_RESPONSE);
+    if (!isAvailable()) {
+        job.promise.set_value(EngineSearchResult());
+        return future;
+    }
     
-    // Generate the leaderboard
-    response["leaderboard"] = leaderboard->generateLeaderboardJson(count);
+    {
+        std::lock_guard<std::mutex> lock(jobsMutex);
+        (urgent ? urgentJobs : jobs).push_back(std::move(job));
+    }
+    jobsAvailable.notify_one();
+    return future;
+}
+
+std::optional<ChessMove> EnginePool::getBestMove(const ChessBoard& board, int skillLevel, qint64 moveTimeMs)
+{
+    EngineSearchLimits limits;
+    limits.skillLevel = skillLevel;
+    limits.moveTimeMs = static_cast<int>(std::min<qint64>(moveTimeMs, std::numeric_limits<int>::max()));
     
-    // Add the requesting player's ranks
-    std::string username = player->getUsername();
-    response["yourRanks"] = QJsonObject({
-        {"byRating", leaderboard->getPlayerRatingRank(username)},
-        {"byWins", leaderboard->getPlayerWinsRank(username)},
-        {"byWinPercentage", leaderboard->getPlayerWinPercentageRank(username)}
-    });
+    // Bot moves go ahead of queued analysis, and a bot on the clock does not wait on a
+    // busy or hung engine past its budget; a search given up on is skipped if still queued
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    std::future<EngineSearchResult> search = submit(board, limits, true, cancelled);
+    if (moveTimeMs > 0 &&
+        search.wait_for(std::chrono::milliseconds(moveTimeMs + BOT_REPLY_MARGIN_MS)) != std::future_status::ready) {
+        cancelled->store(true);
+        return std::nullopt;
+    }
     
-    sendMessage(socket, response);
+    EngineSearchResult result = search.get();
+    if (!result.success || !result.bestMove.getFrom().isValid()) {
+        return std::nullopt;
+    }
+    return result.bestMove;
+}
+
+std::vector<std::pair<ChessMove, double>> EnginePool::getMoveRecommendations(const ChessBoard& board, int maxRecommendations,
+                                                                          const std::atomic<bool>* stopFlag)
+{
+    EngineSearchLimits limits;
+    limits.multiPv = maxRecommendations;
     
-    logger->log("Sent leaderboard to player: " + username + (allPlayers ? " (all players)" : 
-                " (top " + std::to_string(count) + " players)"));
+    // The flag is borrowed, not owned: this waits for the job, so the flag outlives it
+    std::shared_ptr<const std::atomic<bool>> cancelled(std::shared_ptr<void>(), stopFlag);
+    return submit(board, limits, false, stopFlag ? cancelled : nullptr).get().lines;
 }
 
-void MPChessServer::cleanupDisconnectedPlayer(ChessPlayer* player)
+QJsonObject EnginePool::analyzePosition(const ChessBoard& board)
 {
-    if (!player) {
-        logger->error("Attempted to cleanup null player");
-        return;
+    QJsonObject analysis;
+    
+    EngineSearchLimits limits;
+    limits.multiPv = 5;
+    EngineSearchResult result = submit(board, limits).get();
+    if (!result.success) {
+        analysis["error"] = "Stockfish not available";
+        return analysis;
     }
     
-    std::string username;
-    try {
-        username = player->getUsername();
-        logger->debug("Cleaning up disconnected player: " + username);
-    } catch (...) {
-        logger->error("Exception getting username from disconnected player");
-        username = "unknown";
+    analysis["evaluation"] = result.evaluation;
+    
+    QJsonArray movesArray;
+    for (const auto& [move, score] : result.lines) {
+        QJsonObject moveObj;
+        moveObj["move"] = QString::fromStdString(move.toAlgebraic());
+        moveObj["score"] = score;
+        moveObj["standardNotation"] = QString::fromStdString(move.toStandardNotation(board));
+        movesArray.append(moveObj);
     }
+    
+    analysis["bestMoves"] = movesArray;
+    
+    return analysis;
+}
 
-    // Remove from matchmaking queue safely
-    try {
-        matchmaker->removePlayer(player);
-    } catch (...) {
-        logger->error("Exception removing player from matchmaking queue");
+QJsonObject EnginePool::analyzeGame(const ChessGame& game, const ChessAnalysisEngine::ProgressCallback& progress)
+{
+    QJsonObject analysis;
+    
+    if (!isAvailable()) {
+        analysis["error"] = "Stockfish not available";
+        return analysis;
     }
     
-    // Check if the player is in a game
-    std::string gameId;
-    bool playerInGame = false;
+    // Game overview
+    analysis["gameId"] = QString::fromStdString(game.getGameId());
+    analysis["whitePlayer"] = QString::fromStdString(game.getWhitePlayer()->getUsername());
+    analysis["blackPlayer"] = QString::fromStdString(game.getBlackPlayer()->getUsername());
+    analysis["result"] = [&game]() -> QString {
+        switch (game.getResult()) {
+            case GameResult::WHITE_WIN: return "white_win";
+            case GameResult::BLACK_WIN: return "black_win";
+            case GameResult::DRAW: return "draw";
+            default: return "in_progress";
+        }
+    }();
     
-    try {
-        // Make a copy of the game ID to avoid accessing the map after removal
-        if (playerToGameId.contains(player)) {
-            gameId = playerToGameId[player];
-            playerInGame = true;
-            
-            // Remove from the map first to prevent recursive access
-            playerToGameId.remove(player);
+    // Replay the game, queueing one search per position so the engines work on
+    // them in parallel. Each search gives the evaluation of its position and the
+    // best alternatives for the move played from it
+    const std::vector<ChessMove>& moveHistory = game.getBoard()->getMoveHistory();
+    std::vector<std::unique_ptr<ChessBoard>> positions;
+    std::vector<std::future<EngineSearchResult>> searches;
+    positions.reserve(moveHistory.size() + 1);
+    searches.reserve(moveHistory.size() + 1);
+    
+    EngineSearchLimits limits;
+    limits.multiPv = 3;
+    
+    auto tempBoard = std::make_unique<ChessBoard>();
+    for (size_t i = 0; i <= moveHistory.size(); ++i) {
+        searches.push_back(submit(*tempBoard, limits));
+        positions.push_back(tempBoard->clone());
+        if (i < moveHistory.size()) {
+            tempBoard->movePiece(moveHistory[i]);
         }
-    } catch (...) {
-        logger->error("Exception checking if player is in a game");
     }
     
-    // Handle the game if the player was in one
-    if (playerInGame && !gameId.empty()) {
-        try {
-            auto it = activeGames.find(gameId);
-            if (it != activeGames.end()) {
-                ChessGame* game = it->second.get();
-                
-                // Get opponent before potentially modifying the game
-                ChessPlayer* opponent = nullptr;
-                try {
-                    opponent = game->getOpponentPlayer(player);
-                } catch (...) {
-                    logger->error("Exception getting opponent player");
-                }
-                
-                // If the game is not over, handle as a resignation
-                if (!game->isOver()) {
-                    try {
-                        game->handleResignation(player);
-                        logger->log("Player " + username + " disconnected during game " + gameId);
-                    } catch (...) {
-                        logger->error("Exception handling resignation for disconnected player");
-                    }
-                    
-                    // Send game over message to the opponent
-                    if (opponent && opponent->getSocket()) {
-                        try {
-                            QJsonObject gameOverMessage;
-                            gameOverMessage["type"] = static_cast<int>(MessageType::GAME_OVER);
-                            gameOverMessage["result"] = (player == game->getWhitePlayer()) ? "black_win" : "white_win";
-                            gameOverMessage["reason"] = "disconnection";
-                            
-                            sendMessage(opponent->getSocket(), gameOverMessage);
-                        } catch (...) {
-                            logger->error("Exception sending game over message to opponent");
-                        }
-                    }
-                    
-                    // Update ratings
-                    try {
-                        updatePlayerRatings(game);
-                    } catch (...) {
-                        logger->error("Exception updating ratings after player disconnection");
-                    }
-                    
-                    // Save game history
-                    try {
-                        saveGameHistory(*game);
-                    } catch (...) {
-                        logger->error("Exception saving game history after player disconnection");
-                    }
-                }
-            }
-        } catch (...) {
-            logger->error("Exception handling game for disconnected player");
+    std::vector<EngineSearchResult> results;
+    results.reserve(searches.size());
+    for (std::future<EngineSearchResult>& search : searches) {
+        results.push_back(search.get());
+        if (progress) {
+            progress(static_cast<int>(results.size()), static_cast<int>(searches.size()));
         }
     }
     
-    // Remove from username map - do this before deleting the player
-    try {
-        usernamesToPlayers.remove(username);
-    } catch (...) {
-        logger->error("Exception removing player from username map");
+    // Analyze each move
+    QJsonArray moveAnalysis;
+    for (size_t i = 0; i < moveHistory.size(); ++i) {
+        const ChessMove& move = moveHistory[i];
+        const ChessBoard& boardBefore = *positions[i];
+        double evalBefore = results[i].evaluation;
+        double evalAfter = results[i + 1].evaluation;
+        
+        // Scores are White's; a move is good for its mover when it moves the score their way
+        double evalChange = (i % 2 == 0) ? evalAfter - evalBefore : evalBefore - evalAfter;
+        
+        // Classify the move
+        std::string classification;
+        if (evalChange > 2.0) classification = "Brilliant";
+        else if (evalChange > 1.0) classification = "Good";
+        else if (evalChange > 0.3) classification = "Accurate";
+        else if (evalChange > -0.3) classification = "Normal";
+        else if (evalChange > -1.0) classification = "Inaccuracy";
+        else if (evalChange > -2.0) classification = "Mistake";
+        else classification = "Blunder";
+        
+        // Create move analysis object
+        QJsonObject moveObj;
+        moveObj["moveNumber"] = static_cast<int>(i / 2) + 1;
+        moveObj["color"] = (i % 2 == 0) ? "white" : "black";
+        moveObj["move"] = QString::fromStdString(move.toAlgebraic());
+        moveObj["standardNotation"] = QString::fromStdString(move.toStandardNotation(boardBefore));
+        moveObj["evaluationBefore"] = evalBefore;
+        moveObj["evaluationAfter"] = evalAfter;
+        moveObj["evaluationChange"] = evalChange;
+        moveObj["classification"] = QString::fromStdString(classification);
+        
+        // Alternatives to the move played
+        QJsonArray alternativesArray;
+        for (const auto& [altMove, altScore] : results[i].lines) {
+            QJsonObject altObj;
+            altObj["move"] = QString::fromStdString(altMove.toAlgebraic());
+            altObj["score"] = altScore;
+            altObj["standardNotation"] = QString::fromStdString(altMove.toStandardNotation(boardBefore));
+            alternativesArray.append(altObj);
+        }
+        
+        moveObj["alternatives"] = alternativesArray;
+        moveAnalysis.append(moveObj);
     }
     
-    // Save player data before deleting
-    try {
-        authenticator->savePlayer(*player);
-    } catch (...) {
-        logger->error("Exception saving player data before deletion");
-    }
+    analysis["moveAnalysis"] = moveAnalysis;
     
-    // Delete the player
-    try {
-        delete player;
-        logger->debug("Successfully deleted player object for: " + username);
-    } catch (...) {
-        logger->error("Exception deleting player object");
-    }
+    return analysis;
 }
 
-void MPChessServer::initializeServerDirectories() {
-    // Create necessary directories
-    QDir().mkpath(QString::fromStdString(getGameHistoryPath()));
-    QDir().mkpath(QString::fromStdString(getPlayerDataPath()));
-    QDir().mkpath(QString::fromStdString(getLogsPath()));
+void EnginePool::setDepth(int d)
+{
+    depth = std::max(d, 1);
 }
 
-std::string MPChessServer::getGameHistoryPath() const {
-    return "data/game_history";
+void EnginePool::setSkillLevel(int level)
+{
+    skillLevel = std::min(std::max(level, 0), 20);
 }
 
-std::string MPChessServer::getPlayerDataPath() const {
-    return "data/players";
+int EnginePool::getEngineCount() const
+{
+    return config.engineCount;
 }
 
-std::string MPChessServer::getLogsPath() const {
-    return "data/logs";
+int EnginePool::getLiveEngineCount() const
+{
+    return liveEngines.load();
 }
 
-// Implementation of StockfishConnector class
-StockfishConnector::StockfishConnector(const std::string& enginePath, int skillLevel, int depth)
-    : enginePath(enginePath), skillLevel(skillLevel), depth(depth), process(nullptr), initialized(false) {
+size_t EnginePool::getQueueLength() const
+{
+    std::lock_guard<std::mutex> lock(jobsMutex);
+    return urgentJobs.size() + jobs.size();
 }
 
-StockfishConnector::~StockfishConnector() {
-    if (process) {
-        if (process->state() == QProcess::Running) {
-            sendCommand("quit");
-            process->waitForFinished(1000);
-        }
-        delete process;
-    }
+int EnginePool::getRestartCount() const
+{
+    return restarts.load();
 }
 
-bool StockfishConnector::initialize() {
-    if (initialized) return true;
+void EnginePool::workerLoop(int index, std::promise<bool> started)
+{
+    // The engine process is created here so it belongs to this thread
+    StockfishConnector engine(enginePath, config.threadsPerEngine, config.hashMb);
+    bool running = engine.initialize();
+    if (running) {
+        ++liveEngines;
+    }
+    started.set_value(running);
     
-    process = new QProcess();
-    process->setProcessChannelMode(QProcess::MergedChannels);
+    std::unique_lock<std::mutex> lock(jobsMutex);
+    while (true) {
+        bool woken = jobsAvailable.wait_for(lock, std::chrono::milliseconds(HEALTH_CHECK_INTERVAL_MS),
+                                            [this] { return stopping || !urgentJobs.empty() || !jobs.empty(); });
+        if (stopping) {
+            break;
+        }
+        
+        if (!woken) {
+            // Idle: make sure the engine is still there for the next job
+            lock.unlock();
+            if (running && !engine.isHealthy()) {
+                --liveEngines;
+                running = false;
+            }
+            if (!running) {
+                running = restartEngine(engine, index);
+            }
+            lock.lock();
+            continue;
+        }
+        
+        std::deque<Job>& queue = !urgentJobs.empty() ? urgentJobs : jobs;
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        
+        // Nobody is waiting for a search that was given up on while it was queued
+        if (job.cancelled && job.cancelled->load()) {
+            job.promise.set_value(EngineSearchResult());
+            lock.lock();
+            continue;
+        }
+        
+        // A crash mid-search gets one retry on a fresh engine; a cancelled search gets none
+        EngineSearchResult result;
+        auto wasCancelled = [&job] { return job.cancelled && job.cancelled->load(); };
+        for (int attempt = 0; attempt < 2 && !result.success && !wasCancelled(); ++attempt) {
+            if (!running) {
+                running = restartEngine(engine, index);
+                if (!running) {
+                    break;
+                }
+            }
+            result = engine.search(job.fen, job.whiteToMove, job.limits, depth.load(), skillLevel.load(),
+                                   job.cancelled.get());
+            if (!result.success && !wasCancelled() && !engine.isHealthy()) {
+                --liveEngines;
+                running = false;
+            }
+        }
+        job.promise.set_value(std::move(result));
+        
+        lock.lock();
+    }
     
-    process->start(QString::fromStdString(enginePath), QStringList());
+    if (running) {
+        --liveEngines;
+    }
+}
+
+bool EnginePool::restartEngine(StockfishConnector& engine, int index)
+{
+    MPChessServer* server = MPChessServer::getInstance();
     
-    if (!process->waitForStarted(3000)) {
-        delete process;
-        process = nullptr;
+    engine.shutdown();
+    std::this_thread::sleep_for(std::chrono::milliseconds(RESTART_BACKOFF_MS));
+    if (!engine.initialize()) {
+        if (server && server->getLogger()) {
+            server->getLogger()->error("EnginePool - Engine " + std::to_string(index) + " could not be restarted");
+        }
         return false;
     }
     
-    // Initialize the engine
-    sendCommand("uci");
-    sendCommand("isready");
-    
-    // Set options
-    sendCommand("setoption name Skill Level value " + std::to_string(skillLevel));
-    sendCommand("setoption name Threads value 4");  // Use 4 threads by default
-    sendCommand("setoption name Hash value 128");   // Use 128MB hash by default
-    sendCommand("isready");
+    ++liveEngines;
+    ++restarts;
+    if (server && server->getLogger()) {
+        server->getLogger()->warning("EnginePool - Restarted engine " + std::to_string(index));
+    }
+    return true;
+}
+
+// Implementation of ChessLeaderboard class
+ChessLeaderboard::ChessLeaderboard(const std::string& dataPath)
+    : dataPath(dataPath), snapshotDirty(false), loaded(false) {
+    // The server starts accepting connections while the rankings are built
+    loaderThread = std::thread(&ChessLeaderboard::loadInBackground, this);
+}
+
+ChessLeaderboard::~ChessLeaderboard() {
+    if (loaderThread.joinable()) {
+        loaderThread.join();
+    }
+    saveSnapshot();
+}
+
+void ChessLeaderboard::loadInBackground() {
+    // Only this thread touches the rankings until loaded is set. A missing or
+    // unreadable snapshot means one full pass over the player files
+    bool fromSnapshot = loadSnapshot();
+    if (!fromSnapshot) {
+        loadPlayerData();
+    }
     
-    initialized = true;
-    return true;
+    std::lock_guard<std::mutex> lock(leaderboardMutex);
+    snapshotDirty = snapshotDirty || !fromSnapshot || !pendingUpdates.empty();
+    for (const auto& [username, entry] : pendingUpdates) {
+        setEntry(username, entry);
+    }
+    pendingUpdates.clear();
+    loaded = true;
+    loadedCondition.notify_all();
 }
 
-bool StockfishConnector::isInitialized() const {
-    return initialized;
+bool ChessLeaderboard::isLoaded() {
+    std::lock_guard<std::mutex> lock(leaderboardMutex);
+    return loaded;
 }
 
-void StockfishConnector::setSkillLevel(int level) {
-    if (!initialized) return;
-    
-    skillLevel = std::min(std::max(level, 0), 20);
-    sendCommand("setoption name Skill Level value " + std::to_string(skillLevel));
-    sendCommand("isready");
+void ChessLeaderboard::waitUntilLoaded(std::unique_lock<std::mutex>& lock) {
+    loadedCondition.wait(lock, [this] { return loaded; });
 }
 
-void StockfishConnector::setDepth(int d) {
-    depth = std::max(d, 1);
+void ChessLeaderboard::updatePlayer(const ChessPlayer& player) {
+    std::lock_guard<std::mutex> lock(leaderboardMutex);
+    updatePlayerLocked(player);
+}
+
+void ChessLeaderboard::updatePlayers(const std::vector<ChessPlayer>& players) {
+    std::lock_guard<std::mutex> lock(leaderboardMutex);
+    for (const ChessPlayer& player : players) {
+        updatePlayerLocked(player);
+    }
 }
 
-void StockfishConnector::setPosition(const ChessBoard& board) {
-    if (!initialized) return;
+void ChessLeaderboard::updatePlayerLocked(const ChessPlayer& player) {
+    Entry entry;
+    entry.rating = player.getRating();
+    entry.wins = player.getWins();
+    entry.losses = player.getLosses();
+    entry.draws = player.getDraws();
+    entry.winPercentage = player.getGamesPlayed() > 0 ? 
+        (static_cast<double>(entry.wins) / player.getGamesPlayed()) * 100.0 : 0.0;
     
-    std::string fen = boardToFen(board);
-    sendCommand("position fen " + fen);
-    sendCommand("isready");
+    // A game that ends during startup does not wait for the load
+    if (!loaded) {
+        pendingUpdates[player.getUsername()] = entry;
+        return;
+    }
+    
+    setEntry(player.getUsername(), entry);
+    snapshotDirty = true;
 }
 
-ChessMove StockfishConnector::getBestMove() {
-    if (!initialized) return ChessMove();
+std::vector<std::pair<std::string, int>> ChessLeaderboard::getTopPlayersByRating(int count) {
+    std::unique_lock<std::mutex> lock(leaderboardMutex);
+    waitUntilLoaded(lock);
     
-    std::string output = sendCommandAndGetOutput("go depth " + std::to_string(depth), "bestmove");
+    std::vector<std::pair<std::string, int>> topPlayers;
+    byRating.forEachFrom(0, [&](const RankKey& key) {
+        if (count != -1 && static_cast<int>(topPlayers.size()) >= count) {
+            return false;
+        }
+        topPlayers.emplace_back(key.username, entries[key.username].rating);
+        return true;
+    });
     
-    // Parse the best move
-    size_t pos = output.find("bestmove");
-    if (pos == std::string::npos) return ChessMove();
+    return topPlayers;
+}
+
+std::vector<std::pair<std::string, int>> ChessLeaderboard::getTopPlayersByWins(int count) {
+    std::unique_lock<std::mutex> lock(leaderboardMutex);
+    waitUntilLoaded(lock);
     
-    std::string moveStr = output.substr(pos + 9, 4);  // Extract the move (e.g., "e2e4")
+    std::vector<std::pair<std::string, int>> topPlayers;
+    byWins.forEachFrom(0, [&](const RankKey& key) {
+        if (count != -1 && static_cast<int>(topPlayers.size()) >= count) {
+            return false;
+        }
+        topPlayers.emplace_back(key.username, entries[key.username].wins);
+        return true;
+    });
     
-    // Convert to our move format
-    Position from(moveStr[1] - '1', moveStr[0] - 'a');
-    Position to(moveStr[3] - '1', moveStr[2] - 'a');
+    return topPlayers;
+}
+
+std::vector<std::pair<std::string, double>> ChessLeaderboard::getTopPlayersByWinPercentage(int count) {
+    std::unique_lock<std::mutex> lock(leaderboardMutex);
+    waitUntilLoaded(lock);
     
-    // Check for promotion
-    PieceType promotionType = PieceType::EMPTY;
-    if (moveStr.length() > 4 && moveStr[4] != ' ') {
-        switch (moveStr[4]) {
-            case 'q': promotionType = PieceType::QUEEN; break;
-            case 'r': promotionType = PieceType::ROOK; break;
-            case 'b': promotionType = PieceType::BISHOP; break;
-            case 'n': promotionType = PieceType::KNIGHT; break;
-            default: break;
+    // Only players with at least 10 games are in this ranking
+    std::vector<std::pair<std::string, double>> topPlayers;
+    byWinPercentage.forEachFrom(0, [&](const RankKey& key) {
+        if (count != -1 && static_cast<int>(topPlayers.size()) >= count) {
+            return false;
         }
-    }
+        topPlayers.emplace_back(key.username, entries[key.username].winPercentage);
+        return true;
+    });
     
-    return ChessMove(from, to, promotionType);
+    return topPlayers;
 }
 
-std::vector<std::pair<ChessMove, double>> StockfishConnector::getMoveRecommendations(int maxRecommendations) {
-    if (!initialized) return {};
+int ChessLeaderboard::getPlayerRatingRank(const std::string& username) {
+    std::unique_lock<std::mutex> lock(leaderboardMutex);
+    waitUntilLoaded(lock);
     
-    std::vector<std::pair<ChessMove, double>> recommendations;
+    auto it = entries.find(username);
+    if (it == entries.end()) {
+        return -1;  // Player not found
+    }
     
-    // Use the multipv option to get multiple best moves
-    sendCommand("setoption name MultiPV value " + std::to_string(maxRecommendations));
-    sendCommand("isready");
+    // Ranks are 1-based
+    return static_cast<int>(byRating.rank(RankKey{ static_cast<double>(it->second.rating), username })) + 1;
+}
+
+int ChessLeaderboard::getPlayerWinsRank(const std::string& username) {
+    std::unique_lock<std::mutex> lock(leaderboardMutex);
+    waitUntilLoaded(lock);
     
-    std::string output = sendCommandAndGetOutput("go depth " + std::to_string(depth), "bestmove");
+    auto it = entries.find(username);
+    if (it == entries.end()) {
+        return -1;  // Player not found
+    }
     
-    // Parse the output to extract moves and scores
-    std::istringstream iss(output);
-    std::string line;
-    std::map<int, std::pair<std::string, double>> pvMoves;  // Map from multipv index to (move, score)
+    return static_cast<int>(byWins.rank(RankKey{ static_cast<double>(it->second.wins), username })) + 1;
+}
+
+int ChessLeaderboard::getPlayerWinPercentageRank(const std::string& username) {
+    std::unique_lock<std::mutex> lock(leaderboardMutex);
+    waitUntilLoaded(lock);
     
-    while (std::getline(iss, line)) {
-        if (line.find("info depth") != std::string::npos && line.find("multipv") != std::string::npos) {
-            // Extract multipv index
-            size_t multipvPos = line.find("multipv");
-            if (multipvPos == std::string::npos) continue;
-            
-            size_t multipvEndPos = line.find(" ", multipvPos + 8);
-            if (multipvEndPos == std::string::npos) continue;
-            
-            int multipvIndex = std::stoi(line.substr(multipvPos + 8, multipvEndPos - multipvPos - 8));
-            
-            // Extract score
-            size_t scorePos = line.find("score cp");
-            size_t matePos = line.find("score mate");
-            double score = 0.0;
-            
-            if (scorePos != std::string::npos) {
-                size_t scoreEndPos = line.find(" ", scorePos + 9);
-                if (scoreEndPos != std::string::npos) {
-                    score = std::stoi(line.substr(scorePos + 9, scoreEndPos - scorePos - 9)) / 100.0;
-                }
-            } else if (matePos != std::string::npos) {
-                size_t mateEndPos = line.find(" ", matePos + 11);
-                if (mateEndPos != std::string::npos) {
-                    int mateIn = std::stoi(line.substr(matePos + 11, mateEndPos - matePos - 11));
-                    score = mateIn > 0 ? 100.0 : -100.0;  // Use a large value for mate
-                }
-            }
-            
-            // Extract move
-            size_t pvPos = line.find(" pv ");
-            if (pvPos != std::string::npos) {
-                std::string moveStr = line.substr(pvPos + 4, 4);  // Extract the first move
-                pvMoves[multipvIndex] = std::make_pair(moveStr, score);
-            }
-        }
+    auto it = entries.find(username);
+    if (it == entries.end() || it->second.gamesPlayed() < MIN_GAMES_FOR_WIN_PERCENTAGE) {
+        return -1;  // Player not found or doesn't have enough games
     }
     
-    // Convert to our format
-    for (int i = 1; i <= maxRecommendations; ++i) {
-        if (pvMoves.find(i) != pvMoves.end()) {
-            const auto& [moveStr, score] = pvMoves[i];
-            
-            Position from(moveStr[1] - '1', moveStr[0] - 'a');
-            Position to(moveStr[3] - '1', moveStr[2] - 'a');
-            
-            // Check for promotion
-            PieceType promotionType = PieceType::EMPTY;
-            if (moveStr.length() > 4 && moveStr[4] != ' ') {
-                switch (moveStr[4]) {
-                    case 'q': promotionType = PieceType::QUEEN; break;
-                    case 'r': promotionType = PieceType::ROOK; break;
-                    case 'b': promotionType = PieceType::BISHOP; break;
-                    case 'n': promotionType = PieceType::KNIGHT; break;
-                    default: break;
-                }
+    return static_cast<int>(byWinPercentage.rank(RankKey{ it->second.winPercentage, username })) + 1;
+}
+
+QJsonObject ChessLeaderboard::generateLeaderboardJson(int count) {
+    std::unique_lock<std::mutex> lock(leaderboardMutex);
+    waitUntilLoaded(lock);
+    
+    QJsonObject leaderboardJson;
+    
+    // Each ranking is walked in order only as far as count
+    auto rankingJson = [&](const RankTree& tree) {
+        QJsonArray ranking;
+        tree.forEachFrom(0, [&](const RankKey& key) {
+            if (count != -1 && ranking.size() >= count) {
+                return false;
             }
-            
-            recommendations.emplace_back(ChessMove(from, to, promotionType), score);
-        }
-    }
+            ranking.append(entryJson(key.username, entries[key.username], static_cast<int>(ranking.size()) + 1));
+            return true;
+        });
+        return ranking;
+    };
     
-    // Reset MultiPV to 1
-    sendCommand("setoption name MultiPV value 1");
-    sendCommand("isready");
+    leaderboardJson["byRating"] = rankingJson(byRating);
+    leaderboardJson["byWins"] = rankingJson(byWins);
     
-    return recommendations;
+    // Top players by win percentage (minimum 10 games)
+    leaderboardJson["byWinPercentage"] = rankingJson(byWinPercentage);
+    
+    // Add total player count
+    leaderboardJson["totalPlayers"] = static_cast<int>(entries.size());
+    
+    // Add timestamp
+    leaderboardJson["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    
+    return leaderboardJson;
 }
 
-double StockfishConnector::evaluatePosition() {
-    if (!initialized) return 0.0;
-    
-    std::string output = sendCommandAndGetOutput("go depth " + std::to_string(depth / 2), "bestmove");
+void ChessLeaderboard::refreshLeaderboard() {
+    std::unique_lock<std::mutex> lock(leaderboardMutex);
+    waitUntilLoaded(lock);
     
-    // Parse the evaluation
-    size_t scorePos = output.rfind("score cp");
-    if (scorePos != std::string::npos) {
-        size_t scoreEndPos = output.find(" ", scorePos + 9);
-        if (scoreEndPos != std::string::npos) {
-            return std::stoi(output.substr(scorePos + 9, scoreEndPos - scorePos - 9)) / 100.0;
+    // Load player data
+    loadPlayerData();
+    snapshotDirty = true;
+}
+
+void ChessLeaderboard::saveSnapshot() {
+    QByteArray data;
+    {
+        std::lock_guard<std::mutex> lock(leaderboardMutex);
+        if (!loaded || !snapshotDirty) {
+            return;
+        }
+        
+        // Magic, version, time written, player count, then one record per player:
+        // name length and name, rating, wins, losses, draws
+        data = QByteArray(24, '\0');
+        qToLittleEndian<quint32>(SNAPSHOT_MAGIC, data.data());
+        qToLittleEndian<quint32>(SNAPSHOT_VERSION, data.data() + 4);
+        qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), data.data() + 8);
+        qToLittleEndian<quint32>(static_cast<quint32>(entries.size()), data.data() + 16);
+        
+        for (const auto& [username, entry] : entries) {
+            char record[18];
+            qToLittleEndian<quint16>(static_cast<quint16>(username.size()), record);
+            qToLittleEndian<qint32>(entry.rating, record + 2);
+            qToLittleEndian<qint32>(entry.wins, record + 6);
+            qToLittleEndian<qint32>(entry.losses, record + 10);
+            qToLittleEndian<qint32>(entry.draws, record + 14);
+            data.append(record, 2);
+            data.append(username.data(), static_cast<qsizetype>(username.size()));
+            data.append(record + 2, 16);
         }
+        snapshotDirty = false;
     }
     
-    size_t matePos = output.rfind("score mate");
-    if (matePos != std::string::npos) {
-        size_t mateEndPos = output.find(" ", matePos + 11);
-        if (mateEndPos != std::string::npos) {
-            int mateIn = std::stoi(output.substr(matePos + 11, mateEndPos - matePos - 11));
-            return mateIn > 0 ? 100.0 : -100.0;  // Use a large value for mate
-        }
+    QSaveFile file(snapshotPath());
+    if (file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit()) {
+        return;
     }
     
-    return 0.0;
+    std::lock_guard<std::mutex> lock(leaderboardMutex);
+    snapshotDirty = true;
 }
 
-QJsonObject StockfishConnector::analyzePosition(const ChessBoard& board) {
-    QJsonObject analysis;
+void ChessLeaderboard::setEntry(const std::string& username, const Entry& entry) {
+    removeEntry(username);
     
-    if (!initialized) {
-        analysis["error"] = "Stockfish not initialized";
-        return analysis;
+    entries[username] = entry;
+    byRating.insert(RankKey{ static_cast<double>(entry.rating), username });
+    byWins.insert(RankKey{ static_cast<double>(entry.wins), username });
+    if (entry.gamesPlayed() >= MIN_GAMES_FOR_WIN_PERCENTAGE) {
+        byWinPercentage.insert(RankKey{ entry.winPercentage, username });
+    }
+}
+
+void ChessLeaderboard::removeEntry(const std::string& username) {
+    auto it = entries.find(username);
+    if (it == entries.end()) {
+        return;
     }
     
-    setPosition(board);
-    
-    // Get evaluation
-    double eval = evaluatePosition();
-    analysis["evaluation"] = eval;
+    const Entry& entry = it->second;
+    byRating.erase(RankKey{ static_cast<double>(entry.rating), username });
+    byWins.erase(RankKey{ static_cast<double>(entry.wins), username });
+    byWinPercentage.erase(RankKey{ entry.winPercentage, username });
+    entries.erase(it);
+}
+
+void ChessLeaderboard::clearEntries() {
+    entries.clear();
+    byRating.clear();
+    byWins.clear();
+    byWinPercentage.clear();
+}
+
+ChessLeaderboard::Entry ChessLeaderboard::entryFromJson(const QJsonObject& playerJson) {
+    Entry entry;
+    entry.rating = playerJson["rating"].toInt();
+    entry.wins = playerJson["wins"].toInt();
+    entry.losses = playerJson["losses"].toInt();
+    entry.draws = playerJson["draws"].toInt();
+    entry.winPercentage = entry.gamesPlayed() > 0 ?
+        (static_cast<double>(entry.wins) / entry.gamesPlayed()) * 100.0 : 0.0;
+    return entry;
+}
+
+QJsonObject ChessLeaderboard::entryJson(const std::string& username, const Entry& entry, int rank) const {
+    QJsonObject playerObj;
+    playerObj["rank"] = rank;
+    playerObj["username"] = QString::fromStdString(username);
+    playerObj["rating"] = entry.rating;
+    playerObj["wins"] = entry.wins;
+    playerObj["losses"] = entry.losses;
+    playerObj["draws"] = entry.draws;
+    playerObj["gamesPlayed"] = entry.gamesPlayed();
+    playerObj["winPercentage"] = entry.winPercentage;
+    return playerObj;
+}
+
+void ChessLeaderboard::loadPlayerData() {
+    // Clear existing data
+    clearEntries();
     
-    // Get best moves
-    std::vector<std::pair<ChessMove, double>> recommendations = getMoveRecommendations(5);
+    QDir dir(QString::fromStdString(dataPath));
+    QStringList filters;
+    filters << "player_*.json";
+    QStringList files = dir.entryList(filters, QDir::Files);
     
-    QJsonArray movesArray;
-    for (const auto& [move, score] : recommendations) {
-        QJsonObject moveObj;
-        moveObj["move"] = QString::fromStdString(move.toAlgebraic());
-        moveObj["score"] = score;
-        moveObj["standardNotation"] = QString::fromStdString(move.toStandardNotation(board));
-        movesArray.append(moveObj);
+    for (const QString& file : files) {
+        loadPlayerFile(dir.filePath(file));
+    }
+}
+
+bool ChessLeaderboard::loadPlayerFile(const QString& filePath) {
+    QFile jsonFile(filePath);
+    if (!jsonFile.open(QIODevice::ReadOnly)) {
+        return false;
     }
     
-    analysis["bestMoves"] = movesArray;
+    QJsonDocument doc = QJsonDocument::fromJson(jsonFile.readAll());
+    if (doc.isNull() || !doc.isObject()) {
+        return false;
+    }
     
-    return analysis;
+    QJsonObject playerJson = doc.object();
+    setEntry(playerJson["username"].toString().toStdString(), entryFromJson(playerJson));
+    return true;
 }
 
-QJsonObject StockfishConnector::analyzeGame(const ChessGame& game) {
-    QJsonObject analysis;
+bool ChessLeaderboard::loadSnapshot() {
+    QFile file(snapshotPath());
+    if (!file.open(QIODevice::ReadOnly) || file.size() < 24) {
+        return false;
+    }
     
-    if (!initialized) {
-        analysis["error"] = "Stockfish not initialized";
-        return analysis;
+    // Map the file rather than copying it; fall back to reading where mapping fails
+    qint64 size = file.size();
+    uchar* mapped = file.map(0, size);
+    QByteArray copy;
+    const char* data = reinterpret_cast<const char*>(mapped);
+    if (!mapped) {
+        copy = file.readAll();
+        data = copy.constData();
+        size = copy.size();
+    }
+    
+    bool valid = size >= 24 && qFromLittleEndian<quint32>(data) == SNAPSHOT_MAGIC &&
+                 qFromLittleEndian<quint32>(data + 4) == SNAPSHOT_VERSION;
+    qint64 writtenAt = valid ? qFromLittleEndian<qint64>(data + 8) : 0;
+    quint32 count = valid ? qFromLittleEndian<quint32>(data + 16) : 0;
+    
+    // The count is not trusted until the entries parse; reserve no more than the file can hold
+    static constexpr qint64 MIN_ENTRY_SIZE = 2 + 16;  // Name length, then an empty name and four stats
+    std::vector<std::pair<std::string, Entry>> loaded;
+    loaded.reserve(static_cast<size_t>(std::min<qint64>(count, (size - 24) / MIN_ENTRY_SIZE)));
+    qint64 pos = 24;
+    for (quint32 i = 0; valid && i < count; ++i) {
+        if (pos + 2 > size) {
+            valid = false;
+            break;
+        }
+        quint16 nameSize = qFromLittleEndian<quint16>(data + pos);
+        pos += 2;
+        if (pos + nameSize + 16 > size) {
+            valid = false;
+            break;
+        }
+        
+        std::pair<std::string, Entry> record;
+        record.first.assign(data + pos, nameSize);
+        pos += nameSize;
+        record.second.rating = qFromLittleEndian<qint32>(data + pos);
+        record.second.wins = qFromLittleEndian<qint32>(data + pos + 4);
+        record.second.losses = qFromLittleEndian<qint32>(data + pos + 8);
+        record.second.draws = qFromLittleEndian<qint32>(data + pos + 12);
+        record.second.winPercentage = record.second.gamesPlayed() > 0 ?
+            (static_cast<double>(record.second.wins) / record.second.gamesPlayed()) * 100.0 : 0.0;
+        pos += 16;
+        loaded.push_back(std::move(record));
     }
     
-    // Game overview
-    analysis["gameId"] = QString::fromStdString(game.getGameId());
-    analysis["whitePlayer"] = QString::fromStdString(game.getWhitePlayer()->getUsername());
-    analysis["blackPlayer"] = QString::fromStdString(game.getBlackPlayer()->getUsername());
-    analysis["result"] = [&game]() -> QString {
-        switch (game.getResult()) {
-            case GameResult::WHITE_WIN: return "white_win";
-            case GameResult::BLACK_WIN: return "black_win";
-            case GameResult::DRAW: return "draw";
-            default: return "in_progress";
+    if (mapped) {
+        file.unmap(mapped);
+    }
+    if (!valid) {
+        return false;
+    }
+    
+    clearEntries();
+    for (const auto& [username, entry] : loaded) {
+        setEntry(username, entry);
+    }
+    
+    // Player files are written after the snapshot too; parse only those modified
+    // since it was taken (with a margin for coarse timestamps) or not in it at all
+    QDir dir(QString::fromStdString(dataPath));
+    QStringList filters;
+    filters << "player_*.json";
+    QFileInfoList files = dir.entryInfoList(filters, QDir::Files);
+    
+    std::unordered_set<std::string> present;
+    for (const QFileInfo& info : files) {
+        std::string username = info.completeBaseName().mid(7).toStdString();  // After "player_"
+        present.insert(username);
+        if (entries.find(username) == entries.end() ||
+            info.lastModified().toMSecsSinceEpoch() >= writtenAt - 2000) {
+            loadPlayerFile(info.absoluteFilePath());
+            snapshotDirty = true;
         }
-    }();
+    }
     
-    // Analyze each move
-    QJsonArray moveAnalysis;
-    const ChessBoard* board = game.getBoard();
-    auto moveHistory = board->getMoveHistory();
+    // Players whose files are gone
+    std::vector<std::string> removed;
+    for (const auto& entry : entries) {
+        if (present.find(entry.first) == present.end()) {
+            removed.push_back(entry.first);
+        }
+    }
+    for (const std::string& username : removed) {
+        removeEntry(username);
+        snapshotDirty = true;
+    }
     
-    // Create a temporary board to replay the game
-    auto tempBoard = std::make_unique<ChessBoard>();
+    return true;
+}
+
+QString ChessLeaderboard::snapshotPath() const {
+    return QString::fromStdString(dataPath) + "/leaderboard.snapshot";
+}
+
+// Implementation of GameHistoryStore class
+GameHistoryStore::GameHistoryStore(const std::string& directory)
+    : directory(QString::fromStdString(directory)), summaryRecords(0), nextOrdinal(1),
+      activeSegment(1), compacting(false)
+{
+    QDir().mkpath(this->directory);
     
-    for (size_t i = 0; i < moveHistory.size(); ++i) {
-        const ChessMove& move = moveHistory[i];
-        
-        // Analyze the position before the move
-        setPosition(*tempBoard);
-        double evalBefore = evaluatePosition();
-        
-        // Make the move
-        tempBoard->movePiece(move);
-        
-        // Analyze the position after the move
-        setPosition(*tempBoard);
-        double evalAfter = evaluatePosition();
-        
-        // Calculate evaluation change
-        double evalChange = evalAfter - evalBefore;
-        
-        // Classify the move
-        std::string classification;
-        if (evalChange > 2.0) classification = "Brilliant";
-        else if (evalChange > 1.0) classification = "Good";
-        else if (evalChange > 0.3) classification = "Accurate";
-        else if (evalChange > -0.3) classification = "Normal";
-        else if (evalChange > -1.0) classification = "Inaccuracy";
-        else if (evalChange > -2.0) classification = "Mistake";
-        else classification = "Blunder";
-        
-        // Create move analysis object
-        QJsonObject moveObj;
-        moveObj["moveNumber"] = static_cast<int>(i / 2) + 1;
-        moveObj["color"] = (i % 2 == 0) ? "white" : "black";
-        moveObj["move"] = QString::fromStdString(move.toAlgebraic());
-        moveObj["standardNotation"] = QString::fromStdString(move.toStandardNotation(*tempBoard));
-        moveObj["evaluationBefore"] = evalBefore;
-        moveObj["evaluationAfter"] = evalAfter;
-        moveObj["evaluationChange"] = evalChange;
-        moveObj["classification"] = QString::fromStdString(classification);
-        
-        // Get alternative moves
-        setPosition(*tempBoard);
-        std::vector<std::pair<ChessMove, double>> alternatives = getMoveRecommendations(3);
-        
-        QJsonArray alternativesArray;
-        for (const auto& [altMove, altScore] : alternatives) {
-            QJsonObject altObj;
-            altObj["move"] = QString::fromStdString(altMove.toAlgebraic());
-            altObj["score"] = altScore;
-            altObj["standardNotation"] = QString::fromStdString(altMove.toStandardNotation(*tempBoard));
-            alternativesArray.append(altObj);
+    std::lock_guard<std::mutex> lock(storeMutex);
+    loadSegments();
+    loadSummaries();
+    openActiveSegment();
+    importLegacyFiles();
+    compactLocked();
+}
+
+GameHistoryStore::~GameHistoryStore()
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    activeFile.close();
+    summaryFile.close();
+    readers.clear();
+}
+
+QString GameHistoryStore::segmentPath(int segment) const
+{
+    return directory + QString("/segment-%1.log").arg(segment, 6, 10, QChar('0'));
+}
+
+QString GameHistoryStore::indexPath(int segment) const
+{
+    return directory + QString("/segment-%1.idx").arg(segment, 6, 10, QChar('0'));
+}
+
+QString GameHistoryStore::summaryPath() const
+{
+    return directory + "/summaries.log";
+}
+
+QString GameHistoryStore::analysisPath(const std::string& gameId) const
+{
+    return directory + "/analysis/" + QString::fromStdString(gameId) + ".cbor";
+}
+
+QByteArray GameHistoryStore::frameRecord(const QByteArray& body)
+{
+    QByteArray record(RECORD_HEADER_SIZE, '\0');
+    qToLittleEndian<quint32>(static_cast<quint32>(body.size() + 2), record.data());
+    qToLittleEndian<quint16>(qChecksum(QByteArrayView(body.constData(), body.size())), record.data() + 4);
+    record.append(body);
+    return record;
+}
+
+qsizetype GameHistoryStore::unframeRecord(const char* data, qsizetype available, const char*& body, qsizetype& bodySize)
+{
+    if (available < RECORD_HEADER_SIZE) {
+        return -1;
+    }
+    
+    quint32 length = qFromLittleEndian<quint32>(data);
+    if (length < 2 + 6 || length > MAX_RECORD_SIZE || static_cast<qsizetype>(length) + 4 > available) {
+        return -1;
+    }
+    
+    body = data + RECORD_HEADER_SIZE;
+    bodySize = length - 2;
+    if (qChecksum(QByteArrayView(body, bodySize)) != qFromLittleEndian<quint16>(data + 4)) {
+        return -1;
+    }
+    return static_cast<qsizetype>(length) + 4;
+}
+
+void GameHistoryStore::appendField(QByteArray& body, const std::string& field)
+{
+    char length[2];
+    qToLittleEndian<quint16>(static_cast<quint16>(field.size()), length);
+    body.append(length, 2);
+    body.append(field.data(), static_cast<qsizetype>(field.size()));
+}
+
+bool GameHistoryStore::readField(const char* body, qsizetype bodySize, qsizetype& pos, std::string& field)
+{
+    if (pos + 2 > bodySize) {
+        return false;
+    }
+    quint16 fieldSize = qFromLittleEndian<quint16>(body + pos);
+    pos += 2;
+    if (pos + fieldSize > bodySize) {
+        return false;
+    }
+    field.assign(body + pos, fieldSize);
+    pos += fieldSize;
+    return true;
+}
+
+QByteArray GameHistoryStore::encodeRecord(const std::string& gameId, const std::string& whitePlayer,
+                                          const std::string& blackPlayer, const QByteArray& payload)
+{
+    QByteArray body;
+    for (const std::string* field : { &gameId, &whitePlayer, &blackPlayer }) {
+        appendField(body, *field);
+    }
+    body.append(payload);
+    return frameRecord(body);
+}
+
+qsizetype GameHistoryStore::decodeRecordHeader(const char* data, qsizetype available, RecordHeader& header)
+{
+    const char* body = nullptr;
+    qsizetype bodySize = 0;
+    qsizetype recordSize = unframeRecord(data, available, body, bodySize);
+    if (recordSize < 0) {
+        return -1;
+    }
+    
+    qsizetype pos = 0;
+    for (std::string* field : { &header.gameId, &header.whitePlayer, &header.blackPlayer }) {
+        if (!readField(body, bodySize, pos, *field)) {
+            return -1;
         }
-        
-        moveObj["alternatives"] = alternativesArray;
-        moveAnalysis.append(moveObj);
     }
+    header.payloadOffset = RECORD_HEADER_SIZE + pos;
     
-    analysis["moveAnalysis"] = moveAnalysis;
+    return recordSize;
+}
+
+QByteArray GameHistoryStore::encodeSummary(const GameSummary& summary)
+{
+    // Fixed-size fields first, then the names and the result
+    QByteArray body(SUMMARY_FIXED_SIZE, '\0');
+    char* out = body.data();
+    qToLittleEndian<quint64>(summary.ordinal, out);
+    qToLittleEndian<qint64>(summary.startTime, out + 8);
+    qToLittleEndian<qint64>(summary.endTime, out + 16);
+    qToLittleEndian<qint32>(summary.whiteRating, out + 24);
+    qToLittleEndian<qint32>(summary.blackRating, out + 28);
+    qToLittleEndian<quint16>(static_cast<quint16>(std::min(summary.moveCount, 0xFFFF)), out + 32);
+    for (const std::string* field : { &summary.gameId, &summary.whitePlayer, &summary.blackPlayer, &summary.result }) {
+        appendField(body, *field);
+    }
+    return frameRecord(body);
+}
+
+qsizetype GameHistoryStore::decodeSummary(const char* data, qsizetype available, GameSummary& summary)
+{
+    const char* body = nullptr;
+    qsizetype bodySize = 0;
+    qsizetype recordSize = unframeRecord(data, available, body, bodySize);
+    if (recordSize < 0 || bodySize < SUMMARY_FIXED_SIZE) {
+        return -1;
+    }
     
-    return analysis;
+    summary.ordinal = qFromLittleEndian<quint64>(body);
+    summary.startTime = qFromLittleEndian<qint64>(body + 8);
+    summary.endTime = qFromLittleEndian<qint64>(body + 16);
+    summary.whiteRating = qFromLittleEndian<qint32>(body + 24);
+    summary.blackRating = qFromLittleEndian<qint32>(body + 28);
+    summary.moveCount = qFromLittleEndian<quint16>(body + 32);
+    
+    qsizetype pos = SUMMARY_FIXED_SIZE;
+    for (std::string* field : { &summary.gameId, &summary.whitePlayer, &summary.blackPlayer, &summary.result }) {
+        if (!readField(body, bodySize, pos, *field)) {
+            return -1;
+        }
+    }
+    return recordSize;
 }
 
-void StockfishConnector::sendCommand(const std::string& command) {
-    if (!process || process->state() != QProcess::Running) return;
+GameHistoryStore::GameSummary GameHistoryStore::summarize(const std::string& gameId, const std::string& whitePlayer,
+                                                          const std::string& blackPlayer, const QJsonObject& gameJson,
+                                                          int whiteRating, int blackRating)
+{
+    GameSummary summary;
+    summary.gameId = gameId;
+    summary.whitePlayer = whitePlayer;
+    summary.blackPlayer = blackPlayer;
+    summary.result = gameJson["result"].toString("in_progress").toStdString();
     
-    process->write((command + "\n").c_str());
-    process->waitForBytesWritten();
+    QDateTime startTime = QDateTime::fromString(gameJson["startTime"].toString(), Qt::ISODate);
+    QDateTime endTime = QDateTime::fromString(gameJson["endTime"].toString(), Qt::ISODate);
+    summary.startTime = startTime.isValid() ? startTime.toMSecsSinceEpoch() : 0;
+    summary.endTime = endTime.isValid() ? endTime.toMSecsSinceEpoch() : 0;
+    
+    summary.whiteRating = whiteRating;
+    summary.blackRating = blackRating;
+    summary.moveCount = static_cast<int>(gameJson["moveHistory"].toArray().size());
+    return summary;
 }
 
-std::string StockfishConnector::sendCommandAndGetOutput(const std::string& command, const std::string& terminator) {
-    if (!process || process->state() != QProcess::Running) return "";
+void GameHistoryStore::loadSegments()
+{
+    QDir dir(directory);
+    QStringList filters;
+    filters << "segment-*.log";
+    QStringList files = dir.entryList(filters, QDir::Files, QDir::Name);
+    for (const QString& file : files) {
+        bool ok = false;
+        int segment = file.mid(8, file.size() - 12).toInt(&ok);
+        if (ok) {
+            segments[segment].size = QFileInfo(dir.filePath(file)).size();
+        }
+    }
     
-    process->write((command + "\n").c_str());
-    process->waitForBytesWritten();
+    if (segments.empty()) {
+        segments[1] = SegmentInfo();
+    }
+    activeSegment = segments.rbegin()->first;
     
-    std::string output;
-    QByteArray line;
+    // Oldest first, so a game saved again ends up pointing at its newest record
+    for (const auto& entry : segments) {
+        int segment = entry.first;
+        if (segment == activeSegment) {
+            // It will be appended to again, so any sidecar index is stale
+            QFile::remove(indexPath(segment));
+            scanSegment(segment, true);
+        } else if (!loadSidecarIndex(segment)) {
+            scanSegment(segment, false);
+        }
+    }
+}
+
+bool GameHistoryStore::loadSidecarIndex(int segment)
+{
+    QFile file(indexPath(segment));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray data = file.readAll();
     
-    // Read until we find the terminator
-    while (true) {
-        if (process->waitForReadyRead(5000)) {
-            line = process->readLine();
-            output += line.constData();
-            
-            if (line.contains(terminator.c_str())) {
-                break;
+    // Segment size and entry count, then offset, size and the three names per entry
+    if (data.size() < 12 || qFromLittleEndian<qint64>(data.constData()) != segments[segment].size) {
+        return false;
+    }
+    quint32 count = qFromLittleEndian<quint32>(data.constData() + 8);
+    
+    struct Entry {
+        std::string gameId, whitePlayer, blackPlayer;
+        RecordLocation location;
+    };
+    // A corrupt count must not be trusted for the reservation; each entry takes at least
+    // its offset and size and three empty length-prefixed names
+    static constexpr qsizetype MIN_ENTRY_SIZE = 8 + 3 * 2;
+    std::vector<Entry> entries;
+    entries.reserve(static_cast<size_t>(std::min<qsizetype>(count, (data.size() - 12) / MIN_ENTRY_SIZE)));
+    
+    qsizetype pos = 12;
+    for (quint32 i = 0; i < count; ++i) {
+        if (pos + 8 > data.size()) {
+            return false;
+        }
+        Entry entry;
+        entry.location.segment = segment;
+        entry.location.offset = qFromLittleEndian<quint32>(data.constData() + pos);
+        entry.location.size = qFromLittleEndian<quint32>(data.constData() + pos + 4);
+        pos += 8;
+        for (std::string* field : { &entry.gameId, &entry.whitePlayer, &entry.blackPlayer }) {
+            if (!readField(data.constData(), data.size(), pos, *field)) {
+                return false;
             }
-        } else {
-            break;  // Timeout
         }
+        entries.push_back(std::move(entry));
     }
     
-    return output;
+    // Only index once the whole file has parsed, so a bad sidecar falls back to a scan
+    for (const Entry& entry : entries) {
+        indexRecord(entry.gameId, entry.whitePlayer, entry.blackPlayer, entry.location);
+    }
+    return true;
 }
 
-double StockfishConnector::parseEvaluation(const std::string& evalStr) {
-    if (evalStr.find("mate") != std::string::npos) {
-        // Handle mate scores
-        size_t pos = evalStr.find("mate");
-        std::string mateStr = evalStr.substr(pos + 5);
-        int mateIn = std::stoi(mateStr);
-        
-        return mateIn > 0 ? 100.0 : -100.0;  // Use a large value for mate
-    } else {
-        // Handle centipawn scores
-        size_t pos = evalStr.find("cp");
-        std::string cpStr = evalStr.substr(pos + 3);
-        int cp = std::stoi(cpStr);
+void GameHistoryStore::scanSegment(int segment, bool truncateTornTail)
+{
+    MPChessServer* server = MPChessServer::getInstance();
+    
+    QFile file(segmentPath(segment));
+    if (!file.open(QIODevice::ReadWrite)) {
+        if (server && server->getLogger()) {
+            server->getLogger()->error("GameHistoryStore - Cannot open " + file.fileName().toStdString());
+        }
+        return;
+    }
+    QByteArray data = file.readAll();
+    
+    qsizetype offset = 0;
+    while (offset < data.size()) {
+        RecordHeader header;
+        qsizetype recordSize = decodeRecordHeader(data.constData() + offset, data.size() - offset, header);
+        if (recordSize < 0) {
+            break;
+        }
+        indexRecord(header.gameId, header.whitePlayer, header.blackPlayer,
+                    RecordLocation{ segment, offset, static_cast<quint32>(recordSize) });
+        offset += recordSize;
+    }
+    
+    if (offset < data.size()) {
+        if (server && server->getLogger()) {
+            server->getLogger()->warning("GameHistoryStore - " + std::to_string(data.size() - offset) +
+                                         " unreadable bytes at the end of " + file.fileName().toStdString());
+        }
         
-        return cp / 100.0;  // Convert centipawns to pawns
+        // An append that was cut short; drop it so new records follow the last good one
+        if (truncateTornTail) {
+            file.resize(offset);
+            segments[segment].size = offset;
+        }
     }
 }
 
-std::string StockfishConnector::boardToFen(const ChessBoard& board) {
-    std::stringstream ss;
-    
-    // Piece placement
-    for (int r = 7; r >= 0; --r) {
-        int emptyCount = 0;
-        
-        for (int c = 0; c < 8; ++c) {
-            const ChessPiece* piece = board.getPiece(Position(r, c));
-            
-            if (piece) {
-                if (emptyCount > 0) {
-                    ss << emptyCount;
-                    emptyCount = 0;
-                }
-                
-                char pieceChar = piece->getAsciiChar();
-                ss << pieceChar;
-            } else {
-                emptyCount++;
-            }
+void GameHistoryStore::writeSidecarIndex(int segment)
+{
+    QByteArray data(12, '\0');
+    quint32 count = 0;
+    for (const auto& [gameId, entry] : gameIndex) {
+        if (entry.location.segment != segment) {
+            continue;
         }
-        
-        if (emptyCount > 0) {
-            ss << emptyCount;
+        char location[8];
+        qToLittleEndian<quint32>(static_cast<quint32>(entry.location.offset), location);
+        qToLittleEndian<quint32>(entry.location.size, location + 4);
+        data.append(location, 8);
+        for (const std::string* field : { &gameId, &entry.whitePlayer, &entry.blackPlayer }) {
+            appendField(data, *field);
         }
-        
-        if (r > 0) {
-            ss << "/";
+        ++count;
+    }
+    qToLittleEndian<qint64>(segments[segment].size, data.data());
+    qToLittleEndian<quint32>(count, data.data() + 8);
+    
+    // Written aside and renamed, so a crash never leaves a half-written index
+    QString path = indexPath(segment);
+    QFile file(path + ".tmp");
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(data) == data.size()) {
+        file.close();
+        QFile::remove(path);
+        QFile::rename(path + ".tmp", path);
+    }
+}
+
+void GameHistoryStore::openActiveSegment()
+{
+    activeFile.close();
+    activeFile.setFileName(segmentPath(activeSegment));
+    if (!activeFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        MPChessServer* server = MPChessServer::getInstance();
+        if (server && server->getLogger()) {
+            server->getLogger()->error("GameHistoryStore - Cannot open " + activeFile.fileName().toStdString() + " for writing");
         }
     }
+}
+
+void GameHistoryStore::rollOver()
+{
+    writeSidecarIndex(activeSegment);
     
-    // Active color
-    ss << " " << (board.getCurrentTurn() == PieceColor::WHITE ? "w" : "b") << " ";
+    ++activeSegment;
+    segments[activeSegment] = SegmentInfo();
+    openActiveSegment();
     
-    // Castling availability
-    bool hasWhiteKingside = false;
-    bool hasWhiteQueenside = false;
-    bool hasBlackKingside = false;
-    bool hasBlackQueenside = false;
+    if (!compacting) {
+        compactLocked();
+    }
+}
+
+void GameHistoryStore::loadSummaries()
+{
+    MPChessServer* server = MPChessServer::getInstance();
     
-    // Check white king and rooks
-    const ChessPiece* whiteKing = board.getPiece(Position(0, 4));
-    const ChessPiece* whiteKingsideRook = board.getPiece(Position(0, 7));
-    const ChessPiece* whiteQueensideRook = board.getPiece(Position(0, 0));
+    summaryFile.setFileName(summaryPath());
+    if (!summaryFile.open(QIODevice::ReadWrite)) {
+        if (server && server->getLogger()) {
+            server->getLogger()->error("GameHistoryStore - Cannot open " + summaryFile.fileName().toStdString());
+        }
+        return;
+    }
+    QByteArray data = summaryFile.readAll();
     
-    if (whiteKing && whiteKing->getType() == PieceType::KING && !whiteKing->hasMoved()) {
-        if (whiteKingsideRook && whiteKingsideRook->getType() == PieceType::ROOK && !whiteKingsideRook->hasMoved()) {
-            hasWhiteKingside = true;
+    // A game saved again appends a new summary, so later records win
+    qsizetype offset = 0;
+    while (offset < data.size()) {
+        GameSummary summary;
+        qsizetype recordSize = decodeSummary(data.constData() + offset, data.size() - offset, summary);
+        if (recordSize < 0) {
+            break;
         }
-        
-        if (whiteQueensideRook && whiteQueensideRook->getType() == PieceType::ROOK && !whiteQueensideRook->hasMoved()) {
-            hasWhiteQueenside = true;
+        if (gameIndex.find(summary.gameId) != gameIndex.end()) {
+            nextOrdinal = std::max(nextOrdinal, summary.ordinal + 1);
+            summaries[summary.gameId] = std::move(summary);
         }
+        ++summaryRecords;
+        offset += recordSize;
     }
     
-    // Check black king and rooks
-    const ChessPiece* blackKing = board.getPiece(Position(7, 4));
-    const ChessPiece* blackKingsideRook = board.getPiece(Position(7, 7));
-    const ChessPiece* blackQueensideRook = board.getPiece(Position(7, 0));
+    if (offset < data.size()) {
+        if (server && server->getLogger()) {
+            server->getLogger()->warning("GameHistoryStore - " + std::to_string(data.size() - offset) +
+                                         " unreadable bytes at the end of " + summaryFile.fileName().toStdString());
+        }
+        summaryFile.resize(offset);
+    }
+    summaryFile.seek(offset);
     
-    if (blackKing && blackKing->getType() == PieceType::KING && !blackKing->hasMoved()) {
-        if (blackKingsideRook && blackKingsideRook->getType() == PieceType::ROOK && !blackKingsideRook->hasMoved()) {
-            hasBlackKingside = true;
+    // Games stored before the summary table existed, or whose summary append was lost.
+    // They are numbered in the order they were played
+    std::vector<GameSummary> missing;
+    for (const auto& entry : gameIndex) {
+        if (summaries.find(entry.first) != summaries.end()) {
+            continue;
         }
-        
-        if (blackQueensideRook && blackQueensideRook->getType() == PieceType::ROOK && !blackQueensideRook->hasMoved()) {
-            hasBlackQueenside = true;
+        QJsonObject gameJson;
+        if (loadGameLocked(entry.first, gameJson)) {
+            missing.push_back(summarize(entry.first, entry.second.whitePlayer, entry.second.blackPlayer,
+                                        gameJson, 0, 0));
         }
     }
+    std::sort(missing.begin(), missing.end(), [](const GameSummary& a, const GameSummary& b) {
+        return a.startTime != b.startTime ? a.startTime < b.startTime : a.gameId < b.gameId;
+    });
+    for (GameSummary& summary : missing) {
+        summary.ordinal = nextOrdinal++;
+        appendSummary(summary);
+        summaries[summary.gameId] = std::move(summary);
+    }
     
-    if (hasWhiteKingside) ss << "K";
-    if (hasWhiteQueenside) ss << "Q";
-    if (hasBlackKingside) ss << "k";
-    if (hasBlackQueenside) ss << "q";
+    // Summaries of dropped games and superseded saves are only skipped over at startup;
+    // rewrite the table once they make up most of it
+    if (summaryRecords > 2 * summaries.size() + 1024) {
+        rewriteSummaries();
+    }
     
-    if (!hasWhiteKingside && !hasWhiteQueenside && !hasBlackKingside && !hasBlackQueenside) {
-        ss << "-";
+    for (const auto& entry : summaries) {
+        recordSummary(entry.second);
+    }
+    for (auto& entry : playerGames) {
+        std::sort(entry.second.begin(), entry.second.end(), [](const GameSummary* a, const GameSummary* b) {
+            return a->ordinal < b->ordinal;
+        });
+    }
+}
+
+void GameHistoryStore::rewriteSummaries()
+{
+    std::vector<const GameSummary*> ordered;
+    ordered.reserve(summaries.size());
+    for (const auto& entry : summaries) {
+        ordered.push_back(&entry.second);
     }
+    std::sort(ordered.begin(), ordered.end(), [](const GameSummary* a, const GameSummary* b) {
+        return a->ordinal < b->ordinal;
+    });
     
-    // En passant target square
-    Position enPassantTarget = board.getEnPassantTarget();
-    if (enPassantTarget.isValid()) {
-        ss << " " << enPassantTarget.toAlgebraic();
-    } else {
-        ss << " -";
+    QByteArray data;
+    for (const GameSummary* summary : ordered) {
+        data.append(encodeSummary(*summary));
     }
     
-    // Halfmove clock and fullmove number
-    // For simplicity, we'll use placeholder values
-    ss << " 0 1";
+    // Written aside and renamed, like the sidecar indexes
+    QString path = summaryPath();
+    QFile file(path + ".tmp");
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size()) {
+        return;
+    }
+    file.close();
     
-    return ss.str();
+    summaryFile.close();
+    QFile::remove(path);
+    QFile::rename(path + ".tmp", path);
+    summaryFile.setFileName(path);
+    if (summaryFile.open(QIODevice::ReadWrite)) {
+        summaryFile.seek(summaryFile.size());
+    }
+    summaryRecords = ordered.size();
 }
 
-ChessMove StockfishConnector::parseStockfishMove(const std::string& moveStr, const ChessBoard& board) {
-    if (moveStr.length() < 4) return ChessMove();
+bool GameHistoryStore::appendSummary(const GameSummary& summary)
+{
+    QByteArray record = encodeSummary(summary);
+    if (!summaryFile.isOpen() || summaryFile.write(record) != record.size() || !summaryFile.flush()) {
+        return false;
+    }
+    ++summaryRecords;
+    return true;
+}
+
+void GameHistoryStore::recordSummary(const GameSummary& summary)
+{
+    playerGames[summary.whitePlayer].push_back(&summary);
+    if (summary.blackPlayer != summary.whitePlayer) {
+        playerGames[summary.blackPlayer].push_back(&summary);
+    }
+}
+
+void GameHistoryStore::importLegacyFiles()
+{
+    QDir dir(directory);
+    QStringList filters;
+    filters << "*.json";
+    QStringList files = dir.entryList(filters, QDir::Files);
+    if (files.isEmpty()) {
+        return;
+    }
     
-    Position from(moveStr[1] - '1', moveStr[0] - 'a');
-    Position to(moveStr[3] - '1', moveStr[2] - 'a');
+    int imported = 0;
+    for (const QString& fileName : files) {
+        QFile file(dir.filePath(fileName));
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+        file.close();
+        if (doc.isNull() || !doc.isObject()) {
+            continue;
+        }
+        
+        QJsonObject gameJson = doc.object();
+        std::string gameId = gameJson.contains("gameId") ? gameJson["gameId"].toString().toStdString()
+                                                         : QFileInfo(fileName).completeBaseName().toStdString();
+        if (saveGameLocked(gameId, gameJson["whitePlayer"].toString().toStdString(),
+                           gameJson["blackPlayer"].toString().toStdString(), gameJson, 0, 0)) {
+            QFile::remove(dir.filePath(fileName));
+            ++imported;
+        }
+    }
     
-    // Check for promotion
-    PieceType promotionType = PieceType::EMPTY;
-    if (moveStr.length() > 4) {
-        switch (moveStr[4]) {
-            case 'q': promotionType = PieceType::QUEEN; break;
-            case 'r': promotionType = PieceType::ROOK; break;
-            case 'b': promotionType = PieceType::BISHOP; break;
-            case 'n': promotionType = PieceType::KNIGHT; break;
-            default: break;
+    MPChessServer* server = MPChessServer::getInstance();
+    if (server && server->getLogger()) {
+        server->getLogger()->log("GameHistoryStore - Imported " + std::to_string(imported) + " game files");
+    }
+}
+
+void GameHistoryStore::indexRecord(const std::string& gameId, const std::string& whitePlayer,
+                                   const std::string& blackPlayer, const RecordLocation& location)
+{
+    auto it = gameIndex.find(gameId);
+    if (it != gameIndex.end()) {
+        segments[it->second.location.segment].liveBytes -= it->second.location.size;
+        it->second.location = location;
+    } else {
+        gameIndex.emplace(gameId, IndexEntry{ whitePlayer, blackPlayer, location });
+    }
+    segments[location.segment].liveBytes += location.size;
+}
+
+bool GameHistoryStore::appendRecord(const QByteArray& record, RecordLocation& location)
+{
+    if (segments[activeSegment].size > 0 && segments[activeSegment].size + record.size() > SEGMENT_SIZE) {
+        rollOver();
+    }
+    
+    if (!activeFile.isOpen() || activeFile.write(record) != record.size() || !activeFile.flush()) {
+        return false;
+    }
+    
+    location.segment = activeSegment;
+    location.offset = segments[activeSegment].size;
+    location.size = static_cast<quint32>(record.size());
+    segments[activeSegment].size += record.size();
+    return true;
+}
+
+QByteArray GameHistoryStore::readRecord(const RecordLocation& location)
+{
+    std::unique_ptr<QFile>& reader = readers[location.segment];
+    if (!reader) {
+        reader = std::make_unique<QFile>(segmentPath(location.segment));
+        if (!reader->open(QIODevice::ReadOnly)) {
+            reader.reset();
+            return QByteArray();
         }
     }
     
-    return ChessMove(from, to, promotionType);
+    if (!reader->seek(location.offset)) {
+        return QByteArray();
+    }
+    QByteArray record = reader->read(location.size);
+    return record.size() == static_cast<qsizetype>(location.size) ? record : QByteArray();
 }
 
-// Implementation of ChessLeaderboard class
-ChessLeaderboard::ChessLeaderboard(const std::string& dataPath) : dataPath(dataPath) {
-    refreshLeaderboard();
+bool GameHistoryStore::saveGame(const std::string& gameId, const std::string& whitePlayer,
+                                const std::string& blackPlayer, const QJsonObject& gameJson,
+                                int whiteRating, int blackRating)
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    return saveGameLocked(gameId, whitePlayer, blackPlayer, gameJson, whiteRating, blackRating);
 }
 
-void ChessLeaderboard::updatePlayer(const ChessPlayer& player) {
-    std::lock_guard<std::mutex> lock(leaderboardMutex);
+bool GameHistoryStore::saveGameLocked(const std::string& gameId, const std::string& whitePlayer,
+                                      const std::string& blackPlayer, const QJsonObject& gameJson,
+                                      int whiteRating, int blackRating)
+{
+    QByteArray record = encodeRecord(gameId, whitePlayer, blackPlayer, QCborValue::fromJsonValue(gameJson).toCbor());
+    if (record.size() > static_cast<qsizetype>(MAX_RECORD_SIZE)) {
+        return false;
+    }
     
-    std::string username = player.getUsername();
-    int rating = player.getRating();
-    int wins = player.getWins();
-    int losses = player.getLosses();
-    int draws = player.getDraws();
-    double winPercentage = player.getGamesPlayed() > 0 ? 
-        (static_cast<double>(wins) / player.getGamesPlayed()) * 100.0 : 0.0;
-    
-    // Check if player already exists in leaderboard
-    auto it = std::find_if(leaderboardData.begin(), leaderboardData.end(),
-                          [&username](const auto& entry) {
-                              return std::get<0>(entry) == username;
-                          });
-    
-    if (it != leaderboardData.end()) {
-        // Update existing player
-        *it = std::make_tuple(username, rating, wins, losses, draws, winPercentage);
-    } else {
-        // Add new player
-        leaderboardData.emplace_back(username, rating, wins, losses, draws, winPercentage);
+    RecordLocation location;
+    if (!appendRecord(record, location)) {
+        return false;
     }
+    indexRecord(gameId, whitePlayer, blackPlayer, location);
     
-    // Re-sort the leaderboard
-    sortByRating();
+    // A game saved again keeps its place in the players' histories
+    GameSummary summary = summarize(gameId, whitePlayer, blackPlayer, gameJson, whiteRating, blackRating);
+    auto it = summaries.find(gameId);
+    if (it != summaries.end()) {
+        summary.ordinal = it->second.ordinal;
+        appendSummary(summary);
+        it->second = std::move(summary);
+    } else {
+        summary.ordinal = nextOrdinal++;
+        appendSummary(summary);
+        recordSummary(summaries.emplace(gameId, std::move(summary)).first->second);
+    }
+    return true;
 }
 
-std::vector<std::pair<std::string, int>> ChessLeaderboard::getTopPlayersByRating(int count) {
-    std::lock_guard<std::mutex> lock(leaderboardMutex);
+bool GameHistoryStore::loadGame(const std::string& gameId, QJsonObject& gameJson)
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    return loadGameLocked(gameId, gameJson);
+}
+
+bool GameHistoryStore::loadGameLocked(const std::string& gameId, QJsonObject& gameJson)
+{
+    auto it = gameIndex.find(gameId);
+    if (it == gameIndex.end()) {
+        return false;
+    }
     
-    // Sort by rating
-    sortByRating();
+    QByteArray record = readRecord(it->second.location);
+    RecordHeader header;
+    if (decodeRecordHeader(record.constData(), record.size(), header) < 0 || header.gameId != gameId) {
+        return false;
+    }
     
-    // Extract top players
-    std::vector<std::pair<std::string, int>> topPlayers;
-    int numPlayers = (count == -1) ? leaderboardData.size() : 
-                     std::min(static_cast<int>(leaderboardData.size()), count);
+    QCborValue payload = QCborValue::fromCbor(record.mid(header.payloadOffset));
+    gameJson = payload.toJsonValue().toObject();
+    return !gameJson.isEmpty();
+}
+
+bool GameHistoryStore::contains(const std::string& gameId) const
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    return gameIndex.find(gameId) != gameIndex.end();
+}
+
+bool GameHistoryStore::saveAnalysis(const std::string& gameId, const QJsonObject& analysis)
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
     
-    for (int i = 0; i < numPlayers; ++i) {
-        const auto& [username, rating, wins, losses, draws, winPercentage] = leaderboardData[i];
-        topPlayers.emplace_back(username, rating);
+    // Only stored games get an analysis file; their ids are safe to use as file names
+    if (gameIndex.find(gameId) == gameIndex.end()) {
+        return false;
     }
     
-    return topPlayers;
+    QDir().mkpath(directory + "/analysis");
+    
+    QSaveFile file(analysisPath(gameId));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QCborValue::fromJsonValue(analysis).toCbor());
+    return file.commit();
 }
 
-std::vector<std::pair<std::string, int>> ChessLeaderboard::getTopPlayersByWins(int count) {
-    std::lock_guard<std::mutex> lock(leaderboardMutex);
+bool GameHistoryStore::loadAnalysis(const std::string& gameId, QJsonObject& analysis) const
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
     
-    // Sort by wins
-    sortByWins();
+    if (gameIndex.find(gameId) == gameIndex.end()) {
+        return false;
+    }
     
-    // Extract top players
-    std::vector<std::pair<std::string, int>> topPlayers;
-    int numPlayers = (count == -1) ? leaderboardData.size() : 
-                     std::min(static_cast<int>(leaderboardData.size()), count);
+    QFile file(analysisPath(gameId));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
     
-    for (int i = 0; i < numPlayers; ++i) {
-        const auto& [username, rating, wins, losses, draws, winPercentage] = leaderboardData[i];
-        topPlayers.emplace_back(username, wins);
+    QCborValue value = QCborValue::fromCbor(file.readAll());
+    if (!value.isMap()) {
+        return false;
     }
+    analysis = value.toJsonValue().toObject();
+    return !analysis.isEmpty();
+}
+
+std::vector<GameHistoryStore::GameSummary> GameHistoryStore::getAllSummaries() const
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
     
-    return topPlayers;
+    std::vector<GameSummary> all;
+    all.reserve(summaries.size());
+    for (const auto& entry : summaries) {
+        all.push_back(entry.second);
+    }
+    std::sort(all.begin(), all.end(), [](const GameSummary& a, const GameSummary& b) {
+        return a.ordinal < b.ordinal;
+    });
+    return all;
 }
 
-std::vector<std::pair<std::string, double>> ChessLeaderboard::getTopPlayersByWinPercentage(int count) {
-    std::lock_guard<std::mutex> lock(leaderboardMutex);
+std::vector<int> GameHistoryStore::getSegmentIds() const
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
     
-    // Sort by win percentage
-    sortByWinPercentage();
+    std::vector<int> ids;
+    ids.reserve(segments.size());
+    for (const auto& entry : segments) {
+        ids.push_back(entry.first);
+    }
+    return ids;
+}
+
+void GameHistoryStore::forEachGameInSegment(int segment, const std::function<bool(const GameSummary&)>& filter,
+                                            const std::function<bool(const GameSummary&, const QJsonObject&)>& fn) const
+{
+    // Note where the wanted records are, then read them without holding up the store
+    std::vector<std::pair<RecordLocation, GameSummary>> wanted;
+    {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        for (const auto& [gameId, entry] : gameIndex) {
+            if (entry.location.segment != segment) {
+                continue;
+            }
+            auto summary = summaries.find(gameId);
+            if (summary != summaries.end() && filter(summary->second)) {
+                wanted.emplace_back(entry.location, summary->second);
+            }
+        }
+    }
+    std::sort(wanted.begin(), wanted.end(), [](const auto& a, const auto& b) {
+        return a.first.offset < b.first.offset;
+    });
     
-    // Extract top players (minimum 10 games)
-    std::vector<std::pair<std::string, double>> topPlayers;
-    int added = 0;
+    // A segment compacted away in the meantime has nothing left to read
+    QFile file(segmentPath(segment));
+    if (wanted.empty() || !file.open(QIODevice::ReadOnly)) {
+        return;
+    }
     
-    for (const auto& entry : leaderboardData) {
-        const auto& [username, rating, wins, losses, draws, winPercentage] = entry;
+    for (const auto& [location, summary] : wanted) {
+        if (!file.seek(location.offset)) {
+            break;
+        }
+        QByteArray record = file.read(location.size);
+        RecordHeader header;
+        if (record.size() != static_cast<qsizetype>(location.size) ||
+            decodeRecordHeader(record.constData(), record.size(), header) < 0 || header.gameId != summary.gameId) {
+            continue;
+        }
         
-        // Only include players with at least 10 games
-        if (wins + losses + draws >= 10) {
-            topPlayers.emplace_back(username, winPercentage);
-            added++;
-            
-            if (count != -1 && added >= count) {
-                break;
-            }
+        QJsonObject gameJson = QCborValue::fromCbor(record.mid(header.payloadOffset)).toJsonValue().toObject();
+        if (!gameJson.isEmpty() && !fn(summary, gameJson)) {
+            break;
         }
     }
-    
-    return topPlayers;
 }
 
-int ChessLeaderboard::getPlayerRatingRank(const std::string& username) {
-    std::lock_guard<std::mutex> lock(leaderboardMutex);
+size_t GameHistoryStore::size() const
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    return gameIndex.size();
+}
+
+void GameHistoryStore::forEachGameOfPlayer(const std::string& username,
+                                           const std::function<bool(const QJsonObject&)>& fn)
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
     
-    // Sort by rating
-    sortByRating();
+    auto it = playerGames.find(username);
+    if (it == playerGames.end()) {
+        return;
+    }
     
-    // Find player's rank
-    for (size_t i = 0; i < leaderboardData.size(); ++i) {
-        if (std::get<0>(leaderboardData[i]) == username) {
-            return static_cast<int>(i) + 1;  // Ranks are 1-based
+    for (const GameSummary* summary : it->second) {
+        QJsonObject gameJson;
+        if (loadGameLocked(summary->gameId, gameJson) && !fn(gameJson)) {
+            break;
         }
     }
-    
-    return -1;  // Player not found
 }
 
-int ChessLeaderboard::getPlayerWinsRank(const std::string& username) {
-    std::lock_guard<std::mutex> lock(leaderboardMutex);
+std::vector<GameHistoryStore::GameSummary> GameHistoryStore::getPlayerGames(const std::string& username, quint64 cursor,
+                                                                            int limit, quint64& nextCursor) const
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
     
-    // Sort by wins
-    sortByWins();
+    std::vector<GameSummary> page;
+    nextCursor = 0;
     
-    // Find player's rank
-    for (size_t i = 0; i < leaderboardData.size(); ++i) {
-        if (std::get<0>(leaderboardData[i]) == username) {
-            return static_cast<int>(i) + 1;  // Ranks are 1-based
-        }
+    auto it = playerGames.find(username);
+    if (it == playerGames.end() || limit <= 0) {
+        return page;
+    }
+    const std::vector<const GameSummary*>& games = it->second;
+    
+    // Games are in ordinal order; start below the cursor and walk back to older games
+    auto end = cursor == 0 ? games.end()
+                           : std::lower_bound(games.begin(), games.end(), cursor,
+                                              [](const GameSummary* summary, quint64 value) {
+                                                  return summary->ordinal < value;
+                                              });
+    size_t available = static_cast<size_t>(end - games.begin());
+    size_t count = std::min(available, static_cast<size_t>(limit));
+    page.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        page.push_back(*games[available - 1 - i]);
     }
     
-    return -1;  // Player not found
+    if (count < available) {
+        nextCursor = page.back().ordinal;
+    }
+    return page;
 }
 
-int ChessLeaderboard::getPlayerWinPercentageRank(const std::string& username) {
-    std::lock_guard<std::mutex> lock(leaderboardMutex);
-    
-    // Sort by win percentage
-    sortByWinPercentage();
-    
-    // Find player's rank (only counting players with at least 10 games)
-    int rank = 1;
+void GameHistoryStore::forEachGame(const std::function<bool(const QJsonObject&)>& fn)
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
     
-    for (const auto& entry : leaderboardData) {
-        const auto& [entryUsername, rating, wins, losses, draws, winPercentage] = entry;
-        
-        // Only count players with at least 10 games
-        if (wins + losses + draws >= 10) {
-            if (entryUsername == username) {
-                return rank;
-            }
-            rank++;
+    for (const auto& entry : gameIndex) {
+        QJsonObject gameJson;
+        if (loadGameLocked(entry.first, gameJson) && !fn(gameJson)) {
+            break;
         }
     }
-    
-    return -1;  // Player not found or doesn't have enough games
 }
 
-QJsonObject ChessLeaderboard::generateLeaderboardJson(int count) {
-    std::lock_guard<std::mutex> lock(leaderboardMutex);
-    
-    QJsonObject leaderboardJson;
-    
-    // Top players by rating
-    sortByRating();
-    QJsonArray ratingLeaderboard;
-    int numPlayers = (count == -1) ? leaderboardData.size() : 
-                     std::min(static_cast<int>(leaderboardData.size()), count);
+void GameHistoryStore::compact()
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    compactLocked();
+}
+
+void GameHistoryStore::compactLocked()
+{
+    compacting = true;
     
-    for (int i = 0; i < numPlayers; ++i) {
-        const auto& [username, rating, wins, losses, draws, winPercentage] = leaderboardData[i];
+    for (auto it = segments.begin(); it != segments.end(); ) {
+        int segment = it->first;
+        if (segment == activeSegment || it->second.liveBytes * 2 > it->second.size) {
+            ++it;
+            continue;
+        }
+        
+        // Copy the live records forward; the old segment goes only once all are moved
+        bool moved = true;
+        for (auto& [gameId, entry] : gameIndex) {
+            if (entry.location.segment != segment) {
+                continue;
+            }
+            QByteArray record = readRecord(entry.location);
+            RecordLocation location;
+            if (record.isEmpty() || !appendRecord(record, location)) {
+                moved = false;
+                break;
+            }
+            segments[segment].liveBytes -= entry.location.size;
+            segments[location.segment].liveBytes += location.size;
+            entry.location = location;
+        }
         
-        QJsonObject playerObj;
-        playerObj["rank"] = i + 1;
-        playerObj["username"] = QString::fromStdString(username);
-        playerObj["rating"] = rating;
-        playerObj["wins"] = wins;
-        playerObj["losses"] = losses;
-        playerObj["draws"] = draws;
-        playerObj["gamesPlayed"] = wins + losses + draws;
-        playerObj["winPercentage"] = winPercentage;
+        if (!moved) {
+            ++it;
+            continue;
+        }
         
-        ratingLeaderboard.append(playerObj);
+        readers.erase(segment);
+        QFile::remove(segmentPath(segment));
+        QFile::remove(indexPath(segment));
+        it = segments.erase(it);
     }
     
-    leaderboardJson["byRating"] = ratingLeaderboard;
+    compacting = false;
+}
+
+// Implementation of ClusterDirectory class
+ClusterDirectory::ClusterDirectory(const std::string& rootPath, const std::string& nodeId,
+                                   const std::string& host, int port)
+    : root(QString::fromStdString(rootPath)), nodeId(nodeId), host(host), port(port), open(false)
+{
+    open = root.mkpath("nodes") && root.mkpath("sessions") && root.mkpath("events") && root.mkpath("games");
     
-    // Top players by wins
-    sortByWins();
-    QJsonArray winsLeaderboard;
+    NodeInfo self;
+    self.nodeId = nodeId;
+    self.host = host;
+    self.port = port;
+    liveNodes.push_back(self);
+}
+
+bool ClusterDirectory::isOpen() const {
+    return open;
+}
+
+const std::string& ClusterDirectory::getNodeId() const {
+    return nodeId;
+}
+
+void ClusterDirectory::heartbeat(int players, int games) {
+    if (!open) {
+        return;
+    }
     
-    for (int i = 0; i < numPlayers; ++i) {
-        const auto& [username, rating, wins, losses, draws, winPercentage] = leaderboardData[i];
-        
-        QJsonObject playerObj;
-        playerObj["rank"] = i + 1;
-        playerObj["username"] = QString::fromStdString(username);
-        playerObj["rating"] = rating;
-        playerObj["wins"] = wins;
-        playerObj["losses"] = losses;
-        playerObj["draws"] = draws;
-        playerObj["gamesPlayed"] = wins + losses + draws;
-        playerObj["winPercentage"] = winPercentage;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QJsonObject record;
+    record["nodeId"] = QString::fromStdString(nodeId);
+    record["host"] = QString::fromStdString(host);
+    record["port"] = port;
+    record["players"] = players;
+    record["games"] = games;
+    record["heartbeat"] = now;
+    
+    QSaveFile file(nodePath(nodeId));
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(record).toJson(QJsonDocument::Compact));
+        file.commit();
+    }
+    
+    // Heartbeats are stamped by the writer's clock, so the nodes' clocks must agree
+    // to within a fraction of NODE_TIMEOUT_MS
+    std::vector<NodeInfo> nodes;
+    QDir nodesDir(root.filePath("nodes"));
+    for (const QString& name : nodesDir.entryList(QStringList{"*.json"}, QDir::Files)) {
+        QFile nodeFile(nodesDir.filePath(name));
+        if (!nodeFile.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        QJsonObject json = QJsonDocument::fromJson(nodeFile.readAll()).object();
         
-        winsLeaderboard.append(playerObj);
+        NodeInfo node;
+        node.nodeId = json["nodeId"].toString().toStdString();
+        node.host = json["host"].toString().toStdString();
+        node.port = json["port"].toInt();
+        node.players = json["players"].toInt();
+        node.games = json["games"].toInt();
+        node.heartbeat = json["heartbeat"].toInteger();
+        if (!node.nodeId.empty() && now - node.heartbeat <= NODE_TIMEOUT_MS) {
+            nodes.push_back(node);
+        }
     }
     
-    leaderboardJson["byWins"] = winsLeaderboard;
-    
-    // Top players by win percentage (minimum 10 games)
-    sortByWinPercentage();
-    QJsonArray winPercentageLeaderboard;
-    int added = 0;
-    
-    for (const auto& entry : leaderboardData) {
-        const auto& [username, rating, wins, losses, draws, winPercentage] = entry;
-        
-        // Only include players with at least 10 games
-        if (wins + losses + draws >= 10) {
-            QJsonObject playerObj;
-            playerObj["rank"] = added + 1;
-            playerObj["username"] = QString::fromStdString(username);
-            playerObj["rating"] = rating;
-            playerObj["wins"] = wins;
-            playerObj["losses"] = losses;
-            playerObj["draws"] = draws;
-            playerObj["gamesPlayed"] = wins + losses + draws;
-            playerObj["winPercentage"] = winPercentage;
-            
-            winPercentageLeaderboard.append(playerObj);
-            added++;
-            
-            if (count != -1 && added >= count) {
-                break;
-            }
+    std::sort(nodes.begin(), nodes.end(), [](const NodeInfo& a, const NodeInfo& b) {
+        return a.nodeId < b.nodeId;
+    });
+    if (!nodes.empty()) {
+        liveNodes = std::move(nodes);
+    }
+}
+
+void ClusterDirectory::leave() {
+    if (open) {
+        QFile::remove(nodePath(nodeId));
+    }
+}
+
+const std::vector<ClusterDirectory::NodeInfo>& ClusterDirectory::getLiveNodes() const {
+    return liveNodes;
+}
+
+ClusterDirectory::NodeInfo ClusterDirectory::ownerOf(const std::string& key) const {
+    const NodeInfo* owner = &liveNodes.front();
+    uint64_t ownerHash = rendezvousHash(owner->nodeId, key);
+    for (const NodeInfo& node : liveNodes) {
+        uint64_t hash = rendezvousHash(node.nodeId, key);
+        if (hash > ownerHash) {
+            owner = &node;
+            ownerHash = hash;
         }
     }
-    
-    leaderboardJson["byWinPercentage"] = winPercentageLeaderboard;
-    
-    // Add total player count
-    leaderboardJson["totalPlayers"] = static_cast<int>(leaderboardData.size());
-    
-    // Add timestamp
-    leaderboardJson["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
-    
-    return leaderboardJson;
+    return *owner;
 }
 
-void ChessLeaderboard::refreshLeaderboard() {
-    std::lock_guard<std::mutex> lock(leaderboardMutex);
-    
-    // Clear existing data
-    leaderboardData.clear();
-    
-    // Load player data
-    loadPlayerData();
-    
-    // Sort by rating
-    sortByRating();
+bool ClusterDirectory::isLocal(const NodeInfo& node) const {
+    return node.nodeId == nodeId;
 }
 
-void ChessLeaderboard::loadPlayerData() {
-    QDir dir(QString::fromStdString(dataPath));
-    QStringList filters;
-    filters << "player_*.json";
-    QStringList files = dir.entryList(filters, QDir::Files);
-    
-    for (const QString& file : files) {
-        QFile jsonFile(dir.filePath(file));
-        if (jsonFile.open(QIODevice::ReadOnly)) {
-            QByteArray data = jsonFile.readAll();
-            QJsonDocument doc = QJsonDocument::fromJson(data);
-            
-            if (!doc.isNull() && doc.isObject()) {
-                QJsonObject playerJson = doc.object();
-                
-                std::string username = playerJson["username"].toString().toStdString();
-                int rating = playerJson["rating"].toInt();
-                int wins = playerJson["wins"].toInt();
-                int losses = playerJson["losses"].toInt();
-                int draws = playerJson["draws"].toInt();
-                double winPercentage = (wins + losses + draws > 0) ? 
-                    (static_cast<double>(wins) / (wins + losses + draws)) * 100.0 : 0.0;
-                
-                leaderboardData.emplace_back(username, rating, wins, losses, draws, winPercentage);
-            }
+bool ClusterDirectory::pickOtherNode(const std::string& key, NodeInfo& node) const {
+    bool found = false;
+    uint64_t bestHash = 0;
+    for (const NodeInfo& candidate : liveNodes) {
+        uint64_t hash = rendezvousHash(candidate.nodeId, key);
+        if (!isLocal(candidate) && (!found || hash > bestHash)) {
+            node = candidate;
+            bestHash = hash;
+            found = true;
         }
     }
+    return found;
 }
 
-void ChessLeaderboard::sortByRating() {
-    std::sort(leaderboardData.begin(), leaderboardData.end(),
-             [](const auto& a, const auto& b) {
-                 return std::get<1>(a) > std::get<1>(b);  // Sort by rating (descending)
-             });
+bool ClusterDirectory::saveHandoff(const std::string& gameId, const QJsonObject& handoff) {
+    QSaveFile file(handoffPath(gameId));
+    if (!open || !file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(handoff).toJson(QJsonDocument::Compact));
+    return file.commit();
 }
 
-void ChessLeaderboard::sortByWins() {
-    std::sort(leaderboardData.begin(), leaderboardData.end(),
-             [](const auto& a, const auto& b) {
-                 return std::get<2>(a) > std::get<2>(b);  // Sort by wins (descending)
-             });
+bool ClusterDirectory::loadHandoff(const std::string& gameId, QJsonObject& handoff) const {
+    QFile file(handoffPath(gameId));
+    if (!open || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    if (!doc.isObject()) {
+        return false;
+    }
+    handoff = doc.object();
+    return true;
 }
 
-void ChessLeaderboard::sortByWinPercentage() {
-    std::sort(leaderboardData.begin(), leaderboardData.end(),
-             [](const auto& a, const auto& b) {
-                 return std::get<5>(a) > std::get<5>(b);  // Sort by win percentage (descending)
-             });
+void ClusterDirectory::removeHandoff(const std::string& gameId) {
+    if (open) {
+        QFile::remove(handoffPath(gameId));
+    }
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Main function to control the server
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-int main(int argc, char *argv[])
-{
-    QCoreApplication app(argc, argv);
-    
-    // Parse command line arguments
-    QCommandLineParser parser;
-    parser.setApplicationDescription("Multiplayer Chess Server");
-    parser.addHelpOption();
-    
-    QCommandLineOption portOption(QStringList() << "p" << "port",
-                                 "Port to listen on (default: 5000)",
-                                 "port", "5000");
-    parser.addOption(portOption);
+void ClusterDirectory::setSession(const std::string& username, const std::string& gameId) {
+    if (!open) {
+        return;
+    }
     
-    QCommandLineOption stockfishOption(QStringList() << "s" << "stockfish",
-                                     "Path to Stockfish chess engine",
-                                     "path");
-    parser.addOption(stockfishOption);
+    QJsonObject session;
+    session["nodeId"] = QString::fromStdString(nodeId);
+    session["gameId"] = QString::fromStdString(gameId);
     
-    QCommandLineOption stockfishDepthOption(QStringList() << "d" << "depth",
-                                          "Stockfish analysis depth (default: 15)",
-                                          "depth", "15");
-    parser.addOption(stockfishDepthOption);
+    QSaveFile file(sessionPath(username));
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(session).toJson(QJsonDocument::Compact));
+        file.commit();
+    }
+}
+
+void ClusterDirectory::clearSession(const std::string& username) {
+    // The player may have started a game on another node since; that session stays
+    QFile file(sessionPath(username));
+    if (!open || !file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QJsonObject session = QJsonDocument::fromJson(file.readAll()).object();
+    file.close();
     
-    QCommandLineOption stockfishSkillOption(QStringList() << "skill",
-                                          "Stockfish skill level 0-20 (default: 20)",
-                                          "skill", "20");
-    parser.addOption(stockfishSkillOption);
+    if (session["nodeId"].toString().toStdString() == nodeId) {
+        QFile::remove(sessionPath(username));
+    }
+}
+
+bool ClusterDirectory::findSession(const std::string& username, NodeInfo& node, std::string& gameId) const {
+    QFile file(sessionPath(username));
+    if (!open || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QJsonObject session = QJsonDocument::fromJson(file.readAll()).object();
     
-    QCommandLineOption logLevelOption(QStringList() << "l" << "log-level",
-                                    "Log level (0-3, default: 2)",
-                                    "level", "2");
-    parser.addOption(logLevelOption);
+    // A session on a node that has gone is over
+    std::string sessionNode = session["nodeId"].toString().toStdString();
+    for (const NodeInfo& liveNode : liveNodes) {
+        if (liveNode.nodeId == sessionNode) {
+            node = liveNode;
+            gameId = session["gameId"].toString().toStdString();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ClusterDirectory::publish(const QJsonObject& event) {
+    publish(std::vector<QJsonObject>{ event });
+}
+
+void ClusterDirectory::publish(const std::vector<QJsonObject>& events) {
+    if (!open || events.empty()) {
+        return;
+    }
     
-    parser.process(app);
+    // One write for all the lines; readers only take lines that end in a newline
+    QByteArray lines;
+    for (const QJsonObject& event : events) {
+        lines.append(QJsonDocument(event).toJson(QJsonDocument::Compact));
+        lines.append('\n');
+    }
     
-    int port = parser.value(portOption).toInt();
-    std::string stockfishPath = parser.value(stockfishOption).toStdString();
-    int logLevel = parser.value(logLevelOption).toInt();
+    QFile file(eventLogPath(nodeId));
+    if (file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        file.write(lines);
+    }
+}
+
+std::vector<QJsonObject> ClusterDirectory::poll() {
+    std::vector<QJsonObject> events;
+    if (!open) {
+        return events;
+    }
     
-    try {
-        // Create and start the server
-        MPChessServer server(nullptr, stockfishPath);
-        
-        // Set log level
-        if (server.getLogger()) {
-            server.getLogger()->setLogLevel(logLevel);
-            server.getLogger()->log("Log level set to " + std::to_string(logLevel), true);
+    QDir eventsDir(root.filePath("events"));
+    QString ownLog = fileName(nodeId) + ".log";
+    for (const QString& name : eventsDir.entryList(QStringList{"*.log"}, QDir::Files)) {
+        if (name == ownLog) {
+            continue;
         }
         
-        // Configure Stockfish if it was initialized
-        if (server.stockfishConnector && server.stockfishConnector->isInitialized()) {
-            if (parser.isSet(stockfishDepthOption)) {
-                int depth = parser.value(stockfishDepthOption).toInt();
-                server.stockfishConnector->setDepth(depth);
-                server.getLogger()->log("Stockfish depth set to " + std::to_string(depth), true);
-            }
-            
-            if (parser.isSet(stockfishSkillOption)) {
-                int skill = parser.value(stockfishSkillOption).toInt();
-                server.stockfishConnector->setSkillLevel(skill);
-                server.getLogger()->log("Stockfish skill level set to " + std::to_string(skill), true);
-            }
+        QFile file(eventsDir.filePath(name));
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
         }
         
-        if (!server.start(port)) {
-            std::cerr << "Failed to start server on port " << port << std::endl;
-            return 1;
+        // A log shorter than what was read was replaced, so it is read again from the start
+        qint64& offset = eventOffsets[name];
+        if (file.size() < offset) {
+            offset = 0;
+        }
+        if (!file.seek(offset)) {
+            continue;
         }
         
-        std::cout << "Server started on port " << port << std::endl;
-        std::cout << "Press Ctrl+C to quit" << std::endl;
+        QByteArray data = file.readAll();
+        int end = data.lastIndexOf('\n');
+        if (end < 0) {
+            continue;  // The line being written is not complete yet
+        }
+        offset += end + 1;
         
-        return app.exec();
-    } catch (const std::exception& e) {
-        std::cerr << "Fatal error: " << e.what() << std::endl;
-        return 1;
-    } catch (...) {
-        std::cerr << "Unknown fatal error" << std::endl;
-        return 1;
+        int start = 0;
+        while (start < end) {
+            int lineEnd = data.indexOf('\n', start);
+            QJsonDocument doc = QJsonDocument::fromJson(data.mid(start, lineEnd - start));
+            if (doc.isObject()) {
+                events.push_back(doc.object());
+            }
+            start = lineEnd + 1;
+        }
     }
-}
\ No newline at end of file
+    return events;
+}
+
+QString ClusterDirectory::nodePath(const std::string& id) const {
+    return root.filePath("nodes/" + fileName(id) + ".json");
+}
+
+QString ClusterDirectory::sessionPath(const std::string& username) const {
+    return root.filePath("sessions/" + fileName(username) + ".json");
+}
+
+QString ClusterDirectory::eventLogPath(const std::string& id) const {
+    return root.filePath("events/" + fileName(id) + ".log");
+}
+
+QString ClusterDirectory::handoffPath(const std::string& gameId) const {
+    return root.filePath("games/" + fileName(gameId) + ".json");
+}
+
+QString ClusterDirectory::fileName(const std::string& name) {
+    return QString::fromLatin1(QUrl::toPercentEncoding(QString::fromStdString(name), QByteArray(), "."));
+}
+
+uint64_t ClusterDirectory::rendezvousHash(const std::string& nodeId, const std::string& key) {
+    // FNV-1a over node and key, then a finalizer so nearby keys spread over all nodes;
+    // qHash is seeded per process and would not agree between nodes
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const std::string& text) {
+        for (unsigned char c : text) {
+            hash = (hash ^ c) * 0x100000001b3ULL;
+        }
+        hash = (hash ^ 0xff) * 0x100000001b3ULL;
+    };
+    mix(nodeId);
+    mix(key);
+    
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
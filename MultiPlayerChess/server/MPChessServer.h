@@ -12,13 +12,19 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QtEndian>
 #include <QFile>
+#include <QSaveFile>
 #include <QDir>
+#include <QFileInfo>
 #include <QMap>
 #include <QSet>
 #include <QQueue>
 #include <QRandomGenerator>
 #include <QCryptographicHash>
+#include <QPasswordDigestor>
 #include <QMutex>
 #include <QThread>
 #include <QThreadPool>
@@ -29,6 +35,9 @@
 #include <QSslCertificate>
 #include <QHostAddress>
 #include <QNetworkInterface>
+#include <QHostInfo>
+#include <QUrl>
+#include <QSocketNotifier>
 #include <QCommandLineParser>
 #include <QLoggingCategory>
 #include <QProcess>
@@ -39,7 +48,9 @@
 #include <array>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -54,6 +65,22 @@
 #include <iomanip>
 #include <set>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+#include <atomic>
+#include <cstring>
+#include <cctype>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <queue>
+#include <deque>
+#include <future>
+#include <csignal>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 // Forward declarations
 class ChessGame;
@@ -69,6 +96,7 @@ class ChessLogger;
 class ChessAuthenticator;
 class ChessSerializer;
 class MoveRecommendationTask;
+class GameHistoryStore;
 
 /**
  * @brief Enum representing the type of chess piece
@@ -152,7 +180,14 @@ enum class MessageType {
     DRAW_OFFER,
     DRAW_RESPONSE,
     LEADERBOARD_REQUEST,
-    LEADERBOARD_RESPONSE
+    LEADERBOARD_RESPONSE,
+    GAME_STATE_DELTA,
+    GAME_STATE_REQUEST,
+    SPECTATE,
+    GAME_ANALYSIS_PROGRESS,
+    NODE_REDIRECT,
+    TOURNAMENT,
+    TOURNAMENT_STATUS
 };
 
 /**
@@ -193,71 +228,532 @@ struct Position {
     }
 };
 
+// Number of Zobrist keys: 12 * 64 piece keys, 16 castling keys, 8 en passant file keys, 1 side key
+constexpr int ZOBRIST_KEY_COUNT = 12 * 64 + 16 + 8 + 1;
+
+// SplitMix64 step, used to fill the Zobrist table deterministically
+constexpr uint64_t splitMix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Generate the Zobrist table at compile time
+constexpr std::array<uint64_t, ZOBRIST_KEY_COUNT> generateZobristKeys() {
+    std::array<uint64_t, ZOBRIST_KEY_COUNT> keys{};
+    uint64_t seed = 0x4D50436865737321ULL;
+    for (int i = 0; i < ZOBRIST_KEY_COUNT; ++i) {
+        seed = splitMix64(seed);
+        keys[i] = seed;
+    }
+    keys[12 * 64] = 0;  // No castling rights contributes nothing
+    return keys;
+}
+
+constexpr int KNIGHT_OFFSETS[8][2] = {
+    {2, 1}, {1, 2}, {-1, 2}, {-2, 1}, {-2, -1}, {-1, -2}, {1, -2}, {2, -1}
+};
+
+constexpr int KING_OFFSETS[8][2] = {
+    {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1}, {-1, 0}, {-1, 1}
+};
+
+// Generate the attack set of a knight or king on every square at compile time
+constexpr std::array<uint64_t, 64> generateLeaperAttacks(const int (&offsets)[8][2]) {
+    std::array<uint64_t, 64> attacks{};
+    for (int sq = 0; sq < 64; ++sq) {
+        for (int i = 0; i < 8; ++i) {
+            int row = sq / 8 + offsets[i][0];
+            int col = sq % 8 + offsets[i][1];
+            if (row >= 0 && row < 8 && col >= 0 && col < 8) {
+                attacks[sq] |= 1ULL << (row * 8 + col);
+            }
+        }
+    }
+    return attacks;
+}
+
+// Generate pawn capture sets by color at compile time; white pawns advance towards row 7
+constexpr std::array<std::array<uint64_t, 64>, 2> generatePawnAttacks() {
+    std::array<std::array<uint64_t, 64>, 2> attacks{};
+    for (int color = 0; color < 2; ++color) {
+        int direction = color == 0 ? 1 : -1;
+        for (int sq = 0; sq < 64; ++sq) {
+            int row = sq / 8 + direction;
+            int col = sq % 8;
+            if (row < 0 || row > 7) {
+                continue;
+            }
+            if (col > 0) {
+                attacks[color][sq] |= 1ULL << (row * 8 + col - 1);
+            }
+            if (col < 7) {
+                attacks[color][sq] |= 1ULL << (row * 8 + col + 1);
+            }
+        }
+    }
+    return attacks;
+}
+
+// Generate the squares strictly between two squares on a shared line at compile time
+constexpr std::array<std::array<uint64_t, 64>, 64> generateBetween() {
+    std::array<std::array<uint64_t, 64>, 64> between{};
+    for (int from = 0; from < 64; ++from) {
+        for (int i = 0; i < 8; ++i) {
+            int dr = KING_OFFSETS[i][0];
+            int dc = KING_OFFSETS[i][1];
+            uint64_t ray = 0;
+            int row = from / 8 + dr;
+            int col = from % 8 + dc;
+            while (row >= 0 && row < 8 && col >= 0 && col < 8) {
+                between[from][row * 8 + col] = ray;
+                ray |= 1ULL << (row * 8 + col);
+                row += dr;
+                col += dc;
+            }
+        }
+    }
+    return between;
+}
+
 /**
- * @brief Class for performance monitoring
+ * @brief Precomputed attack sets used by attack queries and move generation
+ *
+ * Knight, king and pawn tables are built at compile time. Bishop and rook
+ * attacks are looked up through magic bitboards (PEXT when BMI2 is available)
+ * from tables built once on first use.
  */
-class PerformanceMonitor {
-public:
-    static void startTimer(const std::string& operation) {
-        std::lock_guard<std::mutex> lock(mutex);
-        operationTimers[operation] = std::chrono::high_resolution_clock::now();
+struct AttackTables {
+    static constexpr std::array<uint64_t, 64> KNIGHT_ATTACKS = generateLeaperAttacks(KNIGHT_OFFSETS);
+    static constexpr std::array<uint64_t, 64> KING_ATTACKS = generateLeaperAttacks(KING_OFFSETS);
+    static constexpr std::array<std::array<uint64_t, 64>, 2> PAWN_ATTACKS = generatePawnAttacks();
+    static constexpr std::array<std::array<uint64_t, 64>, 64> BETWEEN = generateBetween();
+    
+    static uint64_t bishopAttacks(int sq, uint64_t occupancy) {
+        const SliderTable& table = bishopTable();
+        return table.attacks[table.index(sq, occupancy)];
     }
     
-    static double endTimer(const std::string& operation) {
-        std::lock_guard<std::mutex> lock(mutex);
-        auto it = operationTimers.find(operation);
-        if (it == operationTimers.end()) return 0.0;
-        
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - it->second).count() / 1000.0;
+    static uint64_t rookAttacks(int sq, uint64_t occupancy) {
+        const SliderTable& table = rookTable();
+        return table.attacks[table.index(sq, occupancy)];
+    }
+    
+    static uint64_t queenAttacks(int sq, uint64_t occupancy) {
+        return bishopAttacks(sq, occupancy) | rookAttacks(sq, occupancy);
+    }
+    
+    // Walk the rays square by square; used to build the slider tables
+    static uint64_t slidingAttacks(int sq, uint64_t occupancy, bool diagonal);
+
+private:
+    struct SliderTable {
+        std::array<uint64_t, 64> masks;
+        std::array<uint64_t, 64> magics;
+        std::array<uint32_t, 64> offsets;
+        std::array<uint8_t, 64> shifts;
+        std::vector<uint64_t> attacks;
         
-        // Record the timing
-        if (operationStats.find(operation) == operationStats.end()) {
-            operationStats[operation] = {duration, duration, duration, 1};
-        } else {
-            auto& stats = operationStats[operation];
-            stats.total += duration;
-            stats.count++;
-            stats.min = std::min(stats.min, duration);
-            stats.max = std::max(stats.max, duration);
+        size_t index(int sq, uint64_t occupancy) const {
+#if defined(__BMI2__)
+            return offsets[sq] + _pext_u64(occupancy, masks[sq]);
+#else
+            return offsets[sq] + (((occupancy & masks[sq]) * magics[sq]) >> shifts[sq]);
+#endif
         }
-        
-        operationTimers.erase(it);
-        return duration;
+    };
+    
+    static const SliderTable& bishopTable();
+    static const SliderTable& rookTable();
+    static SliderTable buildSliderTable(bool diagonal);
+};
+
+/**
+ * @brief Bitboard representation of a chess position
+ *
+ * Squares are numbered row * 8 + col, so bit 0 is a1 and bit 63 is h8.
+ * A mailbox of piece indices is kept alongside the bitboards so that
+ * square lookups stay O(1). A Zobrist key of the position is updated
+ * incrementally by every mutator.
+ */
+struct BitboardPosition {
+    static constexpr uint8_t NO_PIECE = 12;
+    
+    // Zobrist key layout: 12 * 64 piece keys, 16 castling keys, 8 en passant file keys, 1 side key
+    static constexpr int ZOBRIST_CASTLING_OFFSET = 12 * 64;
+    static constexpr int ZOBRIST_EN_PASSANT_OFFSET = ZOBRIST_CASTLING_OFFSET + 16;
+    static constexpr int ZOBRIST_SIDE_OFFSET = ZOBRIST_EN_PASSANT_OFFSET + 8;
+    
+    static constexpr std::array<uint64_t, ZOBRIST_KEY_COUNT> ZOBRIST_KEYS = generateZobristKeys();
+    
+    // Castling right flags
+    static constexpr uint8_t WHITE_KINGSIDE = 1;
+    static constexpr uint8_t WHITE_QUEENSIDE = 2;
+    static constexpr uint8_t BLACK_KINGSIDE = 4;
+    static constexpr uint8_t BLACK_QUEENSIDE = 8;
+    
+    // Material plus piece-square value of a piece on a square, in centipawns from White's side
+    struct PieceSquareScore {
+        int16_t midgame;
+        int16_t endgame;
+    };
+    
+    // Indexed by piece index, then square; filled from ChessAI's piece-square tables
+    static const std::array<std::array<PieceSquareScore, 64>, 12> PIECE_SQUARE_SCORES;
+    
+    // Game phase weight per piece type; all minor and major pieces on the board make MAX_PHASE
+    static constexpr int PHASE_WEIGHTS[6] = { 0, 1, 1, 2, 4, 0 };
+    static constexpr int MAX_PHASE = 24;
+    
+    std::array<uint64_t, 12> pieces;    // One bitboard per piece type and color
+    std::array<uint64_t, 2> occupancy;  // Occupied squares per color
+    uint64_t allOccupancy;              // All occupied squares
+    uint64_t unmoved;                   // Squares whose piece has never moved
+    std::array<uint8_t, 64> mailbox;    // Piece index per square, NO_PIECE if empty
+    PieceColor sideToMove;
+    uint8_t castlingRights;
+    int8_t enPassantSquare;             // -1 if none
+    uint64_t zobristKey;
+    int32_t midgameScore;               // Sum of PIECE_SQUARE_SCORES over the pieces
+    int32_t endgameScore;
+    int phase;                          // Sum of PHASE_WEIGHTS over the pieces
+    
+    BitboardPosition() { clear(); }
+    
+    void clear() {
+        pieces.fill(0);
+        occupancy.fill(0);
+        allOccupancy = 0;
+        unmoved = 0;
+        mailbox.fill(NO_PIECE);
+        sideToMove = PieceColor::WHITE;
+        castlingRights = 0;
+        enPassantSquare = -1;
+        zobristKey = 0;
+        midgameScore = 0;
+        endgameScore = 0;
+        phase = 0;
+    }
+    
+    static int square(int row, int col) { return row * 8 + col; }
+    static int square(const Position& pos) { return pos.row * 8 + pos.col; }
+    static Position toPosition(int sq) { return Position(sq / 8, sq % 8); }
+    static uint64_t bit(int sq) { return 1ULL << sq; }
+    
+    static int pieceIndex(PieceType type, PieceColor color) {
+        return static_cast<int>(color) * 6 + static_cast<int>(type);
+    }
+    
+    static int popCount(uint64_t bb) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(bb);
+#else
+        int count = 0;
+        while (bb) { bb &= bb - 1; ++count; }
+        return count;
+#endif
+    }
+    
+    static int lsb(uint64_t bb) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(bb);
+#else
+        int index = 0;
+        while (!(bb & 1ULL)) { bb >>= 1; ++index; }
+        return index;
+#endif
+    }
+    
+    static int popLsb(uint64_t& bb) {
+        int sq = lsb(bb);
+        bb &= bb - 1;
+        return sq;
+    }
+    
+    bool isEmpty(int sq) const { return mailbox[sq] == NO_PIECE; }
+    
+    PieceType typeAt(int sq) const {
+        return mailbox[sq] == NO_PIECE ? PieceType::EMPTY : static_cast<PieceType>(mailbox[sq] % 6);
+    }
+    
+    PieceColor colorAt(int sq) const {
+        return mailbox[sq] == NO_PIECE ? PieceColor::NONE : static_cast<PieceColor>(mailbox[sq] / 6);
+    }
+    
+    uint64_t piecesOf(PieceType type, PieceColor color) const {
+        return pieces[pieceIndex(type, color)];
+    }
+    
+    // Pieces of both colors attacking the square, with sliders blocked by the given occupancy
+    uint64_t attackersTo(int sq, uint64_t occupied) const {
+        return (AttackTables::PAWN_ATTACKS[1][sq] & pieces[pieceIndex(PieceType::PAWN, PieceColor::WHITE)]) |
+               (AttackTables::PAWN_ATTACKS[0][sq] & pieces[pieceIndex(PieceType::PAWN, PieceColor::BLACK)]) |
+               (AttackTables::KNIGHT_ATTACKS[sq] & (pieces[pieceIndex(PieceType::KNIGHT, PieceColor::WHITE)] |
+                                                    pieces[pieceIndex(PieceType::KNIGHT, PieceColor::BLACK)])) |
+               (AttackTables::KING_ATTACKS[sq] & (pieces[pieceIndex(PieceType::KING, PieceColor::WHITE)] |
+                                                  pieces[pieceIndex(PieceType::KING, PieceColor::BLACK)])) |
+               (AttackTables::bishopAttacks(sq, occupied) & diagonalSliders()) |
+               (AttackTables::rookAttacks(sq, occupied) & orthogonalSliders());
+    }
+    
+    uint64_t diagonalSliders() const {
+        return pieces[pieceIndex(PieceType::BISHOP, PieceColor::WHITE)] | pieces[pieceIndex(PieceType::BISHOP, PieceColor::BLACK)] |
+               pieces[pieceIndex(PieceType::QUEEN, PieceColor::WHITE)] | pieces[pieceIndex(PieceType::QUEEN, PieceColor::BLACK)];
+    }
+    
+    uint64_t orthogonalSliders() const {
+        return pieces[pieceIndex(PieceType::ROOK, PieceColor::WHITE)] | pieces[pieceIndex(PieceType::ROOK, PieceColor::BLACK)] |
+               pieces[pieceIndex(PieceType::QUEEN, PieceColor::WHITE)] | pieces[pieceIndex(PieceType::QUEEN, PieceColor::BLACK)];
     }
     
-    static std::string getStatsSummary() {
-        std::lock_guard<std::mutex> lock(mutex);
-        std::stringstream ss;
+    // Check whether any piece of attackerColor attacks the square
+    bool isSquareAttacked(int sq, PieceColor attackerColor) const {
+        int defender = attackerColor == PieceColor::WHITE ? 1 : 0;
+        if (AttackTables::PAWN_ATTACKS[defender][sq] & piecesOf(PieceType::PAWN, attackerColor)) return true;
+        if (AttackTables::KNIGHT_ATTACKS[sq] & piecesOf(PieceType::KNIGHT, attackerColor)) return true;
+        if (AttackTables::KING_ATTACKS[sq] & piecesOf(PieceType::KING, attackerColor)) return true;
         
-        ss << "Performance Statistics:\n";
-        for (const auto& [operation, stats] : operationStats) {
-            ss << operation << ": "
-               << "avg=" << (stats.total / stats.count) << "ms, "
-               << "min=" << stats.min << "ms, "
-               << "max=" << stats.max << "ms, "
-               << "count=" << stats.count << "\n";
+        uint64_t queens = piecesOf(PieceType::QUEEN, attackerColor);
+        uint64_t diagonal = piecesOf(PieceType::BISHOP, attackerColor) | queens;
+        if (diagonal && (AttackTables::bishopAttacks(sq, allOccupancy) & diagonal)) return true;
+        uint64_t orthogonal = piecesOf(PieceType::ROOK, attackerColor) | queens;
+        if (orthogonal && (AttackTables::rookAttacks(sq, allOccupancy) & orthogonal)) return true;
+        return false;
+    }
+    
+    void addPiece(int sq, PieceType type, PieceColor color, bool hasUnmoved = false) {
+        removePiece(sq);
+        int index = pieceIndex(type, color);
+        uint64_t b = bit(sq);
+        pieces[index] |= b;
+        occupancy[static_cast<int>(color)] |= b;
+        allOccupancy |= b;
+        mailbox[sq] = static_cast<uint8_t>(index);
+        if (hasUnmoved) unmoved |= b; else unmoved &= ~b;
+        zobristKey ^= ZOBRIST_KEYS[index * 64 + sq];
+        midgameScore += PIECE_SQUARE_SCORES[index][sq].midgame;
+        endgameScore += PIECE_SQUARE_SCORES[index][sq].endgame;
+        phase += PHASE_WEIGHTS[index % 6];
+    }
+    
+    void removePiece(int sq) {
+        uint8_t index = mailbox[sq];
+        if (index == NO_PIECE) return;
+        uint64_t b = bit(sq);
+        pieces[index] &= ~b;
+        occupancy[index / 6] &= ~b;
+        allOccupancy &= ~b;
+        unmoved &= ~b;
+        mailbox[sq] = NO_PIECE;
+        zobristKey ^= ZOBRIST_KEYS[index * 64 + sq];
+        midgameScore -= PIECE_SQUARE_SCORES[index][sq].midgame;
+        endgameScore -= PIECE_SQUARE_SCORES[index][sq].endgame;
+        phase -= PHASE_WEIGHTS[index % 6];
+    }
+    
+    void setSideToMove(PieceColor color) {
+        if (color == sideToMove) return;
+        zobristKey ^= ZOBRIST_KEYS[ZOBRIST_SIDE_OFFSET];
+        sideToMove = color;
+    }
+    
+    void setCastlingRights(uint8_t rights) {
+        zobristKey ^= ZOBRIST_KEYS[ZOBRIST_CASTLING_OFFSET + castlingRights];
+        castlingRights = rights & 0x0F;
+        zobristKey ^= ZOBRIST_KEYS[ZOBRIST_CASTLING_OFFSET + castlingRights];
+    }
+    
+    void setEnPassantSquare(int sq) {
+        if (enPassantSquare >= 0) zobristKey ^= ZOBRIST_KEYS[ZOBRIST_EN_PASSANT_OFFSET + enPassantSquare % 8];
+        enPassantSquare = static_cast<int8_t>(sq);
+        if (enPassantSquare >= 0) zobristKey ^= ZOBRIST_KEYS[ZOBRIST_EN_PASSANT_OFFSET + enPassantSquare % 8];
+    }
+    
+    // Recompute the Zobrist key from scratch (used to verify the incremental key)
+    uint64_t computeZobristKey() const {
+        uint64_t key = 0;
+        for (int sq = 0; sq < 64; ++sq) {
+            if (mailbox[sq] != NO_PIECE) key ^= ZOBRIST_KEYS[mailbox[sq] * 64 + sq];
         }
-        
-        return ss.str();
+        key ^= ZOBRIST_KEYS[ZOBRIST_CASTLING_OFFSET + castlingRights];
+        if (enPassantSquare >= 0) key ^= ZOBRIST_KEYS[ZOBRIST_EN_PASSANT_OFFSET + enPassantSquare % 8];
+        if (sideToMove == PieceColor::BLACK) key ^= ZOBRIST_KEYS[ZOBRIST_SIDE_OFFSET];
+        return key;
+    }
+    
+    // Material and piece-square score blended between middlegame and endgame by the phase
+    int taperedScore() const {
+        int weight = std::min(phase, MAX_PHASE);
+        return (midgameScore * weight + endgameScore * (MAX_PHASE - weight)) / MAX_PHASE;
+    }
+    
+    // Move the piece on 'from' to 'to', replacing anything already on 'to'
+    void movePiece(int from, int to) {
+        uint8_t index = mailbox[from];
+        if (index == NO_PIECE) return;
+        removePiece(to);
+        removePiece(from);
+        addPiece(to, static_cast<PieceType>(index % 6), static_cast<PieceColor>(index / 6));
     }
     
-    static void resetStats() {
-        std::lock_guard<std::mutex> lock(mutex);
-        operationStats.clear();
+    // Derive castling rights from which kings and rooks are still unmoved on their home squares
+    void refreshCastlingRights() {
+        uint8_t rights = 0;
+        const uint64_t whiteKing = piecesOf(PieceType::KING, PieceColor::WHITE) & unmoved;
+        const uint64_t blackKing = piecesOf(PieceType::KING, PieceColor::BLACK) & unmoved;
+        const uint64_t whiteRooks = piecesOf(PieceType::ROOK, PieceColor::WHITE) & unmoved;
+        const uint64_t blackRooks = piecesOf(PieceType::ROOK, PieceColor::BLACK) & unmoved;
+        
+        if (whiteKing & bit(square(0, 4))) {
+            if (whiteRooks & bit(square(0, 7))) rights |= WHITE_KINGSIDE;
+            if (whiteRooks & bit(square(0, 0))) rights |= WHITE_QUEENSIDE;
+        }
+        if (blackKing & bit(square(7, 4))) {
+            if (blackRooks & bit(square(7, 7))) rights |= BLACK_KINGSIDE;
+            if (blackRooks & bit(square(7, 0))) rights |= BLACK_QUEENSIDE;
+        }
+        setCastlingRights(rights);
     }
+};
+
+/**
+ * @brief Class for performance monitoring
+ *
+ * Timings are aggregated per thread, so recording never contends with other
+ * threads; getStatsSummary() merges the per-thread counters when it runs.
+ */
+class PerformanceMonitor {
+public:
+    // Times a scope and records it under the operation name, which must be a string literal
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(const char* operation)
+            : operation(operation), start(std::chrono::steady_clock::now()) {}
+        
+        ~ScopedTimer() {
+            auto end = std::chrono::steady_clock::now();
+            record(operation, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+        
+    private:
+        const char* operation;
+        std::chrono::steady_clock::time_point start;
+    };
+    
+    // Record one timing in milliseconds for the calling thread
+    static void record(const char* operation, double durationMs);
+    
+    static std::string getStatsSummary();
+    
+    static void resetStats();
     
 private:
     struct OperationStats {
-        double total;
-        double min;
-        double max;
-        int count;
+        double total = 0.0;
+        double min = std::numeric_limits<double>::max();
+        double max = 0.0;
+        int count = 0;
+        
+        void add(double duration) {
+            total += duration;
+            min = std::min(min, duration);
+            max = std::max(max, duration);
+            count++;
+        }
+        
+        void merge(const OperationStats& other) {
+            total += other.total;
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+            count += other.count;
+        }
+    };
+    
+    // Counters owned by one thread; the mutex is only contended while stats are merged
+    struct ThreadStats {
+        ThreadStats();
+        ~ThreadStats();  // Folds the counters into retiredStats when the thread exits
+        
+        std::mutex mutex;
+        std::unordered_map<const char*, OperationStats> stats;
+    };
+    
+    static ThreadStats& localStats();
+    
+    static std::mutex registryMutex;
+    static std::vector<ThreadStats*> threadStats;
+    static std::map<std::string, OperationStats> retiredStats;
+};
+
+/**
+ * @brief Lock-free histogram with logarithmic buckets, exported in Prometheus text format
+ *
+ * Bucket i counts the values up to firstBound * 2^(i/2), so neighbouring bounds are a
+ * factor of sqrt(2) apart. observe() is a few relaxed atomic adds on any thread.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int BUCKET_COUNT = 48;  // firstBound to about firstBound * 2^23.5, then +Inf
+    
+    explicit LatencyHistogram(double firstBound);
+    
+    void observe(double value);
+    
+    // Append the histogram's _bucket, _sum and _count series
+    void writePrometheus(std::ostream& out, const char* name, const char* help) const;
+    
+    // Times a scope in seconds. With sampleEvery above 1, only one scope in that many
+    // on each thread reads the clock
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(LatencyHistogram& histogram, unsigned int sampleEvery = 1)
+            : histogram(histogram), sampled(sampleEvery <= 1 || ++sampleCounter % sampleEvery == 0) {
+            if (sampled) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+        
+        ~ScopedTimer() {
+            if (sampled) {
+                histogram.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+        }
+        
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+        
+    private:
+        static thread_local unsigned int sampleCounter;
+        
+        LatencyHistogram& histogram;
+        bool sampled;
+        std::chrono::steady_clock::time_point start;
     };
     
-    static std::mutex mutex;
-    static std::unordered_map<std::string, std::chrono::time_point<std::chrono::high_resolution_clock>> operationTimers;
-    static std::unordered_map<std::string, OperationStats> operationStats;
+private:
+    double firstBound;
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT + 1> buckets;  // The last bucket is +Inf
+    std::atomic<double> sum;
+};
+
+/**
+ * @brief Process-wide metrics served on the server's metrics port
+ */
+class ServerMetrics {
+public:
+    static constexpr unsigned int MOVE_GENERATION_SAMPLE = 64;  // Perft and searches call it millions of times
+    
+    static LatencyHistogram moveRequestSeconds;      // Handling a MOVE message
+    static LatencyHistogram moveGenerationSeconds;   // getAllValidMoves(), one call in MOVE_GENERATION_SAMPLE
+    static LatencyHistogram searchSeconds;           // Built-in engine searches for a move
+    static LatencyHistogram writeBacklogBytes;       // Socket send buffer after each write
+    static LatencyHistogram matchmakingWaitSeconds;  // Queue time of each matched or timed-out player
+    static std::atomic<uint64_t> searchNodes;        // Nodes of those searches, over all their threads
+    static LatencyHistogram botMoveQueueSeconds;     // Time bot searches waited for a worker thread
 };
 
 /**
@@ -290,17 +786,32 @@ protected:
 
 /**
  * @brief Class representing a chess move
+ *
+ * Packed into 16 bits: from square (bits 0-5), to square (bits 6-11), promotion
+ * piece type plus one (bits 12-14, 0 for none) and a valid flag (bit 15). A move
+ * with an off-board square is the invalid, all-zero move.
  */
 class ChessMove {
 public:
     ChessMove();
     ChessMove(const Position& from, const Position& to, PieceType promotionType = PieceType::EMPTY);
     
+    // Build a move from square indices (0 is a1), as the move generator does
+    static ChessMove fromSquares(int from, int to, PieceType promotionType = PieceType::EMPTY);
+    
+    // Build a move from its packed encoding
+    static ChessMove fromPacked(uint16_t packed);
+    
     Position getFrom() const;
     Position getTo() const;
+    int getFromSquare() const;  // -1 for the invalid move
+    int getToSquare() const;
     PieceType getPromotionType() const;
     void setPromotionType(PieceType type);
     
+    bool isValid() const;
+    uint16_t getPacked() const;
+    
     // Convert to algebraic notation (e.g., "e2e4" or "e7e8q" for promotion)
     std::string toAlgebraic() const;
     
@@ -314,11 +825,161 @@ public:
     bool operator!=(const ChessMove& other) const;
 
 private:
-    Position from;
-    Position to;
-    PieceType promotionType;
+    static constexpr uint16_t VALID_FLAG = 0x8000;
+    static constexpr int PROMOTION_SHIFT = 12;
+    
+    uint16_t packed;
+};
+
+/**
+ * @brief Fixed-capacity list of moves filled by the legal move generator
+ *
+ * Lives on the caller's stack so generating moves never allocates.
+ */
+class MoveList {
+public:
+    // No legal chess position has more than 218 moves
+    static constexpr int CAPACITY = 256;
+    
+    void add(const ChessMove& move) { moves[count++] = move; }
+    void clear() { count = 0; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    
+    const ChessMove& operator[](int index) const { return moves[index]; }
+    const ChessMove* begin() const { return moves.data(); }
+    const ChessMove* end() const { return moves.data() + count; }
+
+private:
+    std::array<ChessMove, CAPACITY> moves;
+    int count = 0;
+};
+
+/**
+ * @brief What the side to move faces, worked out from one legal move generation
+ *
+ * Only the side to move can be mated or stalemated, so one generation of its moves
+ * answers check, mate, stalemate and the draw rules together.
+ */
+struct PositionStatus {
+    PieceColor sideToMove = PieceColor::NONE;
+    bool inCheck = false;
+    bool checkmate = false;
+    bool stalemate = false;
+    bool insufficientMaterial = false;
+    bool threefoldRepetition = false;
+    bool fiftyMoveRule = false;
+    MoveList legalMoves;
+    
+    // The result the position ends the game with, or IN_PROGRESS
+    GameResult getResult() const {
+        if (checkmate) {
+            return sideToMove == PieceColor::WHITE ? GameResult::BLACK_WIN : GameResult::WHITE_WIN;
+        }
+        if (stalemate || insufficientMaterial || threefoldRepetition || fiftyMoveRule) {
+            return GameResult::DRAW;
+        }
+        return GameResult::IN_PROGRESS;
+    }
+};
+
+/**
+ * @brief Bump allocator for short-lived data, released in bulk
+ *
+ * Allocations are carved from blocks that stay allocated between uses. mark() and
+ * rewind() release everything allocated after a point at once, which suits the
+ * last-in first-out way a depth-first search uses memory. Not thread-safe: every
+ * search thread and every board owns its own arena.
+ */
+class MonotonicArena {
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+    
+    explicit MonotonicArena(size_t blockSize = DEFAULT_BLOCK_SIZE) : blockSize(blockSize) {}
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+    
+    // A point in the arena to rewind to
+    struct Marker {
+        size_t block = 0;
+        size_t offset = 0;
+    };
+    
+    // Rewinds the arena to where it was when the scope was entered
+    class Scope {
+    public:
+        explicit Scope(MonotonicArena& arena) : arena(arena), marker(arena.mark()) {}
+        ~Scope() { arena.rewind(marker); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    
+    private:
+        MonotonicArena& arena;
+        Marker marker;
+    };
+    
+    void* allocate(size_t bytes, size_t alignment) {
+        if (current < blocks.size()) {
+            size_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+            if (aligned + bytes <= blocks[current].size) {
+                offset = aligned + bytes;
+                return blocks[current].data.get() + aligned;
+            }
+        }
+        return allocateInNextBlock(bytes, alignment);
+    }
+    
+    Marker mark() const { return { current, offset }; }
+    void rewind(const Marker& marker) { current = marker.block; offset = marker.offset; }
+    void reset() { rewind(Marker()); }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+    
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t current = 0;  // Block being allocated from
+    size_t offset = 0;   // First free byte in it
+    
+    void* allocateInNextBlock(size_t bytes, size_t alignment);
+};
+
+/**
+ * @brief Standard allocator handing out memory from a MonotonicArena
+ *
+ * Deallocation does nothing; the memory comes back when the arena is rewound or reset.
+ */
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    
+    explicit ArenaAllocator(MonotonicArena& arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+    
+    T* allocate(size_t count) {
+        return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) {}
+    
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+    template <typename U> friend class ArenaAllocator;
+    MonotonicArena* arena;
 };
 
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
 /**
  * @brief Class representing a chess board
  */
@@ -332,12 +993,35 @@ public:
     // Initialize the board with pieces in starting positions
     void initialize();
     
+    // Set up the board from a FEN string; leaves the board unchanged and returns false if it is malformed
+    bool loadFromFen(const std::string& fen);
+    
     // Get the piece at the given position
     const ChessPiece* getPiece(const Position& pos) const;
     
     // Move a piece from one position to another
     MoveValidationStatus movePiece(const ChessMove& move, bool validateOnly = false);
     
+    // State needed to take back a move made with makeMove()
+    struct MoveUndo {
+        ChessMove move;
+        uint8_t movedPiece;       // Piece index that stood on the from square
+        uint8_t capturedPiece;    // Piece index captured, BitboardPosition::NO_PIECE if none
+        int8_t capturedSquare;    // Differs from the destination for en passant
+        bool isCastling;
+        bool isEnPassant;
+        uint64_t unmoved;
+        uint8_t castlingRights;
+        int8_t enPassantSquare;
+        int halfMoveClock;
+    };
+    
+    // Make a move in place without validating it, filling in the undo record
+    void makeMove(const ChessMove& move, MoveUndo& undo);
+    
+    // Take back a move made with makeMove()
+    void unmakeMove(const MoveUndo& undo);
+    
     // Check if the given position is under attack by the given color
     bool isUnderAttack(const Position& pos, PieceColor attackerColor) const;
     
@@ -353,6 +1037,19 @@ public:
     // Get all valid moves for the given color
     std::vector<ChessMove> getAllValidMoves(PieceColor color) const;
     
+    // The same, allocated from the caller's arena
+    ArenaVector<ChessMove> getAllValidMoves(PieceColor color, MonotonicArena& arena) const;
+    
+    // Generate the legal moves for a color into a caller-provided list, computing
+    // checkers and pinned pieces once instead of testing each move
+    void generateLegalMoves(PieceColor color, MoveList& moves) const;
+    
+    // Check whether the color has at least one legal move
+    bool hasLegalMoves(PieceColor color) const;
+    
+    // Check, mate, stalemate, the draw rules and the legal moves of the side to move
+    PositionStatus getPositionStatus() const;
+    
     // Get the position of the king of the given color
     Position getKingPosition(PieceColor color) const;
     
@@ -401,15 +1098,22 @@ public:
     // Check if there is insufficient material for checkmate
     bool hasInsufficientMaterial() const;
 
+    // Get the underlying bitboard position
+    const BitboardPosition& getBitboards() const;
+    
+    // Get the Zobrist key of the current position
+    uint64_t getZobristKey() const;
+    
+    // Half moves since the last capture or pawn move
+    int getHalfMoveClock() const;
+
 private:
-    std::array<std::array<std::unique_ptr<ChessPiece>, 8>, 8> board;
-    PieceColor currentTurn;
-    Position enPassantTarget;
+    BitboardPosition position;  // Piece placement, side to move, castling rights, en passant
     std::vector<ChessMove> moveHistory;
     std::vector<PieceType> capturedWhitePieces;
     std::vector<PieceType> capturedBlackPieces;
     int halfMoveClock;  // For fifty-move rule
-    std::vector<std::string> boardStates;  // For threefold repetition
+    std::vector<uint64_t> boardStates;  // Zobrist keys of past positions, for threefold repetition
     
     // Execute a castling move
     void executeCastlingMove(const ChessMove& move);
@@ -423,7 +1127,7 @@ private:
     // Check if the move would leave the king in check
     bool wouldLeaveInCheck(const ChessMove& move, PieceColor color) const;
     
-    // Get the current board state as a string for repetition detection
+    // Get the current board state as a readable string (FEN-like placement, castling, en passant, turn)
     std::string getBoardStateString() const;
 
     // For depth limiting
@@ -434,25 +1138,34 @@ private:
     bool incrementRecursionDepth(const std::string& functionName) const;
     void decrementRecursionDepth() const;
 
-    // For memoization
-    mutable std::unordered_map<std::string, bool> checkCache;
-    mutable std::unordered_map<std::string, bool> attackCache;
+    // For memoization, keyed on the Zobrist key so entries stay valid across moves.
+    // The entries live in the board's own arena, which is reset when they are dropped
+    using CacheMap = std::unordered_map<uint64_t, bool, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                        ArenaAllocator<std::pair<const uint64_t, bool>>>;
+    static constexpr size_t MAX_CACHE_ENTRIES = 8192;
+    mutable MonotonicArena cacheArena;
+    mutable CacheMap checkCache{makeCacheMap()};
+    mutable CacheMap attackCache{makeCacheMap()};
+    
+    CacheMap makeCacheMap() const;
     
     // Helper methods for caching
-    std::string generateCheckCacheKey(PieceColor color) const;
-    std::string generateAttackCacheKey(const Position& pos, PieceColor attackerColor) const;
+    uint64_t generateCheckCacheKey(PieceColor color) const;
+    uint64_t generateAttackCacheKey(const Position& pos, PieceColor attackerColor) const;
     void clearCaches() const;
+    void trimCaches() const;
 
     // For memoization of wouldLeaveInCheck
-    mutable std::unordered_map<std::string, bool> checkResultCache;
+    mutable CacheMap checkResultCache{makeCacheMap()};
     
     // Helper method to generate cache key for wouldLeaveInCheck
-    std::string generateCheckResultCacheKey(const ChessMove& move, PieceColor color) const;
+    uint64_t generateCheckResultCacheKey(const ChessMove& move, PieceColor color) const;
 
     // For incremental updates
     struct BoardDelta {
         Position position;
-        std::unique_ptr<ChessPiece> oldPiece;
+        uint8_t oldPiece;
+        bool oldUnmoved;
         bool isModified;
     };
     
@@ -464,6 +1177,66 @@ private:
     void restoreBoardDelta() const;
 };
 
+/**
+ * @brief Fixed-size transposition table shared by all search threads
+ *
+ * Each slot holds a packed 64-bit entry plus the Zobrist key XORed with that
+ * entry, so readers can detect torn writes without taking a lock.
+ */
+class TranspositionTable {
+public:
+    enum class Bound : uint8_t {
+        EXACT,
+        LOWER,
+        UPPER
+    };
+    
+    struct Entry {
+        double score;
+        int depth;
+        Bound bound;
+        ChessMove bestMove;
+    };
+    
+    explicit TranspositionTable(size_t sizeInMB = DEFAULT_SIZE_MB);
+    
+    // Reallocate the table; must not be called while searches are running
+    void resize(size_t sizeInMB);
+    
+    // Drop all entries
+    void clear();
+    
+    // Start a new search generation so older entries are replaced first
+    void newSearch();
+    
+    // Look up the entry for the given key
+    bool probe(uint64_t key, Entry& entry) const;
+    
+    // Store an entry for the given key
+    void store(uint64_t key, int depth, double score, Bound bound, const ChessMove& bestMove);
+    
+    // Approximate fill rate in permille, sampled from the first entries
+    int getUsagePermille() const;
+    
+    size_t getSizeInMB() const;
+    
+    static constexpr size_t DEFAULT_SIZE_MB = 64;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> check;  // key ^ data
+        std::atomic<uint64_t> data;
+    };
+    
+    std::unique_ptr<Slot[]> entries;
+    size_t slotCount;
+    size_t sizeInMB;
+    std::atomic<uint8_t> generation;
+    
+    static uint64_t packEntry(double score, int depth, Bound bound, const ChessMove& move, uint8_t generation);
+    static void unpackEntry(uint64_t data, Entry& entry);
+};
+
 /**
  * @brief Class representing a chess player
  */
@@ -504,12 +1277,6 @@ public:
     // Set whether the player is a bot
     void setBot(bool isBot);
     
-    // Get the player's game history IDs
-    const std::vector<std::string>& getGameHistory() const;
-    
-    // Add a game to the player's history
-    void addGameToHistory(const std::string& gameId);
-    
     // Serialize the player data to JSON
     QJsonObject toJson() const;
     
@@ -527,7 +1294,6 @@ private:
     int draws;
     qint64 remainingTime;
     bool bot;
-    std::vector<std::string> gameHistory;
 };
 
 /**
@@ -539,6 +1305,10 @@ public:
               const std::string& gameId, TimeControlType timeControl);
     ~ChessGame();
     
+    // Reuse a finished game for a new one, keeping the board and its allocations
+    void reset(ChessPlayer* whitePlayer, ChessPlayer* blackPlayer,
+               const std::string& gameId, TimeControlType timeControl);
+    
     std::string getGameId() const;
     ChessPlayer* getWhitePlayer() const;
     ChessPlayer* getBlackPlayer() const;
@@ -564,6 +1334,25 @@ public:
     // Get the game state as JSON
     QJsonObject getGameStateJson() const;
     
+    // Get what changed since the previous delta (moves, squares, clocks, status)
+    // and advance the state sequence number
+    QJsonObject takeGameStateDelta();
+    
+    // Sequence number of the last state delta, carried by full snapshots too
+    quint64 getStateSequence() const;
+    
+    // The deltas after sequence, oldest first; false if some of them are no longer kept
+    bool getDeltasSince(quint64 sequence, std::vector<QJsonObject>& deltas) const;
+    
+    // What another node needs to continue the game, and continuing it from that.
+    // The moves are replayed with full validation, so the board is rebuilt exactly
+    QJsonObject exportState() const;
+    bool importState(const QJsonObject& state);
+    
+    // Get the GAME_STATE message for one board orientation and wire format, encoded
+    // once and shared by every recipient until the state changes
+    QByteArray getEncodedGameState(const QString& orientation, bool binary) const;
+    
     // Get the game history as JSON
     QJsonObject getGameHistoryJson() const;
     
@@ -573,6 +1362,10 @@ public:
     // Get the ASCII representation of the current board state
     std::string getBoardAscii() const;
     
+    // Status of the current position, computed once per move and shared by the
+    // game-over check, state messages and recommendations
+    const PositionStatus& getPositionStatus() const;
+    
     // Get move recommendations for a player
     std::vector<std::pair<ChessMove, double>> getMoveRecommendations(ChessPlayer* player) const;
     
@@ -585,12 +1378,18 @@ public:
     // Handle a resignation
     void handleResignation(ChessPlayer* player);
     
-    // Update the game timers
+    // Charge the side to move for the time since its turn began
     void updateTimers();
     
     // Check if a player has run out of time
     bool hasPlayerTimedOut(ChessPlayer* player) const;
     
+    // A player's clock as of now, counting the running turn if it is theirs
+    qint64 getLiveRemainingTime(const ChessPlayer* player) const;
+    
+    // When the side to move runs out of time (ms since epoch), or -1 if the game is over
+    qint64 getClockDeadline() const;
+    
     // Serialize the game state
     QJsonObject serialize() const;
     
@@ -613,50 +1412,253 @@ private:
     bool drawOffered;
     ChessPlayer* drawOfferingPlayer;
     
+    // Encoded GAME_STATE messages, keyed by orientation and wire format (true = binary)
+    struct EncodedState {
+        size_t moveCount;
+        QByteArray bytes;
+    };
+    mutable std::map<std::pair<QString, bool>, EncodedState> stateCache;
+    
+    // Status of the position after positionStatusPly half-moves, if positionStatusValid
+    mutable PositionStatus positionStatus;
+    mutable size_t positionStatusPly;
+    mutable uint64_t positionStatusKey;
+    mutable bool positionStatusValid;
+    
+    // The last deltas sent, for clients that resume a session after missing some
+    static constexpr size_t DELTA_HISTORY_SIZE = 64;
+    std::deque<QJsonObject> recentDeltas;
+    
+    // What clients have been sent as of stateSequence, for building the next delta
+    quint64 stateSequence;
+    std::array<uint8_t, 64> sentPlacement;
+    size_t sentMoveCount;
+    size_t sentWhiteCaptured;
+    size_t sentBlackCaptured;
+    
     // Initialize the time control
     void initializeTimeControl();
     
+    // Take the current board as the delta baseline
+    void resetStateBaseline();
+    
+    // Drop the cached GAME_STATE encodings after the state changes
+    void invalidateStateCache();
+    
     // Update the player's remaining time after a move
     void updatePlayerTime(ChessPlayer* player);
 };
 
 /**
- * @brief Class for chess AI player
+ * @brief The server's own opening book format, memory-mapped
+ *
+ * A book is a header entry followed by a sorted array of 16-byte big-endian entries:
+ * position key, move, weight and a learn field, with moves encoded as Polyglot does
+ * (castling as king takes rook). Positions are keyed by ChessBoard's own Zobrist key
+ * rather than Polyglot's random table, so Polyglot books cannot be read; books are
+ * built from the server's game history with build(), and a file without the header
+ * is rejected.
  */
-class ChessAI {
+class OpeningBook {
 public:
-    ChessAI(int skillLevel = 5);
-    ~ChessAI() = default;
-    
-    // Get the best move for the current board state
-    ChessMove getBestMove(const ChessBoard& board, PieceColor color);
+    explicit OpeningBook(const std::string& path);
+    ~OpeningBook();
     
-    // Set the skill level (1-10)
-    void setSkillLevel(int level);
+    bool isOpen() const;
+    size_t size() const;
     
-    // Get the skill level
-    int getSkillLevel() const;
+    // Legal book moves for the position with their weights, heaviest first
+    std::vector<std::pair<ChessMove, int>> lookup(const ChessBoard& board) const;
     
-    // Evaluate a board position
-    double evaluatePosition(const ChessBoard& board, PieceColor color) const;
+    // A book move chosen at random in proportion to its weight; invalid if out of book
+    ChessMove pickMove(const ChessBoard& board) const;
     
-    // Get move recommendations with evaluations
-    std::vector<std::pair<ChessMove, double>> getMoveRecommendations(
-        const ChessBoard& board, PieceColor color, int maxRecommendations = 5);
+    // Write a book of the first maxPlies moves of every finished stored game. A move
+    // weighs two per win and one per draw for the side that played it
+    static bool build(const std::string& path, GameHistoryStore& store, int maxPlies);
 
 private:
-    int skillLevel;
+    static constexpr int ENTRY_SIZE = 16;
+    static constexpr quint32 BOOK_MAGIC = 0x4D50424B;  // "MPBK"
+    static constexpr quint32 BOOK_VERSION = 1;
     
-    // Minimax algorithm with alpha-beta pruning
-    double minimax(const ChessBoard& board, int depth, double alpha, double beta, 
-                  bool maximizingPlayer, PieceColor aiColor);
+    QFile file;
+    QByteArray copy;       // File contents when it could not be mapped
+    const uchar* mapped;   // Mapped file, header included
+    const uchar* entries;  // First entry, or null when no book is open
+    size_t count;
     
-    // Get the search depth based on skill level
-    int getSearchDepth() const;
+    uint64_t keyAt(size_t index) const;
     
-    // Evaluate a single piece
-    double evaluatePiece(const ChessPiece* piece, const Position& pos, const ChessBoard& board) const;
+    static quint16 encodeMove(const ChessBoard& board, const ChessMove& move);
+    static ChessMove decodeMove(const ChessBoard& board, quint16 encoded);
+};
 
+/**
+ * @brief Syzygy endgame tablebase probing
+ *
+ * Probes go through Fathom, which memory-maps the WDL and DTZ files. The server is
+ * built with it when MPCHESS_HAVE_SYZYGY is defined; otherwise initialize() fails
+ * and no position is ever in the tablebase.
+ */
+class EndgameTablebase {
+public:
+    // Result for the side to move; cursed wins and blessed losses are drawn by the fifty-move rule
+    enum class Wdl {
+        LOSS,
+        BLESSED_LOSS,
+        DRAW,
+        CURSED_WIN,
+        WIN
+    };
+    
+    // Score of a tablebase win, below checkmate so a real mate is still preferred
+    static constexpr double WIN_SCORE = 5000.0;
+    
+    // Load the tables under path (directories separated by ':', ';' on Windows); call before searching
+    static bool initialize(const std::string& path);
+    
+    // Largest number of pieces the loaded tables cover, 0 if none
+    static int maxPieces();
+    
+    // Whether the position has few enough pieces and no castling rights to be probed
+    static bool canProbe(const ChessBoard& board);
+    
+    // Win, draw or loss for the side to move; false if the position is not in the tables
+    static bool probeWdl(const ChessBoard& board, Wdl& result);
+    
+    // The legal move that keeps the best result by the shortest distance to a zeroing move
+    static bool probeRoot(const ChessBoard& board, ChessMove& move, Wdl& result);
+    
+    // Search score for the side to move; wins nearer the root score higher
+    static double score(Wdl result, int ply);
+
+private:
+    static std::atomic<int> largest;
+};
+
+/**
+ * @brief Class for chess AI player
+ */
+class ChessAI {
+public:
+    /**
+     * @brief What the last getBestMove() call searched
+     */
+    struct SearchInfo {
+        int depth = 0;        // Last completed iteration; 0 for book, tablebase and random moves
+        uint64_t nodes = 0;   // Over all search threads
+        double seconds = 0.0;
+        double score = 0.0;   // In pawns, for the side that moved
+    };
+    
+    ChessAI(int skillLevel = 5);
+    ~ChessAI() = default;
+    
+    // Get the best move for the current board state, searching for at most
+    // timeBudgetMs milliseconds (0 searches to the skill level's full depth)
+    ChessMove getBestMove(const ChessBoard& board, PieceColor color, qint64 timeBudgetMs = 0);
+    
+    const SearchInfo& getLastSearchInfo() const { return lastSearch; }
+    
+    // Time to spend on one move given the player's clock and the time control
+    static qint64 computeMoveTimeBudget(qint64 remainingTimeMs, TimeControlType timeControl);
+    
+    // Set the skill level (1-10)
+    void setSkillLevel(int level);
+    
+    // Get the skill level
+    int getSkillLevel() const;
+    
+    // Evaluate a board position
+    double evaluatePosition(const ChessBoard& board, PieceColor color) const;
+    
+    // Material, piece-square and check terms only; constant time
+    double evaluateStatic(const ChessBoard& board, PieceColor color) const;
+    
+    // Centipawn table behind BitboardPosition's running material and piece-square scores
+    static std::array<std::array<BitboardPosition::PieceSquareScore, 64>, 12> buildPieceSquareScores();
+    
+    // Get move recommendations with evaluations
+    std::vector<std::pair<ChessMove, double>> getMoveRecommendations(
+        const ChessBoard& board, PieceColor color, int maxRecommendations = 5);
+    
+    // Get move recommendations scored by a fixed-depth search, splitting the
+    // root moves across the search thread budget
+    std::vector<std::pair<ChessMove, double>> searchMoveRecommendations(
+        const ChessBoard& board, PieceColor color, int maxRecommendations, int depth,
+        const std::atomic<bool>* stopFlag = nullptr);
+    
+    // Threads one search may use, including the calling thread
+    void setSearchThreads(int threads);
+    int getSearchThreads() const;
+    
+    // Search thread budget given to newly created ChessAI instances
+    static void setDefaultSearchThreads(int threads);
+    static int getDefaultSearchThreads();
+    
+    // Transposition table shared by every ChessAI instance and thread
+    static TranspositionTable& getTranspositionTable();
+    
+    // Search with a table of this instance's own instead of the shared one; null goes back to it
+    void setTranspositionTable(std::shared_ptr<TranspositionTable> table);
+    
+    // Pool for helper search threads, kept apart from the server's work scheduler
+    static QThreadPool* getSearchThreadPool();
+    
+    // Opening book consulted before any search; set before searches start
+    static void setOpeningBook(std::shared_ptr<OpeningBook> book);
+    static std::shared_ptr<OpeningBook> getOpeningBook();
+    
+    // Book moves scored like getMoveRecommendations(); empty when out of book
+    std::vector<std::pair<ChessMove, double>> getBookRecommendations(
+        const ChessBoard& board, PieceColor color, int maxRecommendations);
+
+private:
+    static constexpr int MAX_SEARCH_PLY = 64;
+    
+    // Largest swing mobility is expected to add; leaves further than this outside the window skip it
+    static constexpr double LAZY_EVAL_MARGIN = 3.0;
+    static std::atomic<int> defaultSearchThreads;
+    static std::shared_ptr<OpeningBook> openingBook;
+    
+    // Per-search state: deadline, node count and killer moves by ply
+    struct SearchContext {
+        std::chrono::steady_clock::time_point deadline;
+        bool hasDeadline = false;
+        bool aborted = false;
+        uint64_t nodes = 0;
+        const std::atomic<bool>* stopFlag = nullptr;  // Set by the main thread to stop helpers
+        std::array<std::array<ChessMove, 2>, MAX_SEARCH_PLY> killerMoves;
+        MonotonicArena arena;  // Move lists of the nodes being searched, one thread's own
+    };
+    
+    int skillLevel;
+    int searchThreads;
+    SearchInfo lastSearch;
+    std::shared_ptr<TranspositionTable> ownTable;  // Null to use the shared table
+    
+    TranspositionTable& searchTable() const { return ownTable ? *ownTable : getTranspositionTable(); }
+    
+    // Deepen from startDepth to maxDepth over the given root moves; returns the
+    // last completed depth, or 0 if none completed
+    int iterativeDeepening(ChessBoard& board, std::vector<ChessMove> rootMoves, int startDepth, int maxDepth,
+                          SearchContext& context, ChessMove& bestMove, double& bestValue);
+    
+    // Minimax algorithm with alpha-beta pruning
+    double minimax(ChessBoard& board, int depth, int ply, double alpha, double beta, 
+                  bool maximizingPlayer, PieceColor aiColor, SearchContext& context);
+    
+    // Order moves: hash move, captures by MVV-LVA, promotions, killer moves, then the rest
+    static void orderMoves(const ChessBoard& board, ChessMove* moves, size_t count, 
+                          const ChessMove& hashMove, const std::array<ChessMove, 2>* killers);
+    
+    // Remember a quiet move that caused a cutoff at this ply
+    static void storeKillerMove(const ChessBoard& board, const ChessMove& move, int ply, SearchContext& context);
+    
+    // Get the search depth based on skill level
+    int getSearchDepth() const;
+    
     // Simplified evaluation for quick recommendations
     double quickEvaluateMove(const ChessBoard& board, const ChessMove& move, PieceColor color) const;
     
@@ -697,16 +1699,102 @@ public:
     void clearQueue();
 
 private:
-    std::vector<ChessPlayer*> playerQueue;
+    // Rating difference accepted at first, how fast it widens while a player waits,
+    // and the most it widens to
+    static constexpr int BASE_RATING_WINDOW = 100;
+    static constexpr int RATING_WINDOW_GROWTH_PER_SECOND = 10;
+    static constexpr int MAX_RATING_WINDOW = 800;
+    
+    using RatingIndex = std::multimap<int, ChessPlayer*>;
+    
+    RatingIndex ratingIndex;  // Queued players ordered by their rating when they joined
+    std::unordered_map<ChessPlayer*, RatingIndex::iterator> ratingPositions;
     std::unordered_map<ChessPlayer*, QDateTime> queueTimes;
     
-    // Find the best match for a player based on rating
-    ChessPlayer* findBestMatch(ChessPlayer* player) const;
+    // Find the closest-rated queued player within maxDifference of a player's rating
+    ChessPlayer* findBestMatch(ChessPlayer* player, int maxDifference) const;
+    
+    // Rating difference a player accepts after waiting this long
+    int getRatingWindow(qint64 waitSeconds) const;
     
     // Calculate the rating difference score (lower is better)
     double getRatingDifferenceScore(int rating1, int rating2) const;
 };
 
+/**
+ * @brief Swiss tournament: a fixed number of rounds, each paired in one pass
+ *
+ * Players are ranked by score, then rating, and paired down the list with the next
+ * player they have not met yet. Win 1, draw 0.5, loss or forfeit 0; an odd player
+ * out gets a one-point bye, at most once. Runs in the server thread.
+ */
+class ChessTournament {
+public:
+    /**
+     * @brief A game of the current round; an empty black is the bye
+     */
+    struct Pairing {
+        std::string white;
+        std::string black;
+    };
+
+    ChessTournament(const std::string& tournamentId, int rounds, TimeControlType timeControl, qint64 startTime);
+    ~ChessTournament() = default;
+
+    const std::string& getId() const { return tournamentId; }
+    TimeControlType getTimeControl() const { return timeControl; }
+    qint64 getStartTime() const { return startTime; }
+    int getRounds() const { return rounds; }
+    int getCurrentRound() const { return currentRound; }
+    bool hasStarted() const { return currentRound > 0; }
+    bool isFinished() const;
+
+    // Players can join until the last round is paired; a late joiner starts on zero
+    bool addPlayer(const std::string& username, int rating);
+
+    // A withdrawn player is not paired again, but keeps the points already scored
+    bool withdrawPlayer(const std::string& username);
+    bool hasPlayer(const std::string& username) const;
+
+    // Pair the next round. Each player who is not withdrawn appears in one pairing
+    std::vector<Pairing> pairNextRound();
+
+    // Score a game of the current round; IN_PROGRESS scores a double forfeit
+    void recordResult(const std::string& white, const std::string& black, GameResult result);
+
+    // Every pairing of the current round has a result
+    bool isRoundComplete() const { return unfinishedGames == 0; }
+
+    // The players still taking part in the next round
+    std::vector<std::string> getActivePlayers() const;
+
+    // Tournament settings and round, with the standings if asked for
+    QJsonObject toJson(bool includeStandings = true) const;
+
+private:
+    struct Participant {
+        std::string username;
+        int rating = 0;
+        double score = 0.0;
+        int whiteGames = 0;
+        int blackGames = 0;
+        bool withdrawn = false;
+        bool hadBye = false;
+        std::unordered_set<std::string> opponents;
+    };
+
+    std::string tournamentId;
+    int rounds;
+    TimeControlType timeControl;
+    qint64 startTime;  // ms since epoch
+    int currentRound;
+    int unfinishedGames;
+    std::map<std::string, Participant> participants;
+
+    // Players by score, then rating, highest first
+    std::vector<const Participant*> rankedPlayers(bool includeWithdrawn) const;
+};
+
 /**
  * @brief Class for chess rating system (Elo)
  */
@@ -740,15 +1828,19 @@ public:
     ChessAnalysisEngine();
     ~ChessAnalysisEngine() = default;
     
+    // Called with the work done so far out of the total while a game is analyzed
+    using ProgressCallback = std::function<void(int completed, int total)>;
+    
     // Analyze a game and provide insights
-    QJsonObject analyzeGame(const ChessGame& game);
+    QJsonObject analyzeGame(const ChessGame& game, const ProgressCallback& progress = ProgressCallback());
     
     // Analyze a specific move
     QJsonObject analyzeMove(const ChessBoard& boardBefore, const ChessMove& move);
     
-    // Get move recommendations
+    // Get move recommendations; setting stopFlag abandons the search and returns none
     std::vector<std::pair<ChessMove, double>> getMoveRecommendations(
-        const ChessBoard& board, PieceColor color, int maxRecommendations = 5);
+        const ChessBoard& board, PieceColor color, int maxRecommendations = 5,
+        const std::atomic<bool>* stopFlag = nullptr);
     
     // Identify blunders, mistakes, and inaccuracies
     QJsonObject identifyMistakes(const ChessGame& game);
@@ -761,8 +1853,30 @@ public:
     std::string generateGameSummary(const ChessGame& game);
 
 private:
+    static constexpr int RECOMMENDATION_SEARCH_DEPTH = 2;
+    
+    /**
+     * @brief One pass over a game: every position evaluated once and what each move did
+     */
+    struct GameReplay {
+        std::vector<ChessMove> moves;
+        std::vector<double> evaluations;    // evaluations[i] is the position before ply i, for the side to move
+        std::vector<std::string> notation;  // Standard notation of each move
+        std::vector<bool> captures;
+        std::vector<bool> checks;
+        std::vector<int> piecesAfter;       // Pieces other than kings left after each move
+    };
+    
     ChessAI analysisAI;
     
+    // Replay the game once, reporting each evaluated position to progress
+    GameReplay replayGame(const ChessGame& game, const ProgressCallback& progress = ProgressCallback());
+    
+    // The parts of the analysis, derived from one replay
+    QJsonObject identifyMistakes(const GameReplay& replay);
+    QJsonObject identifyCriticalMoments(const GameReplay& replay);
+    std::string generateGameSummary(const ChessGame& game, const QJsonObject& mistakes, const QJsonObject& criticalMoments);
+    
     // Evaluate a position deeply
     double evaluatePositionDeeply(const ChessBoard& board, PieceColor color);
     
@@ -777,64 +1891,175 @@ private:
 };
 
 /**
- * @brief Class for connecting to and communicating with a Stockfish chess engine
+ * @brief Limits for one engine search
+ */
+struct EngineSearchLimits {
+    int depth = 0;        // 0 for the pool's default depth
+    int moveTimeMs = 0;   // Search for this long instead of to a depth, if set
+    int multiPv = 1;      // Number of best lines to report
+    int skillLevel = -1;  // 0-20, or -1 for the pool's default
+};
+
+/**
+ * @brief Outcome of one engine search; scores are in pawns from White's point of view
+ */
+struct EngineSearchResult {
+    bool success = false;
+    ChessMove bestMove;
+    double evaluation = 0.0;
+    std::vector<std::pair<ChessMove, double>> lines;  // Best line first, up to multiPv lines
+};
+
+/**
+ * @brief Settings for the pool of UCI engine processes
+ */
+struct EnginePoolConfig {
+    int engineCount = 0;       // 0 picks from the number of cores
+    int threadsPerEngine = 1;
+    int hashMb = 64;
+    int skillLevel = 20;
+    int depth = 15;
+};
+
+/**
+ * @brief One Stockfish (UCI) engine process
+ *
+ * The process belongs to the thread that called initialize() and must only be
+ * used from that thread; EnginePool gives each of its workers its own connector.
  */
 class StockfishConnector {
 public:
-    StockfishConnector(const std::string& enginePath, int skillLevel = 20, int depth = 15);
+    StockfishConnector(const std::string& enginePath, int threads = 1, int hashMb = 64);
     ~StockfishConnector();
     
-    // Initialize the connection to Stockfish
+    // Start the engine process and wait for it to become ready
     bool initialize();
     
     // Check if the connector is initialized
     bool isInitialized() const;
     
-    // Set the skill level (0-20)
-    void setSkillLevel(int level);
-    
-    // Set the search depth
-    void setDepth(int depth);
-    
-    // Set the position from a board
-    void setPosition(const ChessBoard& board);
-    
-    // Get the best move for the current position
-    ChessMove getBestMove();
+    // Check the process is still running and answers isready
+    bool isHealthy();
     
-    // Get move recommendations with evaluations
-    std::vector<std::pair<ChessMove, double>> getMoveRecommendations(int maxRecommendations = 5);
-    
-    // Evaluate the current position
-    double evaluatePosition();
+    // Stop the engine process
+    void shutdown();
     
-    // Analyze a position deeply and return a detailed analysis
-    QJsonObject analyzePosition(const ChessBoard& board);
+    // Search a position; the skill and depth defaults apply where limits leave them unset.
+    // Setting stopFlag stops the running search, which then gives an unsuccessful result
+    EngineSearchResult search(const std::string& fen, bool whiteToMove, const EngineSearchLimits& limits,
+                              int defaultDepth, int defaultSkillLevel, const std::atomic<bool>* stopFlag = nullptr);
     
-    // Analyze a game and provide insights
-    QJsonObject analyzeGame(const ChessGame& game);
+    // Convert a board to FEN notation
+    static std::string boardToFen(const ChessBoard& board);
 
 private:
+    static constexpr int READY_TIMEOUT_MS = 5000;
+    static constexpr int SEARCH_TIMEOUT_MS = 120000;  // Depth-limited searches
+    static constexpr int STOP_POLL_MS = 20;           // How often a stoppable search checks its flag
+    
     std::string enginePath;
-    int skillLevel;
-    int depth;
+    int threads;
+    int hashMb;
     QProcess* process;
     bool initialized;
+    int currentSkillLevel;  // Options last sent, so they are only resent on change
+    int currentMultiPv;
+    QByteArray readBuffer;
     
-    // Send a command to Stockfish and wait for "readyok"
+    // Send a command to Stockfish
     void sendCommand(const std::string& command);
     
-    // Send a command and get the output until a specific terminator is found
-    std::string sendCommandAndGetOutput(const std::string& command, const std::string& terminator);
+    // Send isready and wait for readyok
+    bool synchronize();
     
-    // Parse the evaluation score from Stockfish output
-    double parseEvaluation(const std::string& evalStr);
+    // Read output lines until one starts with terminator; false on timeout or a dead process
+    bool readUntil(const std::string& terminator, std::vector<std::string>& lines, int timeoutMs);
     
-    // Convert a board to FEN notation
-    std::string boardToFen(const ChessBoard& board);
+    // Parse the "score cp"/"score mate" part of an info line, in pawns for the side to move
+    static bool parseScore(const std::string& line, double& score);
     
     // Parse a move from Stockfish format to our format
-    ChessMove parseStockfishMove(const std::string& moveStr, const ChessBoard& board);
+    static ChessMove parseStockfishMove(const std::string& moveStr);
+};
+
+/**
+ * @brief Pool of persistent engine processes serving an asynchronous search queue
+ *
+ * Each worker thread owns one StockfishConnector and takes jobs from a shared queue,
+ * so independent searches run on as many engines as there are workers. Bot moves
+ * have a queue of their own that is always served first, so they never wait behind
+ * a game analysis. Workers check
+ * their engine while idle and restart it if it has died; a job that was running when
+ * its engine crashed is retried once on the restarted engine.
+ */
+class EnginePool {
+public:
+    EnginePool(const std::string& enginePath, const EnginePoolConfig& config);
+    ~EnginePool();
+    
+    // Start the engines; true if at least one came up
+    bool start();
+    
+    // Check if any engine is running
+    bool isAvailable() const;
+    
+    // Queue a search of a position; the future is ready when an engine has finished it.
+    // Urgent searches go ahead of all others. Once cancelled is set, a queued search is
+    // skipped and a running one stopped, either with an unsuccessful result
+    std::future<EngineSearchResult> submit(const ChessBoard& board, const EngineSearchLimits& limits = EngineSearchLimits(),
+                                           bool urgent = false, std::shared_ptr<const std::atomic<bool>> cancelled = nullptr);
+    
+    // Blocking helpers built on submit(). getBestMove() is urgent and searches for
+    // moveTimeMs if it is set; it gives nothing if no engine answered within that time
+    std::optional<ChessMove> getBestMove(const ChessBoard& board, int skillLevel = -1, qint64 moveTimeMs = 0);
+    std::vector<std::pair<ChessMove, double>> getMoveRecommendations(const ChessBoard& board, int maxRecommendations = 5,
+                                                                     const std::atomic<bool>* stopFlag = nullptr);
+    QJsonObject analyzePosition(const ChessBoard& board);
+    
+    // Analyze a game, searching all of its positions in parallel
+    QJsonObject analyzeGame(const ChessGame& game,
+                            const ChessAnalysisEngine::ProgressCallback& progress = ChessAnalysisEngine::ProgressCallback());
+    
+    // Defaults for searches that do not set their own
+    void setDepth(int depth);
+    void setSkillLevel(int level);
+    
+    int getEngineCount() const;
+    int getLiveEngineCount() const;
+    size_t getQueueLength() const;
+    int getRestartCount() const;
+
+private:
+    static constexpr int HEALTH_CHECK_INTERVAL_MS = 30000;
+    static constexpr int RESTART_BACKOFF_MS = 1000;
+    static constexpr int BOT_REPLY_MARGIN_MS = 200;  // Engine and pipe overhead on top of a bot's move time
+    
+    struct Job {
+        std::string fen;
+        bool whiteToMove;
+        EngineSearchLimits limits;
+        std::shared_ptr<const std::atomic<bool>> cancelled;
+        std::promise<EngineSearchResult> promise;
+    };
+    
+    std::string enginePath;
+    EnginePoolConfig config;
+    std::atomic<int> depth;
+    std::atomic<int> skillLevel;
+    std::atomic<int> liveEngines;
+    std::atomic<int> restarts;
+    
+    std::vector<std::thread> workers;
+    std::deque<Job> urgentJobs;  // Bot moves, taken before any of jobs
+    std::deque<Job> jobs;
+    mutable std::mutex jobsMutex;
+    std::condition_variable jobsAvailable;
+    bool stopping;
+    
+    void workerLoop(int index, std::promise<bool> started);
+    
+    // Restart a dead engine; false if it could not be started
+    bool restartEngine(StockfishConnector& engine, int index);
 };
 
 /**
@@ -878,6 +2103,17 @@ public:
     
     // Deserialize a board from JSON
     std::unique_ptr<ChessBoard> deserializeBoard(const QJsonObject& json);
+    
+    // Write a stored game (as ChessGame::getGameHistoryJson() makes it) as one PGN game.
+    // The moves are replayed from the start, so each is written in SAN for the position
+    // it was played in. Ratings of 0 are left out; false if a move is not legal
+    bool gameJsonToPgn(const QJsonObject& gameJson, int whiteElo, int blackElo, std::string& pgn,
+                       std::string& error);
+    
+    // Parse one PGN game into the stored game format, with the ratings from its Elo tags
+    // (0 if it has none); false with error set if a tag or move cannot be read
+    bool pgnToGameJson(const std::string& pgn, QJsonObject& gameJson, int& whiteElo, int& blackElo,
+                       std::string& error);
 
 private:
     // Helper methods for serialization/deserialization
@@ -885,10 +2121,319 @@ private:
     std::unique_ptr<ChessPiece> deserializePiece(const QJsonObject& json);
     QJsonObject serializeMove(const ChessMove& move);
     ChessMove deserializeMove(const QJsonObject& json);
+    
+    // SAN of one of the legal moves, without the check or mate suffix
+    static std::string sanWithoutSuffix(const ChessBoard& board, const ChessMove& move, const MoveList& legalMoves);
+    
+    // The legal move a SAN (or coordinate) token names; invalid if none or several match
+    static ChessMove moveFromSan(const ChessBoard& board, const std::string& san, const MoveList& legalMoves);
+};
+
+/**
+ * @brief Splits a PGN stream into games, holding only the game being read
+ *
+ * A game is its tag section and movetext; the next line that starts a tag after
+ * movetext begins the following game. Lines starting with '%' are skipped.
+ */
+class PgnReader {
+public:
+    explicit PgnReader(QIODevice* device) : device(device), hasPendingLine(false) {}
+    
+    // The text of the next game; false at the end of the input
+    bool next(std::string& game);
+
+private:
+    QIODevice* device;
+    QByteArray pendingLine;  // First line of the next game, read while finishing the last one
+    bool hasPendingLine;
+};
+
+/**
+ * @brief Length-prefixed binary framing, negotiated per connection alongside JSON
+ *
+ * Frame layout (big-endian): uint32 size of the rest of the frame, uint8 MessageType,
+ * uint8 payload Encoding, payload. MOVE and MOVE_RESULT have packed payloads; GAME_STATE
+ * and every other type carry their fields as CBOR, with the GAME_STATE board packed into
+ * a 64-character placement string. Large CBOR payloads (history, analysis, leaderboard)
+ * can be sent compressed to clients that asked for it. A JSON message never starts with
+ * a zero byte and a frame always does, so a reader can tell them apart from the first byte.
+ */
+class WireProtocol {
+public:
+    enum class Encoding : uint8_t {
+        PACKED = 0,          // Type-specific packed fields
+        CBOR = 1,            // CBOR map of the message fields, without "type"
+        COMPRESSED_CBOR = 2  // The CBOR payload passed through qCompress()
+    };
+    
+    // Value of the "protocol" field a client sends with AUTHENTICATION to ask for binary frames
+    static constexpr const char* PROTOCOL_NAME = "binary-v1";
+    
+    // Value of the "compression" field a client sends with AUTHENTICATION if it can
+    // decode COMPRESSED_CBOR frames
+    static constexpr const char* COMPRESSION_NAME = "qcompress";
+    
+    // CBOR payloads smaller than this are never compressed (keeps MOVE/GAME_STATE cheap)
+    static constexpr int COMPRESSION_THRESHOLD = 8 * 1024;
+    
+    // Largest payload a compressed frame may expand to
+    static constexpr quint32 MAX_UNCOMPRESSED_SIZE = 32 * 1024 * 1024;
+    
+    // Length prefix plus type and encoding bytes
+    static constexpr int HEADER_SIZE = 6;
+    
+    // Largest frame either side will accept
+    static constexpr quint32 MAX_FRAME_SIZE = 4 * 1024 * 1024;
+    
+    // Encode a message (with its "type" field) as a complete frame; with compress set,
+    // large CBOR payloads are compressed when that makes them smaller
+    static QByteArray encode(const QJsonObject& message, bool compress = false);
+    
+    // Total size of the frame at data, 0 if the length prefix is not complete yet, -1 if it is too large
+    static qsizetype frameSize(const char* data, qsizetype available);
+    
+    // Decode a complete frame back into the message object the JSON path would have produced
+    static bool decode(const char* frame, qsizetype size, QJsonObject& message);
+    
+private:
+    static bool encodePacked(MessageType type, const QJsonObject& message, QByteArray& payload);
+    static bool decodePacked(MessageType type, const char* payload, qsizetype size, QJsonObject& message);
+    
+    // Pack "e7e8q" style moves into 16 bits: from (6), to (6), promotion (3)
+    static bool packMove(const QString& move, quint16& packed);
+    static QString unpackMove(quint16 packed);
+    
+    // Convert between the GAME_STATE board array and a 64-character placement string
+    static QString packBoard(const QJsonArray& board);
+    static QJsonArray unpackBoard(const QString& placement);
+};
+
+/**
+ * @brief Incremental receive buffer and frame parser for one client connection
+ *
+ * Accepts compact JSON objects (newline-terminated or not) and WireProtocol frames in
+ * any mix. Each message boundary is found in a single pass over the new bytes, and each
+ * complete message is parsed once, in place.
+ */
+class MessageFramer {
+public:
+    enum class Status {
+        MESSAGE,     // A message was decoded
+        INCOMPLETE,  // Need more bytes
+        INVALID,     // A complete message could not be decoded; it was skipped
+        FATAL        // The stream cannot be framed (oversized or garbage); drop the connection
+    };
+    
+    MessageFramer() : readOffset(0) { resetScan(); }
+    
+    // Append everything the device has available to the buffer
+    void readFrom(QIODevice* device);
+    
+    // Decode the next complete message, if any
+    Status next(QJsonObject& message, std::string& error);
+    
+    qsizetype bufferedBytes() const { return buffer.size() - readOffset; }
+    
+private:
+    QByteArray buffer;
+    qsizetype readOffset;  // Start of the first unconsumed message
+    
+    // State of the JSON object scan, kept across reads so bytes are scanned once
+    qsizetype scanOffset;
+    int depth;
+    bool inString;
+    bool escaped;
+    
+    void resetScan() { scanOffset = -1; depth = 0; inString = false; escaped = false; }
+    void consume(qsizetype bytes);
+    
+    // Find the end of the JSON object at readOffset; -1 if it is not complete
+    qsizetype scanJsonObject();
+};
+
+/**
+ * @brief Token bucket that refills continuously up to its capacity
+ */
+class TokenBucket {
+public:
+    TokenBucket() : TokenBucket(1.0, 1.0) {}
+    TokenBucket(double capacity, double refillPerSecond)
+        : capacity(capacity), refillPerSecond(refillPerSecond), tokens(capacity), lastRefillMs(-1) {}
+    
+    // Take one token if there is one
+    bool tryConsume(qint64 nowMs);
+    
+    // Milliseconds until a token is available, 0 if one is available now
+    qint64 msUntilToken(qint64 nowMs);
+    
+private:
+    double capacity;
+    double refillPerSecond;
+    double tokens;
+    qint64 lastRefillMs;
+    
+    void refill(qint64 nowMs);
+};
+
+/**
+ * @brief Input side of one connection: its framer plus per-class message budgets
+ *
+ * Messages are admitted in arrival order. Once the next message's class is out of
+ * tokens, decoded messages wait in a bounded queue and the socket's read buffer is
+ * capped, so the kernel buffer fills and TCP flow control pushes back on the client
+ * instead of one connection monopolizing the event loop.
+ */
+class InboundConnection {
+public:
+    enum class MessageClass {
+        GAMEPLAY,  // Moves, resignations, draws, state requests, pings
+        SESSION,   // Authentication, matchmaking, spectating
+        CHAT,
+        QUERY,     // History and leaderboard lookups
+        ANALYSIS,  // Full-game analysis, by far the most expensive request
+        COUNT
+    };
+    
+    // Decoded messages that may wait for tokens before the connection is dropped from reading
+    static constexpr int MAX_QUEUED_MESSAGES = 32;
+    
+    // Read buffer size while throttled; 0 restores Qt's unlimited default
+    static constexpr qint64 THROTTLED_READ_BUFFER_SIZE = 16 * 1024;
+    
+    InboundConnection();
+    
+    static MessageClass classify(MessageType type);
+    
+    // Read the socket unless throttled and pass each message within budget to deliver,
+    // which returns false once the connection has been closed. Returns false if the
+    // stream cannot be framed and the connection must be dropped
+    bool process(QTcpSocket* socket, const std::function<bool(const QJsonObject&)>& deliver, ChessLogger* logger);
+    
+    // Milliseconds until the first queued message can be admitted, or -1 if nothing is
+    // waiting or a retry is already scheduled. A delay marks the retry as scheduled
+    qint64 scheduleRetry();
+    void retryStarted() { retryScheduled = false; }
+    
+    bool isThrottled() const { return throttled; }
+    
+private:
+    MessageFramer framer;
+    std::array<TokenBucket, static_cast<size_t>(MessageClass::COUNT)> buckets;
+    QQueue<QJsonObject> queued;
+    bool throttled;
+    bool retryScheduled;
+    
+    TokenBucket& bucketFor(const QJsonObject& message) {
+        return buckets[static_cast<size_t>(classify(static_cast<MessageType>(message["type"].toInt())))];
+    }
+    
+    static qint64 nowMs();
+};
+
+// Trace logging for hot paths (move generation, search, evaluation). The message
+// expression is only evaluated when tracing is enabled at runtime (log level 3), and
+// building with MPCHESS_ENABLE_TRACE=0 removes the sites entirely.
+#ifndef MPCHESS_ENABLE_TRACE
+#define MPCHESS_ENABLE_TRACE 1
+#endif
+
+#if MPCHESS_ENABLE_TRACE
+#define MPCHESS_TRACE(message) \
+    do { \
+        if (ChessLogger::isTraceEnabled()) { \
+            ChessLogger::trace(message); \
+        } \
+    } while (0)
+#else
+#define MPCHESS_TRACE(message) do { } while (0)
+#endif
+
+// Debug logging whose message expression is only built when the logger's level
+// enables debug output
+#define MPCHESS_DEBUG(logger, ...) \
+    do { \
+        if ((logger) && (logger)->isDebugEnabled()) { \
+            (logger)->debug(__VA_ARGS__); \
+        } \
+    } while (0)
+
+/**
+ * @brief Bounded lock-free queue for any number of producers and a single consumer
+ *
+ * Each slot carries a sequence number that tells producers whether it is free and
+ * the consumer whether it has been published, so neither side takes a lock.
+ */
+template <typename T>
+class MpscRingBuffer {
+public:
+    // The capacity is rounded up to a power of two
+    explicit MpscRingBuffer(size_t capacity) : enqueuePos(0), dequeuePos(0) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        cells.reset(new Slot[size]);
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+    // Add a value; false if the queue is full. Safe from any thread
+    bool tryPush(T&& value) {
+        Slot* slot;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            slot = &cells[pos & mask];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::move(value);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Take the oldest published value; false if there is none. Consumer thread only
+    bool tryPop(T& value) {
+        Slot& slot = cells[dequeuePos & mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeuePos + 1) < 0) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+        ++dequeuePos;
+        return true;
+    }
+    
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+    
+    std::unique_ptr<Slot[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) size_t dequeuePos;
 };
 
 /**
  * @brief Class for chess server logging
+ *
+ * Callers only stamp the time and push an entry onto a lock-free queue. A
+ * background thread formats the entries and writes them in batches, flushing
+ * once the queue is drained, so the event loop and search threads never wait on
+ * disk I/O. If the queue fills up, entries are dropped and the count is logged.
  */
 class ChessLogger {
 public:
@@ -916,7 +2461,7 @@ public:
     // Log a server event
     void logServerEvent(const std::string& event);
     
-    // Log a network message
+    // Log a network message; it is serialized on the writer thread
     void logNetworkMessage(const std::string& direction, const QJsonObject& message);
     
     // Set the log level
@@ -925,16 +2470,66 @@ public:
     // Get the current log level
     int getLogLevel() const;
     
-    // Flush the log to disk
+    // Check whether debug messages are written; MPCHESS_DEBUG skips building them otherwise
+    bool isDebugEnabled() const { return logLevel.load(std::memory_order_relaxed) >= 1; }
+    
+    // Log level at which MPCHESS_TRACE sites write their messages
+    static constexpr int TRACE_LOG_LEVEL = 3;
+    
+    // Check whether trace sites are enabled; one relaxed load, no server lookup
+    static bool isTraceEnabled() { return traceEnabled.load(std::memory_order_relaxed); }
+    
+    // Write a trace message through the server logger
+    static void trace(const std::string& message);
+    
+    // Wait until everything logged so far is written, then flush the log to disk
     void flush();
 
 private:
+    /**
+     * @brief One queued log line, formatted by the writer thread
+     */
+    struct LogEntry {
+        std::chrono::system_clock::time_point time;
+        const char* tag = "";
+        int console = 0;          // 0: file only, 1: also stdout, 2: also stderr
+        std::string message;
+        QJsonObject json;         // Network message to serialize after the text, if any
+    };
+    
+    static constexpr size_t QUEUE_CAPACITY = 16384;
+    
     std::ofstream logFile;
-    int logLevel;
-    std::mutex logMutex;
+    std::atomic<int> logLevel;
+    static std::atomic<bool> traceEnabled;
     
-    // Get the current timestamp as a string
-    std::string getCurrentTimestamp() const;
+    MpscRingBuffer<LogEntry> queue;
+    std::atomic<uint64_t> enqueuedCount;
+    std::atomic<uint64_t> droppedCount;
+    std::thread writerThread;
+    
+    // Wake-ups for the writer and for flush() callers waiting on it
+    std::mutex writerMutex;
+    std::condition_variable writerWake;
+    std::condition_variable writerDrained;
+    bool stopping;
+    uint64_t writtenCount;        // Guarded by writerMutex
+    
+    // Cached "YYYY-MM-DD HH:MM:SS" for the last second seen by the writer
+    std::time_t cachedSecond;
+    std::string cachedSecondText;
+    
+    // Stamp and queue an entry
+    void enqueue(const char* tag, int console, std::string message, QJsonObject json = QJsonObject());
+    
+    // Writer thread body
+    void writerLoop();
+    
+    // Format and write one entry
+    void writeEntry(const LogEntry& entry);
+    
+    // Format a timestamp as a string
+    std::string formatTimestamp(std::chrono::system_clock::time_point time);
 };
 
 /**
@@ -957,47 +2552,317 @@ public:
     // Get a player by username
     std::unique_ptr<ChessPlayer> getPlayer(const std::string& username);
     
-    // Save a player's data
+    // Save a player's data; the file is written later by the persistence thread
     bool savePlayer(const ChessPlayer& player);
     
+    // Save several players' data with one hand-off to the persistence thread
+    bool savePlayers(const std::vector<ChessPlayer>& players);
+    
     // Get all registered players
     std::vector<std::string> getAllPlayerUsernames();
     
     // Delete a player
     bool deletePlayer(const std::string& username);
+    
+    // The stored salted hash of a player's password, empty if there is none
+    std::string getPasswordHash(const std::string& username);
+    
+    // Store a player record and password hash that another node wrote
+    void importPlayer(const ChessPlayer& player, const std::string& passwordHash);
+    
+    // Block until every pending player record and password change is on disk
+    void flush();
+    
+    // Work factor of new password hashes: scrypt with N = 2^cost, r = 8 and p = 1, so one
+    // hash takes 2^cost KiB of memory. Hashes stored with another cost are redone at login
+    void setKdfCost(int cost);
+    int getKdfCost() const;
 
 private:
     std::string userDbPath;
-    std::unordered_map<std::string, std::string> passwordCache;
     std::mutex authMutex;
     
-    // Hash a password
+    // Username index: users.index lists every username with its password hash, sorted by
+    // name, and is mapped rather than parsed at startup, so a lookup is a binary search.
+    // passwordCache overlays the changes made since it was written; an empty hash there
+    // marks a deleted player
+    static constexpr quint32 INDEX_MAGIC = 0x4955504D;  // "MPUI"
+    static constexpr quint32 INDEX_VERSION = 1;
+    static constexpr qint64 INDEX_HEADER_SIZE = 16;
+    
+    std::unordered_map<std::string, std::string> passwordCache;
+    std::unique_ptr<QFile> indexFile;
+    const char* indexData;
+    qint64 indexSize;
+    quint32 indexCount;
+    
+    // The stored hash from the overlay or the index; false for an unknown or deleted player
+    bool findPasswordHashLocked(const std::string& username, std::string& hash) const;
+    bool indexRecord(quint32 index, std::string_view& username, std::string_view& hash) const;
+    bool findInIndex(const std::string& username, std::string& hash) const;
+    bool mapUserIndex();
+    void unmapUserIndex();
+    
+    // Write-behind persistence. Callers only record what changed; the writer thread
+    // coalesces repeated saves of a player and writes them in the background
+    static constexpr int FLUSH_DELAY_MS = 200;             // How long changes may wait to be batched
+    static constexpr size_t PASSWORD_JOURNAL_LIMIT = 1024;  // Journal entries before users.index is rewritten
+    
+    std::unordered_map<std::string, QJsonObject> dirtyPlayers;     // Latest unwritten state per player
+    std::unordered_map<std::string, QJsonObject> writingPlayers;   // Batch the writer is writing now
+    std::unordered_set<std::string> deletedPlayers;
+    std::vector<std::pair<std::string, std::string>> passwordChanges;  // Username and hash, empty hash for a deletion
+    size_t passwordJournalEntries;  // Entries in passwords.log since users.index was last rewritten
+    
+    std::thread writerThread;
+    std::mutex persistMutex;
+    std::condition_variable writerWake;
+    std::condition_variable writerDrained;
+    bool stopping;
+    bool writerBusy;
+    int flushWaiters;  // Callers blocked in flush(); the writer skips its batching delay for them
+    
+    void writerLoop();
+    void markPasswordChanged(const std::string& username, const std::string& hash);
+    bool hasPendingWritesLocked() const;
+    
+    // Write a file through a temporary file and rename, so readers never see a partial file
+    static bool writeFileAtomically(const QString& path, const QByteArray& data);
+    
+    static constexpr int DEFAULT_KDF_COST = 14;  // 16 MiB per hash
+    static constexpr int MIN_KDF_COST = 10;
+    static constexpr int MAX_KDF_COST = 20;
+    static constexpr int KDF_BLOCK_SIZE = 8;
+    static constexpr int KDF_PARALLELISM = 1;
+    static constexpr int KDF_KEY_LENGTH = 32;
+    std::atomic<int> kdfCost;
+    
+    // Hash a password as "$scrypt$cost$r$p$salt$key" with the current cost
     std::string hashPassword(const std::string& password, const std::string& salt = "");
     
-    // Generate a random salt
+    // Check a password against a stored hash; upgrade is set when it should be rehashed
+    bool verifyPassword(const std::string& password, const std::string& storedHash, bool& upgrade) const;
+    
+    // Salted SHA-256, the format hashes were stored in before scrypt
+    static std::string legacyHashPassword(const std::string& password, const std::string& salt);
+    
+    static QByteArray deriveScryptKey(const QByteArray& password, const QByteArray& salt, int log2N, int r, int p,
+                                      int keyLength);
+    
+    // Generate a random salt
     std::string generateSalt(int length = 16);
     
-    // Load the password database
+    // Map the username index (importing a legacy passwords.json once) and replay the journal
     void loadPasswordDb();
     
-    // Save the password database
+    // Merge the overlay into a new users.index, which also empties the journal
     void savePasswordDb();
     
+    // Append password changes to passwords.log, replayed over users.index on load
+    void appendPasswordJournal(const std::vector<std::pair<std::string, std::string>>& changes);
+    void replayPasswordJournal();
+    std::string getPasswordJournalPath() const;
+    QString getUserIndexPath() const;
+    
     // Get the path to a player's data file
     std::string getPlayerFilePath(const std::string& username);
 };
 
+/**
+ * @brief Ordered set with rank queries, implemented as a size-augmented treap
+ *
+ * Insert, erase and rank are O(log n) expected, and an in-order walk can start at
+ * any index in O(log n). Less orders the keys; equal keys are stored once.
+ */
+template <typename Key, typename Less = std::less<Key>>
+class OrderStatisticTree {
+public:
+    OrderStatisticTree() : root(nullptr), seed(0x9E3779B97F4A7C15ULL) {}
+    ~OrderStatisticTree() { clear(); }
+    
+    OrderStatisticTree(const OrderStatisticTree&) = delete;
+    OrderStatisticTree& operator=(const OrderStatisticTree&) = delete;
+    
+    size_t size() const { return sizeOf(root); }
+    
+    // Insert a key; false if an equal key is already present
+    bool insert(const Key& key) {
+        if (contains(key)) {
+            return false;
+        }
+        Node* left = nullptr;
+        Node* right = nullptr;
+        split(root, key, left, right);
+        root = merge(merge(left, new Node{ key, nextPriority(), 1, nullptr, nullptr }), right);
+        return true;
+    }
+    
+    // Remove a key; false if it was not present
+    bool erase(const Key& key) {
+        return erase(root, key);
+    }
+    
+    bool contains(const Key& key) const {
+        for (const Node* node = root; node; ) {
+            if (less(key, node->key)) {
+                node = node->left;
+            } else if (less(node->key, key)) {
+                node = node->right;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // Number of keys ordered before key, which need not be present
+    size_t rank(const Key& key) const {
+        size_t before = 0;
+        for (const Node* node = root; node; ) {
+            if (less(node->key, key)) {
+                before += sizeOf(node->left) + 1;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return before;
+    }
+    
+    // Visit keys in order from index first until fn returns false
+    template <typename Fn>
+    void forEachFrom(size_t first, Fn fn) const {
+        std::vector<const Node*> stack;
+        const Node* node = root;
+        while (node) {
+            size_t leftSize = sizeOf(node->left);
+            if (first < leftSize) {
+                stack.push_back(node);
+                node = node->left;
+            } else if (first == leftSize) {
+                stack.push_back(node);
+                break;
+            } else {
+                first -= leftSize + 1;
+                node = node->right;
+            }
+        }
+        
+        while (!stack.empty()) {
+            const Node* current = stack.back();
+            stack.pop_back();
+            if (!fn(current->key)) {
+                return;
+            }
+            for (const Node* child = current->right; child; child = child->left) {
+                stack.push_back(child);
+            }
+        }
+    }
+    
+    void clear() {
+        destroy(root);
+        root = nullptr;
+    }
+
+private:
+    struct Node {
+        Key key;
+        uint64_t priority;
+        size_t size;
+        Node* left;
+        Node* right;
+    };
+    
+    Node* root;
+    uint64_t seed;
+    Less less;
+    
+    static size_t sizeOf(const Node* node) { return node ? node->size : 0; }
+    static void update(Node* node) { node->size = 1 + sizeOf(node->left) + sizeOf(node->right); }
+    
+    uint64_t nextPriority() {
+        // xorshift64; the priorities only need to look random to keep the tree balanced
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    }
+    
+    // Split into keys ordered before key and the rest
+    void split(Node* node, const Key& key, Node*& left, Node*& right) {
+        if (!node) {
+            left = right = nullptr;
+        } else if (less(node->key, key)) {
+            split(node->right, key, node->right, right);
+            left = node;
+            update(node);
+        } else {
+            split(node->left, key, left, node->left);
+            right = node;
+            update(node);
+        }
+    }
+    
+    static Node* merge(Node* left, Node* right) {
+        if (!left || !right) {
+            return left ? left : right;
+        }
+        if (left->priority > right->priority) {
+            left->right = merge(left->right, right);
+            update(left);
+            return left;
+        }
+        right->left = merge(left, right->left);
+        update(right);
+        return right;
+    }
+    
+    bool erase(Node*& node, const Key& key) {
+        if (!node) {
+            return false;
+        }
+        bool erased;
+        if (less(key, node->key)) {
+            erased = erase(node->left, key);
+        } else if (less(node->key, key)) {
+            erased = erase(node->right, key);
+        } else {
+            Node* removed = node;
+            node = merge(node->left, node->right);
+            delete removed;
+            return true;
+        }
+        if (erased) {
+            update(node);
+        }
+        return erased;
+    }
+    
+    static void destroy(Node* node) {
+        if (node) {
+            destroy(node->left);
+            destroy(node->right);
+            delete node;
+        }
+    }
+};
+
 /**
  * @brief Class for managing player leaderboards
  */
 class ChessLeaderboard {
 public:
+    // The rankings are built on a background thread; queries wait until they are ready
     ChessLeaderboard(const std::string& dataPath);
-    ~ChessLeaderboard() = default;
+    ~ChessLeaderboard();
     
     // Update the leaderboard with a player's data
     void updatePlayer(const ChessPlayer& player);
     
+    // Update several players under one lock
+    void updatePlayers(const std::vector<ChessPlayer>& players);
+    
     // Get the top N players by rating (or all if count is -1)
     std::vector<std::pair<std::string, int>> getTopPlayersByRating(int count = 100);
     
@@ -1016,24 +2881,495 @@ public:
     // Get a player's rank by win percentage
     int getPlayerWinPercentageRank(const std::string& username);
     
+    // Whether the startup load has finished; the queries below wait for it until then
+    bool isLoaded();
+    
     // Generate the leaderboard JSON (all players if count is -1)
     QJsonObject generateLeaderboardJson(int count = 100);
     
-    // Refresh the leaderboard from player data files
+    // Rebuild the leaderboard from every player data file
     void refreshLeaderboard();
+    
+    // Write the snapshot if anything changed since it was last written
+    void saveSnapshot();
 
 private:
+    static constexpr int MIN_GAMES_FOR_WIN_PERCENTAGE = 10;
+    static constexpr quint32 SNAPSHOT_MAGIC = 0x424C504D;  // "MPLB"
+    static constexpr quint32 SNAPSHOT_VERSION = 1;
+    
+    struct Entry {
+        int rating = 0;
+        int wins = 0;
+        int losses = 0;
+        int draws = 0;
+        double winPercentage = 0.0;
+        
+        int gamesPlayed() const { return wins + losses + draws; }
+    };
+    
+    // Ranking key: higher values first, ties broken by username so ranks are stable
+    struct RankKey {
+        double value;
+        std::string username;
+    };
+    struct RankKeyOrder {
+        bool operator()(const RankKey& a, const RankKey& b) const {
+            return a.value != b.value ? a.value > b.value : a.username < b.username;
+        }
+    };
+    using RankTree = OrderStatisticTree<RankKey, RankKeyOrder>;
+    
     std::string dataPath;
-    std::vector<std::tuple<std::string, int, int, int, int, double>> leaderboardData;  // username, rating, wins, losses, draws, win%
+    std::unordered_map<std::string, Entry> entries;
+    RankTree byRating;
+    RankTree byWins;
+    RankTree byWinPercentage;  // Only players with MIN_GAMES_FOR_WIN_PERCENTAGE games
+    bool snapshotDirty;
     std::mutex leaderboardMutex;
     
+    // Startup load; updates that arrive before it finishes are applied on top of it
+    std::thread loaderThread;
+    std::condition_variable loadedCondition;
+    bool loaded;
+    std::unordered_map<std::string, Entry> pendingUpdates;
+    
+    void loadInBackground();
+    void waitUntilLoaded(std::unique_lock<std::mutex>& lock);
+    
+    // Add, replace or remove one player in the three rankings
+    void setEntry(const std::string& username, const Entry& entry);
+    void removeEntry(const std::string& username);
+    void clearEntries();
+    
+    // Apply one player's record; leaderboardMutex must be held
+    void updatePlayerLocked(const ChessPlayer& player);
+    
+    static Entry entryFromJson(const QJsonObject& playerJson);
+    QJsonObject entryJson(const std::string& username, const Entry& entry, int rank) const;
+    
     // Load all player data
     void loadPlayerData();
     
-    // Sort the leaderboard by different criteria
-    void sortByRating();
-    void sortByWins();
-    void sortByWinPercentage();
+    // Load the binary snapshot, then read only the player files written after it
+    bool loadSnapshot();
+    bool loadPlayerFile(const QString& filePath);
+    QString snapshotPath() const;
+};
+
+/**
+ * @brief Append-only store of finished games
+ *
+ * Games are appended to numbered segment files as length-prefixed, checksummed
+ * records. An in-memory index maps each gameId to its newest record and each
+ * player to their games, so a single game loads with one read and a player's
+ * games are streamed without parsing anyone else's. A segment is sealed once it
+ * reaches SEGMENT_SIZE; sealed segments get a sidecar index so startup does not
+ * rescan them, and one that is mostly superseded records is compacted into the
+ * active segment. Legacy <gameId>.json files are imported the first time it opens.
+ *
+ * Alongside the games, a summary table (summaries.log) keeps a compact header per
+ * game. It is loaded at startup and indexed by player, so history pages are served
+ * from memory and only a request for one specific game reads its full record.
+ */
+class GameHistoryStore {
+public:
+    /**
+     * @brief Header of a stored game, as kept in the summary table
+     */
+    struct GameSummary {
+        std::string gameId;
+        std::string whitePlayer;
+        std::string blackPlayer;
+        std::string result;      // "white_win", "black_win", "draw" or "in_progress"
+        qint64 startTime = 0;    // Milliseconds since the epoch, 0 if unknown
+        qint64 endTime = 0;
+        int whiteRating = 0;     // Ratings when the game was saved, 0 if unknown
+        int blackRating = 0;
+        int moveCount = 0;
+        quint64 ordinal = 0;     // Order in which games were first saved; also the paging cursor
+    };
+    
+    explicit GameHistoryStore(const std::string& directory);
+    ~GameHistoryStore();
+    
+    // Append a game's record; a game saved again replaces its earlier record
+    bool saveGame(const std::string& gameId, const std::string& whitePlayer,
+                  const std::string& blackPlayer, const QJsonObject& gameJson,
+                  int whiteRating = 0, int blackRating = 0);
+    
+    // A page of a player's game headers, newest first. cursor is the previous page's
+    // nextCursor, or 0 for the newest games; nextCursor is set to 0 on the last page
+    std::vector<GameSummary> getPlayerGames(const std::string& username, quint64 cursor, int limit,
+                                            quint64& nextCursor) const;
+    
+    // Load one game; false if it is unknown or its record cannot be read
+    bool loadGame(const std::string& gameId, QJsonObject& gameJson);
+    
+    // Check whether a game is stored
+    bool contains(const std::string& gameId) const;
+    
+    // Keep the analysis of a stored game so it does not have to be recomputed
+    bool saveAnalysis(const std::string& gameId, const QJsonObject& analysis);
+    
+    // Load a game's saved analysis; false if it has none
+    bool loadAnalysis(const std::string& gameId, QJsonObject& analysis) const;
+    
+    // Read a player's games in the order they were first saved until fn returns false.
+    // fn must not call back into the store
+    void forEachGameOfPlayer(const std::string& username, const std::function<bool(const QJsonObject&)>& fn);
+    
+    // Read every stored game until fn returns false. fn must not call back into the store
+    void forEachGame(const std::function<bool(const QJsonObject&)>& fn);
+    
+    // Every game's header, in the order the games were first saved
+    std::vector<GameSummary> getAllSummaries() const;
+    
+    // Segment files holding games, oldest first
+    std::vector<int> getSegmentIds() const;
+    
+    // Read the games whose newest record is in the segment and whose header passes
+    // filter, in file order, until fn returns false. The records are read through a file
+    // handle of this call's own, outside the store lock, so several segments can be read
+    // at once. filter runs under the lock; neither callback may call back into the store
+    void forEachGameInSegment(int segment, const std::function<bool(const GameSummary&)>& filter,
+                              const std::function<bool(const GameSummary&, const QJsonObject&)>& fn) const;
+    
+    // Number of stored games
+    size_t size() const;
+    
+    // Rewrite sealed segments whose records are mostly superseded
+    void compact();
+
+private:
+    static constexpr qint64 SEGMENT_SIZE = 64 * 1024 * 1024;
+    static constexpr quint32 MAX_RECORD_SIZE = 16 * 1024 * 1024;
+    static constexpr int RECORD_HEADER_SIZE = 6;  // Length of the rest of the record, checksum of the body
+    static constexpr int SUMMARY_FIXED_SIZE = 34;  // Ordinal, start and end times, ratings, move count
+    
+    struct RecordLocation {
+        int segment = 0;
+        qint64 offset = 0;
+        quint32 size = 0;
+    };
+    
+    struct IndexEntry {
+        std::string whitePlayer;
+        std::string blackPlayer;
+        RecordLocation location;
+    };
+    
+    struct SegmentInfo {
+        qint64 size = 0;
+        qint64 liveBytes = 0;  // Bytes of records that are still the newest for their game
+    };
+    
+    // Fields of a record ahead of its CBOR payload
+    struct RecordHeader {
+        std::string gameId;
+        std::string whitePlayer;
+        std::string blackPlayer;
+        qsizetype payloadOffset = 0;
+    };
+    
+    QString directory;
+    std::unordered_map<std::string, IndexEntry> gameIndex;
+    
+    // Summary table, and each player's summaries in ordinal order. The pointers stay
+    // valid because unordered_map never moves its elements
+    std::unordered_map<std::string, GameSummary> summaries;
+    std::unordered_map<std::string, std::vector<const GameSummary*>> playerGames;
+    QFile summaryFile;
+    size_t summaryRecords;  // Records in summaries.log, superseded ones included
+    quint64 nextOrdinal;
+    std::map<int, SegmentInfo> segments;
+    std::map<int, std::unique_ptr<QFile>> readers;
+    QFile activeFile;
+    int activeSegment;
+    bool compacting;
+    mutable std::mutex storeMutex;
+    
+    QString segmentPath(int segment) const;
+    QString indexPath(int segment) const;
+    QString summaryPath() const;
+    QString analysisPath(const std::string& gameId) const;
+    
+    // Build the index from the sidecar indexes and by scanning the active segment
+    void loadSegments();
+    bool loadSidecarIndex(int segment);
+    void scanSegment(int segment, bool truncateTornTail);
+    void writeSidecarIndex(int segment);
+    
+    void openActiveSegment();
+    void rollOver();
+    void importLegacyFiles();
+    
+    // Load the summary table, summarize stored games it does not cover yet, and
+    // rewrite it when it is mostly superseded records
+    void loadSummaries();
+    void rewriteSummaries();
+    bool appendSummary(const GameSummary& summary);
+    void recordSummary(const GameSummary& summary);
+    static GameSummary summarize(const std::string& gameId, const std::string& whitePlayer,
+                                 const std::string& blackPlayer, const QJsonObject& gameJson,
+                                 int whiteRating, int blackRating);
+    
+    // Record a game's newest location and update the live byte counts
+    void indexRecord(const std::string& gameId, const std::string& whitePlayer,
+                     const std::string& blackPlayer, const RecordLocation& location);
+    
+    bool appendRecord(const QByteArray& record, RecordLocation& location);
+    QByteArray readRecord(const RecordLocation& location);
+    bool loadGameLocked(const std::string& gameId, QJsonObject& gameJson);
+    bool saveGameLocked(const std::string& gameId, const std::string& whitePlayer,
+                        const std::string& blackPlayer, const QJsonObject& gameJson,
+                        int whiteRating, int blackRating);
+    void compactLocked();
+    
+    static QByteArray encodeRecord(const std::string& gameId, const std::string& whitePlayer,
+                                   const std::string& blackPlayer, const QByteArray& payload);
+    
+    // Size of the valid record at data, or -1 if it is incomplete or corrupt
+    static qsizetype decodeRecordHeader(const char* data, qsizetype available, RecordHeader& header);
+    
+    static QByteArray encodeSummary(const GameSummary& summary);
+    static qsizetype decodeSummary(const char* data, qsizetype available, GameSummary& summary);
+    
+    // Length, checksum and body framing shared by game and summary records
+    static QByteArray frameRecord(const QByteArray& body);
+    static qsizetype unframeRecord(const char* data, qsizetype available, const char*& body, qsizetype& bodySize);
+    
+    // Length-prefixed strings inside a record body
+    static void appendField(QByteArray& body, const std::string& field);
+    static bool readField(const char* body, qsizetype bodySize, qsizetype& pos, std::string& field);
+};
+
+/**
+ * @brief Shared directory through which the nodes of a cluster find each other
+ *
+ * The root is any directory every node can reach, such as an NFS share. Each node
+ * keeps a heartbeat record with its address and load in nodes/, records which node
+ * hosts each player's game in sessions/, and appends the player records it changes
+ * to its own log in events/, which the other nodes replay. Every file has a single
+ * writer, so no locking is needed. Nodes keep their own data directories; the
+ * directory only carries what the others need to route clients and keep ratings.
+ * Used from the server's thread only.
+ */
+class ClusterDirectory {
+public:
+    static constexpr int HEARTBEAT_INTERVAL_MS = 2000;
+    static constexpr qint64 NODE_TIMEOUT_MS = 10000;  // A node without a heartbeat this long is gone
+    
+    struct NodeInfo {
+        std::string nodeId;
+        std::string host;
+        int port = 0;
+        int players = 0;
+        int games = 0;
+        qint64 heartbeat = 0;  // ms since epoch
+    };
+    
+    ClusterDirectory(const std::string& rootPath, const std::string& nodeId, const std::string& host, int port);
+    
+    bool isOpen() const;
+    const std::string& getNodeId() const;
+    
+    // Write this node's record with its current load and reread everyone else's
+    void heartbeat(int players, int games);
+    
+    // Remove this node's record so the others stop routing to it
+    void leave();
+    
+    // Nodes seen alive at the last heartbeat, this one included, by id
+    const std::vector<NodeInfo>& getLiveNodes() const;
+    
+    // The live node that owns a key by rendezvous hashing, so every node picks the
+    // same one and only the keys of a node that joins or leaves move
+    NodeInfo ownerOf(const std::string& key) const;
+    bool isLocal(const NodeInfo& node) const;
+    
+    // The node hosting a player's game
+    void setSession(const std::string& username, const std::string& gameId);
+    void clearSession(const std::string& username);
+    bool findSession(const std::string& username, NodeInfo& node, std::string& gameId) const;
+    
+    // The owner of key among the other live nodes; false when this node is alone
+    bool pickOtherNode(const std::string& key, NodeInfo& node) const;
+    
+    // Games handed from a node that is shutting down to the node its players go to
+    bool saveHandoff(const std::string& gameId, const QJsonObject& handoff);
+    bool loadHandoff(const std::string& gameId, QJsonObject& handoff) const;
+    void removeHandoff(const std::string& gameId);
+    
+    // Append an event, or several with one write, to this node's log
+    void publish(const QJsonObject& event);
+    void publish(const std::vector<QJsonObject>& events);
+    
+    // Events the other nodes appended since the last call; the first call replays their logs
+    std::vector<QJsonObject> poll();
+
+private:
+    QDir root;
+    std::string nodeId;
+    std::string host;
+    int port;
+    bool open;
+    std::vector<NodeInfo> liveNodes;
+    std::map<QString, qint64> eventOffsets;  // Bytes of each other node's log already read
+    
+    QString nodePath(const std::string& id) const;
+    QString sessionPath(const std::string& username) const;
+    QString eventLogPath(const std::string& id) const;
+    QString handoffPath(const std::string& gameId) const;
+    
+    // File names are percent-encoded, so any username or node id is safe
+    static QString fileName(const std::string& name);
+    static uint64_t rendezvousHash(const std::string& nodeId, const std::string& key);
+};
+
+class MPChessServer;
+
+/**
+ * @brief Socket I/O for the connections owned by one network thread
+ *
+ * Lives in its own QThread. Reads, frames and decodes the input of its sockets and
+ * hands each message to the server's thread, which owns all player and game state.
+ * Writes reach the socket as calls queued on its thread (see runOnSocketThread()).
+ */
+class NetworkWorker : public QObject {
+public:
+    explicit NetworkWorker(MPChessServer* server);
+    
+    // Start serving a socket that was moved to this worker's thread, with any input
+    // already buffered by its previous owner. Runs in this worker's thread
+    void adoptSocket(QTcpSocket* socket, const InboundConnection& pending);
+    
+    // Move one of this worker's sockets, and its partial input, to another worker.
+    // Runs in this worker's thread
+    void transferSocket(QTcpSocket* socket, NetworkWorker* target);
+
+private:
+    MPChessServer* server;
+    QMap<QTcpSocket*, InboundConnection> receiveBuffers;
+    
+    // Decode everything complete and within budget in the socket's buffer and post it
+    // to the server
+    void readSocket(QTcpSocket* socket);
+    
+    // Come back to a throttled socket once its next message has tokens
+    void scheduleRetry(QTcpSocket* socket);
+    
+    // Drop the socket's buffer and let the server clean up after it
+    void handleDisconnected(QTcpSocket* socket);
+};
+
+/**
+ * @brief Fixed set of network threads, each running its own event loop
+ *
+ * New connections are spread round-robin. When a game starts, both players'
+ * sockets move to the worker picked by hashing the game ID, so a game's traffic
+ * stays on one thread.
+ */
+class NetworkWorkerPool {
+public:
+    NetworkWorkerPool(MPChessServer* server, int threadCount);
+    ~NetworkWorkerPool();
+    
+    // Hand a socket just accepted in the server's thread to the next worker
+    void addSocket(QTcpSocket* socket);
+    
+    // Move a socket to the worker that serves the game's shard
+    void assignToGame(QTcpSocket* socket, const std::string& gameId);
+    
+    // The worker running in a thread, or nullptr for a thread outside the pool
+    NetworkWorker* workerForThread(QThread* thread) const;
+    
+    int size() const { return static_cast<int>(workers.size()); }
+
+private:
+    std::vector<QThread*> threads;
+    std::vector<NetworkWorker*> workers;
+    size_t nextWorker;
+};
+
+/**
+ * @brief The kinds of background work, most urgent first
+ */
+enum class WorkLane {
+    BOT_MOVE,        // A bot's search, against its clock
+    RECOMMENDATION,  // Live move recommendations for players
+    ANALYSIS,        // Whole-game analysis; best effort
+    COUNT
+};
+
+/**
+ * @brief Worker threads serving one queue per WorkLane
+ *
+ * A free thread takes a bot move first, then work from its home lane, then steals
+ * from the other lanes. Each lane has a cap on the threads it may hold at once, and
+ * RECOMMENDATION and ANALYSIS together leave at least one thread to bot moves, so a
+ * burst of analysis cannot make a bot wait for a thread. Within a lane, tasks with
+ * the earliest deadline run first, then by priority, then in submission order.
+ */
+class WorkScheduler {
+public:
+    explicit WorkScheduler(int threadCount);
+    ~WorkScheduler();
+
+    // Queue a task; the scheduler owns it from here on and deletes it after it ran
+    // if autoDelete() is set. deadline is in ms since epoch, 0 for none
+    void submit(WorkLane lane, QRunnable* task, qint64 deadline = 0, int priority = 0);
+
+    // Stop the threads once their running tasks return; queued tasks are dropped
+    void shutdown();
+
+    int getThreadCount() const { return static_cast<int>(workers.size()); }
+    size_t getQueueLength(WorkLane lane) const;
+    int getActiveCount(WorkLane lane) const;
+
+private:
+    static constexpr int LANE_COUNT = static_cast<int>(WorkLane::COUNT);
+    static constexpr int BOT_RESERVED_THREADS = 1;
+
+    struct Task {
+        qint64 deadline;  // INT64_MAX for none
+        int priority;
+        quint64 sequence;
+        QRunnable* runnable;
+
+        // Heap order: the task that should run first compares greatest
+        bool operator<(const Task& other) const {
+            if (deadline != other.deadline) return deadline > other.deadline;
+            if (priority != other.priority) return priority < other.priority;
+            return sequence > other.sequence;
+        }
+    };
+
+    struct Lane {
+        std::priority_queue<Task> tasks;
+        int cap = 0;
+        int active = 0;
+    };
+
+    std::array<Lane, LANE_COUNT> lanes;
+    std::vector<std::thread> workers;
+    mutable std::mutex mutex;
+    std::condition_variable workAvailable;
+    quint64 nextSequence;
+    bool stopping;
+
+    void workerLoop(WorkLane home);
+
+    // Whether a thread may take the lane's next task now; called with mutex held
+    bool canRun(int lane) const;
+};
+
+/**
+ * @brief Stop flag shared by a recommendation search and the positions it was started for
+ */
+struct RecommendationJob {
+    std::atomic<bool> cancelled{false};
+    int livePositions = 0;  // Positions still wanted from the search; touched by the server thread only
 };
 
 /**
@@ -1042,13 +3378,30 @@ private:
 class MPChessServer : public QObject {
     Q_OBJECT
     Q_DISABLE_COPY(MPChessServer)
+    
+    friend class NetworkWorker;
 
 public:
-    MPChessServer(QObject* parent = nullptr, const std::string& stockfishPath = "");
+    MPChessServer(QObject* parent = nullptr, const std::string& stockfishPath = "",
+                  const EnginePoolConfig& engineConfig = EnginePoolConfig());
     ~MPChessServer();
 
     static MPChessServer* getInstance() { return mpChessServerInstance; }
 
+    // Serve sockets on this many network threads (0 keeps all I/O in the server's
+    // thread); takes effect on the next start()
+    void setNetworkThreads(int count);
+    
+    // Threads searching bot moves, recommendations and analyses; call before start()
+    void setWorkerThreads(int count);
+    
+    // Threads hashing passwords for logins and registrations, and their work factor
+    void setAuthThreads(int count);
+    void setPasswordKdfCost(int cost);
+    
+    // Serve Prometheus metrics over HTTP on this port (0 disables it); takes effect on the next start()
+    void setMetricsPort(int port);
+    
     // Start the server on the specified port
     bool start(int port);
     
@@ -1060,6 +3413,9 @@ public:
 
     bool isPlayerInGame(ChessPlayer* player) const;
     
+    // Schedule the flag-fall check of a game; called whenever its clock changes hands
+    void scheduleClockDeadline(const std::string& gameId, qint64 deadline);
+    
     // Get the server port
     int getPort() const;
     
@@ -1074,6 +3430,28 @@ public:
     
     // Get server statistics
     QJsonObject getServerStats() const;
+    
+    // Current metrics in the Prometheus text exposition format
+    std::string getMetricsText() const;
+    
+    // Write an opening book from the finished games in the history store
+    bool buildOpeningBook(const std::string& path, int maxPlies);
+    
+    // Run as a node of the cluster sharing rootPath; takes effect on the next start().
+    // Clients are advertised host and the port the server listens on
+    void setClusterDirectory(const std::string& rootPath, const std::string& nodeId, const std::string& host);
+    
+    // Before a planned shutdown: leave the cluster, hand the unfinished games to other
+    // nodes and send their players there. Returns how many games were handed over
+    int drain();
+    
+    // Schedule a Swiss tournament of this many rounds, its first round paired at
+    // startTime (ms since epoch). Players join it with a TOURNAMENT message. Returns its id
+    std::string scheduleTournament(int rounds, TimeControlType timeControl, qint64 startTime);
+    
+    // Encode a message for the wire: a WireProtocol frame (large payloads compressed if
+    // compress is set), or one line of compact JSON
+    static QByteArray encodeMessage(const QJsonObject& message, bool binary, bool compress = false);
 
     void setLogLevel(int level);
     std::unique_ptr<ChessLogger>& getLogger(void) { return logger; }
@@ -1081,9 +3459,10 @@ public:
     // Process a leaderboard request
     void processLeaderboardRequest(QTcpSocket* socket, const QJsonObject& data);
 
-    // Making stockfishConnector & leaderboard public so it can be accessed by other classes
-    std::unique_ptr<StockfishConnector> stockfishConnector;
+    // Making enginePool & leaderboard public so it can be accessed by other classes
+    std::unique_ptr<EnginePool> enginePool;
     std::unique_ptr<ChessLeaderboard> leaderboard;
+    std::unique_ptr<GameHistoryStore> historyStore;
 
 public slots:
     // Handle a new client connection
@@ -1095,6 +3474,7 @@ public slots:
     // Handle client data
     void handleClientData();
     
+    
     // Handle matchmaking timer
     void handleMatchmakingTimer();
     
@@ -1106,6 +3486,9 @@ public slots:
 
     // Handle leaderboard refresh timer
     void handleLeaderboardRefresh();
+    
+    // Send this node's heartbeat and apply the other nodes' events
+    void handleClusterHeartbeat();
 
 private:
     static MPChessServer* mpChessServerInstance; 
@@ -1120,15 +3503,94 @@ private:
     QTimer* matchmakingTimer;
     QTimer* gameTimer;
     QTimer* statusTimer;
+    
+    // Flag-fall deadlines (ms since epoch), earliest first. A move pushes the game's new
+    // deadline and leaves the old entry behind; stale entries are dropped when they surface
+    std::priority_queue<std::pair<qint64, std::string>, std::vector<std::pair<qint64, std::string>>,
+                        std::greater<std::pair<qint64, std::string>>> clockDeadlines;
     QDateTime startTime;
     QTimer* leaderboardTimer;
     
     // Maps to track clients, players, and games
     QMap<QTcpSocket*, ChessPlayer*> socketToPlayer;
     QMap<std::string, ChessPlayer*> usernamesToPlayers;
+    QSet<QTcpSocket*> binaryProtocolSockets;  // Sockets that negotiated WireProtocol frames
+    QSet<QTcpSocket*> stateDeltaSockets;      // Sockets that take GAME_STATE_DELTA after moves
+    QSet<QTcpSocket*> compressionSockets;     // Binary sockets that accept COMPRESSED_CBOR frames
+    QMap<QTcpSocket*, InboundConnection> receiveBuffers;  // Partial input and budgets per connection
     QMap<ChessPlayer*, std::string> playerToGameId;
     std::map<std::string, std::unique_ptr<ChessGame>> activeGames;
     
+    // Finished games stay in activeGames for late requests, then their objects are
+    // retired into gamePool and reused by createGame()
+    static constexpr int FINISHED_GAME_RETENTION_MS = 60 * 1000;
+    static constexpr size_t GAME_POOL_SIZE = 256;
+    std::vector<std::unique_ptr<ChessGame>> gamePool;
+    
+    // Bot players by skill level (1-10); a bot that is not in a game plays the next bot match
+    std::array<std::vector<std::unique_ptr<ChessPlayer>>, 11> botPlayers;
+    
+    // Cluster mode. Matchmaking for a time control and rating band is owned by one
+    // node, and clients are redirected to the node that owns their queue or game
+    static constexpr int MATCHMAKING_RATING_BAND = 200;
+    std::string clusterRoot;
+    std::string clusterNodeId;
+    std::string clusterHost;
+    std::unique_ptr<ClusterDirectory> cluster;
+    QTimer* clusterTimer;
+    std::map<std::string, std::vector<std::string>> clusterSessions;  // Players recorded per game
+    std::unordered_map<std::string, qint64> playerEventTimes;  // Newest player record applied, per username
+    
+    // Resumable sessions. Every login is given a token. A player who drops out of a game
+    // is kept for RECONNECT_GRACE_MS with the game going on, and a client that comes
+    // back with its token skips the password check and is sent only the deltas it missed
+    static constexpr int RECONNECT_GRACE_MS = 30 * 1000;
+    static constexpr qint64 SESSION_TOKEN_LIFETIME_MS = 12LL * 60 * 60 * 1000;
+    struct SessionToken {
+        std::string username;
+        qint64 expires = 0;  // ms since epoch
+    };
+    std::unordered_map<std::string, SessionToken> sessionTokens;
+    std::unordered_map<std::string, std::string> playerSessionTokens;  // Current token per username
+    std::unordered_map<std::string, qint64> reconnectDeadlines;        // Players in their grace period
+    
+    // Replace the player's token with a new one
+    std::string issueSessionToken(const std::string& username);
+    
+    // The player a live token belongs to. A token for a game handed over by another
+    // node is accepted once that game has been taken over here
+    bool checkSessionToken(const std::string& token, const std::string& gameId, std::string& username);
+    
+    // Keep a disconnected player's game going until they return or the grace period ends
+    void holdDisconnectedPlayer(ChessPlayer* player);
+    void expireReconnectGrace(const std::string& username, qint64 deadline);
+    
+    // Send a returning player the deltas after lastSequence, or a snapshot when those are gone
+    void resendGameState(QTcpSocket* socket, ChessPlayer* player, qint64 lastSequence);
+    
+    // Continue a game another node handed over, if token belongs to one of its players
+    bool adoptMigratedGame(const std::string& gameId, const std::string& token);
+    
+    // Send a client to another node; it reconnects there and repeats its login
+    void sendNodeRedirect(QTcpSocket* socket, const ClusterDirectory::NodeInfo& node, const QJsonObject& details);
+    
+    // Tell the other nodes about a player's new record
+    void publishPlayer(const ChessPlayer& player);
+    void publishPlayers(const std::vector<ChessPlayer>& players);
+    void applyClusterEvent(const QJsonObject& event);
+    
+    // Spectators per game; each socket watches at most one game. A spectator whose
+    // send buffer is over SPECTATOR_BACKLOG_LIMIT skips updates and is sent only the
+    // latest snapshot once it drains
+    std::map<std::string, QSet<QTcpSocket*>> gameSpectators;
+    QMap<QTcpSocket*, std::string> spectatorToGameId;
+    QMap<QTcpSocket*, QMetaObject::Connection> spectatorDrainConnections;
+    static constexpr qint64 SPECTATOR_BACKLOG_LIMIT = 256 * 1024;
+    
+    // Network threads; null when all sockets are served from the server's thread
+    int networkThreadCount;
+    std::unique_ptr<NetworkWorkerPool> networkWorkers;
+    
     // Server statistics
     int totalGamesPlayed;
     int totalPlayersRegistered;
@@ -1141,15 +3603,34 @@ private:
     // Send a message to a client
     void sendMessage(QTcpSocket* socket, const QJsonObject& message);
     
+    // Send a message already encoded for this socket's wire format
+    void sendMessage(QTcpSocket* socket, const QByteArray& encoded);
+    
     // Create a new game between two players
     std::string createGame(ChessPlayer* player1, ChessPlayer* player2, TimeControlType timeControl);
     
+    // A game object for the players, reused from gamePool when there is one
+    std::unique_ptr<ChessGame> acquireGame(ChessPlayer* whitePlayer, ChessPlayer* blackPlayer,
+                                           const std::string& gameId, TimeControlType timeControl);
+    
+    // Start an acquired game and register it, without telling the players yet
+    ChessGame* startGame(std::unique_ptr<ChessGame> game);
+    
+    // Send GAME_START and the initial state of started games. Everything for one socket,
+    // after the bytes already in pending, goes out in a single write
+    void announceGames(const std::vector<ChessGame*>& games,
+                       std::unordered_map<QTcpSocket*, QByteArray> pending = {});
+    
     // End a game
     void endGame(const std::string& gameId, GameResult result);
     
-    // Process an authentication request
+    // Process an authentication request; the password is checked in authPool
     void processAuthRequest(QTcpSocket* socket, const QJsonObject& data);
     
+    // Finish a login or registration in the server thread once the credentials are checked
+    void completeAuthRequest(QTcpSocket* socket, const QJsonObject& data, bool authenticated, bool resumed,
+                             const QJsonObject& playerRecord);
+    
     // Process a registration request
     void processRegisterRequest(QTcpSocket* socket, const QJsonObject& data);
     
@@ -1174,18 +3655,90 @@ private:
     // Process a draw response
     void processDrawResponseRequest(QTcpSocket* socket, const QJsonObject& data);
     
-    // Create a bot player
+    // Process a request for a full game state snapshot (client resync)
+    void processGameStateRequest(QTcpSocket* socket, const QJsonObject& data);
+    
+    // Process a request to start or stop watching a game
+    void processSpectateRequest(QTcpSocket* socket, const QJsonObject& data);
+    
+    // Stop a socket watching the game it spectates, if any
+    void removeSpectator(QTcpSocket* socket);
+    
+    // Write a snapshot to a spectator unless its send buffer is over the limit
+    void sendSpectatorSnapshot(QTcpSocket* socket, const QByteArray& encoded);
+    
+    // Send the latest snapshot to a spectator whose buffer has drained
+    void catchUpSpectator(QTcpSocket* socket);
+    
+    // Run a task in the thread that owns the socket: directly if that is this thread,
+    // otherwise queued (and dropped if the socket is deleted first)
+    void runOnSocketThread(QTcpSocket* socket, std::function<void()> task);
+    
+    // Buffer data on the socket and flush once per event-loop pass. Runs in the socket's thread
+    static void writeCoalesced(QTcpSocket* socket, const QByteArray& data);
+    
+    // Process a message decoded by a network worker
+    void handleWorkerMessage(QTcpSocket* socket, const QJsonObject& message);
+    
+    // Forget a disconnected socket and delete it
+    void removeClient(QTcpSocket* socket, const std::string& peerAddress);
+    
+    // Process a socket's input within its budget when there are no network threads,
+    // coming back later if a message has to wait for tokens
+    void readClient(QTcpSocket* socket);
+    
+    // Get an idle bot player of the skill level, creating one if all are playing
     ChessPlayer* createBotPlayer(int skillLevel);
     
+    // Drop a finished game from activeGames and keep its object for reuse
+    void retireGame(const std::string& gameId);
+    
+    // Start the search for a bot whose turn it is on the BOT_MOVE lane; the move is
+    // played by applyBotMove() back in this thread
+    void processBotMove(const std::string& gameId);
+    void applyBotMove(const std::string& gameId, size_t ply, const ChessMove& move, qint64 timeBudget);
+    
+    // Games with a bot search queued or running
+    std::unordered_set<std::string> botSearches;
+    
     // Save game history
     void saveGameHistory(const ChessGame& game);
     
     // Load all game histories
     QJsonArray loadAllGameHistories();
     
-    // Update player ratings after a game
+    // Update player ratings after a game; the players' records are queued for the next batch
     void updatePlayerRatings(ChessGame* game);
     
+    // Player records changed by finished games. The players themselves are updated at
+    // once; their records wait here, one per player, and flushPlayerUpdates() applies
+    // them together: one leaderboard lock, one hand-off to the persistence thread and
+    // one cluster log write per batch
+    static constexpr int PLAYER_UPDATE_BATCH_MS = 250;
+    static constexpr size_t PLAYER_UPDATE_BATCH_LIMIT = 256;
+    std::unordered_map<std::string, ChessPlayer> pendingPlayerUpdates;
+    QTimer* playerUpdateTimer;
+    
+    // Queue a player's current record, flushing at once when the batch is full
+    void queuePlayerUpdate(const ChessPlayer& player);
+    void flushPlayerUpdates();
+    
+    // Tournaments hosted by this node, and the tournament of each of their running games.
+    // A round is paired in one pass, its games acquired before any of them starts, and
+    // every player is sent the round's messages in a single write
+    static constexpr int TOURNAMENT_ROUND_BREAK_MS = 30 * 1000;
+    std::map<std::string, std::unique_ptr<ChessTournament>> tournaments;
+    std::unordered_map<std::string, std::string> tournamentGames;
+    
+    // Pair and start the next round of a tournament, or finish it after the last one
+    void startTournamentRound(const std::string& tournamentId);
+    
+    // Score a finished game if it belongs to a tournament round
+    void recordTournamentGame(const ChessGame& game);
+    
+    // Process a tournament list, status, join or leave request
+    void processTournamentRequest(QTcpSocket* socket, const QJsonObject& data);
+    
     // Clean up resources for a disconnected player
     void cleanupDisconnectedPlayer(ChessPlayer* player);
     
@@ -1201,19 +3754,97 @@ private:
     // Get the path to the logs directory
     std::string getLogsPath() const;
 
-    QThreadPool* threadPool;
-    
-    // Map to track recommendation tasks by game ID
-    QMap<std::string, MoveRecommendationTask*> recommendationTasks;
+    // Bot searches, recommendations and analyses, each on its own lane
+    static constexpr int DEFAULT_WORKER_THREADS = 4;
+    std::unique_ptr<WorkScheduler> workScheduler;
+    
+    // Logins have their own pool, so a burst of them neither waits behind analysis work
+    // nor takes its threads; tasks past AUTH_QUEUE_LIMIT are turned away
+    static constexpr int AUTH_QUEUE_LIMIT = 512;
+    QThreadPool* authPool;
+    quint64 authSerial;
+    struct AuthRequest {
+        quint64 serial;
+        std::shared_ptr<std::atomic<bool>> cancelled;  // Set when replaced or the socket closes
+    };
+    std::unordered_map<QTcpSocket*, AuthRequest> authRequests;  // Current login of each socket
+    int authTasksQueued;  // Tasks in authPool, cancelled ones included, until they report back
+    int authPeakQueueDepth;
+    qint64 authCompleted;
+    qint64 authRejected;
+    qint64 authTotalMs;  // Queue plus hashing time of the completed requests
+    
+    // Queue a task on a lane of workScheduler
+    void startPoolTask(QRunnable* task, WorkLane lane, qint64 deadline = 0, int priority = 0);
+    
+    // HTTP listener answering GET /metrics; null when no metrics port is set
+    static constexpr int METRICS_REQUEST_TIMEOUT_MS = 10000;  // Whole request, headers included
+    int metricsPort;
+    QTcpServer* metricsServer;
+    void handleMetricsConnection();
 
     // Method to generate move recommendations asynchronously
     void generateMoveRecommendationsAsync(const std::string& gameId, ChessPlayer* player);
+    
+    // Send a player the recommendations for their game's current position
+    void sendMoveRecommendations(const std::string& gameId, ChessPlayer* player,
+                                 const std::vector<std::pair<ChessMove, double>>& recommendations);
+    
+    // Recommendations computed on the opponent's time, by the key of the position they
+    // are for, oldest first in speculativeOrder
+    static constexpr int SPECULATIVE_REPLIES = 2;
+    static constexpr size_t SPECULATIVE_CACHE_SIZE = 512;
+    std::unordered_map<uint64_t, std::vector<std::pair<ChessMove, double>>> speculativeRecommendations;
+    std::deque<uint64_t> speculativeOrder;
+    
+    /**
+     * @brief A position whose recommendations are being searched
+     */
+    struct PendingRecommendation {
+        std::shared_ptr<RecommendationJob> job;
+        std::string gameId;  // Game the position was searched for
+        int ply = 0;         // Moves played in that game before the position
+        std::vector<std::pair<std::string, ChessPlayer*>> waiters;  // Players to send the result to
+    };
+    
+    // Every position being searched, speculatively or not, so a request for one joins
+    // the search already running
+    std::unordered_map<uint64_t, PendingRecommendation> pendingRecommendations;
+    
+    // Precompute waitingPlayer's recommendations for the positions after the opponent's
+    // likely replies; with no replies given, the task finds them itself
+    void speculateRecommendations(const std::string& gameId, ChessPlayer* waitingPlayer,
+                                  const std::vector<ChessMove>& replies);
+    void storeSpeculativeRecommendations(uint64_t key, const std::vector<std::pair<ChessMove, double>>& recommendations);
+    
+    // Track a position as being searched by job
+    void addPendingRecommendation(uint64_t key, const std::shared_ptr<RecommendationJob>& job,
+                                  const std::string& gameId, int ply);
+    
+    // Deliver a finished search to the players waiting for its position
+    void finishRecommendation(uint64_t key, const std::shared_ptr<RecommendationJob>& job,
+                              const std::vector<std::pair<ChessMove, double>>& recommendations);
+    
+    // Drop the positions a game has moved past, stopping searches nobody needs any more
+    void retireRecommendations(const std::string& gameId);
+    
+    // Game analyses running on the ANALYSIS lane, with the sockets waiting for each
+    QMap<std::string, QList<QTcpSocket*>> analysisWaiters;
+    
+    // Queue the analysis of a serialized game; later requests for it join the same job
+    void startGameAnalysis(const std::string& gameId, const QJsonObject& gameJson, QTcpSocket* socket);
 
     // Helper method to determine board orientation for a player
     QString getBoardOrientationForPlayer(ChessPlayer* player, const std::string& gameId) const;
 
-    // Helper method to send game state to players with correct orientation
-    void sendGameStateToPlayers(const std::string& gameId);
+    // Helper method to send game state to players with correct orientation; clients
+    // that negotiated deltas get a GAME_STATE_DELTA instead of the full state. With
+    // pending given, the players' bytes are appended there instead of being sent
+    void sendGameStateToPlayers(const std::string& gameId,
+                                std::unordered_map<QTcpSocket*, QByteArray>* pending = nullptr);
+    
+    // Write the game's latest snapshot, encoded once, to every spectator that keeps up
+    void sendGameStateToSpectators(const std::string& gameId);
 
     // Performance monitor timer
     QTimer* performanceTimer;
@@ -1229,8 +3860,9 @@ class MoveRecommendationTask : public QObject, public QRunnable {
     Q_OBJECT
     
 public:
-    MoveRecommendationTask(const ChessBoard& board, PieceColor color, int maxRecommendations, ChessAnalysisEngine* engine)
-        : board(board.clone()), color(color), maxRecommendations(maxRecommendations), engine(engine) {
+    MoveRecommendationTask(const ChessBoard& board, PieceColor color, int maxRecommendations, ChessAnalysisEngine* engine,
+                           std::shared_ptr<RecommendationJob> job)
+        : board(board.clone()), color(color), maxRecommendations(maxRecommendations), engine(engine), job(std::move(job)) {
         setAutoDelete(true);
     }
     
@@ -1244,8 +3876,9 @@ public:
             // Generate recommendations
             std::vector<std::pair<ChessMove, double>> recommendations;
             
-            if (engine) {
-                recommendations = engine->getMoveRecommendations(*board, color, maxRecommendations);
+            // A search whose position is stale by the time it starts is skipped outright
+            if (engine && !job->cancelled.load()) {
+                recommendations = engine->getMoveRecommendations(*board, color, maxRecommendations, &job->cancelled);
             }
             
             if (server && server->getLogger()) {
@@ -1279,6 +3912,218 @@ private:
     PieceColor color;
     int maxRecommendations;
     ChessAnalysisEngine* engine;
+    std::shared_ptr<RecommendationJob> job;
+};
+
+/**
+ * @brief Task for precomputing recommendations while the opponent is thinking
+ *
+ * Plays each likely reply on its own copy of the board and computes the waiting
+ * player's recommendations for the resulting position. Without given replies it
+ * takes the opponent's best few moves from a shallow search.
+ */
+class SpeculativeRecommendationTask : public QObject, public QRunnable {
+    Q_OBJECT
+    
+public:
+    SpeculativeRecommendationTask(const ChessBoard& board, const std::vector<ChessMove>& replies,
+                                  int replyCount, int maxRecommendations, ChessAnalysisEngine* engine,
+                                  std::shared_ptr<RecommendationJob> job)
+        : board(board.clone()), replies(replies), replyCount(replyCount),
+          maxRecommendations(maxRecommendations), engine(engine), job(std::move(job)) {
+        setAutoDelete(true);
+    }
+    
+    void run() override {
+        MPChessServer* server = MPChessServer::getInstance();
+        
+        try {
+            if (replies.empty() && engine && !job->cancelled.load()) {
+                for (const auto& [move, evaluation] : engine->getMoveRecommendations(*board, board->getCurrentTurn(),
+                                                                                   replyCount, &job->cancelled)) {
+                    replies.push_back(move);
+                }
+                
+                // Let the server track the positions found, so they can be joined or cancelled
+                std::vector<uint64_t> keys;
+                ChessBoard::MoveUndo undo;
+                for (const ChessMove& reply : replies) {
+                    board->makeMove(reply, undo);
+                    keys.push_back(board->getZobristKey());
+                    board->unmakeMove(undo);
+                }
+                emit repliesChosen(keys);
+            }
+        } catch (...) {
+            if (server && server->getLogger()) {
+                server->getLogger()->error("SpeculativeRecommendationTask::run() - Exception finding likely replies");
+            }
+            return;
+        }
+        
+        // Every reply gets a result, empty on failure, so nobody waiting on one is left hanging
+        PieceColor waitingColor = board->getCurrentTurn() == PieceColor::WHITE ? PieceColor::BLACK : PieceColor::WHITE;
+        ChessBoard::MoveUndo undo;
+        for (const ChessMove& reply : replies) {
+            board->makeMove(reply, undo);
+            uint64_t key = board->getZobristKey();
+            std::vector<std::pair<ChessMove, double>> recommendations;
+            
+            try {
+                if (engine && !job->cancelled.load() && board->hasLegalMoves(waitingColor)) {
+                    recommendations = engine->getMoveRecommendations(*board, waitingColor, maxRecommendations,
+                                                                     &job->cancelled);
+                }
+            } catch (const std::exception& e) {
+                if (server && server->getLogger()) {
+                    server->getLogger()->error("SpeculativeRecommendationTask::run() - Exception: " + std::string(e.what()));
+                }
+                recommendations.clear();
+            } catch (...) {
+                if (server && server->getLogger()) {
+                    server->getLogger()->error("SpeculativeRecommendationTask::run() - Unknown exception");
+                }
+                recommendations.clear();
+            }
+            
+            board->unmakeMove(undo);
+            emit speculationReady(key, recommendations);
+        }
+    }
+    
+signals:
+    // Keys of the positions after the replies the task picked itself
+    void repliesChosen(const std::vector<uint64_t>& keys);
+    
+    // Empty recommendations if the position could not be worked out or was cancelled
+    void speculationReady(uint64_t key, const std::vector<std::pair<ChessMove, double>>& recommendations);
+    
+private:
+    std::unique_ptr<ChessBoard> board;
+    std::vector<ChessMove> replies;
+    int replyCount;
+    int maxRecommendations;
+    ChessAnalysisEngine* engine;
+    std::shared_ptr<RecommendationJob> job;
+};
+
+/**
+ * @brief Task for analyzing a whole game on the work scheduler
+ *
+ * Works on its own copy of the game, rebuilt from its serialized form, and its own
+ * analysis engine, so nothing it touches is shared with the server thread.
+ */
+class GameAnalysisTask : public QObject, public QRunnable {
+    Q_OBJECT
+    
+public:
+    explicit GameAnalysisTask(const QJsonObject& gameJson) : gameJson(gameJson) {
+        setAutoDelete(true);
+    }
+    
+    void run() override {
+        MPChessServer* server = MPChessServer::getInstance();
+        QJsonObject analysis;
+        
+        try {
+            ChessPlayer whitePlayer(gameJson["whitePlayer"].toString().toStdString());
+            ChessPlayer blackPlayer(gameJson["blackPlayer"].toString().toStdString());
+            std::unique_ptr<ChessGame> game = ChessGame::deserialize(gameJson, &whitePlayer, &blackPlayer);
+            
+            if (game) {
+                // Report only when another step of the work is done
+                int lastStep = -1;
+                ChessAnalysisEngine engine;
+                analysis = engine.analyzeGame(*game, [this, &lastStep](int completed, int total) {
+                    int step = total > 0 ? completed * PROGRESS_STEPS / total : PROGRESS_STEPS;
+                    if (step != lastStep) {
+                        lastStep = step;
+                        emit progress(completed, total);
+                    }
+                });
+            }
+        } catch (const std::exception& e) {
+            if (server && server->getLogger()) {
+                server->getLogger()->error("GameAnalysisTask::run() - Exception: " + std::string(e.what()));
+            }
+            analysis = QJsonObject();
+        } catch (...) {
+            if (server && server->getLogger()) {
+                server->getLogger()->error("GameAnalysisTask::run() - Unknown exception");
+            }
+            analysis = QJsonObject();
+        }
+        
+        emit analysisReady(analysis);
+    }
+    
+signals:
+    void progress(int completed, int total);
+    void analysisReady(const QJsonObject& analysis);  // Empty if the game could not be analyzed
+    
+private:
+    static constexpr int PROGRESS_STEPS = 20;
+    
+    QJsonObject gameJson;
+};
+
+/**
+ * @brief Task for checking credentials in the authentication pool
+ *
+ * Runs the two slow steps of a login, the password key derivation and reading the
+ * player's record, so neither holds up the server thread.
+ */
+class AuthenticationTask : public QObject, public QRunnable {
+    Q_OBJECT
+    
+public:
+    AuthenticationTask(ChessAuthenticator* authenticator, const std::string& username, const std::string& password,
+                       bool registration, std::shared_ptr<std::atomic<bool>> cancelled)
+        : authenticator(authenticator), username(username), password(password), registration(registration),
+          cancelled(std::move(cancelled)) {
+        setAutoDelete(true);
+    }
+    
+    void run() override {
+        bool success = false;
+        QJsonObject playerRecord;
+        
+        // A request replaced by a newer one, or whose socket closed, skips the password hash
+        if (cancelled && cancelled->load()) {
+            emit authenticationReady(false, playerRecord);
+            return;
+        }
+        
+        try {
+            if (registration) {
+                success = authenticator->registerPlayer(username, password);
+            } else if (authenticator->authenticatePlayer(username, password)) {
+                success = true;
+                std::unique_ptr<ChessPlayer> player = authenticator->getPlayer(username);
+                if (player) {
+                    playerRecord = player->toJson();
+                }
+            }
+        } catch (const std::exception& e) {
+            MPChessServer* server = MPChessServer::getInstance();
+            if (server && server->getLogger()) {
+                server->getLogger()->error("AuthenticationTask::run() - Exception: " + std::string(e.what()));
+            }
+            success = false;
+        }
+        
+        emit authenticationReady(success, playerRecord);
+    }
+    
+signals:
+    void authenticationReady(bool success, const QJsonObject& playerRecord);  // Record empty if none was stored
+    
+private:
+    ChessAuthenticator* authenticator;
+    std::string username;
+    std::string password;
+    bool registration;
+    std::shared_ptr<std::atomic<bool>> cancelled;
 };
 
 #endif // MP_CHESS_SERVER_H
\ No newline at end of file
@@ -0,0 +1,303 @@
+// MPChessServerMain.cpp
+//
+// Command line entry point of MPChessServer. Everything else is in the
+// mpchess_server_core library that the tools link as well.
+
+#include "MPChessServer.h"
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_UNIX
+// SIGTERM and SIGINT are turned into a readable byte so the drain runs in the event loop
+static int shutdownSignalPipe[2] = { -1, -1 };
+
+static void handleShutdownSignal(int)
+{
+    char byte = 1;
+    ssize_t written = ::write(shutdownSignalPipe[1], &byte, sizeof(byte));
+    (void)written;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    
+    // Parse command line arguments
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Multiplayer Chess Server");
+    parser.addHelpOption();
+    
+    QCommandLineOption portOption(QStringList() << "p" << "port",
+                                 "Port to listen on (default: 5000)",
+                                 "port", "5000");
+    parser.addOption(portOption);
+    
+    QCommandLineOption stockfishOption(QStringList() << "s" << "stockfish",
+                                     "Path to Stockfish chess engine",
+                                     "path");
+    parser.addOption(stockfishOption);
+    
+    QCommandLineOption stockfishDepthOption(QStringList() << "d" << "depth",
+                                          "Stockfish analysis depth (default: 15)",
+                                          "depth", "15");
+    parser.addOption(stockfishDepthOption);
+    
+    QCommandLineOption stockfishSkillOption(QStringList() << "skill",
+                                          "Stockfish skill level 0-20 (default: 20)",
+                                          "skill", "20");
+    parser.addOption(stockfishSkillOption);
+    
+    QCommandLineOption logLevelOption(QStringList() << "l" << "log-level",
+                                    "Log level (0-3, default: 2)",
+                                    "level", "2");
+    parser.addOption(logLevelOption);
+    
+    QCommandLineOption hashSizeOption(QStringList() << "tt-size",
+                                    "Transposition table size in MB shared by all AI searches (default: 64)",
+                                    "mb", "64");
+    parser.addOption(hashSizeOption);
+    
+    QCommandLineOption searchThreadsOption(QStringList() << "search-threads",
+                                         "Threads one AI search may use (default: a quarter of the cores, at most 4)",
+                                         "threads");
+    parser.addOption(searchThreadsOption);
+    
+    QCommandLineOption networkThreadsOption(QStringList() << "network-threads",
+                                          "Threads serving client sockets, games sharded across them (default: 0, all in the main thread)",
+                                          "threads", "0");
+    parser.addOption(networkThreadsOption);
+    
+    QCommandLineOption workerThreadsOption(QStringList() << "worker-threads",
+                                         "Threads searching bot moves, recommendations and analyses, one kept "
+                                         "free for bots (default: 4, at least 2)",
+                                         "threads", "4");
+    parser.addOption(workerThreadsOption);
+    
+    QCommandLineOption authThreadsOption(QStringList() << "auth-threads",
+                                       "Threads hashing passwords for logins and registrations (default: 2)",
+                                       "threads", "2");
+    parser.addOption(authThreadsOption);
+    
+    QCommandLineOption kdfCostOption(QStringList() << "kdf-cost",
+                                   "scrypt work factor of new password hashes, N = 2^cost (default: 14, 16 MiB each)",
+                                   "cost", "14");
+    parser.addOption(kdfCostOption);
+    
+    QCommandLineOption metricsPortOption(QStringList() << "metrics-port",
+                                       "Serve Prometheus metrics at http://host:port/metrics (default: 0, disabled)",
+                                       "port", "0");
+    parser.addOption(metricsPortOption);
+    
+    QCommandLineOption enginesOption(QStringList() << "engines",
+                                   "Stockfish processes kept running for searches (default: half the cores, at most 8)",
+                                   "count", "0");
+    parser.addOption(enginesOption);
+    
+    QCommandLineOption engineThreadsOption(QStringList() << "engine-threads",
+                                         "Threads each Stockfish process searches with (default: 1)",
+                                         "threads", "1");
+    parser.addOption(engineThreadsOption);
+    
+    QCommandLineOption engineHashOption(QStringList() << "engine-hash",
+                                      "Hash size in MB of each Stockfish process (default: 64)",
+                                      "mb", "64");
+    parser.addOption(engineHashOption);
+    
+    QCommandLineOption bookOption(QStringList() << "book",
+                                "Opening book written by --build-book, used by the AI and recommendations",
+                                "path");
+    parser.addOption(bookOption);
+    
+    QCommandLineOption buildBookOption(QStringList() << "build-book",
+                                     "Build an opening book from the game history, then use it",
+                                     "path");
+    parser.addOption(buildBookOption);
+    
+    QCommandLineOption bookPliesOption(QStringList() << "book-plies",
+                                     "Plies of each game written to a built book (default: 16)",
+                                     "plies", "16");
+    parser.addOption(bookPliesOption);
+    
+    QCommandLineOption syzygyOption(QStringList() << "syzygy",
+                                  "Directories holding Syzygy tablebase files, for bots and analysis",
+                                  "path");
+    parser.addOption(syzygyOption);
+    
+    QCommandLineOption clusterOption(QStringList() << "cluster-dir",
+                                   "Shared directory of the cluster this server joins as a node",
+                                   "path");
+    parser.addOption(clusterOption);
+    
+    QCommandLineOption nodeIdOption(QStringList() << "node-id",
+                                  "Name of this node in the cluster (default: <host>-<port>)",
+                                  "id");
+    parser.addOption(nodeIdOption);
+    
+    QCommandLineOption advertiseOption(QStringList() << "advertise-host",
+                                     "Host name clients redirected to this node connect to (default: local host name)",
+                                     "host");
+    parser.addOption(advertiseOption);
+    
+    QCommandLineOption tournamentOption(QStringList() << "tournament",
+                                      "Schedule a Swiss tournament on this node, as rounds:timecontrol:minutes "
+                                      "from now until round 1, e.g. 5:blitz:30 (may be repeated)",
+                                      "spec");
+    parser.addOption(tournamentOption);
+    
+    parser.process(app);
+    
+    int port = parser.value(portOption).toInt();
+    std::string stockfishPath = parser.value(stockfishOption).toStdString();
+    int logLevel = parser.value(logLevelOption).toInt();
+    
+    // Per-search thread budget; must be set before the server creates its AI instances
+    int searchThreads = std::max(1, std::min(4, QThread::idealThreadCount() / 4));
+    if (parser.isSet(searchThreadsOption)) {
+        searchThreads = parser.value(searchThreadsOption).toInt();
+    }
+    ChessAI::setDefaultSearchThreads(searchThreads);
+    
+    // Stockfish pool settings; the engines are configured as they start
+    EnginePoolConfig engineConfig;
+    engineConfig.engineCount = parser.value(enginesOption).toInt();
+    engineConfig.threadsPerEngine = std::max(1, parser.value(engineThreadsOption).toInt());
+    engineConfig.hashMb = std::max(1, parser.value(engineHashOption).toInt());
+    engineConfig.depth = std::max(1, parser.value(stockfishDepthOption).toInt());
+    engineConfig.skillLevel = std::min(std::max(parser.value(stockfishSkillOption).toInt(), 0), 20);
+    
+    try {
+        // Create and start the server
+        MPChessServer server(nullptr, stockfishPath, engineConfig);
+        
+        // Set log level
+        if (server.getLogger()) {
+            server.getLogger()->setLogLevel(logLevel);
+            server.getLogger()->log("Log level set to " + std::to_string(logLevel), true);
+        }
+        
+        if (server.enginePool) {
+            server.getLogger()->log("Stockfish depth " + std::to_string(engineConfig.depth) +
+                                   ", skill level " + std::to_string(engineConfig.skillLevel), true);
+        }
+        
+        // Size the shared transposition table before any search can start
+        if (parser.isSet(hashSizeOption)) {
+            int hashSize = parser.value(hashSizeOption).toInt();
+            if (hashSize > 0) {
+                ChessAI::getTranspositionTable().resize(static_cast<size_t>(hashSize));
+            }
+        }
+        server.getLogger()->log("Transposition table size set to " + 
+                               std::to_string(ChessAI::getTranspositionTable().getSizeInMB()) + " MB", true);
+        server.getLogger()->log("AI search threads per search set to " + 
+                               std::to_string(ChessAI::getDefaultSearchThreads()), true);
+        
+        // Opening book, built from the finished games first when asked to
+        QString bookPath = parser.value(bookOption);
+        if (parser.isSet(buildBookOption)) {
+            bookPath = parser.value(buildBookOption);
+            int plies = std::max(1, parser.value(bookPliesOption).toInt());
+            if (!server.buildOpeningBook(bookPath.toStdString(), plies)) {
+                server.getLogger()->error("Failed to build opening book " + bookPath.toStdString());
+            }
+        }
+        if (!bookPath.isEmpty()) {
+            auto book = std::make_shared<OpeningBook>(bookPath.toStdString());
+            if (book->isOpen()) {
+                ChessAI::setOpeningBook(book);
+                server.getLogger()->log("Opening book " + bookPath.toStdString() + " loaded with " +
+                                       std::to_string(book->size()) + " entries", true);
+            } else {
+                server.getLogger()->warning("Opening book " + bookPath.toStdString() + " could not be opened");
+            }
+        }
+        
+        // Endgame tablebases; loaded before any search can probe them
+        if (parser.isSet(syzygyOption)) {
+            std::string syzygyPath = parser.value(syzygyOption).toStdString();
+            if (EndgameTablebase::initialize(syzygyPath)) {
+                server.getLogger()->log("Syzygy tablebases loaded for up to " +
+                                       std::to_string(EndgameTablebase::maxPieces()) + " pieces", true);
+            } else {
+                server.getLogger()->warning("No Syzygy tablebases available from " + syzygyPath);
+            }
+        }
+        
+        // Cluster mode; the node joins the shared directory when it starts listening
+        if (parser.isSet(clusterOption)) {
+            QString advertiseHost = parser.isSet(advertiseOption) ? parser.value(advertiseOption)
+                                                                  : QHostInfo::localHostName();
+            server.setClusterDirectory(parser.value(clusterOption).toStdString(),
+                                       parser.value(nodeIdOption).toStdString(), advertiseHost.toStdString());
+        }
+        
+        server.setNetworkThreads(parser.value(networkThreadsOption).toInt());
+        server.setWorkerThreads(parser.value(workerThreadsOption).toInt());
+        server.setAuthThreads(parser.value(authThreadsOption).toInt());
+        server.setPasswordKdfCost(parser.value(kdfCostOption).toInt());
+        server.setMetricsPort(parser.value(metricsPortOption).toInt());
+        
+        if (!server.start(port)) {
+            std::cerr << "Failed to start server on port " << port << std::endl;
+            return 1;
+        }
+        
+        // Tournaments are hosted by the node they are scheduled on
+        for (const QString& spec : parser.values(tournamentOption)) {
+            QStringList fields = spec.split(':');
+            static const QMap<QString, TimeControlType> timeControls = {
+                { "rapid", TimeControlType::RAPID }, { "blitz", TimeControlType::BLITZ },
+                { "bullet", TimeControlType::BULLET }, { "classical", TimeControlType::CLASSICAL },
+                { "casual", TimeControlType::CASUAL }
+            };
+            int rounds = fields.value(0).toInt();
+            int minutes = fields.value(2, "0").toInt();
+            if (fields.size() > 3 || rounds < 1 || minutes < 0 || !timeControls.contains(fields.value(1))) {
+                std::cerr << "Invalid tournament " << spec.toStdString() << ", expected rounds:timecontrol:minutes"
+                          << std::endl;
+                return 1;
+            }
+            std::string tournamentId = server.scheduleTournament(
+                rounds, timeControls.value(fields.value(1)),
+                QDateTime::currentMSecsSinceEpoch() + static_cast<qint64>(minutes) * 60 * 1000);
+            std::cout << "Tournament " << tournamentId << " scheduled in " << minutes << " minute(s)" << std::endl;
+        }
+        
+        std::cout << "Server started on port " << port << std::endl;
+        std::cout << "Press Ctrl+C to quit" << std::endl;
+        
+#ifdef Q_OS_UNIX
+        // In cluster mode the games in progress move to other nodes before the server exits;
+        // the redirects get a moment to go out, and stop() saves the players on the way down
+        if (::pipe(shutdownSignalPipe) == 0) {
+            std::signal(SIGTERM, handleShutdownSignal);
+            std::signal(SIGINT, handleShutdownSignal);
+            
+            QSocketNotifier* shutdownNotifier = new QSocketNotifier(shutdownSignalPipe[0], QSocketNotifier::Read, &app);
+            QObject::connect(shutdownNotifier, &QSocketNotifier::activated, &app, [&server, &app, shutdownNotifier]() {
+                char byte;
+                ssize_t bytesRead = ::read(shutdownSignalPipe[0], &byte, sizeof(byte));
+                (void)bytesRead;
+                shutdownNotifier->setEnabled(false);
+                
+                int migrated = server.drain();
+                if (migrated > 0) {
+                    server.getLogger()->log("Handed " + std::to_string(migrated) + " games over to other nodes");
+                }
+                QTimer::singleShot(migrated > 0 ? 2000 : 0, &app, &QCoreApplication::quit);
+            });
+        }
+#endif
+        
+        return app.exec();
+    } catch (const std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "Unknown fatal error" << std::endl;
+        return 1;
+    }
+}